@@ -0,0 +1,108 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// thread_count 0 uses all available cores
+inline size_t resolve_thread_count(const size_t thread_count) { return thread_count != 0 ? thread_count : std::max<size_t>(std::thread::hardware_concurrency(), 1); }
+
+/* Worker threads which are started once and then run every parallel_for of their owner, so the phases of a compilation
+ * don't pay for starting and joining threads each time. The calling thread works on the indices too, so a pool of
+ * thread_count threads starts thread_count - 1 workers. parallel_for must not be called from inside a job. */
+class ThreadPool {
+  public:
+    explicit ThreadPool(const size_t thread_count) {
+        for (size_t i = 1; i < thread_count; ++i) {
+            workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    [[nodiscard]] size_t thread_count() const { return workers.size() + 1; }
+
+    // calls func for every index in [0, count), the indices are handed out in order. Returns once all calls are done
+    template <typename Func> void parallel_for(const size_t count, Func &&func) {
+        if (workers.empty() || count <= 1) {
+            for (size_t i = 0; i < count; ++i) {
+                func(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = [&func](const size_t idx) { func(idx); };
+            job_count = count;
+            next_idx = 0;
+            busy_workers = workers.size();
+            ++generation;
+        }
+        wake.notify_all();
+        run_job();
+
+        // every worker has to be done with the job before func goes out of scope
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return busy_workers == 0; });
+        job = nullptr;
+    }
+
+  private:
+    void run_job() {
+        for (auto idx = next_idx++; idx < job_count; idx = next_idx++) {
+            job(idx);
+        }
+    }
+
+    void work() {
+        uint64_t seen_generation = 0;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wake.wait(lock, [this, &seen_generation]() { return stopping || generation != seen_generation; });
+            if (stopping) {
+                return;
+            }
+            seen_generation = generation;
+
+            lock.unlock();
+            run_job();
+            lock.lock();
+            if (--busy_workers == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers = {};
+    std::mutex mutex = {};
+    std::condition_variable wake = {};
+    std::condition_variable done = {};
+
+    // the current job, only changed while no worker runs it
+    std::function<void(size_t)> job = nullptr;
+    size_t job_count = 0;
+    std::atomic<size_t> next_idx = 0;
+    size_t busy_workers = 0;
+    // incremented for every job so the workers see that there is a new one
+    uint64_t generation = 0;
+    bool stopping = false;
+};
@@ -437,6 +437,7 @@ enum class AMD64_SYSCALL_ID : uint16_t {
     VHANGUP = 153,
     PIVOT_ROOT = 155,
     PRCTL = 157,
+    ARCH_PRCTL = 158,
     ADJTIMEX = 159,
     SETRLIMIT = 160,
     CHROOT = 161,
@@ -609,3 +610,16 @@ enum class AMD64_SYSCALL_ID : uint16_t {
     SYSCALL_ID_MAX = LANDLOCK_RESTRICT_SELF,
     SYSCALL_ID_INVALID
 };
+
+// ids of the native routines the lifter substitutes for recognised libc functions (lifter option libc_subst). They are
+// the number of a syscall cfop in the IR and placed above all RISC-V syscall ids, the generator turns such a cfop into
+// a direct call of the routine instead of a call to syscall_impl
+enum class LIBC_ROUTINE_ID : uint64_t {
+    MEMCPY = 0x1000,
+    MEMSET,
+    MEMMOVE,
+    STRLEN,
+    STRCMP,
+    MEMCHR,
+    LIBC_ROUTINE_ID_MAX = MEMCHR
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "generator/x86_64/machine_ir.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace generator::x86_64::assembler {
+
+// In-process replacement for piping the generated code through `as`.
+// The generator hands its machine IR blocks to the assembler, which encodes them directly into an ELF64 relocatable
+// object without formatting or parsing any text. Intel syntax is only produced for --asm-out and external assemblers.
+
+// linear combination of symbols plus a constant, e.g. `b5 + 8` or `$ - b5`
+struct Expr {
+    int64_t constant = 0;
+    // (symbol index, coefficient)
+    std::vector<std::pair<uint32_t, int64_t>> terms{};
+
+    [[nodiscard]] bool is_constant() const { return terms.empty(); }
+};
+
+struct Fixup {
+    enum class Kind : uint8_t {
+        ABS,   // absolute value, zero-extended if the field is 32 bits wide
+        ABS_S, // absolute value, sign-extended from 32 bits
+        PCREL, // relative to the end of the instruction, e.g. rip-relative memory operands
+        BRANCH // like PCREL, but calls/jumps to other objects go through the PLT
+    };
+
+    Kind kind;
+    uint8_t size;
+    // distance from the start of the field to the end of the instruction, only used for PC-relative fixups
+    uint8_t pc_bias;
+    // offset inside of the chunk
+    uint32_t offset;
+    // number of the instruction, for error messages
+    size_t inst;
+    Expr expr;
+};
+
+struct Chunk {
+    enum class Kind : uint8_t { DATA, BRANCH, ALIGN, FILL };
+
+    Kind kind = Kind::DATA;
+
+    // DATA
+    std::vector<uint8_t> bytes{};
+    std::vector<Fixup> fixups{};
+
+    // BRANCH: jmp (cond = -1) or jcc which starts out as a short jump and is only widened if the target is out of range
+    int8_t cond = -1;
+    bool is_long = false;
+    size_t inst = 0;
+    Expr target{};
+
+    // ALIGN and FILL
+    uint64_t alignment = 0;
+    uint64_t max_skip = 0;
+    uint64_t count = 0;
+    uint8_t fill = 0;
+    bool nop_fill = false;
+
+    // set during layout
+    uint64_t addr = 0;
+    uint64_t size = 0;
+};
+
+struct Relocation {
+    enum class Target : uint8_t { NONE, SECTION, SYMBOL };
+
+    uint64_t offset;
+    uint32_t type;
+    Target target;
+    uint32_t index;
+    int64_t addend;
+};
+
+struct Section {
+    std::string name;
+    uint32_t type;
+    uint64_t flags;
+    uint64_t alignment = 1;
+    std::vector<Chunk> chunks{};
+
+    // set by Assembler::finish
+    uint64_t size = 0;
+    std::vector<uint8_t> data{};
+    std::vector<Relocation> relocations{};
+};
+
+struct Symbol {
+    enum class Kind : uint8_t { UNDEFINED, LABEL, EQU };
+
+    std::string name;
+    Kind kind = Kind::UNDEFINED;
+    bool global = false;
+    bool weak = false;
+    // numeric local labels and `.L` labels are not written to the symbol table
+    bool temporary = false;
+    uint8_t elf_type = 0;
+
+    // LABEL
+    uint32_t section = 0;
+    uint32_t chunk = 0;
+    uint64_t offset = 0;
+
+    // EQU
+    Expr equ{};
+
+    bool has_size = false;
+    Expr size{};
+};
+
+// encoding of an opcode, see instruction_table
+struct InstDesc;
+
+struct Assembler {
+    std::vector<Section> sections{};
+    std::vector<Symbol> symbols{};
+    std::vector<std::string> errors{};
+
+    Assembler();
+
+    // Encodes the machine instructions and pseudo instructions of a block. fs_statics: the statics are addressed
+    // relative to fs (multithreaded_guest)
+    void assemble(const mir::Block &block, bool fs_statics = false);
+    // Resolves branch sizes and fixups, returns false if there were any errors
+    bool finish();
+    bool write_object(const std::string &path) const;
+
+    [[nodiscard]] const Section *find_section(std::string_view name) const;
+
+  private:
+    struct Operand;
+    struct Inst;
+    struct Resolved;
+
+    std::unordered_map<std::string, uint32_t> symbol_map{};
+    std::unordered_map<std::string, uint32_t> section_map{};
+    std::unordered_map<uint64_t, uint32_t> numeric_labels{};
+    struct SymbolHash {
+        size_t operator()(const mir::Symbol &sym) const;
+    };
+    // symbol indices of machine IR labels, numeric ones aren't cached since they are redefined
+    std::unordered_map<mir::Symbol, uint32_t, SymbolHash> mir_symbols{};
+    // number of the current instruction, counted across blocks
+    size_t inst_nr = 0;
+    uint32_t cur_section = 0;
+
+    void error(const std::string &msg, size_t inst = 0);
+
+    void encode(const InstDesc &desc, std::array<Operand, 3> &ops, const mir::Inst &src);
+    bool convert_operand(const mir::Operand &in, Operand &out, bool fs_statics);
+    // immediate or the address of a label
+    bool convert_value(const mir::Operand &in, Expr &out);
+
+    uint32_t symbol_index(std::string_view name);
+    uint32_t symbol_index(const mir::Symbol &sym);
+    // adds a symbol to an expression, symbols which are set to constants are added as numbers
+    void add_symbol(Expr &expr, uint32_t sym);
+    uint32_t numeric_label(uint64_t num, bool forward);
+    uint32_t here();
+    void define_label(uint32_t sym);
+    [[nodiscard]] bool constant_equ(uint32_t sym, int64_t &value, int depth = 0) const;
+
+    uint32_t switch_section(std::string_view name, const char *flags = nullptr, uint32_t type = 0);
+    Chunk &data_chunk();
+    void append_value(int64_t value, uint8_t size);
+    void emit_data(const Expr &expr, uint8_t size);
+    void emit_align(uint64_t alignment, int64_t fill, uint64_t max_skip);
+    void emit_fill(uint64_t count, uint8_t fill);
+    void emit_branch(int8_t cond, const Expr &target);
+    bool encode_rm(Inst &inst, const Operand &op);
+    void emit(Inst &inst);
+
+    void layout(Section &sec);
+    [[nodiscard]] Resolved resolve(const Expr &expr, int depth = 0) const;
+    [[nodiscard]] uint64_t symbol_addr(const Symbol &sym) const;
+    void apply_fixup(uint32_t sec_idx, uint64_t addr, const Fixup &fixup, uint8_t *field, bool relaxed = false);
+};
+
+} // namespace generator::x86_64::assembler
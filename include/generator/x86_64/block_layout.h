@@ -0,0 +1,33 @@
+#pragma once
+
+#include <ir/ir.h>
+
+namespace generator::x86_64::layout {
+
+// Static code layout for the translated blocks.
+// Since there is no profile available at translation time, blocks are chained greedily along their most likely
+// fall-through edges (a variation of the Pettis-Hansen bottom-up chain formation) and blocks which can only end
+// in an unreachable-panic are split off so they can be moved into a cold section.
+struct BlockLayout {
+    IR *ir;
+
+    // blocks in emission order, without cold blocks
+    std::vector<BasicBlock *> hot_blocks{};
+    std::vector<BasicBlock *> cold_blocks{};
+    // indexed by block id
+    std::vector<bool> loop_headers{};
+
+    explicit BlockLayout(IR *ir) : ir(ir) {}
+
+    void build();
+
+    [[nodiscard]] bool is_loop_header(const BasicBlock *bb) const { return bb->id < loop_headers.size() && loop_headers[bb->id]; }
+
+    // a block is cold if it can never leave to another block without panicking
+    static bool is_cold(const BasicBlock *bb);
+
+  private:
+    void find_loop_headers();
+};
+
+} // namespace generator::x86_64::layout
@@ -1,54 +1,26 @@
 #pragma once
 
+#include "common/parallel.h"
+#include "generator/x86_64/assembler.h"
+#include "generator/x86_64/block_layout.h"
+#include "generator/x86_64/static_liveness.h"
 #include "generator/x86_64/hashing.h"
+#include "generator/x86_64/helper/rv64_syscalls.h"
+#include "generator/x86_64/helper/thread.h"
+#include "generator/x86_64/machine_ir.h"
+#include "generator/x86_64/peephole.h"
+#include "generator/x86_64/rounding.h"
+#include "generator/x86_64/weighted_eviction.h"
 #include "ir/ir.h"
 
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
 namespace generator::x86_64 {
 
 struct Generator;
 
-enum REGISTER : uint32_t {
-    REG_A,
-    REG_B,
-    REG_C,
-    REG_D,
-    REG_DI,
-    REG_SI,
-    REG_8,
-    REG_9,
-    REG_10,
-    REG_11,
-    REG_12,
-    REG_13,
-    REG_14,
-    REG_15,
-
-    REG_COUNT,
-    REG_NONE
-};
-
-enum FP_REGISTER : uint32_t {
-    REG_XMM0,
-    REG_XMM1,
-    REG_XMM2,
-    REG_XMM3,
-    REG_XMM4,
-    REG_XMM5,
-    REG_XMM6,
-    REG_XMM7,
-    REG_XMM8,
-    REG_XMM9,
-    REG_XMM10,
-    REG_XMM11,
-    REG_XMM12,
-    REG_XMM13,
-    REG_XMM14,
-    REG_XMM15,
-
-    FP_REG_COUNT,
-    FP_REG_NONE
-};
-
 // General TODOs:
 // - This needs a sensible way to choose which blocks to compile as a group since otherwise you will end up
 // with the program going through a lot of translation blocks during normal execution since we e.g. compile a call as a jump
@@ -74,82 +46,188 @@ struct RegAlloc {
         RegMap reg_map;
         FPRegMap fp_reg_map;
         StackMap stack_map;
-        std::string assembly;
+        mir::Block assembly;
+        // the assembly starts with the bX_reg_alloc label, which the first block of a group doesn't have
+        bool has_entry_label;
     };
 
-    Generator *gen;
-    // pair: bb_id, asm
-    std::vector<std::pair<size_t, std::string>> translation_blocks;
-    // without cfops
-    std::vector<AssembledBlock> assembled_blocks;
-    char print_buf[512];
-    // need to store produced asm as we don't know the size of the stack frame and need to change it later on
-    std::string asm_buf = {};
-    RegMap *cur_reg_map = nullptr;
-    FPRegMap *cur_fp_reg_map = nullptr;
-    StackMap *cur_stack_map = nullptr;
-    BasicBlock *cur_bb = nullptr;
+    // blocks which are register allocated together, the first one is the top-level block the group is entered through
+    struct Group {
+        std::vector<BasicBlock *> blocks;
+    };
 
-    RegAlloc(Generator *gen) : gen(gen) {}
+    // State of a single group while it is compiled.
+    // Groups only depend on each other through the input maps of their blocks. plan_groups sets up all input maps which don't
+    // depend on the register allocation beforehand, the remaining ones are only set by predecessors in the same group, so
+    // groups can be compiled in parallel as long as their cfops are compiled after the groups they might jump into
+    struct GroupContext {
+        Generator *gen;
+        const RegAlloc *reg_alloc;
+        size_t group_id;
+        size_t max_stack_frame_size = 0;
+        // pair: bb_id, asm
+        std::vector<std::pair<size_t, mir::Block>> translation_blocks = {};
+        // without cfops
+        std::vector<AssembledBlock> assembled_blocks = {};
+        // blocks of later groups which are jumped to through the statics and therefore need a translation block
+        std::vector<BasicBlock *> trans_bb_requests = {};
+        std::vector<const BasicBlock *> unreachable_blocks = {};
+        char print_buf[512];
+        // need to store produced asm as we don't know the size of the stack frame and need to change it later on
+        mir::Block asm_buf = {};
+        // finished assembly of the group, written out in group order
+        mir::Block output = {};
+        RegMap *cur_reg_map = nullptr;
+        FPRegMap *cur_fp_reg_map = nullptr;
+        StackMap *cur_stack_map = nullptr;
+        BasicBlock *cur_bb = nullptr;
+        // OPT_PEEPHOLE, runs over each block once its cfops are known
+        peephole::Peephole peephole;
+        // only set for --regalloc=weighted
+        std::unique_ptr<weighted_eviction::LiveIntervals> live_intervals = nullptr;
+        // statics are only written by cfops, so while compiling the block's body its static inputs can be reloaded
+        // instead of spilled
+        bool remat_statics = false;
+        // x86 addressing mode [base + index * scale + disp] of a folded address computation (OPT_MERGE_OP)
+        struct AddressMode {
+            SSAVar *base = nullptr;
+            SSAVar *index = nullptr;
+            uint8_t scale = 1;
+            int64_t disp = 0;
+        };
+        // set up by fold_addresses for the current block: the addressing mode of loads and stores (keyed by their output
+        // variable) and the variables whose code is generated by a later operation (address parts and loads which are
+        // used as a memory source)
+        std::unordered_map<const SSAVar *, AddressMode> folded_addrs = {};
+        std::unordered_set<const SSAVar *> folded_vars = {};
+        // MXCSR rounding modes at the block boundaries and the mode while the current block is compiled, nullopt after a
+        // dynamic rounding mode has been set from cur_dyn_rm_var
+        rounding::GroupPlan rounding_plan = {};
+        std::optional<RoundingMode> cur_rounding_mode = RoundingMode::NEAREST;
+        const SSAVar *cur_dyn_rm_var = nullptr;
+        // comments only end up in the text output, they aren't formatted if the group is only encoded
+        bool keep_comments;
+
+        GroupContext(Generator *gen, const RegAlloc *reg_alloc, size_t group_id);
+
+        // register allocation of all blocks without their cfops
+        void compile_group();
+        // cfops, needs all groups with a lower id to be compiled
+        void write_group();
+        // needs the cfops of all groups with a lower id to be compiled
+        void write_translation_blocks();
+
+        [[nodiscard]] bool in_group(const BasicBlock *bb) const { return reg_alloc->group_ids[bb->id] == group_id; }
+        [[nodiscard]] bool use_weighted_eviction() const { return live_intervals != nullptr; }
+        [[nodiscard]] bool can_remat_static(const SSAVar *var) const { return remat_statics && live_intervals->home_static(var) != SIZE_MAX; }
+        // the static's memory operand or its register if it is pinned (--pin-regs)
+        [[nodiscard]] mir::Operand static_op(size_t static_idx, Type type = Type::i64) const;
+        [[nodiscard]] bool is_reg_pinned(size_t reg) const;
+
+        void compile_block(BasicBlock *bb, bool first_block);
+        void compile_vars(BasicBlock *bb);
+        void compile_fp_op(SSAVar *var, size_t cur_time);
+        bool merge_op_bin(size_t cur_time, size_t var_idx, REGISTER dst_reg);
+        void fold_addresses(BasicBlock *bb);
+        // folded collects the address computations that become part of the returned addressing mode
+        AddressMode match_address(SSAVar *addr, std::vector<SSAVar *> &folded) const;
+        // loads the registers of the addressing mode
+        mir::Operand address_operand(size_t cur_time, const AddressMode &mode);
+        // also merges a following sign/zero extension of the loaded value
+        void compile_folded_load(size_t cur_time, size_t var_idx, const AddressMode &mode);
+        // sets up MXCSR for the operation, signed fp -> int conversions may instead round in_reg with roundsd/roundss if
+        // use_rounds is set and then return the register holding the rounded value
+        FP_REGISTER compile_rounding_mode(size_t cur_time, const Operation *op, const bool use_rounds = false, const FP_REGISTER in_reg = FP_REG_NONE);
+        // only writes MXCSR if the mode differs from cur_rounding_mode
+        void switch_rounding_mode(RoundingMode mode);
+        void write_rounding_mode(RoundingMode mode);
+        // for jumps to blocks which are entered with another mode than the one bb is left with
+        void write_edge_rounding_mode(const BasicBlock *bb, RoundingMode target_mode);
+        void prepare_cf_ops(BasicBlock *bb);
+        // compare whose result is only used by the block's cjump, it is then compiled with the cjump (OPT_FUSE_BRANCHES)
+        [[nodiscard]] const Operation *fused_compare(const BasicBlock *bb) const;
+        // emits the compare and the jump that skips the cjump
+        void compile_fused_compare(size_t cur_time, const Operation *op, size_t bb_id, size_t cf_idx, bool skip_if_set);
+        // body is the block's assembly without the cfops
+        void compile_cf_ops(BasicBlock *bb, const mir::Block &body, RegMap &reg_map, FPRegMap &fp_reg_map, StackMap &stack_map, size_t max_stack_frame_size, BasicBlock *next_bb);
+        void write_assembled_blocks(size_t max_stack_frame_size);
+
+        void generate_translation_block(BasicBlock *bb);
+        void set_bb_inputs(BasicBlock *target, const std::vector<RefPtr<SSAVar>> &inputs);
+        void write_static_mapping(BasicBlock *bb, size_t cur_time, const std::vector<std::pair<RefPtr<SSAVar>, size_t>> &mapping);
+        // stack_slot_offset is added to the target's stack inputs if its stack frame is smaller than the current one
+        void write_target_inputs(BasicBlock *target, size_t cur_time, const std::vector<RefPtr<SSAVar>> &inputs, size_t stack_slot_offset = 0);
+
+        // register call convention (OPT_CALL_CONV), see call_conv_regs
+        void write_call_conv_regs(size_t cur_time, const std::vector<std::pair<RefPtr<SSAVar>, size_t>> &mapping);
+        void write_call_conv_statics();
+        void write_call_conv_continuation(BasicBlock *cont_block);
+        void init_time_of_use(BasicBlock *bb);
+
+        template <typename... Args> void comment(mir::Block &block, const char *fmt, Args &&...args) {
+            if (!keep_comments) {
+                return;
+            }
+            // NOLINTNEXTLINE(clang-diagnostic-format-security)
+            const auto len = snprintf(print_buf, sizeof(print_buf), fmt, args...);
+            block.comment(std::string_view{print_buf, std::min(static_cast<size_t>(len), sizeof(print_buf) - 1)});
+        }
 
-    void compile_blocks();
-    void compile_block(BasicBlock *bb, bool first_block, size_t &max_stack_frame_size, std::vector<BasicBlock *> &compiled_blocks);
-    void compile_vars(BasicBlock *bb);
-    void compile_fp_op(SSAVar *var, size_t cur_time);
-    bool merge_op_bin(size_t cur_time, size_t var_idx, REGISTER dst_reg);
-    FP_REGISTER compile_rounding_mode(size_t cur_time, const Operation *op, const REGISTER help_reg, const bool use_rounds = false, const FP_REGISTER in_reg = FP_REG_NONE);
-    void prepare_cf_ops(BasicBlock *bb);
-    void compile_cf_ops(BasicBlock *bb, RegMap &reg_map, FPRegMap &fp_reg_map, StackMap &stack_map, size_t max_stack_frame_size, BasicBlock *next_bb, std::vector<BasicBlock *> &compiled_blocks);
-    void write_assembled_blocks(size_t max_stack_frame_size, std::vector<BasicBlock *> &compiled_blocks);
-
-    void generate_translation_block(BasicBlock *bb);
-    void generate_input_map(BasicBlock *bb);
-    void set_bb_inputs_from_static(BasicBlock *target);
-    void set_bb_inputs(BasicBlock *target, const std::vector<RefPtr<SSAVar>> &inputs);
-    void write_static_mapping(BasicBlock *bb, size_t cur_time, const std::vector<std::pair<RefPtr<SSAVar>, size_t>> &mapping);
-    void write_target_inputs(BasicBlock *target, size_t cur_time, const std::vector<RefPtr<SSAVar>> &inputs);
-    void init_time_of_use(BasicBlock *bb);
+        template <typename... Ops> mir::Inst &emit(const mir::Opcode op, const Ops &...ops) { return asm_buf.append(op, ops...); }
 
-    template <typename... Args> void print_asm(const char *fmt, Args &&...args) {
-        // NOLINTNEXTLINE(clang-diagnostic-format-security)
-        snprintf(print_buf, sizeof(print_buf), fmt, args...);
-        asm_buf += print_buf;
-        // nocheckin
-        // fprintf(gen->out_fd, "%s", print_buf);
-    }
+        template <bool evict_imms = true, typename... Args> REGISTER alloc_reg(size_t cur_time, REGISTER only_this_reg = REG_NONE, Args... clear_regs);
+        template <typename... Args> FP_REGISTER alloc_fp_reg(size_t cur_time, FP_REGISTER only_this_reg = FP_REG_NONE, Args... clear_regs);
 
-    template <bool evict_imms = true, typename... Args> REGISTER alloc_reg(size_t cur_time, REGISTER only_this_reg = REG_NONE, Args... clear_regs);
-    template <typename... Args> FP_REGISTER alloc_fp_reg(size_t cur_time, FP_REGISTER only_this_reg = FP_REG_NONE, Args... clear_regs);
+        template <bool evict_imms = true, typename... Args> REGISTER load_val_in_reg(size_t cur_time, SSAVar *var, REGISTER only_this_reg = REG_NONE, Args... clear_regs);
+        template <typename... Args> FP_REGISTER load_val_in_fp_reg(size_t cur_time, SSAVar *var, FP_REGISTER only_this_reg = FP_REG_NONE, Args... clear_regs);
 
-    template <bool evict_imms = true, typename... Args> REGISTER load_val_in_reg(size_t cur_time, SSAVar *var, REGISTER only_this_reg = REG_NONE, Args... clear_regs);
-    template <typename... Args> FP_REGISTER load_val_in_fp_reg(size_t cur_time, SSAVar *var, FP_REGISTER only_this_reg = FP_REG_NONE, Args... clear_regs);
+        // empty reg and do not save the value
+        void clear_reg(size_t cur_time, REGISTER reg, bool imm_to_stack = false);
+        void clear_fp_reg(size_t cur_time, FP_REGISTER reg);
 
-    // empty reg and do not save the value
-    void clear_reg(size_t cur_time, REGISTER reg, bool imm_to_stack = false);
-    void clear_fp_reg(size_t cur_time, FP_REGISTER reg);
+        size_t allocate_stack_slot(SSAVar *var);
+        void save_reg(REGISTER reg, bool imm_to_stack = false);
+        void save_fp_reg(FP_REGISTER reg);
 
-    size_t allocate_stack_slot(SSAVar *var);
-    void save_reg(REGISTER reg, bool imm_to_stack = false);
-    void save_fp_reg(FP_REGISTER reg);
+        void set_var_to_reg(size_t cur_time, SSAVar *var, REGISTER reg) {
+            auto &reg_map = *cur_reg_map;
+            reg_map[reg].cur_var = var;
+            reg_map[reg].alloc_time = cur_time;
+            var->gen_info.location = SSAVar::GeneratorInfoX64::REGISTER;
+            var->gen_info.reg_idx = reg;
+        }
 
-    void set_var_to_reg(size_t cur_time, SSAVar *var, REGISTER reg) {
-        auto &reg_map = *cur_reg_map;
-        reg_map[reg].cur_var = var;
-        reg_map[reg].alloc_time = cur_time;
-        var->gen_info.location = SSAVar::GeneratorInfoX64::REGISTER;
-        var->gen_info.reg_idx = reg;
-    }
+        void set_var_to_fp_reg(size_t cur_time, SSAVar *var, FP_REGISTER fp_reg) {
+            auto &fp_reg_map = *cur_fp_reg_map;
+            fp_reg_map[fp_reg].cur_var = var;
+            fp_reg_map[fp_reg].alloc_time = cur_time;
+            var->gen_info.location = SSAVar::GeneratorInfoX64::FP_REGISTER;
+            var->gen_info.reg_idx = fp_reg;
+        }
 
-    void set_var_to_fp_reg(size_t cur_time, SSAVar *var, FP_REGISTER fp_reg) {
-        auto &fp_reg_map = *cur_fp_reg_map;
-        fp_reg_map[fp_reg].cur_var = var;
-        fp_reg_map[fp_reg].alloc_time = cur_time;
-        var->gen_info.location = SSAVar::GeneratorInfoX64::FP_REGISTER;
-        var->gen_info.reg_idx = fp_reg;
-    }
+        // doesn't save
+        void clear_after_alloc_time(size_t alloc_time);
+    };
+
+    static constexpr size_t NO_GROUP = static_cast<size_t>(-1);
+
+    Generator *gen;
+    std::vector<Group> groups;
+    // indexed by block id
+    std::vector<size_t> group_ids;
+    // (predecessor, cfop index) whose register allocation determines the input map of a block, indexed by block id
+    std::vector<std::pair<const BasicBlock *, size_t>> input_map_owners;
+
+    RegAlloc(Generator *gen) : gen(gen) {}
 
-    // doesn't save
-    void clear_after_alloc_time(size_t alloc_time);
+    void compile_blocks();
+
+    void set_bb_inputs_from_static(BasicBlock *target);
+    static void generate_input_map(BasicBlock *bb);
+
+    // register call convention (OPT_CALL_CONV), see call_conv_regs
+    static bool uses_call_conv(const Generator *gen, const BasicBlock *bb);
+    static void set_call_conv_input_locations(BasicBlock *bb);
 
     // TODO: this thing is only needed because smth in the lifter breaks predecessor/successor lists
     static bool is_block_top_level(BasicBlock *bb);
@@ -167,6 +245,13 @@ struct RegAlloc {
 
         return true;
     }
+
+  private:
+    // splits the blocks into groups in the order in which the serial generator used to compile them
+    void plan_groups();
+    bool setup_group_entry(BasicBlock *bb);
+    void plan_block(BasicBlock *bb);
+    [[nodiscard]] bool is_input_map_planned(const BasicBlock *bb) const { return bb->gen_info.input_map_setup || input_map_owners[bb->id].first != nullptr; }
 };
 
 struct Generator {
@@ -180,8 +265,25 @@ struct Generator {
         OPT_ARCH_FMA3 = 1 << 5,
         OPT_ARCH_SSE4 = 1 << 6,
         OPT_NO_HASH_LOOKUP = 1 << 7,
+        OPT_BLOCK_LAYOUT = 1 << 8,
+        OPT_CALL_CONV = 1 << 9,
+        OPT_STATIC_LIVENESS = 1 << 10,
+        OPT_PEEPHOLE = 1 << 11,
+        OPT_FUSE_BRANCHES = 1 << 12,
+        OPT_INLINE_CACHE = 1 << 13,
+        OPT_JUMP_TABLES = 1 << 14,
+        OPT_INLINE_SYSCALLS = 1 << 15,
+    };
+    enum class RegAllocKind {
+        // evicts the value whose next use is the farthest away, only looks at the current block
+        GREEDY,
+        // evicts by the spill weights of the group's live intervals and rematerializes static inputs
+        WEIGHTED_EVICTION,
     };
 
+    // callee-saved in the SysV ABI so the pinned values survive calls into the helpers
+    static constexpr std::array<REGISTER, 4> pinned_regs = {REG_12, REG_13, REG_14, REG_15};
+
     // Optimization Warnings:
     // OPT_UNUSED_STATIC:
     // this optimization does not allow the swapping of statics to occur in cfops
@@ -191,9 +293,37 @@ struct Generator {
     IR *ir;
     std::vector<std::pair<ErrType, const BasicBlock *>> err_msgs;
     std::string binary_filepath;
+    // Intel syntax output for --asm-out and external assemblers, may be null
     FILE *out_fd;
+    // encodes the generated code directly if set
+    assembler::Assembler *assembler = nullptr;
+    // code of the current block or data, written out by flush()
+    mir::Block output = {};
+    char print_buf[512];
     std::unique_ptr<RegAlloc> reg_alloc = nullptr;
+    std::unique_ptr<layout::BlockLayout> block_layout = nullptr;
+    std::unique_ptr<liveness::StaticLiveness> static_liveness = nullptr;
     uint32_t optimizations = 0;
+    // threads used to compile register allocation groups in parallel, 0 uses all available cores
+    size_t thread_count = 0;
+    // started by compile() with thread_count threads and used by all of its parallel phases
+    std::unique_ptr<ThreadPool> thread_pool = nullptr;
+    // allocator used with OPT_MBRA
+    RegAllocKind reg_alloc_kind = RegAllocKind::GREEDY;
+    // OPT_PEEPHOLE: number of instructions the rules look ahead
+    size_t peephole_window = 8;
+    // OPT_PEEPHOLE: hits per rule summed over all groups
+    peephole::Counters peephole_hits = {};
+    // OPT_MBRA: statics that are kept in pinned_regs in all generated code instead of the register file (--pin-regs).
+    // They are only written back when the interpreter or panic need the register file
+    std::vector<size_t> pinned_statics = {};
+    // --multithreaded: the statics and the return stack state are per thread and addressed relative to fs, see
+    // helper::ThreadControlBlock
+    bool multithreaded_guest = false;
+    // --stats: count the ijump lookups and their misses, mispredicted returns and rounding mode switches in the
+    // translated code, the helper only writes SBT_STATS for binaries translated with it. Disables OPT_INLINE_SYSCALLS
+    // so that all syscalls go through the helper which counts them
+    bool count_stats = false;
     hashing::HashtableBuilder ijump_hasher;
 
     const bool interpreter_only;
@@ -211,29 +341,100 @@ struct Generator {
     }
 
     void compile();
-    void compile_block(const BasicBlock *block);
+    // next_block is the block whose label directly follows this one, the jump to it is omitted
+    void compile_block(const BasicBlock *block, const BasicBlock *next_block = nullptr);
+    // blocks with inputs that aren't statics can't be compiled on their own and get no label
+    static bool is_block_compilable(const BasicBlock *block);
+
+    // lowers the block to out_fd and passes it to the assembler
+    void write(const mir::Block &block);
+    void flush() {
+        write(output);
+        output.clear();
+    }
+
+    template <typename... Ops> mir::Inst &emit(const mir::Opcode op, const Ops &...ops) { return output.append(op, ops...); }
+
+    // comments only end up in the text output, they aren't formatted without one
+    template <typename... Args> void comment(const char *fmt, Args &&...args) {
+        if (out_fd == nullptr) {
+            return;
+        }
+        // NOLINTNEXTLINE(clang-diagnostic-format-security)
+        const auto len = snprintf(print_buf, sizeof(print_buf), fmt, args...);
+        output.comment(std::string_view{print_buf, std::min(static_cast<size_t>(len), sizeof(print_buf) - 1)});
+    }
 
-    static const char *fp_op_size_from_type(const Type type);
+    using Section = mir::Section;
+    void compile_section(Section section) { output.section(section); }
+
+    [[nodiscard]] bool is_loop_header(const BasicBlock *block) const { return block_layout && block_layout->is_loop_header(block); }
+    // whether the value of the static at the entry of the block can still be read, if not the writeback to it can be elided
+    [[nodiscard]] bool is_static_live_in(const BasicBlock *block, const size_t static_idx) const { return !static_liveness || static_liveness->is_live_in(block, static_idx); }
+
+    [[nodiscard]] REGISTER pinned_reg(size_t static_idx) const;
+    [[nodiscard]] bool is_reg_pinned(const REGISTER reg) const {
+        return (optimizations & OPT_MBRA) && reg >= pinned_regs[0] && reg - pinned_regs[0] < std::min(pinned_statics.size(), pinned_regs.size());
+    }
+    // picks the integer statics that are accessed in the most blocks, there is no runtime profile so that is the best guess
+    [[nodiscard]] std::vector<size_t> choose_pinned_statics(size_t count = pinned_regs.size()) const;
+    // jump target for ijumps that couldn't be resolved, syncs the pinned statics around the interpreter
+    [[nodiscard]] mir::Symbol unresolved_ijump_label() const;
+    // where an ijump, icall or mispredicted return jumps to with the guest address in rbx: the site's inline cache or ijump_lookup
+    [[nodiscard]] mir::Symbol ijump_target_label(const BasicBlock *bb, const CfOp &cf_op) const;
+
+    // whether the ijump indexes a translated copy of its jump table, the entry address is in in_vars[1]
+    [[nodiscard]] bool uses_jump_table(const CfOp &cf_op) const {
+        return (optimizations & OPT_JUMP_TABLES) && cf_op.type == CFCInstruction::ijump && std::get<CfOp::IJumpInfo>(cf_op.info).jump_table && cf_op.in_vars[1];
+    }
+    // turns the entry address into the index of the entry, misaligned addresses and ones below the table get out of range
+    void jump_table_index(mir::Block &out, const CfOp &cf_op, REGISTER index_reg, REGISTER entry_addr_reg) const;
+    // jumps through the translated table if the index is in range, otherwise to the regular ijump target
+    void jump_table_dispatch(mir::Block &out, const BasicBlock *bb, const CfOp &cf_op, REGISTER index_reg) const;
+    [[nodiscard]] static mir::Symbol jump_table_label(const BasicBlock *bb, const CfOp &cf_op);
+
+    // the helper's table entry if the syscall number is constant and the syscall is passed through to the kernel unchanged,
+    // it is then issued inline instead of calling syscall_impl
+    [[nodiscard]] const helper::SyscallInfo *inline_syscall_info(const CfOp &cf_op) const;
+    // the helper's native routine if the syscall is a libc function substituted by the lifter, it is called directly
+    // with the arguments following the number instead of going through syscall_impl
+    [[nodiscard]] static const char *libc_routine_symbol(const CfOp &cf_op);
+
+    // segment override of the memory operands of statics and the thread state, "fs:" with multithreaded_guest
+    [[nodiscard]] const char *tcb_prefix() const { return multithreaded_guest ? "fs:" : ""; }
+    // rsp is compared against this before a call pushes onto the return stack
+    [[nodiscard]] mir::Operand ret_stack_limit() const { return multithreaded_guest ? mir::tcb("ret_stack_limit") : mir::mem(mir::named("stack_space"), REG_NONE, REG_NONE, 1, 524288); }
+    // x86 only lets loads pass earlier stores, so only a fence which orders writes before reads needs an mfence
+    [[nodiscard]] static bool fence_needs_barrier(const Operation &op) {
+        return (op.atomic_info.pred & (Operation::AtomicInfo::WRITE | Operation::AtomicInfo::OUTPUT)) && (op.atomic_info.succ & (Operation::AtomicInfo::READ | Operation::AtomicInfo::INPUT));
+    }
 
-    static const char *convert_name_from_type(const Type type);
+    // (guest address, host target) pairs in the inline cache of every indirect jump site, needs to match the helper
+    static constexpr size_t IJUMP_CACHE_ENTRIES = 4;
+    // guest bytes covered by one second level array of the ijump lookup table without hashing, needs to match the helper
+    static constexpr uint64_t IJUMP_LOOKUP_PAGE_SIZE = 4096;
 
   protected:
-    enum class Section { DATA, BSS, TEXT, RODATA };
-    void compile_section(Section section);
 
     void compile_statics();
     void compile_phdr_info();
     void compile_interpreter_only_entry();
     void compile_blocks();
     void compile_entry();
+    void compile_pinned_statics(bool load);
+    void compile_thread_start();
     void compile_err_msgs();
     void compile_ijump_lookup();
+    void compile_ijump_caches();
+    void compile_jump_tables();
 
     void compile_ijump(const BasicBlock *block, const CfOp &op, size_t stack_size);
     void compile_call(const BasicBlock *block, const CfOp &op, size_t stack_size);
     void compile_icall(const BasicBlock *block, const CfOp &op, size_t stack_size);
     void compile_vars(const BasicBlock *block);
-    void compile_rounding_mode(const SSAVar *var);
+    // cur_mode is the rounding mode MXCSR is currently set to
+    void compile_rounding_mode(const Operation *op, RoundingMode &cur_mode);
+    void write_rounding_mode(RoundingMode mode);
     void compile_cf_args(const BasicBlock *block, const CfOp &op, size_t stack_size);
     void compile_ret(const BasicBlock *block, const CfOp &op, size_t stack_size);
     void compile_cjump(const BasicBlock *block, const CfOp &op, size_t cond_idx, size_t stack_size);
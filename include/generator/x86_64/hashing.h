@@ -1,56 +1,60 @@
 #pragma once
 
+#include <common/parallel.h>
+#include <generator/x86_64/machine_ir.h>
 #include <iostream>
 #include <ir/ir.h>
 #include <math.h>
 
 namespace generator::x86_64::hashing {
-struct Hash {
-    uint64_t h0;
-    uint64_t h1;
-    uint64_t h2;
-    uint64_t key;
 
-    Hash(uint64_t h0, uint64_t h1, uint64_t h2, uint64_t key) : h0(h0), h1(h1), h2(h2), key(key){};
-};
-
-struct Bucket {
-    std::vector<Hash> stored_hashes;
-};
-
-// variation of the CHD algorithm described in http://cmph.sourceforge.net/papers/esa09.pdf "Hash, displace, and compress"
+/* Variation of the CHD algorithm described in http://cmph.sourceforge.net/papers/esa09.pdf "Hash, displace, and compress".
+ * All sizes are powers of two so the lookup only needs shifts and a multiplication: the top bits of the hash select a
+ * bucket, the slot of a key is the high part of (hash ^ displacement of the bucket) * SLOT_MULTIPLIER.
+ * The top bits of the bucket number select a partition of the table. Buckets only displace their keys into the
+ * slots of their own partition, so the partitions are placed independently on multiple threads.
+ */
 struct HashtableBuilder {
     uint32_t optimizations{0};
+    // threads used to place the partitions, 0 uses all available cores. Only used without thread_pool
+    size_t thread_count = 0;
+    // pool of the generator the partitions are placed on, build() starts its own if it's not set
+    ThreadPool *thread_pool = nullptr;
 
-    float load_factor = 1.0;
-    size_t bucket_size = 10;
+    // upper bound of keys per slot, the table size is rounded up to a power of two
+    float load_factor = 0.9;
+    // average number of keys per bucket
+    size_t bucket_size = 4;
 
     size_t hash_table_size{};
     size_t bucket_number{};
+    uint64_t bucket_bits{};
+    uint64_t partition_bits{};
+    // slots per partition
+    uint64_t slot_bits{};
+    uint64_t seed = 42;
 
     std::vector<uint64_t> keys{};
-    std::vector<Bucket> buckets{};
-    std::vector<uint16_t> hash_idxs{};
+    std::vector<uint32_t> displacements{};
     std::vector<uint64_t> hash_table{};
 
-    const std::pair<uint64_t, uint64_t> seeds = {42, 0xbeef};
-
-    HashtableBuilder() : hash_table_size(0), bucket_number(0){};
-    HashtableBuilder(HashtableBuilder &){};
-    ~HashtableBuilder(){};
+    // partitions are only split off if each of them gets at least this many keys
+    static constexpr size_t MIN_PARTITION_KEYS = 16384;
+    static constexpr uint64_t MAX_PARTITION_BITS = 6;
+    // displacements tried per bucket before the seed is changed
+    static constexpr uint32_t MAX_DISPLACEMENT = 1 << 20;
+    static constexpr size_t MAX_SEED_ATTEMPTS = 8;
 
-    void fill(std::vector<uint64_t> &keys) {
-        hash_table_size = std::floor(keys.size() / load_factor) + 1;
-        bucket_number = std::floor(keys.size() / bucket_size) + 1;
-        this->keys = keys;
-    }
+    void fill(std::vector<uint64_t> &keys);
 
     bool build();
-    void print_hash_table(FILE *out_fd, IR *ir);
-    void print_hash_func_ids(FILE *out_fd);
-    void print_hash_constants(FILE *out_fd) const;
-    void print_ijump_lookup(FILE *out_fd) const;
-    [[nodiscard]] std::array<uint64_t, 3> spookey_hash(uint64_t key) const;
+    void compile_hash_table(mir::Block &out, IR *ir);
+    void compile_hash_displacements(mir::Block &out) const;
+    void compile_hash_constants(mir::Block &out) const;
+    void compile_ijump_lookup(mir::Block &out, const mir::Symbol &unresolved_label, bool count_stats, bool lock_stats) const;
+
+  private:
+    bool place_buckets(ThreadPool &pool);
 };
 
 } // namespace generator::x86_64::hashing
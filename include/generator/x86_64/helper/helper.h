@@ -30,12 +30,39 @@ struct HashTableTuple {
 };
 
 extern "C" const HashTableTuple ijump_hash_table[];
-extern "C" const uint16_t ijump_hash_function_idxs[];
-extern "C" const size_t ijump_hash_bucket_number;
+extern "C" const uint32_t ijump_hash_displacements[];
 extern "C" const size_t ijump_hash_table_size;
+extern "C" const uint64_t ijump_hash_seed;
+extern "C" const uint64_t ijump_hash_bucket_bits;
+extern "C" const uint64_t ijump_hash_partition_bits;
+extern "C" const uint64_t ijump_hash_slot_bits;
+
+/* Two-level lookup table used instead of the hash table, laid out by Generator::compile_ijump_lookup */
+constexpr uint64_t IJUMP_LOOKUP_PAGE_SIZE = 4096;
 
 size_t calc_target(uint64_t addr);
 
+/* Inline cache of an indirect jump site, laid out by Generator::compile_ijump_caches */
+constexpr size_t IJUMP_CACHE_ENTRIES = 4;
+struct IJumpCache {
+    uint64_t miss_target, lookup_target, misses;
+    HashTableTuple entries[IJUMP_CACHE_ENTRIES];
+};
+
+extern "C" uint64_t ijump_cache_update(uint64_t addr, IJumpCache *cache);
+
+/* Native routines for libc functions substituted by the lifter, the translated code calls them directly with the
+ * arguments of the RISC-V function, see Generator::libc_routine_symbol */
+extern "C" {
+uint64_t libc_memcpy(uint64_t dst, uint64_t src, uint64_t count);
+uint64_t libc_memset(uint64_t dst, uint64_t val, uint64_t count);
+uint64_t libc_memmove(uint64_t dst, uint64_t src, uint64_t count);
+uint64_t libc_strlen(uint64_t str);
+uint64_t libc_strcmp(uint64_t str1, uint64_t str2);
+uint64_t libc_memchr(uint64_t ptr, uint64_t val, uint64_t count);
+}
+
+
 // from https://github.com/aengelke/ria-jit/blob/master/src/runtime/emulateEcall.c
 extern size_t syscall0(AMD64_SYSCALL_ID id);
 extern size_t syscall1(AMD64_SYSCALL_ID id, size_t a1);
@@ -68,6 +95,9 @@ void print_hex64(uint64_t byte);
 namespace interpreter {
 
 void interpreter_dump_perf_stats();
+/* file the entry addresses of unresolved_ijump_handler are appended to at exit, from SBT_IJUMP_HINTS */
+extern const char *ijump_hints_path;
+void interpreter_write_ijump_hints();
 uint32_t evaluate_rounding_mode(uint32_t riscv_rounding_mode, const bool is_rm_field);
 } // namespace interpreter
 
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "frvdec.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace helper::jit {
+
+/* Native code of a hot block of the interpreter, works on the given register_file and returns the guest address to continue at */
+using CompiledBlock = uint64_t (*)(uint64_t *register_file);
+
+} // namespace helper::jit
+
+namespace helper::interpreter {
+
+/* Block cache of the interpreter
+ * Instructions are decoded once per basic block into a static arena, the blocks are found through a direct-mapped
+ * table keyed by their guest address and chained to their successors. Blocks with translated code only cache the
+ * result of calc_target. When the arena is full everything is dropped by starting a new generation, blocks and table
+ * entries of older generations are never followed again.
+ */
+struct DecodedInstr {
+    FrvInst instr;
+    // length in bytes, FRV_UNDEF/FRV_PARTIAL if the instruction couldn't be decoded
+    int len;
+    // label of the instruction's handler in unresolved_ijump_handler, set when it's executed the first time
+    void *handler;
+};
+
+struct DecodedBlock {
+    uint64_t pc;
+    // address after the last instruction
+    uint64_t end_pc;
+    // calc_target(pc), the interpreter leaves for the translated code when it reaches a block which has some
+    uint64_t translated;
+    uint64_t generation;
+    // chained successors, indexed by whether the last instruction of the block jumped
+    DecodedBlock *successors[2];
+    DecodedInstr *instrs;
+    uint32_t instr_count;
+    // times the block has been interpreted, it's compiled when it gets hot
+    uint32_t exec_count;
+    jit::CompiledBlock compiled;
+};
+
+/* Entry addresses of unresolved_ijump_handler with the times they were entered and the guest instructions run from
+ * there on until translated code is reached. Only recorded for SBT_IJUMP_HINTS or SBT_STATS, with open addressing on a
+ * fixed table, addresses which find no free slot within a few probes are dropped.
+ */
+struct EntryStats {
+    uint64_t addr, count, instr_count;
+};
+
+constexpr inline size_t ENTRY_STATS_BITS = 16;
+extern EntryStats entry_stats[1 << ENTRY_STATS_BITS];
+
+extern volatile uint64_t perf_enter_count;
+extern volatile uint64_t perf_instr_count;
+extern volatile uint64_t perf_block_decode_count;
+extern volatile uint64_t perf_block_compile_count;
+
+/* whether a RISC-V fence (the sets in its immediate) needs an mfence, x86 only lets loads pass earlier stores. Like in
+ * the lifter a fence without one of the sets is treated as a full fence. */
+constexpr bool fence_needs_barrier(const int32_t imm) {
+    const auto pred = (imm >> 4) & 0xF;
+    const auto succ = imm & 0xF;
+    // i = 8, o = 4, r = 2, w = 1
+    return pred == 0 || succ == 0 || ((pred & 0x5) && (succ & 0xA));
+}
+
+} // namespace helper::interpreter
+
+namespace helper::jit {
+
+/* executions after which an interpreted block is compiled */
+constexpr inline uint32_t HOT_BLOCK_THRESHOLD = 32;
+
+/* nullptr if the block uses instructions the jit doesn't support or there is no space left for its code */
+CompiledBlock compile_block(const interpreter::DecodedBlock &block);
+
+/* drops all compiled code, done together with the block cache of the interpreter */
+void reset();
+
+} // namespace helper::jit
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "generator/syscall_ids.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/* Counters of the translated code, incremented in the ijump lookup, on mispredicted returns and on rounding mode
+ * switches. The generator only emits the increments with --stats since the lookup is on the path of every ijump.
+ * They are shared by all threads, so with --multithreaded they are incremented with a lock prefix and the helper
+ * increments them atomically, see stats::count. */
+extern "C" {
+/* from compiled code, set if it was translated with --stats */
+extern const bool stats_counted;
+extern uint64_t stats_ijump_lookups;
+extern uint64_t stats_ijump_lookup_misses;
+extern uint64_t stats_ret_mispredicts;
+extern uint64_t stats_rounding_switches;
+}
+
+namespace helper::stats {
+
+/* file the statistics are written to as JSON at exit, from SBT_STATS, nullptr if it is unset */
+extern const char *output_path;
+
+/* SBT_STATS is ignored for binaries that don't count, the numbers of the translated code would all be zero */
+inline bool enabled() { return stats_counted && __atomic_load_n(&output_path, __ATOMIC_ACQUIRE) != nullptr; }
+
+/* increments a counter of the helper, which is only counted with --stats like the ones of the translated code */
+inline void count(uint64_t &counter) {
+    if (stats_counted) {
+        __atomic_fetch_add(&counter, 1, __ATOMIC_RELAXED);
+    }
+}
+
+struct SyscallStats {
+    uint64_t count;
+    // rdtsc cycles spent in syscall_handler
+    uint64_t cycles;
+};
+
+extern SyscallStats syscalls[static_cast<size_t>(RISCV_SYSCALL_ID::SYSCALL_ID_MAX) + 1];
+
+void record_syscall(uint64_t id, uint64_t cycles);
+
+/* writes the statistics once, later calls (e.g. from other exiting threads) do nothing */
+void write();
+
+} // namespace helper::stats
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace helper {
+
+/* number of statics of the generated code, the maximum with floating point support */
+constexpr inline size_t REGISTER_FILE_SIZE = 32 + 1 + 32 + 1;
+
+/* Per thread state of a binary translated with --multithreaded, shared by the generator which addresses it relative to
+ * fs and the helper which sets it up for new threads. The register file is at the start so the statics are at
+ * fs:[8 * idx], the block of the main thread is the register_file of the generated code.
+ */
+struct ThreadControlBlock {
+    uint64_t register_file[REGISTER_FILE_SIZE];
+    // fs:[self] gives the helper a regular pointer to the block
+    ThreadControlBlock *self;
+    // RISC-V stack pointer the entry block starts with, only set for the main thread
+    uint64_t init_stack_ptr;
+    // start of the return stack of the translated code, it's reset to this on mispredicted returns
+    uint64_t init_ret_stack_ptr;
+    // the return stack is reset when it grows below this, 0 for the main thread whose stack is grown by the kernel
+    uint64_t ret_stack_limit;
+    // value loaded by the last load reserved of the thread, a store conditional succeeds if the memory still holds it
+    uint64_t reservation;
+    // next block in the list of blocks of exited threads, which are reused for new threads
+    ThreadControlBlock *next_free;
+};
+
+namespace thread {
+
+extern "C" {
+/* from compiled code */
+extern const bool multithreaded;
+// REGISTER_FILE_SIZE statics, the whole ThreadControlBlock of the main thread with --multithreaded
+extern uint64_t register_file[];
+}
+
+inline ThreadControlBlock *current() {
+    ThreadControlBlock *tcb;
+    __asm__("mov %%fs:%c1, %0" : "=r"(tcb) : "i"(offsetof(ThreadControlBlock, self)));
+    return tcb;
+}
+
+/* register file of the calling thread */
+inline uint64_t *current_register_file() { return multithreaded ? current()->register_file : register_file; }
+
+/* points fs at the block of the main thread, called before any translated code runs */
+void init_main_thread();
+
+/* whether a clone creates a thread which shares the address space but runs on its own stack */
+bool creates_thread(uint64_t flags, uint64_t stack);
+
+/* Callee-saved registers a new thread starts with and the address it returns to, in the order syscall_impl pushes them
+ * and clone_thread pops them (wrappers.S). The helper's frames in between aren't copied to the stack of the thread, so
+ * it can't return through the epilogues which restore them.
+ */
+struct EntryFrame {
+    uint64_t r15, r14, r13, r12, rbx;
+    uint64_t return_address;
+};
+
+/* Create a thread with its own ThreadControlBlock and host stack, the arguments are the ones of the RISC-V clone.
+ * A thread cloned by translated code returns from the syscall_impl call like the caller, with the caller's registers
+ * from entry_frame and on a copy of the caller's stack frames above it. One cloned by the interpreter starts
+ * interpreting at pc.
+ */
+uint64_t clone_translated(uint64_t flags, uint64_t stack, uint64_t parent_tid, uint64_t tls, uint64_t child_tid, const EntryFrame *entry_frame);
+uint64_t clone_interpreted(uint64_t flags, uint64_t stack, uint64_t parent_tid, uint64_t tls, uint64_t child_tid, uint64_t pc);
+
+/* the calling thread exits, returns whether it was the last one */
+bool exit_thread();
+
+/* Ends the calling thread with the exit syscall. The stack and block of a thread created by the helper are reused for
+ * the next one, the thread doesn't touch them anymore once another thread can take them.
+ */
+[[noreturn]] void exit_current(uint64_t status);
+
+/* The interpreter and its block cache and compiled blocks are shared by all threads, only one of them interprets at a
+ * time. Nothing is locked in binaries which aren't translated with --multithreaded.
+ */
+void lock_interpreter();
+void unlock_interpreter();
+
+} // namespace thread
+
+} // namespace helper
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+
+/* Hash used for the ijump lookup, shared by the generator which builds the table and the helper which resolves
+ * addresses at runtime, the lookup stub emitted by the generator computes the same. */
+namespace generator::x86_64::ijump_hash {
+
+// spreads the displaced hash over the slot bits, the slot is taken from the high bits of the product
+constexpr uint64_t SLOT_MULTIPLIER = 0x9e3779b97f4a7c15;
+
+// finalizer of MurmurHash3, the high bits select the bucket and the partition
+inline uint64_t mix(uint64_t key, const uint64_t seed) {
+    key ^= seed;
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccd;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53;
+    key ^= key >> 33;
+    return key;
+}
+
+inline uint64_t bucket(const uint64_t hash, const uint64_t bucket_bits) { return hash >> (64 - bucket_bits); }
+
+// index in the table, the partition is the top bits of the hash so its slots are contiguous
+inline uint64_t slot(const uint64_t hash, const uint32_t displacement, const uint64_t partition_bits, const uint64_t slot_bits) {
+    const uint64_t partition = partition_bits == 0 ? 0 : hash >> (64 - partition_bits);
+    return (partition << slot_bits) | (((hash ^ displacement) * SLOT_MULTIPLIER) >> (64 - slot_bits));
+}
+
+} // namespace generator::x86_64::ijump_hash
@@ -0,0 +1,444 @@
+#pragma once
+
+#include "ir/type.h"
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace generator::x86_64 {
+
+enum REGISTER : uint32_t {
+    REG_A,
+    REG_B,
+    REG_C,
+    REG_D,
+    REG_DI,
+    REG_SI,
+    REG_8,
+    REG_9,
+    REG_10,
+    REG_11,
+    REG_12,
+    REG_13,
+    REG_14,
+    REG_15,
+
+    REG_COUNT,
+    REG_NONE,
+
+    // not allocatable, only used in machine instructions
+    REG_SP,
+    REG_BP,
+    REG_IP,
+};
+
+enum FP_REGISTER : uint32_t {
+    REG_XMM0,
+    REG_XMM1,
+    REG_XMM2,
+    REG_XMM3,
+    REG_XMM4,
+    REG_XMM5,
+    REG_XMM6,
+    REG_XMM7,
+    REG_XMM8,
+    REG_XMM9,
+    REG_XMM10,
+    REG_XMM11,
+    REG_XMM12,
+    REG_XMM13,
+    REG_XMM14,
+    REG_XMM15,
+
+    FP_REG_COUNT,
+    FP_REG_NONE
+};
+
+// 64, 32, 16 and 8 bit names
+extern const std::array<std::array<const char *, 4>, REG_COUNT> reg_names;
+extern const std::array<const char *, FP_REG_COUNT> fp_reg_names;
+
+// Machine instructions produced by the generator.
+// Instructions are only lowered once a block is written out, so they can still be inspected and rewritten after register
+// allocation. A block is encoded directly by assembler::Assembler::assemble and only lowered to Intel syntax text for
+// --asm-out and external assemblers. Labels, comments, sections, symbol attributes and data are pseudo instructions in the
+// same stream.
+namespace mir {
+
+enum class Opcode : uint8_t {
+    NONE,    // removed instruction, lowered to nothing
+    COMMENT, // text in Block::text
+    LABEL,   // ops[0] is the label
+    ALIGN,   // ops[0] is the log2 of the alignment
+    SECTION, // ops[0] is the Section
+    GLOBAL,  // ops[0] is the symbol
+    SET,     // sets the symbol ops[0] to ops[1], an immediate or another symbol
+    TYPE,    // ops[0] is the symbol, ops[1] its SymbolType
+    SIZE,    // size of the symbol ops[0], it ends at the label ops[1] or the current position
+    BYTE,    // data of 1, 4 or 8 bytes, ops[0] is an immediate or the address of a label
+    LONG,
+    QUAD,
+    SPACE,   // ops[0] zero bytes
+    ASCII,   // string in Block::text
+    INCBIN,  // contents of the file whose path is in Block::text
+    MOV,
+    MOVD,
+    MOVQ,
+    MOVZX,
+    MOVSX,
+    MOVSXD,
+    LEA,
+    ADD,
+    SUB,
+    AND,
+    OR,
+    XOR,
+    CMP,
+    TEST,
+    IMUL,
+    MUL,
+    DIV,
+    IDIV,
+    NEG,
+    NOT,
+    INC,
+    SHL,
+    SHR,
+    SAR,
+    ROR,
+    SHLX,
+    SHRX,
+    SARX,
+    CDQ,
+    CQO,
+    XCHG,
+    XADD,
+    CMPXCHG,
+    PUSH,
+    POP,
+    JMP,
+    JCC,
+    CMOVCC,
+    SETCC,
+    CALL,
+    RET,
+    SYSCALL,
+    MFENCE,
+    LDMXCSR,
+    STMXCSR,
+    // scalar floating point, the double precision variant follows the single precision one, see scalar()
+    ADDSS,
+    ADDSD,
+    SUBSS,
+    SUBSD,
+    MULSS,
+    MULSD,
+    DIVSS,
+    DIVSD,
+    MINSS,
+    MINSD,
+    MAXSS,
+    MAXSD,
+    SQRTSS,
+    SQRTSD,
+    COMISS,
+    COMISD,
+    UCOMISS,
+    UCOMISD,
+    ROUNDSS,
+    ROUNDSD,
+    VFMADD213SS,
+    VFMADD213SD,
+    VFMSUB213SS,
+    VFMSUB213SD,
+    VFNMADD213SS,
+    VFNMADD213SD,
+    VFNMSUB213SS,
+    VFNMSUB213SD,
+    CVTSI2SS,
+    CVTSI2SD,
+    CVTSS2SI,
+    CVTSD2SI,
+    CVTTSS2SI,
+    CVTTSD2SI,
+    CVTSS2SD,
+    CVTSD2SS,
+    PXOR,
+};
+
+constexpr size_t OPCODE_COUNT = static_cast<size_t>(Opcode::PXOR) + 1;
+
+// condition codes of JCC, CMOVCC and SETCC in the order of their encoding
+enum class Cond : uint8_t { O, NO, B, AE, E, NE, BE, A, S, NS, P, NP, L, GE, LE, G };
+
+enum class Section : uint8_t { DATA, BSS, TEXT, TEXT_COLD, RODATA, ORIG_BINARY };
+
+enum class SymbolType : uint8_t { OBJECT, FUNC };
+
+// the single precision opcode of a scalar floating point operation or its double precision variant
+constexpr Opcode scalar(const Opcode op, const Type type) { return type == Type::f64 ? static_cast<Opcode>(static_cast<uint8_t>(op) + 1) : op; }
+
+// Labels and other symbols, the name is only formatted when the block is lowered
+struct Symbol {
+    enum class Kind : uint8_t {
+        NAMED,           // name
+        STATIC,          // s<id>
+        BLOCK,           // b<id>
+        REG_ALLOC,       // b<id>_reg_alloc
+        CALL_CONV,       // b<id>_cc
+        CF,              // b<id>_cf<sub>
+        REG_ALLOC_CF,    // b<id>_reg_alloc_cf<sub>
+        UNORDERED,       // b<id>_reg_alloc_cf<sub>_unordered
+        ATOMIC,          // b<id>_<sub>_atomic
+        UMAX,            // b<id>_<sub>_max
+        UMIN,            // b<id>_<sub>_min
+        SMAX,            // b<id>_<sub>_smax
+        SMIN,            // b<id>_<sub>_smin
+        IJUMP_CACHE,     // b<id>_cf<sub>_ic
+        IJUMP_CACHE_DATA, // b<id>_cf<sub>_ic_data
+        IJUMP_CACHE_MISS, // b<id>_cf<sub>_ic_miss
+        JUMP_TABLE,      // b<id>_cf<sub>_jt
+        ERR_UNREACHABLE, // err_unreachable_b<id>
+        LOOKUP_PAGE,     // ijump_lookup_page<id>
+        // numeric label <id>, references go to the next (sub = 1) or the previous (sub = 0) definition
+        LOCAL,
+    };
+
+    Kind kind = Kind::NAMED;
+    uint32_t sub = 0;
+    uint64_t id = 0;
+    const char *name = nullptr;
+
+    [[nodiscard]] bool operator==(const Symbol &other) const { return kind == other.kind && sub == other.sub && id == other.id && name == other.name; }
+    [[nodiscard]] bool operator!=(const Symbol &other) const { return !(*this == other); }
+};
+
+// name has to outlive the instructions, i.e. it should be a string literal
+constexpr Symbol named(const char *name) { return Symbol{Symbol::Kind::NAMED, 0, 0, name}; }
+constexpr Symbol symbol(const Symbol::Kind kind, const uint64_t id, const uint32_t sub = 0) { return Symbol{kind, sub, id, nullptr}; }
+constexpr Symbol local(const uint64_t num, const bool forward = true) { return Symbol{Symbol::Kind::LOCAL, forward ? 1u : 0u, num, nullptr}; }
+
+struct Operand {
+    enum class Kind : uint8_t {
+        NONE,
+        REG,        // reg, width selects the name
+        FP_REG,     // reg
+        IMM,        // val, printed as decimal
+        HEX_IMM,    // val, printed as 64 bit hex
+        MEM,        // [sym + reg + index * scale + val], every part is optional
+        STACK_SLOT, // [rsp + 8 * val]
+        STATIC,     // [s<val>]
+        BINARY,     // [binary + val]
+        LABEL,      // sym, a jump target or data address
+        OFFSET,     // offset sym, the address of sym as an immediate
+    };
+
+    // size prefix of memory operands
+    static constexpr uint8_t NO_PTR = 0xFF;
+
+    Kind kind = Kind::NONE;
+    // REG: column in reg_names, memory kinds: column in reg_names of the access size or NO_PTR
+    uint8_t width = NO_PTR;
+    bool has_disp = false;
+    // MEM: per-thread state, gets the segment override of the statics
+    bool tcb = false;
+    // MEM: 1, 2, 4 or 8
+    uint8_t scale = 1;
+    REGISTER reg = REG_NONE;
+    REGISTER index = REG_NONE;
+    int64_t val = 0;
+    // MEM, LABEL and OFFSET
+    bool has_sym = false;
+    Symbol sym = {};
+
+    [[nodiscard]] bool is_reg() const { return kind == Kind::REG; }
+    [[nodiscard]] bool is_mem() const { return kind == Kind::MEM || kind == Kind::STACK_SLOT || kind == Kind::STATIC || kind == Kind::BINARY; }
+    [[nodiscard]] bool is_imm() const { return kind == Kind::IMM || kind == Kind::HEX_IMM; }
+
+    [[nodiscard]] bool operator==(const Operand &other) const {
+        return kind == other.kind && width == other.width && has_disp == other.has_disp && tcb == other.tcb && scale == other.scale && reg == other.reg && index == other.index &&
+               val == other.val && has_sym == other.has_sym && (!has_sym || sym == other.sym);
+    }
+    [[nodiscard]] bool operator!=(const Operand &other) const { return !(*this == other); }
+};
+
+// reg_names column for an integer type
+constexpr uint8_t width_of(const Type type) {
+    switch (type) {
+    case Type::i32:
+        return 1;
+    case Type::i16:
+        return 2;
+    case Type::i8:
+        return 3;
+    default:
+        return 0;
+    }
+}
+
+constexpr Operand make_operand(const Operand::Kind kind, const int64_t val = 0) {
+    Operand op{};
+    op.kind = kind;
+    op.val = val;
+    return op;
+}
+
+constexpr Operand reg(const REGISTER reg, const Type type = Type::i64) {
+    auto op = make_operand(Operand::Kind::REG);
+    op.width = width_of(type);
+    op.reg = reg;
+    return op;
+}
+
+constexpr Operand fp_reg(const FP_REGISTER reg) {
+    auto op = make_operand(Operand::Kind::FP_REG);
+    op.reg = static_cast<REGISTER>(reg);
+    return op;
+}
+
+constexpr Operand imm(const int64_t val) { return make_operand(Operand::Kind::IMM, val); }
+constexpr Operand hex_imm(const int64_t val) { return make_operand(Operand::Kind::HEX_IMM, val); }
+
+// [base]
+constexpr Operand mem(const REGISTER base) {
+    auto op = make_operand(Operand::Kind::MEM);
+    op.reg = base;
+    return op;
+}
+
+// [base + disp], the displacement is printed even if it is zero
+constexpr Operand mem(const REGISTER base, const int64_t disp) {
+    auto op = make_operand(Operand::Kind::MEM, disp);
+    op.reg = base;
+    op.has_disp = true;
+    return op;
+}
+
+// [base + index]
+constexpr Operand mem(const REGISTER base, const REGISTER index) {
+    auto op = make_operand(Operand::Kind::MEM);
+    op.reg = base;
+    op.index = index;
+    return op;
+}
+
+// [base + index * scale + disp], index may be REG_NONE and the displacement is only printed if it isn't zero
+constexpr Operand mem(const REGISTER base, const REGISTER index, const uint8_t scale, const int64_t disp) {
+    auto op = make_operand(Operand::Kind::MEM, disp);
+    op.reg = base;
+    op.index = index;
+    op.scale = scale;
+    op.has_disp = disp != 0;
+    return op;
+}
+
+// [sym + base + index * scale + disp] ([rip + sym + disp] for REG_IP), the displacement is only printed if it isn't zero
+constexpr Operand mem(const Symbol &sym, const REGISTER base = REG_NONE, const REGISTER index = REG_NONE, const uint8_t scale = 1, const int64_t disp = 0) {
+    auto op = mem(base, index, scale, disp);
+    op.has_sym = true;
+    op.sym = sym;
+    return op;
+}
+
+// [name] in the thread state, e.g. init_stack_ptr
+constexpr Operand tcb(const char *name) {
+    auto op = mem(named(name));
+    op.tcb = true;
+    return op;
+}
+
+constexpr Operand stack_slot(const size_t slot) { return make_operand(Operand::Kind::STACK_SLOT, static_cast<int64_t>(slot)); }
+constexpr Operand static_var(const size_t idx) { return make_operand(Operand::Kind::STATIC, static_cast<int64_t>(idx)); }
+constexpr Operand binary(const int64_t offset) { return make_operand(Operand::Kind::BINARY, offset); }
+
+constexpr Operand stack_ptr() { return reg(REG_SP); }
+
+constexpr Operand label(const Symbol &sym) {
+    auto op = make_operand(Operand::Kind::LABEL);
+    op.has_sym = true;
+    op.sym = sym;
+    return op;
+}
+
+// label of a block
+constexpr Operand block(const size_t id, const Symbol::Kind kind = Symbol::Kind::BLOCK) { return label(symbol(kind, id)); }
+
+constexpr Operand offset(const Symbol &sym) {
+    auto op = label(sym);
+    op.kind = Operand::Kind::OFFSET;
+    return op;
+}
+
+// adds a size prefix (e.g. QWORD PTR) to a memory operand
+constexpr Operand sized(Operand op, const Type type) {
+    op.width = width_of(type);
+    return op;
+}
+
+struct Inst {
+    Opcode op = Opcode::NONE;
+    // JCC, CMOVCC and SETCC
+    Cond cond = Cond::O;
+    bool lock = false;
+    uint8_t op_count = 0;
+    std::array<Operand, 3> ops = {};
+    // COMMENT, ASCII and INCBIN: range in Block::text
+    uint32_t text_off = 0;
+    uint32_t text_len = 0;
+};
+
+struct Block {
+    std::vector<Inst> insts = {};
+    std::string text = {};
+
+    Inst &append(const Opcode op) { return insts.emplace_back(Inst{op, Cond::O, false, 0, {}, 0, 0}); }
+    Inst &append(const Opcode op, const Operand &op1) { return insts.emplace_back(Inst{op, Cond::O, false, 1, {op1, Operand{}, Operand{}}, 0, 0}); }
+    Inst &append(const Opcode op, const Operand &op1, const Operand &op2) { return insts.emplace_back(Inst{op, Cond::O, false, 2, {op1, op2, Operand{}}, 0, 0}); }
+    Inst &append(const Opcode op, const Operand &op1, const Operand &op2, const Operand &op3) { return insts.emplace_back(Inst{op, Cond::O, false, 3, {op1, op2, op3}, 0, 0}); }
+    // JCC, CMOVCC and SETCC
+    template <typename... Ops> Inst &append(const Opcode op, const Cond cond, const Ops &...ops) {
+        auto &inst = append(op, ops...);
+        inst.cond = cond;
+        return inst;
+    }
+    // appends all instructions of another block
+    void append(const Block &other);
+
+    void comment(std::string_view comment) { append_text(Opcode::COMMENT, comment); }
+    void label(const Symbol &sym) { append(Opcode::LABEL, mir::label(sym)); }
+    void align(const uint8_t log2) { append(Opcode::ALIGN, imm(log2)); }
+    void section(const Section section) { append(Opcode::SECTION, imm(static_cast<int64_t>(section))); }
+    void global(const Symbol &sym) { append(Opcode::GLOBAL, mir::label(sym)); }
+    void set(const Symbol &sym, const Operand &value) { append(Opcode::SET, mir::label(sym), value); }
+    void type(const Symbol &sym, const SymbolType type) { append(Opcode::TYPE, mir::label(sym), imm(static_cast<int64_t>(type))); }
+    // the symbol ends at the current position
+    void size(const Symbol &sym) { append(Opcode::SIZE, mir::label(sym)); }
+    void size(const Symbol &sym, const Symbol &end) { append(Opcode::SIZE, mir::label(sym), mir::label(end)); }
+    void space(const size_t bytes) { append(Opcode::SPACE, imm(static_cast<int64_t>(bytes))); }
+    void ascii(std::string_view str) { append_text(Opcode::ASCII, str); }
+    void incbin(std::string_view path) { append_text(Opcode::INCBIN, path); }
+    [[nodiscard]] std::string_view text_of(const Inst &inst) const { return std::string_view{text}.substr(inst.text_off, inst.text_len); }
+
+    [[nodiscard]] bool empty() const { return insts.empty(); }
+    void clear() {
+        insts.clear();
+        text.clear();
+    }
+
+    // appends the Intel syntax text of all instructions, static_segment is the segment override of the statics
+    void lower(std::string &out, const char *static_segment = "") const;
+
+  private:
+    void append_text(Opcode op, std::string_view str);
+};
+
+const char *mnemonic(Opcode op);
+const char *cond_name(Cond cond);
+const char *section_directive(Section section);
+void lower_symbol(std::string &out, const Symbol &sym);
+
+} // namespace mir
+} // namespace generator::x86_64
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "generator/x86_64/machine_ir.h"
+
+#include <array>
+#include <cstddef>
+
+namespace generator::x86_64::peephole {
+
+enum Rule : size_t {
+    SELF_MOVE,       // mov rax, rax
+    REVERSE_MOVE,    // mov rax, rbx; mov rbx, rax
+    DEAD_MOVE,       // register written again before it is read
+    STORE_FORWARD,   // mov [s1], rax; mov rbx, [s1] -> mov rbx, rax
+    RELOAD_FORWARD,  // mov rax, [s1]; mov rbx, [s1] -> mov rbx, rax
+    REDUNDANT_STORE, // mov rax, [s1]; mov [s1], rax
+    DEAD_STORE,      // memory written again before it is read
+    STACK_ADJUST,    // add rsp, 16; sub rsp, 8 -> add rsp, 8
+    REDUNDANT_ZERO,  // xor rax, rax; mov eax, [...] in the default generator
+    RULE_COUNT
+};
+
+constexpr std::array<const char *, RULE_COUNT> rule_names = {"self_move",       "reverse_move", "dead_move",    "store_forward", "reload_forward",
+                                                             "redundant_store", "dead_store",   "stack_adjust", "redundant_zero"};
+
+using Counters = std::array<size_t, RULE_COUNT>;
+
+// Post-allocation peephole optimizer over the machine instructions of a block.
+// Every rule looks at most `window` instructions ahead of the instruction it starts at, comments don't count. Labels,
+// control flow and instructions with implicit operands (e.g. div or syscall) are treated as barriers, so the rules never
+// look across labels.
+struct Peephole {
+    size_t window;
+    Counters hits = {};
+
+    explicit Peephole(const size_t window) : window(window) {}
+
+    void run(mir::Block &block);
+
+  private:
+    bool self_move(mir::Block &block, size_t idx);
+    bool reverse_move(mir::Block &block, size_t idx);
+    bool dead_move(mir::Block &block, size_t idx);
+    bool forward_memory(mir::Block &block, size_t idx);
+    bool stack_adjust(mir::Block &block, size_t idx);
+};
+
+} // namespace generator::x86_64::peephole
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <ir/ir.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace generator::x86_64::rounding {
+
+// What an operation needs from the rounding mode in MXCSR.
+struct Requirement {
+    enum Kind {
+        // the result doesn't depend on MXCSR (exact conversions, cvtt, roundsd)
+        NONE,
+        // a static rounding mode from the instruction's rm field
+        STATIC,
+        // the rounding mode from fcsr, resolved by a helper at runtime
+        DYNAMIC,
+        // arithmetic without an explicit rounding mode, runs with round-to-nearest
+        DEFAULT,
+    };
+    Kind kind = NONE;
+    RoundingMode mode = RoundingMode::NEAREST;
+    const SSAVar *rm_var = nullptr;
+};
+
+// use_rounds: signed fp -> int conversions can round with roundsd/roundss (SSE4.1) instead of switching MXCSR
+Requirement requirement(const Operation *op, bool use_rounds);
+
+// the rounding control bits of MXCSR
+uint32_t mxcsr_bits(RoundingMode mode);
+
+// fp -> int conversions which round towards zero can use cvttsd2si/cvttss2si
+inline bool is_truncating(const Operation *op) { return std::holds_alternative<RoundingMode>(op->rounding_info) && std::get<RoundingMode>(op->rounding_info) == RoundingMode::ZERO; }
+
+// Rounding modes at the boundaries of the blocks of a register allocation group.
+// MXCSR is at round-to-nearest whenever the translated code is entered through a translation block, a call or the
+// interpreter. Blocks connected by jumps agree on a common mode so that e.g. a loop which converts with rdn switches
+// MXCSR once before it's entered instead of twice in every iteration.
+struct GroupPlan {
+    // both indexed by the block's position in the group
+    std::vector<RoundingMode> entry_modes = {};
+    std::vector<RoundingMode> exit_modes = {};
+
+    void build(const std::vector<BasicBlock *> &blocks, bool use_rounds);
+
+    [[nodiscard]] RoundingMode entry_mode(const BasicBlock *bb) const { return lookup(entry_modes, bb); }
+    [[nodiscard]] RoundingMode exit_mode(const BasicBlock *bb) const { return lookup(exit_modes, bb); }
+
+  private:
+    std::unordered_map<size_t, size_t> block_idxs = {};
+
+    [[nodiscard]] RoundingMode lookup(const std::vector<RoundingMode> &modes, const BasicBlock *bb) const {
+        const auto it = block_idxs.find(bb->id);
+        return it == block_idxs.end() ? RoundingMode::NEAREST : modes[it->second];
+    }
+};
+
+} // namespace generator::x86_64::rounding
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <ir/ir.h>
+
+namespace generator::x86_64::liveness {
+
+// Whole-program backwards liveness of the statics at block entry.
+// A static is live at the entry of a block if its current value may still be read by a later block.
+// Edges leaving the translated code (ijumps, icalls, returns and syscalls) could end up anywhere, including the
+// interpreter, so every static is considered live after them.
+struct StaticLiveness {
+    IR *ir;
+
+    // indexed by block id, then by static idx
+    std::vector<std::vector<bool>> live_in{};
+    // statics live at the entry of any successor, indexed like live_in
+    std::vector<std::vector<bool>> live_out{};
+
+    explicit StaticLiveness(IR *ir) : ir(ir) {}
+
+    void build();
+
+    [[nodiscard]] bool is_live_in(const BasicBlock *bb, const size_t static_idx) const {
+        return bb->id >= live_in.size() || static_idx >= live_in[bb->id].size() || live_in[bb->id][static_idx];
+    }
+};
+
+} // namespace generator::x86_64::liveness
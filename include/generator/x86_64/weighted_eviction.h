@@ -0,0 +1,58 @@
+#pragma once
+
+#include <ir/ir.h>
+
+#include <unordered_map>
+#include <vector>
+
+namespace generator::x86_64::weighted_eviction {
+
+// Live intervals of a register allocation group for the weighted eviction of the allocator (--regalloc=weighted).
+// Registers are still assigned while the allocator walks the instructions, the intervals only give the spill weights
+// it picks the value to evict by once it runs out of registers.
+// The blocks of the group are numbered in group order, so every variable gets an interval over the whole region. SSA
+// variables only live inside their block, values crossing a block boundary are passed to a new input variable of the
+// target. The intervals are therefore split at every block boundary, which lets the allocator decide per block whether
+// a value should stay in a register.
+struct Interval {
+    SSAVar *var = nullptr;
+    const BasicBlock *bb = nullptr;
+    // positions in the region, a block's variables and cfops are numbered consecutively
+    size_t start = 0;
+    size_t end = 0;
+    size_t use_count = 0;
+    size_t loop_depth = 0;
+    // spill cost per position: uses weighted by 10^loop_depth divided by the interval's length
+    float weight = 0.f;
+    // immediates are recomputed instead of being spilled
+    bool remat = false;
+    // static the unmodified input can be reloaded from instead of being spilled, SIZE_MAX if there is none
+    size_t home_static = SIZE_MAX;
+};
+
+struct LiveIntervals {
+    const std::vector<BasicBlock *> &blocks;
+    std::vector<Interval> intervals = {};
+    // indexed by the block's position in the group
+    std::vector<size_t> loop_depths = {};
+    std::vector<size_t> block_starts = {};
+
+    explicit LiveIntervals(const std::vector<BasicBlock *> &blocks) : blocks(blocks) {}
+
+    void build();
+
+    [[nodiscard]] size_t loop_depth(const BasicBlock *bb) const;
+    // 0 for variables without an interval, e.g. the ones of blocks outside of the group
+    [[nodiscard]] float spill_weight(const SSAVar *var) const;
+    [[nodiscard]] size_t home_static(const SSAVar *var) const;
+    void set_home_static(const SSAVar *var, size_t static_idx);
+
+  private:
+    // index of each variable's interval
+    std::unordered_map<const SSAVar *, size_t> var_intervals = {};
+
+    void find_loops();
+    void add_block(size_t block_idx);
+};
+
+} // namespace generator::x86_64::weighted_eviction
@@ -36,6 +36,8 @@ struct BasicBlock {
         bool call_cont_block = false;
         bool needs_trans_bb = false;
         size_t max_stack_size = 0;
+        // MXCSR rounding mode the register allocated code of the block expects when it's jumped to
+        RoundingMode entry_rounding_mode = RoundingMode::NEAREST;
 
         struct InputInfo {
             enum LOCATION { STATIC, REGISTER, FP_REGISTER, STACK };
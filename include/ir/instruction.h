@@ -40,8 +40,19 @@ enum class Instruction {
     fnmsub,   // fused negative multiply sub, d = - (a * b) - c
     convert,  // conversion between integer and floating point or between single and double precision (maybe with rounding_mode)
     uconvert, // conversion between unsigned integer and floating point (maybe with rounding_mode)
+    // the atomic operations are kept in place like a store, the kind of operation and the ordering are in atomic_info
+    atomic_rmw,    // dst, addr, val, mem_token: dst = [addr], [addr] = dst op val in one atomic access
+    cas,           // dst, addr, expected, new, mem_token: dst = [addr], [addr] = new if dst == expected in one atomic access
+    load_reserved, // dst, addr, mem_token: load which also saves the loaded value as the reservation of the thread
+    reservation,   // dst: the value saved by the last load_reserved of the thread
+    fence,         // mt_out, mt_in: memory accesses in the ordered sets can't be moved across it
 };
 
+// the operation writes memory or thread state or orders memory accesses, so it is never removed or merged with another one
+constexpr bool has_side_effects(const Instruction instr) {
+    return instr == Instruction::store || instr == Instruction::atomic_rmw || instr == Instruction::cas || instr == Instruction::load_reserved || instr == Instruction::fence;
+}
+
 enum class RoundingMode {
     ZERO,    // Round towards zero
     NEAREST, // Round to nearest (ties to even)
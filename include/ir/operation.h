@@ -21,7 +21,23 @@ struct Operation {
     struct LifterInfo {
         Type in_op_size;
     };
-    LifterInfo lifter_info;
+    LifterInfo lifter_info = {};
+
+    struct AtomicInfo {
+        // bits of the ordered sets of a fence, the same as the ones of the RISC-V fence
+        static constexpr uint8_t INPUT = 8, OUTPUT = 4, READ = 2, WRITE = 1;
+
+        // the operation of an atomic_rmw, store exchanges the value in memory for val
+        Instruction rmw_op = Instruction::store;
+        // aq and rl bits of the RISC-V atomics
+        bool acquire = false;
+        bool release = false;
+        // a fence orders the accesses in the predecessor set before it with the ones in the successor set after it
+        uint8_t pred = 0;
+        uint8_t succ = 0;
+    };
+    // only for atomic_rmw, cas, load_reserved and fence
+    AtomicInfo atomic_info = {};
 
     explicit Operation(const Instruction type) : type(type) {}
 
@@ -66,8 +82,18 @@ struct CfOp {
         std::vector<RefPtr<SSAVar>> target_inputs = {};
     };
 
+    // a switch dispatch through a table of absolute guest addresses in read-only memory
+    struct JumpTable {
+        uint64_t base = 0;
+        size_t entry_size = 0;
+        // the guest address in each entry, 0 if it's not a valid jump target.
+        // the size is the bound of the preceding index check if there is one
+        std::vector<uint64_t> entries{};
+    };
+
     struct IJumpInfo {
         // jump addr is in in_vars[0]
+        // for jump tables the address of the loaded entry is in in_vars[1]
 
         /* new multi-target ijumps */
         std::vector<BasicBlock *> targets{};
@@ -75,6 +101,8 @@ struct CfOp {
 
         // one (same) mapping for all jump targets
         std::vector<std::pair<RefPtr<SSAVar>, size_t>> mapping{};
+
+        std::optional<JumpTable> jump_table{};
     };
 
     struct CJumpInfo {
@@ -2,6 +2,25 @@
 
 #include "ir/ir.h"
 
+#include <optional>
+
 namespace optimizer {
-void const_fold(IR *ir);
-}
+/**
+ * Memory of the translated binary which can never be written to (non-writable PT_LOAD segments).
+ * Loads from constant addresses inside of it can be evaluated at translation time.
+ */
+struct ReadOnlyMemory {
+    struct Segment {
+        uint64_t start;
+        const uint8_t *data;
+        size_t size;
+    };
+
+    std::vector<Segment> segments;
+
+    /** Returns the zero-extended little-endian value of `size` bytes at `addr` if they are all inside of one segment */
+    std::optional<uint64_t> read(uint64_t addr, size_t size) const;
+};
+
+void const_fold(IR *ir, const ReadOnlyMemory *ro_memory = nullptr);
+} // namespace optimizer
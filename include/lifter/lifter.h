@@ -15,7 +15,7 @@ constexpr size_t COUNT_STATIC_FP_VARS = 33;
 
 class Lifter {
   public:
-    enum Optimization : uint32_t { OPT_CALL_RET = 1 << 0 };
+    enum Optimization : uint32_t { OPT_CALL_RET = 1 << 0, OPT_LIBC_SUBST = 1 << 1 };
 
     IR *ir;
     std::vector<bool> needs_bb_start;
@@ -31,6 +31,13 @@ class Lifter {
 
     const uint32_t optimizations;
 
+    // guest addresses the translated binary had to interpret in earlier runs (--ijump-hints), lifted as additional ijump targets
+    std::vector<uint64_t> ijump_hints{};
+
+    // lift the A extension to atomic operations and fences to barriers (--multithreaded). Otherwise they are plain loads
+    // and stores, which are only atomic as long as there is one thread
+    bool multithreaded_guest = false;
+
     explicit Lifter(IR *ir, bool floating_point_support = false, bool interpreter_only = false, uint32_t optimizations = 0)
         : ir(ir), dummy(), floating_point_support(floating_point_support), count_used_static_vars(COUNT_STATIC_VARS + (floating_point_support ? COUNT_STATIC_FP_VARS : 0)),
           interpreter_only(interpreter_only), optimizations(optimizations) {}
@@ -93,7 +100,7 @@ class Lifter {
 
     void lift_slt(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, bool is_unsigned, bool with_immediate);
 
-    void lift_fence(BasicBlock *bb, const RV64Inst &instr, uint64_t ip);
+    void lift_fence(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip);
 
     void lift_auipc(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip);
 
@@ -139,6 +146,10 @@ class Lifter {
     void lift_amo_store_conditional(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, const Type op_size);
     void lift_amo_swap(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, const Type op_size);
     void lift_amo_binary_op(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, const Instruction instruction_type, const Type op_size);
+    // --multithreaded: rmw_op is the operation of the atomic_rmw, store for a swap
+    void lift_amo_atomic(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, const Instruction rmw_op, const Type op_size);
+    // sign extends the result of a 32 bit amo instruction and writes it to rd
+    void write_amo_result(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, SSAVar *result);
 
     // ziscr and ziscr helpers
     void lift_csr_read_write(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, bool with_immediate);
@@ -185,6 +196,7 @@ class Lifter {
     std::vector<std::array<int64_t, 4>> load_input_vars(BasicBlock *bb, Operation *op, std::vector<SSAVar *> &parsed_vars);
     void register_jump_address(BasicBlock *jump_bb, uint64_t jmp_addr, ELF64File *elf_base);
     void process_ijumps(std::vector<CfOp *> &unprocessed_ijumps, ELF64File *elf_base);
+    void process_ijump_hints(const Program *prog);
 
     bool is_jump_table_jump(const BasicBlock *bb, CfOp &cfOp, const RV64Inst &instr, const Program *prog);
 
@@ -230,5 +242,8 @@ class Lifter {
     static bool is_link_reg(size_t reg_idx);
 
     void postprocess(Program *prog);
+
+    // replace recognised libc functions (found by their symbol names) with native routines of the helper library
+    void substitute_libc_routines(const ELF64File *elf_base);
 };
 } // namespace lifter::RV64
@@ -0,0 +1,269 @@
+#include "generator/x86_64/assembler.h"
+#include "generator/x86_64/machine_ir.h"
+
+#include <elf.h>
+#include <gtest/gtest.h>
+
+using namespace generator::x86_64;
+using assembler::Assembler;
+using assembler::Relocation;
+
+namespace {
+
+template <typename... Ops> mir::Inst inst(const mir::Opcode op, const Ops &...ops) {
+    mir::Block block;
+    return block.append(op, ops...);
+}
+
+template <typename... Ops> mir::Inst inst(const mir::Opcode op, const mir::Cond cond, const Ops &...ops) {
+    mir::Block block;
+    return block.append(op, cond, ops...);
+}
+
+mir::Inst locked(mir::Inst inst) {
+    inst.lock = true;
+    return inst;
+}
+
+std::vector<uint8_t> assemble(Assembler &as, const mir::Block &block, const char *section = ".text") {
+    as.assemble(block);
+    EXPECT_TRUE(as.finish());
+    for (const auto &error : as.errors) {
+        ADD_FAILURE() << error;
+    }
+    const auto *sec = as.find_section(section);
+    if (sec == nullptr) {
+        ADD_FAILURE() << "missing section " << section;
+        return {};
+    }
+    return sec->data;
+}
+
+const assembler::Symbol *find_symbol(const Assembler &as, std::string_view name) {
+    for (const auto &sym : as.symbols) {
+        if (sym.name == name) {
+            return &sym;
+        }
+    }
+    return nullptr;
+}
+
+struct EncodingCase {
+    mir::Inst inst;
+    // the lowered instruction which was fed to GNU as
+    const char *text;
+    std::vector<uint8_t> bytes;
+};
+
+} // namespace
+
+// Every instruction is encoded on its own and compared against the encoding GNU as produces for its Intel syntax lowering.
+TEST(Assembler, encodings) {
+    using mir::Opcode;
+    const auto xmm0 = mir::fp_reg(REG_XMM0), xmm1 = mir::fp_reg(REG_XMM1), xmm2 = mir::fp_reg(REG_XMM2);
+
+    const EncodingCase cases[] = {
+        {inst(Opcode::MOV, mir::reg(REG_A), mir::mem(REG_B, REG_C, 8, 16)), "mov rax, [rbx + rcx * 8 + 16]", {0x48, 0x8B, 0x44, 0xCB, 0x10}},
+        {inst(Opcode::MOV, mir::stack_slot(3), mir::reg(REG_9, Type::i32)), "mov [rsp + 8 * 3], r9d", {0x44, 0x89, 0x4C, 0x24, 0x18}},
+        {inst(Opcode::MOV, mir::sized(mir::mem(REG_SI, -8), Type::i8), mir::imm(5)), "mov BYTE PTR [rsi + -8], 5", {0xC6, 0x46, 0xF8, 0x05}},
+        {inst(Opcode::MOV, mir::sized(mir::mem(REG_13), Type::i16), mir::imm(-2)), "mov WORD PTR [r13], -2", {0x66, 0x41, 0xC7, 0x45, 0x00, 0xFE, 0xFF}},
+        {inst(Opcode::MOV, mir::reg(REG_A), mir::imm(2)), "mov rax, 2", {0x48, 0xC7, 0xC0, 0x02, 0x00, 0x00, 0x00}},
+        {inst(Opcode::MOV, mir::reg(REG_D), mir::hex_imm(0xFF51AFD7ED558CCD)), "mov rdx, 0xff51afd7ed558ccd", {0x48, 0xBA, 0xCD, 0x8C, 0x55, 0xED, 0xD7, 0xAF, 0x51, 0xFF}},
+        {inst(Opcode::MOV, mir::reg(REG_C, Type::i8), mir::reg(REG_B, Type::i8)), "mov cl, bl", {0x88, 0xD9}},
+        {inst(Opcode::MOVZX, mir::reg(REG_A, Type::i32), mir::reg(REG_SI, Type::i8)), "movzx eax, sil", {0x40, 0x0F, 0xB6, 0xC6}},
+        {inst(Opcode::MOVSX, mir::reg(REG_A), mir::sized(mir::mem(REG_A), Type::i16)), "movsx rax, WORD PTR [rax]", {0x48, 0x0F, 0xBF, 0x00}},
+        {inst(Opcode::MOVSXD, mir::reg(REG_B), mir::reg(REG_B, Type::i32)), "movsxd rbx, ebx", {0x48, 0x63, 0xDB}},
+        {inst(Opcode::LEA, mir::reg(REG_DI), mir::mem(REG_DI, REG_15)), "lea rdi, [rdi + r15]", {0x4A, 0x8D, 0x3C, 0x3F}},
+        {inst(Opcode::LEA, mir::reg(REG_A), mir::mem(REG_BP, 8)), "lea rax, [rbp + 8]", {0x48, 0x8D, 0x45, 0x08}},
+        {inst(Opcode::ADD, mir::reg(REG_12), mir::imm(127)), "add r12, 127", {0x49, 0x83, 0xC4, 0x7F}},
+        {inst(Opcode::SUB, mir::sized(mir::mem(REG_SP), Type::i32), mir::imm(1000)), "sub DWORD PTR [rsp], 1000", {0x81, 0x2C, 0x24, 0xE8, 0x03, 0x00, 0x00}},
+        {inst(Opcode::AND, mir::sized(mir::mem(REG_SP), Type::i32), mir::hex_imm(0xFFFF1FFF)), "and DWORD PTR [rsp], 0xffff1fff", {0x81, 0x24, 0x24, 0xFF, 0x1F, 0xFF, 0xFF}},
+        {inst(Opcode::OR, mir::reg(REG_A, Type::i16), mir::reg(REG_14, Type::i16)), "or ax, r14w", {0x66, 0x44, 0x09, 0xF0}},
+        {inst(Opcode::XOR, mir::reg(REG_10, Type::i32), mir::reg(REG_10, Type::i32)), "xor r10d, r10d", {0x45, 0x31, 0xD2}},
+        {inst(Opcode::CMP, mir::mem(REG_SP, 8), mir::reg(REG_A)), "cmp [rsp + 8], rax", {0x48, 0x39, 0x44, 0x24, 0x08}},
+        {inst(Opcode::TEST, mir::reg(REG_C, Type::i8), mir::reg(REG_C, Type::i8)), "test cl, cl", {0x84, 0xC9}},
+        {inst(Opcode::IMUL, mir::reg(REG_A), mir::reg(REG_B)), "imul rax, rbx", {0x48, 0x0F, 0xAF, 0xC3}},
+        {inst(Opcode::IMUL, mir::reg(REG_B)), "imul rbx", {0x48, 0xF7, 0xEB}},
+        {inst(Opcode::MUL, mir::reg(REG_B)), "mul rbx", {0x48, 0xF7, 0xE3}},
+        {inst(Opcode::DIV, mir::reg(REG_11)), "div r11", {0x49, 0xF7, 0xF3}},
+        {inst(Opcode::IDIV, mir::reg(REG_9, Type::i32)), "idiv r9d", {0x41, 0xF7, 0xF9}},
+        {inst(Opcode::NEG, mir::reg(REG_8)), "neg r8", {0x49, 0xF7, 0xD8}},
+        {inst(Opcode::NOT, mir::sized(mir::mem(REG_A), Type::i64)), "not QWORD PTR [rax]", {0x48, 0xF7, 0x10}},
+        {inst(Opcode::INC, mir::sized(mir::mem(REG_B), Type::i64)), "inc QWORD PTR [rbx]", {0x48, 0xFF, 0x03}},
+        {inst(Opcode::SHL, mir::reg(REG_A), mir::reg(REG_C, Type::i8)), "shl rax, cl", {0x48, 0xD3, 0xE0}},
+        {inst(Opcode::SHR, mir::reg(REG_A)), "shr rax", {0x48, 0xD1, 0xE8}},
+        {inst(Opcode::SAR, mir::reg(REG_B, Type::i32), mir::imm(31)), "sar ebx, 31", {0xC1, 0xFB, 0x1F}},
+        {inst(Opcode::ROR, mir::reg(REG_14, Type::i16), mir::imm(8)), "ror r14w, 8", {0x66, 0x41, 0xC1, 0xCE, 0x08}},
+        {inst(Opcode::SHLX, mir::reg(REG_9), mir::reg(REG_10), mir::reg(REG_11)), "shlx r9, r10, r11", {0xC4, 0x42, 0xA1, 0xF7, 0xCA}},
+        {inst(Opcode::SARX, mir::reg(REG_A, Type::i32), mir::reg(REG_C, Type::i32), mir::reg(REG_D, Type::i32)), "sarx eax, ecx, edx", {0xC4, 0xE2, 0x6A, 0xF7, 0xC1}},
+        {inst(Opcode::SHRX, mir::reg(REG_A), mir::mem(REG_SI), mir::reg(REG_D)), "shrx rax, [rsi], rdx", {0xC4, 0xE2, 0xEB, 0xF7, 0x06}},
+        {inst(Opcode::CDQ), "cdq", {0x99}},
+        {inst(Opcode::CQO), "cqo", {0x48, 0x99}},
+        {inst(Opcode::XCHG, mir::sized(mir::mem(REG_A), Type::i32), mir::reg(REG_B, Type::i32)), "xchg DWORD PTR [rax], ebx", {0x87, 0x18}},
+        {locked(inst(Opcode::XADD, mir::sized(mir::mem(REG_SP), Type::i16), mir::reg(REG_C, Type::i16))), "lock xadd WORD PTR [rsp], cx", {0x66, 0xF0, 0x0F, 0xC1, 0x0C, 0x24}},
+        {locked(inst(Opcode::CMPXCHG, mir::sized(mir::mem(REG_C), Type::i8), mir::reg(REG_D, Type::i8))), "lock cmpxchg BYTE PTR [rcx], dl", {0xF0, 0x0F, 0xB0, 0x11}},
+        {inst(Opcode::PUSH, mir::reg(REG_A)), "push rax", {0x50}},
+        {inst(Opcode::POP, mir::reg(REG_12)), "pop r12", {0x41, 0x5C}},
+        {inst(Opcode::JMP, mir::reg(REG_C)), "jmp rcx", {0xFF, 0xE1}},
+        {inst(Opcode::JMP, mir::mem(REG_A, 8)), "jmp [rax + 8]", {0xFF, 0x60, 0x08}},
+        {inst(Opcode::CALL, mir::reg(REG_A)), "call rax", {0xFF, 0xD0}},
+        {inst(Opcode::CMOVCC, mir::Cond::GE, mir::reg(REG_A), mir::reg(REG_12)), "cmovge rax, r12", {0x49, 0x0F, 0x4D, 0xC4}},
+        {inst(Opcode::SETCC, mir::Cond::B, mir::reg(REG_SI, Type::i8)), "setb sil", {0x40, 0x0F, 0x92, 0xC6}},
+        {inst(Opcode::RET), "ret", {0xC3}},
+        {inst(Opcode::SYSCALL), "syscall", {0x0F, 0x05}},
+        {inst(Opcode::MFENCE), "mfence", {0x0F, 0xAE, 0xF0}},
+        {inst(Opcode::STMXCSR, mir::mem(REG_SP)), "stmxcsr [rsp]", {0x0F, 0xAE, 0x1C, 0x24}},
+        {inst(Opcode::LDMXCSR, mir::mem(REG_SP, 4)), "ldmxcsr [rsp + 4]", {0x0F, 0xAE, 0x54, 0x24, 0x04}},
+        {inst(Opcode::ADDSD, xmm0, xmm1), "addsd xmm0, xmm1", {0xF2, 0x0F, 0x58, 0xC1}},
+        {inst(Opcode::SUBSS, mir::fp_reg(REG_XMM8), mir::mem(REG_A)), "subss xmm8, [rax]", {0xF3, 0x44, 0x0F, 0x5C, 0x00}},
+        {inst(Opcode::MULSD, xmm0, mir::fp_reg(REG_XMM15)), "mulsd xmm0, xmm15", {0xF2, 0x41, 0x0F, 0x59, 0xC7}},
+        {inst(Opcode::DIVSS, xmm0, xmm1), "divss xmm0, xmm1", {0xF3, 0x0F, 0x5E, 0xC1}},
+        {inst(Opcode::MINSD, xmm2, xmm1), "minsd xmm2, xmm1", {0xF2, 0x0F, 0x5D, 0xD1}},
+        {inst(Opcode::MAXSS, xmm0, xmm1), "maxss xmm0, xmm1", {0xF3, 0x0F, 0x5F, 0xC1}},
+        {inst(Opcode::SQRTSD, xmm0, xmm0), "sqrtsd xmm0, xmm0", {0xF2, 0x0F, 0x51, 0xC0}},
+        {inst(Opcode::COMISD, xmm0, xmm1), "comisd xmm0, xmm1", {0x66, 0x0F, 0x2F, 0xC1}},
+        {inst(Opcode::UCOMISS, xmm2, mir::fp_reg(REG_XMM3)), "ucomiss xmm2, xmm3", {0x0F, 0x2E, 0xD3}},
+        {inst(Opcode::ROUNDSS, xmm1, xmm2, mir::imm(3)), "roundss xmm1, xmm2, 3", {0x66, 0x0F, 0x3A, 0x0A, 0xCA, 0x03}},
+        {inst(Opcode::VFMADD213SD, xmm0, xmm1, xmm2), "vfmadd213sd xmm0, xmm1, xmm2", {0xC4, 0xE2, 0xF1, 0xA9, 0xC2}},
+        {inst(Opcode::VFNMSUB213SS, xmm0, mir::fp_reg(REG_XMM9), mir::fp_reg(REG_XMM15)), "vfnmsub213ss xmm0, xmm9, xmm15", {0xC4, 0xC2, 0x31, 0xAF, 0xC7}},
+        {inst(Opcode::CVTSI2SD, xmm0, mir::reg(REG_A)), "cvtsi2sd xmm0, rax", {0xF2, 0x48, 0x0F, 0x2A, 0xC0}},
+        {inst(Opcode::CVTSI2SS, xmm1, mir::reg(REG_A, Type::i32)), "cvtsi2ss xmm1, eax", {0xF3, 0x0F, 0x2A, 0xC8}},
+        {inst(Opcode::CVTSS2SI, mir::reg(REG_A), xmm0), "cvtss2si rax, xmm0", {0xF3, 0x48, 0x0F, 0x2D, 0xC0}},
+        {inst(Opcode::CVTTSD2SI, mir::reg(REG_D, Type::i32), mir::fp_reg(REG_XMM3)), "cvttsd2si edx, xmm3", {0xF2, 0x0F, 0x2C, 0xD3}},
+        {inst(Opcode::CVTSS2SD, xmm0, xmm0), "cvtss2sd xmm0, xmm0", {0xF3, 0x0F, 0x5A, 0xC0}},
+        {inst(Opcode::CVTSD2SS, xmm0, xmm1), "cvtsd2ss xmm0, xmm1", {0xF2, 0x0F, 0x5A, 0xC1}},
+        {inst(Opcode::PXOR, xmm0, mir::fp_reg(REG_XMM3)), "pxor xmm0, xmm3", {0x66, 0x0F, 0xEF, 0xC3}},
+        {inst(Opcode::MOVD, xmm0, mir::reg(REG_A, Type::i32)), "movd xmm0, eax", {0x66, 0x0F, 0x6E, 0xC0}},
+        {inst(Opcode::MOVQ, mir::reg(REG_A), xmm0), "movq rax, xmm0", {0x66, 0x48, 0x0F, 0x7E, 0xC0}},
+        {inst(Opcode::MOVQ, xmm0, mir::stack_slot(2)), "movq xmm0, [rsp + 8 * 2]", {0xF3, 0x0F, 0x7E, 0x44, 0x24, 0x10}},
+        {inst(Opcode::MOVD, mir::stack_slot(1), xmm0), "movd [rsp + 8 * 1], xmm0", {0x66, 0x0F, 0x7E, 0x44, 0x24, 0x08}},
+        {inst(Opcode::MOVQ, mir::fp_reg(REG_XMM9), mir::mem(REG_C)), "movq xmm9, [rcx]", {0xF3, 0x44, 0x0F, 0x7E, 0x09}},
+    };
+
+    for (const auto &test : cases) {
+        mir::Block block;
+        block.insts.push_back(test.inst);
+
+        std::string text;
+        block.lower(text);
+        EXPECT_EQ(text, std::string{test.text} + '\n');
+
+        Assembler as;
+        EXPECT_EQ(assemble(as, block), test.bytes) << test.text;
+    }
+}
+
+TEST(Assembler, branch_relaxation) {
+    mir::Block block;
+    block.label(mir::local(1));
+    block.append(mir::Opcode::JMP, mir::label(mir::local(2)));
+    block.append(mir::Opcode::JCC, mir::Cond::NE, mir::label(mir::local(1, false)));
+    block.space(200);
+    block.label(mir::local(2));
+    block.append(mir::Opcode::JCC, mir::Cond::E, mir::label(mir::local(1, false)));
+
+    Assembler as;
+    const auto bytes = assemble(as, block);
+    ASSERT_EQ(bytes.size(), 5 + 2 + 200 + 6);
+    // the short forward jump has to be widened since the label is out of range
+    ASSERT_EQ(bytes[0], 0xE9);
+    ASSERT_EQ(bytes[5], 0x75);
+    ASSERT_EQ(bytes[6], static_cast<uint8_t>(-7));
+    ASSERT_EQ(bytes[207], 0x0F);
+    ASSERT_EQ(bytes[208], 0x84);
+}
+
+TEST(Assembler, relocations) {
+    const auto f = mir::named("f"), table = mir::named("table");
+
+    mir::Block block;
+    block.global(f);
+    block.label(f);
+    block.append(mir::Opcode::CMP, mir::stack_ptr(), mir::mem(mir::named("stack_space"), REG_NONE, REG_NONE, 1, 524288));
+    block.append(mir::Opcode::CALL, mir::label(mir::named("helper")));
+    block.append(mir::Opcode::LEA, mir::reg(REG_A), mir::mem(table, REG_IP));
+    block.section(mir::Section::RODATA);
+    block.label(table);
+    block.append(mir::Opcode::QUAD, mir::label(f));
+
+    Assembler as;
+    assemble(as, block);
+    const auto *text = as.find_section(".text");
+    ASSERT_NE(text, nullptr);
+    ASSERT_EQ(text->relocations.size(), 3);
+    ASSERT_EQ(text->relocations[0].type, R_X86_64_32S);
+    ASSERT_EQ(text->relocations[0].addend, 524288);
+    ASSERT_EQ(text->relocations[1].type, R_X86_64_PLT32);
+    ASSERT_EQ(text->relocations[1].addend, -4);
+    ASSERT_EQ(text->relocations[2].type, R_X86_64_PC32);
+    ASSERT_EQ(text->relocations[2].target, Relocation::Target::SECTION);
+
+    const auto *rodata = as.find_section(".rodata");
+    ASSERT_NE(rodata, nullptr);
+    ASSERT_EQ(rodata->relocations.size(), 1);
+    ASSERT_EQ(rodata->relocations[0].type, R_X86_64_64);
+    ASSERT_EQ(rodata->relocations[0].target, Relocation::Target::SYMBOL);
+}
+
+TEST(Assembler, directives) {
+    const auto msg = mir::named("msg"), answer = mir::named("answer");
+
+    mir::Block block;
+    block.section(mir::Section::DATA);
+    block.global(msg);
+    block.type(msg, mir::SymbolType::OBJECT);
+    block.label(msg);
+    block.ascii(std::string_view{"hi\n\0", 4});
+    block.size(msg);
+    block.set(answer, mir::imm(42));
+    block.align(3);
+    block.append(mir::Opcode::QUAD, mir::label(answer));
+    block.append(mir::Opcode::LONG, mir::imm(-1));
+    block.append(mir::Opcode::BYTE, mir::imm(7));
+    block.section(mir::Section::BSS);
+    block.space(16);
+
+    Assembler as;
+    const auto data = assemble(as, block, ".data");
+    const std::vector<uint8_t> expected = {'h', 'i', '\n', 0, 0, 0, 0, 0, 42, 0, 0, 0, 0, 0, 0, 0, 0xFF, 0xFF, 0xFF, 0xFF, 7};
+    ASSERT_EQ(data, expected);
+    // constants are resolved right away instead of being relocated
+    ASSERT_TRUE(as.find_section(".data")->relocations.empty());
+    ASSERT_EQ(as.find_section(".bss")->size, 16);
+
+    const auto *sym = find_symbol(as, "msg");
+    ASSERT_NE(sym, nullptr);
+    ASSERT_TRUE(sym->global);
+    ASSERT_EQ(sym->elf_type, STT_OBJECT);
+    ASSERT_TRUE(sym->has_size);
+    sym = find_symbol(as, "answer");
+    ASSERT_NE(sym, nullptr);
+    ASSERT_EQ(sym->kind, assembler::Symbol::Kind::EQU);
+}
+
+TEST(Assembler, errors) {
+    {
+        // no form with two memory operands
+        mir::Block block;
+        block.append(mir::Opcode::MOV, mir::mem(REG_A), mir::mem(REG_B));
+        Assembler as;
+        as.assemble(block);
+        ASSERT_FALSE(as.finish());
+        ASSERT_FALSE(as.errors.empty());
+    }
+    {
+        mir::Block block;
+        block.section(mir::Section::BSS);
+        block.append(mir::Opcode::BYTE, mir::imm(1));
+        Assembler as;
+        as.assemble(block);
+        ASSERT_FALSE(as.finish());
+    }
+    {
+        mir::Block block;
+        block.append(mir::Opcode::JMP, mir::label(mir::local(1)));
+        Assembler as;
+        as.assemble(block);
+        ASSERT_FALSE(as.finish());
+    }
+}
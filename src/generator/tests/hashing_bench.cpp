@@ -0,0 +1,162 @@
+#include "generator/x86_64/generator.h"
+#include "generator/x86_64/hashing.h"
+#include "generator/x86_64/ijump_hash.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <random>
+
+/* Benchmark of the ijump lookup (meson test --benchmark): time to build the CHD hash table and latency of a lookup
+ * compared to the two-level table used with no_hash_lookup. The lookups resolve the same code as helper::calc_target
+ * and form a dependency chain, every target is the address looked up next, so the latency is measured and not the
+ * throughput.
+ */
+
+using namespace generator::x86_64;
+
+namespace {
+
+constexpr uint64_t PAGE_SIZE = Generator::IJUMP_LOOKUP_PAGE_SIZE;
+constexpr size_t LOOKUPS = 10'000'000;
+
+using Clock = std::chrono::steady_clock;
+
+double elapsed_ms(const Clock::time_point start) { return std::chrono::duration<double, std::milli>(Clock::now() - start).count(); }
+
+// addresses 2 to 26 bytes apart like the starts of basic blocks, same as in hashing_test.cpp
+std::vector<uint64_t> block_addrs(const size_t count) {
+    std::vector<uint64_t> keys;
+    uint64_t addr = 0x10000;
+    for (size_t i = 0; i < count; ++i) {
+        addr += 2 * (1 + (i * 7) % 13);
+        keys.emplace_back(addr);
+    }
+    return keys;
+}
+
+struct HashTableTuple {
+    uint64_t addr;
+    uint64_t target;
+};
+
+struct HashTable {
+    hashing::HashtableBuilder builder;
+    std::vector<HashTableTuple> table;
+
+    uint64_t lookup(const uint64_t addr) const {
+        const uint64_t hash = ijump_hash::mix(addr, builder.seed);
+        const uint32_t displacement = builder.displacements[ijump_hash::bucket(hash, builder.bucket_bits)];
+        const auto &tuple = table[ijump_hash::slot(hash, displacement, builder.partition_bits, builder.slot_bits)];
+        return tuple.addr == addr ? tuple.target : 0;
+    }
+};
+
+struct TwoLevelTable {
+    uint64_t base{};
+    std::vector<uint64_t> empty_page;
+    std::vector<std::vector<uint64_t>> pages;
+    std::vector<const uint64_t *> first_level;
+
+    uint64_t lookup(const uint64_t addr) const {
+        if (addr < base) {
+            return 0;
+        }
+        const uint64_t offset = addr - base;
+        const uint64_t page = offset / PAGE_SIZE;
+        if (page >= first_level.size()) {
+            return 0;
+        }
+        return first_level[page][(offset % PAGE_SIZE) / 2];
+    }
+};
+
+// maps every key to the next one of a random cycle through all keys
+std::vector<uint64_t> random_cycle(const std::vector<uint64_t> &keys) {
+    std::vector<size_t> order(keys.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::shuffle(order.begin(), order.end(), std::mt19937_64{42});
+
+    std::vector<uint64_t> next(keys.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        next[order[i]] = keys[order[(i + 1) % order.size()]];
+    }
+    return next;
+}
+
+template <typename Table> double lookup_ns(const Table &table, const uint64_t start) {
+    uint64_t addr = start;
+    const auto begin = Clock::now();
+    for (size_t i = 0; i < LOOKUPS; ++i) {
+        addr = table.lookup(addr);
+    }
+    const auto ms = elapsed_ms(begin);
+    if (addr == 0) {
+        fprintf(stderr, "A lookup missed\n");
+        exit(1);
+    }
+    return ms * 1e6 / LOOKUPS;
+}
+
+void run(const size_t count) {
+    const auto keys = block_addrs(count);
+    const auto next = random_cycle(keys);
+
+    auto start = Clock::now();
+    HashTable hash;
+    hash.builder.thread_count = 1;
+    auto hash_keys = keys;
+    hash.builder.fill(hash_keys);
+    while (!hash.builder.build()) {
+        // same fallback as the generator
+        hash.builder.load_factor /= 2;
+        hash.builder.fill(hash_keys);
+    }
+    hash.table.resize(hash.builder.hash_table_size);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        const uint64_t hash_value = ijump_hash::mix(keys[i], hash.builder.seed);
+        const uint32_t displacement = hash.builder.displacements[ijump_hash::bucket(hash_value, hash.builder.bucket_bits)];
+        hash.table[ijump_hash::slot(hash_value, displacement, hash.builder.partition_bits, hash.builder.slot_bits)] = {keys[i], next[i]};
+    }
+    const auto hash_build_ms = elapsed_ms(start);
+
+    start = Clock::now();
+    TwoLevelTable two_level;
+    two_level.base = keys.front() & ~(PAGE_SIZE - 1);
+    two_level.empty_page.resize(PAGE_SIZE / 2);
+    const size_t page_count = (keys.back() - two_level.base) / PAGE_SIZE + 1;
+    two_level.pages.resize(page_count);
+    for (size_t i = 0; i < keys.size(); ++i) {
+        auto &page = two_level.pages[(keys[i] - two_level.base) / PAGE_SIZE];
+        if (page.empty()) {
+            page.resize(PAGE_SIZE / 2);
+        }
+        page[(keys[i] % PAGE_SIZE) / 2] = next[i];
+    }
+    for (const auto &page : two_level.pages) {
+        two_level.first_level.push_back(page.empty() ? two_level.empty_page.data() : page.data());
+    }
+    const auto two_level_build_ms = elapsed_ms(start);
+
+    const size_t hash_bytes = hash.table.size() * sizeof(HashTableTuple) + hash.builder.displacements.size() * sizeof(uint32_t);
+    size_t two_level_bytes = two_level.first_level.size() * sizeof(uint64_t) + two_level.empty_page.size() * sizeof(uint64_t);
+    for (const auto &page : two_level.pages) {
+        two_level_bytes += page.size() * sizeof(uint64_t);
+    }
+
+    printf("%8zu %12.1f %12.1f %10.1f %10.1f %10zu %10zu\n", count, hash_build_ms, two_level_build_ms, lookup_ns(hash, keys.front()), lookup_ns(two_level, keys.front()),
+           hash_bytes / 1024, two_level_bytes / 1024);
+}
+
+} // namespace
+
+int main() {
+    printf("%8s %12s %12s %10s %10s %10s %10s\n", "keys", "build ms", "build ms", "lookup ns", "lookup ns", "KiB", "KiB");
+    printf("%8s %12s %12s %10s %10s %10s %10s\n", "", "hash", "two-level", "hash", "two-level", "hash", "two-level");
+    for (const size_t count : {size_t{1000}, size_t{100'000}, size_t{1'000'000}}) {
+        run(count);
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "generator/x86_64/hashing.h"
+#include "generator/x86_64/ijump_hash.h"
+
+#include <gtest/gtest.h>
+
+using namespace generator::x86_64;
+
+static void verify_lookup(const hashing::HashtableBuilder &builder) {
+    ASSERT_EQ(builder.hash_table.size(), builder.hash_table_size);
+    ASSERT_EQ(builder.displacements.size(), builder.bucket_number);
+    for (const auto key : builder.keys) {
+        const auto hash = ijump_hash::mix(key, builder.seed);
+        const auto displacement = builder.displacements[ijump_hash::bucket(hash, builder.bucket_bits)];
+        const auto slot = ijump_hash::slot(hash, displacement, builder.partition_bits, builder.slot_bits);
+        ASSERT_LT(slot, builder.hash_table_size);
+        ASSERT_EQ(builder.hash_table[slot], key);
+    }
+}
+
+static std::vector<uint64_t> block_addrs(const size_t count) {
+    std::vector<uint64_t> keys;
+    uint64_t addr = 0x10000;
+    for (size_t i = 0; i < count; ++i) {
+        addr += 2 * (1 + (i * 7) % 13);
+        keys.emplace_back(addr);
+    }
+    return keys;
+}
+
+TEST(HashtableBuilder, small) {
+    for (const size_t count : {size_t{0}, size_t{1}, size_t{5}, size_t{1000}}) {
+        hashing::HashtableBuilder builder;
+        auto keys = block_addrs(count);
+        builder.fill(keys);
+        ASSERT_TRUE(builder.build());
+        ASSERT_EQ(builder.partition_bits, 0);
+        verify_lookup(builder);
+    }
+}
+
+TEST(HashtableBuilder, partitioned) {
+    hashing::HashtableBuilder builder;
+    builder.thread_count = 4;
+    auto keys = block_addrs(4 * hashing::HashtableBuilder::MIN_PARTITION_KEYS);
+    builder.fill(keys);
+    ASSERT_EQ(builder.partition_bits, 2);
+    ASSERT_TRUE(builder.build());
+    verify_lookup(builder);
+
+    // the result doesn't depend on the number of threads
+    hashing::HashtableBuilder single;
+    single.thread_count = 1;
+    single.fill(keys);
+    ASSERT_TRUE(single.build());
+    ASSERT_EQ(single.hash_table, builder.hash_table);
+}
+
+TEST(HashtableBuilder, duplicate_keys) {
+    hashing::HashtableBuilder builder;
+    std::vector<uint64_t> keys = {0x1000, 0x1004, 0x1000};
+    builder.fill(keys);
+    ASSERT_EQ(builder.keys.size(), 2);
+    ASSERT_TRUE(builder.build());
+    verify_lookup(builder);
+}
@@ -0,0 +1,116 @@
+#include "generator/x86_64/assembler.h"
+#include "generator/x86_64/machine_ir.h"
+
+#include <gtest/gtest.h>
+
+using namespace generator::x86_64;
+
+TEST(MachineIR, lowering) {
+    mir::Block block;
+    block.append(mir::Opcode::MOV, mir::reg(REG_A), mir::static_var(3));
+    block.append(mir::Opcode::MOV, mir::stack_slot(2), mir::reg(REG_8, Type::i32));
+    block.append(mir::Opcode::ADD, mir::reg(REG_B, Type::i16), mir::hex_imm(-1));
+    block.append(mir::Opcode::MOV, mir::sized(mir::mem(REG_SI, -8), Type::i8), mir::imm(5));
+    block.append(mir::Opcode::LEA, mir::reg(REG_DI), mir::mem(REG_DI, REG_15));
+    block.append(mir::Opcode::MOVQ, mir::fp_reg(REG_XMM9), mir::mem(REG_C));
+    block.append(mir::Opcode::SHLX, mir::reg(REG_A), mir::reg(REG_A), mir::reg(REG_C));
+    block.append(mir::Opcode::JMP, mir::block(7, mir::Symbol::Kind::REG_ALLOC));
+    block.append(mir::Opcode::LEA, mir::reg(REG_D), mir::binary(16));
+
+    std::string text;
+    block.lower(text);
+    ASSERT_EQ(text, "mov rax, [s3]\n"
+                    "mov [rsp + 8 * 2], r8d\n"
+                    "add bx, 0xffffffffffffffff\n"
+                    "mov BYTE PTR [rsi + -8], 5\n"
+                    "lea rdi, [rdi + r15]\n"
+                    "movq xmm9, [rcx]\n"
+                    "shlx rax, rax, rcx\n"
+                    "jmp b7_reg_alloc\n"
+                    "lea rdx, [binary + 16]\n");
+}
+
+TEST(MachineIR, pseudo_ops) {
+    mir::Block block;
+    block.comment("comment");
+    block.label(mir::symbol(mir::Symbol::Kind::REG_ALLOC_CF, 1, 2));
+    block.append(mir::Opcode::JCC, mir::Cond::NE, mir::label(mir::local(0)));
+    block.append(mir::Opcode::CMPXCHG, mir::sized(mir::mem(REG_DI), Type::i32), mir::reg(REG_SI, Type::i32)).lock = true;
+    block.label(mir::local(0));
+    block.append(mir::Opcode::CMP, mir::stack_ptr(), mir::tcb("ret_stack_limit"));
+    block.append(mir::Opcode::LEA, mir::reg(REG_DI), mir::mem(mir::symbol(mir::Symbol::Kind::ERR_UNREACHABLE, 4), REG_IP));
+    block.align(4);
+    block.section(mir::Section::TEXT_COLD);
+    block.append(mir::Opcode::ROUNDSD, mir::fp_reg(REG_XMM1), mir::fp_reg(REG_XMM2), mir::imm(1));
+
+    std::string text;
+    block.lower(text, "fs:");
+    ASSERT_EQ(text, "# comment\n"
+                    "b1_reg_alloc_cf2:\n"
+                    "jne 0f\n"
+                    "lock cmpxchg DWORD PTR [rdi], esi\n"
+                    "0:\n"
+                    "cmp rsp, fs:[ret_stack_limit]\n"
+                    "lea rdi, [rip + err_unreachable_b4]\n"
+                    ".p2align 4\n"
+                    ".section .text.cold, \"ax\", @progbits\n"
+                    "roundsd xmm1, xmm2, 1\n");
+}
+
+TEST(MachineIR, directives) {
+    const auto obj = mir::named("obj");
+    mir::Block block;
+    block.section(mir::Section::ORIG_BINARY);
+    block.incbin("/tmp/binary");
+    block.section(mir::Section::DATA);
+    block.global(obj);
+    block.type(obj, mir::SymbolType::OBJECT);
+    block.label(obj);
+    block.ascii(std::string_view{"a\"\n\0", 4});
+    block.size(obj);
+    block.set(mir::symbol(mir::Symbol::Kind::STATIC, 2), mir::imm(16));
+    block.append(mir::Opcode::QUAD, mir::block(3));
+    block.append(mir::Opcode::LONG, mir::imm(-1));
+    block.space(8);
+
+    std::string text;
+    block.lower(text);
+    ASSERT_EQ(text, ".section .orig_binary, \"aw\"\n"
+                    ".incbin \"/tmp/binary\"\n"
+                    ".data\n"
+                    ".global obj\n"
+                    ".type obj,STT_OBJECT\n"
+                    "obj:\n"
+                    ".ascii \"a\\\"\\n\\0\"\n"
+                    ".size obj,$-obj\n"
+                    "s2 = 16\n"
+                    ".8byte b3\n"
+                    ".4byte -1\n"
+                    ".space 8\n");
+}
+
+// the expected encodings were taken from the output of GNU as for the lowered text
+TEST(MachineIR, assemble) {
+    mir::Block block;
+    block.append(mir::Opcode::CQO);
+    block.append(mir::Opcode::IDIV, mir::reg(REG_9, Type::i32));
+    block.append(mir::Opcode::SETCC, mir::Cond::B, mir::reg(REG_SI, Type::i8));
+    block.append(mir::Opcode::CMOVCC, mir::Cond::GE, mir::reg(REG_A), mir::reg(REG_12));
+    block.append(mir::Opcode::XADD, mir::sized(mir::mem(REG_B), Type::i64), mir::reg(REG_C)).lock = true;
+    block.label(mir::local(1));
+    block.append(mir::Opcode::CVTTSD2SI, mir::reg(REG_D, Type::i32), mir::fp_reg(REG_XMM3));
+    block.append(mir::Opcode::VFNMSUB213SS, mir::fp_reg(REG_XMM0), mir::fp_reg(REG_XMM9), mir::fp_reg(REG_XMM15));
+    block.append(mir::Opcode::STMXCSR, mir::mem(REG_SP));
+    block.append(mir::Opcode::PXOR, mir::fp_reg(REG_XMM4), mir::mem(REG_SP));
+    block.append(mir::Opcode::JCC, mir::Cond::P, mir::label(mir::local(1, false)));
+    block.append(mir::Opcode::SYSCALL);
+
+    assembler::Assembler as;
+    as.assemble(block);
+    ASSERT_TRUE(as.finish());
+    const auto *text = as.find_section(".text");
+    ASSERT_NE(text, nullptr);
+    const std::vector<uint8_t> expected = {0x48, 0x99, 0x41, 0xF7, 0xF9, 0x40, 0x0F, 0x92, 0xC6, 0x49, 0x0F, 0x4D, 0xC4, 0xF0, 0x48, 0x0F, 0xC1, 0x0B, 0xF2, 0x0F,
+                                           0x2C, 0xD3, 0xC4, 0xC2, 0x31, 0xAF, 0xC7, 0x0F, 0xAE, 0x1C, 0x24, 0x66, 0x0F, 0xEF, 0x24, 0x24, 0x7A, 0xEC, 0x0F, 0x05};
+    ASSERT_EQ(text->data, expected);
+}
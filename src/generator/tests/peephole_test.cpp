@@ -0,0 +1,136 @@
+#include "generator/x86_64/generator.h"
+#include "generator/x86_64/peephole.h"
+#include "test_irs.h"
+#include "util.h"
+
+#include <gtest/gtest.h>
+
+using namespace generator::x86_64;
+
+static std::string run_peephole(peephole::Peephole &opt, mir::Block &block) {
+    opt.run(block);
+    std::string text;
+    block.lower(text);
+    return text;
+}
+
+TEST(Peephole, moves) {
+    peephole::Peephole opt{8};
+    mir::Block block;
+    block.append(mir::Opcode::MOV, mir::reg(REG_A), mir::reg(REG_A));
+    // mov eax, eax clears the upper half and has to stay
+    block.append(mir::Opcode::MOV, mir::reg(REG_B, Type::i32), mir::reg(REG_B, Type::i32));
+    block.append(mir::Opcode::MOV, mir::reg(REG_C), mir::reg(REG_D));
+    block.append(mir::Opcode::MOV, mir::reg(REG_D), mir::reg(REG_C));
+    block.append(mir::Opcode::MOV, mir::reg(REG_SI), mir::imm(1));
+    block.append(mir::Opcode::MOV, mir::reg(REG_SI), mir::imm(2));
+    // guest memory loads might fault
+    block.append(mir::Opcode::MOV, mir::reg(REG_DI), mir::mem(REG_SI));
+    block.append(mir::Opcode::MOV, mir::reg(REG_DI), mir::imm(3));
+
+    ASSERT_EQ(run_peephole(opt, block), "mov ebx, ebx\n"
+                                        "mov rcx, rdx\n"
+                                        "mov rsi, 2\n"
+                                        "mov rdi, [rsi]\n"
+                                        "mov rdi, 3\n");
+    ASSERT_EQ(opt.hits[peephole::SELF_MOVE], 1);
+    ASSERT_EQ(opt.hits[peephole::REVERSE_MOVE], 1);
+    ASSERT_EQ(opt.hits[peephole::DEAD_MOVE], 1);
+}
+
+TEST(Peephole, memory) {
+    peephole::Peephole opt{8};
+    mir::Block block;
+    block.append(mir::Opcode::MOV, mir::static_var(1), mir::reg(REG_A));
+    block.append(mir::Opcode::MOV, mir::reg(REG_B), mir::static_var(1));
+    block.append(mir::Opcode::MOV, mir::reg(REG_C), mir::stack_slot(0));
+    block.append(mir::Opcode::ADD, mir::reg(REG_C), mir::reg(REG_B));
+    block.append(mir::Opcode::MOV, mir::reg(REG_D), mir::stack_slot(0));
+    block.append(mir::Opcode::MOV, mir::stack_slot(0), mir::reg(REG_D));
+    block.append(mir::Opcode::MOV, mir::static_var(1), mir::reg(REG_C));
+    block.append(mir::Opcode::JMP, mir::block(1));
+
+    ASSERT_EQ(run_peephole(opt, block), "mov rbx, rax\n"
+                                        "mov rcx, [rsp + 8 * 0]\n"
+                                        "add rcx, rbx\n"
+                                        "mov rdx, [rsp + 8 * 0]\n"
+                                        "mov [s1], rcx\n"
+                                        "jmp b1\n");
+    ASSERT_EQ(opt.hits[peephole::STORE_FORWARD], 1);
+    ASSERT_EQ(opt.hits[peephole::REDUNDANT_STORE], 1);
+    ASSERT_EQ(opt.hits[peephole::DEAD_STORE], 1);
+    // rcx is written in between, so the second load can't be forwarded from it
+    ASSERT_EQ(opt.hits[peephole::RELOAD_FORWARD], 0);
+}
+
+TEST(Peephole, barriers) {
+    peephole::Peephole opt{8};
+    mir::Block block;
+    block.append(mir::Opcode::MOV, mir::static_var(2), mir::reg(REG_A));
+    block.append(mir::Opcode::CALL, mir::label(mir::named("helper")));
+    block.append(mir::Opcode::MOV, mir::reg(REG_B), mir::static_var(2));
+    // the store might alias any static
+    block.append(mir::Opcode::MOV, mir::reg(REG_C), mir::static_var(3));
+    block.append(mir::Opcode::MOV, mir::mem(REG_SI), mir::reg(REG_D));
+    block.append(mir::Opcode::MOV, mir::reg(REG_DI), mir::static_var(3));
+
+    ASSERT_EQ(run_peephole(opt, block), "mov [s2], rax\n"
+                                        "call helper\n"
+                                        "mov rbx, [s2]\n"
+                                        "mov rcx, [s3]\n"
+                                        "mov [rsi], rdx\n"
+                                        "mov rdi, [s3]\n");
+    for (const auto hits : opt.hits) {
+        ASSERT_EQ(hits, 0);
+    }
+}
+
+TEST(Peephole, stack_adjust) {
+    peephole::Peephole opt{8};
+    mir::Block block;
+    block.append(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(16));
+    block.append(mir::Opcode::MOV, mir::reg(REG_A), mir::static_var(0));
+    block.append(mir::Opcode::SUB, mir::stack_ptr(), mir::imm(24));
+    block.append(mir::Opcode::MOV, mir::stack_slot(1), mir::reg(REG_A));
+    block.append(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(8));
+    block.append(mir::Opcode::SUB, mir::stack_ptr(), mir::imm(8));
+
+    ASSERT_EQ(run_peephole(opt, block), "sub rsp, 8\n"
+                                        "mov rax, [s0]\n"
+                                        "mov [rsp + 8 * 1], rax\n");
+    ASSERT_EQ(opt.hits[peephole::STACK_ADJUST], 2);
+}
+
+TEST(Peephole, window) {
+    peephole::Peephole opt{2};
+    mir::Block block;
+    block.append(mir::Opcode::MOV, mir::static_var(0), mir::reg(REG_A));
+    block.append(mir::Opcode::MOV, mir::reg(REG_B), mir::imm(1));
+    block.append(mir::Opcode::MOV, mir::reg(REG_C), mir::imm(2));
+    block.append(mir::Opcode::MOV, mir::reg(REG_D), mir::static_var(0));
+
+    run_peephole(opt, block);
+    ASSERT_EQ(block.insts.size(), 4);
+    ASSERT_EQ(opt.hits[peephole::STORE_FORWARD], 0);
+
+    opt.window = 0;
+    block.append(mir::Opcode::MOV, mir::reg(REG_A), mir::reg(REG_A));
+    run_peephole(opt, block);
+    ASSERT_EQ(block.insts.size(), 5);
+}
+
+TEST(Peephole, generator) {
+    const uint32_t opts[] = {Generator::OPT_MBRA | Generator::OPT_PEEPHOLE, Generator::OPT_MBRA | Generator::OPT_MERGE_OP | Generator::OPT_PEEPHOLE, Generator::OPT_PEEPHOLE};
+    for (const auto optimizations : opts) {
+        Buffer buf;
+        IR ir{};
+        gen_first_ir(ir);
+        {
+            auto file = buf.open();
+            Generator gen(&ir, {}, file.handle());
+            gen.optimizations = optimizations;
+            gen.compile();
+        }
+        ASSERT_FALSE(buf.view().empty());
+    }
+}
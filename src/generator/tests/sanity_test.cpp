@@ -1,18 +1,25 @@
 #include "generator/x86_64/generator.h"
+#include "generator/x86_64/static_liveness.h"
 #include "test_irs.h"
 #include "util.h"
 
+#include <array>
 #include <gtest/gtest.h>
+#include <map>
+#include <string>
 
 using generator::x86_64::Generator;
 
 // These sanity checks test whether the generator runs without hitting an assertion, and that it produces some output.
 
-static void run_generator(File &output, void (*ir_generator)(IR &)) {
-    IR ir;
+static void run_generator(File &output, void (*ir_generator)(IR &), uint32_t optimizations = 0, size_t thread_count = 0) {
+    // value-initialized so the ELF info in the output is deterministic
+    IR ir{};
     ir_generator(ir);
 
     Generator gen(&ir, {}, output.handle());
+    gen.optimizations = optimizations;
+    gen.thread_count = thread_count;
     gen.compile();
 }
 
@@ -70,7 +77,717 @@ TEST(GeneratorBasicIR, first) {
     ASSERT_FALSE(buf.view().empty());
 }
 
+TEST(GeneratorBlockLayout, unreachable) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_unreachable_ir, Generator::OPT_BLOCK_LAYOUT);
+    }
+    // the block only panics, so it's moved to the cold section
+    const auto view = buf.view();
+    const auto cold = view.find(".section .text.cold");
+    const auto b0 = view.find("\nb0:\n");
+    ASSERT_NE(cold, std::string_view::npos);
+    ASSERT_NE(b0, std::string_view::npos);
+    ASSERT_LT(cold, b0);
+    ASSERT_EQ(view.substr(cold, b0 - cold).find("\n.text\n"), std::string_view::npos);
+}
+
+TEST(GeneratorBlockLayout, first) {
+    // b1 jumps to b0, with the layout b0 follows b1 and the jump is left out
+    for (const auto optimizations : {0u, static_cast<uint32_t>(Generator::OPT_BLOCK_LAYOUT)}) {
+        Buffer buf;
+        {
+            auto file = buf.open();
+            run_generator(file, gen_first_ir, optimizations);
+        }
+        const auto view = buf.view();
+        const auto b0 = view.find("\nb0:\n"), b1 = view.find("\nb1:\n");
+        ASSERT_NE(b0, std::string_view::npos);
+        ASSERT_NE(b1, std::string_view::npos);
+        if (optimizations == 0) {
+            ASSERT_LT(b0, b1);
+            ASSERT_NE(view.find("jmp b0\n", b1), std::string_view::npos);
+        } else {
+            ASSERT_LT(b1, b0);
+            ASSERT_EQ(view.substr(b1, b0 - b1).find("jmp "), std::string_view::npos);
+        }
+    }
+}
+
+TEST(GeneratorBlockLayout, order) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_layout_ir, Generator::OPT_BLOCK_LAYOUT);
+    }
+    const auto view = buf.view();
+    const auto b0 = view.find("\nb0:\n"), b2 = view.find("\nb2:\n"), b1 = view.find("\nb1:\n"), b3 = view.find("\nb3:\n");
+    ASSERT_NE(b3, std::string_view::npos);
+    ASSERT_LT(b0, b2);
+    ASSERT_LT(b2, b1);
+    ASSERT_LT(b1, b3);
+    // only the jumps to the block emitted right after are omitted
+    ASSERT_EQ(view.substr(b0, b2 - b0).find("jmp b2\n"), std::string_view::npos);
+    ASSERT_NE(view.substr(b2, b1 - b2).find("jmp b3\n"), std::string_view::npos);
+    ASSERT_EQ(view.substr(b1, b3 - b1).find("jmp b3\n"), std::string_view::npos);
+}
+
+TEST(GeneratorBlockLayout, reg_alloc_order) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_layout_ir, Generator::OPT_MBRA | Generator::OPT_BLOCK_LAYOUT);
+    }
+    // the fall-through target of a block is compiled right after it, b1 comes last and jumps back to b3
+    const auto view = buf.view();
+    const auto b2 = view.find("\nb2_reg_alloc:\n"), b3 = view.find("\nb3_reg_alloc:\n"), b1 = view.find("\nb1_reg_alloc:\n");
+    const auto cold = view.find(".text.cold");
+    ASSERT_NE(cold, std::string_view::npos);
+    ASSERT_LT(b2, b3);
+    ASSERT_LT(b3, b1);
+    ASSERT_LT(b1, cold);
+    ASSERT_EQ(view.substr(b2, b3 - b2).find("jmp "), std::string_view::npos);
+    ASSERT_NE(view.substr(b1, cold - b1).find("jmp b3_reg_alloc\n"), std::string_view::npos);
+}
+
+// fixed registers of the call convention: a0-a7, sp, s0 and ra
+static constexpr std::array<std::pair<size_t, std::string_view>, 11> call_conv_regs = {
+    std::pair<size_t, std::string_view>{10, "rdi"}, {11, "rsi"}, {12, "rdx"}, {13, "rcx"}, {14, "r8"}, {15, "r9"}, {16, "r10"}, {17, "r11"}, {2, "r12"}, {8, "r13"}, {1, "r14"},
+};
+
+static std::string_view section(const std::string_view view, const std::string_view begin, const std::string_view end) {
+    const auto start = view.find(begin);
+    EXPECT_NE(start, std::string_view::npos) << begin;
+    const auto stop = view.find(end, start);
+    EXPECT_NE(stop, std::string_view::npos) << end;
+    return view.substr(start, stop - start);
+}
+
+TEST(GeneratorCallConv, call) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_call_ir, Generator::OPT_MBRA | Generator::OPT_CALL_CONV);
+    }
+    const auto view = buf.view();
+
+    // the plain entries load the statics into the fixed registers, the _cc entries expect them there
+    for (const auto *entry : {"\nb1:\n", "\nb2:\n"}) {
+        const auto loads = section(view, entry, "_cc:\n");
+        for (const auto &[idx, reg] : call_conv_regs) {
+            ASSERT_NE(loads.find("mov " + std::string{reg} + ", [s" + std::to_string(idx) + "]\n"), std::string_view::npos) << entry << reg;
+        }
+    }
+
+    // a0 and ra are passed in rdi and r14, nothing is written back to the statics
+    const auto call = section(view, "b0_reg_alloc_cf0:\n", "call b1_cc\n");
+    ASSERT_NE(call.find("mov rdi, "), std::string_view::npos);
+    ASSERT_NE(call.find("lea r14, [binary + 14]\n"), std::string_view::npos);
+    ASSERT_EQ(call.find("mov [s"), std::string_view::npos);
+    ASSERT_NE(view.find("jmp b2_cc\n", view.find("call b1_cc\n")), std::string_view::npos);
+
+    // the function computes a0 = a0 + a1 in place and returns without touching the statics,
+    // they are only written back before the ijump lookup on a return address mismatch
+    const auto func = section(view, "b1_cc:\n", "\nret\n");
+    ASSERT_NE(func.find("add rdi, rsi\n"), std::string_view::npos);
+    ASSERT_EQ(func.find("mov [s"), std::string_view::npos);
+    ASSERT_EQ(func.find(", [s"), std::string_view::npos);
+    const auto mismatch = section(view, "\nret\n0:\n", "jmp ijump_lookup\n");
+    for (const auto &[idx, reg] : call_conv_regs) {
+        ASSERT_NE(mismatch.find("mov [s" + std::to_string(idx) + "], " + std::string{reg} + "\n"), std::string_view::npos) << reg;
+    }
+
+    // the continuation gets the result of the function in rdi and only writes the statics for the syscall
+    const auto cont = section(view, "b2_cc:\n", "call syscall_impl\n");
+    ASSERT_EQ(cont.find(", [s"), std::string_view::npos);
+    for (const auto &[idx, reg] : call_conv_regs) {
+        ASSERT_NE(cont.find("mov [s" + std::to_string(idx) + "], " + std::string{reg} + "\n"), std::string_view::npos) << reg;
+    }
+}
+
+TEST(GeneratorCallConv, disabled) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_call_ir, Generator::OPT_MBRA);
+    }
+    const auto view = buf.view();
+    ASSERT_EQ(view.find("_cc"), std::string_view::npos);
+
+    // a0 and ra go through the statics
+    const auto call = section(view, "b0_reg_alloc_cf0:\n", "call b1\n");
+    ASSERT_NE(call.find("mov [s10], "), std::string_view::npos);
+    ASSERT_NE(call.find("mov [s1], "), std::string_view::npos);
+}
+
+TEST(GeneratorStaticLiveness, dead) {
+    // static1 is overwritten by b1 before anything reads it, so b0 doesn't need to write it back
+    for (const auto optimizations : {0u, static_cast<uint32_t>(Generator::OPT_STATIC_LIVENESS)}) {
+        Buffer buf;
+        {
+            auto file = buf.open();
+            run_generator(file, gen_dead_static_ir, optimizations);
+        }
+        const auto view = buf.view();
+        const auto b0 = view.find("\nb0:\n"), b1 = view.find("\nb1:\n");
+        ASSERT_LT(b0, b1);
+        const auto block = view.substr(b0, b1 - b0);
+        ASSERT_NE(block.find("mov [s2], "), std::string_view::npos);
+        ASSERT_EQ(block.find("mov [s1], ") == std::string_view::npos, optimizations != 0);
+    }
+}
+
+TEST(GeneratorStaticLiveness, reg_alloc) {
+    // the back edge of the loop in b1 passes the counter as static1 and static2, only static2 is read again
+    for (const auto optimizations : {0u, static_cast<uint32_t>(Generator::OPT_STATIC_LIVENESS)}) {
+        Buffer buf;
+        {
+            auto file = buf.open();
+            run_generator(file, gen_liveness_ir, Generator::OPT_MBRA | optimizations);
+        }
+        const auto view = buf.view();
+        const auto back_edge = view.find("b1_reg_alloc_cf0:\n");
+        ASSERT_NE(back_edge, std::string_view::npos);
+        const auto jmp = view.find("jmp b1_reg_alloc\n", back_edge);
+        ASSERT_NE(jmp, std::string_view::npos);
+        const auto edge = view.substr(back_edge, jmp - back_edge);
+        ASSERT_NE(edge.find("mov [s2], "), std::string_view::npos);
+        ASSERT_EQ(edge.find("mov [s1], ") == std::string_view::npos, optimizations != 0);
+    }
+}
+
+TEST(GeneratorStaticLiveness, sets) {
+    IR ir{};
+    gen_liveness_ir(ir);
+    generator::x86_64::liveness::StaticLiveness liveness(&ir);
+    liveness.build();
+
+    using Set = std::vector<bool>;
+    // static:                                   0      1      2      3
+    ASSERT_EQ(liveness.live_in[0], (Set{false, true, true, true}));
+    ASSERT_EQ(liveness.live_out[0], (Set{false, false, true, true}));
+    // the loop keeps static2 alive through the back edge, static1 is never read again
+    ASSERT_EQ(liveness.live_in[1], (Set{false, false, true, true}));
+    ASSERT_EQ(liveness.live_out[1], (Set{false, false, true, true}));
+    // static3 is overwritten before b3 reads it
+    ASSERT_EQ(liveness.live_in[2], (Set{false, false, false, false}));
+    ASSERT_EQ(liveness.live_out[2], (Set{false, false, false, true}));
+    // nothing is live after unreachable
+    ASSERT_EQ(liveness.live_in[3], (Set{false, false, false, true}));
+    ASSERT_EQ(liveness.live_out[3], (Set{false, false, false, false}));
+
+    ASSERT_FALSE(liveness.is_live_in(ir.basic_blocks[2].get(), 3));
+    ASSERT_TRUE(liveness.is_live_in(ir.basic_blocks[1].get(), 3));
+}
+
+TEST(GeneratorRegAlloc, parallel) {
+    // the groups have to be written out in the same order no matter how many threads compile them
+    for (auto *ir_generator : {gen_print_ir, gen_first_ir, gen_call_ir}) {
+        Buffer serial, parallel;
+        {
+            auto file = serial.open();
+            run_generator(file, ir_generator, Generator::OPT_MBRA | Generator::OPT_MERGE_OP | Generator::OPT_UNUSED_STATIC, 1);
+        }
+        {
+            auto file = parallel.open();
+            run_generator(file, ir_generator, Generator::OPT_MBRA | Generator::OPT_MERGE_OP | Generator::OPT_UNUSED_STATIC, 4);
+        }
+        ASSERT_EQ(serial.view(), parallel.view());
+    }
+}
+
+static void run_weighted_eviction(File &output, void (*ir_generator)(IR &), uint32_t optimizations) {
+    IR ir{};
+    ir_generator(ir);
+
+    Generator gen(&ir, {}, output.handle());
+    gen.optimizations = optimizations;
+    gen.reg_alloc_kind = Generator::RegAllocKind::WEIGHTED_EVICTION;
+    gen.compile();
+}
+
+TEST(GeneratorRegAlloc, weighted_eviction) {
+    for (auto *ir_generator : {gen_print_ir, gen_first_ir, gen_third_ir, gen_call_ir, gen_dead_static_ir}) {
+        Buffer buf;
+        {
+            auto file = buf.open();
+            run_weighted_eviction(file, ir_generator, Generator::OPT_MBRA | Generator::OPT_MERGE_OP | Generator::OPT_CALL_CONV | Generator::OPT_STATIC_LIVENESS);
+        }
+        ASSERT_FALSE(buf.view().empty());
+    }
+}
+
+// Runs the `mov`, `imul` and `add` instructions of a block of the generator output on 64 bit registers, statics and
+// stack slots. Returns false if it finds another instruction.
+static bool evaluate(const std::string_view block, std::map<std::string, uint64_t> &state) {
+    size_t pos = 0;
+    while (pos < block.size()) {
+        auto end = block.find('\n', pos);
+        if (end == std::string_view::npos) {
+            end = block.size();
+        }
+        const auto line = block.substr(pos, end - pos);
+        pos = end + 1;
+        if (line.empty() || line[0] == '#' || line.back() == ':' || line.substr(0, 8) == "sub rsp," || line.substr(0, 8) == "add rsp,") {
+            continue;
+        }
+
+        const auto space = line.find(' '), comma = line.find(", ");
+        if (space == std::string_view::npos || comma == std::string_view::npos) {
+            return false;
+        }
+        const auto mnemonic = line.substr(0, space);
+        const auto dst = std::string{line.substr(space + 1, comma - space - 1)};
+        const auto src = state[std::string{line.substr(comma + 2)}];
+        if (mnemonic == "mov") {
+            state[dst] = src;
+        } else if (mnemonic == "imul") {
+            state[dst] *= src;
+        } else if (mnemonic == "add") {
+            state[dst] += src;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+TEST(GeneratorRegAlloc, weighted_eviction_spills) {
+    // gen_pressure_ir keeps 20 products live at the same time, so some of them have to be spilled and reloaded
+    Buffer greedy, weighted;
+    {
+        auto file = greedy.open();
+        run_generator(file, gen_pressure_ir, Generator::OPT_MBRA);
+    }
+    {
+        auto file = weighted.open();
+        run_weighted_eviction(file, gen_pressure_ir, Generator::OPT_MBRA);
+    }
+
+    size_t spills[2] = {};
+    for (const auto *buf : {&greedy, &weighted}) {
+        const auto view = buf->view();
+        const auto block = view.substr(view.find("\nb0:\n"), view.find("jmp b0\n") - view.find("\nb0:\n"));
+
+        // the greedy allocator also saves inputs it doesn't reload, every spill of the weighted eviction is reloaded
+        for (size_t slot = 0;; ++slot) {
+            const auto name = "[rsp + 8 * " + std::to_string(slot) + "]";
+            const auto store = block.find("mov " + name + ", ");
+            if (store == std::string_view::npos) {
+                ASSERT_EQ(block.find(name), std::string_view::npos) << name;
+                break;
+            }
+            if (buf == &weighted) {
+                ASSERT_NE(block.find(", " + name + "\n", store), std::string_view::npos) << name;
+            }
+            ++spills[buf == &weighted];
+        }
+
+        std::map<std::string, uint64_t> state;
+        uint64_t expected = 0;
+        for (uint64_t i = 1; i <= 20; ++i) {
+            state["[s" + std::to_string(i) + "]"] = i + 1000;
+            expected += (i + 1000) * (i + 1000);
+        }
+        ASSERT_TRUE(evaluate(block, state)) << block;
+        ASSERT_EQ(state["[s1]"], expected);
+        for (uint64_t i = 2; i <= 20; ++i) {
+            ASSERT_EQ(state["[s" + std::to_string(i) + "]"], i + 1000);
+        }
+    }
+
+    // 14 of the products fit into registers, the weighted eviction only spills the others
+    ASSERT_GT(spills[1], 0u);
+    ASSERT_LE(spills[1], 20u - 14u + 1u);
+    ASSERT_LE(spills[1], spills[0]);
+}
+
+TEST(GeneratorRegAlloc, live_intervals) {
+    IR ir{};
+    gen_first_ir(ir);
+
+    auto blocks = std::vector<BasicBlock *>{};
+    for (auto &bb : ir.basic_blocks) {
+        blocks.push_back(bb.get());
+    }
+    auto intervals = generator::x86_64::weighted_eviction::LiveIntervals{blocks};
+    intervals.build();
+
+    ASSERT_EQ(intervals.loop_depths.size(), blocks.size());
+    ASSERT_FALSE(intervals.intervals.empty());
+    for (const auto &interval : intervals.intervals) {
+        ASSERT_LE(interval.start, interval.end);
+        ASSERT_EQ(intervals.spill_weight(interval.var), interval.weight);
+        if (interval.use_count == 0) {
+            ASSERT_EQ(interval.weight, 0.f);
+        }
+    }
+}
+
+TEST(GeneratorFuseBranches, fused) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_fused_cmp_ir, Generator::OPT_MBRA | Generator::OPT_FUSE_BRANCHES);
+    }
+    // the compare results are never materialized
+    ASSERT_EQ(buf.view().find("setl"), std::string_view::npos);
+    ASSERT_EQ(buf.view().find("cmov"), std::string_view::npos);
+    ASSERT_NE(buf.view().find("ucomisd"), std::string_view::npos);
+    ASSERT_NE(buf.view().find("_unordered:"), std::string_view::npos);
+}
+
+TEST(GeneratorFuseBranches, disabled) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_fused_cmp_ir, Generator::OPT_MBRA);
+    }
+    ASSERT_NE(buf.view().find("setl"), std::string_view::npos);
+    ASSERT_EQ(buf.view().find("ucomisd"), std::string_view::npos);
+}
+
+TEST(GeneratorAddressFolding, folded) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_scaled_load_ir, Generator::OPT_MBRA | Generator::OPT_MERGE_OP);
+    }
+    // the shifts and adds become part of the memory operands
+    ASSERT_NE(buf.view().find(" * 8 + 16]"), std::string_view::npos);
+    ASSERT_NE(buf.view().find(" * 8 + 8], "), std::string_view::npos);
+    // the second load is the memory source of the add
+    ASSERT_NE(buf.view().find("add rax, [r"), std::string_view::npos);
+}
+
+TEST(GeneratorAddressFolding, disabled) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_scaled_load_ir, Generator::OPT_MBRA);
+    }
+    ASSERT_EQ(buf.view().find(" * 8 + 16]"), std::string_view::npos);
+}
+
+TEST(GeneratorPinnedRegs, pinned) {
+    for (auto *ir_generator : {gen_print_ir, gen_first_ir, gen_call_ir}) {
+        Buffer buf;
+        {
+            IR ir{};
+            ir_generator(ir);
+
+            auto file = buf.open();
+            Generator gen(&ir, {}, file.handle());
+            gen.optimizations = Generator::OPT_MBRA | Generator::OPT_MERGE_OP | Generator::OPT_CALL_CONV;
+            gen.pinned_statics = gen.choose_pinned_statics();
+            ASSERT_FALSE(gen.pinned_statics.empty());
+            gen.compile();
+        }
+        ASSERT_NE(buf.view().find("unresolved_ijump_pinned:"), std::string_view::npos);
+        // the call convention is turned off since it uses r12-r14 itself
+        ASSERT_EQ(buf.view().find("_cc:"), std::string_view::npos);
+    }
+}
+
+TEST(GeneratorPinnedRegs, choose) {
+    IR ir{};
+    gen_call_ir(ir);
+    Generator gen(&ir, {}, nullptr);
+
+    const auto pinned = gen.choose_pinned_statics(2);
+    ASSERT_FALSE(pinned.empty());
+    ASSERT_LE(pinned.size(), 2);
+    for (const auto static_idx : pinned) {
+        ASSERT_NE(static_idx, 0);
+        ASSERT_EQ(ir.statics[static_idx].type, Type::i64);
+    }
+    // without register allocation the statics stay in memory
+    gen.pinned_statics = pinned;
+    ASSERT_EQ(gen.pinned_reg(pinned[0]), generator::x86_64::REG_NONE);
+    gen.optimizations = Generator::OPT_MBRA;
+    ASSERT_EQ(gen.pinned_reg(pinned[0]), generator::x86_64::REG_12);
+    ASSERT_TRUE(gen.is_reg_pinned(generator::x86_64::REG_12));
+    ASSERT_FALSE(gen.is_reg_pinned(generator::x86_64::REG_15));
+}
+
+TEST(GeneratorRounding, hoisted) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_rounding_loop_ir, Generator::OPT_MBRA);
+    }
+    // the loop is entered with rdn and only switches back to rne when it's left
+    const auto view = buf.view();
+    const auto loop_start = view.find("b1_reg_alloc:\n");
+    const auto loop_end = view.find("b1_reg_alloc_cf1:\n");
+    ASSERT_NE(loop_start, std::string_view::npos);
+    ASSERT_NE(loop_end, std::string_view::npos);
+    const auto loop = view.substr(loop_start, loop_end - loop_start);
+    ASSERT_EQ(loop.find("ldmxcsr"), std::string_view::npos);
+    ASSERT_NE(loop.find("cvttsd2si"), std::string_view::npos);
+    ASSERT_NE(view.find("ldmxcsr"), std::string_view::npos);
+}
+
+TEST(GeneratorRounding, sse4) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_rounding_loop_ir, Generator::OPT_MBRA | Generator::OPT_ARCH_SSE4);
+    }
+    ASSERT_EQ(buf.view().find("ldmxcsr"), std::string_view::npos);
+    ASSERT_NE(buf.view().find("roundsd"), std::string_view::npos);
+}
+
+TEST(GeneratorRounding, no_mbra) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_rounding_loop_ir);
+    }
+    // one switch to rdn and one back to rne at the end of the loop block
+    const auto view = buf.view();
+    const auto first = view.find("ldmxcsr");
+    ASSERT_NE(first, std::string_view::npos);
+    const auto second = view.find("ldmxcsr", first + 1);
+    ASSERT_NE(second, std::string_view::npos);
+    ASSERT_EQ(view.find("ldmxcsr", second + 1), std::string_view::npos);
+    ASSERT_NE(view.find("cvttsd2si"), std::string_view::npos);
+}
+
+TEST(GeneratorInlineCache, sites) {
+    for (const uint32_t optimizations : {0u, static_cast<uint32_t>(Generator::OPT_MBRA)}) {
+        Buffer buf;
+        {
+            auto file = buf.open();
+            run_generator(file, gen_call_ir, optimizations | Generator::OPT_INLINE_CACHE);
+        }
+        // returns go through their own cache, only the megamorphic fallback refers to the shared lookup
+        const auto view = buf.view();
+        ASSERT_EQ(view.find("jmp ijump_lookup"), std::string_view::npos);
+        ASSERT_NE(view.find("ijump_cache_miss:"), std::string_view::npos);
+        ASSERT_NE(view.find("_ic_data:\n.8byte"), std::string_view::npos);
+    }
+}
+
+TEST(GeneratorInlineCache, disabled) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_call_ir, Generator::OPT_MBRA);
+    }
+    ASSERT_NE(buf.view().find("jmp ijump_lookup"), std::string_view::npos);
+    ASSERT_EQ(buf.view().find("ijump_cache_miss"), std::string_view::npos);
+}
+
+TEST(GeneratorJumpTable, dispatch) {
+    for (const uint32_t optimizations : {0u, static_cast<uint32_t>(Generator::OPT_MBRA)}) {
+        Buffer buf;
+        {
+            auto file = buf.open();
+            run_generator(file, gen_jump_table_ir, optimizations | Generator::OPT_JUMP_TABLES);
+        }
+        // entries without a block and indices out of range fall back to the lookup
+        const auto view = buf.view();
+        ASSERT_NE(view.find("_jt:\n.8byte b1\n.8byte b2\n.8byte ijump_lookup\n"), std::string_view::npos);
+        ASSERT_NE(view.find("ja ijump_lookup\njmp [b0_cf0_jt + "), std::string_view::npos);
+    }
+}
+
+TEST(GeneratorJumpTable, disabled) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_jump_table_ir, Generator::OPT_MBRA);
+    }
+    ASSERT_EQ(buf.view().find("_jt"), std::string_view::npos);
+}
+
+TEST(GeneratorInlineSyscalls, passthrough) {
+    for (const uint32_t optimizations : {0u, static_cast<uint32_t>(Generator::OPT_MBRA)}) {
+        Buffer buf;
+        {
+            auto file = buf.open();
+            run_generator(file, gen_print_ir, optimizations | Generator::OPT_INLINE_SYSCALLS);
+        }
+        // write is passed through with the x86 number, exit is handled by the helper
+        const auto view = buf.view();
+        ASSERT_NE(view.find("mov eax, 1\nsyscall\n"), std::string_view::npos);
+        ASSERT_NE(view.find("call syscall_impl"), std::string_view::npos);
+    }
+}
+
+TEST(GeneratorInlineSyscalls, disabled) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_print_ir, Generator::OPT_MBRA);
+    }
+    ASSERT_EQ(buf.view().find("\nsyscall\n"), std::string_view::npos);
+}
+
+TEST(GeneratorInlineSyscalls, not_with_stats) {
+    for (const uint32_t optimizations : {0u, static_cast<uint32_t>(Generator::OPT_MBRA)}) {
+        Buffer buf;
+        {
+            IR ir{};
+            gen_print_ir(ir);
+
+            auto file = buf.open();
+            Generator gen(&ir, {}, file.handle());
+            gen.optimizations = optimizations | Generator::OPT_INLINE_SYSCALLS;
+            gen.count_stats = true;
+            gen.compile();
+        }
+        // the helper has to count the write as well
+        const auto view = buf.view();
+        ASSERT_EQ(view.find("\nsyscall\n"), std::string_view::npos);
+        ASSERT_NE(view.find("call syscall_impl"), std::string_view::npos);
+    }
+}
+
+TEST(GeneratorLibcRoutines, direct_call) {
+    for (const uint32_t optimizations : {0u, static_cast<uint32_t>(Generator::OPT_MBRA)}) {
+        Buffer buf;
+        {
+            auto file = buf.open();
+            run_generator(file, gen_libc_routine_ir, optimizations);
+        }
+        // memcpy is called directly with a0-a2 and returns in a0, only the exit goes through syscall_impl
+        const auto view = buf.view();
+        ASSERT_NE(view.find("call libc_memcpy\nmov [s1], rax\n"), std::string_view::npos);
+        ASSERT_EQ(view.find("call syscall_impl"), view.rfind("call syscall_impl"));
+    }
+}
+
+TEST(GeneratorMultithreaded, tcb_relative) {
+    for (const uint32_t optimizations : {0u, static_cast<uint32_t>(Generator::OPT_MBRA)}) {
+        Buffer buf;
+        {
+            IR ir{};
+            gen_call_ir(ir);
+
+            auto file = buf.open();
+            Generator gen(&ir, {}, file.handle());
+            gen.optimizations = optimizations | Generator::OPT_INLINE_CACHE;
+            gen.multithreaded_guest = true;
+            gen.compile();
+        }
+        // the statics are offsets into the thread's block, the inline caches aren't thread safe
+        const auto view = buf.view();
+        ASSERT_NE(view.find("s0 = 0\n"), std::string_view::npos);
+        ASSERT_NE(view.find("fs:[s"), std::string_view::npos);
+        ASSERT_NE(view.find("cmp rsp, fs:[ret_stack_limit]"), std::string_view::npos);
+        ASSERT_NE(view.find("multithreaded:\n.byte 1\n"), std::string_view::npos);
+        ASSERT_NE(view.find("thread_start:\npop rdi\ncall unresolved_ijump_handler\n"), std::string_view::npos);
+        ASSERT_EQ(view.find("init_stack_ptr:\n.8byte 0\n"), std::string_view::npos);
+        ASSERT_EQ(view.find("ijump_cache_miss"), std::string_view::npos);
+    }
+}
+
+TEST(GeneratorMultithreaded, pinned_syscall) {
+    Buffer buf;
+    std::vector<size_t> pinned_statics;
+    {
+        IR ir{};
+        gen_print_ir(ir);
+
+        auto file = buf.open();
+        Generator gen(&ir, {}, file.handle());
+        gen.optimizations = Generator::OPT_MBRA;
+        gen.pinned_statics = pinned_statics = gen.choose_pinned_statics();
+        gen.multithreaded_guest = true;
+        gen.compile();
+    }
+    // a thread created by the syscall only gets the register file, the pinned statics are synced around the call
+    ASSERT_FALSE(pinned_statics.empty());
+    const auto last = pinned_statics.size() - 1;
+    const auto around_call = "mov fs:[s" + std::to_string(pinned_statics[last]) + "], r1" + std::to_string(2 + last) + "\ncall syscall_impl\nmov r12, fs:[s" +
+                             std::to_string(pinned_statics[0]) + "]\n";
+    ASSERT_NE(buf.view().find(around_call), std::string_view::npos);
+}
+
+TEST(GeneratorMultithreaded, single_threaded) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        run_generator(file, gen_call_ir, Generator::OPT_MBRA);
+    }
+    ASSERT_EQ(buf.view().find("fs:"), std::string_view::npos);
+    ASSERT_EQ(buf.view().find("thread_start"), std::string_view::npos);
+    ASSERT_NE(buf.view().find("multithreaded:\n.byte 0\n"), std::string_view::npos);
+}
+
+TEST(GeneratorAtomics, locked) {
+    for (const uint32_t optimizations : {0u, static_cast<uint32_t>(Generator::OPT_MBRA)}) {
+        Buffer buf;
+        {
+            IR ir{};
+            gen_atomics_ir(ir);
+
+            auto file = buf.open();
+            Generator gen(&ir, {}, file.handle());
+            gen.optimizations = optimizations;
+            gen.multithreaded_guest = true;
+            gen.compile();
+        }
+        // only the fence which orders a store before a load needs an mfence
+        const auto view = buf.view();
+        ASSERT_NE(view.find("lock xadd "), std::string_view::npos);
+        ASSERT_NE(view.find("_atomic:\n"), std::string_view::npos);
+        ASSERT_NE(view.find("lock cmpxchg "), std::string_view::npos);
+        ASSERT_NE(view.find("fs:[reservation]"), std::string_view::npos);
+        const auto fence = view.find("mfence\n");
+        ASSERT_NE(fence, std::string_view::npos);
+        ASSERT_EQ(view.find("mfence\n", fence + 1), std::string_view::npos);
+    }
+}
+
+TEST(GeneratorLookupTable, sparse_pages) {
+    Buffer buf;
+    {
+        auto file = buf.open();
+        // blocks in the first and the third page of the guest range, none in the second
+        run_generator(
+            file,
+            [](IR &ir) {
+                ir.add_static(Type::i64);
+                ir.setup_bb_addr_vec(0x10000, 0x12100);
+                for (const uint64_t addr : {0x10000, 0x10ffe, 0x12000}) {
+                    ir.add_basic_block(addr)->add_cf_op(CFCInstruction::unreachable, nullptr);
+                }
+                ir.entry_block = 0;
+            },
+            Generator::OPT_NO_HASH_LOOKUP);
+    }
+    const auto view = buf.view();
+    ASSERT_NE(view.find("ijump_lookup_table:\n.8byte ijump_lookup_page0\n.8byte ijump_lookup_empty_page\n.8byte ijump_lookup_page2\nijump_lookup_table_end:"), std::string_view::npos);
+    ASSERT_NE(view.find("ijump_lookup_page0:\n# 0x10000:\n.8byte b0\n.space 16368\n# 0x10ffe:\n.8byte b1\n"), std::string_view::npos);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
 }
+
+TEST(GeneratorStats, counters) {
+    for (const auto optimizations : {0u, static_cast<uint32_t>(Generator::OPT_MBRA)}) {
+        for (const auto count_stats : {false, true}) {
+            Buffer buf;
+            {
+                IR ir{};
+                gen_call_ir(ir);
+
+                auto file = buf.open();
+                Generator gen(&ir, {}, file.handle());
+                gen.optimizations = optimizations;
+                gen.count_stats = count_stats;
+                gen.compile();
+            }
+            const auto output = buf.view();
+            ASSERT_EQ(output.find("inc QWORD PTR [stats_ijump_lookups]") != std::string_view::npos, count_stats);
+            ASSERT_EQ(output.find("inc QWORD PTR [stats_ret_mispredicts]") != std::string_view::npos, count_stats);
+            ASSERT_NE(output.find(count_stats ? "stats_counted:\n.byte 1\n" : "stats_counted:\n.byte 0\n"), std::string_view::npos);
+        }
+    }
+}
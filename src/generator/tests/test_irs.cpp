@@ -1,5 +1,7 @@
 #include "test_irs.h"
 
+#include "generator/syscall_ids.h"
+
 void gen_print_ir(IR &ir) {
     (void)ir.add_static(Type::i64);                /* x0 */
     const auto static0 = ir.add_static(Type::i64); /* x1 */
@@ -215,6 +217,8 @@ void gen_print_ir(IR &ir) {
                 auto op = std::make_unique<Operation>(Instruction::store);
                 op->set_inputs(new_stack_ptr, newline, mt0);
                 op->set_outputs(mt1);
+                // the store size is normally set by the lifter
+                op->lifter_info.in_op_size = Type::i64;
                 mt1->set_op(std::move(op));
             }
 
@@ -490,3 +494,672 @@ void gen_first_ir(IR &ir) {
 
     ir.entry_block = block2->id;
 }
+
+void gen_call_ir(IR &ir) {
+    // x0, ra and the argument registers a0-a7
+    for (size_t i = 0; i < 18; ++i) {
+        (void)ir.add_static(Type::i64);
+    }
+
+    ir.setup_bb_addr_vec(10, 100);
+
+    auto *block1 = ir.add_basic_block(10);
+    auto *func = ir.add_basic_block(40);
+    auto *cont = ir.add_basic_block(14);
+    func->gen_info.call_target = true;
+    cont->gen_info.call_cont_block = true;
+
+    std::vector<SSAVar *> block1_in, func_in, cont_in;
+    for (size_t i = 1; i < 18; ++i) {
+        block1_in.push_back(block1->add_var_from_static(i, 10));
+        func_in.push_back(func->add_var_from_static(i, 40));
+        cont_in.push_back(cont->add_var_from_static(i, 14));
+    }
+
+    {
+        auto *imm = block1->add_var_imm(1, 10);
+        auto *var = block1->add_var(Type::i64, 10); // a0 = a0 + 1
+        {
+            auto op = std::make_unique<Operation>(Instruction::add);
+            op->set_inputs(block1_in[9], imm);
+            op->set_outputs(var);
+            var->set_op(std::move(op));
+        }
+        auto *ret_addr = block1->add_var_imm(14, 10, true);
+
+        auto &op = block1->add_cf_op(CFCInstruction::call, func);
+        std::get<CfOp::CallInfo>(op.info).continuation_block = cont;
+        for (size_t i = 1; i < 18; ++i) {
+            op.add_target_input(i == 1 ? ret_addr : (i == 10 ? var : block1_in[i - 1]), i);
+        }
+    }
+
+    {
+        auto *var = func->add_var(Type::i64, 40); // a0 = a0 + a1
+        {
+            auto op = std::make_unique<Operation>(Instruction::add);
+            op->set_inputs(func_in[9], func_in[10]);
+            op->set_outputs(var);
+            var->set_op(std::move(op));
+        }
+
+        auto &op = func->add_cf_op(CFCInstruction::_return, nullptr);
+        op.set_inputs(func_in[0]);
+        auto &ret_info = std::get<CfOp::RetInfo>(op.info);
+        for (size_t i = 1; i < 18; ++i) {
+            ret_info.mapping.emplace_back(i == 10 ? var : func_in[i - 1], i);
+        }
+    }
+
+    {
+        auto *imm = cont->add_var_imm(93, 14);
+        auto &op = cont->add_cf_op(CFCInstruction::syscall, cont);
+        op.set_inputs(imm, cont_in[9]);
+        for (size_t i = 1; i < 18; ++i) {
+            op.add_target_input(cont_in[i - 1], i);
+        }
+    }
+
+    ir.entry_block = block1->id;
+}
+
+void gen_dead_static_ir(IR &ir) {
+    const auto static0 = ir.add_static(Type::i64);
+    const auto static1 = ir.add_static(Type::i64);
+    const auto static2 = ir.add_static(Type::i64);
+
+    ir.setup_bb_addr_vec(10, 100);
+
+    auto *block1 = ir.add_basic_block(10);
+    auto *block2 = ir.add_basic_block(20);
+    auto *block2_in1 = block2->add_var_from_static(static1, 20);
+    auto *block2_in2 = block2->add_var_from_static(static2, 20);
+    {
+        auto *in2 = block1->add_var_from_static(static2, 10);
+        auto *v1 = block1->add_var_imm(1, 10);
+        auto *v2 = block1->add_var_imm(2, 10);
+        auto *v3 = block1->add_var(Type::i64, 10); // temporary, overwritten in block2 before it is read
+        {
+            auto op = std::make_unique<Operation>(Instruction::add);
+            op->set_inputs(v1, v2);
+            op->set_outputs(v3);
+            v3->set_op(std::move(op));
+        }
+
+        auto &cf_op = block1->add_cf_op(CFCInstruction::jump, block2);
+        cf_op.add_target_input(v3, static1);
+        cf_op.add_target_input(in2, static2);
+    }
+
+    {
+        (void)block2_in1;
+        auto *imm = block2->add_var_imm(5, 20);
+        auto *id = block2->add_var_imm(93, 20);
+        auto &cf_op = block2->add_cf_op(CFCInstruction::syscall, block2);
+        cf_op.set_inputs(id, block2_in2);
+        cf_op.add_target_input(imm, static1);
+        cf_op.add_target_input(block2_in2, static2);
+    }
+
+    (void)static0;
+    ir.entry_block = block1->id;
+}
+
+void gen_fused_cmp_ir(IR &ir) {
+    // static 0 is never a block input
+    ir.add_static(Type::i64);
+    const auto static1 = ir.add_static(Type::i64);
+    const auto static2 = ir.add_static(Type::i64);
+    const auto static3 = ir.add_static(Type::f64);
+    const auto static4 = ir.add_static(Type::f64);
+
+    ir.setup_bb_addr_vec(10, 100);
+
+    auto *int_block = ir.add_basic_block(10);
+    auto *fp_block = ir.add_basic_block(20);
+    auto *exit_block = ir.add_basic_block(30);
+    auto *fp_in0 = fp_block->add_var_from_static(static1, 20);
+    auto *fp_in2 = fp_block->add_var_from_static(static3, 20);
+    auto *fp_in3 = fp_block->add_var_from_static(static4, 20);
+    auto *exit_in0 = exit_block->add_var_from_static(static1, 30);
+    {
+        // v4 <- slt v0, v1, 1, 0; cjump eq v4, 0
+        auto *in0 = int_block->add_var_from_static(static1, 10);
+        auto *in1 = int_block->add_var_from_static(static2, 10);
+        auto *in2 = int_block->add_var_from_static(static3, 10);
+        auto *in3 = int_block->add_var_from_static(static4, 10);
+        auto *one = int_block->add_var_imm(1, 10);
+        auto *zero = int_block->add_var_imm(0, 10);
+        auto *cmp = int_block->add_var(Type::i64, 10);
+        {
+            auto op = std::make_unique<Operation>(Instruction::slt);
+            op->set_inputs(in0, in1, one, zero);
+            op->set_outputs(cmp);
+            cmp->set_op(std::move(op));
+        }
+
+        auto *null = int_block->add_var_imm(0, 10);
+        auto &cf_op = int_block->add_cf_op(CFCInstruction::cjump, exit_block);
+        cf_op.set_inputs(cmp, null);
+        std::get<CfOp::CJumpInfo>(cf_op.info).type = CfOp::CJumpInfo::CJumpType::eq;
+        cf_op.add_target_input(in0, static1);
+
+        auto &jmp_op = int_block->add_cf_op(CFCInstruction::jump, fp_block);
+        jmp_op.add_target_input(in0, static1);
+        jmp_op.add_target_input(in2, static3);
+        jmp_op.add_target_input(in3, static4);
+    }
+
+    {
+        // v5 <- seq v1, v2, 1, 0; cjump eq v5, 0
+        auto *one = fp_block->add_var_imm(1, 20);
+        auto *zero = fp_block->add_var_imm(0, 20);
+        auto *cmp = fp_block->add_var(Type::i64, 20);
+        {
+            auto op = std::make_unique<Operation>(Instruction::seq);
+            op->set_inputs(fp_in2, fp_in3, one, zero);
+            op->set_outputs(cmp);
+            cmp->set_op(std::move(op));
+        }
+
+        auto *null = fp_block->add_var_imm(0, 20);
+        auto &cf_op = fp_block->add_cf_op(CFCInstruction::cjump, exit_block);
+        cf_op.set_inputs(cmp, null);
+        std::get<CfOp::CJumpInfo>(cf_op.info).type = CfOp::CJumpInfo::CJumpType::eq;
+        cf_op.add_target_input(fp_in0, static1);
+
+        auto &jmp_op = fp_block->add_cf_op(CFCInstruction::jump, exit_block);
+        jmp_op.add_target_input(fp_in0, static1);
+    }
+
+    {
+        auto *id = exit_block->add_var_imm(93, 30);
+        auto &cf_op = exit_block->add_cf_op(CFCInstruction::syscall, exit_block);
+        cf_op.set_inputs(id, exit_in0);
+        cf_op.add_target_input(exit_in0, static1);
+    }
+
+    ir.entry_block = int_block->id;
+}
+
+void gen_scaled_load_ir(IR &ir) {
+    // static 0 is never a block input
+    ir.add_static(Type::i64);
+    const auto static1 = ir.add_static(Type::i64);
+    const auto static2 = ir.add_static(Type::i64);
+
+    ir.setup_bb_addr_vec(10, 100);
+
+    auto *entry_block = ir.add_basic_block(10);
+    auto *exit_block = ir.add_basic_block(20);
+    auto *exit_in0 = exit_block->add_var_from_static(static1, 20);
+    {
+        auto *base = entry_block->add_var_from_static(static1, 10);
+        auto *idx = entry_block->add_var_from_static(static2, 10);
+        auto *mt0 = entry_block->add_var(Type::mt, 10);
+        const auto add_op = [entry_block](const Instruction type, SSAVar *in1, SSAVar *in2) {
+            auto *out = entry_block->add_var(Type::i64, 10);
+            auto op = std::make_unique<Operation>(type);
+            op->set_inputs(in1, in2);
+            op->set_outputs(out);
+            out->set_op(std::move(op));
+            return out;
+        };
+
+        // v <- load (base + (idx << 3) + 16)
+        auto *three = entry_block->add_var_imm(3, 10);
+        auto *scaled = add_op(Instruction::shl, idx, three);
+        auto *sum = add_op(Instruction::add, base, scaled);
+        auto *disp = entry_block->add_var_imm(16, 10);
+        auto *addr = add_op(Instruction::add, sum, disp);
+        auto *val = entry_block->add_var(Type::i64, 10);
+        {
+            auto op = std::make_unique<Operation>(Instruction::load);
+            op->set_inputs(addr, mt0);
+            op->set_outputs(val);
+            val->set_op(std::move(op));
+        }
+
+        // res <- v + load base
+        auto *val2 = entry_block->add_var(Type::i64, 10);
+        {
+            auto op = std::make_unique<Operation>(Instruction::load);
+            op->set_inputs(base, mt0);
+            op->set_outputs(val2);
+            val2->set_op(std::move(op));
+        }
+        auto *res = add_op(Instruction::add, val, val2);
+
+        // store (base + (idx << 3) + 8), res
+        auto *three2 = entry_block->add_var_imm(3, 10);
+        auto *scaled2 = add_op(Instruction::shl, idx, three2);
+        auto *sum2 = add_op(Instruction::add, scaled2, base);
+        auto *disp2 = entry_block->add_var_imm(8, 10);
+        auto *addr2 = add_op(Instruction::add, sum2, disp2);
+        auto *mt1 = entry_block->add_var(Type::mt, 10);
+        {
+            auto op = std::make_unique<Operation>(Instruction::store);
+            op->set_inputs(addr2, res, mt0);
+            op->set_outputs(mt1);
+            op->lifter_info.in_op_size = Type::i64;
+            mt1->set_op(std::move(op));
+        }
+
+        auto &cf_op = entry_block->add_cf_op(CFCInstruction::jump, exit_block);
+        cf_op.add_target_input(res, static1);
+    }
+
+    {
+        auto *id = exit_block->add_var_imm(93, 20);
+        auto &cf_op = exit_block->add_cf_op(CFCInstruction::syscall, exit_block);
+        cf_op.set_inputs(id, exit_in0);
+        cf_op.add_target_input(exit_in0, static1);
+    }
+
+    ir.entry_block = entry_block->id;
+}
+
+void gen_rounding_loop_ir(IR &ir) {
+    // static 0 is never a block input
+    ir.add_static(Type::i64);
+    const auto static1 = ir.add_static(Type::i64);
+    const auto static2 = ir.add_static(Type::f64);
+
+    ir.setup_bb_addr_vec(10, 100);
+
+    auto *entry_block = ir.add_basic_block(10);
+    auto *loop_block = ir.add_basic_block(20);
+    auto *exit_block = ir.add_basic_block(30);
+    auto *loop_in0 = loop_block->add_var_from_static(static1, 20);
+    auto *loop_in1 = loop_block->add_var_from_static(static2, 20);
+    auto *exit_in0 = exit_block->add_var_from_static(static1, 30);
+    {
+        auto *in0 = entry_block->add_var_from_static(static1, 10);
+        auto *in1 = entry_block->add_var_from_static(static2, 10);
+        auto &cf_op = entry_block->add_cf_op(CFCInstruction::jump, loop_block);
+        cf_op.add_target_input(in0, static1);
+        cf_op.add_target_input(in1, static2);
+    }
+
+    {
+        // v2 <- convert v1 (rdn), v3 <- convert v1 (rtz), v4 <- v0 + v2 - v3
+        const auto add_convert = [loop_block, loop_in1](const RoundingMode mode) {
+            auto *out = loop_block->add_var(Type::i64, 20);
+            auto op = std::make_unique<Operation>(Instruction::convert);
+            op->set_inputs(loop_in1);
+            op->set_outputs(out);
+            op->set_rounding_mode(mode);
+            op->lifter_info.in_op_size = Type::f64;
+            out->set_op(std::move(op));
+            return out;
+        };
+        auto *floor = add_convert(RoundingMode::DOWN);
+        auto *trunc = add_convert(RoundingMode::ZERO);
+        auto *sum = loop_block->add_var(Type::i64, 20);
+        {
+            auto op = std::make_unique<Operation>(Instruction::add);
+            op->set_inputs(loop_in0, floor);
+            op->set_outputs(sum);
+            sum->set_op(std::move(op));
+        }
+        auto *diff = loop_block->add_var(Type::i64, 20);
+        {
+            auto op = std::make_unique<Operation>(Instruction::sub);
+            op->set_inputs(sum, trunc);
+            op->set_outputs(diff);
+            diff->set_op(std::move(op));
+        }
+
+        auto *null = loop_block->add_var_imm(0, 20);
+        auto &cf_op = loop_block->add_cf_op(CFCInstruction::cjump, loop_block);
+        cf_op.set_inputs(diff, null);
+        std::get<CfOp::CJumpInfo>(cf_op.info).type = CfOp::CJumpInfo::CJumpType::neq;
+        cf_op.add_target_input(diff, static1);
+        cf_op.add_target_input(loop_in1, static2);
+
+        auto &jmp_op = loop_block->add_cf_op(CFCInstruction::jump, exit_block);
+        jmp_op.add_target_input(diff, static1);
+    }
+
+    {
+        auto *id = exit_block->add_var_imm(93, 30);
+        auto &cf_op = exit_block->add_cf_op(CFCInstruction::syscall, exit_block);
+        cf_op.set_inputs(id, exit_in0);
+        cf_op.add_target_input(exit_in0, static1);
+    }
+
+    ir.entry_block = entry_block->id;
+}
+
+void gen_jump_table_ir(IR &ir) {
+    // static 0 is never a block input
+    ir.add_static(Type::i64);
+    const auto static1 = ir.add_static(Type::i64);
+
+    ir.setup_bb_addr_vec(10, 100);
+
+    auto *entry_block = ir.add_basic_block(10);
+    auto *case0_block = ir.add_basic_block(20);
+    auto *case1_block = ir.add_basic_block(30);
+    {
+        auto *idx = entry_block->add_var_from_static(static1, 10);
+        auto *mt0 = entry_block->add_var(Type::mt, 10);
+        const auto add_op = [entry_block](const Instruction type, SSAVar *in1, SSAVar *in2) {
+            auto *out = entry_block->add_var(Type::i64, 10);
+            auto op = std::make_unique<Operation>(type);
+            op->set_inputs(in1, in2);
+            op->set_outputs(out);
+            out->set_op(std::move(op));
+            return out;
+        };
+
+        // ijump load (0x1000 + (idx << 3)) with a table of three entries, the last one isn't a block
+        auto *three = entry_block->add_var_imm(3, 10);
+        auto *scaled = add_op(Instruction::shl, idx, three);
+        auto *base = entry_block->add_var_imm(0x1000, 10);
+        auto *entry_addr = add_op(Instruction::add, base, scaled);
+        auto *dst = entry_block->add_var(Type::i64, 10);
+        {
+            auto op = std::make_unique<Operation>(Instruction::load);
+            op->set_inputs(entry_addr, mt0);
+            op->set_outputs(dst);
+            dst->set_op(std::move(op));
+        }
+
+        auto &cf_op = entry_block->add_cf_op(CFCInstruction::ijump, nullptr);
+        cf_op.set_inputs(dst, entry_addr);
+        auto &info = std::get<CfOp::IJumpInfo>(cf_op.info);
+        info.jump_table = CfOp::JumpTable{0x1000, 8, {20, 30, 44}};
+        cf_op.add_target_input(idx, static1);
+    }
+
+    for (auto *block : {case0_block, case1_block}) {
+        auto *in0 = block->add_var_from_static(static1, block->virt_start_addr);
+        auto *id = block->add_var_imm(93, block->virt_start_addr);
+        auto &cf_op = block->add_cf_op(CFCInstruction::syscall, block);
+        cf_op.set_inputs(id, in0);
+        cf_op.add_target_input(in0, static1);
+    }
+
+    ir.entry_block = entry_block->id;
+}
+
+void gen_atomics_ir(IR &ir) {
+    // static 0 is never a block input
+    ir.add_static(Type::i64);
+    const auto static1 = ir.add_static(Type::i64);
+    const auto static2 = ir.add_static(Type::i64);
+
+    ir.setup_bb_addr_vec(10, 100);
+
+    auto *entry_block = ir.add_basic_block(10);
+    auto *exit_block = ir.add_basic_block(20);
+    auto *exit_in0 = exit_block->add_var_from_static(static1, 20);
+    {
+        auto *addr = entry_block->add_var_from_static(static1, 10);
+        auto *val = entry_block->add_var_from_static(static2, 10);
+        auto *mt0 = entry_block->add_var(Type::mt, 10);
+        // the atomics also output a memory token which replaces mt
+        const auto add_rmw = [entry_block, addr](const Instruction rmw_op, SSAVar *in, SSAVar *&mt) {
+            auto *out = entry_block->add_var(Type::i64, 10);
+            auto *mt_out = entry_block->add_var(Type::mt, 10);
+            auto op = std::make_unique<Operation>(Instruction::atomic_rmw);
+            op->set_inputs(addr, in, mt);
+            op->set_outputs(out, mt_out);
+            mt = mt_out;
+            op->lifter_info.in_op_size = Type::i64;
+            op->atomic_info.rmw_op = rmw_op;
+            out->set_op(std::move(op));
+            return out;
+        };
+        const auto add_fence = [entry_block](SSAVar *mt_in, const uint8_t pred, const uint8_t succ) {
+            auto *mt_out = entry_block->add_var(Type::mt, 10);
+            auto op = std::make_unique<Operation>(Instruction::fence);
+            op->set_inputs(mt_in);
+            op->set_outputs(mt_out);
+            op->atomic_info.pred = pred;
+            op->atomic_info.succ = succ;
+            mt_out->set_op(std::move(op));
+            return mt_out;
+        };
+
+        // amoadd.d, amomaxu.d
+        SSAVar *mt = mt0;
+        auto *old_val = add_rmw(Instruction::add, val, mt);
+        auto *max_val = add_rmw(Instruction::umax, old_val, mt);
+
+        // fence w, r needs a barrier on x86, fence r, rw doesn't
+        auto *mt1 = add_fence(mt, Operation::AtomicInfo::WRITE, Operation::AtomicInfo::READ);
+        auto *mt2 = add_fence(mt1, Operation::AtomicInfo::READ, Operation::AtomicInfo::READ | Operation::AtomicInfo::WRITE);
+
+        // sc.d of max_val
+        auto *expected = entry_block->add_var(Type::i64, 10);
+        {
+            auto op = std::make_unique<Operation>(Instruction::reservation);
+            op->set_outputs(expected);
+            op->lifter_info.in_op_size = Type::i64;
+            expected->set_op(std::move(op));
+        }
+        auto *res = entry_block->add_var(Type::i64, 10);
+        auto *mt3 = entry_block->add_var(Type::mt, 10);
+        {
+            auto op = std::make_unique<Operation>(Instruction::cas);
+            op->set_inputs(addr, expected, max_val, mt2);
+            op->set_outputs(res, mt3);
+            op->lifter_info.in_op_size = Type::i64;
+            res->set_op(std::move(op));
+        }
+
+        auto &cf_op = entry_block->add_cf_op(CFCInstruction::jump, exit_block);
+        cf_op.add_target_input(res, static1);
+    }
+
+    {
+        auto *id = exit_block->add_var_imm(93, 20);
+        auto &cf_op = exit_block->add_cf_op(CFCInstruction::syscall, exit_block);
+        cf_op.set_inputs(id, exit_in0);
+        cf_op.add_target_input(exit_in0, static1);
+    }
+
+    ir.entry_block = entry_block->id;
+}
+
+void gen_layout_ir(IR &ir) {
+    // static 0 is never a block input
+    ir.add_static(Type::i64);
+    const auto static1 = ir.add_static(Type::i64);
+
+    ir.setup_bb_addr_vec(10, 100);
+
+    // b0 branches to b1 or falls through to b2, both continue at b3. b0 -> b2 and b1 -> b3 are chained,
+    // so the layout is b0, b2, b1, b3 and b2 needs a jump to b3
+    auto *entry_block = ir.add_basic_block(10);
+    auto *left_block = ir.add_basic_block(20);
+    auto *right_block = ir.add_basic_block(30);
+    auto *exit_block = ir.add_basic_block(40);
+    {
+        auto *in0 = entry_block->add_var_from_static(static1, 10);
+        auto *null = entry_block->add_var_imm(0, 10);
+        auto &cf_op = entry_block->add_cf_op(CFCInstruction::cjump, left_block);
+        cf_op.set_inputs(in0, null);
+        std::get<CfOp::CJumpInfo>(cf_op.info).type = CfOp::CJumpInfo::CJumpType::eq;
+        cf_op.add_target_input(in0, static1);
+
+        auto &jmp_op = entry_block->add_cf_op(CFCInstruction::jump, right_block);
+        jmp_op.add_target_input(in0, static1);
+    }
+
+    for (auto *block : {left_block, right_block}) {
+        auto *in0 = block->add_var_from_static(static1, block->virt_start_addr);
+        auto &cf_op = block->add_cf_op(CFCInstruction::jump, exit_block);
+        cf_op.add_target_input(in0, static1);
+    }
+
+    {
+        auto *in0 = exit_block->add_var_from_static(static1, 40);
+        auto *id = exit_block->add_var_imm(93, 40);
+        auto &cf_op = exit_block->add_cf_op(CFCInstruction::syscall, exit_block);
+        cf_op.set_inputs(id, in0);
+        cf_op.add_target_input(in0, static1);
+    }
+
+    ir.entry_block = entry_block->id;
+}
+
+void gen_liveness_ir(IR &ir) {
+    // static 0 is never used
+    ir.add_static(Type::i64);
+    const auto static1 = ir.add_static(Type::i64);
+    const auto static2 = ir.add_static(Type::i64);
+    const auto static3 = ir.add_static(Type::i64);
+
+    ir.setup_bb_addr_vec(10, 100);
+
+    // b0 branches on static1 into the loop b1, which counts static2 up, or to b2, which overwrites static3.
+    // Both continue at b3 which only reads static3, so static3 is dead on the way through b2
+    auto *entry_block = ir.add_basic_block(10);
+    auto *loop_block = ir.add_basic_block(20);
+    auto *overwrite_block = ir.add_basic_block(30);
+    auto *exit_block = ir.add_basic_block(40);
+    {
+        auto *in1 = entry_block->add_var_from_static(static1, 10);
+        auto *in2 = entry_block->add_var_from_static(static2, 10);
+        auto *in3 = entry_block->add_var_from_static(static3, 10);
+        auto *null = entry_block->add_var_imm(0, 10);
+        auto &cf_op = entry_block->add_cf_op(CFCInstruction::cjump, loop_block);
+        cf_op.set_inputs(in1, null);
+        std::get<CfOp::CJumpInfo>(cf_op.info).type = CfOp::CJumpInfo::CJumpType::eq;
+        cf_op.add_target_input(in1, static1);
+        cf_op.add_target_input(in2, static2);
+        cf_op.add_target_input(in3, static3);
+
+        entry_block->add_cf_op(CFCInstruction::jump, overwrite_block);
+    }
+
+    {
+        // static1 stays an input of the loop, it is only never read in it
+        loop_block->add_var_from_static(static1, 20);
+        auto *in2 = loop_block->add_var_from_static(static2, 20);
+        auto *in3 = loop_block->add_var_from_static(static3, 20);
+        auto *one = loop_block->add_var_imm(1, 20);
+        auto *null = loop_block->add_var_imm(0, 20);
+        auto *counter = loop_block->add_var(Type::i64, 20);
+        {
+            auto op = std::make_unique<Operation>(Instruction::add);
+            op->set_inputs(in2, one);
+            op->set_outputs(counter);
+            counter->set_op(std::move(op));
+        }
+
+        auto &cf_op = loop_block->add_cf_op(CFCInstruction::cjump, loop_block);
+        cf_op.set_inputs(counter, null);
+        std::get<CfOp::CJumpInfo>(cf_op.info).type = CfOp::CJumpInfo::CJumpType::neq;
+        // static1 gets the counter as well, but nothing reads it anymore so the write back can be dropped
+        cf_op.add_target_input(counter, static1);
+        cf_op.add_target_input(counter, static2);
+        cf_op.add_target_input(in3, static3);
+
+        auto &jmp_op = loop_block->add_cf_op(CFCInstruction::jump, exit_block);
+        jmp_op.add_target_input(in3, static3);
+    }
+
+    {
+        auto *imm = overwrite_block->add_var_imm(5, 30);
+        auto &cf_op = overwrite_block->add_cf_op(CFCInstruction::jump, exit_block);
+        cf_op.add_target_input(imm, static3);
+    }
+
+    {
+        auto *in3 = exit_block->add_var_from_static(static3, 40);
+        auto *sum = exit_block->add_var(Type::i64, 40);
+        {
+            auto op = std::make_unique<Operation>(Instruction::add);
+            op->set_inputs(in3, in3);
+            op->set_outputs(sum);
+            sum->set_op(std::move(op));
+        }
+        exit_block->add_cf_op(CFCInstruction::unreachable, nullptr);
+    }
+
+    ir.entry_block = entry_block->id;
+}
+
+void gen_pressure_ir(IR &ir) {
+    // more values are live at the same time than there are registers
+    constexpr size_t count = 20;
+    // static 0 is x0 and never a block input
+    for (size_t i = 0; i <= count; ++i) {
+        (void)ir.add_static(Type::i64);
+    }
+
+    ir.setup_bb_addr_vec(10, 100);
+
+    auto *block = ir.add_basic_block(10);
+    std::vector<SSAVar *> inputs, products;
+    for (size_t i = 0; i < count; ++i) {
+        inputs.push_back(block->add_var_from_static(i + 1, 10));
+    }
+
+    // p_i = s_i * s_i are all computed before the first of them is summed up
+    for (size_t i = 0; i < count; ++i) {
+        auto *var = block->add_var(Type::i64, 10);
+        auto op = std::make_unique<Operation>(Instruction::mul_l);
+        op->set_inputs(inputs[i], inputs[i]);
+        op->set_outputs(var);
+        var->set_op(std::move(op));
+        products.push_back(var);
+    }
+
+    auto *sum = products[0];
+    for (size_t i = 1; i < count; ++i) {
+        auto *var = block->add_var(Type::i64, 10);
+        auto op = std::make_unique<Operation>(Instruction::add);
+        op->set_inputs(sum, products[i]);
+        op->set_outputs(var);
+        var->set_op(std::move(op));
+        sum = var;
+    }
+
+    auto &cf_op = block->add_cf_op(CFCInstruction::jump, block);
+    cf_op.add_target_input(sum, 1);
+    for (size_t i = 1; i < count; ++i) {
+        cf_op.add_target_input(inputs[i], i + 1);
+    }
+
+    ir.entry_block = block->id;
+}
+
+void gen_libc_routine_ir(IR &ir) {
+    // memcpy substituted by the lifter: a syscall with the routine's id and a0-a2 (statics 1-3) as arguments
+    ir.add_static(Type::i64);
+    const auto static1 = ir.add_static(Type::i64);
+    const auto static2 = ir.add_static(Type::i64);
+    const auto static3 = ir.add_static(Type::i64);
+
+    ir.setup_bb_addr_vec(10, 100);
+
+    auto *entry_block = ir.add_basic_block(10);
+    auto *exit_block = ir.add_basic_block(20);
+    {
+        auto *in1 = entry_block->add_var_from_static(static1, 10);
+        auto *in2 = entry_block->add_var_from_static(static2, 10);
+        auto *in3 = entry_block->add_var_from_static(static3, 10);
+        auto *id = entry_block->add_var_imm(static_cast<int64_t>(LIBC_ROUTINE_ID::MEMCPY), 10);
+        auto &cf_op = entry_block->add_cf_op(CFCInstruction::syscall, exit_block);
+        cf_op.set_inputs(id, in1, in2, in3);
+        std::get<CfOp::SyscallInfo>(cf_op.info).static_mapping = {static1};
+        cf_op.add_target_input(in1, static1);
+        cf_op.add_target_input(in2, static2);
+        cf_op.add_target_input(in3, static3);
+    }
+
+    {
+        auto *in1 = exit_block->add_var_from_static(static1, 20);
+        auto *id = exit_block->add_var_imm(93, 20);
+        auto &cf_op = exit_block->add_cf_op(CFCInstruction::syscall, exit_block);
+        cf_op.set_inputs(id, in1);
+        cf_op.add_target_input(in1, static1);
+    }
+
+    ir.entry_block = entry_block->id;
+}
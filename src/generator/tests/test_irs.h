@@ -8,3 +8,14 @@ void gen_syscall_ir(IR &);
 void gen_third_ir(IR &);
 void gen_sec_ir(IR &);
 void gen_first_ir(IR &);
+void gen_call_ir(IR &);
+void gen_dead_static_ir(IR &);
+void gen_fused_cmp_ir(IR &);
+void gen_scaled_load_ir(IR &);
+void gen_rounding_loop_ir(IR &);
+void gen_jump_table_ir(IR &);
+void gen_atomics_ir(IR &);
+void gen_layout_ir(IR &);
+void gen_liveness_ir(IR &);
+void gen_pressure_ir(IR &);
+void gen_libc_routine_ir(IR &);
@@ -0,0 +1,1960 @@
+#include "generator/x86_64/assembler.h"
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstring>
+#include <elf.h>
+#include <fstream>
+#include <iterator>
+#include <optional>
+
+using namespace generator::x86_64::assembler;
+
+namespace {
+
+struct Register {
+    uint8_t num = 0;
+    // in bytes, 16 for xmm registers
+    uint8_t size = 0;
+    bool xmm = false;
+    // spl, bpl, sil and dil can only be encoded with a REX prefix
+    bool rex_only = false;
+    // ah, ch, dh and bh can only be encoded without one
+    bool high_byte = false;
+    bool rip = false;
+};
+
+} // namespace
+
+namespace generator::x86_64::assembler {
+
+enum class Form : uint8_t {
+    FIXED,     // no operands, opcode bytes only
+    RET,       // ret [imm16]
+    ALU,       // add, or, adc, sbb, and, sub, xor, cmp
+    MOV,       // mov
+    MOVX,      // movsx, movzx
+    MOVSXD,    // movsxd
+    LEA,       // lea
+    TEST,      // test
+    XCHG,      // xchg
+    PUSH,      // push
+    POP,       // pop
+    GROUP3,    // not, neg, mul, div, idiv (0xF6/0xF7) and inc, dec (0xFE/0xFF)
+    IMUL,      // imul with one, two or three operands
+    SHIFT,     // rol, ror, rcl, rcr, shl, sal, shr, sar
+    CMOV,      // cmovcc
+    SETCC,     // setcc
+    JMP,       // jmp
+    JCC,       // jcc
+    CALL,      // call
+    XADD,      // xadd, cmpxchg
+    SSE,       // xmm, xmm/m
+    MOVD,      // movd
+    MOVQ,      // movq
+    CVT_SI2F,  // cvtsi2ss, cvtsi2sd
+    CVT_F2SI,  // cvtss2si, cvtsd2si, cvttss2si, cvttsd2si
+    MXCSR,     // ldmxcsr, stmxcsr
+    FMA,       // vfmadd213ss, ...
+    BMI2_SHIFT // shlx, shrx, sarx
+};
+
+struct InstDesc {
+    Form form;
+    // opcode or opcode extension, depending on the form
+    uint8_t op = 0;
+    // mandatory prefix (0x66, 0xF2, 0xF3) or 0
+    uint8_t prefix = 0;
+    // base opcode of GROUP3
+    uint8_t op2 = 0;
+    // 1: 0F, 2: 0F 38, 3: 0F 3A
+    uint8_t map = 1;
+    // SSE instruction with an imm8 (rounds[s|d])
+    bool imm8 = false;
+    // VEX.W
+    bool w = false;
+    // FIXED: encoded bytes
+    std::array<uint8_t, 3> bytes{};
+    uint8_t len = 0;
+};
+
+} // namespace generator::x86_64::assembler
+
+namespace {
+
+namespace mir = generator::x86_64::mir;
+
+// descriptions of the machine IR opcodes, the condition of JCC, CMOVCC and SETCC is filled in per instruction
+const std::array<InstDesc, mir::OPCODE_COUNT> &instruction_table() {
+    using mir::Opcode;
+    static const auto table = [] {
+        std::array<InstDesc, mir::OPCODE_COUNT> insts{};
+        const auto set = [&insts](const Opcode op, const InstDesc &desc) { insts[static_cast<size_t>(op)] = desc; };
+
+        const auto fixed = [&set](const Opcode op, std::initializer_list<uint8_t> bytes) {
+            InstDesc desc{Form::FIXED};
+            std::copy(bytes.begin(), bytes.end(), desc.bytes.begin());
+            desc.len = static_cast<uint8_t>(bytes.size());
+            set(op, desc);
+        };
+        fixed(Opcode::CQO, {0x48, 0x99});
+        fixed(Opcode::CDQ, {0x99});
+        fixed(Opcode::SYSCALL, {0x0F, 0x05});
+        fixed(Opcode::MFENCE, {0x0F, 0xAE, 0xF0});
+        set(Opcode::RET, InstDesc{Form::RET});
+
+        set(Opcode::ADD, InstDesc{Form::ALU, 0});
+        set(Opcode::OR, InstDesc{Form::ALU, 1});
+        set(Opcode::AND, InstDesc{Form::ALU, 4});
+        set(Opcode::SUB, InstDesc{Form::ALU, 5});
+        set(Opcode::XOR, InstDesc{Form::ALU, 6});
+        set(Opcode::CMP, InstDesc{Form::ALU, 7});
+        set(Opcode::MOV, InstDesc{Form::MOV});
+        set(Opcode::MOVZX, InstDesc{Form::MOVX, 0xB6});
+        set(Opcode::MOVSX, InstDesc{Form::MOVX, 0xBE});
+        set(Opcode::MOVSXD, InstDesc{Form::MOVSXD});
+        set(Opcode::LEA, InstDesc{Form::LEA});
+        set(Opcode::TEST, InstDesc{Form::TEST});
+        set(Opcode::XCHG, InstDesc{Form::XCHG});
+        set(Opcode::PUSH, InstDesc{Form::PUSH});
+        set(Opcode::POP, InstDesc{Form::POP});
+        set(Opcode::INC, InstDesc{Form::GROUP3, 0, 0, 0xFE});
+        set(Opcode::NOT, InstDesc{Form::GROUP3, 2, 0, 0xF6});
+        set(Opcode::NEG, InstDesc{Form::GROUP3, 3, 0, 0xF6});
+        set(Opcode::MUL, InstDesc{Form::GROUP3, 4, 0, 0xF6});
+        set(Opcode::DIV, InstDesc{Form::GROUP3, 6, 0, 0xF6});
+        set(Opcode::IDIV, InstDesc{Form::GROUP3, 7, 0, 0xF6});
+        set(Opcode::IMUL, InstDesc{Form::IMUL});
+        set(Opcode::ROR, InstDesc{Form::SHIFT, 1});
+        set(Opcode::SHL, InstDesc{Form::SHIFT, 4});
+        set(Opcode::SHR, InstDesc{Form::SHIFT, 5});
+        set(Opcode::SAR, InstDesc{Form::SHIFT, 7});
+        set(Opcode::JMP, InstDesc{Form::JMP});
+        set(Opcode::JCC, InstDesc{Form::JCC});
+        set(Opcode::CALL, InstDesc{Form::CALL});
+        set(Opcode::CMOVCC, InstDesc{Form::CMOV});
+        set(Opcode::SETCC, InstDesc{Form::SETCC});
+        set(Opcode::XADD, InstDesc{Form::XADD, 0xC0});
+        set(Opcode::CMPXCHG, InstDesc{Form::XADD, 0xB0});
+
+        // scalar floating point arithmetic, the double precision variant follows the single precision one
+        const std::array<std::pair<Opcode, uint8_t>, 7> fp_arith = {
+            {{Opcode::ADDSS, 0x58}, {Opcode::SUBSS, 0x5C}, {Opcode::MULSS, 0x59}, {Opcode::DIVSS, 0x5E}, {Opcode::SQRTSS, 0x51}, {Opcode::MINSS, 0x5D}, {Opcode::MAXSS, 0x5F}}};
+        for (const auto &[op, code] : fp_arith) {
+            set(op, InstDesc{Form::SSE, code, 0xF3});
+            set(mir::scalar(op, Type::f64), InstDesc{Form::SSE, code, 0xF2});
+        }
+        set(Opcode::CVTSS2SD, InstDesc{Form::SSE, 0x5A, 0xF3});
+        set(Opcode::CVTSD2SS, InstDesc{Form::SSE, 0x5A, 0xF2});
+        set(Opcode::COMISS, InstDesc{Form::SSE, 0x2F});
+        set(Opcode::COMISD, InstDesc{Form::SSE, 0x2F, 0x66});
+        set(Opcode::UCOMISS, InstDesc{Form::SSE, 0x2E});
+        set(Opcode::UCOMISD, InstDesc{Form::SSE, 0x2E, 0x66});
+        set(Opcode::PXOR, InstDesc{Form::SSE, 0xEF, 0x66});
+        set(Opcode::ROUNDSS, InstDesc{Form::SSE, 0x0A, 0x66, 0, 3, true});
+        set(Opcode::ROUNDSD, InstDesc{Form::SSE, 0x0B, 0x66, 0, 3, true});
+        set(Opcode::MOVD, InstDesc{Form::MOVD});
+        set(Opcode::MOVQ, InstDesc{Form::MOVQ});
+        set(Opcode::CVTSI2SS, InstDesc{Form::CVT_SI2F, 0x2A, 0xF3});
+        set(Opcode::CVTSI2SD, InstDesc{Form::CVT_SI2F, 0x2A, 0xF2});
+        set(Opcode::CVTSS2SI, InstDesc{Form::CVT_F2SI, 0x2D, 0xF3});
+        set(Opcode::CVTSD2SI, InstDesc{Form::CVT_F2SI, 0x2D, 0xF2});
+        set(Opcode::CVTTSS2SI, InstDesc{Form::CVT_F2SI, 0x2C, 0xF3});
+        set(Opcode::CVTTSD2SI, InstDesc{Form::CVT_F2SI, 0x2C, 0xF2});
+        set(Opcode::LDMXCSR, InstDesc{Form::MXCSR, 2});
+        set(Opcode::STMXCSR, InstDesc{Form::MXCSR, 3});
+
+        // vf[n]m[add|sub]213s[s|d]
+        const std::array<std::pair<Opcode, uint8_t>, 4> fma = {{{Opcode::VFMADD213SS, 0xA9}, {Opcode::VFMSUB213SS, 0xAB}, {Opcode::VFNMADD213SS, 0xAD}, {Opcode::VFNMSUB213SS, 0xAF}}};
+        for (const auto &[op, code] : fma) {
+            set(op, InstDesc{Form::FMA, code, 0x66, 0, 2, false, false});
+            set(mir::scalar(op, Type::f64), InstDesc{Form::FMA, code, 0x66, 0, 2, false, true});
+        }
+        set(Opcode::SHLX, InstDesc{Form::BMI2_SHIFT, 0xF7, 0x66, 0, 2});
+        set(Opcode::SARX, InstDesc{Form::BMI2_SHIFT, 0xF7, 0xF3, 0, 2});
+        set(Opcode::SHRX, InstDesc{Form::BMI2_SHIFT, 0xF7, 0xF2, 0, 2});
+        return insts;
+    }();
+    return table;
+}
+
+// Intel syntax of an instruction for error messages
+std::string describe(const mir::Inst &inst) {
+    mir::Block block;
+    block.insts.push_back(inst);
+    std::string text;
+    block.lower(text);
+    text.pop_back();
+    return text;
+}
+
+constexpr bool fits_i8(const int64_t val) { return val >= INT8_MIN && val <= INT8_MAX; }
+
+constexpr bool fits_i32(const int64_t val) { return val >= INT32_MIN && val <= INT32_MAX; }
+
+// whether a value can be stored in a field of the given size, either as signed or unsigned value
+constexpr bool fits_size(const int64_t val, const uint8_t size) {
+    switch (size) {
+    case 1:
+        return val >= INT8_MIN && val <= UINT8_MAX;
+    case 2:
+        return val >= INT16_MIN && val <= UINT16_MAX;
+    case 4:
+        return val >= INT32_MIN && val <= UINT32_MAX;
+    default:
+        return true;
+    }
+}
+
+// truncate to the operand size and sign-extend again, used to check whether a sign-extended imm8 can be used
+constexpr int64_t sign_extend(const int64_t val, const uint8_t size) {
+    switch (size) {
+    case 1:
+        return static_cast<int8_t>(val);
+    case 2:
+        return static_cast<int16_t>(val);
+    case 4:
+        return static_cast<int32_t>(val);
+    default:
+        return val;
+    }
+}
+
+void write_le(uint8_t *dst, const uint64_t val, const uint8_t size) {
+    for (uint8_t i = 0; i < size; ++i) {
+        dst[i] = static_cast<uint8_t>(val >> (8 * i));
+    }
+}
+
+void add_term(Expr &expr, const uint32_t sym, const int64_t coeff) {
+    for (auto &term : expr.terms) {
+        if (term.first == sym) {
+            term.second += coeff;
+            return;
+        }
+    }
+    expr.terms.emplace_back(sym, coeff);
+}
+
+// recommended multi-byte nops, used to pad executable sections
+void write_nops(uint8_t *dst, uint64_t count) {
+    static const std::array<std::array<uint8_t, 11>, 11> nops = {{
+        {0x90},
+        {0x66, 0x90},
+        {0x0F, 0x1F, 0x00},
+        {0x0F, 0x1F, 0x40, 0x00},
+        {0x0F, 0x1F, 0x44, 0x00, 0x00},
+        {0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00},
+        {0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00},
+        {0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+        {0x66, 0x66, 0x2E, 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00},
+    }};
+    while (count > 0) {
+        const auto len = std::min<uint64_t>(count, nops.size());
+        std::memcpy(dst, nops[len - 1].data(), len);
+        dst += len;
+        count -= len;
+    }
+}
+
+} // namespace
+
+struct Assembler::Operand {
+    enum class Kind : uint8_t { REG, MEM, IMM };
+
+    Kind kind = Kind::IMM;
+    Register reg{};
+
+    // MEM: explicit size from a `PTR` specifier or 0
+    uint8_t size = 0;
+    uint8_t segment = 0;
+    // memory operand written without brackets, i.e. a direct branch target
+    bool bare = false;
+    std::optional<Register> base{};
+    std::optional<Register> index{};
+    uint8_t scale = 1;
+
+    // displacement or immediate
+    Expr value{};
+};
+
+struct Assembler::Inst {
+    uint8_t segment = 0;
+    bool lock = false;
+    bool operand_size = false;
+    // mandatory prefix of SSE instructions, pp field for VEX encoded ones
+    uint8_t mandatory = 0;
+    bool rex_w = false, rex_r = false, rex_x = false, rex_b = false;
+    bool rex_needed = false, rex_forbidden = false;
+
+    bool vex = false;
+    uint8_t vex_map = 1;
+    uint8_t vex_vvvv = 0;
+
+    std::array<uint8_t, 3> opcode{};
+    uint8_t opcode_len = 0;
+
+    bool has_modrm = false;
+    uint8_t mod = 0, reg = 0, rm = 0;
+    bool has_sib = false;
+    uint8_t sib = 0;
+
+    uint8_t disp_size = 0;
+    bool disp_rip = false;
+    // the address is truncated to 32 bits, e.g. lea r32, [sym]
+    bool disp_zero_extend = false;
+    Expr disp{};
+
+    uint8_t imm_size = 0;
+    bool imm_signed = false;
+    Expr imm{};
+
+    void set_opcode(std::initializer_list<uint8_t> bytes) {
+        std::copy(bytes.begin(), bytes.end(), opcode.begin());
+        opcode_len = static_cast<uint8_t>(bytes.size());
+    }
+
+    void set_size(const uint8_t size) {
+        operand_size = size == 2;
+        rex_w = size == 8;
+    }
+
+    void set_reg(const Register &r) {
+        has_modrm = true;
+        reg = r.num & 7;
+        rex_r = r.num >= 8;
+        rex_needed |= r.rex_only;
+        rex_forbidden |= r.high_byte;
+    }
+
+    // +r encoding in the low bits of the last opcode byte
+    void set_opcode_reg(const Register &r) {
+        opcode[opcode_len - 1] |= r.num & 7;
+        rex_b = r.num >= 8;
+        rex_needed |= r.rex_only;
+        rex_forbidden |= r.high_byte;
+    }
+
+    void set_imm(const Expr &val, const uint8_t size, const bool sign) {
+        imm = val;
+        imm_size = size;
+        imm_signed = sign;
+    }
+};
+
+struct Assembler::Resolved {
+    enum class Kind : uint8_t { INVALID, ABSOLUTE, SECTION, SYMBOL };
+
+    Kind kind = Kind::INVALID;
+    // index of the section or symbol
+    uint32_t index = 0;
+    // for SECTION this includes the offset inside of the section
+    int64_t value = 0;
+    // SECTION relative to a global label, references to it get relocated against the symbol so it can be interposed
+    std::optional<uint32_t> global_sym{};
+};
+
+Assembler::Assembler() {
+    // `as` always creates these, even if they stay empty
+    switch_section(".data");
+    switch_section(".bss");
+    switch_section(".text");
+}
+
+void Assembler::error(const std::string &msg, const size_t inst) { errors.push_back("instruction " + std::to_string(inst ? inst : inst_nr) + ": " + msg); }
+
+uint32_t Assembler::symbol_index(const std::string_view name) {
+    std::string key{name};
+    if (const auto it = symbol_map.find(key); it != symbol_map.end()) {
+        return it->second;
+    }
+    const auto idx = static_cast<uint32_t>(symbols.size());
+    auto &sym = symbols.emplace_back();
+    sym.name = key;
+    sym.temporary = key.rfind(".L", 0) == 0;
+    symbol_map.emplace(std::move(key), idx);
+    return idx;
+}
+
+uint32_t Assembler::numeric_label(const uint64_t num, const bool forward) {
+    const auto count = numeric_labels[num];
+    const auto instance = forward ? count : count - 1;
+    return symbol_index(".L" + std::to_string(num) + "\x01" + std::to_string(instance));
+}
+
+uint32_t Assembler::here() {
+    const auto idx = static_cast<uint32_t>(symbols.size());
+    auto &sym = symbols.emplace_back();
+    sym.name = ".L.dot";
+    sym.temporary = true;
+    define_label(idx);
+    return idx;
+}
+
+void Assembler::define_label(const uint32_t idx) {
+    auto &chunk = data_chunk();
+    auto &sym = symbols[idx];
+    if (sym.kind != Symbol::Kind::UNDEFINED) {
+        error("symbol `" + sym.name + "' is already defined");
+        return;
+    }
+    sym.kind = Symbol::Kind::LABEL;
+    sym.section = cur_section;
+    sym.chunk = static_cast<uint32_t>(sections[cur_section].chunks.size() - 1);
+    sym.offset = chunk.bytes.size();
+}
+
+bool Assembler::constant_equ(const uint32_t idx, int64_t &value, const int depth) const {
+    const auto &sym = symbols[idx];
+    if (sym.kind != Symbol::Kind::EQU || depth > 32) {
+        return false;
+    }
+    int64_t res = sym.equ.constant;
+    for (const auto &[term, coeff] : sym.equ.terms) {
+        int64_t term_val;
+        if (!constant_equ(term, term_val, depth + 1)) {
+            return false;
+        }
+        res += coeff * term_val;
+    }
+    value = res;
+    return true;
+}
+
+uint32_t Assembler::switch_section(const std::string_view name, const char *flags, uint32_t type) {
+    std::string key{name};
+    if (const auto it = section_map.find(key); it != section_map.end()) {
+        cur_section = it->second;
+        return cur_section;
+    }
+
+    const auto has_prefix = [&key](const char *prefix) {
+        const auto len = std::strlen(prefix);
+        return key.compare(0, len, prefix) == 0 && (key.size() == len || key[len] == '.');
+    };
+    uint64_t sec_flags = 0;
+    if (flags) {
+        for (const char *c = flags; *c; ++c) {
+            switch (*c) {
+            case 'a':
+                sec_flags |= SHF_ALLOC;
+                break;
+            case 'w':
+                sec_flags |= SHF_WRITE;
+                break;
+            case 'x':
+                sec_flags |= SHF_EXECINSTR;
+                break;
+            default:
+                error(std::string("unsupported section flag `") + *c + "'");
+                break;
+            }
+        }
+    } else if (has_prefix(".text")) {
+        sec_flags = SHF_ALLOC | SHF_EXECINSTR;
+    } else if (has_prefix(".data") || has_prefix(".bss")) {
+        sec_flags = SHF_ALLOC | SHF_WRITE;
+    } else if (has_prefix(".rodata")) {
+        sec_flags = SHF_ALLOC;
+    }
+    if (type == 0) {
+        type = has_prefix(".bss") ? SHT_NOBITS : SHT_PROGBITS;
+    }
+
+    cur_section = static_cast<uint32_t>(sections.size());
+    sections.push_back(Section{key, type, sec_flags});
+    section_map.emplace(std::move(key), cur_section);
+    return cur_section;
+}
+
+Chunk &Assembler::data_chunk() {
+    auto &chunks = sections[cur_section].chunks;
+    if (chunks.empty() || chunks.back().kind != Chunk::Kind::DATA) {
+        chunks.emplace_back();
+    }
+    return chunks.back();
+}
+
+void Assembler::append_value(const int64_t value, const uint8_t size) {
+    auto &bytes = data_chunk().bytes;
+    const auto off = bytes.size();
+    bytes.resize(off + size);
+    write_le(bytes.data() + off, static_cast<uint64_t>(value), size);
+}
+
+void Assembler::emit_data(const Expr &expr, const uint8_t size) {
+    if (expr.is_constant()) {
+        if (!fits_size(expr.constant, size)) {
+            error("value " + std::to_string(expr.constant) + " does not fit into " + std::to_string(size) + " bytes");
+        }
+        append_value(expr.constant, size);
+        return;
+    }
+    auto &chunk = data_chunk();
+    chunk.fixups.push_back(Fixup{Fixup::Kind::ABS, size, 0, static_cast<uint32_t>(chunk.bytes.size()), inst_nr, expr});
+    chunk.bytes.resize(chunk.bytes.size() + size);
+}
+
+void Assembler::emit_align(const uint64_t alignment, const int64_t fill, const uint64_t max_skip) {
+    auto &sec = sections[cur_section];
+    sec.alignment = std::max(sec.alignment, alignment);
+    auto &chunk = sec.chunks.emplace_back();
+    chunk.kind = Chunk::Kind::ALIGN;
+    chunk.alignment = alignment;
+    chunk.max_skip = max_skip;
+    chunk.fill = static_cast<uint8_t>(fill < 0 ? 0 : fill);
+    chunk.nop_fill = fill < 0 && (sec.flags & SHF_EXECINSTR);
+}
+
+void Assembler::emit_fill(const uint64_t count, const uint8_t fill) {
+    auto &chunk = sections[cur_section].chunks.emplace_back();
+    chunk.kind = Chunk::Kind::FILL;
+    chunk.count = count;
+    chunk.fill = fill;
+}
+
+void Assembler::emit_branch(const int8_t cond, const Expr &target) {
+    auto &chunk = sections[cur_section].chunks.emplace_back();
+    chunk.kind = Chunk::Kind::BRANCH;
+    chunk.cond = cond;
+    chunk.target = target;
+    chunk.inst = inst_nr;
+}
+
+bool Assembler::encode_rm(Inst &inst, const Operand &op) {
+    inst.has_modrm = true;
+    if (op.kind == Operand::Kind::REG) {
+        inst.mod = 3;
+        inst.rm = op.reg.num & 7;
+        inst.rex_b = op.reg.num >= 8;
+        inst.rex_needed |= op.reg.rex_only;
+        inst.rex_forbidden |= op.reg.high_byte;
+        return true;
+    }
+
+    assert(op.kind == Operand::Kind::MEM);
+    inst.segment = op.segment;
+    inst.disp = op.value;
+
+    if (op.base && op.base->rip) {
+        inst.mod = 0;
+        inst.rm = 5;
+        inst.disp_size = 4;
+        inst.disp_rip = true;
+        return true;
+    }
+
+    const uint8_t scale_bits = op.scale == 8 ? 3 : (op.scale == 4 ? 2 : (op.scale == 2 ? 1 : 0));
+    const uint8_t index_bits = op.index ? (op.index->num & 7) : 4;
+    inst.rex_x = op.index && op.index->num >= 8;
+
+    if (!op.base) {
+        // absolute address, always needs a SIB byte in 64-bit mode
+        inst.mod = 0;
+        inst.rm = 4;
+        inst.has_sib = true;
+        inst.sib = static_cast<uint8_t>(scale_bits << 6 | index_bits << 3 | 5);
+        inst.disp_size = 4;
+        return true;
+    }
+
+    const uint8_t base_bits = op.base->num & 7;
+    inst.rex_b = op.base->num >= 8;
+    if (!op.value.is_constant()) {
+        inst.mod = 2;
+        inst.disp_size = 4;
+    } else if (op.value.constant == 0 && base_bits != 5) {
+        inst.mod = 0;
+    } else if (fits_i8(op.value.constant)) {
+        inst.mod = 1;
+        inst.disp_size = 1;
+    } else if (fits_i32(op.value.constant)) {
+        inst.mod = 2;
+        inst.disp_size = 4;
+    } else {
+        error("displacement " + std::to_string(op.value.constant) + " is out of range");
+        return false;
+    }
+
+    if (op.index || base_bits == 4) {
+        inst.rm = 4;
+        inst.has_sib = true;
+        inst.sib = static_cast<uint8_t>(scale_bits << 6 | index_bits << 3 | base_bits);
+    } else {
+        inst.rm = base_bits;
+    }
+    return true;
+}
+
+void Assembler::emit(Inst &inst) {
+    std::array<uint8_t, 16> buf{};
+    size_t len = 0;
+
+    if (inst.segment) {
+        buf[len++] = inst.segment;
+    }
+    if (inst.operand_size) {
+        buf[len++] = 0x66;
+    }
+    if (inst.lock) {
+        buf[len++] = 0xF0;
+    }
+
+    if (inst.vex) {
+        const uint8_t pp = inst.mandatory == 0x66 ? 1 : (inst.mandatory == 0xF3 ? 2 : (inst.mandatory == 0xF2 ? 3 : 0));
+        const uint8_t vvvv = static_cast<uint8_t>((~inst.vex_vvvv & 0xF) << 3);
+        if (inst.vex_map == 1 && !inst.rex_w && !inst.rex_x && !inst.rex_b) {
+            buf[len++] = 0xC5;
+            buf[len++] = static_cast<uint8_t>((inst.rex_r ? 0 : 0x80) | vvvv | pp);
+        } else {
+            buf[len++] = 0xC4;
+            buf[len++] = static_cast<uint8_t>((inst.rex_r ? 0 : 0x80) | (inst.rex_x ? 0 : 0x40) | (inst.rex_b ? 0 : 0x20) | inst.vex_map);
+            buf[len++] = static_cast<uint8_t>((inst.rex_w ? 0x80 : 0) | vvvv | pp);
+        }
+    } else {
+        if (inst.mandatory) {
+            buf[len++] = inst.mandatory;
+        }
+        const uint8_t rex = static_cast<uint8_t>(0x40 | (inst.rex_w ? 8 : 0) | (inst.rex_r ? 4 : 0) | (inst.rex_x ? 2 : 0) | (inst.rex_b ? 1 : 0));
+        if (rex != 0x40 || inst.rex_needed) {
+            if (inst.rex_forbidden) {
+                error("ah, bh, ch and dh can't be used in an instruction requiring a REX prefix");
+                return;
+            }
+            buf[len++] = rex;
+        }
+    }
+
+    for (uint8_t i = 0; i < inst.opcode_len; ++i) {
+        buf[len++] = inst.opcode[i];
+    }
+    if (inst.has_modrm) {
+        buf[len++] = static_cast<uint8_t>(inst.mod << 6 | inst.reg << 3 | inst.rm);
+    }
+    if (inst.has_sib) {
+        buf[len++] = inst.sib;
+    }
+
+    auto &chunk = data_chunk();
+    const auto base = chunk.bytes.size();
+    if (inst.disp_size) {
+        if (inst.disp.is_constant()) {
+            if (inst.disp_size == 4 && !fits_i32(inst.disp.constant)) {
+                error("displacement " + std::to_string(inst.disp.constant) + " is out of range");
+            }
+            write_le(buf.data() + len, static_cast<uint64_t>(inst.disp.constant), inst.disp_size);
+        } else {
+            const auto kind = inst.disp_rip ? Fixup::Kind::PCREL : (inst.disp_zero_extend ? Fixup::Kind::ABS : Fixup::Kind::ABS_S);
+            chunk.fixups.push_back(Fixup{kind, inst.disp_size, static_cast<uint8_t>(inst.disp_size + inst.imm_size), static_cast<uint32_t>(base + len), inst_nr, inst.disp});
+        }
+        len += inst.disp_size;
+    }
+    if (inst.imm_size) {
+        if (inst.imm.is_constant()) {
+            write_le(buf.data() + len, static_cast<uint64_t>(inst.imm.constant), inst.imm_size);
+        } else {
+            const auto kind = inst.imm_signed ? Fixup::Kind::ABS_S : Fixup::Kind::ABS;
+            chunk.fixups.push_back(Fixup{kind, inst.imm_size, 0, static_cast<uint32_t>(base + len), inst_nr, inst.imm});
+        }
+        len += inst.imm_size;
+    }
+
+    chunk.bytes.insert(chunk.bytes.end(), buf.begin(), buf.begin() + static_cast<ptrdiff_t>(len));
+}
+
+void Assembler::encode(const InstDesc &desc, std::array<Operand, 3> &ops, const mir::Inst &src) {
+    size_t count = src.op_count;
+    const auto fail = [this, &src]() { error("invalid operands for `" + describe(src) + "'"); };
+    const auto is_reg = [&ops](const size_t idx) { return ops[idx].kind == Operand::Kind::REG && !ops[idx].reg.xmm; };
+    const auto is_xmm = [&ops](const size_t idx) { return ops[idx].kind == Operand::Kind::REG && ops[idx].reg.xmm; };
+    const auto is_mem = [&ops](const size_t idx) { return ops[idx].kind == Operand::Kind::MEM; };
+    const auto is_rm = [&is_reg, &is_mem](const size_t idx) { return is_reg(idx) || is_mem(idx); };
+    const auto is_xmm_rm = [&is_xmm, &is_mem](const size_t idx) { return is_xmm(idx) || is_mem(idx); };
+    const auto is_imm = [&ops](const size_t idx) { return ops[idx].kind == Operand::Kind::IMM; };
+    const auto op_size = [&ops](const size_t idx) { return ops[idx].kind == Operand::Kind::REG ? ops[idx].reg.size : ops[idx].size; };
+    // size of a (reg|mem, reg|mem|imm) pair, 0 if it is ambiguous or doesn't match
+    const auto pair_size = [this, &ops, &op_size, &src]() -> uint8_t {
+        const uint8_t size_0 = op_size(0);
+        const uint8_t size_1 = ops[1].kind == Operand::Kind::IMM ? 0 : op_size(1);
+        if (size_0 && size_1 && size_0 != size_1) {
+            error("operand size mismatch for `" + describe(src) + "'");
+            return 0;
+        }
+        const auto size = size_0 ? size_0 : size_1;
+        if (size == 0) {
+            error("ambiguous operand size for `" + describe(src) + "'");
+        }
+        return size;
+    };
+    // immediates which have to fit into the operand size (imm64 only exists for mov)
+    const auto check_imm = [this](const Expr &imm, const uint8_t size) {
+        if (!imm.is_constant()) {
+            return true;
+        }
+        const bool fits = size == 8 ? fits_i32(imm.constant) : fits_size(imm.constant, size);
+        if (!fits) {
+            error("immediate " + std::to_string(imm.constant) + " does not fit into the operand");
+        }
+        return fits;
+    };
+
+    Inst inst;
+    inst.lock = src.lock;
+
+    switch (desc.form) {
+    case Form::FIXED: {
+        if (count != 0) {
+            fail();
+            return;
+        }
+        auto &chunk = data_chunk();
+        chunk.bytes.insert(chunk.bytes.end(), desc.bytes.begin(), desc.bytes.begin() + desc.len);
+        return;
+    }
+    case Form::RET:
+        if (count == 0) {
+            inst.set_opcode({0xC3});
+        } else if (count == 1 && is_imm(0) && check_imm(ops[0].value, 2)) {
+            inst.set_opcode({0xC2});
+            inst.set_imm(ops[0].value, 2, false);
+        } else {
+            fail();
+            return;
+        }
+        break;
+    case Form::ALU: {
+        if (count != 2) {
+            fail();
+            return;
+        }
+        const auto size = pair_size();
+        if (size == 0 || size > 8) {
+            return;
+        }
+        inst.set_size(size);
+        const uint8_t wide = size > 1 ? 1 : 0;
+        if (is_rm(0) && is_reg(1)) {
+            inst.set_opcode({static_cast<uint8_t>(desc.op * 8 + wide)});
+            inst.set_reg(ops[1].reg);
+            encode_rm(inst, ops[0]);
+        } else if (is_reg(0) && is_mem(1)) {
+            inst.set_opcode({static_cast<uint8_t>(desc.op * 8 + 2 + wide)});
+            inst.set_reg(ops[0].reg);
+            encode_rm(inst, ops[1]);
+        } else if (is_rm(0) && is_imm(1)) {
+            const auto &imm = ops[1].value;
+            if (!check_imm(imm, size)) {
+                return;
+            }
+            const bool accumulator = is_reg(0) && ops[0].reg.num == 0;
+            if (size == 1) {
+                if (accumulator) {
+                    inst.set_opcode({static_cast<uint8_t>(desc.op * 8 + 4)});
+                } else {
+                    inst.set_opcode({0x80});
+                    inst.reg = desc.op;
+                    encode_rm(inst, ops[0]);
+                }
+                inst.set_imm(imm, 1, false);
+            } else if (imm.is_constant() && fits_i8(sign_extend(imm.constant, size))) {
+                inst.set_opcode({0x83});
+                inst.reg = desc.op;
+                encode_rm(inst, ops[0]);
+                inst.set_imm(Expr{sign_extend(imm.constant, size)}, 1, true);
+            } else {
+                if (accumulator) {
+                    inst.set_opcode({static_cast<uint8_t>(desc.op * 8 + 5)});
+                } else {
+                    inst.set_opcode({0x81});
+                    inst.reg = desc.op;
+                    encode_rm(inst, ops[0]);
+                }
+                inst.set_imm(imm, size == 2 ? 2 : 4, size == 8);
+            }
+        } else {
+            fail();
+            return;
+        }
+        break;
+    }
+    case Form::MOV: {
+        if (count != 2) {
+            fail();
+            return;
+        }
+        const auto size = pair_size();
+        if (size == 0 || size > 8) {
+            return;
+        }
+        inst.set_size(size);
+        const uint8_t wide = size > 1 ? 1 : 0;
+        if (is_rm(0) && is_reg(1) && desc.op == 0) {
+            inst.set_opcode({static_cast<uint8_t>(0x88 + wide)});
+            inst.set_reg(ops[1].reg);
+            encode_rm(inst, ops[0]);
+        } else if (is_reg(0) && is_mem(1) && desc.op == 0) {
+            inst.set_opcode({static_cast<uint8_t>(0x8A + wide)});
+            inst.set_reg(ops[0].reg);
+            encode_rm(inst, ops[1]);
+        } else if (is_reg(0) && is_imm(1)) {
+            const auto &imm = ops[1].value;
+            if (size == 8 && desc.op == 0 && (!imm.is_constant() || fits_i32(imm.constant))) {
+                // sign-extended imm32
+                inst.set_opcode({0xC7});
+                inst.reg = 0;
+                encode_rm(inst, ops[0]);
+                inst.set_imm(imm, 4, true);
+            } else {
+                if (size != 8 && !check_imm(imm, size)) {
+                    return;
+                }
+                inst.set_opcode({static_cast<uint8_t>(size == 1 ? 0xB0 : 0xB8)});
+                inst.set_opcode_reg(ops[0].reg);
+                inst.set_imm(imm, size, false);
+            }
+        } else if (is_mem(0) && is_imm(1) && desc.op == 0) {
+            if (!check_imm(ops[1].value, size)) {
+                return;
+            }
+            inst.set_opcode({static_cast<uint8_t>(0xC6 + wide)});
+            inst.reg = 0;
+            encode_rm(inst, ops[0]);
+            inst.set_imm(ops[1].value, size == 8 ? 4 : size, size == 8);
+        } else {
+            fail();
+            return;
+        }
+        break;
+    }
+    case Form::MOVX: {
+        if (count != 2 || !is_reg(0) || !is_rm(1)) {
+            fail();
+            return;
+        }
+        const auto dst_size = ops[0].reg.size, src_size = op_size(1);
+        if (src_size == 0) {
+            error("ambiguous operand size for `" + describe(src) + "'");
+            return;
+        }
+        if (desc.op == 0xBE && dst_size == 8 && src_size == 4) {
+            // movsx r64, r/m32 is movsxd
+            inst.set_opcode({0x63});
+        } else if (src_size < dst_size && src_size <= 2) {
+            inst.set_opcode({0x0F, static_cast<uint8_t>(desc.op + (src_size == 2 ? 1 : 0))});
+        } else {
+            fail();
+            return;
+        }
+        inst.set_size(dst_size);
+        inst.set_reg(ops[0].reg);
+        encode_rm(inst, ops[1]);
+        break;
+    }
+    case Form::MOVSXD:
+        if (count != 2 || !is_reg(0) || ops[0].reg.size != 8 || !is_rm(1) || (op_size(1) != 4 && op_size(1) != 0)) {
+            fail();
+            return;
+        }
+        inst.set_opcode({0x63});
+        inst.set_size(8);
+        inst.set_reg(ops[0].reg);
+        encode_rm(inst, ops[1]);
+        break;
+    case Form::LEA:
+        if (count != 2 || !is_reg(0) || ops[0].reg.size == 1 || !is_mem(1)) {
+            fail();
+            return;
+        }
+        inst.set_opcode({0x8D});
+        inst.set_size(ops[0].reg.size);
+        inst.set_reg(ops[0].reg);
+        encode_rm(inst, ops[1]);
+        inst.disp_zero_extend = ops[0].reg.size != 8;
+        break;
+    case Form::TEST: {
+        if (count != 2) {
+            fail();
+            return;
+        }
+        const auto size = pair_size();
+        if (size == 0 || size > 8) {
+            return;
+        }
+        inst.set_size(size);
+        const uint8_t wide = size > 1 ? 1 : 0;
+        if (is_rm(0) && is_reg(1)) {
+            inst.set_opcode({static_cast<uint8_t>(0x84 + wide)});
+            inst.set_reg(ops[1].reg);
+            encode_rm(inst, ops[0]);
+        } else if (is_reg(0) && is_mem(1)) {
+            inst.set_opcode({static_cast<uint8_t>(0x84 + wide)});
+            inst.set_reg(ops[0].reg);
+            encode_rm(inst, ops[1]);
+        } else if (is_rm(0) && is_imm(1)) {
+            if (!check_imm(ops[1].value, size)) {
+                return;
+            }
+            if (is_reg(0) && ops[0].reg.num == 0) {
+                inst.set_opcode({static_cast<uint8_t>(0xA8 + wide)});
+            } else {
+                inst.set_opcode({static_cast<uint8_t>(0xF6 + wide)});
+                inst.reg = 0;
+                encode_rm(inst, ops[0]);
+            }
+            inst.set_imm(ops[1].value, size == 8 ? 4 : size, size == 8);
+        } else {
+            fail();
+            return;
+        }
+        break;
+    }
+    case Form::XCHG: {
+        if (count != 2 || !is_rm(0) || !is_rm(1) || (is_mem(0) && is_mem(1))) {
+            fail();
+            return;
+        }
+        const auto size = pair_size();
+        if (size == 0 || size > 8) {
+            return;
+        }
+        inst.set_size(size);
+        // xchg eax, eax can't use 0x90 since that is a nop which doesn't clear the upper half
+        if (size > 1 && is_reg(0) && is_reg(1) && (ops[0].reg.num == 0 || ops[1].reg.num == 0) && !(size == 4 && ops[0].reg.num == ops[1].reg.num)) {
+            inst.set_opcode({0x90});
+            inst.set_opcode_reg(ops[0].reg.num == 0 ? ops[1].reg : ops[0].reg);
+            if (ops[0].reg.num == 0 && ops[1].reg.num == 0) {
+                // xchg rax, rax is just a nop
+                inst.rex_w = false;
+            }
+        } else {
+            inst.set_opcode({static_cast<uint8_t>(size > 1 ? 0x87 : 0x86)});
+            const auto reg_idx = is_reg(1) ? 1 : 0;
+            inst.set_reg(ops[reg_idx].reg);
+            encode_rm(inst, ops[1 - reg_idx]);
+        }
+        break;
+    }
+    case Form::PUSH:
+    case Form::POP: {
+        const bool push = desc.form == Form::PUSH;
+        if (count != 1) {
+            fail();
+            return;
+        }
+        if (is_reg(0) && (ops[0].reg.size == 8 || ops[0].reg.size == 2)) {
+            inst.operand_size = ops[0].reg.size == 2;
+            inst.set_opcode({static_cast<uint8_t>(push ? 0x50 : 0x58)});
+            inst.set_opcode_reg(ops[0].reg);
+        } else if (is_mem(0) && (op_size(0) == 0 || op_size(0) == 8)) {
+            inst.set_opcode({static_cast<uint8_t>(push ? 0xFF : 0x8F)});
+            inst.reg = push ? 6 : 0;
+            encode_rm(inst, ops[0]);
+        } else if (push && is_imm(0)) {
+            if (!check_imm(ops[0].value, 8)) {
+                return;
+            }
+            if (ops[0].value.is_constant() && fits_i8(ops[0].value.constant)) {
+                inst.set_opcode({0x6A});
+                inst.set_imm(ops[0].value, 1, true);
+            } else {
+                inst.set_opcode({0x68});
+                inst.set_imm(ops[0].value, 4, true);
+            }
+        } else {
+            fail();
+            return;
+        }
+        break;
+    }
+    case Form::GROUP3: {
+        if (count != 1 || !is_rm(0)) {
+            fail();
+            return;
+        }
+        const auto size = op_size(0);
+        if (size == 0 || size > 8) {
+            error("ambiguous operand size for `" + describe(src) + "'");
+            return;
+        }
+        inst.set_size(size);
+        inst.set_opcode({static_cast<uint8_t>(desc.op2 + (size > 1 ? 1 : 0))});
+        inst.reg = desc.op;
+        encode_rm(inst, ops[0]);
+        break;
+    }
+    case Form::IMUL: {
+        if (count == 1) {
+            if (!is_rm(0) || op_size(0) == 0 || op_size(0) > 8) {
+                fail();
+                return;
+            }
+            inst.set_size(op_size(0));
+            inst.set_opcode({static_cast<uint8_t>(op_size(0) > 1 ? 0xF7 : 0xF6)});
+            inst.reg = 5;
+            encode_rm(inst, ops[0]);
+            break;
+        }
+        if (count == 2 && is_reg(0) && is_imm(1)) {
+            // imul reg, imm is imul reg, reg, imm
+            ops[2] = ops[1];
+            ops[1] = ops[0];
+            count = 3;
+        }
+        if (!is_reg(0) || ops[0].reg.size == 1 || !is_rm(1) || (op_size(1) != 0 && op_size(1) != ops[0].reg.size)) {
+            fail();
+            return;
+        }
+        const auto size = ops[0].reg.size;
+        inst.set_size(size);
+        inst.set_reg(ops[0].reg);
+        if (count == 2) {
+            inst.set_opcode({0x0F, 0xAF});
+        } else if (count == 3 && is_imm(2)) {
+            const auto &imm = ops[2].value;
+            if (!check_imm(imm, size)) {
+                return;
+            }
+            if (imm.is_constant() && fits_i8(sign_extend(imm.constant, size))) {
+                inst.set_opcode({0x6B});
+                inst.set_imm(Expr{sign_extend(imm.constant, size)}, 1, true);
+            } else {
+                inst.set_opcode({0x69});
+                inst.set_imm(imm, size == 2 ? 2 : 4, size == 8);
+            }
+        } else {
+            fail();
+            return;
+        }
+        encode_rm(inst, ops[1]);
+        break;
+    }
+    case Form::SHIFT: {
+        if (count == 0 || count > 2 || !is_rm(0)) {
+            fail();
+            return;
+        }
+        const auto size = op_size(0);
+        if (size == 0 || size > 8) {
+            error("ambiguous operand size for `" + describe(src) + "'");
+            return;
+        }
+        inst.set_size(size);
+        const uint8_t wide = size > 1 ? 1 : 0;
+        inst.reg = desc.op;
+        if (count == 1 || (is_imm(1) && ops[1].value.is_constant() && ops[1].value.constant == 1)) {
+            inst.set_opcode({static_cast<uint8_t>(0xD0 + wide)});
+        } else if (is_reg(1) && ops[1].reg.num == 1 && ops[1].reg.size == 1) {
+            inst.set_opcode({static_cast<uint8_t>(0xD2 + wide)});
+        } else if (is_imm(1) && check_imm(ops[1].value, 1)) {
+            inst.set_opcode({static_cast<uint8_t>(0xC0 + wide)});
+            inst.set_imm(ops[1].value, 1, false);
+        } else {
+            fail();
+            return;
+        }
+        encode_rm(inst, ops[0]);
+        break;
+    }
+    case Form::CMOV:
+        if (count != 2 || !is_reg(0) || ops[0].reg.size == 1 || !is_rm(1) || (op_size(1) != 0 && op_size(1) != ops[0].reg.size)) {
+            fail();
+            return;
+        }
+        inst.set_size(ops[0].reg.size);
+        inst.set_opcode({0x0F, static_cast<uint8_t>(0x40 + desc.op)});
+        inst.set_reg(ops[0].reg);
+        encode_rm(inst, ops[1]);
+        break;
+    case Form::SETCC:
+        if (count != 1 || !is_rm(0) || (op_size(0) != 0 && op_size(0) != 1)) {
+            fail();
+            return;
+        }
+        inst.set_opcode({0x0F, static_cast<uint8_t>(0x90 + desc.op)});
+        inst.reg = 0;
+        encode_rm(inst, ops[0]);
+        break;
+    case Form::JMP:
+    case Form::JCC:
+    case Form::CALL: {
+        if (count != 1) {
+            fail();
+            return;
+        }
+        if (is_mem(0) && ops[0].bare && ops[0].segment == 0) {
+            if (desc.form == Form::CALL) {
+                auto &chunk = data_chunk();
+                chunk.fixups.push_back(Fixup{Fixup::Kind::BRANCH, 4, 4, static_cast<uint32_t>(chunk.bytes.size() + 1), inst_nr, ops[0].value});
+                chunk.bytes.insert(chunk.bytes.end(), {0xE8, 0, 0, 0, 0});
+            } else {
+                emit_branch(desc.form == Form::JCC ? static_cast<int8_t>(desc.op) : -1, ops[0].value);
+            }
+            return;
+        }
+        if (desc.form == Form::JCC || !(is_rm(0) && (op_size(0) == 8 || (is_mem(0) && op_size(0) == 0)))) {
+            fail();
+            return;
+        }
+        inst.set_opcode({0xFF});
+        inst.reg = desc.form == Form::CALL ? 2 : 4;
+        encode_rm(inst, ops[0]);
+        break;
+    }
+    case Form::XADD: {
+        if (count != 2 || !is_rm(0) || !is_reg(1)) {
+            fail();
+            return;
+        }
+        const auto size = pair_size();
+        if (size == 0 || size > 8) {
+            return;
+        }
+        inst.set_size(size);
+        inst.set_opcode({0x0F, static_cast<uint8_t>(desc.op + (size > 1 ? 1 : 0))});
+        inst.set_reg(ops[1].reg);
+        encode_rm(inst, ops[0]);
+        break;
+    }
+    case Form::SSE:
+        if (count != (desc.imm8 ? 3u : 2u) || !is_xmm(0) || !is_xmm_rm(1) || (desc.imm8 && !(is_imm(2) && check_imm(ops[2].value, 1)))) {
+            fail();
+            return;
+        }
+        inst.mandatory = desc.prefix;
+        if (desc.map == 3) {
+            inst.set_opcode({0x0F, 0x3A, desc.op});
+        } else if (desc.map == 2) {
+            inst.set_opcode({0x0F, 0x38, desc.op});
+        } else {
+            inst.set_opcode({0x0F, desc.op});
+        }
+        inst.set_reg(ops[0].reg);
+        encode_rm(inst, ops[1]);
+        if (desc.imm8) {
+            inst.set_imm(ops[2].value, 1, false);
+        }
+        break;
+    case Form::MOVD:
+    case Form::MOVQ: {
+        if (count != 2) {
+            fail();
+            return;
+        }
+        const bool quad = desc.form == Form::MOVQ;
+        if (is_xmm(0) && is_xmm_rm(1) && quad) {
+            // movq xmm, xmm/m64
+            inst.mandatory = 0xF3;
+            inst.set_opcode({0x0F, 0x7E});
+            inst.set_reg(ops[0].reg);
+            encode_rm(inst, ops[1]);
+        } else if (is_mem(0) && is_xmm(1) && quad) {
+            // movq m64, xmm
+            inst.mandatory = 0x66;
+            inst.set_opcode({0x0F, 0xD6});
+            inst.set_reg(ops[1].reg);
+            encode_rm(inst, ops[0]);
+        } else if ((is_xmm(0) && is_rm(1)) || (is_rm(0) && is_xmm(1))) {
+            // movd/movq between general purpose registers (or memory for movd) and xmm registers
+            const auto gp_idx = is_xmm(0) ? 1 : 0;
+            const auto size = op_size(gp_idx) ? op_size(gp_idx) : (quad ? 8 : 4);
+            if ((size != 4 && size != 8) || (quad && size != 8) || (quad && is_mem(gp_idx))) {
+                fail();
+                return;
+            }
+            inst.mandatory = 0x66;
+            inst.rex_w = size == 8;
+            inst.set_opcode({0x0F, static_cast<uint8_t>(gp_idx == 1 ? 0x6E : 0x7E)});
+            inst.set_reg(ops[1 - gp_idx].reg);
+            encode_rm(inst, ops[gp_idx]);
+        } else {
+            fail();
+            return;
+        }
+        break;
+    }
+    case Form::CVT_SI2F: {
+        if (count != 2 || !is_xmm(0) || !is_rm(1)) {
+            fail();
+            return;
+        }
+        const auto size = op_size(1);
+        if (size != 4 && size != 8) {
+            error(size == 0 ? "ambiguous operand size for `" + describe(src) + "'" : "invalid operands for `" + describe(src) + "'");
+            return;
+        }
+        inst.mandatory = desc.prefix;
+        inst.rex_w = size == 8;
+        inst.set_opcode({0x0F, desc.op});
+        inst.set_reg(ops[0].reg);
+        encode_rm(inst, ops[1]);
+        break;
+    }
+    case Form::CVT_F2SI:
+        if (count != 2 || !is_reg(0) || (ops[0].reg.size != 4 && ops[0].reg.size != 8) || !is_xmm_rm(1)) {
+            fail();
+            return;
+        }
+        inst.mandatory = desc.prefix;
+        inst.rex_w = ops[0].reg.size == 8;
+        inst.set_opcode({0x0F, desc.op});
+        inst.set_reg(ops[0].reg);
+        encode_rm(inst, ops[1]);
+        break;
+    case Form::MXCSR:
+        if (count != 1 || !is_mem(0) || (op_size(0) != 0 && op_size(0) != 4)) {
+            fail();
+            return;
+        }
+        inst.set_opcode({0x0F, 0xAE});
+        inst.reg = desc.op;
+        encode_rm(inst, ops[0]);
+        break;
+    case Form::FMA:
+        if (count != 3 || !is_xmm(0) || !is_xmm(1) || !is_xmm_rm(2)) {
+            fail();
+            return;
+        }
+        inst.vex = true;
+        inst.vex_map = desc.map;
+        inst.mandatory = desc.prefix;
+        inst.rex_w = desc.w;
+        inst.vex_vvvv = ops[1].reg.num;
+        inst.set_opcode({desc.op});
+        inst.set_reg(ops[0].reg);
+        encode_rm(inst, ops[2]);
+        break;
+    case Form::BMI2_SHIFT:
+        if (count != 3 || !is_reg(0) || !is_rm(1) || !is_reg(2) || (ops[0].reg.size != 4 && ops[0].reg.size != 8) || ops[2].reg.size != ops[0].reg.size ||
+            (op_size(1) != 0 && op_size(1) != ops[0].reg.size)) {
+            fail();
+            return;
+        }
+        inst.vex = true;
+        inst.vex_map = desc.map;
+        inst.mandatory = desc.prefix;
+        inst.rex_w = ops[0].reg.size == 8;
+        inst.vex_vvvv = ops[2].reg.num;
+        inst.set_opcode({desc.op});
+        inst.set_reg(ops[0].reg);
+        encode_rm(inst, ops[1]);
+        break;
+    }
+
+    emit(inst);
+}
+
+size_t Assembler::SymbolHash::operator()(const mir::Symbol &sym) const {
+    return std::hash<uint64_t>{}(sym.id) ^ (std::hash<uint64_t>{}(static_cast<uint64_t>(sym.sub) << 8 | static_cast<uint64_t>(sym.kind)) << 1) ^ std::hash<const void *>{}(sym.name);
+}
+
+uint32_t Assembler::symbol_index(const mir::Symbol &sym) {
+    if (sym.kind == mir::Symbol::Kind::LOCAL) {
+        if (!sym.sub && numeric_labels[sym.id] == 0) {
+            error("backward reference to undefined label `" + std::to_string(sym.id) + "'");
+        }
+        return numeric_label(sym.id, sym.sub != 0);
+    }
+    if (const auto it = mir_symbols.find(sym); it != mir_symbols.end()) {
+        return it->second;
+    }
+    std::string name;
+    mir::lower_symbol(name, sym);
+    const auto idx = symbol_index(name);
+    mir_symbols.emplace(sym, idx);
+    return idx;
+}
+
+void Assembler::add_symbol(Expr &expr, const uint32_t sym) {
+    if (int64_t value; constant_equ(sym, value)) {
+        expr.constant += value;
+        return;
+    }
+    add_term(expr, sym, 1);
+}
+
+bool Assembler::convert_operand(const mir::Operand &in, Operand &out, const bool fs_statics) {
+    using Kind = mir::Operand::Kind;
+    // x86 register numbers of the generator's registers
+    static constexpr std::array<uint8_t, REG_IP + 1> reg_nums = {0, 3, 1, 2, 7, 6, 8, 9, 10, 11, 12, 13, 14, 15, 0, 0, 4, 5, 0};
+    static constexpr std::array<uint8_t, 4> sizes = {8, 4, 2, 1};
+    const auto gp_reg = [](const REGISTER reg, const uint8_t size) {
+        auto res = Register{reg_nums[reg], size};
+        res.rex_only = size == 1 && res.num >= 4 && res.num < 8;
+        res.rip = reg == REG_IP;
+        return res;
+    };
+
+    out = Operand{};
+    switch (in.kind) {
+    case Kind::REG:
+        out.kind = Operand::Kind::REG;
+        out.reg = gp_reg(in.reg, sizes[in.width]);
+        return true;
+    case Kind::FP_REG:
+        out.kind = Operand::Kind::REG;
+        out.reg = Register{static_cast<uint8_t>(in.reg), 16, true};
+        return true;
+    case Kind::IMM:
+    case Kind::HEX_IMM:
+        out.value.constant = in.val;
+        return true;
+    case Kind::OFFSET:
+        add_symbol(out.value, symbol_index(in.sym));
+        return true;
+    case Kind::LABEL:
+        // direct branch target
+        out.kind = Operand::Kind::MEM;
+        out.bare = true;
+        add_symbol(out.value, symbol_index(in.sym));
+        return true;
+    default:
+        break;
+    }
+
+    out.kind = Operand::Kind::MEM;
+    out.size = in.width == mir::Operand::NO_PTR ? 0 : sizes[in.width];
+    switch (in.kind) {
+    case Kind::MEM:
+        if (in.reg != REG_NONE) {
+            out.base = gp_reg(in.reg, 8);
+        }
+        if (in.index != REG_NONE) {
+            out.index = gp_reg(in.index, 8);
+            out.scale = in.scale;
+        }
+        if (in.has_sym) {
+            add_symbol(out.value, symbol_index(in.sym));
+        }
+        out.value.constant += in.val;
+        out.segment = (in.tcb && fs_statics) ? 0x64 : 0;
+        return true;
+    case Kind::STACK_SLOT:
+        out.base = gp_reg(REG_SP, 8);
+        out.value.constant = 8 * in.val;
+        return true;
+    case Kind::STATIC:
+        add_symbol(out.value, symbol_index(mir::symbol(mir::Symbol::Kind::STATIC, static_cast<uint64_t>(in.val))));
+        out.segment = fs_statics ? 0x64 : 0;
+        return true;
+    case Kind::BINARY:
+        add_symbol(out.value, symbol_index(mir::named("binary")));
+        out.value.constant += in.val;
+        return true;
+    default:
+        error("invalid operand");
+        return false;
+    }
+}
+
+bool Assembler::convert_value(const mir::Operand &in, Expr &out) {
+    out = Expr{};
+    switch (in.kind) {
+    case mir::Operand::Kind::IMM:
+    case mir::Operand::Kind::HEX_IMM:
+        out.constant = in.val;
+        return true;
+    case mir::Operand::Kind::LABEL:
+    case mir::Operand::Kind::OFFSET:
+        add_symbol(out, symbol_index(in.sym));
+        return true;
+    default:
+        error("invalid value");
+        return false;
+    }
+}
+
+void Assembler::assemble(const mir::Block &block, const bool fs_statics) {
+    using mir::Opcode;
+
+    for (const auto &inst : block.insts) {
+        ++inst_nr;
+        switch (inst.op) {
+        case Opcode::NONE:
+        case Opcode::COMMENT:
+            continue;
+        case Opcode::LABEL: {
+            const auto &sym = inst.ops[0].sym;
+            if (sym.kind == mir::Symbol::Kind::LOCAL) {
+                define_label(numeric_label(sym.id, true));
+                numeric_labels[sym.id]++;
+            } else {
+                define_label(symbol_index(sym));
+            }
+            continue;
+        }
+        case Opcode::ALIGN:
+            emit_align(uint64_t{1} << inst.ops[0].val, -1, 0);
+            continue;
+        case Opcode::SECTION:
+            switch (static_cast<mir::Section>(inst.ops[0].val)) {
+            case mir::Section::DATA:
+                switch_section(".data");
+                break;
+            case mir::Section::BSS:
+                switch_section(".bss");
+                break;
+            case mir::Section::TEXT:
+                switch_section(".text");
+                break;
+            case mir::Section::TEXT_COLD:
+                switch_section(".text.cold", "ax", SHT_PROGBITS);
+                break;
+            case mir::Section::RODATA:
+                switch_section(".rodata");
+                break;
+            case mir::Section::ORIG_BINARY:
+                switch_section(".orig_binary", "aw");
+                break;
+            }
+            continue;
+        case Opcode::GLOBAL:
+            symbols[symbol_index(inst.ops[0].sym)].global = true;
+            continue;
+        case Opcode::SET: {
+            const auto idx = symbol_index(inst.ops[0].sym);
+            Expr value;
+            if (!convert_value(inst.ops[1], value)) {
+                return;
+            }
+            auto &sym = symbols[idx];
+            if (sym.kind == Symbol::Kind::LABEL) {
+                error("symbol `" + sym.name + "' is already defined");
+                continue;
+            }
+            sym.kind = Symbol::Kind::EQU;
+            sym.equ = std::move(value);
+            continue;
+        }
+        case Opcode::TYPE:
+            symbols[symbol_index(inst.ops[0].sym)].elf_type = static_cast<mir::SymbolType>(inst.ops[1].val) == mir::SymbolType::FUNC ? STT_FUNC : STT_OBJECT;
+            continue;
+        case Opcode::SIZE: {
+            const auto idx = symbol_index(inst.ops[0].sym);
+            Expr size;
+            add_term(size, inst.op_count > 1 ? symbol_index(inst.ops[1].sym) : here(), 1);
+            add_term(size, idx, -1);
+            symbols[idx].has_size = true;
+            symbols[idx].size = std::move(size);
+            continue;
+        }
+        case Opcode::BYTE:
+        case Opcode::LONG:
+        case Opcode::QUAD: {
+            Expr value;
+            if (!convert_value(inst.ops[0], value)) {
+                return;
+            }
+            emit_data(value, inst.op == Opcode::BYTE ? 1 : (inst.op == Opcode::LONG ? 4 : 8));
+            continue;
+        }
+        case Opcode::SPACE:
+            emit_fill(static_cast<uint64_t>(inst.ops[0].val), 0);
+            continue;
+        case Opcode::ASCII: {
+            const auto str = block.text_of(inst);
+            auto &bytes = data_chunk().bytes;
+            bytes.insert(bytes.end(), str.begin(), str.end());
+            continue;
+        }
+        case Opcode::INCBIN: {
+            const std::string path{block.text_of(inst)};
+            std::ifstream file{path, std::ios::binary};
+            if (!file) {
+                error("can't open `" + path + "'");
+                return;
+            }
+            auto &bytes = data_chunk().bytes;
+            bytes.insert(bytes.end(), std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+            continue;
+        }
+        default:
+            break;
+        }
+
+        auto desc = instruction_table()[static_cast<size_t>(inst.op)];
+        if (inst.op == Opcode::JCC || inst.op == Opcode::CMOVCC || inst.op == Opcode::SETCC) {
+            desc.op = static_cast<uint8_t>(inst.cond);
+        }
+        std::array<Operand, 3> ops{};
+        for (size_t i = 0; i < inst.op_count; ++i) {
+            if (!convert_operand(inst.ops[i], ops[i], fs_statics)) {
+                return;
+            }
+        }
+        encode(desc, ops, inst);
+    }
+}
+
+uint64_t Assembler::symbol_addr(const Symbol &sym) const { return sections[sym.section].chunks[sym.chunk].addr + sym.offset; }
+
+Assembler::Resolved Assembler::resolve(const Expr &expr, const int depth) const {
+    Resolved res;
+    if (depth > 32) {
+        return res;
+    }
+
+    int64_t value = expr.constant;
+    // (section or symbol index, coefficient)
+    std::vector<std::pair<uint32_t, int64_t>> secs, syms, globals;
+    const auto add = [](std::vector<std::pair<uint32_t, int64_t>> &list, const uint32_t idx, const int64_t coeff) {
+        for (auto &entry : list) {
+            if (entry.first == idx) {
+                entry.second += coeff;
+                return;
+            }
+        }
+        list.emplace_back(idx, coeff);
+    };
+
+    for (const auto &[sym_idx, coeff] : expr.terms) {
+        const auto &sym = symbols[sym_idx];
+        switch (sym.kind) {
+        case Symbol::Kind::LABEL:
+            value += coeff * static_cast<int64_t>(symbol_addr(sym));
+            add(secs, sym.section, coeff);
+            if (sym.global || sym.weak) {
+                add(globals, sym_idx, coeff);
+            }
+            break;
+        case Symbol::Kind::UNDEFINED:
+            add(syms, sym_idx, coeff);
+            break;
+        case Symbol::Kind::EQU: {
+            const auto equ = resolve(sym.equ, depth + 1);
+            switch (equ.kind) {
+            case Resolved::Kind::INVALID:
+                return res;
+            case Resolved::Kind::ABSOLUTE:
+                value += coeff * equ.value;
+                break;
+            case Resolved::Kind::SECTION:
+                value += coeff * equ.value;
+                add(secs, equ.index, coeff);
+                break;
+            case Resolved::Kind::SYMBOL:
+                value += coeff * equ.value;
+                add(syms, equ.index, coeff);
+                break;
+            }
+            break;
+        }
+        }
+    }
+
+    const auto drop_zero = [](std::vector<std::pair<uint32_t, int64_t>> &list) {
+        list.erase(std::remove_if(list.begin(), list.end(), [](const auto &entry) { return entry.second == 0; }), list.end());
+    };
+    drop_zero(secs);
+    drop_zero(syms);
+    drop_zero(globals);
+
+    res.value = value;
+    if (secs.empty() && syms.empty()) {
+        res.kind = Resolved::Kind::ABSOLUTE;
+    } else if (secs.size() == 1 && syms.empty() && secs[0].second == 1) {
+        res.kind = Resolved::Kind::SECTION;
+        res.index = secs[0].first;
+        if (globals.size() == 1 && globals[0].second == 1) {
+            res.global_sym = globals[0].first;
+        }
+    } else if (syms.size() == 1 && secs.empty() && syms[0].second == 1) {
+        res.kind = Resolved::Kind::SYMBOL;
+        res.index = syms[0].first;
+    }
+    return res;
+}
+
+void Assembler::layout(Section &sec) {
+    const auto sec_idx = static_cast<uint32_t>(&sec - sections.data());
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        uint64_t addr = 0;
+        for (auto &chunk : sec.chunks) {
+            chunk.addr = addr;
+            switch (chunk.kind) {
+            case Chunk::Kind::DATA:
+                chunk.size = chunk.bytes.size();
+                break;
+            case Chunk::Kind::BRANCH:
+                chunk.size = chunk.is_long ? (chunk.cond < 0 ? 5 : 6) : 2;
+                break;
+            case Chunk::Kind::ALIGN:
+                chunk.size = (chunk.alignment - addr % chunk.alignment) % chunk.alignment;
+                if (chunk.max_skip && chunk.size > chunk.max_skip) {
+                    chunk.size = 0;
+                }
+                break;
+            case Chunk::Kind::FILL:
+                chunk.size = chunk.count;
+                break;
+            }
+            addr += chunk.size;
+        }
+        sec.size = addr;
+
+        // branches only ever grow so this terminates
+        for (auto &chunk : sec.chunks) {
+            if (chunk.kind != Chunk::Kind::BRANCH || chunk.is_long) {
+                continue;
+            }
+            const auto target = resolve(chunk.target);
+            if (target.kind != Resolved::Kind::SECTION || target.index != sec_idx || !fits_i8(target.value - static_cast<int64_t>(chunk.addr + 2))) {
+                chunk.is_long = true;
+                changed = true;
+            }
+        }
+    }
+}
+
+void Assembler::apply_fixup(const uint32_t sec_idx, const uint64_t addr, const Fixup &fixup, uint8_t *field, const bool relaxed) {
+    auto &sec = sections[sec_idx];
+    auto target = resolve(fixup.expr);
+    if (target.kind == Resolved::Kind::INVALID) {
+        error("can't resolve expression", fixup.inst);
+        return;
+    }
+
+    // like `as`, only relaxed jumps to global labels in the same section are resolved directly
+    const bool local = target.kind == Resolved::Kind::SECTION && target.index == sec_idx && (relaxed || !target.global_sym);
+    if (target.kind == Resolved::Kind::SECTION && target.global_sym && !local) {
+        target.kind = Resolved::Kind::SYMBOL;
+        target.value -= static_cast<int64_t>(symbol_addr(symbols[*target.global_sym]));
+        target.index = *target.global_sym;
+    }
+
+    Relocation reloc{addr, 0, Relocation::Target::NONE, target.index, target.value};
+    if (target.kind == Resolved::Kind::SECTION) {
+        reloc.target = Relocation::Target::SECTION;
+    } else if (target.kind == Resolved::Kind::SYMBOL) {
+        reloc.target = Relocation::Target::SYMBOL;
+    }
+
+    if (fixup.kind == Fixup::Kind::PCREL || fixup.kind == Fixup::Kind::BRANCH) {
+        if (local) {
+            const auto disp = target.value - static_cast<int64_t>(addr + fixup.pc_bias);
+            if ((fixup.size == 1 && !fits_i8(disp)) || !fits_i32(disp)) {
+                error("relative displacement out of range", fixup.inst);
+                return;
+            }
+            write_le(field, static_cast<uint64_t>(disp), fixup.size);
+            return;
+        }
+        if (fixup.size != 4) {
+            error("can't relocate a short relative displacement", fixup.inst);
+            return;
+        }
+        // branches with an offset from the symbol can't go through the PLT
+        reloc.type = (fixup.kind == Fixup::Kind::BRANCH && target.kind == Resolved::Kind::SYMBOL && target.value == 0) ? R_X86_64_PLT32 : R_X86_64_PC32;
+        reloc.addend -= fixup.pc_bias;
+        sec.relocations.push_back(reloc);
+        return;
+    }
+
+    if (target.kind == Resolved::Kind::ABSOLUTE) {
+        const bool fits = fixup.kind == Fixup::Kind::ABS_S ? fits_i32(target.value) : fits_size(target.value, fixup.size);
+        if (!fits) {
+            error("value " + std::to_string(target.value) + " does not fit into the field", fixup.inst);
+            return;
+        }
+        write_le(field, static_cast<uint64_t>(target.value), fixup.size);
+        return;
+    }
+
+    switch (fixup.size) {
+    case 1:
+        reloc.type = R_X86_64_8;
+        break;
+    case 2:
+        reloc.type = R_X86_64_16;
+        break;
+    case 4:
+        reloc.type = fixup.kind == Fixup::Kind::ABS_S ? R_X86_64_32S : R_X86_64_32;
+        break;
+    default:
+        reloc.type = R_X86_64_64;
+        break;
+    }
+    sec.relocations.push_back(reloc);
+}
+
+bool Assembler::finish() {
+    for (const auto &sym : symbols) {
+        if (sym.temporary && sym.kind == Symbol::Kind::UNDEFINED) {
+            const auto sep = sym.name.find('\x01');
+            errors.push_back("undefined local label `" + sym.name.substr(2, sep - 2) + "'");
+        }
+    }
+    if (!errors.empty()) {
+        return false;
+    }
+
+    for (auto &sec : sections) {
+        layout(sec);
+    }
+
+    for (uint32_t sec_idx = 0; sec_idx < sections.size(); ++sec_idx) {
+        auto &sec = sections[sec_idx];
+        const bool nobits = sec.type == SHT_NOBITS;
+        sec.data.assign(nobits ? 0 : sec.size, 0);
+        sec.relocations.clear();
+
+        for (const auto &chunk : sec.chunks) {
+            uint8_t *dst = nobits ? nullptr : sec.data.data() + chunk.addr;
+            switch (chunk.kind) {
+            case Chunk::Kind::DATA:
+                if (nobits) {
+                    if (!chunk.fixups.empty() || std::any_of(chunk.bytes.begin(), chunk.bytes.end(), [](const uint8_t b) { return b != 0; })) {
+                        errors.push_back("attempt to store non-zero value in section `" + sec.name + "'");
+                    }
+                    break;
+                }
+                std::copy(chunk.bytes.begin(), chunk.bytes.end(), dst);
+                for (const auto &fixup : chunk.fixups) {
+                    apply_fixup(sec_idx, chunk.addr + fixup.offset, fixup, dst + fixup.offset);
+                }
+                break;
+            case Chunk::Kind::BRANCH: {
+                if (nobits) {
+                    errors.push_back("attempt to store non-zero value in section `" + sec.name + "'");
+                    break;
+                }
+                uint8_t op_len;
+                if (!chunk.is_long) {
+                    dst[0] = chunk.cond < 0 ? 0xEB : static_cast<uint8_t>(0x70 + chunk.cond);
+                    op_len = 1;
+                } else if (chunk.cond < 0) {
+                    dst[0] = 0xE9;
+                    op_len = 1;
+                } else {
+                    dst[0] = 0x0F;
+                    dst[1] = static_cast<uint8_t>(0x80 + chunk.cond);
+                    op_len = 2;
+                }
+                const uint8_t disp_size = chunk.is_long ? 4 : 1;
+                const Fixup fixup{Fixup::Kind::BRANCH, disp_size, disp_size, 0, chunk.inst, chunk.target};
+                apply_fixup(sec_idx, chunk.addr + op_len, fixup, dst + op_len, true);
+                break;
+            }
+            case Chunk::Kind::ALIGN:
+                if (nobits) {
+                    break;
+                }
+                if (chunk.nop_fill) {
+                    write_nops(dst, chunk.size);
+                } else {
+                    std::memset(dst, chunk.fill, chunk.size);
+                }
+                break;
+            case Chunk::Kind::FILL:
+                if (nobits) {
+                    if (chunk.fill != 0) {
+                        errors.push_back("attempt to store non-zero value in section `" + sec.name + "'");
+                    }
+                    break;
+                }
+                std::memset(dst, chunk.fill, chunk.size);
+                break;
+            }
+        }
+    }
+
+    return errors.empty();
+}
+
+const Section *Assembler::find_section(const std::string_view name) const {
+    if (const auto it = section_map.find(std::string{name}); it != section_map.end()) {
+        return &sections[it->second];
+    }
+    return nullptr;
+}
+
+bool Assembler::write_object(const std::string &path) const {
+    // section header layout: null, user sections, their relocation sections, .symtab, .strtab, .shstrtab
+    std::vector<uint32_t> rela_idx(sections.size(), 0);
+    uint32_t next_idx = static_cast<uint32_t>(sections.size()) + 1;
+    for (size_t i = 0; i < sections.size(); ++i) {
+        if (!sections[i].relocations.empty()) {
+            rela_idx[i] = next_idx++;
+        }
+    }
+    const uint32_t symtab_idx = next_idx++;
+    const uint32_t strtab_idx = next_idx++;
+    const uint32_t shstrtab_idx = next_idx++;
+    const uint32_t section_count = next_idx;
+
+    // symbol table: null, section symbols, local symbols, global symbols
+    std::string strtab(1, '\0');
+    std::vector<Elf64_Sym> syms(1 + sections.size(), Elf64_Sym{});
+    for (uint32_t i = 0; i < sections.size(); ++i) {
+        syms[i + 1].st_info = ELF64_ST_INFO(STB_LOCAL, STT_SECTION);
+        syms[i + 1].st_shndx = static_cast<uint16_t>(i + 1);
+    }
+
+    std::vector<uint32_t> sym_elf_idx(symbols.size(), 0);
+    std::vector<std::string> errs;
+    const auto add_symbols = [&](const bool global) {
+        for (uint32_t i = 0; i < symbols.size(); ++i) {
+            const auto &sym = symbols[i];
+            const bool sym_global = sym.global || sym.weak || sym.kind == Symbol::Kind::UNDEFINED;
+            if (sym.temporary || sym_global != global) {
+                continue;
+            }
+            Elf64_Sym elf_sym{};
+            elf_sym.st_name = static_cast<uint32_t>(strtab.size());
+            strtab.append(sym.name);
+            strtab.push_back('\0');
+            const auto binding = sym.weak ? STB_WEAK : (global ? STB_GLOBAL : STB_LOCAL);
+            elf_sym.st_info = ELF64_ST_INFO(binding, sym.elf_type);
+
+            if (sym.kind == Symbol::Kind::LABEL) {
+                elf_sym.st_shndx = static_cast<uint16_t>(sym.section + 1);
+                elf_sym.st_value = symbol_addr(sym);
+            } else if (sym.kind == Symbol::Kind::EQU) {
+                const auto value = resolve(sym.equ);
+                if (value.kind == Resolved::Kind::ABSOLUTE) {
+                    elf_sym.st_shndx = SHN_ABS;
+                } else if (value.kind == Resolved::Kind::SECTION) {
+                    elf_sym.st_shndx = static_cast<uint16_t>(value.index + 1);
+                } else {
+                    errs.push_back("can't emit symbol `" + sym.name + "'");
+                    continue;
+                }
+                elf_sym.st_value = static_cast<uint64_t>(value.value);
+            }
+
+            if (sym.has_size) {
+                const auto size = resolve(sym.size);
+                if (size.kind != Resolved::Kind::ABSOLUTE) {
+                    errs.push_back("size of `" + sym.name + "' is not a constant");
+                } else {
+                    elf_sym.st_size = static_cast<uint64_t>(size.value);
+                }
+            }
+
+            sym_elf_idx[i] = static_cast<uint32_t>(syms.size());
+            syms.push_back(elf_sym);
+        }
+    };
+    add_symbols(false);
+    const auto first_global = static_cast<uint32_t>(syms.size());
+    add_symbols(true);
+    if (!errs.empty()) {
+        for (const auto &err : errs) {
+            fprintf(stderr, "%s\n", err.c_str());
+        }
+        return false;
+    }
+
+    std::string shstrtab(1, '\0');
+    const auto add_name = [&shstrtab](const std::string &name) {
+        const auto off = static_cast<uint32_t>(shstrtab.size());
+        shstrtab.append(name);
+        shstrtab.push_back('\0');
+        return off;
+    };
+
+    std::vector<uint8_t> out(sizeof(Elf64_Ehdr), 0);
+    const auto append_blob = [&out](const void *data, const size_t size, const uint64_t align) {
+        out.resize((out.size() + align - 1) / align * align, 0);
+        const auto off = out.size();
+        const auto *bytes = static_cast<const uint8_t *>(data);
+        out.insert(out.end(), bytes, bytes + size);
+        return static_cast<uint64_t>(off);
+    };
+
+    std::vector<Elf64_Shdr> shdrs(section_count, Elf64_Shdr{});
+    for (uint32_t i = 0; i < sections.size(); ++i) {
+        const auto &sec = sections[i];
+        auto &shdr = shdrs[i + 1];
+        shdr.sh_name = add_name(sec.name);
+        shdr.sh_type = sec.type;
+        shdr.sh_flags = sec.flags;
+        shdr.sh_size = sec.size;
+        shdr.sh_addralign = sec.alignment;
+        if (sec.type == SHT_NOBITS) {
+            shdr.sh_offset = (out.size() + sec.alignment - 1) / sec.alignment * sec.alignment;
+        } else {
+            shdr.sh_offset = append_blob(sec.data.data(), sec.data.size(), sec.alignment);
+        }
+    }
+
+    for (uint32_t i = 0; i < sections.size(); ++i) {
+        if (!rela_idx[i]) {
+            continue;
+        }
+        std::vector<Elf64_Rela> relas;
+        relas.reserve(sections[i].relocations.size());
+        for (const auto &reloc : sections[i].relocations) {
+            uint32_t sym = 0;
+            if (reloc.target == Relocation::Target::SECTION) {
+                sym = reloc.index + 1;
+            } else if (reloc.target == Relocation::Target::SYMBOL) {
+                sym = sym_elf_idx[reloc.index];
+            }
+            relas.push_back(Elf64_Rela{reloc.offset, ELF64_R_INFO(sym, reloc.type), reloc.addend});
+        }
+        auto &shdr = shdrs[rela_idx[i]];
+        shdr.sh_name = add_name(".rela" + sections[i].name);
+        shdr.sh_type = SHT_RELA;
+        shdr.sh_flags = SHF_INFO_LINK;
+        shdr.sh_link = symtab_idx;
+        shdr.sh_info = i + 1;
+        shdr.sh_addralign = 8;
+        shdr.sh_entsize = sizeof(Elf64_Rela);
+        shdr.sh_size = relas.size() * sizeof(Elf64_Rela);
+        shdr.sh_offset = append_blob(relas.data(), shdr.sh_size, 8);
+    }
+
+    auto &symtab = shdrs[symtab_idx];
+    symtab.sh_name = add_name(".symtab");
+    symtab.sh_type = SHT_SYMTAB;
+    symtab.sh_link = strtab_idx;
+    symtab.sh_info = first_global;
+    symtab.sh_addralign = 8;
+    symtab.sh_entsize = sizeof(Elf64_Sym);
+    symtab.sh_size = syms.size() * sizeof(Elf64_Sym);
+    symtab.sh_offset = append_blob(syms.data(), symtab.sh_size, 8);
+
+    auto &strtab_hdr = shdrs[strtab_idx];
+    strtab_hdr.sh_name = add_name(".strtab");
+    strtab_hdr.sh_type = SHT_STRTAB;
+    strtab_hdr.sh_addralign = 1;
+    strtab_hdr.sh_size = strtab.size();
+    strtab_hdr.sh_offset = append_blob(strtab.data(), strtab.size(), 1);
+
+    auto &shstrtab_hdr = shdrs[shstrtab_idx];
+    shstrtab_hdr.sh_name = add_name(".shstrtab");
+    shstrtab_hdr.sh_type = SHT_STRTAB;
+    shstrtab_hdr.sh_addralign = 1;
+    shstrtab_hdr.sh_size = shstrtab.size();
+    shstrtab_hdr.sh_offset = append_blob(shstrtab.data(), shstrtab.size(), 1);
+
+    const auto shdr_off = append_blob(shdrs.data(), shdrs.size() * sizeof(Elf64_Shdr), 8);
+
+    Elf64_Ehdr ehdr{};
+    std::memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr.e_type = ET_REL;
+    ehdr.e_machine = EM_X86_64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_shoff = shdr_off;
+    ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr.e_shentsize = sizeof(Elf64_Shdr);
+    ehdr.e_shnum = static_cast<uint16_t>(section_count);
+    ehdr.e_shstrndx = static_cast<uint16_t>(shstrtab_idx);
+    std::memcpy(out.data(), &ehdr, sizeof(ehdr));
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return false;
+    }
+    file.write(reinterpret_cast<const char *>(out.data()), static_cast<std::streamsize>(out.size()));
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,140 @@
+#include <generator/x86_64/block_layout.h>
+
+#include <algorithm>
+
+using namespace generator::x86_64::layout;
+
+namespace {
+struct Edge {
+    BasicBlock *src;
+    BasicBlock *dst;
+    uint32_t weight;
+};
+
+// without a profile we can only guess how likely an edge is taken
+uint32_t edge_weight(const CfOp &cf_op) {
+    switch (cf_op.type) {
+    case CFCInstruction::jump:
+        // either an unconditional jump or the fall-through of a cjump
+        return 4;
+    case CFCInstruction::syscall:
+        return 3;
+    case CFCInstruction::call:
+        return 2;
+    case CFCInstruction::cjump:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+BasicBlock *layout_successor(const CfOp &cf_op) {
+    if (cf_op.type == CFCInstruction::call) {
+        // the call target is reached through a call instruction anyway, so the code after the call should follow
+        return std::get<CfOp::CallInfo>(cf_op.info).continuation_block;
+    }
+    return cf_op.target();
+}
+
+size_t find_chain(std::vector<size_t> &chain_ids, size_t id) {
+    while (chain_ids[id] != id) {
+        chain_ids[id] = chain_ids[chain_ids[id]];
+        id = chain_ids[id];
+    }
+    return id;
+}
+} // namespace
+
+bool BlockLayout::is_cold(const BasicBlock *bb) {
+    if (bb->control_flow_ops.empty()) {
+        return false;
+    }
+    return std::all_of(bb->control_flow_ops.begin(), bb->control_flow_ops.end(), [](const CfOp &cf_op) { return cf_op.type == CFCInstruction::unreachable; });
+}
+
+void BlockLayout::find_loop_headers() {
+    loop_headers.assign(ir->cur_block_id, false);
+    for (const auto &bb : ir->basic_blocks) {
+        for (const auto &cf_op : bb->control_flow_ops) {
+            if (cf_op.type != CFCInstruction::jump && cf_op.type != CFCInstruction::cjump) {
+                continue;
+            }
+            // a jump backwards in the original binary most likely closes a loop
+            const auto *target = cf_op.target();
+            if (target && target->virt_start_addr != 0 && target->virt_start_addr <= bb->virt_start_addr) {
+                loop_headers[target->id] = true;
+            }
+        }
+    }
+}
+
+void BlockLayout::build() {
+    hot_blocks.clear();
+    cold_blocks.clear();
+    find_loop_headers();
+
+    const size_t block_count = ir->cur_block_id;
+    std::vector<BasicBlock *> next(block_count, nullptr);
+    std::vector<BasicBlock *> prev(block_count, nullptr);
+    std::vector<size_t> chain_ids(block_count);
+    for (size_t i = 0; i < block_count; ++i) {
+        chain_ids[i] = i;
+    }
+
+    std::vector<Edge> edges;
+    for (const auto &bb : ir->basic_blocks) {
+        if (is_cold(bb.get())) {
+            continue;
+        }
+        for (const auto &cf_op : bb->control_flow_ops) {
+            auto *dst = layout_successor(cf_op);
+            const auto weight = edge_weight(cf_op);
+            if (dst == nullptr || dst == bb.get() || weight == 0 || is_cold(dst)) {
+                continue;
+            }
+            edges.push_back(Edge{bb.get(), dst, weight});
+        }
+    }
+
+    // stable to keep the output deterministic, edges with equal weight are chained in original block order
+    std::stable_sort(edges.begin(), edges.end(), [](const Edge &e1, const Edge &e2) { return e1.weight > e2.weight; });
+
+    for (const auto &edge : edges) {
+        // only tail-to-head connections are allowed, everything else would break up an existing chain
+        if (next[edge.src->id] != nullptr || prev[edge.dst->id] != nullptr) {
+            continue;
+        }
+        const auto src_chain = find_chain(chain_ids, edge.src->id);
+        const auto dst_chain = find_chain(chain_ids, edge.dst->id);
+        if (src_chain == dst_chain) {
+            continue;
+        }
+        next[edge.src->id] = edge.dst;
+        prev[edge.dst->id] = edge.src;
+        chain_ids[dst_chain] = src_chain;
+    }
+
+    // emit the chains in the order in which their first member appears in the IR so the layout stays close to the original one
+    std::vector<bool> placed(block_count, false);
+    hot_blocks.reserve(ir->basic_blocks.size());
+    for (const auto &bb : ir->basic_blocks) {
+        if (placed[bb->id]) {
+            continue;
+        }
+        if (is_cold(bb.get())) {
+            placed[bb->id] = true;
+            cold_blocks.push_back(bb.get());
+            continue;
+        }
+
+        auto *head = bb.get();
+        while (prev[head->id] != nullptr) {
+            head = prev[head->id];
+        }
+        for (auto *cur = head; cur != nullptr; cur = next[cur->id]) {
+            assert(!placed[cur->id]);
+            placed[cur->id] = true;
+            hot_blocks.push_back(cur);
+        }
+    }
+}
@@ -1,5 +1,6 @@
 #include "generator/x86_64/generator.h"
 
+#include <algorithm>
 #include <iostream>
 
 using namespace generator::x86_64;
@@ -7,30 +8,34 @@ using namespace generator::x86_64;
 // TODO: imm handling is questionable at best here
 
 namespace {
-std::array<const char *, 4> op_reg_mapping_64 = {"rax", "rbx", "rcx", "rdx"};
+std::array<REGISTER, 4> op_regs = {REG_A, REG_B, REG_C, REG_D};
 
-std::array<const char *, 4> op_reg_mapping_32 = {"eax", "ebx", "ecx", "edx"};
-
-std::array<const char *, 4> op_reg_mapping_16 = {"ax", "bx", "cx", "dx"};
+// operand register in_idx of an operation, xmm<in_idx> for floats
+mir::Operand op_reg(const Type type, const size_t in_idx) {
+    assert(type != Type::mt);
+    if (is_float(type)) {
+        return mir::fp_reg(static_cast<FP_REGISTER>(in_idx));
+    }
+    return mir::reg(op_regs[in_idx], type);
+}
 
-std::array<const char *, 4> op_reg_mapping_8 = {"al", "bl", "cl", "dl"};
+std::array<REGISTER, 6> call_reg = {REG_DI, REG_SI, REG_D, REG_C, REG_8, REG_9};
 
-std::array<const char *, 4> op_reg_mapping_fp = {"xmm0", "xmm1", "xmm2", "xmm3"};
+// arguments of the syscall instruction
+std::array<REGISTER, 6> syscall_reg = {REG_DI, REG_SI, REG_D, REG_10, REG_8, REG_9};
 
-std::array<const char *, 4> &op_reg_map_for_type(const Type type) {
+mir::Operand rax_from_type(const Type type) {
     switch (type) {
     case Type::imm:
     case Type::i64:
-        return op_reg_mapping_64;
     case Type::i32:
-        return op_reg_mapping_32;
     case Type::i16:
-        return op_reg_mapping_16;
     case Type::i8:
-        return op_reg_mapping_8;
+        return mir::reg(REG_A, type);
     case Type::f32:
+        return mir::reg(REG_A, Type::i32);
     case Type::f64:
-        return op_reg_mapping_fp;
+        return mir::reg(REG_A);
     case Type::mt:
         assert(0);
         exit(1);
@@ -40,52 +45,18 @@ std::array<const char *, 4> &op_reg_map_for_type(const Type type) {
     exit(1);
 }
 
-std::array<const char *, 6> call_reg = {"rdi", "rsi", "rdx", "rcx", "r8", "r9"};
+// movd for f32, movq for f64 and 64 bit integers
+mir::Opcode mov_from_type(const Type type) { return (type == Type::f32 || type == Type::i32) ? mir::Opcode::MOVD : mir::Opcode::MOVQ; }
 
-const char *rax_from_type(const Type type) {
-    switch (type) {
-    case Type::imm:
-    case Type::i64:
-        return "rax";
-    case Type::i32:
-        return "eax";
-    case Type::i16:
-        return "ax";
-    case Type::i8:
-        return "al";
-    case Type::f32:
-        return "eax";
-    case Type::f64:
-        return "rax";
-    case Type::mt:
-        assert(0);
-        exit(1);
+// cvt[t]<in>2<out>, at least one of the types is a float
+mir::Opcode convert_from_types(const Type in, const Type out, const bool truncate) {
+    if (is_integer(in)) {
+        return mir::scalar(mir::Opcode::CVTSI2SS, out);
     }
-
-    assert(0);
-    exit(1);
-}
-
-const char *ptr_from_type(const Type type) {
-    switch (type) {
-    case Type::imm:
-    case Type::i64:
-        return "QWORD PTR";
-    case Type::i32:
-        return "DWORD PTR";
-    case Type::i16:
-        return "WORD PTR";
-    case Type::i8:
-        return "BYTE PTR";
-    case Type::f32:
-    case Type::f64:
-    case Type::mt:
-        assert(0);
-        exit(1);
+    if (is_integer(out)) {
+        return mir::scalar(truncate ? mir::Opcode::CVTTSS2SI : mir::Opcode::CVTSS2SI, in);
     }
-
-    assert(0);
-    exit(1);
+    return in == Type::f32 ? mir::Opcode::CVTSS2SD : mir::Opcode::CVTSD2SS;
 }
 
 size_t index_for_var(const BasicBlock *block, const SSAVar *var) {
@@ -98,71 +69,69 @@ size_t index_for_var(const BasicBlock *block, const SSAVar *var) {
     exit(1);
 }
 
-} // namespace
+mir::Symbol block_label(const size_t id) { return mir::symbol(mir::Symbol::Kind::BLOCK, id); }
 
-const char *Generator::fp_op_size_from_type(const Type type) {
-    assert(is_float(type));
-    return type == Type::f32 ? "s" : "d";
-}
-
-const char *Generator::convert_name_from_type(const Type type) {
-    switch (type) {
-    case Type::i32:
-    case Type::i64:
-        return "si";
-    case Type::f32:
-        return "ss";
-    case Type::f64:
-        return "sd";
-    default:
-        assert(0);
-        exit(0);
-        break;
-    }
-}
+} // namespace
 
 constexpr bool compatible_types(const Type t1, const Type t2) { return (t1 == t2) || ((t1 == Type::imm || t2 == Type::imm) && (is_integer(t1) || is_integer(t2))); }
 
 void Generator::compile() {
     assert(err_msgs.empty());
+    assert(pinned_statics.size() <= pinned_regs.size());
+    if ((optimizations & OPT_MBRA) && !pinned_statics.empty()) {
+        // the register call convention passes sp, s0 and ra in r12-r14 itself
+        optimizations &= ~OPT_CALL_CONV;
+    }
+    if (multithreaded_guest) {
+        // the helper fills the inline caches without synchronization, a thread could read a half written entry
+        optimizations &= ~OPT_INLINE_CACHE;
+    }
 
-    fprintf(out_fd, ".intel_syntax noprefix\n\n");
+    thread_pool = std::make_unique<ThreadPool>(resolve_thread_count(thread_count));
+
+    if (out_fd != nullptr) {
+        fprintf(out_fd, ".intel_syntax noprefix\n\n");
+    }
     if (!binary_filepath.empty()) {
         /* TODO: extract read-write-execute information from source ELF program headers */
 
         /* Put the original image into a seperate section so we can set the start address */
-        fprintf(out_fd, ".section .orig_binary, \"aw\"\n");
-        fprintf(out_fd, ".incbin \"%s\"\n", binary_filepath.c_str());
+        compile_section(Section::ORIG_BINARY);
+        output.incbin(binary_filepath);
     }
 
     /* we expect the linker to link the original binary image (if any) at
      * exactly this address
      */
-    fprintf(out_fd, ".global orig_binary_vaddr\n");
-    fprintf(out_fd, "orig_binary_vaddr = %#lx\n", ir->base_addr);
-    fprintf(out_fd, ".global orig_binary_size\n");
-    fprintf(out_fd, "orig_binary_size = %#lx\n", ir->load_size);
-    fprintf(out_fd, "binary = orig_binary_vaddr\n");
+    output.global(mir::named("orig_binary_vaddr"));
+    output.set(mir::named("orig_binary_vaddr"), mir::hex_imm(static_cast<int64_t>(ir->base_addr)));
+    output.global(mir::named("orig_binary_size"));
+    output.set(mir::named("orig_binary_size"), mir::hex_imm(static_cast<int64_t>(ir->load_size)));
+    output.set(mir::named("binary"), mir::label(mir::named("orig_binary_vaddr")));
 
     compile_statics();
     compile_phdr_info();
 
     compile_section(Section::BSS);
 
-    fprintf(out_fd, "param_passing:\n");
-    fprintf(out_fd, ".space 128\n");
-    fprintf(out_fd, ".type param_passing,STT_OBJECT\n");
-    fprintf(out_fd, ".size param_passing,$-param_passing\n");
-
-    fprintf(out_fd, ".align 16\n");
-    fprintf(out_fd, "stack_space:\n");
-    fprintf(out_fd, ".space 1048576\n"); /* 1MiB */
-    fprintf(out_fd, "stack_space_end:\n");
-    fprintf(out_fd, ".type stack_space,STT_OBJECT\n");
-    fprintf(out_fd, ".size stack_space,$-stack_space\n");
-
-    fprintf(out_fd, "init_stack_ptr: .quad 0\n");
-    fprintf(out_fd, "init_ret_stack_ptr: .quad 0\n");
+    output.label(mir::named("param_passing"));
+    output.space(128);
+    output.type(mir::named("param_passing"), mir::SymbolType::OBJECT);
+    output.size(mir::named("param_passing"));
+
+    output.align(4);
+    output.label(mir::named("stack_space"));
+    output.space(1048576); /* 1MiB */
+    output.label(mir::named("stack_space_end"));
+    output.type(mir::named("stack_space"), mir::SymbolType::OBJECT);
+    output.size(mir::named("stack_space"));
+
+    if (!multithreaded_guest) {
+        for (const auto *name : {"init_stack_ptr", "init_ret_stack_ptr", "reservation"}) {
+            output.label(mir::named(name));
+            emit(mir::Opcode::QUAD, mir::imm(0));
+        }
+    }
 
     if (interpreter_only) {
         compile_interpreter_only_entry();
@@ -172,23 +141,40 @@ void Generator::compile() {
         compile_entry();
 
         compile_err_msgs();
+
+        compile_ijump_caches();
+
+        compile_jump_tables();
     }
 
     compile_ijump_lookup();
+    flush();
+}
+
+void Generator::write(const mir::Block &block) {
+    if (out_fd != nullptr) {
+        std::string text;
+        block.lower(text, tcb_prefix());
+        fwrite(text.data(), 1, text.size(), out_fd);
+    }
+    if (assembler != nullptr) {
+        assembler->assemble(block, multithreaded_guest);
+    }
 }
 
 void Generator::compile_ijump_lookup() {
-    fprintf(out_fd, ".global ijump_use_hash_table\n");
+    using mir::Opcode;
+    const auto rbx = mir::reg(REG_B), rdi = mir::reg(REG_DI), rsi = mir::reg(REG_SI);
 
-    fprintf(out_fd, ".global ijump_lookup_table_base\n");
-    fprintf(out_fd, ".global ijump_lookup_table\n");
-    fprintf(out_fd, ".global ijump_lookup_table_end\n");
+    for (const auto *name : {"ijump_use_hash_table", "ijump_lookup_table_base", "ijump_lookup_table", "ijump_lookup_table_end"}) {
+        output.global(mir::named(name));
+    }
 
     if (!(optimizations & OPT_NO_HASH_LOOKUP)) {
-        using namespace hashing;
+        ijump_hasher.thread_pool = thread_pool.get();
         while (!ijump_hasher.build()) {
-            ijump_hasher.load_factor -= 0.1;
-            ijump_hasher.bucket_size -= 1;
+            // every halving doubles the size of the table
+            ijump_hasher.load_factor /= 2;
             if (ijump_hasher.load_factor <= 0.05) {
                 std::cerr << "Unable to calculate valid hash function!" << std::endl;
                 assert(0);
@@ -198,152 +184,482 @@ void Generator::compile_ijump_lookup() {
         }
 
         compile_section(Section::TEXT);
-        ijump_hasher.print_ijump_lookup(out_fd);
+        ijump_hasher.compile_ijump_lookup(output, unresolved_ijump_label(), count_stats, multithreaded_guest);
 
         compile_section(Section::RODATA);
-        ijump_hasher.print_hash_func_ids(out_fd);
-        ijump_hasher.print_hash_table(out_fd, ir);
-        ijump_hasher.print_hash_constants(out_fd);
+        ijump_hasher.compile_hash_displacements(output);
+        ijump_hasher.compile_hash_table(output, ir);
+        ijump_hasher.compile_hash_constants(output);
 
-        fprintf(out_fd, "ijump_use_hash_table:\n.byte 1\n");
+        output.label(mir::named("ijump_use_hash_table"));
+        emit(Opcode::BYTE, mir::imm(1));
         // Lookup table stubs
-        fprintf(out_fd, "ijump_lookup_table:\n");
-        fprintf(out_fd, "ijump_lookup_table_end:\n");
-        fprintf(out_fd, "ijump_lookup_table_base:\n.8byte 0\n");
+        output.label(mir::named("ijump_lookup_table"));
+        output.label(mir::named("ijump_lookup_table_end"));
+        output.label(mir::named("ijump_lookup_table_base"));
+        emit(Opcode::QUAD, mir::imm(0));
     } else {
+        /* Two-level table: the first level has a pointer for every guest page, the second level an entry for every
+         * 2 bytes of a page. Pages without blocks share an array of zeros so the lookup is two loads without a check
+         * in between. */
+        assert(ir->virt_bb_start_addr <= ir->virt_bb_end_addr);
+        const uint64_t table_base = ir->virt_bb_start_addr & ~(IJUMP_LOOKUP_PAGE_SIZE - 1);
+        const size_t page_count = (ir->virt_bb_end_addr - table_base + IJUMP_LOOKUP_PAGE_SIZE - 1) / IJUMP_LOOKUP_PAGE_SIZE;
+        const size_t page_entries = IJUMP_LOOKUP_PAGE_SIZE / 2;
+
         compile_section(Section::TEXT);
-        fprintf(out_fd, "ijump_lookup:");
-        fprintf(out_fd, "sub rbx, %zu\n", ir->virt_bb_start_addr);
+        output.label(mir::named("ijump_lookup"));
+        if (count_stats) {
+            emit(Opcode::INC, mir::sized(mir::mem(mir::named("stats_ijump_lookups")), Type::i64)).lock = multithreaded_guest;
+        }
+        emit(Opcode::MOV, rdi, rbx);
+        if (table_base <= INT32_MAX) {
+            emit(Opcode::SUB, rdi, mir::imm(static_cast<int64_t>(table_base)));
+        } else {
+            emit(Opcode::MOV, rsi, mir::imm(static_cast<int64_t>(table_base)));
+            emit(Opcode::SUB, rdi, rsi);
+        }
 
-        size_t size = ir->virt_bb_end_addr - ir->virt_bb_start_addr;
+        const size_t size = page_count * IJUMP_LOOKUP_PAGE_SIZE;
         if (size < 0x8000'0000) {
-            fprintf(out_fd, "cmp rbx, %zu\n", size);
+            emit(Opcode::CMP, rdi, mir::imm(static_cast<int64_t>(size)));
         } else {
-            fprintf(out_fd, "mov rdi, %zu\n", size);
-            fprintf(out_fd, "cmp rbx, rdi\n");
+            emit(Opcode::MOV, rsi, mir::imm(static_cast<int64_t>(size)));
+            emit(Opcode::CMP, rdi, rsi);
         }
-        fprintf(out_fd, "ja 0f\n");
-        fprintf(out_fd, "lea rdi, [rip + ijump_lookup_table]\n");
-        fprintf(out_fd, "mov rdi, [rdi + 4 * rbx]\n");
-        fprintf(out_fd, "test rdi, rdi\n");
-        fprintf(out_fd, "je 0f\n");
-        fprintf(out_fd, "jmp rdi\n");
-        fprintf(out_fd, "0:\n");
+        emit(Opcode::JCC, mir::Cond::AE, mir::label(mir::local(0)));
+        emit(Opcode::MOV, rsi, rdi);
+        emit(Opcode::SHR, rsi, mir::imm(__builtin_ctzll(IJUMP_LOOKUP_PAGE_SIZE)));
+        emit(Opcode::MOV, rsi, mir::mem(mir::named("ijump_lookup_table"), REG_NONE, REG_SI, 8));
+        // offset in the page without the lowest bit, scaled from 2 bytes per entry to 8
+        emit(Opcode::AND, mir::reg(REG_DI, Type::i32), mir::imm(IJUMP_LOOKUP_PAGE_SIZE - 2));
+        emit(Opcode::MOV, rsi, mir::mem(REG_SI, REG_DI, 4, 0));
+        emit(Opcode::TEST, rsi, rsi);
+        emit(Opcode::JCC, mir::Cond::E, mir::label(mir::local(0)));
+        emit(Opcode::JMP, rsi);
+        output.label(mir::local(0));
 
         /* Slow-path: unresolved IJump, call interpreter */
-        fprintf(out_fd, "lea rdi, [rbx + %zu]\n", ir->virt_bb_start_addr);
-        fprintf(out_fd, "jmp unresolved_ijump\n");
+        if (count_stats) {
+            emit(Opcode::INC, mir::sized(mir::mem(mir::named("stats_ijump_lookup_misses")), Type::i64)).lock = multithreaded_guest;
+        }
+        emit(Opcode::MOV, rdi, rbx);
+        emit(Opcode::JMP, mir::label(unresolved_ijump_label()));
+
+        const auto lookup_target = [this](const uint64_t addr) -> BasicBlock * {
+            auto *bb = ir->bb_at_addr(addr);
+            if (addr >= ir->virt_bb_start_addr && addr < ir->virt_bb_end_addr && bb != nullptr && bb->virt_start_addr == addr &&
+                (!(optimizations & OPT_MBRA) || !(optimizations & OPT_NO_TRANS_BBS) || RegAlloc::is_block_jumpable(bb))) {
+                return bb;
+            }
+            return nullptr;
+        };
 
-        compile_section(Section::RODATA);
+        std::vector<bool> page_used(page_count, false);
+        for (size_t page = 0; page < page_count; ++page) {
+            for (size_t i = 0; i < page_entries && !page_used[page]; ++i) {
+                page_used[page] = lookup_target(table_base + page * IJUMP_LOOKUP_PAGE_SIZE + 2 * i) != nullptr;
+            }
+        }
 
-        fprintf(out_fd, "ijump_lookup_table_base:\n");
-        fprintf(out_fd, ".8byte %zu\n", ir->virt_bb_start_addr);
+        compile_section(Section::BSS);
+        output.align(3);
+        output.label(mir::named("ijump_lookup_empty_page"));
+        output.space(page_entries * 8);
 
-        fprintf(out_fd, "ijump_lookup_table:\n");
+        compile_section(Section::RODATA);
+        output.align(3);
 
-        assert(ir->virt_bb_start_addr <= ir->virt_bb_end_addr);
+        output.label(mir::named("ijump_lookup_table_base"));
+        emit(Opcode::QUAD, mir::imm(static_cast<int64_t>(table_base)));
 
-        /* Incredibly space inefficient but also O(1) fast */
-        for (uint64_t i = ir->virt_bb_start_addr; i < ir->virt_bb_end_addr; i += 2) {
-            const auto bb = ir->bb_at_addr(i);
-            fprintf(out_fd, "/* 0x%#.8lx: */", i);
-            if (bb != nullptr && bb->virt_start_addr == i && (!(optimizations & OPT_MBRA) || !(optimizations & OPT_NO_TRANS_BBS) || RegAlloc::is_block_jumpable(bb))) {
-                fprintf(out_fd, ".8byte b%zu\n", bb->id);
+        output.label(mir::named("ijump_lookup_table"));
+        for (size_t page = 0; page < page_count; ++page) {
+            if (page_used[page]) {
+                emit(Opcode::QUAD, mir::label(mir::symbol(mir::Symbol::Kind::LOOKUP_PAGE, page)));
             } else {
-                fprintf(out_fd, ".8byte 0x0\n");
+                emit(Opcode::QUAD, mir::label(mir::named("ijump_lookup_empty_page")));
             }
         }
+        output.label(mir::named("ijump_lookup_table_end"));
+        output.type(mir::named("ijump_lookup_table"), mir::SymbolType::OBJECT);
+        output.size(mir::named("ijump_lookup_table"), mir::named("ijump_lookup_table_end"));
+
+        for (size_t page = 0; page < page_count; ++page) {
+            if (!page_used[page]) {
+                continue;
+            }
 
-        fprintf(out_fd, "ijump_lookup_table_end:\n");
-        fprintf(out_fd, ".type ijump_lookup_table,STT_OBJECT\n");
-        fprintf(out_fd, ".size ijump_lookup_table,ijump_lookup_table_end-ijump_lookup_table\n");
+            output.label(mir::symbol(mir::Symbol::Kind::LOOKUP_PAGE, page));
+            size_t zeros = 0;
+            for (size_t i = 0; i < page_entries; ++i) {
+                const uint64_t addr = table_base + page * IJUMP_LOOKUP_PAGE_SIZE + 2 * i;
+                const auto *bb = lookup_target(addr);
+                if (bb == nullptr) {
+                    zeros++;
+                    continue;
+                }
+                if (zeros != 0) {
+                    output.space(zeros * 8);
+                    zeros = 0;
+                }
+                comment("%#lx:", addr);
+                emit(Opcode::QUAD, mir::block(bb->id));
+            }
+            if (zeros != 0) {
+                output.space(zeros * 8);
+            }
+            // the pages can get big, so they aren't held in memory until the end
+            flush();
+        }
 
-        fprintf(out_fd, "ijump_use_hash_table:\n.byte 0\n");
+        output.label(mir::named("ijump_use_hash_table"));
+        emit(Opcode::BYTE, mir::imm(0));
         // Hash stubs
-        fprintf(out_fd, ".global ijump_hash_function_idxs\nijump_hash_function_idxs:\n");
-        fprintf(out_fd, ".global ijump_hash_table\nijump_hash_table:\n");
-        fprintf(out_fd, ".global ijump_hash_bucket_number\nijump_hash_bucket_number:\n.quad 0\n");
-        fprintf(out_fd, ".global ijump_hash_table_size\nijump_hash_table_size:\n.quad 0\n");
+        for (const auto *name : {"ijump_hash_displacements", "ijump_hash_table"}) {
+            output.global(mir::named(name));
+            output.label(mir::named(name));
+        }
+        output.align(3);
+        for (const auto *constant : {"ijump_hash_table_size", "ijump_hash_seed", "ijump_hash_bucket_bits", "ijump_hash_partition_bits", "ijump_hash_slot_bits"}) {
+            output.global(mir::named(constant));
+            output.label(mir::named(constant));
+            emit(Opcode::QUAD, mir::imm(0));
+        }
+    }
+}
+
+/* Every indirect jump site gets its own inline cache so that the branch predictor sees one indirect jump per site instead of
+ * the single one in ijump_lookup. The site compares the guest address against the cached ones and jumps through the
+ * matching entry. The text section isn't writable, so the "patched" jump is an indirect jump through the site's data.
+ * On a miss ijump_cache_update resolves the address and puts it in front of the cache. Sites which keep missing are
+ * megamorphic, they are redirected to ijump_lookup for good.
+ *
+ * layout of the data: miss target, lookup target, miss count, IJUMP_CACHE_ENTRIES * (guest address, host target)
+ */
+void Generator::compile_ijump_caches() {
+    if (!(optimizations & OPT_INLINE_CACHE)) {
+        return;
+    }
+
+    using mir::Opcode;
+    const auto rax = mir::reg(REG_A), rbx = mir::reg(REG_B), rbp = mir::reg(REG_BP);
+
+    compile_section(Section::TEXT);
+    // the helper gets an aligned stack, rbx and the pinned registers are callee-saved
+    output.label(mir::named("ijump_cache_miss"));
+    emit(Opcode::PUSH, rbp);
+    emit(Opcode::MOV, rbp, mir::stack_ptr());
+    emit(Opcode::AND, mir::stack_ptr(), mir::imm(-16));
+    emit(Opcode::MOV, mir::reg(REG_DI), rbx);
+    emit(Opcode::CALL, mir::label(mir::named("ijump_cache_update")));
+    emit(Opcode::MOV, mir::stack_ptr(), rbp);
+    emit(Opcode::POP, rbp);
+    emit(Opcode::TEST, rax, rax);
+    emit(Opcode::JCC, mir::Cond::E, mir::label(mir::local(0)));
+    emit(Opcode::JMP, rax);
+    output.label(mir::local(0));
+    emit(Opcode::MOV, mir::reg(REG_DI), rbx);
+    emit(Opcode::JMP, mir::label(unresolved_ijump_label()));
+
+    // the data and miss labels of a site have the same block and cfop as the site's label
+    const auto site_label = [](const mir::Symbol &site, const mir::Symbol::Kind kind) { return mir::symbol(kind, site.id, site.sub); };
+    const auto for_each_site = [this](const auto &fn) {
+        for (const auto &bb : ir->basic_blocks) {
+            for (const auto &cf_op : bb->control_flow_ops) {
+                if (cf_op.type == CFCInstruction::ijump || cf_op.type == CFCInstruction::icall || cf_op.type == CFCInstruction::_return) {
+                    fn(ijump_target_label(bb.get(), cf_op));
+                }
+            }
+        }
+    };
+
+    for_each_site([this, &site_label, &rbx](const mir::Symbol &site) {
+        const auto data = site_label(site, mir::Symbol::Kind::IJUMP_CACHE_DATA);
+        const auto miss = site_label(site, mir::Symbol::Kind::IJUMP_CACHE_MISS);
+        output.label(site);
+        for (size_t i = 0; i < IJUMP_CACHE_ENTRIES; ++i) {
+            emit(Opcode::CMP, rbx, mir::mem(data, REG_NONE, REG_NONE, 1, static_cast<int64_t>(24 + 16 * i)));
+            emit(Opcode::JCC, mir::Cond::NE, mir::label(mir::local(0)));
+            emit(Opcode::JMP, mir::mem(data, REG_NONE, REG_NONE, 1, static_cast<int64_t>(32 + 16 * i)));
+            output.label(mir::local(0));
+        }
+        emit(Opcode::JMP, mir::mem(data));
+        output.label(miss);
+        emit(Opcode::MOV, mir::reg(REG_SI), mir::offset(data));
+        emit(Opcode::JMP, mir::label(mir::named("ijump_cache_miss")));
+    });
+
+    compile_section(Section::DATA);
+    output.align(3);
+    for_each_site([this, &site_label](const mir::Symbol &site) {
+        const auto miss = site_label(site, mir::Symbol::Kind::IJUMP_CACHE_MISS);
+        output.label(site_label(site, mir::Symbol::Kind::IJUMP_CACHE_DATA));
+        emit(Opcode::QUAD, mir::label(miss));
+        emit(Opcode::QUAD, mir::label(mir::named("ijump_lookup")));
+        emit(Opcode::QUAD, mir::imm(0));
+        // empty entries resolve through the miss path as well, so a jump to address 0 still ends up in the interpreter
+        for (size_t i = 0; i < IJUMP_CACHE_ENTRIES; ++i) {
+            emit(Opcode::QUAD, mir::imm(0));
+            emit(Opcode::QUAD, mir::label(miss));
+        }
+    });
+}
+
+const helper::SyscallInfo *Generator::inline_syscall_info(const CfOp &cf_op) const {
+    // inline syscalls bypass syscall_impl which counts and times them for --stats
+    if (!(optimizations & OPT_INLINE_SYSCALLS) || count_stats || cf_op.type != CFCInstruction::syscall || !cf_op.in_vars[0] || !cf_op.in_vars[0]->is_immediate()) {
+        return nullptr;
+    }
+
+    // libc routines substituted by the lifter use ids after the syscalls
+    const auto &id = cf_op.in_vars[0]->get_immediate();
+    if (id.binary_relative || id.val < 0 || static_cast<uint64_t>(id.val) > static_cast<uint64_t>(RISCV_SYSCALL_ID::SYSCALL_ID_MAX)) {
+        return nullptr;
     }
+
+    const auto &info = helper::rv64_syscall_table[id.val];
+    return info.action == helper::SyscallAction::passthrough ? &info : nullptr;
+}
+
+const char *Generator::libc_routine_symbol(const CfOp &cf_op) {
+    if (cf_op.type != CFCInstruction::syscall || !cf_op.in_vars[0] || !cf_op.in_vars[0]->is_immediate()) {
+        return nullptr;
+    }
+
+    const auto &id = cf_op.in_vars[0]->get_immediate();
+    if (id.binary_relative) {
+        return nullptr;
+    }
+    switch (static_cast<LIBC_ROUTINE_ID>(id.val)) {
+    case LIBC_ROUTINE_ID::MEMCPY:
+        return "libc_memcpy";
+    case LIBC_ROUTINE_ID::MEMSET:
+        return "libc_memset";
+    case LIBC_ROUTINE_ID::MEMMOVE:
+        return "libc_memmove";
+    case LIBC_ROUTINE_ID::STRLEN:
+        return "libc_strlen";
+    case LIBC_ROUTINE_ID::STRCMP:
+        return "libc_strcmp";
+    case LIBC_ROUTINE_ID::MEMCHR:
+        return "libc_memchr";
+    }
+    return nullptr;
+}
+
+mir::Symbol Generator::ijump_target_label(const BasicBlock *bb, const CfOp &cf_op) const {
+    if (!(optimizations & OPT_INLINE_CACHE)) {
+        return mir::named("ijump_lookup");
+    }
+    return mir::symbol(mir::Symbol::Kind::IJUMP_CACHE, bb->id, static_cast<uint32_t>(&cf_op - bb->control_flow_ops.data()));
+}
+
+/* Switch dispatches which the lifter recognised as jump tables in read-only memory index a translated copy of the table
+ * instead of looking up the loaded address. Entries which aren't valid jump targets go through the regular ijump path.
+ */
+void Generator::compile_jump_tables() {
+    if (!(optimizations & OPT_JUMP_TABLES)) {
+        return;
+    }
+
+    compile_section(Section::RODATA);
+    output.align(3);
+    for (const auto &bb : ir->basic_blocks) {
+        for (const auto &cf_op : bb->control_flow_ops) {
+            if (!uses_jump_table(cf_op)) {
+                continue;
+            }
+
+            const auto fallback = ijump_target_label(bb.get(), cf_op);
+            output.label(jump_table_label(bb.get(), cf_op));
+            for (const auto addr : std::get<CfOp::IJumpInfo>(cf_op.info).jump_table->entries) {
+                auto *target = (addr != 0 ? ir->bb_at_addr(addr) : nullptr);
+                if (target != nullptr && target->virt_start_addr == addr && (!(optimizations & OPT_MBRA) || !(optimizations & OPT_NO_TRANS_BBS) || RegAlloc::is_block_jumpable(target))) {
+                    emit(mir::Opcode::QUAD, mir::block(target->id));
+                } else {
+                    emit(mir::Opcode::QUAD, mir::label(fallback));
+                }
+            }
+        }
+    }
+}
+
+void Generator::jump_table_index(mir::Block &out, const CfOp &cf_op, const REGISTER index_reg, const REGISTER entry_addr_reg) const {
+    const auto &table = *std::get<CfOp::IJumpInfo>(cf_op.info).jump_table;
+    assert(table.entry_size != 0 && table.entry_size <= 8 && (table.entry_size & (table.entry_size - 1)) == 0);
+
+    if (table.base <= INT32_MAX) {
+        out.append(mir::Opcode::LEA, mir::reg(index_reg), mir::mem(entry_addr_reg, -static_cast<int64_t>(table.base)));
+    } else {
+        out.append(mir::Opcode::MOV, mir::reg(index_reg), mir::imm(static_cast<int64_t>(table.base)));
+        out.append(mir::Opcode::NEG, mir::reg(index_reg));
+        out.append(mir::Opcode::ADD, mir::reg(index_reg), mir::reg(entry_addr_reg));
+    }
+    // the bits of a misaligned offset are rotated to the top
+    if (table.entry_size > 1) {
+        out.append(mir::Opcode::ROR, mir::reg(index_reg), mir::imm(__builtin_ctzll(table.entry_size)));
+    }
+}
+
+void Generator::jump_table_dispatch(mir::Block &out, const BasicBlock *bb, const CfOp &cf_op, const REGISTER index_reg) const {
+    const auto &table = *std::get<CfOp::IJumpInfo>(cf_op.info).jump_table;
+    assert(!table.entries.empty() && table.entries.size() <= INT32_MAX);
+
+    out.append(mir::Opcode::CMP, mir::reg(index_reg), mir::imm(static_cast<int64_t>(table.entries.size() - 1)));
+    out.append(mir::Opcode::JCC, mir::Cond::A, mir::label(ijump_target_label(bb, cf_op)));
+    out.append(mir::Opcode::JMP, mir::mem(jump_table_label(bb, cf_op), REG_NONE, index_reg, 8));
+}
+
+mir::Symbol Generator::jump_table_label(const BasicBlock *bb, const CfOp &cf_op) {
+    return mir::symbol(mir::Symbol::Kind::JUMP_TABLE, bb->id, static_cast<uint32_t>(&cf_op - bb->control_flow_ops.data()));
 }
 
 void Generator::compile_statics() {
     compile_section(Section::DATA);
 
-    fprintf(out_fd, ".global register_file\n");
-    fprintf(out_fd, "register_file:\n");
+    output.global(mir::named("register_file"));
+    output.label(mir::named("register_file"));
 
-    for (const auto &var : ir->statics) {
-        fprintf(out_fd, "s%zu: .quad 0\n", var.id); // for now have all of the statics be 64bit
+    if (multithreaded_guest) {
+        // the register file is the ThreadControlBlock of the main thread, every other thread gets its own and the statics
+        // are offsets into it
+        output.space(sizeof(helper::ThreadControlBlock));
+        for (const auto &var : ir->statics) {
+            assert(var.id < helper::REGISTER_FILE_SIZE);
+            output.set(mir::symbol(mir::Symbol::Kind::STATIC, var.id), mir::imm(static_cast<int64_t>(offsetof(helper::ThreadControlBlock, register_file) + 8 * var.id)));
+        }
+        output.set(mir::named("init_stack_ptr"), mir::imm(offsetof(helper::ThreadControlBlock, init_stack_ptr)));
+        output.set(mir::named("init_ret_stack_ptr"), mir::imm(offsetof(helper::ThreadControlBlock, init_ret_stack_ptr)));
+        output.set(mir::named("ret_stack_limit"), mir::imm(offsetof(helper::ThreadControlBlock, ret_stack_limit)));
+        output.set(mir::named("reservation"), mir::imm(offsetof(helper::ThreadControlBlock, reservation)));
+    } else {
+        for (const auto &var : ir->statics) {
+            output.label(mir::symbol(mir::Symbol::Kind::STATIC, var.id));
+            emit(mir::Opcode::QUAD, mir::imm(0)); // for now have all of the statics be 64bit
+        }
     }
+
+    output.global(mir::named("multithreaded"));
+    output.label(mir::named("multithreaded"));
+    emit(mir::Opcode::BYTE, mir::imm(multithreaded_guest ? 1 : 0));
+    output.global(mir::named("stats_counted"));
+    output.label(mir::named("stats_counted"));
+    emit(mir::Opcode::BYTE, mir::imm(count_stats ? 1 : 0));
 }
 
 void Generator::compile_phdr_info() {
-    std::fprintf(out_fd, "phdr_off: .quad %lu\n", ir->phdr_off);
-    std::fprintf(out_fd, "phdr_num: .quad %lu\n", ir->phdr_num);
-    std::fprintf(out_fd, "phdr_size: .quad %lu\n", ir->phdr_size);
-    std::fprintf(out_fd, ".global phdr_off\n.global phdr_num\n.global phdr_size\n");
+    output.label(mir::named("phdr_off"));
+    emit(mir::Opcode::QUAD, mir::imm(static_cast<int64_t>(ir->phdr_off)));
+    output.label(mir::named("phdr_num"));
+    emit(mir::Opcode::QUAD, mir::imm(static_cast<int64_t>(ir->phdr_num)));
+    output.label(mir::named("phdr_size"));
+    emit(mir::Opcode::QUAD, mir::imm(static_cast<int64_t>(ir->phdr_size)));
+    for (const auto *name : {"phdr_off", "phdr_num", "phdr_size"}) {
+        output.global(mir::named(name));
+    }
 }
 
 void Generator::compile_interpreter_only_entry() {
+    using mir::Opcode;
+
     compile_section(Section::TEXT);
-    fprintf(out_fd, ".global _start\n");
-    fprintf(out_fd, "_start:\n");
+    output.global(mir::named("_start"));
+    output.label(mir::named("_start"));
 
     // setup the RISC-V stack
-    fprintf(out_fd, "mov rbx, offset param_passing\n");
-    fprintf(out_fd, "mov rdi, rsp\n");
-    fprintf(out_fd, "mov rsi, offset stack_space_end\n");
-    fprintf(out_fd, "call copy_stack\n");
+    emit(Opcode::MOV, mir::reg(REG_B), mir::offset(mir::named("param_passing")));
+    emit(Opcode::MOV, mir::reg(REG_DI), mir::stack_ptr());
+    emit(Opcode::MOV, mir::reg(REG_SI), mir::offset(mir::named("stack_space_end")));
+    emit(Opcode::CALL, mir::label(mir::named("copy_stack")));
 
     // mov the stack pointer to the register which holds the stack pointer (refering to the calling convention)
-    fprintf(out_fd, "mov [rip + register_file + 16], rax\n");
+    emit(Opcode::MOV, mir::mem(mir::named("register_file"), REG_IP, REG_NONE, 1, 16), mir::reg(REG_A));
 
     // load the entry address of the binary and call the interpreter
-    fprintf(out_fd, "mov rdi, %ld\n", ir->p_entry_addr);
-    fprintf(out_fd, "call unresolved_ijump_handler\n");
+    emit(Opcode::MOV, mir::reg(REG_DI), mir::imm(static_cast<int64_t>(ir->p_entry_addr)));
+    emit(Opcode::CALL, mir::label(mir::named("unresolved_ijump_handler")));
+
+    output.type(mir::named("_start"), mir::SymbolType::FUNC);
+    output.size(mir::named("_start"));
 
-    fprintf(out_fd, ".type _start,STT_FUNC\n");
-    fprintf(out_fd, ".size _start,$-_start\n");
+    compile_thread_start();
 }
 
 void Generator::compile_blocks() {
     compile_section(Section::TEXT);
 
+    if (optimizations & OPT_BLOCK_LAYOUT) {
+        block_layout = std::make_unique<layout::BlockLayout>(ir);
+        block_layout->build();
+    }
+
+    if (optimizations & OPT_STATIC_LIVENESS) {
+        static_liveness = std::make_unique<liveness::StaticLiveness>(ir);
+        static_liveness->build();
+    }
+
     if (optimizations & OPT_MBRA) {
+        // the groups are written out directly
+        flush();
         reg_alloc = std::make_unique<RegAlloc>(this);
         reg_alloc->compile_blocks();
         return;
     }
 
+    if (block_layout) {
+        const auto &hot_blocks = block_layout->hot_blocks;
+        for (size_t i = 0; i < hot_blocks.size(); ++i) {
+            // skipped blocks emit nothing, so the label after this block is the one of the next compilable block
+            const auto next = std::find_if(hot_blocks.begin() + i + 1, hot_blocks.end(), is_block_compilable);
+            compile_block(hot_blocks[i], next != hot_blocks.end() ? *next : nullptr);
+        }
+
+        compile_section(Section::TEXT_COLD);
+        for (const auto *block : block_layout->cold_blocks) {
+            compile_block(block);
+        }
+        compile_section(Section::TEXT);
+        return;
+    }
+
     for (const auto &block : ir->basic_blocks) {
         compile_block(block.get());
     }
 }
 
-void Generator::compile_block(const BasicBlock *block) {
-    for (const auto *input : block->inputs) {
-        // don't try to compile blocks that cannot be independent for now
-        if (!std::holds_alternative<size_t>(input->info))
-            return;
+bool Generator::is_block_compilable(const BasicBlock *block) {
+    // don't try to compile blocks that cannot be independent for now
+    return std::all_of(block->inputs.begin(), block->inputs.end(), [](const SSAVar *input) { return std::holds_alternative<size_t>(input->info); });
+}
+
+void Generator::compile_block(const BasicBlock *block, const BasicBlock *next_block) {
+    if (!is_block_compilable(block)) {
+        return;
     }
 
     // align to size to 16 bytes
     const size_t stack_size = (((block->variables.size() * 8) + 15) & 0xFFFFFFFF'FFFFFFF0);
-    fprintf(out_fd, "b%zu:\nsub rsp, %zu\n", block->id, stack_size);
-    fprintf(out_fd, "# block->virt_start_addr: %#lx\n", block->virt_start_addr);
+    if (is_loop_header(block)) {
+        output.align(4);
+    }
+    output.label(block_label(block->id));
+    emit(mir::Opcode::SUB, mir::stack_ptr(), mir::imm(static_cast<int64_t>(stack_size)));
+    comment("block->virt_start_addr: %#lx", block->virt_start_addr);
     compile_vars(block);
 
     for (size_t i = 0; i < block->control_flow_ops.size(); ++i) {
         const auto &cf_op = block->control_flow_ops[i];
         assert(cf_op.source == block);
 
-        fprintf(out_fd, "b%zu_cf%zu:\n", block->id, i);
+        output.label(mir::symbol(mir::Symbol::Kind::CF, block->id, static_cast<uint32_t>(i)));
         switch (cf_op.type) {
         case CFCInstruction::jump:
             compile_cf_args(block, cf_op, stack_size);
-            fprintf(out_fd, "# control flow\n");
-            fprintf(out_fd, "jmp b%zu\n", std::get<CfOp::JumpInfo>(cf_op.info).target->id);
+            comment("control flow");
+            if (i + 1 != block->control_flow_ops.size() || std::get<CfOp::JumpInfo>(cf_op.info).target != next_block) {
+                emit(mir::Opcode::JMP, mir::block(std::get<CfOp::JumpInfo>(cf_op.info).target->id));
+            }
             break;
         case CFCInstruction::_return:
             compile_ret(block, cf_op, stack_size);
@@ -362,8 +678,8 @@ void Generator::compile_block(const BasicBlock *block) {
             break;
         case CFCInstruction::unreachable:
             err_msgs.emplace_back(ErrType::unreachable, block);
-            fprintf(out_fd, "lea rdi, [rip + err_unreachable_b%zu]\n", block->id);
-            fprintf(out_fd, "jmp panic\n");
+            emit(mir::Opcode::LEA, mir::reg(REG_DI), mir::mem(mir::symbol(mir::Symbol::Kind::ERR_UNREACHABLE, block->id), REG_IP));
+            emit(mir::Opcode::JMP, mir::label(mir::named("panic")));
             break;
         case CFCInstruction::icall:
             compile_icall(block, cf_op, stack_size);
@@ -371,39 +687,42 @@ void Generator::compile_block(const BasicBlock *block) {
         }
     }
 
-    fprintf(out_fd, ".type b%zu,STT_FUNC\n", block->id);
-    fprintf(out_fd, ".size b%zu,$-b%zu\n", block->id, block->id);
+    output.type(block_label(block->id), mir::SymbolType::FUNC);
+    output.size(block_label(block->id));
 
-    fprintf(out_fd, "\n");
+    flush();
 }
 
 void Generator::compile_call(const BasicBlock *block, const CfOp &op, const size_t stack_size) {
-    fprintf(out_fd, "# Call Mapping\n");
+    comment("Call Mapping");
     // Store statics for call
     compile_cf_args(block, op, stack_size);
 
     // prevent overflow
-    fprintf(out_fd, "cmp rsp, stack_space + 524288\n"); // max depth ~65k
-    fprintf(out_fd, "cmovb rsp, [init_ret_stack_ptr]\n");
+    emit(mir::Opcode::CMP, mir::stack_ptr(), ret_stack_limit()); // max depth ~65k
+    emit(mir::Opcode::CMOVCC, mir::Cond::B, mir::stack_ptr(), mir::tcb("init_ret_stack_ptr"));
 
     // return address
     const auto &info = std::get<CfOp::CallInfo>(op.info);
     if (info.continuation_block->virt_start_addr <= 0x7FFFFFFF) {
-        fprintf(out_fd, "push %lu\n", info.continuation_block->virt_start_addr);
+        emit(mir::Opcode::PUSH, mir::imm(static_cast<int64_t>(info.continuation_block->virt_start_addr)));
     } else {
-        fprintf(out_fd, "mov rax, %lu\n", info.continuation_block->virt_start_addr);
-        fprintf(out_fd, "push rax\n");
+        emit(mir::Opcode::MOV, mir::reg(REG_A), mir::imm(static_cast<int64_t>(info.continuation_block->virt_start_addr)));
+        emit(mir::Opcode::PUSH, mir::reg(REG_A));
     }
 
-    fprintf(out_fd, "# control flow\n");
-    fprintf(out_fd, "call b%zu\nadd rsp, 8\n", std::get<CfOp::CallInfo>(op.info).target->id);
+    comment("control flow");
+    emit(mir::Opcode::CALL, mir::block(std::get<CfOp::CallInfo>(op.info).target->id));
+    emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(8));
 
     assert(std::get<CfOp::CallInfo>(op.info).continuation_block != nullptr);
-    fprintf(out_fd, "jmp b%zu\n", std::get<CfOp::CallInfo>(op.info).continuation_block->id);
+    emit(mir::Opcode::JMP, mir::block(std::get<CfOp::CallInfo>(op.info).continuation_block->id));
 }
 
 void Generator::compile_icall(const BasicBlock *block, const CfOp &op, const size_t stack_size) {
-    fprintf(out_fd, "# ICall Mapping\n");
+    using mir::Opcode;
+    const auto rax = mir::reg(REG_A);
+    comment("ICall Mapping");
 
     const auto &icall_info = std::get<CfOp::ICallInfo>(op.info);
 
@@ -412,50 +731,53 @@ void Generator::compile_icall(const BasicBlock *block, const CfOp &op, const siz
             continue;
         }
 
-        fprintf(out_fd, "# s%zu from var v%zu\n", s_idx, var->id);
+        comment("s%zu from var v%zu", s_idx, var->id);
 
         if (optimizations & OPT_UNUSED_STATIC && std::holds_alternative<size_t>(var->info)) {
             const auto orig_static_idx = std::get<size_t>(var->info);
             if (orig_static_idx == s_idx) {
-                fprintf(out_fd, "# Skipped\n");
+                comment("Skipped");
                 continue;
             }
-            fprintf(out_fd, "xor rax, rax\n");
-            fprintf(out_fd, "mov %s, [s%zu]\n", rax_from_type(var->type), orig_static_idx);
+            emit(Opcode::XOR, rax, rax);
+            emit(Opcode::MOV, rax_from_type(var->type), mir::static_var(orig_static_idx));
         } else {
-            fprintf(out_fd, "xor rax, rax\n");
-            fprintf(out_fd, "mov %s, [rsp + 8 * %zu]\n", rax_from_type(var->type), index_for_var(block, var));
+            emit(Opcode::XOR, rax, rax);
+            emit(Opcode::MOV, rax_from_type(var->type), mir::stack_slot(index_for_var(block, var)));
         }
 
-        fprintf(out_fd, "mov [s%zu], rax\n", s_idx);
+        emit(Opcode::MOV, mir::static_var(s_idx), rax);
     }
     assert(op.in_vars[0] != nullptr);
 
-    fprintf(out_fd, "# Get IJump Destination\n");
-    fprintf(out_fd, "xor rax, rax\n");
-    fprintf(out_fd, "mov %s, [rsp + 8 * %zu]\n", rax_from_type(op.in_vars[0]->type), index_for_var(block, op.in_vars[0]));
+    comment("Get IJump Destination");
+    emit(Opcode::XOR, rax, rax);
+    emit(Opcode::MOV, rax_from_type(op.in_vars[0]->type), mir::stack_slot(index_for_var(block, op.in_vars[0])));
 
-    fprintf(out_fd, "# destroy stack space\n");
-    fprintf(out_fd, "add rsp, %zu\n", stack_size + 8);
+    comment("destroy stack space");
+    emit(Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(stack_size + 8)));
 
-    fprintf(out_fd, "mov rbx, rax\n");
+    emit(Opcode::MOV, mir::reg(REG_B), rax);
     if (icall_info.continuation_block->virt_start_addr <= 0x7FFFFFFF) {
-        fprintf(out_fd, "push %lu\n", icall_info.continuation_block->virt_start_addr);
+        emit(Opcode::PUSH, mir::imm(static_cast<int64_t>(icall_info.continuation_block->virt_start_addr)));
     } else {
-        fprintf(out_fd, "mov rax, %lu\n", icall_info.continuation_block->virt_start_addr);
-        fprintf(out_fd, "push rax\n");
+        emit(Opcode::MOV, rax, mir::imm(static_cast<int64_t>(icall_info.continuation_block->virt_start_addr)));
+        emit(Opcode::PUSH, rax);
     }
 
-    fprintf(out_fd, "call ijump_lookup\nadd rsp, 8\n");
+    emit(Opcode::CALL, mir::label(ijump_target_label(block, op)));
+    emit(Opcode::ADD, mir::stack_ptr(), mir::imm(8));
 
     assert(std::get<CfOp::ICallInfo>(op.info).continuation_block != nullptr);
-    fprintf(out_fd, "jmp b%zu\n", std::get<CfOp::ICallInfo>(op.info).continuation_block->id);
+    emit(Opcode::JMP, mir::block(std::get<CfOp::ICallInfo>(op.info).continuation_block->id));
 }
 
 void Generator::compile_ijump(const BasicBlock *block, const CfOp &op, const size_t stack_size) {
     assert(op.type == CFCInstruction::ijump);
+    using mir::Opcode;
+    const auto rax = mir::reg(REG_A);
 
-    fprintf(out_fd, "# IJump Mapping\n");
+    comment("IJump Mapping");
 
     const auto &ijump_info = std::get<CfOp::IJumpInfo>(op.info);
 
@@ -464,75 +786,202 @@ void Generator::compile_ijump(const BasicBlock *block, const CfOp &op, const siz
             continue;
         }
 
-        fprintf(out_fd, "# s%zu from var v%zu\n", s_idx, var->id);
+        comment("s%zu from var v%zu", s_idx, var->id);
 
         if (optimizations & OPT_UNUSED_STATIC && std::holds_alternative<size_t>(var->info)) {
             const auto orig_static_idx = std::get<size_t>(var->info);
             if (orig_static_idx == s_idx) {
-                fprintf(out_fd, "# Skipped\n");
+                comment("Skipped");
                 continue;
             }
-            fprintf(out_fd, "xor rax, rax\n");
-            fprintf(out_fd, "mov %s, [s%zu]\n", rax_from_type(var->type), orig_static_idx);
+            emit(Opcode::XOR, rax, rax);
+            emit(Opcode::MOV, rax_from_type(var->type), mir::static_var(orig_static_idx));
         } else {
-            fprintf(out_fd, "xor rax, rax\n");
-            fprintf(out_fd, "mov %s, [rsp + 8 * %zu]\n", rax_from_type(var->type), index_for_var(block, var));
+            emit(Opcode::XOR, rax, rax);
+            emit(Opcode::MOV, rax_from_type(var->type), mir::stack_slot(index_for_var(block, var)));
         }
 
-        fprintf(out_fd, "mov [s%zu], rax\n", s_idx);
+        emit(Opcode::MOV, mir::static_var(s_idx), rax);
     }
 
     assert(op.in_vars[0] != nullptr);
     assert(ijump_info.targets.empty());
     assert((op.in_vars[0]->type == Type::i64) || (op.in_vars[0]->type == Type::imm)); // TODO: only one should be used
 
-    fprintf(out_fd, "# Get IJump Destination\n");
-    fprintf(out_fd, "xor rax, rax\n");
-    fprintf(out_fd, "mov %s, [rsp + 8 * %zu]\n", rax_from_type(op.in_vars[0]->type), index_for_var(block, op.in_vars[0]));
+    comment("Get IJump Destination");
+    emit(Opcode::XOR, rax, rax);
+    emit(Opcode::MOV, rax_from_type(op.in_vars[0]->type), mir::stack_slot(index_for_var(block, op.in_vars[0])));
 
-    fprintf(out_fd, "# destroy stack space\n");
-    fprintf(out_fd, "add rsp, %zu\n", stack_size);
+    const auto jump_table = uses_jump_table(op);
+    if (jump_table) {
+        comment("Jump Table Index");
+        emit(Opcode::MOV, mir::reg(REG_DI), mir::stack_slot(index_for_var(block, op.in_vars[1])));
+        jump_table_index(output, op, REG_DI, REG_DI);
+    }
 
-    fprintf(out_fd, "mov rbx, rax\n");
-    fprintf(out_fd, "jmp ijump_lookup\n");
+    comment("destroy stack space");
+    emit(Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(stack_size)));
+
+    emit(Opcode::MOV, mir::reg(REG_B), rax);
+    if (jump_table) {
+        jump_table_dispatch(output, block, op, REG_DI);
+    } else {
+        emit(Opcode::JMP, mir::label(ijump_target_label(block, op)));
+    }
 }
 
 void Generator::compile_entry() {
+    using mir::Opcode;
+
     compile_section(Section::TEXT);
-    fprintf(out_fd, ".global _start\n");
-    fprintf(out_fd, "_start:\n");
+    output.global(mir::named("_start"));
+    output.label(mir::named("_start"));
     // create zero
-    fprintf(out_fd, "xor rbp, rbp\n");
-    fprintf(out_fd, "mov rbx, offset param_passing\n");
-    fprintf(out_fd, "mov rdi, rsp\n");
-    fprintf(out_fd, "mov rsi, offset stack_space_end\n");
-    fprintf(out_fd, "call copy_stack\n");
-    fprintf(out_fd, "mov [init_stack_ptr], rax\n");
-    fprintf(out_fd, "push 0\npush 0\n");
-    fprintf(out_fd, "mov [init_ret_stack_ptr], rsp\n");
-    fprintf(out_fd, "jmp b%zu\n", ir->entry_block);
-    fprintf(out_fd, ".type _start,STT_FUNC\n");
-    fprintf(out_fd, ".size _start,$-_start\n");
+    emit(Opcode::XOR, mir::reg(REG_BP), mir::reg(REG_BP));
+    emit(Opcode::MOV, mir::reg(REG_B), mir::offset(mir::named("param_passing")));
+    emit(Opcode::MOV, mir::reg(REG_DI), mir::stack_ptr());
+    emit(Opcode::MOV, mir::reg(REG_SI), mir::offset(mir::named("stack_space_end")));
+    emit(Opcode::CALL, mir::label(mir::named("copy_stack")));
+    emit(Opcode::MOV, mir::tcb("init_stack_ptr"), mir::reg(REG_A));
+    emit(Opcode::PUSH, mir::imm(0));
+    emit(Opcode::PUSH, mir::imm(0));
+    emit(Opcode::MOV, mir::tcb("init_ret_stack_ptr"), mir::stack_ptr());
+    compile_pinned_statics(true);
+    emit(Opcode::JMP, mir::block(ir->entry_block));
+    output.type(mir::named("_start"), mir::SymbolType::FUNC);
+    output.size(mir::named("_start"));
+
+    if ((optimizations & OPT_MBRA) && !pinned_statics.empty()) {
+        // the interpreter works on the register file, the address it returns is a compiled block that expects the pinned
+        // statics in their registers again
+        output.label(unresolved_ijump_label());
+        compile_pinned_statics(false);
+        emit(Opcode::CALL, mir::label(mir::named("unresolved_ijump_handler")));
+        compile_pinned_statics(true);
+        emit(Opcode::JMP, mir::reg(REG_A));
+    }
+
+    compile_thread_start();
 }
 
+/* threads created by the interpreter return from the clone into this with the guest address they continue at on the stack,
+ * see helper::thread::clone_interpreted
+ */
+void Generator::compile_thread_start() {
+    if (!multithreaded_guest) {
+        return;
+    }
+
+    output.global(mir::named("thread_start"));
+    output.label(mir::named("thread_start"));
+    emit(mir::Opcode::POP, mir::reg(REG_DI));
+    emit(mir::Opcode::CALL, mir::label(mir::named("unresolved_ijump_handler")));
+    compile_pinned_statics(true);
+    emit(mir::Opcode::JMP, mir::reg(REG_A));
+    output.type(mir::named("thread_start"), mir::SymbolType::FUNC);
+    output.size(mir::named("thread_start"));
+}
+
+void Generator::compile_pinned_statics(const bool load) {
+    if (!(optimizations & OPT_MBRA)) {
+        return;
+    }
+    for (size_t i = 0; i < pinned_statics.size(); ++i) {
+        if (load) {
+            emit(mir::Opcode::MOV, mir::reg(pinned_regs[i]), mir::static_var(pinned_statics[i]));
+        } else {
+            emit(mir::Opcode::MOV, mir::static_var(pinned_statics[i]), mir::reg(pinned_regs[i]));
+        }
+    }
+}
+
+REGISTER Generator::pinned_reg(const size_t static_idx) const {
+    if (!(optimizations & OPT_MBRA)) {
+        return REG_NONE;
+    }
+    for (size_t i = 0; i < pinned_statics.size(); ++i) {
+        if (pinned_statics[i] == static_idx) {
+            return pinned_regs[i];
+        }
+    }
+    return REG_NONE;
+}
+
+std::vector<size_t> Generator::choose_pinned_statics(const size_t count) const {
+    auto accesses = std::vector<size_t>(ir->statics.size(), 0);
+    const auto add_mapping = [&accesses](const std::vector<std::pair<RefPtr<SSAVar>, size_t>> &mapping) {
+        for (const auto &pair : mapping) {
+            ++accesses[pair.second];
+        }
+    };
+    for (const auto &bb : ir->basic_blocks) {
+        for (const auto *input : bb->inputs) {
+            if (std::holds_alternative<size_t>(input->info)) {
+                ++accesses[std::get<size_t>(input->info)];
+            }
+        }
+        for (const auto &cf_op : bb->control_flow_ops) {
+            switch (cf_op.type) {
+            case CFCInstruction::ijump:
+                add_mapping(std::get<CfOp::IJumpInfo>(cf_op.info).mapping);
+                break;
+            case CFCInstruction::icall:
+                add_mapping(std::get<CfOp::ICallInfo>(cf_op.info).mapping);
+                break;
+            case CFCInstruction::_return:
+                add_mapping(std::get<CfOp::RetInfo>(cf_op.info).mapping);
+                break;
+            case CFCInstruction::syscall:
+                add_mapping(std::get<CfOp::SyscallInfo>(cf_op.info).continuation_mapping);
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    auto candidates = std::vector<size_t>{};
+    for (size_t i = 0; i < ir->statics.size(); ++i) {
+        // x0 is never written so there is nothing to gain
+        if (i != 0 && ir->statics[i].type == Type::i64 && accesses[i] != 0) {
+            candidates.push_back(i);
+        }
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [&accesses](const size_t a, const size_t b) { return accesses[a] > accesses[b]; });
+    candidates.resize(std::min(candidates.size(), std::min(count, pinned_regs.size())));
+    return candidates;
+}
+
+mir::Symbol Generator::unresolved_ijump_label() const { return mir::named(((optimizations & OPT_MBRA) && !pinned_statics.empty()) ? "unresolved_ijump_pinned" : "unresolved_ijump"); }
+
 void Generator::compile_err_msgs() {
     compile_section(Section::RODATA);
 
     for (const auto &[type, block] : err_msgs) {
         switch (type) {
-        case ErrType::unreachable:
-            fprintf(out_fd, "err_unreachable_b%zu: .ascii \"Reached unreachable code in block %zu\\n\\0\"\n", block->id, block->id);
+        case ErrType::unreachable: {
+            auto msg = "Reached unreachable code in block " + std::to_string(block->id) + "\n";
+            msg += '\0';
+            output.label(mir::symbol(mir::Symbol::Kind::ERR_UNREACHABLE, block->id));
+            output.ascii(msg);
             break;
         }
+        }
     }
 
     err_msgs.clear();
 }
 
 void Generator::compile_vars(const BasicBlock *block) {
+    using mir::Opcode;
+    const auto rax = mir::reg(REG_A), rbx = mir::reg(REG_B), rcx = mir::reg(REG_C), rdx = mir::reg(REG_D);
+    const auto xmm0 = mir::fp_reg(REG_XMM0), xmm1 = mir::fp_reg(REG_XMM1), xmm2 = mir::fp_reg(REG_XMM2), xmm3 = mir::fp_reg(REG_XMM3);
+
+    // blocks are entered and left with round-to-nearest
+    auto cur_rounding_mode = RoundingMode::NEAREST;
     for (size_t idx = 0; idx < block->variables.size(); ++idx) {
         const auto *var = block->variables[idx].get();
-        fprintf(out_fd, "# Handling v%zu (v%zu)\n", idx, var->id);
+        comment("Handling v%zu (v%zu)", idx, var->id);
         if (var->info.index() == 0) {
             continue;
         }
@@ -563,14 +1012,13 @@ void Generator::compile_vars(const BasicBlock *block) {
                 }
 
                 if (!has_var_ref) {
-                    fprintf(out_fd, "# Skipped\n");
+                    comment("Skipped");
                     continue;
                 }
             }
 
-            const auto *reg_str = rax_from_type(var->type);
-            fprintf(out_fd, "mov rax, [s%zu]\n", std::get<size_t>(var->info));
-            fprintf(out_fd, "mov [rsp + 8 * %zu], %s\n", idx, reg_str);
+            emit(Opcode::MOV, rax, mir::static_var(std::get<size_t>(var->info)));
+            emit(Opcode::MOV, mir::stack_slot(idx), rax_from_type(var->type));
             continue;
         }
 
@@ -578,15 +1026,16 @@ void Generator::compile_vars(const BasicBlock *block) {
         if (var->info.index() == 1) {
             const auto &info = std::get<SSAVar::ImmInfo>(var->info);
             if (info.binary_relative) {
-                fprintf(out_fd, "lea rax, [binary + %ld]\n", info.val);
-                fprintf(out_fd, "mov [rsp + 8 * %zu], rax\n", idx);
+                emit(Opcode::LEA, rax, mir::binary(info.val));
+                emit(Opcode::MOV, mir::stack_slot(idx), rax);
             } else {
                 // use other loading if the immediate is to big
                 if (info.val > INT32_MAX || info.val < INT32_MIN) {
-                    fprintf(out_fd, "mov rax, %ld\n", info.val);
-                    fprintf(out_fd, "mov QWORD PTR [rsp + 8 * %zu], rax\n", idx);
+                    emit(Opcode::MOV, rax, mir::imm(info.val));
+                    emit(Opcode::MOV, mir::sized(mir::stack_slot(idx), Type::i64), rax);
                 } else {
-                    fprintf(out_fd, "mov %s [rsp + 8 * %zu], %ld\n", ptr_from_type(var->type), idx, info.val);
+                    assert(!is_float(var->type));
+                    emit(Opcode::MOV, mir::sized(mir::stack_slot(idx), var->type), mir::imm(info.val));
                 }
             }
 
@@ -596,8 +1045,9 @@ void Generator::compile_vars(const BasicBlock *block) {
         assert(var->info.index() == 3);
         const auto *op = std::get<3>(var->info).get();
         assert(op != nullptr);
+        compile_rounding_mode(op, cur_rounding_mode);
 
-        std::array<const char *, 4> in_regs{};
+        std::array<mir::Operand, 4> in_regs{};
         size_t arg_count = 0;
         for (size_t in_idx = 0; in_idx < op->in_vars.size(); ++in_idx) {
             const auto &in_var = op->in_vars[in_idx];
@@ -608,44 +1058,51 @@ void Generator::compile_vars(const BasicBlock *block) {
             if (in_var->type == Type::mt)
                 continue;
 
-            const auto *reg_str = op_reg_map_for_type(in_var->type)[in_idx];
+            const auto in_reg = op_reg(in_var->type, in_idx);
 
             // zero the full register so stuff doesn't go broke e.g. in zero-extend, cast
+            // movd/movq and 32/64 bit movs already clear the upper part, so the zeroing only matters for 8/16 bit loads
+            const auto load_clears = (is_float(in_var->type) || in_var->type == Type::i32 || in_var->type == Type::i64);
+            if (load_clears && (optimizations & OPT_PEEPHOLE)) {
+                ++peephole_hits[peephole::REDUNDANT_ZERO];
+            } else if (is_float(in_var->type)) {
+                emit(Opcode::PXOR, in_reg, in_reg);
+            } else {
+                const auto full_reg = op_reg(Type::i64, in_idx);
+                emit(Opcode::XOR, full_reg, full_reg);
+            }
             if (is_float(in_var->type)) {
-                fprintf(out_fd, "pxor %s, %s\n", reg_str, reg_str);
-                fprintf(out_fd, "mov%s %s, [rsp + 8 * %zu]\n", (in_var->type == Type::f32 ? "d" : "q"), reg_str, index_for_var(block, in_var));
+                emit(mov_from_type(in_var->type), in_reg, mir::stack_slot(index_for_var(block, in_var)));
             } else {
-                const auto *full_reg_str = op_reg_map_for_type(Type::i64)[in_idx];
-                fprintf(out_fd, "xor %s, %s\n", full_reg_str, full_reg_str);
-                fprintf(out_fd, "mov %s, [rsp + 8 * %zu]\n", reg_str, index_for_var(block, in_var));
+                emit(Opcode::MOV, in_reg, mir::stack_slot(index_for_var(block, in_var)));
             }
-            in_regs[in_idx] = reg_str;
+            in_regs[in_idx] = in_reg;
         }
 
-        auto set_if_op = [this, var, op, in_regs, arg_count](const char *cc_i_1, const char *cc_i_2, const char *cc_fp_1, const char *cc_fp_2, bool allow_fp = true) {
+        auto set_if_op = [this, var, op, &in_regs, arg_count](const mir::Cond cc_i_1, const mir::Cond cc_i_2, const mir::Cond cc_fp_1, const mir::Cond cc_fp_2, bool allow_fp = true) {
             assert(arg_count == 4);
             SSAVar *const in1 = op->in_vars[0];
             SSAVar *const in2 = op->in_vars[1];
             SSAVar *const in3 = op->in_vars[2];
             SSAVar *const in4 = op->in_vars[3];
-            const char *cc_1, *cc_2;
+            mir::Cond cc_1, cc_2;
             if (is_float(in1->type) || is_float(in2->type)) {
                 assert(allow_fp);
                 assert(in1->type == in2->type);
                 assert(!is_float(var->type));
                 assert(compatible_types(var->type, in3->type) && compatible_types(var->type, in4->type));
-                fprintf(out_fd, "comis%s %s, %s\n", fp_op_size_from_type(in1->type), in_regs[0], in_regs[1]);
+                emit(mir::scalar(Opcode::COMISS, in1->type), in_regs[0], in_regs[1]);
                 cc_1 = cc_fp_1;
                 cc_2 = cc_fp_2;
             } else {
                 const Type cmp_type = (in1->type == Type::imm ? (in2->type == Type::imm ? Type::i64 : in2->type) : in1->type);
                 assert(compatible_types(var->type, in3->type) && compatible_types(var->type, in4->type));
-                fprintf(out_fd, "cmp %s, %s\n", op_reg_map_for_type(cmp_type)[0], op_reg_map_for_type(cmp_type)[1]);
+                emit(Opcode::CMP, op_reg(cmp_type, 0), op_reg(cmp_type, 1));
                 cc_1 = cc_i_1;
                 cc_2 = cc_i_2;
             }
-            fprintf(out_fd, "cmov%s %s, %s\n", cc_1, rax_from_type(var->type), op_reg_map_for_type(var->type)[2]);
-            fprintf(out_fd, "cmov%s %s, %s\n", cc_2, rax_from_type(var->type), op_reg_map_for_type(var->type)[3]);
+            emit(Opcode::CMOVCC, cc_1, rax_from_type(var->type), op_reg(var->type, 2));
+            emit(Opcode::CMOVCC, cc_2, rax_from_type(var->type), op_reg(var->type, 3));
         };
 
         switch (op->type) {
@@ -653,9 +1110,9 @@ void Generator::compile_vars(const BasicBlock *block) {
             assert(op->in_vars[0]->type == Type::i64 || op->in_vars[0]->type == Type::imm);
             assert(arg_count == 3);
             if (is_float(op->in_vars[1]->type)) {
-                fprintf(out_fd, "mov%s [%s], %s\n", (op->in_vars[1]->type == Type::f32 ? "d" : "q"), in_regs[0], in_regs[1]);
+                emit(mov_from_type(op->in_vars[1]->type), mir::mem(REG_A), in_regs[1]);
             } else {
-                fprintf(out_fd, "mov %s [%s], %s\n", ptr_from_type(op->in_vars[1]->type), in_regs[0], in_regs[1]);
+                emit(Opcode::MOV, mir::sized(mir::mem(REG_A), op->in_vars[1]->type), in_regs[1]);
             }
             break;
         case Instruction::load:
@@ -663,69 +1120,76 @@ void Generator::compile_vars(const BasicBlock *block) {
             assert(op->out_vars[0] == var);
             assert(arg_count == 2);
             if (is_float(var->type)) {
-                fprintf(out_fd, "mov%s xmm0, [%s]\n", (op->in_vars[1]->type == Type::f32 ? "d" : "q"), in_regs[0]);
+                emit(op->in_vars[1]->type == Type::f32 ? Opcode::MOVD : Opcode::MOVQ, xmm0, mir::mem(REG_A));
             } else {
-                fprintf(out_fd, "mov %s, %s [%s]\n", op_reg_map_for_type(var->type)[0], ptr_from_type(var->type), in_regs[0]);
+                emit(Opcode::MOV, op_reg(var->type, 0), mir::sized(mir::mem(REG_A), var->type));
             }
             break;
         case Instruction::add:
             assert(arg_count == 2);
             if (is_float(var->type)) {
                 assert(var->type == op->in_vars[0]->type && op->in_vars[0]->type == op->in_vars[1]->type);
-                fprintf(out_fd, "adds%s xmm0, xmm1\n", fp_op_size_from_type(op->in_vars[0]->type));
+                emit(mir::scalar(Opcode::ADDSS, op->in_vars[0]->type), xmm0, xmm1);
             } else {
-                fprintf(out_fd, "add rax, rbx\n");
+                emit(Opcode::ADD, rax, rbx);
             }
             break;
         case Instruction::sub:
             assert(arg_count == 2);
             if (is_float(var->type)) {
                 assert(var->type == op->in_vars[0]->type && op->in_vars[0]->type == op->in_vars[1]->type);
-                fprintf(out_fd, "subs%s xmm0, xmm1\n", fp_op_size_from_type(op->in_vars[0]->type));
+                emit(mir::scalar(Opcode::SUBSS, op->in_vars[0]->type), xmm0, xmm1);
             } else {
-                fprintf(out_fd, "sub rax, rbx\n");
+                emit(Opcode::SUB, rax, rbx);
             }
             break;
         case Instruction::mul_l:
             assert(arg_count == 2);
             assert(!is_float(var->type));
-            fprintf(out_fd, "imul rax, rbx\n");
+            emit(Opcode::IMUL, rax, rbx);
             break;
         case Instruction::ssmul_h:
             assert(arg_count == 2);
             assert(!is_float(var->type));
-            fprintf(out_fd, "imul rbx\nmov rax, rdx\n");
+            emit(Opcode::IMUL, rbx);
+            emit(Opcode::MOV, rax, rdx);
             break;
         case Instruction::uumul_h:
             assert(arg_count == 2);
             assert(!is_float(var->type));
-            fprintf(out_fd, "mul rbx\nmov rax, rdx\n");
+            emit(Opcode::MUL, rbx);
+            emit(Opcode::MOV, rax, rdx);
             break;
         case Instruction::div:
             assert(arg_count == 2 || arg_count == 3);
             assert(!is_float(var->type));
             if (var->type == Type::i32) {
-                fprintf(out_fd, "cdq\nidiv ebx\n");
+                emit(Opcode::CDQ);
+                emit(Opcode::IDIV, mir::reg(REG_B, Type::i32));
             } else {
-                fprintf(out_fd, "cqo\nidiv rbx\n");
+                emit(Opcode::CQO);
+                emit(Opcode::IDIV, rbx);
             }
-            fprintf(out_fd, "mov rbx, rdx\n"); // second output is remainder and needs to be in rbx atm
+            emit(Opcode::MOV, rbx, rdx); // second output is remainder and needs to be in rbx atm
             break;
         case Instruction::udiv:
             assert(arg_count == 2);
             assert(!is_float(var->type));
-            fprintf(out_fd, "xor rdx, rdx\ndiv rbx\n");
-            fprintf(out_fd, "mov rbx, rdx\n"); // second output is remainder and needs to be in rbx atm
+            emit(Opcode::XOR, rdx, rdx);
+            emit(Opcode::DIV, rbx);
+            emit(Opcode::MOV, rbx, rdx); // second output is remainder and needs to be in rbx atm
             break;
         case Instruction::shl:
             assert(arg_count == 2);
             assert(!is_float(var->type));
-            fprintf(out_fd, "mov cl, bl\nshl %s, cl\n", rax_from_type(op->in_vars[0]->type));
+            emit(Opcode::MOV, mir::reg(REG_C, Type::i8), mir::reg(REG_B, Type::i8));
+            emit(Opcode::SHL, rax_from_type(op->in_vars[0]->type), mir::reg(REG_C, Type::i8));
             break;
         case Instruction::shr:
             assert(arg_count == 2);
             assert(!is_float(var->type));
-            fprintf(out_fd, "mov cl, bl\nshr %s, cl\n", rax_from_type(op->in_vars[0]->type));
+            emit(Opcode::MOV, mir::reg(REG_C, Type::i8), mir::reg(REG_B, Type::i8));
+            emit(Opcode::SHR, rax_from_type(op->in_vars[0]->type), mir::reg(REG_C, Type::i8));
             break;
         case Instruction::sar:
             assert(arg_count == 2);
@@ -733,27 +1197,28 @@ void Generator::compile_vars(const BasicBlock *block) {
             // make sure that it uses the bit-width of the input operand for shifting
             // so that the sign-bit is properly recognized
             // TODO: find out if that is a problem elsewhere
-            fprintf(out_fd, "mov cl, bl\nsar %s, cl\n", rax_from_type(op->in_vars[0]->type));
+            emit(Opcode::MOV, mir::reg(REG_C, Type::i8), mir::reg(REG_B, Type::i8));
+            emit(Opcode::SAR, rax_from_type(op->in_vars[0]->type), mir::reg(REG_C, Type::i8));
             break;
         case Instruction::_or:
             assert(arg_count == 2);
             assert(!is_float(var->type));
-            fprintf(out_fd, "or rax, rbx\n");
+            emit(Opcode::OR, rax, rbx);
             break;
         case Instruction::_and:
             assert(arg_count == 2);
             assert(!is_float(var->type));
-            fprintf(out_fd, "and rax, rbx\n");
+            emit(Opcode::AND, rax, rbx);
             break;
         case Instruction::_not:
             assert(arg_count == 1);
             assert(!is_float(var->type));
-            fprintf(out_fd, "not rax\n");
+            emit(Opcode::NOT, rax);
             break;
         case Instruction::_xor:
             assert(arg_count == 2);
             assert(!is_float(var->type));
-            fprintf(out_fd, "xor rax, rbx\n");
+            emit(Opcode::XOR, rax, rbx);
             break;
         case Instruction::cast:
             assert(arg_count == 1);
@@ -761,17 +1226,17 @@ void Generator::compile_vars(const BasicBlock *block) {
                 if (op->in_vars[0]->type == Type::f64 && var->type == Type::f32) {
                     // nothing to be done
                 } else if (is_integer(op->in_vars[0]->type)) {
-                    fprintf(out_fd, "mov%s xmm0, %s\n", (var->type == Type::f32 ? "d" : "q"), in_regs[0]);
+                    emit(mov_from_type(var->type), xmm0, in_regs[0]);
                 } else {
                     assert(0);
                 }
             } else if (is_integer(var->type) && is_float(op->in_vars[0]->type)) {
-                fprintf(out_fd, "mov%s %s, xmm0\n", (var->type == Type::i32 ? "d" : "q"), rax_from_type(var->type));
+                emit(mov_from_type(var->type), rax_from_type(var->type), xmm0);
             }
             break;
         case Instruction::setup_stack:
             assert(arg_count == 0);
-            fprintf(out_fd, "mov rax, [init_stack_ptr]\n");
+            emit(Opcode::MOV, rax, mir::tcb("init_stack_ptr"));
             break;
         case Instruction::zero_extend:
             assert(arg_count == 1);
@@ -781,14 +1246,14 @@ void Generator::compile_vars(const BasicBlock *block) {
             assert(arg_count == 1);
             assert(!is_float(var->type));
             if (op->in_vars[0]->type != Type::i64) {
-                fprintf(out_fd, "movsx rax, %s\n", in_regs[0]);
+                emit(Opcode::MOVSX, rax, in_regs[0]);
             }
             break;
         case Instruction::slt:
-            set_if_op("l", "ge", "b", "ae");
+            set_if_op(mir::Cond::L, mir::Cond::GE, mir::Cond::B, mir::Cond::AE);
             break;
         case Instruction::sltu:
-            set_if_op("b", "ae", "", "", false);
+            set_if_op(mir::Cond::B, mir::Cond::AE, mir::Cond::B, mir::Cond::AE, false);
             break;
         case Instruction::sumul_h: /* TODO: implement */
             assert(0);
@@ -796,208 +1261,276 @@ void Generator::compile_vars(const BasicBlock *block) {
         case Instruction::umax:
             assert(arg_count == 2);
             assert(!is_float(var->type));
-            fprintf(out_fd, "cmp %s, %s\n", in_regs[0], in_regs[1]);
-            fprintf(out_fd, "cmova %s, %s\n", in_regs[0], in_regs[1]);
-            fprintf(out_fd, "mov %s, %s\n", rax_from_type(op->in_vars[0]->type), in_regs[0]);
+            emit(Opcode::CMP, in_regs[0], in_regs[1]);
+            emit(Opcode::CMOVCC, mir::Cond::A, in_regs[0], in_regs[1]);
+            emit(Opcode::MOV, rax_from_type(op->in_vars[0]->type), in_regs[0]);
             break;
         case Instruction::umin:
             assert(arg_count == 2);
             assert(!is_float(var->type));
-            fprintf(out_fd, "cmp %s, %s\n", in_regs[0], in_regs[1]);
-            fprintf(out_fd, "cmovb %s, %s\n", in_regs[0], in_regs[1]);
-            fprintf(out_fd, "mov %s, %s\n", rax_from_type(op->in_vars[0]->type), in_regs[0]);
+            emit(Opcode::CMP, in_regs[0], in_regs[1]);
+            emit(Opcode::CMOVCC, mir::Cond::B, in_regs[0], in_regs[1]);
+            emit(Opcode::MOV, rax_from_type(op->in_vars[0]->type), in_regs[0]);
             break;
         case Instruction::max:
             assert(arg_count == 2);
             if (is_float(var->type)) {
-                fprintf(out_fd, "maxs%s xmm0, xmm1\n", fp_op_size_from_type(var->type));
+                emit(mir::scalar(Opcode::MAXSS, var->type), xmm0, xmm1);
             } else {
-                fprintf(out_fd, "cmp %s, %s\n", in_regs[0], in_regs[1]);
-                fprintf(out_fd, "cmovg %s, %s\n", in_regs[0], in_regs[1]);
-                fprintf(out_fd, "mov %s, %s\n", rax_from_type(op->in_vars[0]->type), in_regs[0]);
+                emit(Opcode::CMP, in_regs[0], in_regs[1]);
+                emit(Opcode::CMOVCC, mir::Cond::G, in_regs[0], in_regs[1]);
+                emit(Opcode::MOV, rax_from_type(op->in_vars[0]->type), in_regs[0]);
             }
             break;
         case Instruction::min:
             assert(arg_count == 2);
             if (is_float(var->type)) {
-                fprintf(out_fd, "mins%s xmm0, xmm1\n", fp_op_size_from_type(var->type));
+                emit(mir::scalar(Opcode::MINSS, var->type), xmm0, xmm1);
             } else {
-                fprintf(out_fd, "cmp %s, %s\n", in_regs[0], in_regs[1]);
-                fprintf(out_fd, "cmovl %s, %s\n", in_regs[0], in_regs[1]);
-                fprintf(out_fd, "mov %s, %s\n", rax_from_type(op->in_vars[0]->type), in_regs[0]);
+                emit(Opcode::CMP, in_regs[0], in_regs[1]);
+                emit(Opcode::CMOVCC, mir::Cond::L, in_regs[0], in_regs[1]);
+                emit(Opcode::MOV, rax_from_type(op->in_vars[0]->type), in_regs[0]);
             }
             break;
         case Instruction::sle:
-            set_if_op("le", "g", "be", "a");
+            set_if_op(mir::Cond::LE, mir::Cond::G, mir::Cond::BE, mir::Cond::A);
             break;
         case Instruction::seq:
-            set_if_op("e", "ne", "e", "ne");
+            set_if_op(mir::Cond::E, mir::Cond::NE, mir::Cond::E, mir::Cond::NE);
             break;
         case Instruction::fmul:
             assert(arg_count == 2);
             assert(is_float(var->type));
             assert(var->type == op->in_vars[0]->type && var->type == op->in_vars[1]->type);
-            fprintf(out_fd, "muls%s xmm0, xmm1\n", fp_op_size_from_type(var->type));
+            emit(mir::scalar(Opcode::MULSS, var->type), xmm0, xmm1);
             break;
         case Instruction::fdiv:
             assert(arg_count == 2);
             assert(is_float(var->type));
             assert(var->type == op->in_vars[0]->type && var->type == op->in_vars[1]->type);
-            fprintf(out_fd, "divs%s xmm0, xmm1\n", fp_op_size_from_type(var->type));
+            emit(mir::scalar(Opcode::DIVSS, var->type), xmm0, xmm1);
             break;
         case Instruction::fsqrt:
             assert(arg_count == 1);
             assert(is_float(var->type));
             assert(var->type == op->in_vars[0]->type);
-            fprintf(out_fd, "sqrts%s xmm0, xmm0\n", fp_op_size_from_type(var->type));
+            emit(mir::scalar(Opcode::SQRTSS, var->type), xmm0, xmm0);
             break;
         case Instruction::fmadd:
             assert(arg_count == 3);
             assert(is_float(var->type));
             assert(var->type == op->in_vars[0]->type && var->type == op->in_vars[1]->type && var->type == op->in_vars[2]->type);
-            fprintf(out_fd, "muls%s xmm0, xmm1\n", fp_op_size_from_type(var->type));
-            fprintf(out_fd, "adds%s xmm0, xmm2\n", fp_op_size_from_type(var->type));
+            emit(mir::scalar(Opcode::MULSS, var->type), xmm0, xmm1);
+            emit(mir::scalar(Opcode::ADDSS, var->type), xmm0, xmm2);
             break;
         case Instruction::fmsub:
             assert(arg_count == 3);
             assert(is_float(var->type));
             assert(var->type == op->in_vars[0]->type && var->type == op->in_vars[1]->type && var->type == op->in_vars[2]->type);
-            fprintf(out_fd, "muls%s xmm0, xmm1\n", fp_op_size_from_type(var->type));
-            fprintf(out_fd, "subs%s xmm0, xmm2\n", fp_op_size_from_type(var->type));
+            emit(mir::scalar(Opcode::MULSS, var->type), xmm0, xmm1);
+            emit(mir::scalar(Opcode::SUBSS, var->type), xmm0, xmm2);
             break;
-        case Instruction::fnmadd: {
-            assert(arg_count == 3);
-            assert(is_float(var->type));
-            assert(var->type == op->in_vars[0]->type && var->type == op->in_vars[1]->type && var->type == op->in_vars[2]->type);
-            const bool is_single_precision = var->type == Type::f32;
-            fprintf(out_fd, "muls%s xmm0, xmm1\n", fp_op_size_from_type(var->type));
-            // toggle the sign of the result (negate) of the product by using a mask and xor
-            fprintf(out_fd, "mov rax, %s\n", is_single_precision ? "0x80000000" : "0x8000000000000000");
-            fprintf(out_fd, "mov%s xmm3, rax\n", is_single_precision ? "d" : "q");
-            fprintf(out_fd, "pxor xmm0, xmm3\n");
-            fprintf(out_fd, "adds%s xmm0, xmm2\n", fp_op_size_from_type(var->type));
-            break;
-        }
+        case Instruction::fnmadd:
         case Instruction::fnmsub: {
             assert(arg_count == 3);
             assert(is_float(var->type));
             assert(var->type == op->in_vars[0]->type && var->type == op->in_vars[1]->type && var->type == op->in_vars[2]->type);
             const bool is_single_precision = var->type == Type::f32;
-            fprintf(out_fd, "muls%s xmm0, xmm1\n", fp_op_size_from_type(var->type));
+            emit(mir::scalar(Opcode::MULSS, var->type), xmm0, xmm1);
             // toggle the sign of the result (negate) of the product by using a mask and xor
-            fprintf(out_fd, "mov rax, %s\n", is_single_precision ? "0x80000000" : "0x8000000000000000");
-            fprintf(out_fd, "mov%s xmm3, rax\n", is_single_precision ? "d" : "q");
-            fprintf(out_fd, "pxor xmm0, xmm3\n");
-            fprintf(out_fd, "subs%s xmm0, xmm2\n", fp_op_size_from_type(var->type));
+            emit(Opcode::MOV, rax, mir::hex_imm(is_single_precision ? 0x80000000 : INT64_MIN));
+            emit(is_single_precision ? Opcode::MOVD : Opcode::MOVQ, xmm3, rax);
+            emit(Opcode::PXOR, xmm0, xmm3);
+            emit(mir::scalar(op->type == Instruction::fnmadd ? Opcode::ADDSS : Opcode::SUBSS, var->type), xmm0, xmm2);
             break;
         }
         case Instruction::convert:
             assert(arg_count == 1);
             assert(is_float(var->type) || is_float(op->in_vars[0]->type));
-            if (is_integer(var->type)) {
-                compile_rounding_mode(var);
-            }
-            fprintf(out_fd, "cvt%s2%s %s, %s\n", convert_name_from_type(op->in_vars[0]->type), convert_name_from_type(var->type), (is_float(var->type) ? "xmm0" : rax_from_type(var->type)),
-                    (is_float(op->in_vars[0]->type) ? "xmm0" : rax_from_type(op->in_vars[0]->type)));
+            emit(convert_from_types(op->in_vars[0]->type, var->type, is_integer(var->type) && rounding::is_truncating(op)), (is_float(var->type) ? xmm0 : rax_from_type(var->type)),
+                 (is_float(op->in_vars[0]->type) ? xmm0 : rax_from_type(op->in_vars[0]->type)));
             break;
         case Instruction::uconvert: {
             assert(arg_count == 1);
             const Type in_var_type = op->in_vars[0]->type;
             assert(is_float(var->type) ^ is_float(in_var_type));
             if (is_float(in_var_type)) {
-                compile_rounding_mode(var);
                 const bool is_single_precision = in_var_type == Type::f32;
                 // spread the sign bit of the floating point number to the length of the (result) integer.
                 // Negate this value and with an "and" operation set so the result to zero if the floating point value is negative
-                const char *help_reg_name = (is_single_precision ? "ebx" : "rbx");
-                fprintf(out_fd, "mov%s %s, xmm0\n", (is_single_precision ? "d" : "q"), help_reg_name);
-                fprintf(out_fd, "sar %s, %u\n", help_reg_name, (is_single_precision ? 31 : 63));
-                fprintf(out_fd, "not %s\n", help_reg_name);
+                const auto help_reg = mir::reg(REG_B, is_single_precision ? Type::i32 : Type::i64);
+                emit(is_single_precision ? Opcode::MOVD : Opcode::MOVQ, help_reg, xmm0);
+                emit(Opcode::SAR, help_reg, mir::imm(is_single_precision ? 31 : 63));
+                emit(Opcode::NOT, help_reg);
                 if (is_single_precision && var->type == Type::i64) {
-                    fprintf(out_fd, "movsxd rbx, ebx\n");
+                    emit(Opcode::MOVSXD, rbx, mir::reg(REG_B, Type::i32));
                 }
-                fprintf(out_fd, "cvt%s2%s %s, xmm0\n", convert_name_from_type(in_var_type), convert_name_from_type(var->type), rax_from_type(var->type));
-                fprintf(out_fd, "and rax, rbx\n");
+                emit(convert_from_types(in_var_type, var->type, rounding::is_truncating(op)), rax_from_type(var->type), xmm0);
+                emit(Opcode::AND, rax, rbx);
             } else {
                 if (in_var_type == Type::i32) {
                     // "zero extend" and then convert: use 64bit register
-                    fprintf(out_fd, "mov eax, eax\n");
-                    fprintf(out_fd, "cvt%s2%s xmm0, rax\n", convert_name_from_type(Type::i32), convert_name_from_type(var->type));
+                    emit(Opcode::MOV, mir::reg(REG_A, Type::i32), mir::reg(REG_A, Type::i32));
+                    emit(convert_from_types(Type::i32, var->type, false), xmm0, rax);
                 } else if (in_var_type == Type::i64) {
                     // method taken from gcc compiler
-                    fprintf(out_fd, "mov rbx, rax\n");
-                    fprintf(out_fd, "shr rax\n");
-                    fprintf(out_fd, "and rbx, 1\n");
-                    fprintf(out_fd, "or rax, rbx\n");
-                    fprintf(out_fd, "cvt%s2%s xmm0, rax\n", convert_name_from_type(Type::i64), convert_name_from_type(var->type));
-                    fprintf(out_fd, "adds%s xmm0, xmm0\n", fp_op_size_from_type(var->type));
+                    emit(Opcode::MOV, rbx, rax);
+                    emit(Opcode::SHR, rax);
+                    emit(Opcode::AND, rbx, mir::imm(1));
+                    emit(Opcode::OR, rax, rbx);
+                    emit(convert_from_types(Type::i64, var->type, false), xmm0, rax);
+                    emit(mir::scalar(Opcode::ADDSS, var->type), xmm0, xmm0);
                 } else {
                     assert(0);
                 }
             }
             break;
         }
+        case Instruction::atomic_rmw: {
+            assert(arg_count == 3);
+            const auto type = op->lifter_info.in_op_size;
+            const auto val_reg = op_reg(type, 1);
+            if (op->atomic_info.rmw_op == Instruction::store) {
+                // xchg with memory is always locked
+                emit(Opcode::XCHG, mir::sized(mir::mem(REG_A), type), val_reg);
+                emit(Opcode::MOV, rax_from_type(type), val_reg);
+                break;
+            }
+            if (op->atomic_info.rmw_op == Instruction::add) {
+                emit(Opcode::XADD, mir::sized(mir::mem(REG_A), type), val_reg).lock = true;
+                emit(Opcode::MOV, rax_from_type(type), val_reg);
+                break;
+            }
+
+            // the new value is computed from the loaded one and only stored if the memory still holds that
+            const auto new_reg = op_reg(type, 3);
+            const auto retry = mir::symbol(mir::Symbol::Kind::ATOMIC, block->id, static_cast<uint32_t>(idx));
+            emit(Opcode::MOV, rcx, rax);
+            emit(Opcode::MOV, rax_from_type(type), mir::sized(mir::mem(REG_C), type));
+            output.label(retry);
+            emit(Opcode::MOV, new_reg, val_reg);
+            switch (op->atomic_info.rmw_op) {
+            case Instruction::_and:
+                emit(Opcode::AND, new_reg, rax_from_type(type));
+                break;
+            case Instruction::_or:
+                emit(Opcode::OR, new_reg, rax_from_type(type));
+                break;
+            case Instruction::_xor:
+                emit(Opcode::XOR, new_reg, rax_from_type(type));
+                break;
+            case Instruction::max:
+                emit(Opcode::CMP, rax_from_type(type), val_reg);
+                emit(Opcode::CMOVCC, mir::Cond::G, new_reg, rax_from_type(type));
+                break;
+            case Instruction::min:
+                emit(Opcode::CMP, rax_from_type(type), val_reg);
+                emit(Opcode::CMOVCC, mir::Cond::L, new_reg, rax_from_type(type));
+                break;
+            case Instruction::umax:
+                emit(Opcode::CMP, rax_from_type(type), val_reg);
+                emit(Opcode::CMOVCC, mir::Cond::A, new_reg, rax_from_type(type));
+                break;
+            case Instruction::umin:
+                emit(Opcode::CMP, rax_from_type(type), val_reg);
+                emit(Opcode::CMOVCC, mir::Cond::B, new_reg, rax_from_type(type));
+                break;
+            default:
+                assert(0);
+                break;
+            }
+            emit(Opcode::CMPXCHG, mir::sized(mir::mem(REG_C), type), new_reg).lock = true;
+            emit(Opcode::JCC, mir::Cond::NE, mir::label(retry));
+            break;
+        }
+        case Instruction::cas: {
+            assert(arg_count == 4);
+            const auto type = op->lifter_info.in_op_size;
+            emit(Opcode::MOV, rdx, rax);
+            emit(Opcode::MOV, rax_from_type(type), op_reg(type, 1));
+            emit(Opcode::CMPXCHG, mir::sized(mir::mem(REG_D), type), op_reg(type, 2)).lock = true;
+            break;
+        }
+        case Instruction::load_reserved:
+            assert(arg_count == 2);
+            emit(Opcode::MOV, rax_from_type(var->type), mir::sized(mir::mem(REG_A), var->type));
+            emit(Opcode::MOV, mir::tcb("reservation"), rax);
+            break;
+        case Instruction::reservation:
+            assert(arg_count == 0);
+            emit(Opcode::MOV, rax_from_type(var->type), mir::tcb("reservation"));
+            break;
+        case Instruction::fence:
+            assert(arg_count == 1);
+            if (fence_needs_barrier(*op)) {
+                emit(Opcode::MFENCE);
+            }
+            break;
         }
 
         if (var->type != Type::mt) {
             if (is_float(var->type)) {
-                fprintf(out_fd, "mov%s [rsp + 8 * %zu], xmm0\n", (var->type == Type::f32 ? "d" : "q"), index_for_var(block, var));
+                emit(mov_from_type(var->type), mir::stack_slot(index_for_var(block, var)), xmm0);
             } else {
                 for (size_t out_idx = 0; out_idx < op->out_vars.size(); ++out_idx) {
                     const auto &out_var = op->out_vars[out_idx];
-                    if (!out_var)
+                    // memory tokens, e.g. of an atomic, only order the memory ops in the IR
+                    if (!out_var || out_var->type == Type::mt)
                         continue;
 
-                    const auto *reg_str = op_reg_map_for_type(out_var->type)[out_idx];
-                    fprintf(out_fd, "mov [rsp + 8 * %zu], %s\n", index_for_var(block, out_var), reg_str);
+                    emit(Opcode::MOV, mir::stack_slot(index_for_var(block, out_var)), op_reg(out_var->type, out_idx));
                 }
             }
         }
     }
+
+    if (cur_rounding_mode != RoundingMode::NEAREST) {
+        write_rounding_mode(RoundingMode::NEAREST);
+    }
 }
 
-void Generator::compile_rounding_mode(const SSAVar *var) {
-    assert(std::holds_alternative<std::unique_ptr<Operation>>(var->info));
-    auto &rounding_mode_variant = std::get<std::unique_ptr<Operation>>(var->info).get()->rounding_info;
-    if (std::holds_alternative<RefPtr<SSAVar>>(rounding_mode_variant)) {
+void Generator::compile_rounding_mode(const Operation *op, RoundingMode &cur_mode) {
+    const auto req = rounding::requirement(op, false);
+    switch (req.kind) {
+    case rounding::Requirement::NONE:
+        return;
+    case rounding::Requirement::DYNAMIC:
         // TODO: Handle dynamic rounding
-        assert(0);
-    } else if (std::holds_alternative<RoundingMode>(rounding_mode_variant)) {
-        uint32_t x86_64_rounding_mode;
-        switch (std::get<RoundingMode>(rounding_mode_variant)) {
-        case RoundingMode::NEAREST:
-            x86_64_rounding_mode = 0x0000;
-            break;
-        case RoundingMode::DOWN:
-            x86_64_rounding_mode = 0x2000;
-            break;
-        case RoundingMode::UP:
-            x86_64_rounding_mode = 0x4000;
-            break;
-        case RoundingMode::ZERO:
-            x86_64_rounding_mode = 0x6000;
-            break;
-        default:
-            assert(0);
-            break;
-        }
-        // clear rounding mode and set correctly
-        fprintf(out_fd, "sub rsp, 4\n");
-        fprintf(out_fd, "stmxcsr [rsp]\n");
-        fprintf(out_fd, "mov edi, [rsp]\n");
-        fprintf(out_fd, "and edi, 0xFFFF1FFF\n");
-        if (x86_64_rounding_mode != 0) {
-            fprintf(out_fd, "or edi, %u\n", x86_64_rounding_mode);
+        assert(!is_integer(op->out_vars[0]->type));
+        return;
+    case rounding::Requirement::STATIC:
+    case rounding::Requirement::DEFAULT: {
+        const auto mode = (req.kind == rounding::Requirement::STATIC) ? req.mode : RoundingMode::NEAREST;
+        if (mode != cur_mode) {
+            write_rounding_mode(mode);
+            cur_mode = mode;
         }
-        fprintf(out_fd, "mov [rsp], edi\n");
-        fprintf(out_fd, "ldmxcsr [rsp]\n");
-        fprintf(out_fd, "add rsp, 4\n");
-    } else {
-        assert(0);
+        return;
+    }
+    }
+}
+
+void Generator::write_rounding_mode(const RoundingMode mode) {
+    using mir::Opcode;
+
+    // clear rounding mode and set correctly
+    emit(Opcode::SUB, mir::stack_ptr(), mir::imm(4));
+    emit(Opcode::STMXCSR, mir::mem(REG_SP));
+    emit(Opcode::AND, mir::sized(mir::mem(REG_SP), Type::i32), mir::hex_imm(0xFFFF1FFF));
+    if (const auto bits = rounding::mxcsr_bits(mode); bits != 0) {
+        emit(Opcode::OR, mir::sized(mir::mem(REG_SP), Type::i32), mir::imm(bits));
+    }
+    emit(Opcode::LDMXCSR, mir::mem(REG_SP));
+    emit(Opcode::ADD, mir::stack_ptr(), mir::imm(4));
+    if (count_stats) {
+        emit(Opcode::INC, mir::sized(mir::mem(mir::named("stats_rounding_switches")), Type::i64)).lock = multithreaded_guest;
     }
 }
 
 void Generator::compile_cf_args(const BasicBlock *block, const CfOp &cf_op, const size_t stack_size) {
+    using mir::Opcode;
+    const auto rax = mir::reg(REG_A);
+
     const auto *target = cf_op.target();
     const auto &target_inputs = cf_op.target_inputs();
     if (target->inputs.size() != target_inputs.size()) {
@@ -1016,44 +1549,52 @@ void Generator::compile_cf_args(const BasicBlock *block, const CfOp &cf_op, cons
             continue;
         }
 
-        fprintf(out_fd, "# Setting input %zu\n", i);
+        comment("Setting input %zu", i);
 
         const auto target_is_static = std::holds_alternative<size_t>(target_var->info);
+        if (target_is_static && !is_static_live_in(target, std::get<size_t>(target_var->info))) {
+            comment("Skipped (dead)");
+            continue;
+        }
         if (std::holds_alternative<size_t>(source_var->info)) {
             if (optimizations & OPT_UNUSED_STATIC) {
                 if (target_is_static && std::get<size_t>(source_var->info) == std::get<size_t>(target_var->info)) {
                     // TODO: see this as a different optimization?
-                    fprintf(out_fd, "# Skipped\n");
+                    comment("Skipped");
                     continue;
                 } else {
                     // when using the unused static optimization, the static load might have been optimized out
                     // so we need to get the static directly
-                    fprintf(out_fd, "xor rax, rax\n");
-                    fprintf(out_fd, "mov %s, [s%zu]\n", rax_from_type(source_var->type), std::get<size_t>(source_var->info));
+                    emit(Opcode::XOR, rax, rax);
+                    emit(Opcode::MOV, rax_from_type(source_var->type), mir::static_var(std::get<size_t>(source_var->info)));
                 }
             } else {
-                fprintf(out_fd, "xor rax, rax\n");
-                fprintf(out_fd, "mov %s, [rsp + 8 * %zu]\n", rax_from_type(source_var->type), index_for_var(block, source_var));
+                emit(Opcode::XOR, rax, rax);
+                emit(Opcode::MOV, rax_from_type(source_var->type), mir::stack_slot(index_for_var(block, source_var)));
             }
         } else {
-            fprintf(out_fd, "xor rax, rax\n");
-            fprintf(out_fd, "mov %s, [rsp + 8 * %zu]\n", rax_from_type(source_var->type), index_for_var(block, source_var));
+            emit(Opcode::XOR, rax, rax);
+            emit(Opcode::MOV, rax_from_type(source_var->type), mir::stack_slot(index_for_var(block, source_var)));
         }
 
         if (target_is_static) {
-            fprintf(out_fd, "mov [s%zu], rax\n", std::get<size_t>(target_var->info));
+            emit(Opcode::MOV, mir::static_var(std::get<size_t>(target_var->info)), rax);
         } else {
-            fprintf(out_fd, "mov qword ptr [rbx], rax\nadd rbx, 8\n");
+            emit(Opcode::MOV, mir::sized(mir::mem(REG_B), Type::i64), rax);
+            emit(Opcode::ADD, mir::reg(REG_B), mir::imm(8));
         }
     }
 
     // destroy stack space
-    fprintf(out_fd, "# destroy stack space\n");
-    fprintf(out_fd, "add rsp, %zu\n", stack_size);
+    comment("destroy stack space");
+    emit(Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(stack_size)));
 }
 
 void Generator::compile_ret(const BasicBlock *block, const CfOp &op, const size_t stack_size) {
-    fprintf(out_fd, "# Ret Mapping\n");
+    using mir::Opcode;
+    const auto rax = mir::reg(REG_A);
+
+    comment("Ret Mapping");
 
     assert(op.info.index() == 2);
     const auto &ret_info = std::get<CfOp::RetInfo>(op.info);
@@ -1064,89 +1605,153 @@ void Generator::compile_ret(const BasicBlock *block, const CfOp &op, const size_
 
         if (optimizations & OPT_UNUSED_STATIC && std::holds_alternative<size_t>(var->info)) {
             if (std::get<size_t>(var->info) == s_idx) {
-                fprintf(out_fd, "# Skipped\n");
+                comment("Skipped");
                 continue;
             }
-            fprintf(out_fd, "xor rax, rax\n");
-            fprintf(out_fd, "mov %s, [s%zu]\n", rax_from_type(var->type), std::get<size_t>(var->info));
+            emit(Opcode::XOR, rax, rax);
+            emit(Opcode::MOV, rax_from_type(var->type), mir::static_var(std::get<size_t>(var->info)));
         } else {
-            fprintf(out_fd, "xor rax, rax\n");
-            fprintf(out_fd, "mov %s, [rsp + 8 * %zu]\n", rax_from_type(var->type), index_for_var(block, var));
+            emit(Opcode::XOR, rax, rax);
+            emit(Opcode::MOV, rax_from_type(var->type), mir::stack_slot(index_for_var(block, var)));
         }
 
-        fprintf(out_fd, "mov [s%zu], rax\n", s_idx);
+        emit(Opcode::MOV, mir::static_var(s_idx), rax);
     }
 
     const auto ret_idx = index_for_var(block, op.in_vars[0]);
-    fprintf(out_fd, "mov rax, [rsp + 8 * %zu]\n", ret_idx);
+    emit(Opcode::MOV, rax, mir::stack_slot(ret_idx));
 
     // destroy stack space
-    fprintf(out_fd, "# destroy stack space\n");
-    fprintf(out_fd, "add rsp, %zu\n", stack_size);
+    comment("destroy stack space");
+    emit(Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(stack_size)));
 
-    fprintf(out_fd, "cmp [rsp + 8], rax\n");
-    fprintf(out_fd, "jnz 0f\n");
-    fprintf(out_fd, "ret\n");
-    fprintf(out_fd, "0:\n");
+    emit(Opcode::CMP, mir::mem(REG_SP, 8), rax);
+    emit(Opcode::JCC, mir::Cond::NE, mir::label(mir::local(0)));
+    emit(Opcode::RET);
+    output.label(mir::local(0));
     // reset ret stack
-    fprintf(out_fd, "mov rsp, [init_ret_stack_ptr]\n");
+    if (count_stats) {
+        emit(Opcode::INC, mir::sized(mir::mem(mir::named("stats_ret_mispredicts")), Type::i64)).lock = multithreaded_guest;
+    }
+    emit(Opcode::MOV, mir::stack_ptr(), mir::tcb("init_ret_stack_ptr"));
 
     // do ijump
-    fprintf(out_fd, "mov rbx, rax\n");
-    fprintf(out_fd, "jmp ijump_lookup\n");
+    emit(Opcode::MOV, mir::reg(REG_B), rax);
+    emit(Opcode::JMP, mir::label(ijump_target_label(block, op)));
 }
 
 void Generator::compile_cjump(const BasicBlock *block, const CfOp &cf_op, const size_t cond_idx, const size_t stack_size) {
+    using mir::Opcode;
+    const auto rax = mir::reg(REG_A), rbx = mir::reg(REG_B);
+
     assert(cf_op.in_vars[0] != nullptr && cf_op.in_vars[1] != nullptr);
     assert(cf_op.info.index() == 1);
     // this breaks when the arg mapping is changed
-    fprintf(out_fd, "# Get CJump Args\nxor rax, rax\nxor rbx, rbx\n");
+    comment("Get CJump Args");
+    emit(Opcode::XOR, rax, rax);
+    emit(Opcode::XOR, rbx, rbx);
     if (optimizations & OPT_UNUSED_STATIC && std::holds_alternative<size_t>(cf_op.in_vars[0]->info)) {
         // load might be optimized out so get the value directly
-        fprintf(out_fd, "mov %s, [s%zu]\n", rax_from_type(cf_op.in_vars[0]->type), std::get<size_t>(cf_op.in_vars[0]->info));
+        emit(Opcode::MOV, rax_from_type(cf_op.in_vars[0]->type), mir::static_var(std::get<size_t>(cf_op.in_vars[0]->info)));
     } else {
-        fprintf(out_fd, "mov %s, [rsp + 8 * %zu]\n", rax_from_type(cf_op.in_vars[0]->type), index_for_var(block, cf_op.in_vars[0]));
+        emit(Opcode::MOV, rax_from_type(cf_op.in_vars[0]->type), mir::stack_slot(index_for_var(block, cf_op.in_vars[0])));
     }
     if (optimizations & OPT_UNUSED_STATIC && std::holds_alternative<size_t>(cf_op.in_vars[1]->info)) {
         // load might be optimized out so get the value directly
-        fprintf(out_fd, "mov %s, [s%zu]\n", op_reg_map_for_type(cf_op.in_vars[1]->type)[1], std::get<size_t>(cf_op.in_vars[1]->info));
+        emit(Opcode::MOV, op_reg(cf_op.in_vars[1]->type, 1), mir::static_var(std::get<size_t>(cf_op.in_vars[1]->info)));
     } else {
-        fprintf(out_fd, "mov %s, [rsp + 8 * %zu]\n", op_reg_map_for_type(cf_op.in_vars[1]->type)[1], index_for_var(block, cf_op.in_vars[1]));
+        emit(Opcode::MOV, op_reg(cf_op.in_vars[1]->type, 1), mir::stack_slot(index_for_var(block, cf_op.in_vars[1])));
     }
-    fprintf(out_fd, "cmp rax, rbx\n");
+    emit(Opcode::CMP, rax, rbx);
 
-    fprintf(out_fd, "# Check CJump cond\n");
+    comment("Check CJump cond");
     const auto &info = std::get<CfOp::CJumpInfo>(cf_op.info);
+    // jumps to the next cf op if the condition doesn't hold
+    auto cond = mir::Cond::NE;
     switch (info.type) {
     case CfOp::CJumpInfo::CJumpType::eq:
-        fprintf(out_fd, "jne b%zu_cf%zu\n", block->id, cond_idx + 1);
+        cond = mir::Cond::NE;
         break;
     case CfOp::CJumpInfo::CJumpType::neq:
-        fprintf(out_fd, "je b%zu_cf%zu\n", block->id, cond_idx + 1);
+        cond = mir::Cond::E;
         break;
     case CfOp::CJumpInfo::CJumpType::lt:
-        fprintf(out_fd, "jae b%zu_cf%zu\n", block->id, cond_idx + 1);
+        cond = mir::Cond::AE;
         break;
     case CfOp::CJumpInfo::CJumpType::gt:
-        fprintf(out_fd, "jbe b%zu_cf%zu\n", block->id, cond_idx + 1);
+        cond = mir::Cond::BE;
         break;
     case CfOp::CJumpInfo::CJumpType::slt:
-        fprintf(out_fd, "jge b%zu_cf%zu\n", block->id, cond_idx + 1);
+        cond = mir::Cond::GE;
         break;
     case CfOp::CJumpInfo::CJumpType::sgt:
-        fprintf(out_fd, "jle b%zu_cf%zu\n", block->id, cond_idx + 1);
+        cond = mir::Cond::LE;
         break;
     }
+    emit(Opcode::JCC, cond, mir::label(mir::symbol(mir::Symbol::Kind::CF, block->id, static_cast<uint32_t>(cond_idx + 1))));
 
     compile_cf_args(block, cf_op, stack_size);
-    fprintf(out_fd, "# control flow\n");
-    fprintf(out_fd, "jmp b%zu\n", info.target->id);
+    comment("control flow");
+    emit(Opcode::JMP, mir::block(info.target->id));
 }
 
 void Generator::compile_syscall(const BasicBlock *block, const CfOp &cf_op, const size_t stack_size) {
+    using mir::Opcode;
+
     const auto &info = std::get<CfOp::SyscallInfo>(cf_op.info);
     compile_continuation_args(block, info.continuation_mapping);
 
+    if (const auto *syscall_info = inline_syscall_info(cf_op)) {
+        // the arguments follow the number in the inputs
+        for (size_t i = 0; i < syscall_info->param_count; ++i) {
+            const auto &var = cf_op.in_vars[i + 1];
+            if (!var) {
+                break;
+            }
+
+            comment("syscall argument %lu", i);
+            if (optimizations & OPT_UNUSED_STATIC && std::holds_alternative<size_t>(var->info)) {
+                emit(Opcode::MOV, mir::reg(syscall_reg[i]), mir::static_var(std::get<size_t>(var->info)));
+            } else {
+                emit(Opcode::MOV, mir::reg(syscall_reg[i]), mir::stack_slot(index_for_var(block, var)));
+            }
+        }
+        emit(Opcode::MOV, mir::reg(REG_A, Type::i32), mir::imm(static_cast<int64_t>(syscall_info->translated_id)));
+        emit(Opcode::SYSCALL);
+        if (info.static_mapping.size() > 0) {
+            emit(Opcode::MOV, mir::static_var(info.static_mapping.at(0)), mir::reg(REG_A));
+        }
+        comment("destroy stack space");
+        emit(Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(stack_size)));
+        emit(Opcode::JMP, mir::block(info.continuation_block->id));
+        return;
+    }
+
+    if (const auto *routine = libc_routine_symbol(cf_op)) {
+        // the routines take at most 3 arguments and don't need the stack space syscall_impl gets
+        for (size_t i = 0; i < 3; ++i) {
+            const auto &var = cf_op.in_vars[i + 1];
+            if (!var) {
+                break;
+            }
+
+            comment("libc routine argument %lu", i);
+            if (optimizations & OPT_UNUSED_STATIC && std::holds_alternative<size_t>(var->info)) {
+                emit(Opcode::MOV, mir::reg(call_reg[i]), mir::static_var(std::get<size_t>(var->info)));
+            } else {
+                emit(Opcode::MOV, mir::reg(call_reg[i]), mir::stack_slot(index_for_var(block, var)));
+            }
+        }
+        emit(Opcode::CALL, mir::label(mir::named(routine)));
+        if (info.static_mapping.size() > 0) {
+            emit(Opcode::MOV, mir::static_var(info.static_mapping.at(0)), mir::reg(REG_A));
+        }
+        comment("destroy stack space");
+        emit(Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(stack_size)));
+        emit(Opcode::JMP, mir::block(info.continuation_block->id));
+        return;
+    }
+
     for (size_t i = 0; i < call_reg.size(); ++i) {
         const auto &var = cf_op.in_vars[i];
         if (!var)
@@ -1155,32 +1760,36 @@ void Generator::compile_syscall(const BasicBlock *block, const CfOp &cf_op, cons
         if (var->type == Type::mt)
             continue;
 
-        fprintf(out_fd, "# syscall argument %lu\n", i);
+        comment("syscall argument %lu", i);
         if (optimizations & OPT_UNUSED_STATIC && std::holds_alternative<size_t>(var->info)) {
-            fprintf(out_fd, "mov %s, [s%zu]\n", call_reg[i], std::get<size_t>(var->info));
+            emit(Opcode::MOV, mir::reg(call_reg[i]), mir::static_var(std::get<size_t>(var->info)));
         } else {
-            fprintf(out_fd, "mov %s, [rsp + 8 * %zu]\n", call_reg[i], index_for_var(block, var));
+            emit(Opcode::MOV, mir::reg(call_reg[i]), mir::stack_slot(index_for_var(block, var)));
         }
     }
     if (cf_op.in_vars[6] == nullptr) {
         // since the function can theoretically change the value on the stack we do want to add some space here
-        fprintf(out_fd, "sub rsp, 16\n");
+        emit(Opcode::SUB, mir::stack_ptr(), mir::imm(16));
     } else {
-        fprintf(out_fd, "mov rax, [rsp + 8 * %zu]\n", index_for_var(block, cf_op.in_vars[6]));
-        fprintf(out_fd, "sub rsp, 8\n");
-        fprintf(out_fd, "push rax\n");
+        emit(Opcode::MOV, mir::reg(REG_A), mir::stack_slot(index_for_var(block, cf_op.in_vars[6])));
+        emit(Opcode::SUB, mir::stack_ptr(), mir::imm(8));
+        emit(Opcode::PUSH, mir::reg(REG_A));
     }
 
-    fprintf(out_fd, "call syscall_impl\nadd rsp, 16\n");
+    emit(Opcode::CALL, mir::label(mir::named("syscall_impl")));
+    emit(Opcode::ADD, mir::stack_ptr(), mir::imm(16));
     if (info.static_mapping.size() > 0) {
-        fprintf(out_fd, "mov [s%zu], rax\n", info.static_mapping.at(0));
+        emit(Opcode::MOV, mir::static_var(info.static_mapping.at(0)), mir::reg(REG_A));
     }
-    fprintf(out_fd, "# destroy stack space\n");
-    fprintf(out_fd, "add rsp, %zu\n", stack_size);
-    fprintf(out_fd, "jmp b%zu\n", info.continuation_block->id);
+    comment("destroy stack space");
+    emit(Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(stack_size)));
+    emit(Opcode::JMP, mir::block(info.continuation_block->id));
 }
 
 void Generator::compile_continuation_args(const BasicBlock *block, const std::vector<std::pair<RefPtr<SSAVar>, size_t>> &mapping) {
+    using mir::Opcode;
+    const auto rax = mir::reg(REG_A);
+
     for (const auto &[var, s_idx] : mapping) {
         if (var->type == Type::mt) {
             continue;
@@ -1189,33 +1798,16 @@ void Generator::compile_continuation_args(const BasicBlock *block, const std::ve
         if (optimizations & OPT_UNUSED_STATIC && std::holds_alternative<size_t>(var->info)) {
             const auto orig_static_idx = std::get<size_t>(var->info);
             if (orig_static_idx == s_idx) {
-                fprintf(out_fd, "# Skipped\n");
+                comment("Skipped");
                 continue;
             }
-            fprintf(out_fd, "xor rax, rax\n");
-            fprintf(out_fd, "mov %s, [s%zu]\n", rax_from_type(var->type), orig_static_idx);
+            emit(Opcode::XOR, rax, rax);
+            emit(Opcode::MOV, rax_from_type(var->type), mir::static_var(orig_static_idx));
         } else {
-            fprintf(out_fd, "xor rax, rax\n");
-            fprintf(out_fd, "mov %s, [rsp + 8 * %zu]\n", rax_from_type(var->type), index_for_var(block, var));
+            emit(Opcode::XOR, rax, rax);
+            emit(Opcode::MOV, rax_from_type(var->type), mir::stack_slot(index_for_var(block, var)));
         }
 
-        fprintf(out_fd, "mov [s%zu], rax\n", s_idx);
-    }
-}
-
-void Generator::compile_section(Section section) {
-    switch (section) {
-    case Section::DATA:
-        fprintf(out_fd, ".data\n");
-        break;
-    case Section::BSS:
-        fprintf(out_fd, ".bss\n");
-        break;
-    case Section::TEXT:
-        fprintf(out_fd, ".text\n");
-        break;
-    case Section::RODATA:
-        fprintf(out_fd, ".section .rodata\n");
-        break;
+        emit(Opcode::MOV, mir::static_var(s_idx), rax);
     }
 }
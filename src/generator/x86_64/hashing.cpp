@@ -1,220 +1,242 @@
 #include <common/internal.h>
+#include <common/parallel.h>
 #include <generator/x86_64/generator.h>
 #include <generator/x86_64/hashing.h>
+#include <generator/x86_64/ijump_hash.h>
+
+#include <numeric>
+#include <optional>
 
 using namespace generator::x86_64::hashing;
 
-bool HashtableBuilder::build() {
-    buckets.clear();
-    buckets.reserve(bucket_number);
-
-    hash_idxs.clear();
-    hash_idxs.reserve(bucket_number);
-    for (size_t i = 0; i < bucket_number; ++i) {
-        buckets.emplace_back(Bucket());
-        hash_idxs.emplace_back(0);
+namespace {
+size_t ceil_log2(const size_t value) {
+    uint64_t bits = 0;
+    while ((size_t{1} << bits) < value) {
+        bits++;
     }
+    return bits;
+}
+} // namespace
+
+void HashtableBuilder::fill(std::vector<uint64_t> &keys) {
+    // equal keys can't be separated by any displacement
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    this->keys = keys;
+
+    const size_t key_count = keys.size();
+    const uint64_t table_bits = std::max<uint64_t>(ceil_log2(std::ceil(key_count / load_factor)), 1);
+    bucket_bits = std::max<uint64_t>(ceil_log2((key_count + bucket_size - 1) / bucket_size), 1);
+
+    partition_bits = 0;
+    while (partition_bits < MAX_PARTITION_BITS && (key_count >> (partition_bits + 1)) >= MIN_PARTITION_KEYS && partition_bits + 1 <= bucket_bits && partition_bits + 1 < table_bits) {
+        partition_bits++;
+    }
+    slot_bits = table_bits - partition_bits;
+
+    hash_table_size = size_t{1} << table_bits;
+    bucket_number = size_t{1} << bucket_bits;
+}
 
-    hash_table.clear();
-    hash_table.reserve(hash_table_size);
-    for (size_t i = 0; i < hash_table_size; ++i) {
-        hash_table.emplace_back(0);
+bool HashtableBuilder::build() {
+    std::optional<ThreadPool> own_pool;
+    if (thread_pool == nullptr) {
+        own_pool.emplace(resolve_thread_count(thread_count));
     }
+    auto &pool = thread_pool != nullptr ? *thread_pool : *own_pool;
 
-    for (auto key : keys) {
-        auto hashes = spookey_hash(key);
-        buckets[hashes[0]].stored_hashes.emplace_back(hashes[0], hashes[1], hashes[2], key);
+    for (size_t attempt = 0; attempt < MAX_SEED_ATTEMPTS; ++attempt) {
+        if (place_buckets(pool)) {
+            return true;
+        }
+        seed += ijump_hash::SLOT_MULTIPLIER;
     }
 
-    // sort buckets by number of items, descending
-    std::sort(buckets.begin(), buckets.end(), [](const Bucket &b1, const Bucket &b2) { return b1.stored_hashes.size() > b2.stored_hashes.size(); });
+    DEBUG_LOG("Unable to calculate valid hash function. Reducing load factor.");
+    return false;
+}
 
-    std::vector<bool> occupied_bins(hash_table_size);
-    std::fill(occupied_bins.begin(), occupied_bins.end(), false);
+bool HashtableBuilder::place_buckets(ThreadPool &pool) {
+    using namespace ijump_hash;
 
-    for (auto &bucket : buckets) {
-        if (bucket.stored_hashes.empty()) {
-            continue;
+    // group the keys by bucket
+    std::vector<size_t> bucket_starts(bucket_number + 1, 0);
+    for (const auto key : keys) {
+        bucket_starts[bucket(mix(key, seed), bucket_bits) + 1]++;
+    }
+    std::partial_sum(bucket_starts.begin(), bucket_starts.end(), bucket_starts.begin());
+    std::vector<uint64_t> bucket_keys(keys.size());
+    {
+        auto next_idxs = bucket_starts;
+        for (const auto key : keys) {
+            bucket_keys[next_idxs[bucket(mix(key, seed), bucket_bits)]++] = key;
         }
+    }
+
+    displacements.assign(bucket_number, 0);
+    hash_table.assign(hash_table_size, 0);
+
+    const size_t buckets_per_partition = bucket_number >> partition_bits;
+    const size_t slots_per_partition = size_t{1} << slot_bits;
+    std::atomic<bool> failed = false;
+    pool.parallel_for(size_t{1} << partition_bits, [&](const size_t partition) {
+        const auto bucket_len = [&bucket_starts](const size_t bucket_idx) { return bucket_starts[bucket_idx + 1] - bucket_starts[bucket_idx]; };
+
+        // the buckets with the most keys are the hardest to place, so they go first
+        std::vector<size_t> order(buckets_per_partition);
+        std::iota(order.begin(), order.end(), partition * buckets_per_partition);
+        std::stable_sort(order.begin(), order.end(), [&bucket_len](const size_t b1, const size_t b2) { return bucket_len(b1) > bucket_len(b2); });
+
+        const size_t partition_start = partition << slot_bits;
+        std::vector<bool> occupied(slots_per_partition, false);
+        std::vector<uint64_t> hashes;
+        std::vector<uint64_t> slots;
+        for (const auto bucket_idx : order) {
+            if (bucket_len(bucket_idx) == 0 || failed) {
+                return;
+            }
+
+            hashes.clear();
+            for (size_t i = bucket_starts[bucket_idx]; i < bucket_starts[bucket_idx + 1]; ++i) {
+                hashes.emplace_back(mix(bucket_keys[i], seed));
+            }
 
-        // apply hashing scheme described in "Hash, displace, and compress" (Appendix: A Practical Version)
-        size_t d0 = 0;
-        size_t d1 = 0;
-
-        // for storage efficient storage of hash function
-        uint16_t combination_idx = 0;
-
-        while ((d0 < hash_table_size || d1 < hash_table_size) && (combination_idx < UINT16_MAX)) {
-            std::vector<size_t> valid_idxs;
-            for (auto &hash : bucket.stored_hashes) {
-                size_t hashed_idx = (hash.h1 + d0 * hash.h2 + d1) % hash_table_size;
-                if (occupied_bins[hashed_idx]) {
-                    // revert false inserts
-                    for (size_t idx : valid_idxs) {
-                        occupied_bins[idx] = false;
-                        hash_table[idx] = 0;
+            uint32_t displacement = 0;
+            for (; displacement < MAX_DISPLACEMENT; ++displacement) {
+                slots.clear();
+                for (const auto hash : hashes) {
+                    const auto slot_idx = slot(hash, displacement, partition_bits, slot_bits);
+                    if (occupied[slot_idx - partition_start] || std::find(slots.begin(), slots.end(), slot_idx) != slots.end()) {
+                        break;
                     }
+                    slots.emplace_back(slot_idx);
+                }
+                if (slots.size() == hashes.size()) {
                     break;
-                } else {
-                    valid_idxs.emplace_back(hashed_idx);
-                    occupied_bins[hashed_idx] = true;
-                    hash_table[hashed_idx] = hash.key;
                 }
             }
 
-            if (valid_idxs.size() == bucket.stored_hashes.size()) {
-                hash_idxs[bucket.stored_hashes.front().h0] = combination_idx;
-                break;
+            if (displacement == MAX_DISPLACEMENT) {
+                failed = true;
+                return;
             }
 
-            d1++;
-            combination_idx++;
-            // "rollover" to d0 and clear d1
-            if (d1 >= hash_table_size) {
-                d1 = 0;
-                d0++;
+            displacements[bucket_idx] = displacement;
+            for (size_t i = 0; i < slots.size(); ++i) {
+                occupied[slots[i] - partition_start] = true;
+                hash_table[slots[i]] = bucket_keys[bucket_starts[bucket_idx] + i];
             }
         }
+    });
 
-        if (hash_idxs[bucket.stored_hashes.front().h0] != combination_idx) {
-            DEBUG_LOG("Unable to calculate valid hash function. Reducing load factor by 10%.");
-            return false;
-        }
-    }
-    return true;
-}
-
-// taken from https://www.burtleburtle.net/bob/c/SpookyV2.h
-inline uint64_t rot_64(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
-
-std::array<uint64_t, 3> HashtableBuilder::spookey_hash(uint64_t key) const {
-    uint64_t h0 = seeds.first;
-    uint64_t h1 = seeds.second;
-
-    // "sc_const" = 0xdeadbeefdeadbeef
-    uint64_t h2 = 0xdeadbeefdeadbeef;
-    uint64_t h3 = 0xdeadbeefdeadbeef + key;
-
-    h2 += ((uint64_t)8) << 56;
-
-    // ShortEnd from https://www.burtleburtle.net/bob/c/SpookyV2.h
-    h3 ^= h2;
-    h2 = rot_64(h2, 15);
-    h3 += h2;
-    h0 ^= h3;
-    h3 = rot_64(h3, 52);
-    h0 += h3;
-    h1 ^= h0;
-    h0 = rot_64(h0, 26);
-    h1 += h0;
-    h2 ^= h1;
-    h1 = rot_64(h1, 51);
-    h2 += h1;
-    h3 ^= h2;
-    h2 = rot_64(h2, 28);
-    h3 += h2;
-    h0 ^= h3;
-    h3 = rot_64(h3, 9);
-    h0 += h3;
-    h1 ^= h0;
-    h0 = rot_64(h0, 47);
-    h1 += h0;
-    h2 ^= h1;
-    h1 = rot_64(h1, 54);
-    h2 += h1;
-    h3 ^= h2;
-    h2 = rot_64(h2, 32);
-    h3 += h2;
-    h0 ^= h3;
-    h3 = rot_64(h3, 25);
-    h0 += h3;
-    h1 ^= h0;
-    h0 = rot_64(h0, 63);
-    h1 += h0;
-
-    // apply size constraints
-    h0 %= bucket_number;
-    h1 %= hash_table_size;
-    h2 %= hash_table_size;
-    return {h0, h1, h2};
+    return !failed;
 }
 
-void HashtableBuilder::print_hash_table(FILE *out_fd, IR *ir) {
-    fprintf(out_fd, ".global ijump_hash_table\n");
-    fprintf(out_fd, "ijump_hash_table:\n");
+void HashtableBuilder::compile_hash_table(mir::Block &out, IR *ir) {
+    out.align(4);
+    out.global(mir::named("ijump_hash_table"));
+    out.label(mir::named("ijump_hash_table"));
+    size_t empty_slots = 0;
     for (uint64_t key : hash_table) {
-        BasicBlock *bb_at_addr = ir->bb_at_addr(key);
+        BasicBlock *bb_at_addr = (key != 0 ? ir->bb_at_addr(key) : nullptr);
         if (bb_at_addr != nullptr && (!(optimizations & Generator::OPT_MBRA) || !(optimizations & Generator::OPT_NO_TRANS_BBS) || RegAlloc::is_block_jumpable(bb_at_addr))) {
-            fprintf(out_fd, ".8byte 0x%lx\n", key);
-            fprintf(out_fd, ".8byte b%zu\n", bb_at_addr->id);
+            if (empty_slots != 0) {
+                out.space(empty_slots * 16);
+                empty_slots = 0;
+            }
+            out.append(mir::Opcode::QUAD, mir::hex_imm(static_cast<int64_t>(key)));
+            out.append(mir::Opcode::QUAD, mir::block(bb_at_addr->id));
         } else {
-            fprintf(out_fd, ".8byte 0x0\n");
-            fprintf(out_fd, ".8byte 0x0\n");
+            empty_slots++;
         }
     }
+    if (empty_slots != 0) {
+        out.space(empty_slots * 16);
+    }
 }
 
-void HashtableBuilder::print_hash_func_ids(FILE *out_fd) {
-    fprintf(out_fd, ".global ijump_hash_function_idxs\n");
-    fprintf(out_fd, "ijump_hash_function_idxs:\n");
-    for (uint16_t idx : hash_idxs) {
-        fprintf(out_fd, ".word %hu\n", idx);
+void HashtableBuilder::compile_hash_displacements(mir::Block &out) const {
+    out.align(2);
+    out.global(mir::named("ijump_hash_displacements"));
+    out.label(mir::named("ijump_hash_displacements"));
+    for (const auto displacement : displacements) {
+        out.append(mir::Opcode::LONG, mir::imm(displacement));
     }
 }
 
-void HashtableBuilder::print_hash_constants(FILE *out_fd) const {
-    fprintf(out_fd, ".global ijump_hash_bucket_number\n");
-    fprintf(out_fd, "ijump_hash_bucket_number:\n.quad %zu\n", bucket_number);
-
-    fprintf(out_fd, ".global ijump_hash_table_size\n");
-    fprintf(out_fd, "ijump_hash_table_size:\n.quad %zu\n", hash_table_size);
+void HashtableBuilder::compile_hash_constants(mir::Block &out) const {
+    const auto constant = [&out](const char *name, const mir::Operand &value) {
+        out.global(mir::named(name));
+        out.label(mir::named(name));
+        out.append(mir::Opcode::QUAD, value);
+    };
+
+    out.align(3);
+    constant("ijump_hash_table_size", mir::imm(static_cast<int64_t>(hash_table_size)));
+    constant("ijump_hash_seed", mir::hex_imm(static_cast<int64_t>(seed)));
+    constant("ijump_hash_bucket_bits", mir::imm(static_cast<int64_t>(bucket_bits)));
+    constant("ijump_hash_partition_bits", mir::imm(static_cast<int64_t>(partition_bits)));
+    constant("ijump_hash_slot_bits", mir::imm(static_cast<int64_t>(slot_bits)));
 }
 
-void HashtableBuilder::print_ijump_lookup(FILE *out_fd) const {
-    fprintf(out_fd, "ijump_lookup:\n");
-
-    // setup stack frame
-    fprintf(out_fd, "sub rsp, 32\n");
+// computes the same as ijump_hash::mix and ijump_hash::slot, clobbers rax, rcx and rdx
+// lock_stats: the stats counters are shared by all threads of a --multithreaded binary
+void HashtableBuilder::compile_ijump_lookup(mir::Block &out, const mir::Symbol &unresolved_label, const bool count_stats, const bool lock_stats) const {
+    using mir::Opcode;
+    const auto rax = mir::reg(REG_A), rbx = mir::reg(REG_B), rcx = mir::reg(REG_C), rdx = mir::reg(REG_D);
 
-    // hash function input parameters
-    fprintf(out_fd, "mov rsi, rbx\n");
-    fprintf(out_fd, "mov rdi, rsp\n");
-
-    fprintf(out_fd, "call spookey_hash\n");
-
-    // load hash idx to rax (h0 at rbp-32)
-    fprintf(out_fd, "mov rsi, [rsp]\n");
-    fprintf(out_fd, "shl rsi, 1\n");
-    fprintf(out_fd, "xor rax, rax\n");
-    fprintf(out_fd, "mov ax, [rsi + ijump_hash_function_idxs]\n");
-
-    // calculate d0 and d1 values and store into r8 and r9
-    fprintf(out_fd, "xor rdx, rdx\n");
-    fprintf(out_fd, "mov rdi, %zu\n", hash_table_size);
-    fprintf(out_fd, "div rdi\n");
-    fprintf(out_fd, "mov rcx, rdx\n");
+    out.label(mir::named("ijump_lookup"));
+    if (count_stats) {
+        out.append(Opcode::INC, mir::sized(mir::mem(mir::named("stats_ijump_lookups")), Type::i64)).lock = lock_stats;
+    }
 
-    // calculate index in hash table: (hashes[1] + (d0 * hashes[2]) + d1) % builder.hash_table_size;
-    fprintf(out_fd, "mov rsi, [rsp + 16]\n");
-    fprintf(out_fd, "mul rsi\n");
-    fprintf(out_fd, "add rax, rcx\n");
-    fprintf(out_fd, "add rax, [rsp + 8]\n");
-    fprintf(out_fd, "div rdi\n");
-    fprintf(out_fd, "mov rax, rdx\n");
+    // mix the address
+    out.append(Opcode::MOV, rax, mir::hex_imm(static_cast<int64_t>(seed)));
+    out.append(Opcode::XOR, rax, rbx);
+    for (const uint64_t factor : {0xff51afd7ed558ccdull, 0xc4ceb9fe1a85ec53ull}) {
+        out.append(Opcode::MOV, rdx, rax);
+        out.append(Opcode::SHR, rdx, mir::imm(33));
+        out.append(Opcode::XOR, rax, rdx);
+        out.append(Opcode::MOV, rdx, mir::hex_imm(static_cast<int64_t>(factor)));
+        out.append(Opcode::IMUL, rax, rdx);
+    }
+    out.append(Opcode::MOV, rdx, rax);
+    out.append(Opcode::SHR, rdx, mir::imm(33));
+    out.append(Opcode::XOR, rax, rdx);
+
+    // offset of the partition in the table
+    if (partition_bits != 0) {
+        out.append(Opcode::MOV, rcx, rax);
+        out.append(Opcode::SHR, rcx, mir::imm(static_cast<int64_t>(64 - partition_bits)));
+        out.append(Opcode::SHL, rcx, mir::imm(static_cast<int64_t>(slot_bits + 4)));
+    }
 
-    // destroy stack frame in advance
-    fprintf(out_fd, "add rsp, 32\n");
+    // displace the hash by the displacement of its bucket
+    out.append(Opcode::MOV, rdx, rax);
+    out.append(Opcode::SHR, rdx, mir::imm(static_cast<int64_t>(64 - bucket_bits)));
+    out.append(Opcode::MOV, mir::reg(REG_D, Type::i32), mir::mem(mir::named("ijump_hash_displacements"), REG_NONE, REG_D, 4));
+    out.append(Opcode::XOR, rax, rdx);
+    out.append(Opcode::MOV, rdx, mir::hex_imm(static_cast<int64_t>(ijump_hash::SLOT_MULTIPLIER)));
+    out.append(Opcode::IMUL, rax, rdx);
+    out.append(Opcode::SHR, rax, mir::imm(static_cast<int64_t>(64 - slot_bits)));
+    out.append(Opcode::SHL, rax, mir::imm(4));
+    if (partition_bits != 0) {
+        out.append(Opcode::ADD, rax, rcx);
+    }
 
-    // load address from hash table
-    fprintf(out_fd, "shl rax, 4\n");
-    fprintf(out_fd, "mov rdx, [ijump_hash_table + rax]\n");
-    fprintf(out_fd, "cmp rdx, rbx\n");
-    fprintf(out_fd, "jne 0f\n");
+    // compare the address in the slot
+    out.append(Opcode::CMP, rbx, mir::mem(mir::named("ijump_hash_table"), REG_A));
+    out.append(Opcode::JCC, mir::Cond::NE, mir::label(mir::local(0)));
 
     // jump to ijump entry point
-    fprintf(out_fd, "mov rbx, rax\n");
-    fprintf(out_fd, "jmp [ijump_hash_table + rbx + 8]\n");
+    out.append(Opcode::JMP, mir::mem(mir::named("ijump_hash_table"), REG_A, REG_NONE, 1, 8));
 
     // panic
-    fprintf(out_fd, "0:\nmov rdi, rbx\njmp unresolved_ijump\n");
+    out.label(mir::local(0));
+    if (count_stats) {
+        out.append(Opcode::INC, mir::sized(mir::mem(mir::named("stats_ijump_lookup_misses")), Type::i64)).lock = lock_stats;
+    }
+    out.append(Opcode::MOV, mir::reg(REG_DI), rbx);
+    out.append(Opcode::JMP, mir::label(unresolved_label));
 }
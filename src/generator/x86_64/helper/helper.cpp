@@ -2,10 +2,14 @@
 
 #include "generator/syscall_ids.h"
 #include "generator/x86_64/helper/rv64_syscalls.h"
+#include "generator/x86_64/helper/stats.h"
+#include "generator/x86_64/helper/thread.h"
+#include "generator/x86_64/ijump_hash.h"
 
 #include <cstddef>
 #include <cstdint>
 #include <elf.h>
+#include <fcntl.h>
 #include <linux/errno.h>
 #include <sys/epoll.h>
 #include <sys/stat.h>
@@ -20,6 +24,12 @@ bool have_fma;
 /* dump interpreter statistics at exit */
 constexpr bool INTERPRETER_DUMP_PERF_STATS_AT_EXIT = false;
 
+/* environment variable naming the file the interpreted ijump targets are written to, see interpreter_write_ijump_hints */
+constexpr char IJUMP_HINTS_ENV[] = "SBT_IJUMP_HINTS";
+
+/* environment variable naming the file the runtime statistics are written to, see stats::write */
+constexpr char STATS_ENV[] = "SBT_STATS";
+
 struct auxv_t {
     // see https://fossies.org/dox/Checker-0.9.9.1/gcc-startup_8c_source.html#l00042
     // see also https://refspecs.linuxfoundation.org/ELF/zSeries/lzsabi0_zSeries/x895.html
@@ -79,8 +89,9 @@ struct rv64_epoll_event_t {
     epoll_data_t data;
 };
 
+namespace {
 // TODO: make a bitmap which syscalls are passthrough, which are not implemented
-extern "C" uint64_t syscall_impl(uint64_t id, uint64_t arg0, uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5) {
+uint64_t dispatch_syscall(uint64_t id, uint64_t arg0, uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5) {
     if (id <= static_cast<uint64_t>(RISCV_SYSCALL_ID::SYSCALL_ID_MAX)) {
         const auto &info = rv64_syscall_table[id];
         if (info.action == SyscallAction::succeed) {
@@ -111,10 +122,16 @@ extern "C" uint64_t syscall_impl(uint64_t id, uint64_t arg0, uint64_t arg1, uint
             switch (static_cast<RISCV_SYSCALL_ID>(id)) {
             case RISCV_SYSCALL_ID::EXIT:
             case RISCV_SYSCALL_ID::EXIT_GROUP: {
-                if constexpr (INTERPRETER_DUMP_PERF_STATS_AT_EXIT) {
-                    helper::interpreter::interpreter_dump_perf_stats();
+                // the process only ends with the last thread
+                if (id == static_cast<uint64_t>(RISCV_SYSCALL_ID::EXIT_GROUP) || thread::exit_thread()) {
+                    if constexpr (INTERPRETER_DUMP_PERF_STATS_AT_EXIT) {
+                        helper::interpreter::interpreter_dump_perf_stats();
+                    }
+                    helper::interpreter::interpreter_write_ijump_hints();
+                    stats::write();
+                    return syscall1(info.translated_id, arg0);
                 }
-                return syscall1(info.translated_id, arg0);
+                thread::exit_current(arg0);
             }
             case RISCV_SYSCALL_ID::EPOLL_CTL: {
                 struct epoll_event event;
@@ -202,6 +219,35 @@ extern "C" uint64_t syscall_impl(uint64_t id, uint64_t arg0, uint64_t arg1, uint
     panic("Couldn't translate syscall ID");
 }
 
+// returns the value if env is "<name>=<value>" with a non-empty value
+const char *env_value(const char *env, const char *name) {
+    while (*name != '\0' && *env == *name) {
+        ++env;
+        ++name;
+    }
+    return (*name == '\0' && *env == '=' && env[1] != '\0') ? env + 1 : nullptr;
+}
+} // namespace
+
+// called by syscall_impl (wrappers.S) which saved the registers of its caller
+extern "C" uint64_t syscall_handler(uint64_t id, uint64_t arg0, uint64_t arg1, uint64_t arg2, uint64_t arg3, uint64_t arg4, uint64_t arg5) {
+    if (id == static_cast<uint64_t>(RISCV_SYSCALL_ID::CLONE) && thread::creates_thread(arg0, arg1)) {
+        // the new thread returns from the syscall_impl call like the calling one, above this frame are arg5, the
+        // alignment padding and the EntryFrame syscall_impl pushed
+        const auto *entry_frame = reinterpret_cast<const thread::EntryFrame *>(static_cast<const uint8_t *>(__builtin_frame_address(0)) + 32);
+        return thread::clone_translated(arg0, arg1, arg2, arg3, arg4, entry_frame);
+    }
+
+    if (!stats::enabled()) {
+        return dispatch_syscall(id, arg0, arg1, arg2, arg3, arg4, arg5);
+    }
+
+    const uint64_t start = __rdtsc();
+    const uint64_t result = dispatch_syscall(id, arg0, arg1, arg2, arg3, arg4, arg5);
+    stats::record_syscall(id, __rdtsc() - start);
+    return result;
+}
+
 extern "C" [[noreturn]] void panic(const char *err_msg) {
     puts("PANIC: ");
     // in theory string length is known so maybe give it as an arg?
@@ -217,6 +263,7 @@ void resolve_dynamic_rounding(uint32_t dyn_rm) {
     // clear rounding mode and set correctly
     status = (status & 0xFF'FF'1F'FF) | interpreter::evaluate_rounding_mode(dyn_rm, false);
     _mm_setcsr(status);
+    stats::count(stats_rounding_switches);
 }
 
 /**
@@ -235,6 +282,10 @@ extern "C" uint8_t *copy_stack(uint8_t *stack, uint8_t *out_stack) {
         }
     }
 
+    if (thread::multithreaded) {
+        thread::init_main_thread();
+    }
+
     /*
      * stack looks like this:
      * *data*
@@ -262,6 +313,13 @@ extern "C" uint8_t *copy_stack(uint8_t *stack, uint8_t *out_stack) {
     auto *orig_out_stack = out_stack;
     // copy all env strs first, then all arg strs
     for (const auto *cur_env = reinterpret_cast<char **>(auxv) - 2; cur_env >= envp; --cur_env) {
+        // the strings on the x86 stack stay valid, so the paths aren't copied
+        if (const auto *path = env_value(*cur_env, IJUMP_HINTS_ENV)) {
+            interpreter::ijump_hints_path = path;
+        } else if (const auto *path = env_value(*cur_env, STATS_ENV)) {
+            stats::output_path = path;
+        }
+
         const auto len = strlen(*cur_env) + 1;
         out_stack -= (len + 7) & ~7; // align to 8 byte
         memcpy(out_stack, *cur_env, len);
@@ -427,87 +485,21 @@ void print_hex64(uint64_t byte) {
     write_stderr(str, 2 + 16);
 }
 
-/* Hashing helpers for ijump target resolution */
-struct Hashes {
-    uint64_t h0, h1, h2;
-};
-
-// taken from https://www.burtleburtle.net/bob/c/SpookyV2.h
-inline uint64_t rot_64(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
-
-// taken from https://www.burtleburtle.net/bob/c/SpookyV2.h
-extern "C" Hashes spookey_hash(uint64_t key) {
-    // "random" seeds
-    uint64_t h0 = 42;
-    uint64_t h1 = 0xbeef;
-
-    // "sc_const" = 0xdeadbeefdeadbeef
-    uint64_t h2 = 0xdeadbeefdeadbeef;
-    uint64_t h3 = 0xdeadbeefdeadbeef + key;
-
-    h2 += ((uint64_t)8) << 56;
-
-    // inlined ShortEnd from https://www.burtleburtle.net/bob/c/SpookyV2.h
-    h3 ^= h2;
-    h2 = rot_64(h2, 15);
-    h3 += h2;
-    h0 ^= h3;
-    h3 = rot_64(h3, 52);
-    h0 += h3;
-    h1 ^= h0;
-    h0 = rot_64(h0, 26);
-    h1 += h0;
-    h2 ^= h1;
-    h1 = rot_64(h1, 51);
-    h2 += h1;
-    h3 ^= h2;
-    h2 = rot_64(h2, 28);
-    h3 += h2;
-    h0 ^= h3;
-    h3 = rot_64(h3, 9);
-    h0 += h3;
-    h1 ^= h0;
-    h0 = rot_64(h0, 47);
-    h1 += h0;
-    h2 ^= h1;
-    h1 = rot_64(h1, 54);
-    h2 += h1;
-    h3 ^= h2;
-    h2 = rot_64(h2, 32);
-    h3 += h2;
-    h0 ^= h3;
-    h3 = rot_64(h3, 25);
-    h0 += h3;
-    h1 ^= h0;
-    h0 = rot_64(h0, 63);
-    h1 += h0;
-
-    // apply size constraints
-    h0 %= ijump_hash_bucket_number;
-    h1 %= ijump_hash_table_size;
-    h2 %= ijump_hash_table_size;
-    return {h0, h1, h2};
-}
-
 extern "C" bool ijump_use_hash_table;
 
 extern "C" uint64_t ijump_lookup_table_base;
 
-extern "C" uint64_t ijump_lookup_table[];
-extern "C" uint64_t ijump_lookup_table_end;
+// one pointer to a second level array per guest page, pages without blocks share an array of zeros
+extern "C" const uint64_t *const ijump_lookup_table[];
+extern "C" const uint64_t *const ijump_lookup_table_end;
 
 // returns the target basic block start address for valid input risc-v addresses and return 0x0 otherwise.
 size_t calc_target(uint64_t addr) {
     if (ijump_use_hash_table) {
-        // required, because we otherwise divide by zero for calculating hashes (happens in interpreter-only runs)
-        if (ijump_hash_table_size <= 1) {
-            return 0x0;
-        }
-
-        const Hashes hashes = spookey_hash(addr);
-        const size_t idx = ijump_hash_function_idxs[hashes.h0];
-        const size_t hash_table_idx = ((hashes.h1 + ((idx / ijump_hash_table_size) * hashes.h2) + (idx % ijump_hash_table_size)) % ijump_hash_table_size);
-        const struct HashTableTuple result_tuple = ijump_hash_table[hash_table_idx];
+        using namespace generator::x86_64::ijump_hash;
+        const uint64_t hash = mix(addr, ijump_hash_seed);
+        const uint32_t displacement = ijump_hash_displacements[bucket(hash, ijump_hash_bucket_bits)];
+        const struct HashTableTuple result_tuple = ijump_hash_table[slot(hash, displacement, ijump_hash_partition_bits, ijump_hash_slot_bits)];
 
         if (result_tuple.addr == addr) {
             return result_tuple.target;
@@ -518,13 +510,38 @@ size_t calc_target(uint64_t addr) {
             return 0x0;
         }
 
-        uint64_t index = (addr - ijump_lookup_table_base) / 2;
+        const uint64_t offset = addr - ijump_lookup_table_base;
+        const uint64_t page = offset / IJUMP_LOOKUP_PAGE_SIZE;
 
-        if (index >= static_cast<uint64_t>(&ijump_lookup_table_end - ijump_lookup_table) / sizeof(uint64_t)) {
+        if (page >= static_cast<uint64_t>(&ijump_lookup_table_end - ijump_lookup_table)) {
             return 0x0;
         }
 
-        return ijump_lookup_table[index];
+        return ijump_lookup_table[page][(offset % IJUMP_LOOKUP_PAGE_SIZE) / 2];
+    }
+}
+
+// a site which missed this often jumps between too many targets to be cached
+constexpr uint64_t IJUMP_CACHE_MAX_MISSES = 64;
+
+// resolves addr on a miss of a site's inline cache and puts it in front of the cache, returns 0 if it's unresolved
+extern "C" uint64_t ijump_cache_update(uint64_t addr, IJumpCache *cache) {
+    const auto target = calc_target(addr);
+    stats::count(stats_ijump_lookups);
+    if (target == 0) {
+        stats::count(stats_ijump_lookup_misses);
+        return 0;
+    }
+
+    if (++cache->misses > IJUMP_CACHE_MAX_MISSES) {
+        cache->miss_target = cache->lookup_target;
+        return target;
+    }
+
+    for (size_t i = IJUMP_CACHE_ENTRIES - 1; i > 0; --i) {
+        cache->entries[i] = cache->entries[i - 1];
     }
+    cache->entries[0] = {addr, target};
+    return target;
 }
 } // namespace helper
@@ -1,11 +1,16 @@
 #include "frvdec.h"
 #include "generator/syscall_ids.h"
 #include "generator/x86_64/helper/helper.h"
+#include "generator/x86_64/helper/interpreter.h"
 #include "generator/x86_64/helper/rv64_syscalls.h"
+#include "generator/x86_64/helper/stats.h"
+#include "generator/x86_64/helper/thread.h"
 
 #include <cstddef>
 #include <cstdint>
+#include <fcntl.h>
 #include <immintrin.h>
+#include <signal.h>
 
 namespace helper::interpreter {
 
@@ -25,12 +30,18 @@ typedef union converter {
 /* tims unresolved_ijump_handler has been entered */
 volatile uint64_t perf_enter_count = 0;
 
-/* number of instruction decoded by the interpreter */
+/* number of instruction executed by the interpreter */
 volatile uint64_t perf_instr_count = 0;
 
-/* number of bytes decoded by the interpreter */
+/* number of bytes executed by the interpreter */
 volatile uint64_t perf_instr_byte_count = 0;
 
+/* number of basic blocks decoded into the block cache */
+volatile uint64_t perf_block_decode_count = 0;
+
+/* number of basic blocks compiled by the jit */
+volatile uint64_t perf_block_compile_count = 0;
+
 uint8_t cur_rounding_mode = 0;
 
 void interpreter_dump_perf_stats() {
@@ -40,20 +51,92 @@ void interpreter_dump_perf_stats() {
     print_hex64(perf_instr_count);
     puts("\nperf_instr_byte_count: ");
     print_hex64(perf_instr_byte_count);
+    puts("\nperf_block_decode_count: ");
+    print_hex64(perf_block_decode_count);
+    puts("\nperf_block_compile_count: ");
+    print_hex64(perf_block_compile_count);
     puts("\n");
 }
 
+const char *ijump_hints_path = nullptr;
+
+EntryStats entry_stats[1 << ENTRY_STATS_BITS];
+
+constexpr inline size_t ENTRY_STATS_MAX_PROBES = 16;
+
+EntryStats *record_entry(const uint64_t pc) {
+    size_t idx = ((pc >> 1) * 0x9e3779b97f4a7c15) >> (64 - ENTRY_STATS_BITS);
+    for (size_t probe = 0; probe < ENTRY_STATS_MAX_PROBES; ++probe, idx = (idx + 1) & ((1 << ENTRY_STATS_BITS) - 1)) {
+        if (entry_stats[idx].addr == pc || entry_stats[idx].addr == 0) {
+            entry_stats[idx].addr = pc;
+            entry_stats[idx].count++;
+            return &entry_stats[idx];
+        }
+    }
+    return nullptr;
+}
+
+/* Appends "<address> <count>" in hex for every recorded address, so the file collects the targets of multiple runs.
+ * It is read by the translator with --ijump-hints.
+ */
+void interpreter_write_ijump_hints() {
+    if (ijump_hints_path == nullptr) {
+        return;
+    }
+
+    const auto fd = static_cast<int64_t>(syscall4(AMD64_SYSCALL_ID::OPENAT, static_cast<size_t>(AT_FDCWD), reinterpret_cast<size_t>(ijump_hints_path), O_WRONLY | O_CREAT | O_APPEND, 0644));
+    // only written once if multiple threads exit
+    ijump_hints_path = nullptr;
+    if (fd < 0) {
+        puts("WARNING: the ijump hints file could not be opened\n");
+        return;
+    }
+
+    constexpr size_t LINE_LEN = 16 + 1 + 16 + 1;
+    char buf[LINE_LEN * 128];
+    size_t buf_len = 0;
+    for (const auto &hint : entry_stats) {
+        if (hint.addr == 0) {
+            continue;
+        }
+
+        char *line = buf + buf_len;
+        utoa(hint.addr, line, 16, 16);
+        line[16] = ' ';
+        utoa(hint.count, line + 17, 16, 16);
+        line[LINE_LEN - 1] = '\n';
+        buf_len += LINE_LEN;
+        if (buf_len == sizeof(buf)) {
+            syscall3(AMD64_SYSCALL_ID::WRITE, fd, reinterpret_cast<size_t>(buf), buf_len);
+            buf_len = 0;
+        }
+    }
+    if (buf_len != 0) {
+        syscall3(AMD64_SYSCALL_ID::WRITE, fd, reinterpret_cast<size_t>(buf), buf_len);
+    }
+    syscall1(AMD64_SYSCALL_ID::CLOSE, fd);
+}
+
 /* for debugging, generates a massive amount of output */
 #define TRACE false
 
+/* the translated code of other threads runs while one interprets, with them the memory is only changed with a cas */
 #define AMO_OP(ptr_type, type) \
     { \
         ptr_type *ptr = reinterpret_cast<ptr_type *>(register_file[instr.rs1]); \
         type rs2_val = static_cast<type>(register_file[instr.rs2]); \
+        ptr_type old_val; \
+        if (thread::multithreaded) { \
+            old_val = __atomic_load_n(ptr, __ATOMIC_RELAXED); \
+            while (!__atomic_compare_exchange_n(ptr, &old_val, static_cast<ptr_type>(operation(static_cast<type>(old_val), rs2_val)), false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) { \
+            } \
+        } else { \
+            old_val = *ptr; \
+            *ptr = static_cast<ptr_type>(operation(static_cast<type>(old_val), rs2_val)); \
+        } \
         if (instr.rd != 0) { \
-            register_file[instr.rd] = sign_extend_int64_t(*ptr); \
+            register_file[instr.rd] = static_cast<int64_t>(old_val); \
         } \
-        *ptr = operation(static_cast<type>(register_file[instr.rd]), rs2_val); \
         break; \
     }
 
@@ -70,6 +153,18 @@ void interpreter_dump_perf_stats() {
         break; \
     }
 
+/* comparisons of the F and D extension, the result is written to an integer register */
+#define FP_COMPARE(bits_field, float_field, operation) \
+    { \
+        if (instr.rd != 0) { \
+            converter conv1, conv2; \
+            conv1.bits_field = register_file[instr.rs1 + START_FP_STATICS]; \
+            conv2.bits_field = register_file[instr.rs2 + START_FP_STATICS]; \
+            register_file[instr.rd] = (conv1.float_field operation conv2.float_field) ? 1 : 0; \
+        } \
+        break; \
+    }
+
 #define FP_THREE_OP_FLOAT() \
     { \
         set_rounding_mode(instr.misc); \
@@ -122,9 +217,6 @@ void interpreter_dump_perf_stats() {
         register_file[instr.rd + (fp_dest_reg ? START_FP_STATICS : 0)] = conv3.d64; \
     }
 
-/* from compiled code */
-extern "C" uint64_t register_file[32 + 1 + 32 + 1]; /* size is the maximum register_file size when compiled with floating point support */
-
 void trace(uint64_t addr, const FrvInst *instr) {
     puts("TRACE: ");
     print_hex64(addr);
@@ -139,6 +231,17 @@ void trace(uint64_t addr, const FrvInst *instr) {
 /* make the code a bit clearer */
 constexpr uint64_t sign_extend_int64_t(int32_t v) { return static_cast<int64_t>(v); }
 
+/* A store conditional succeeds if the memory still holds the value the last load reserved of the thread loaded, like in
+ * the translated code. Without other threads it always succeeds. Returns the value of rd, 0 on success. */
+template <typename T> uint64_t store_conditional(T *ptr, const T val) {
+    if (!thread::multithreaded) {
+        *ptr = val;
+        return 0;
+    }
+    auto expected = static_cast<T>(thread::current()->reservation);
+    return __atomic_compare_exchange_n(ptr, &expected, val, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED) ? 0 : 1;
+}
+
 size_t evaluate_csr_index(uint32_t csr_id) {
     switch (csr_id) {
     case 1:
@@ -172,7 +275,7 @@ uint32_t evaluate_rounding_mode(uint32_t riscv_rounding_mode, const bool is_rm_f
     case 7:
         // dynamic rounding mode
         if (is_rm_field) {
-            uint32_t fcsr = static_cast<uint32_t>(register_file[FCSR_IDX]);
+            uint32_t fcsr = static_cast<uint32_t>(thread::current_register_file()[FCSR_IDX]);
             // extract rounding mode of fcsr (bits 5-7)
             uint32_t rounding_mode = (fcsr >> 5) & 0x7;
             return evaluate_rounding_mode(rounding_mode, false);
@@ -194,10 +297,12 @@ void set_rounding_mode(uint8_t rm) {
         status = (status & 0xFF'FF'1F'FF) | evaluate_rounding_mode(rm, true);
         _mm_setcsr(status);
         cur_rounding_mode = rm;
+        stats::count(stats_rounding_switches);
     }
 }
 
 void trace_dump_state(uint64_t pc) {
+    const uint64_t *const register_file = thread::current_register_file();
     puts("TRACE: STATE");
 
     puts("\npc:  ");
@@ -336,7 +441,111 @@ void trace_dump_state(uint64_t pc) {
     puts("\n");
 }
 
+/* Instructions which can't be decoded or aren't supported raise SIGILL like on RISC-V Linux, the guest can't install
+ * handlers for it so the process is terminated. */
+[[noreturn]] void illegal_instruction(const uint64_t pc) {
+    puts("Illegal instruction at ");
+    print_hex64(pc);
+    puts("\n");
+    trace_dump_state(pc);
+    syscall2(AMD64_SYSCALL_ID::KILL, syscall0(AMD64_SYSCALL_ID::GETPID), SIGILL);
+    panic("Illegal instruction");
+}
+
+constexpr inline size_t MAX_BLOCK_INSTRS = 64;
+constexpr inline size_t BLOCK_CACHE_BLOCKS = 1 << 14;
+constexpr inline size_t BLOCK_CACHE_INSTRS = 1 << 16;
+constexpr inline size_t BLOCK_TABLE_SIZE = 1 << 14;
+
+DecodedBlock block_arena[BLOCK_CACHE_BLOCKS];
+DecodedInstr instr_arena[BLOCK_CACHE_INSTRS];
+DecodedBlock *block_table[BLOCK_TABLE_SIZE];
+size_t block_arena_used = 0;
+size_t instr_arena_used = 0;
+uint64_t block_cache_generation = 1;
+
+/* blocks end at control flow instructions and syscalls, so nothing is decoded which is never executed */
+bool ends_block(const FrvInst &instr) {
+    switch (instr.mnem) {
+    case FRV_JAL:
+    case FRV_JALR:
+    case FRV_BEQ:
+    case FRV_BNE:
+    case FRV_BLT:
+    case FRV_BLTU:
+    case FRV_BGE:
+    case FRV_BGEU:
+    case FRV_ECALL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+DecodedBlock *decode_block(uint64_t pc) {
+    if (block_arena_used == BLOCK_CACHE_BLOCKS || instr_arena_used + MAX_BLOCK_INSTRS > BLOCK_CACHE_INSTRS) {
+        block_arena_used = 0;
+        instr_arena_used = 0;
+        block_cache_generation++;
+        jit::reset();
+    }
+
+    DecodedBlock *block = &block_arena[block_arena_used++];
+    block->pc = pc;
+    block->translated = calc_target(pc);
+    block->generation = block_cache_generation;
+    block->successors[0] = nullptr;
+    block->successors[1] = nullptr;
+    block->instrs = &instr_arena[instr_arena_used];
+    block->exec_count = 0;
+    block->compiled = nullptr;
+
+    uint32_t count = 0;
+    uint64_t end_pc = pc;
+    while (block->translated == 0 && count < MAX_BLOCK_INSTRS) {
+        DecodedInstr &decoded = block->instrs[count++];
+        decoded.len = frv_decode(0x1000, reinterpret_cast<const uint8_t *>(end_pc), FRV_RV64, &decoded.instr);
+        decoded.handler = nullptr;
+        // undecodable instructions only panic when they are executed
+        if (decoded.len < 0) {
+            break;
+        }
+        end_pc += decoded.len;
+        if (ends_block(decoded.instr)) {
+            break;
+        }
+    }
+    block->end_pc = end_pc;
+    block->instr_count = count;
+    instr_arena_used += count;
+
+    perf_block_decode_count++;
+    return block;
+}
+
+DecodedBlock *find_block(uint64_t pc) {
+    DecodedBlock *&entry = block_table[(pc >> 1) & (BLOCK_TABLE_SIZE - 1)];
+    if (entry == nullptr || entry->generation != block_cache_generation || entry->pc != pc) {
+        entry = decode_block(pc);
+    }
+    return entry;
+}
+
+// the interpreter records the labels of its handlers in the decoded instructions
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+
+/* A case of the instruction switch. The switch is only entered when a decoded instruction is executed the first time,
+ * it stores the label of the handler in the instruction so later executions jump there directly. */
+#define INSTR(mnem) \
+    case mnem: \
+        decoded->handler = &&op_##mnem; \
+        op_##mnem
+
 /**
+ * Interprets from pc on until a control flow instruction reaches an address with translated code.
+ * Instructions are decoded once into the block cache and dispatched through the labels of their handlers.
+ *
  * @param pc unresolved jump target address
  */
 extern "C" uint64_t unresolved_ijump_handler(uint64_t pc) {
@@ -347,1146 +556,1170 @@ extern "C" uint64_t unresolved_ijump_handler(uint64_t pc) {
     trace_dump_state(pc);
 #endif
 
+    // the block cache, the compiled blocks and the statistics are shared by all threads
+    thread::lock_interpreter();
+    uint64_t *const register_file = thread::current_register_file();
+
     perf_enter_count++;
+    EntryStats *entry = nullptr;
+    if (ijump_hints_path != nullptr || stats::enabled()) {
+        entry = record_entry(pc);
+    }
+    // guest instructions run in this call, including the ones of compiled blocks
+    uint64_t instr_count = 0;
     uint32_t status = _mm_getcsr();
     // clear rounding mode
     status = (status & 0xFF'FF'1F'FF);
     _mm_setcsr(status);
     cur_rounding_mode = 0;
-    uint64_t return_addr;
 
-    bool is_cfop;
-    do {
+    DecodedBlock *block = find_block(pc);
+    while (block->translated == 0) {
         bool jump = false;
-        is_cfop = false;
-        FrvInst instr;
-        const int r = frv_decode(0x1000, reinterpret_cast<const uint8_t *>(pc), FRV_RV64, &instr);
-
-        if (r == FRV_UNDEF) {
-            trace_dump_state(pc);
-            panic("Unable to decode instruction");
-        } else if (r == FRV_PARTIAL) {
-            trace_dump_state(pc);
-            panic("partial instruction");
-        } else if (r < 0) {
-            trace_dump_state(pc);
-            panic("undefined");
+        // another thread started a new generation of the block cache while this one was in a syscall
+        bool cache_dropped = false;
+        if (block->compiled == nullptr && ++block->exec_count == jit::HOT_BLOCK_THRESHOLD) {
+            block->compiled = jit::compile_block(*block);
+            perf_block_compile_count += (block->compiled != nullptr);
         }
 
-#if TRACE
-        trace(pc, &instr);
-        //    trace_dump_state(pc);
-#endif
-
-        perf_instr_count++;
-        perf_instr_byte_count += r;
-
-        // TODO: we might be able to ignore everything with rd=0 as either HINT or NOP instructions
-        switch (instr.mnem) {
-        /* 2.4 Integer Computational Instructions */
-        case FRV_ADDI:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] + sign_extend_int64_t(instr.imm);
-            }
-            break;
-        case FRV_ADDIW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) + instr.imm);
-            }
-            break;
-        case FRV_ADD:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] + register_file[instr.rs2];
-            }
-            break;
-        case FRV_ADDW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) + static_cast<int32_t>(register_file[instr.rs2]));
-            }
-            break;
-        case FRV_SUB:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] - register_file[instr.rs2];
-            }
-            break;
-        case FRV_SUBW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) - static_cast<int32_t>(register_file[instr.rs2]));
-            }
-            break;
-
-        case FRV_SLTI:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = static_cast<int64_t>(register_file[instr.rs1]) < static_cast<int64_t>(instr.imm);
-            }
-            break;
-        case FRV_SLTIU:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] < static_cast<uint64_t>(sign_extend_int64_t(instr.imm));
-            }
-            break;
-        case FRV_SLT:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = static_cast<int64_t>(register_file[instr.rs1]) < static_cast<int64_t>(register_file[instr.rs2]);
-            }
-            break;
-        case FRV_SLTU:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] < register_file[instr.rs2];
-            }
-            break;
-
-        case FRV_ANDI:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] & sign_extend_int64_t(instr.imm);
-            }
-            break;
-        case FRV_ORI:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] | sign_extend_int64_t(instr.imm);
-            }
-            break;
-        case FRV_XORI:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] ^ sign_extend_int64_t(instr.imm);
-            }
-            break;
-        case FRV_AND:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] & register_file[instr.rs2];
-            }
-            break;
-        case FRV_OR:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] | register_file[instr.rs2];
-            }
-            break;
-        case FRV_XOR:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] ^ register_file[instr.rs2];
-            }
-            break;
-
-        case FRV_SLLI:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] << instr.imm;
-            }
-            break;
-        case FRV_SRLI:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] >> instr.imm;
-            }
-            break;
-        case FRV_SRAI:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = static_cast<int64_t>(register_file[instr.rs1]) >> instr.imm;
-            }
-            break;
-        case FRV_SLLIW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(static_cast<uint32_t>(register_file[instr.rs1]) << instr.imm));
-            }
-            break;
-        case FRV_SRLIW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(static_cast<uint32_t>(register_file[instr.rs1]) >> instr.imm));
-            }
-            break;
-        case FRV_SRAIW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) >> instr.imm);
-            }
-            break;
-        case FRV_SLL:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] << (register_file[instr.rs2] & 0x3F);
-            }
-            break;
-        case FRV_SRL:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] >> (register_file[instr.rs2] & 0x3F);
-            }
-            break;
-        case FRV_SRA:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = static_cast<int64_t>(register_file[instr.rs1]) >> (register_file[instr.rs2] & 0x3F);
-            }
-            break;
-        case FRV_SLLW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(static_cast<uint32_t>(register_file[instr.rs1]) << (register_file[instr.rs2] & 0x1F)));
-            }
-            break;
-        case FRV_SRLW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(static_cast<uint32_t>(register_file[instr.rs1]) >> (register_file[instr.rs2] & 0x1F)));
-            }
-            break;
-        case FRV_SRAW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) >> (register_file[instr.rs2] & 0x1F));
-            }
-            break;
+        // compiled blocks leave nothing to interpret
+        uint32_t interpreted_count = block->instr_count;
+        instr_count += block->instr_count;
+        if (block->compiled != nullptr) {
+            pc = block->compiled(register_file);
+            jump = (pc != block->end_pc);
+            interpreted_count = 0;
+        }
 
-        case FRV_LUI:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(instr.imm);
-            }
-            break;
-        case FRV_AUIPC:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = pc + sign_extend_int64_t(instr.imm);
-            }
-            break;
+        for (DecodedInstr *decoded = block->instrs; decoded != block->instrs + interpreted_count; ++decoded) {
+            const FrvInst instr = decoded->instr;
+            const int r = decoded->len;
 
-            /* 2.5 Control Transfer Instructions */
+#if TRACE
+            trace(pc, &instr);
+            //    trace_dump_state(pc);
+#endif
 
-        case FRV_JAL:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = pc + r;
-            }
-            pc += static_cast<int64_t>(instr.imm);
-            jump = true;
-            is_cfop = true;
-            break;
-        case FRV_JALR: {
-            uint64_t jmp_addr = (register_file[instr.rs1] + static_cast<int64_t>(instr.imm)) & 0xFFFF'FFFF'FFFF'FFFE;
-            if (instr.rd != 0) {
-                register_file[instr.rd] = pc + r;
-            }
-            pc = jmp_addr;
-            jump = true;
-            is_cfop = true;
-            break;
-        }
-        case FRV_BEQ:
-            if (register_file[instr.rs1] == register_file[instr.rs2]) {
-                pc += static_cast<int64_t>(instr.imm);
-                jump = true;
-            }
-            is_cfop = true;
-            break;
-        case FRV_BNE:
-            if (register_file[instr.rs1] != register_file[instr.rs2]) {
-                pc += static_cast<int64_t>(instr.imm);
-                jump = true;
-            }
-            is_cfop = true;
-            break;
-        case FRV_BLT:
-            if (static_cast<int64_t>(register_file[instr.rs1]) < static_cast<int64_t>(register_file[instr.rs2])) {
-                pc += static_cast<int64_t>(instr.imm);
-                jump = true;
-            }
-            is_cfop = true;
-            break;
-        case FRV_BLTU:
-            if (register_file[instr.rs1] < register_file[instr.rs2]) {
+            perf_instr_count++;
+            perf_instr_byte_count += r;
+
+            if (decoded->handler != nullptr) {
+                goto *decoded->handler;
+            }
+
+            if (r < 0) {
+                illegal_instruction(pc);
+            }
+
+            // TODO: we might be able to ignore everything with rd=0 as either HINT or NOP instructions
+            switch (instr.mnem) {
+            /* 2.4 Integer Computational Instructions */
+            INSTR(FRV_ADDI):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] + sign_extend_int64_t(instr.imm);
+                }
+                break;
+            INSTR(FRV_ADDIW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) + instr.imm);
+                }
+                break;
+            INSTR(FRV_ADD):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] + register_file[instr.rs2];
+                }
+                break;
+            INSTR(FRV_ADDW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) + static_cast<int32_t>(register_file[instr.rs2]));
+                }
+                break;
+            INSTR(FRV_SUB):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] - register_file[instr.rs2];
+                }
+                break;
+            INSTR(FRV_SUBW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) - static_cast<int32_t>(register_file[instr.rs2]));
+                }
+                break;
+
+            INSTR(FRV_SLTI):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = static_cast<int64_t>(register_file[instr.rs1]) < static_cast<int64_t>(instr.imm);
+                }
+                break;
+            INSTR(FRV_SLTIU):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] < static_cast<uint64_t>(sign_extend_int64_t(instr.imm));
+                }
+                break;
+            INSTR(FRV_SLT):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = static_cast<int64_t>(register_file[instr.rs1]) < static_cast<int64_t>(register_file[instr.rs2]);
+                }
+                break;
+            INSTR(FRV_SLTU):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] < register_file[instr.rs2];
+                }
+                break;
+
+            INSTR(FRV_ANDI):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] & sign_extend_int64_t(instr.imm);
+                }
+                break;
+            INSTR(FRV_ORI):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] | sign_extend_int64_t(instr.imm);
+                }
+                break;
+            INSTR(FRV_XORI):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] ^ sign_extend_int64_t(instr.imm);
+                }
+                break;
+            INSTR(FRV_AND):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] & register_file[instr.rs2];
+                }
+                break;
+            INSTR(FRV_OR):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] | register_file[instr.rs2];
+                }
+                break;
+            INSTR(FRV_XOR):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] ^ register_file[instr.rs2];
+                }
+                break;
+
+            INSTR(FRV_SLLI):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] << instr.imm;
+                }
+                break;
+            INSTR(FRV_SRLI):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] >> instr.imm;
+                }
+                break;
+            INSTR(FRV_SRAI):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = static_cast<int64_t>(register_file[instr.rs1]) >> instr.imm;
+                }
+                break;
+            INSTR(FRV_SLLIW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(static_cast<uint32_t>(register_file[instr.rs1]) << instr.imm));
+                }
+                break;
+            INSTR(FRV_SRLIW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(static_cast<uint32_t>(register_file[instr.rs1]) >> instr.imm));
+                }
+                break;
+            INSTR(FRV_SRAIW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) >> instr.imm);
+                }
+                break;
+            INSTR(FRV_SLL):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] << (register_file[instr.rs2] & 0x3F);
+                }
+                break;
+            INSTR(FRV_SRL):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] >> (register_file[instr.rs2] & 0x3F);
+                }
+                break;
+            INSTR(FRV_SRA):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = static_cast<int64_t>(register_file[instr.rs1]) >> (register_file[instr.rs2] & 0x3F);
+                }
+                break;
+            INSTR(FRV_SLLW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(static_cast<uint32_t>(register_file[instr.rs1]) << (register_file[instr.rs2] & 0x1F)));
+                }
+                break;
+            INSTR(FRV_SRLW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(static_cast<uint32_t>(register_file[instr.rs1]) >> (register_file[instr.rs2] & 0x1F)));
+                }
+                break;
+            INSTR(FRV_SRAW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) >> (register_file[instr.rs2] & 0x1F));
+                }
+                break;
+
+            INSTR(FRV_LUI):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(instr.imm);
+                }
+                break;
+            INSTR(FRV_AUIPC):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = pc + sign_extend_int64_t(instr.imm);
+                }
+                break;
+
+                /* 2.5 Control Transfer Instructions */
+
+            INSTR(FRV_JAL):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = pc + r;
+                }
                 pc += static_cast<int64_t>(instr.imm);
                 jump = true;
-            }
-            is_cfop = true;
-            break;
-        case FRV_BGE:
-            if (static_cast<int64_t>(register_file[instr.rs1]) >= static_cast<int64_t>(register_file[instr.rs2])) {
-                pc += static_cast<int64_t>(instr.imm);
+                break;
+            INSTR(FRV_JALR): {
+                uint64_t jmp_addr = (register_file[instr.rs1] + static_cast<int64_t>(instr.imm)) & 0xFFFF'FFFF'FFFF'FFFE;
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = pc + r;
+                }
+                pc = jmp_addr;
                 jump = true;
-            }
-            is_cfop = true;
-            break;
-        case FRV_BGEU:
-            if (register_file[instr.rs1] >= register_file[instr.rs2]) {
-                pc += static_cast<int64_t>(instr.imm);
-                jump = true;
-            }
-            is_cfop = true;
-            break;
-
-        /* 2.6 Load and Store Instructions */
-        case FRV_SD: {
-            uint64_t *ptr = reinterpret_cast<uint64_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-            *ptr = register_file[instr.rs2];
-            break;
-        }
-        case FRV_SW: {
-            uint32_t *ptr = reinterpret_cast<uint32_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-            *ptr = static_cast<uint32_t>(register_file[instr.rs2]);
-            break;
-        }
-        case FRV_SH: {
-            uint16_t *ptr = reinterpret_cast<uint16_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-            *ptr = static_cast<uint16_t>(register_file[instr.rs2]);
-            break;
-        }
-        case FRV_SB: {
-            uint8_t *ptr = reinterpret_cast<uint8_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-            *ptr = static_cast<uint8_t>(register_file[instr.rs2]);
-            break;
-        }
-
-        case FRV_LD:
-            if (instr.rd != 0) {
+                break;
+            }
+            INSTR(FRV_BEQ):
+                if (register_file[instr.rs1] == register_file[instr.rs2]) {
+                    pc += static_cast<int64_t>(instr.imm);
+                    jump = true;
+                }
+                break;
+            INSTR(FRV_BNE):
+                if (register_file[instr.rs1] != register_file[instr.rs2]) {
+                    pc += static_cast<int64_t>(instr.imm);
+                    jump = true;
+                }
+                break;
+            INSTR(FRV_BLT):
+                if (static_cast<int64_t>(register_file[instr.rs1]) < static_cast<int64_t>(register_file[instr.rs2])) {
+                    pc += static_cast<int64_t>(instr.imm);
+                    jump = true;
+                }
+                break;
+            INSTR(FRV_BLTU):
+                if (register_file[instr.rs1] < register_file[instr.rs2]) {
+                    pc += static_cast<int64_t>(instr.imm);
+                    jump = true;
+                }
+                break;
+            INSTR(FRV_BGE):
+                if (static_cast<int64_t>(register_file[instr.rs1]) >= static_cast<int64_t>(register_file[instr.rs2])) {
+                    pc += static_cast<int64_t>(instr.imm);
+                    jump = true;
+                }
+                break;
+            INSTR(FRV_BGEU):
+                if (register_file[instr.rs1] >= register_file[instr.rs2]) {
+                    pc += static_cast<int64_t>(instr.imm);
+                    jump = true;
+                }
+                break;
+
+            /* 2.6 Load and Store Instructions */
+            INSTR(FRV_SD): {
                 uint64_t *ptr = reinterpret_cast<uint64_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-                register_file[instr.rd] = *ptr;
-            }
-            break;
-        case FRV_LW:
-            if (instr.rd != 0) {
-                int32_t *ptr = reinterpret_cast<int32_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-                register_file[instr.rd] = static_cast<int64_t>(*ptr);
+                *ptr = register_file[instr.rs2];
+                break;
             }
-            break;
-        case FRV_LWU:
-            if (instr.rd != 0) {
+            INSTR(FRV_SW): {
                 uint32_t *ptr = reinterpret_cast<uint32_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-                register_file[instr.rd] = static_cast<uint64_t>(*ptr);
-            }
-            break;
-        case FRV_LH:
-            if (instr.rd != 0) {
-                int16_t *ptr = reinterpret_cast<int16_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-                register_file[instr.rd] = static_cast<int64_t>(*ptr);
+                *ptr = static_cast<uint32_t>(register_file[instr.rs2]);
+                break;
             }
-            break;
-        case FRV_LHU:
-            if (instr.rd != 0) {
+            INSTR(FRV_SH): {
                 uint16_t *ptr = reinterpret_cast<uint16_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-                register_file[instr.rd] = static_cast<uint64_t>(*ptr);
-            }
-            break;
-        case FRV_LB:
-            if (instr.rd != 0) {
-                int8_t *ptr = reinterpret_cast<int8_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-                register_file[instr.rd] = static_cast<int64_t>(*ptr);
+                *ptr = static_cast<uint16_t>(register_file[instr.rs2]);
+                break;
             }
-            break;
-        case FRV_LBU:
-            if (instr.rd != 0) {
+            INSTR(FRV_SB): {
                 uint8_t *ptr = reinterpret_cast<uint8_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-                register_file[instr.rd] = static_cast<uint64_t>(*ptr);
-            }
-            break;
-
-        /* 2.7 Memory Ordering Instructions */
-        case FRV_FENCE:
-            [[fallthrough]];
-        case FRV_FENCEI:
-            // ignore
-            break;
-
-        /* 2.8 Environment Call and Breakpoints */
-        case FRV_ECALL:
-            register_file[10] = syscall_impl(register_file[17], register_file[10], register_file[11], register_file[12], register_file[13], register_file[14], register_file[15]);
-            break;
-
-        /* M extension */
-        case FRV_MUL:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] * register_file[instr.rs2];
-            }
-            break;
-        case FRV_MULW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) * static_cast<int32_t>(register_file[instr.rs2]));
-            }
-            break;
-        case FRV_MULH:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = (static_cast<__int128_t>(static_cast<int64_t>(register_file[instr.rs1])) * static_cast<__int128_t>(static_cast<int64_t>(register_file[instr.rs2]))) >> 64;
-            }
-            break;
-        case FRV_MULHU:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = (static_cast<__uint128_t>(register_file[instr.rs1]) * static_cast<__uint128_t>(register_file[instr.rs2])) >> 64;
-            }
-            break;
-        case FRV_MULHSU:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = (static_cast<__int128_t>(static_cast<int64_t>(register_file[instr.rs1])) * static_cast<__uint128_t>(register_file[instr.rs2])) >> 64;
-            }
-            break;
-
-        case FRV_DIV:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = static_cast<int64_t>(register_file[instr.rs1]) / static_cast<int64_t>(register_file[instr.rs2]);
-            }
-            break;
-        case FRV_DIVU:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] / register_file[instr.rs2];
-            }
-            break;
-        case FRV_DIVW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) / static_cast<int32_t>(register_file[instr.rs2]));
-            }
-            break;
-        case FRV_DIVUW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(static_cast<uint32_t>(register_file[instr.rs1]) / static_cast<uint32_t>(register_file[instr.rs2])));
-            }
-            break;
-        case FRV_REM:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = static_cast<int64_t>(register_file[instr.rs1]) % static_cast<int64_t>(register_file[instr.rs2]);
-            }
-            break;
-        case FRV_REMU:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1] % register_file[instr.rs2];
-            }
-            break;
-        case FRV_REMW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) % static_cast<int32_t>(register_file[instr.rs2]));
-            }
-            break;
-        case FRV_REMUW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(static_cast<uint32_t>(register_file[instr.rs1]) % static_cast<uint32_t>(register_file[instr.rs2])));
-            }
-            break;
-
-        /* A extension */
-        case FRV_LRW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = sign_extend_int64_t(*reinterpret_cast<int32_t *>(register_file[instr.rs1]));
-            }
-            break;
-        case FRV_LRD:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = *reinterpret_cast<int64_t *>(register_file[instr.rs1]);
-            }
-            break;
-        case FRV_SCW:
-            *reinterpret_cast<uint32_t *>(register_file[instr.rs1]) = static_cast<uint32_t>(register_file[instr.rs2]);
-            if (instr.rd != 0) {
-                register_file[instr.rd] = 0;
-            }
-            break;
-        case FRV_SCD:
-            *reinterpret_cast<uint64_t *>(register_file[instr.rs1]) = register_file[instr.rs2];
-            if (instr.rd != 0) {
-                register_file[instr.rd] = 0;
-            }
-            break;
-        case FRV_AMOSWAPW:
-#define operation(val1, val2) val2
-            AMO_OP(int32_t, uint32_t);
-#undef operation
-        case FRV_AMOSWAPD:
-#define operation(val1, val2) val2
-            AMO_OP(int64_t, uint64_t);
-#undef operation
-        case FRV_AMOADDW:
-#define operation(val1, val2) val1 + val2
-            AMO_OP(int32_t, uint32_t);
-#undef operation
-        case FRV_AMOADDD:
-#define operation(val1, val2) val1 + val2
-            AMO_OP(int64_t, uint64_t);
-#undef operation
-        case FRV_AMOANDW:
-#define operation(val1, val2) val1 &val2
-            AMO_OP(int32_t, uint32_t);
-#undef operation
-        case FRV_AMOANDD:
-#define operation(val1, val2) val1 &val2
-            AMO_OP(int64_t, uint64_t);
-#undef operation
-        case FRV_AMOORW:
-#define operation(val1, val2) val1 | val2
-            AMO_OP(int32_t, uint32_t);
-#undef operation
-        case FRV_AMOORD:
-#define operation(val1, val2) val1 | val2
-            AMO_OP(int64_t, uint64_t);
-#undef operation
-        case FRV_AMOXORW:
-#define operation(val1, val2) val1 ^ val2
-            AMO_OP(int32_t, uint32_t);
-#undef operation
-        case FRV_AMOXORD:
-#define operation(val1, val2) val1 ^ val2
-            AMO_OP(int64_t, uint64_t);
-#undef operation
-        case FRV_AMOMAXW:
-#define operation(val1, val2) (val1 > val2) ? val1 : val2
-            AMO_OP(int32_t, int32_t);
-#undef operation
-        case FRV_AMOMAXD:
-#define operation(val1, val2) (val1 > val2) ? val1 : val2
-            AMO_OP(int64_t, int64_t);
-#undef operation
-        case FRV_AMOMAXUW:
-#define operation(val1, val2) (val1 > val2) ? val1 : val2
-            AMO_OP(int32_t, uint32_t);
-#undef operation
-        case FRV_AMOMAXUD:
-#define operation(val1, val2) (val1 > val2) ? val1 : val2
-            AMO_OP(int64_t, uint64_t);
-#undef operation
-        case FRV_AMOMINW:
-#define operation(val1, val2) (val1 < val2) ? val1 : val2
-            AMO_OP(int32_t, int32_t);
-#undef operation
-        case FRV_AMOMIND:
-#define operation(val1, val2) (val1 < val2) ? val1 : val2
-            AMO_OP(int64_t, int64_t);
-#undef operation
-        case FRV_AMOMINUW:
-#define operation(val1, val2) (val1 < val2) ? val1 : val2
-            AMO_OP(int32_t, uint32_t);
-#undef operation
-        case FRV_AMOMINUD:
-#define operation(val1, val2) (val1 < val2) ? val1 : val2
-            AMO_OP(int64_t, uint64_t);
-#undef operation
-
-        /* Ziscr extension */
-        case FRV_CSRRW:
-            CSR_OP(register_file[instr.rs1], =);
-        case FRV_CSRRS:
-            CSR_OP(register_file[instr.rs1], |=);
-        case FRV_CSRRC:
-            CSR_OP(register_file[instr.rs1], &= ~);
-        case FRV_CSRRWI:
-            CSR_OP(instr.rs1, =);
-        case FRV_CSRRSI:
-            CSR_OP(instr.rs1, |=);
-        case FRV_CSRRCI:
-            CSR_OP(instr.rs1, &= ~);
-
-        /* F extension */
-        case FRV_FLW: {
-            uint32_t *ptr = reinterpret_cast<uint32_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-            register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(*ptr);
-            break;
-        }
-        case FRV_FLD:
-            register_file[instr.rd + START_FP_STATICS] = *reinterpret_cast<uint64_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-            break;
-        case FRV_FSW: {
-            uint32_t *ptr = reinterpret_cast<uint32_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-            *ptr = static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]);
-            break;
-        }
-        case FRV_FSD: {
-            uint64_t *ptr = reinterpret_cast<uint64_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
-            *ptr = register_file[instr.rs2 + START_FP_STATICS];
-            break;
-        }
-
-        case FRV_FADDS:
-#define operation(val1, val2) val1 + val2
-            FP_TWO_OP_FLOAT(true);
-#undef operation
-            break;
-        case FRV_FADDD:
-#define operation(val1, val2) val1 + val2
-            FP_TWO_OP_DOUBLE(true);
-#undef operation
-            break;
-        case FRV_FSUBS:
-#define operation(val1, val2) val1 - val2
-            FP_TWO_OP_FLOAT(true);
-#undef operation
-            break;
-        case FRV_FSUBD:
-#define operation(val1, val2) val1 - val2
-            FP_TWO_OP_DOUBLE(true);
-#undef operation
-            break;
-        case FRV_FMULS:
-#define operation(val1, val2) val1 *val2
-            FP_TWO_OP_FLOAT(true);
-#undef operation
-            break;
-        case FRV_FMULD:
-#define operation(val1, val2) val1 *val2
-            FP_TWO_OP_DOUBLE(true);
-#undef operation
-            break;
-        case FRV_FDIVS:
-#define operation(val1, val2) val1 / val2
-            FP_TWO_OP_FLOAT(true);
-#undef operation
-            break;
-        case FRV_FDIVD:
-#define operation(val1, val2) val1 / val2
-            FP_TWO_OP_DOUBLE(true);
-#undef operation
-            break;
-        case FRV_FMINS:
-#define operation(val1, val2) (val1 < val2) ? val1 : val2
-            FP_TWO_OP_FLOAT(true);
-#undef operation
-            break;
-        case FRV_FMIND:
-#define operation(val1, val2) (val1 < val2) ? val1 : val2
-            FP_TWO_OP_DOUBLE(true);
-#undef operation
-            break;
-        case FRV_FMAXS:
-#define operation(val1, val2) (val1 > val2) ? val1 : val2
-            FP_TWO_OP_FLOAT(true);
-#undef operation
-            break;
-        case FRV_FMAXD:
-#define operation(val1, val2) (val1 > val2) ? val1 : val2
-            FP_TWO_OP_DOUBLE(true);
-#undef operation
-            break;
-        case FRV_FSQRTS: {
-            set_rounding_mode(instr.misc);
-            converter conv1, conv2;
-            conv1.d32 = register_file[instr.rs1 + START_FP_STATICS];
-            __asm__ __volatile__("sqrtss %1, %0" : "=x"(conv2.d32) : "x"(conv1.f32));
-            register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(conv2.d32);
-            break;
-        }
-        case FRV_FSQRTD: {
-            set_rounding_mode(instr.misc);
-            converter conv1, conv2;
-            conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
-            __asm__ __volatile__("sqrtsd %1, %0" : "=x"(conv2.f64) : "x"(conv1.f64));
-            register_file[instr.rd + START_FP_STATICS] = conv2.d64;
-            break;
-        }
-
-        case FRV_FMADDS: {
-            set_rounding_mode(instr.misc);
-            converter conv1;
-            converter conv2;
-            converter conv3;
-            conv1.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
-            conv2.d32 = static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]);
-            conv3.d32 = static_cast<uint32_t>(register_file[instr.rs3 + START_FP_STATICS]);
-            if (have_fma) {
-                __asm__ __volatile__("vfmadd213ss %2, %1, %0" : "+x"(conv1.f32) : "x"(conv2.f32), "x"(conv3.f32));
-            } else {
-                conv1.f32 = conv1.f32 * conv2.f32 + conv3.f32;
+                *ptr = static_cast<uint8_t>(register_file[instr.rs2]);
+                break;
+            }
+
+            INSTR(FRV_LD):
+                if (instr.rd != 0) {
+                    uint64_t *ptr = reinterpret_cast<uint64_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
+                    register_file[instr.rd] = *ptr;
+                }
+                break;
+            INSTR(FRV_LW):
+                if (instr.rd != 0) {
+                    int32_t *ptr = reinterpret_cast<int32_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
+                    register_file[instr.rd] = static_cast<int64_t>(*ptr);
+                }
+                break;
+            INSTR(FRV_LWU):
+                if (instr.rd != 0) {
+                    uint32_t *ptr = reinterpret_cast<uint32_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
+                    register_file[instr.rd] = static_cast<uint64_t>(*ptr);
+                }
+                break;
+            INSTR(FRV_LH):
+                if (instr.rd != 0) {
+                    int16_t *ptr = reinterpret_cast<int16_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
+                    register_file[instr.rd] = static_cast<int64_t>(*ptr);
+                }
+                break;
+            INSTR(FRV_LHU):
+                if (instr.rd != 0) {
+                    uint16_t *ptr = reinterpret_cast<uint16_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
+                    register_file[instr.rd] = static_cast<uint64_t>(*ptr);
+                }
+                break;
+            INSTR(FRV_LB):
+                if (instr.rd != 0) {
+                    int8_t *ptr = reinterpret_cast<int8_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
+                    register_file[instr.rd] = static_cast<int64_t>(*ptr);
+                }
+                break;
+            INSTR(FRV_LBU):
+                if (instr.rd != 0) {
+                    uint8_t *ptr = reinterpret_cast<uint8_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
+                    register_file[instr.rd] = static_cast<uint64_t>(*ptr);
+                }
+                break;
+
+            /* 2.7 Memory Ordering Instructions */
+            INSTR(FRV_FENCE):
+                // a single thread can't observe the order of its own memory accesses
+                if (thread::multithreaded && fence_needs_barrier(instr.imm)) {
+                    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                }
+                break;
+            INSTR(FRV_FENCEI):
+                // ignore
+                break;
+
+            /* 2.8 Environment Call and Breakpoints */
+            INSTR(FRV_ECALL): {
+                // other threads can interpret while this one blocks in the syscall
+                const uint8_t rounding_mode = cur_rounding_mode;
+                const uint64_t generation = block_cache_generation;
+                thread::unlock_interpreter();
+                if (register_file[17] == static_cast<uint64_t>(RISCV_SYSCALL_ID::CLONE) && thread::creates_thread(register_file[10], register_file[11])) {
+                    register_file[10] = thread::clone_interpreted(register_file[10], register_file[11], register_file[12], register_file[13], register_file[14], pc + r);
+                } else {
+                    register_file[10] = syscall_impl(register_file[17], register_file[10], register_file[11], register_file[12], register_file[13], register_file[14], register_file[15]);
+                }
+                thread::lock_interpreter();
+                cur_rounding_mode = rounding_mode;
+                cache_dropped = (generation != block_cache_generation);
+                break;
+            }
+
+            /* M extension */
+            INSTR(FRV_MUL):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] * register_file[instr.rs2];
+                }
+                break;
+            INSTR(FRV_MULW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) * static_cast<int32_t>(register_file[instr.rs2]));
+                }
+                break;
+            INSTR(FRV_MULH):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = (static_cast<__int128_t>(static_cast<int64_t>(register_file[instr.rs1])) * static_cast<__int128_t>(static_cast<int64_t>(register_file[instr.rs2]))) >> 64;
+                }
+                break;
+            INSTR(FRV_MULHU):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = (static_cast<__uint128_t>(register_file[instr.rs1]) * static_cast<__uint128_t>(register_file[instr.rs2])) >> 64;
+                }
+                break;
+            INSTR(FRV_MULHSU):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = (static_cast<__int128_t>(static_cast<int64_t>(register_file[instr.rs1])) * static_cast<__uint128_t>(register_file[instr.rs2])) >> 64;
+                }
+                break;
+
+            INSTR(FRV_DIV):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = static_cast<int64_t>(register_file[instr.rs1]) / static_cast<int64_t>(register_file[instr.rs2]);
+                }
+                break;
+            INSTR(FRV_DIVU):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] / register_file[instr.rs2];
+                }
+                break;
+            INSTR(FRV_DIVW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) / static_cast<int32_t>(register_file[instr.rs2]));
+                }
+                break;
+            INSTR(FRV_DIVUW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(static_cast<uint32_t>(register_file[instr.rs1]) / static_cast<uint32_t>(register_file[instr.rs2])));
+                }
+                break;
+            INSTR(FRV_REM):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = static_cast<int64_t>(register_file[instr.rs1]) % static_cast<int64_t>(register_file[instr.rs2]);
+                }
+                break;
+            INSTR(FRV_REMU):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1] % register_file[instr.rs2];
+                }
+                break;
+            INSTR(FRV_REMW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(register_file[instr.rs1]) % static_cast<int32_t>(register_file[instr.rs2]));
+                }
+                break;
+            INSTR(FRV_REMUW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = sign_extend_int64_t(static_cast<int32_t>(static_cast<uint32_t>(register_file[instr.rs1]) % static_cast<uint32_t>(register_file[instr.rs2])));
+                }
+                break;
+
+            /* A extension */
+            INSTR(FRV_LRW): {
+                const auto val = sign_extend_int64_t(*reinterpret_cast<int32_t *>(register_file[instr.rs1]));
+                if (thread::multithreaded) {
+                    thread::current()->reservation = val;
+                }
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = val;
+                }
+                break;
+            }
+            INSTR(FRV_LRD): {
+                const auto val = *reinterpret_cast<uint64_t *>(register_file[instr.rs1]);
+                if (thread::multithreaded) {
+                    thread::current()->reservation = val;
+                }
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = val;
+                }
+                break;
+            }
+            INSTR(FRV_SCW): {
+                const auto res = store_conditional(reinterpret_cast<uint32_t *>(register_file[instr.rs1]), static_cast<uint32_t>(register_file[instr.rs2]));
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = res;
+                }
+                break;
+            }
+            INSTR(FRV_SCD): {
+                const auto res = store_conditional(reinterpret_cast<uint64_t *>(register_file[instr.rs1]), register_file[instr.rs2]);
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = res;
+                }
+                break;
+            }
+            INSTR(FRV_AMOSWAPW):
+    #define operation(val1, val2) val2
+                AMO_OP(int32_t, uint32_t);
+    #undef operation
+            INSTR(FRV_AMOSWAPD):
+    #define operation(val1, val2) val2
+                AMO_OP(int64_t, uint64_t);
+    #undef operation
+            INSTR(FRV_AMOADDW):
+    #define operation(val1, val2) val1 + val2
+                AMO_OP(int32_t, uint32_t);
+    #undef operation
+            INSTR(FRV_AMOADDD):
+    #define operation(val1, val2) val1 + val2
+                AMO_OP(int64_t, uint64_t);
+    #undef operation
+            INSTR(FRV_AMOANDW):
+    #define operation(val1, val2) val1 &val2
+                AMO_OP(int32_t, uint32_t);
+    #undef operation
+            INSTR(FRV_AMOANDD):
+    #define operation(val1, val2) val1 &val2
+                AMO_OP(int64_t, uint64_t);
+    #undef operation
+            INSTR(FRV_AMOORW):
+    #define operation(val1, val2) val1 | val2
+                AMO_OP(int32_t, uint32_t);
+    #undef operation
+            INSTR(FRV_AMOORD):
+    #define operation(val1, val2) val1 | val2
+                AMO_OP(int64_t, uint64_t);
+    #undef operation
+            INSTR(FRV_AMOXORW):
+    #define operation(val1, val2) val1 ^ val2
+                AMO_OP(int32_t, uint32_t);
+    #undef operation
+            INSTR(FRV_AMOXORD):
+    #define operation(val1, val2) val1 ^ val2
+                AMO_OP(int64_t, uint64_t);
+    #undef operation
+            INSTR(FRV_AMOMAXW):
+    #define operation(val1, val2) (val1 > val2) ? val1 : val2
+                AMO_OP(int32_t, int32_t);
+    #undef operation
+            INSTR(FRV_AMOMAXD):
+    #define operation(val1, val2) (val1 > val2) ? val1 : val2
+                AMO_OP(int64_t, int64_t);
+    #undef operation
+            INSTR(FRV_AMOMAXUW):
+    #define operation(val1, val2) (val1 > val2) ? val1 : val2
+                AMO_OP(int32_t, uint32_t);
+    #undef operation
+            INSTR(FRV_AMOMAXUD):
+    #define operation(val1, val2) (val1 > val2) ? val1 : val2
+                AMO_OP(int64_t, uint64_t);
+    #undef operation
+            INSTR(FRV_AMOMINW):
+    #define operation(val1, val2) (val1 < val2) ? val1 : val2
+                AMO_OP(int32_t, int32_t);
+    #undef operation
+            INSTR(FRV_AMOMIND):
+    #define operation(val1, val2) (val1 < val2) ? val1 : val2
+                AMO_OP(int64_t, int64_t);
+    #undef operation
+            INSTR(FRV_AMOMINUW):
+    #define operation(val1, val2) (val1 < val2) ? val1 : val2
+                AMO_OP(int32_t, uint32_t);
+    #undef operation
+            INSTR(FRV_AMOMINUD):
+    #define operation(val1, val2) (val1 < val2) ? val1 : val2
+                AMO_OP(int64_t, uint64_t);
+    #undef operation
+
+            /* Ziscr extension */
+            INSTR(FRV_CSRRW):
+                CSR_OP(register_file[instr.rs1], =);
+            INSTR(FRV_CSRRS):
+                CSR_OP(register_file[instr.rs1], |=);
+            INSTR(FRV_CSRRC):
+                CSR_OP(register_file[instr.rs1], &= ~);
+            INSTR(FRV_CSRRWI):
+                CSR_OP(instr.rs1, =);
+            INSTR(FRV_CSRRSI):
+                CSR_OP(instr.rs1, |=);
+            INSTR(FRV_CSRRCI):
+                CSR_OP(instr.rs1, &= ~);
+
+            /* F extension */
+            INSTR(FRV_FLW): {
+                uint32_t *ptr = reinterpret_cast<uint32_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
+                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(*ptr);
+                break;
             }
-            register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(conv1.d32);
-            break;
-        }
-        case FRV_FMSUBS: {
-            set_rounding_mode(instr.misc);
-            converter conv1;
-            converter conv2;
-            converter conv3;
-            conv1.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
-            conv2.d32 = static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]);
-            conv3.d32 = static_cast<uint32_t>(register_file[instr.rs3 + START_FP_STATICS]);
-            if (have_fma) {
-                __asm__ __volatile__("vfmsub213ss %2, %1, %0" : "+x"(conv1.f32) : "x"(conv2.f32), "x"(conv3.f32));
-            } else {
-                conv1.f32 = conv1.f32 * conv2.f32 - conv3.f32;
+            INSTR(FRV_FLD):
+                register_file[instr.rd + START_FP_STATICS] = *reinterpret_cast<uint64_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
+                break;
+            INSTR(FRV_FSW): {
+                uint32_t *ptr = reinterpret_cast<uint32_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
+                *ptr = static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]);
+                break;
             }
-            register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(conv1.d32);
-            break;
-        }
-        case FRV_FNMADDS: {
-            set_rounding_mode(instr.misc);
-            converter conv1;
-            converter conv2;
-            converter conv3;
-            conv1.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
-            conv2.d32 = static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]);
-            conv3.d32 = static_cast<uint32_t>(register_file[instr.rs3 + START_FP_STATICS]);
-            if (have_fma) {
-                __asm__ __volatile__("vfnmsub213ss %2, %1, %0" : "+x"(conv1.f32) : "x"(conv2.f32), "x"(conv3.f32));
-            } else {
-                conv1.f32 = -(conv1.f32 * conv2.f32 + conv3.f32);
+            INSTR(FRV_FSD): {
+                uint64_t *ptr = reinterpret_cast<uint64_t *>(register_file[instr.rs1] + sign_extend_int64_t(instr.imm));
+                *ptr = register_file[instr.rs2 + START_FP_STATICS];
+                break;
+            }
+
+            INSTR(FRV_FADDS):
+    #define operation(val1, val2) val1 + val2
+                FP_TWO_OP_FLOAT(true);
+    #undef operation
+                break;
+            INSTR(FRV_FADDD):
+    #define operation(val1, val2) val1 + val2
+                FP_TWO_OP_DOUBLE(true);
+    #undef operation
+                break;
+            INSTR(FRV_FSUBS):
+    #define operation(val1, val2) val1 - val2
+                FP_TWO_OP_FLOAT(true);
+    #undef operation
+                break;
+            INSTR(FRV_FSUBD):
+    #define operation(val1, val2) val1 - val2
+                FP_TWO_OP_DOUBLE(true);
+    #undef operation
+                break;
+            INSTR(FRV_FMULS):
+    #define operation(val1, val2) val1 *val2
+                FP_TWO_OP_FLOAT(true);
+    #undef operation
+                break;
+            INSTR(FRV_FMULD):
+    #define operation(val1, val2) val1 *val2
+                FP_TWO_OP_DOUBLE(true);
+    #undef operation
+                break;
+            INSTR(FRV_FDIVS):
+    #define operation(val1, val2) val1 / val2
+                FP_TWO_OP_FLOAT(true);
+    #undef operation
+                break;
+            INSTR(FRV_FDIVD):
+    #define operation(val1, val2) val1 / val2
+                FP_TWO_OP_DOUBLE(true);
+    #undef operation
+                break;
+            INSTR(FRV_FMINS):
+    #define operation(val1, val2) (val1 < val2) ? val1 : val2
+                FP_TWO_OP_FLOAT(true);
+    #undef operation
+                break;
+            INSTR(FRV_FMIND):
+    #define operation(val1, val2) (val1 < val2) ? val1 : val2
+                FP_TWO_OP_DOUBLE(true);
+    #undef operation
+                break;
+            INSTR(FRV_FMAXS):
+    #define operation(val1, val2) (val1 > val2) ? val1 : val2
+                FP_TWO_OP_FLOAT(true);
+    #undef operation
+                break;
+            INSTR(FRV_FMAXD):
+    #define operation(val1, val2) (val1 > val2) ? val1 : val2
+                FP_TWO_OP_DOUBLE(true);
+    #undef operation
+                break;
+            INSTR(FRV_FSQRTS): {
+                set_rounding_mode(instr.misc);
+                converter conv1, conv2;
+                conv1.d32 = register_file[instr.rs1 + START_FP_STATICS];
+                __asm__ __volatile__("sqrtss %1, %0" : "=x"(conv2.d32) : "x"(conv1.f32));
+                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(conv2.d32);
+                break;
             }
-            register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(conv1.d32);
-            break;
-        }
-        case FRV_FNMSUBS: {
-            set_rounding_mode(instr.misc);
-            converter conv1;
-            converter conv2;
-            converter conv3;
-            conv1.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
-            conv2.d32 = static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]);
-            conv3.d32 = static_cast<uint32_t>(register_file[instr.rs3 + START_FP_STATICS]);
-            if (have_fma) {
-                __asm__ __volatile__("vfnmadd213ss %2, %1, %0" : "+x"(conv1.f32) : "x"(conv2.f32), "x"(conv3.f32));
-            } else {
-                conv1.f32 = (-conv1.f32) * conv2.f32 + conv3.f32;
+            INSTR(FRV_FSQRTD): {
+                set_rounding_mode(instr.misc);
+                converter conv1, conv2;
+                conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
+                __asm__ __volatile__("sqrtsd %1, %0" : "=x"(conv2.f64) : "x"(conv1.f64));
+                register_file[instr.rd + START_FP_STATICS] = conv2.d64;
+                break;
             }
-            register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(conv1.d32);
-            break;
-        }
 
-        case FRV_FMADDD: {
-            set_rounding_mode(instr.misc);
-            converter conv1;
-            converter conv2;
-            converter conv3;
-            conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
-            conv2.d64 = register_file[instr.rs2 + START_FP_STATICS];
-            conv3.d64 = register_file[instr.rs3 + START_FP_STATICS];
-            if (have_fma) {
-                __asm__ __volatile__("vfmadd213sd %2, %1, %0" : "+x"(conv1.f64) : "x"(conv2.f64), "x"(conv3.f64));
-            } else {
-                conv1.f64 = conv1.f64 * conv2.f64 + conv3.f64;
-            }
-            register_file[instr.rd + START_FP_STATICS] = conv1.d64;
-            break;
-        }
-        case FRV_FMSUBD: {
-            set_rounding_mode(instr.misc);
-            converter conv1;
-            converter conv2;
-            converter conv3;
-            conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
-            conv2.d64 = register_file[instr.rs2 + START_FP_STATICS];
-            conv3.d64 = register_file[instr.rs3 + START_FP_STATICS];
-            if (have_fma) {
-                __asm__ __volatile__("vfmsub213sd %2, %1, %0" : "+x"(conv1.f64) : "x"(conv2.f64), "x"(conv3.f64));
-            } else {
-                conv1.f64 = conv1.f64 * conv2.f64 + conv3.f64;
-            }
-            register_file[instr.rd + START_FP_STATICS] = conv1.d64;
-            break;
-        }
-        case FRV_FNMADDD: {
-            set_rounding_mode(instr.misc);
-            converter conv1;
-            converter conv2;
-            converter conv3;
-            conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
-            conv2.d64 = register_file[instr.rs2 + START_FP_STATICS];
-            conv3.d64 = register_file[instr.rs3 + START_FP_STATICS];
-            if (have_fma) {
-                __asm__ __volatile__("vfnmsub213sd %2, %1, %0" : "+x"(conv1.f64) : "x"(conv2.f64), "x"(conv3.f64));
-            } else {
-                conv1.f64 = -(conv1.f64 * conv2.f64 + conv3.f64);
-            }
-            register_file[instr.rd + START_FP_STATICS] = conv1.d64;
-            break;
-        }
-        case FRV_FNMSUBD: {
-            set_rounding_mode(instr.misc);
-            converter conv1;
-            converter conv2;
-            converter conv3;
-            conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
-            conv2.d64 = register_file[instr.rs2 + START_FP_STATICS];
-            conv3.d64 = register_file[instr.rs3 + START_FP_STATICS];
-            if (have_fma) {
-                __asm__ __volatile__("vfnmadd213sd %2, %1, %0" : "+x"(conv1.f64) : "x"(conv2.f64), "x"(conv3.f64));
-            } else {
-                conv1.f64 = (-conv1.f64) * conv2.f64 + conv3.f64;
+            INSTR(FRV_FMADDS): {
+                set_rounding_mode(instr.misc);
+                converter conv1;
+                converter conv2;
+                converter conv3;
+                conv1.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
+                conv2.d32 = static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]);
+                conv3.d32 = static_cast<uint32_t>(register_file[instr.rs3 + START_FP_STATICS]);
+                if (have_fma) {
+                    __asm__ __volatile__("vfmadd213ss %2, %1, %0" : "+x"(conv1.f32) : "x"(conv2.f32), "x"(conv3.f32));
+                } else {
+                    conv1.f32 = conv1.f32 * conv2.f32 + conv3.f32;
+                }
+                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(conv1.d32);
+                break;
+            }
+            INSTR(FRV_FMSUBS): {
+                set_rounding_mode(instr.misc);
+                converter conv1;
+                converter conv2;
+                converter conv3;
+                conv1.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
+                conv2.d32 = static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]);
+                conv3.d32 = static_cast<uint32_t>(register_file[instr.rs3 + START_FP_STATICS]);
+                if (have_fma) {
+                    __asm__ __volatile__("vfmsub213ss %2, %1, %0" : "+x"(conv1.f32) : "x"(conv2.f32), "x"(conv3.f32));
+                } else {
+                    conv1.f32 = conv1.f32 * conv2.f32 - conv3.f32;
+                }
+                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(conv1.d32);
+                break;
+            }
+            INSTR(FRV_FNMADDS): {
+                set_rounding_mode(instr.misc);
+                converter conv1;
+                converter conv2;
+                converter conv3;
+                conv1.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
+                conv2.d32 = static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]);
+                conv3.d32 = static_cast<uint32_t>(register_file[instr.rs3 + START_FP_STATICS]);
+                if (have_fma) {
+                    __asm__ __volatile__("vfnmsub213ss %2, %1, %0" : "+x"(conv1.f32) : "x"(conv2.f32), "x"(conv3.f32));
+                } else {
+                    conv1.f32 = -(conv1.f32 * conv2.f32 + conv3.f32);
+                }
+                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(conv1.d32);
+                break;
+            }
+            INSTR(FRV_FNMSUBS): {
+                set_rounding_mode(instr.misc);
+                converter conv1;
+                converter conv2;
+                converter conv3;
+                conv1.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
+                conv2.d32 = static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]);
+                conv3.d32 = static_cast<uint32_t>(register_file[instr.rs3 + START_FP_STATICS]);
+                if (have_fma) {
+                    __asm__ __volatile__("vfnmadd213ss %2, %1, %0" : "+x"(conv1.f32) : "x"(conv2.f32), "x"(conv3.f32));
+                } else {
+                    conv1.f32 = (-conv1.f32) * conv2.f32 + conv3.f32;
+                }
+                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(conv1.d32);
+                break;
+            }
+
+            INSTR(FRV_FMADDD): {
+                set_rounding_mode(instr.misc);
+                converter conv1;
+                converter conv2;
+                converter conv3;
+                conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
+                conv2.d64 = register_file[instr.rs2 + START_FP_STATICS];
+                conv3.d64 = register_file[instr.rs3 + START_FP_STATICS];
+                if (have_fma) {
+                    __asm__ __volatile__("vfmadd213sd %2, %1, %0" : "+x"(conv1.f64) : "x"(conv2.f64), "x"(conv3.f64));
+                } else {
+                    conv1.f64 = conv1.f64 * conv2.f64 + conv3.f64;
+                }
+                register_file[instr.rd + START_FP_STATICS] = conv1.d64;
+                break;
+            }
+            INSTR(FRV_FMSUBD): {
+                set_rounding_mode(instr.misc);
+                converter conv1;
+                converter conv2;
+                converter conv3;
+                conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
+                conv2.d64 = register_file[instr.rs2 + START_FP_STATICS];
+                conv3.d64 = register_file[instr.rs3 + START_FP_STATICS];
+                if (have_fma) {
+                    __asm__ __volatile__("vfmsub213sd %2, %1, %0" : "+x"(conv1.f64) : "x"(conv2.f64), "x"(conv3.f64));
+                } else {
+                    conv1.f64 = conv1.f64 * conv2.f64 + conv3.f64;
+                }
+                register_file[instr.rd + START_FP_STATICS] = conv1.d64;
+                break;
+            }
+            INSTR(FRV_FNMADDD): {
+                set_rounding_mode(instr.misc);
+                converter conv1;
+                converter conv2;
+                converter conv3;
+                conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
+                conv2.d64 = register_file[instr.rs2 + START_FP_STATICS];
+                conv3.d64 = register_file[instr.rs3 + START_FP_STATICS];
+                if (have_fma) {
+                    __asm__ __volatile__("vfnmsub213sd %2, %1, %0" : "+x"(conv1.f64) : "x"(conv2.f64), "x"(conv3.f64));
+                } else {
+                    conv1.f64 = -(conv1.f64 * conv2.f64 + conv3.f64);
+                }
+                register_file[instr.rd + START_FP_STATICS] = conv1.d64;
+                break;
+            }
+            INSTR(FRV_FNMSUBD): {
+                set_rounding_mode(instr.misc);
+                converter conv1;
+                converter conv2;
+                converter conv3;
+                conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
+                conv2.d64 = register_file[instr.rs2 + START_FP_STATICS];
+                conv3.d64 = register_file[instr.rs3 + START_FP_STATICS];
+                if (have_fma) {
+                    __asm__ __volatile__("vfnmadd213sd %2, %1, %0" : "+x"(conv1.f64) : "x"(conv2.f64), "x"(conv3.f64));
+                } else {
+                    conv1.f64 = (-conv1.f64) * conv2.f64 + conv3.f64;
+                }
+                register_file[instr.rd + START_FP_STATICS] = conv1.d64;
+                break;
+            }
+            INSTR(FRV_FCVTWS):
+                if (instr.rd != 0) {
+                    converter conv;
+                    conv.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
+                    set_rounding_mode(instr.misc);
+                    // perform conversion (not using c conversion because this using the conversion with truncation: cvtt)
+                    int32_t result;
+                    __asm__ __volatile__("cvtss2si %1, %0" : "=r"(result) : "x"(conv.f32));
+                    register_file[instr.rd] = static_cast<int64_t>(result);
+                }
+                break;
+            INSTR(FRV_FCVTWUS):
+                if (instr.rd != 0) {
+                    converter conv;
+                    conv.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
+                    set_rounding_mode(instr.misc);
+                    // perform conversion (not using c conversion because gcc using the conversion with truncation: cvtt)
+                    int32_t result;
+                    __asm__ __volatile__("cvtss2si %1, %0" : "=r"(result) : "x"(conv.f32));
+                    // if value is negative, the result should be zero. spread sign bit and use inverted value to zero if necessary.
+                    result = result & ~(conv.i32 >> 31);
+                    register_file[instr.rd] = static_cast<uint32_t>(result);
+                }
+                break;
+            INSTR(FRV_FCVTLS):
+                if (instr.rd != 0) {
+                    converter conv;
+                    conv.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
+                    set_rounding_mode(instr.misc);
+                    // perform conversion (not using c conversion because gcc using the conversion with truncation: cvtt)
+                    int64_t result;
+                    __asm__ __volatile__("cvtss2si %1, %0" : "=r"(result) : "x"(conv.f32));
+                    register_file[instr.rd] = result;
+                }
+                break;
+            INSTR(FRV_FCVTLUS):
+                if (instr.rd != 0) {
+                    converter conv;
+                    conv.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
+                    set_rounding_mode(instr.misc);
+                    // perform conversion (not using c conversion because gcc using the conversion with truncation: cvtt)
+                    int64_t result;
+                    __asm__ __volatile__("cvtss2si %1, %0" : "=r"(result) : "x"(conv.f32));
+                    // if value is negative, the result should be zero. spread sign bit and use inverted value to zero if necessary.
+                    int64_t mask = ~(conv.i64 >> 63);
+                    result = result & static_cast<int64_t>(mask);
+                    register_file[instr.rd] = result;
+                }
+                break;
+
+            INSTR(FRV_FCVTSW): {
+                set_rounding_mode(instr.misc);
+                float res = static_cast<float>(static_cast<int32_t>(register_file[instr.rs1]));
+                uint32_t *res_ptr = reinterpret_cast<uint32_t *>(&res);
+                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(*res_ptr);
+                break;
             }
-            register_file[instr.rd + START_FP_STATICS] = conv1.d64;
-            break;
-        }
-        case FRV_FCVTWS:
-            if (instr.rd != 0) {
-                converter conv;
-                conv.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
+            INSTR(FRV_FCVTSWU): {
                 set_rounding_mode(instr.misc);
-                // perform conversion (not using c conversion because this using the conversion with truncation: cvtt)
-                int32_t result;
-                __asm__ __volatile__("cvtss2si %1, %0" : "=r"(result) : "x"(conv.f32));
-                register_file[instr.rd] = static_cast<int64_t>(result);
+                float res = static_cast<float>(static_cast<uint32_t>(register_file[instr.rs1]));
+                uint32_t *res_ptr = reinterpret_cast<uint32_t *>(&res);
+                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(*res_ptr);
+                break;
             }
-            break;
-        case FRV_FCVTWUS:
-            if (instr.rd != 0) {
-                converter conv;
-                conv.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
+            INSTR(FRV_FCVTSL): {
                 set_rounding_mode(instr.misc);
-                // perform conversion (not using c conversion because gcc using the conversion with truncation: cvtt)
-                int32_t result;
-                __asm__ __volatile__("cvtss2si %1, %0" : "=r"(result) : "x"(conv.f32));
-                // if value is negative, the result should be zero. spread sign bit and use inverted value to zero if necessary.
-                result = result & ~(conv.i32 >> 31);
-                register_file[instr.rd] = static_cast<uint32_t>(result);
+                float res = static_cast<float>(static_cast<int64_t>(register_file[instr.rs1]));
+                uint32_t *res_ptr = reinterpret_cast<uint32_t *>(&res);
+                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(*res_ptr);
+                break;
             }
-            break;
-        case FRV_FCVTLS:
-            if (instr.rd != 0) {
-                converter conv;
-                conv.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
+            INSTR(FRV_FCVTSLU): {
+                set_rounding_mode(instr.misc);
+                float res = static_cast<float>(register_file[instr.rs1]);
+                uint32_t *res_ptr = reinterpret_cast<uint32_t *>(&res);
+                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(*res_ptr);
+                break;
+            }
+
+            INSTR(FRV_FCVTWD):
+                if (instr.rd != 0) {
+                    converter conv;
+                    conv.d64 = register_file[instr.rs1 + START_FP_STATICS];
+                    set_rounding_mode(instr.misc);
+                    // perform conversion (not using c conversion because this using the conversion with truncation: cvtt)
+                    int32_t result;
+                    __asm__ __volatile__("cvtsd2si %1, %0" : "=r"(result) : "x"(conv.f64));
+                    register_file[instr.rd] = static_cast<int64_t>(result);
+                }
+                break;
+            INSTR(FRV_FCVTWUD):
+                if (instr.rd != 0) {
+                    converter conv;
+                    conv.d64 = register_file[instr.rs1 + START_FP_STATICS];
+                    set_rounding_mode(instr.misc);
+                    // perform conversion (not using c conversion because this using the conversion with truncation: cvtt)
+                    int32_t result;
+                    __asm__ __volatile__("cvtsd2si %1, %0" : "=r"(result) : "x"(conv.f64));
+                    // if value is negative, the result should be zero. spread sign bit and use inverted value to zero if necessary.
+                    result = result & static_cast<int32_t>(~(conv.i64 >> 63));
+                    register_file[instr.rd] = static_cast<uint32_t>(result);
+                }
+                break;
+            INSTR(FRV_FCVTLD):
+                if (instr.rd != 0) {
+                    converter conv;
+                    conv.d64 = register_file[instr.rs1 + START_FP_STATICS];
+                    set_rounding_mode(instr.misc);
+                    // perform conversion (not using c conversion because this using the conversion with truncation: cvtt)
+                    int64_t result;
+                    __asm__ __volatile__("cvtsd2si %1, %0" : "=r"(result) : "x"(conv.f64));
+                    register_file[instr.rd] = result;
+                }
+                break;
+            INSTR(FRV_FCVTLUD):
+                if (instr.rd != 0) {
+                    converter conv;
+                    conv.d64 = register_file[instr.rs1 + START_FP_STATICS];
+                    set_rounding_mode(instr.misc);
+                    // perform conversion (not using c conversion because this using the conversion with truncation: cvtt)
+                    int64_t result;
+                    __asm__ __volatile__("cvtsd2si %1, %0" : "=r"(result) : "x"(conv.f64));
+                    // if value is negative, the result should be zero. spread sign bit and use inverted value to zero if necessary.
+                    result = result & ~(conv.i64 >> 63);
+                    register_file[instr.rd] = result;
+                }
+                break;
+
+            INSTR(FRV_FCVTDW): {
                 set_rounding_mode(instr.misc);
-                // perform conversion (not using c conversion because gcc using the conversion with truncation: cvtt)
-                int64_t result;
-                __asm__ __volatile__("cvtss2si %1, %0" : "=r"(result) : "x"(conv.f32));
-                register_file[instr.rd] = result;
+                double res = static_cast<double>(static_cast<int32_t>(register_file[instr.rs1]));
+                uint64_t *res_ptr = reinterpret_cast<uint64_t *>(&res);
+                register_file[instr.rd + START_FP_STATICS] = *res_ptr;
+                break;
             }
-            break;
-        case FRV_FCVTLUS:
-            if (instr.rd != 0) {
-                converter conv;
-                conv.d32 = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]);
+            INSTR(FRV_FCVTDWU): {
                 set_rounding_mode(instr.misc);
-                // perform conversion (not using c conversion because gcc using the conversion with truncation: cvtt)
-                int64_t result;
-                __asm__ __volatile__("cvtss2si %1, %0" : "=r"(result) : "x"(conv.f32));
-                // if value is negative, the result should be zero. spread sign bit and use inverted value to zero if necessary.
-                int64_t mask = ~(conv.i64 >> 63);
-                result = result & static_cast<int64_t>(mask);
-                register_file[instr.rd] = result;
+                double res = static_cast<double>(static_cast<uint32_t>(register_file[instr.rs1]));
+                uint64_t *res_ptr = reinterpret_cast<uint64_t *>(&res);
+                register_file[instr.rd + START_FP_STATICS] = *res_ptr;
+                break;
             }
-            break;
-
-        case FRV_FCVTSW: {
-            set_rounding_mode(instr.misc);
-            float res = static_cast<float>(static_cast<int32_t>(register_file[instr.rs1]));
-            uint32_t *res_ptr = reinterpret_cast<uint32_t *>(&res);
-            register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(*res_ptr);
-            break;
-        }
-        case FRV_FCVTSWU: {
-            set_rounding_mode(instr.misc);
-            float res = static_cast<float>(static_cast<uint32_t>(register_file[instr.rs1]));
-            uint32_t *res_ptr = reinterpret_cast<uint32_t *>(&res);
-            register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(*res_ptr);
-            break;
-        }
-        case FRV_FCVTSL: {
-            set_rounding_mode(instr.misc);
-            float res = static_cast<float>(static_cast<int64_t>(register_file[instr.rs1]));
-            uint32_t *res_ptr = reinterpret_cast<uint32_t *>(&res);
-            register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(*res_ptr);
-            break;
-        }
-        case FRV_FCVTSLU: {
-            set_rounding_mode(instr.misc);
-            float res = static_cast<float>(register_file[instr.rs1]);
-            uint32_t *res_ptr = reinterpret_cast<uint32_t *>(&res);
-            register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(*res_ptr);
-            break;
-        }
-
-        case FRV_FCVTWD:
-            if (instr.rd != 0) {
-                converter conv;
-                conv.d64 = register_file[instr.rs1 + START_FP_STATICS];
+            INSTR(FRV_FCVTDL): {
                 set_rounding_mode(instr.misc);
-                // perform conversion (not using c conversion because this using the conversion with truncation: cvtt)
-                int32_t result;
-                __asm__ __volatile__("cvtsd2si %1, %0" : "=r"(result) : "x"(conv.f64));
-                register_file[instr.rd] = static_cast<int64_t>(result);
+                double res = static_cast<double>(static_cast<int64_t>(register_file[instr.rs1]));
+                uint64_t *res_ptr = reinterpret_cast<uint64_t *>(&res);
+                register_file[instr.rd + START_FP_STATICS] = *res_ptr;
+                break;
             }
-            break;
-        case FRV_FCVTWUD:
-            if (instr.rd != 0) {
-                converter conv;
-                conv.d64 = register_file[instr.rs1 + START_FP_STATICS];
+            INSTR(FRV_FCVTDLU): {
                 set_rounding_mode(instr.misc);
-                // perform conversion (not using c conversion because this using the conversion with truncation: cvtt)
-                int32_t result;
-                __asm__ __volatile__("cvtsd2si %1, %0" : "=r"(result) : "x"(conv.f64));
-                // if value is negative, the result should be zero. spread sign bit and use inverted value to zero if necessary.
-                result = result & static_cast<int32_t>(~(conv.i64 >> 63));
-                register_file[instr.rd] = static_cast<uint32_t>(result);
+                double res = static_cast<double>(register_file[instr.rs1]);
+                uint64_t *res_ptr = reinterpret_cast<uint64_t *>(&res);
+                register_file[instr.rd + START_FP_STATICS] = *res_ptr;
+                break;
             }
-            break;
-        case FRV_FCVTLD:
-            if (instr.rd != 0) {
-                converter conv;
-                conv.d64 = register_file[instr.rs1 + START_FP_STATICS];
+            INSTR(FRV_FCVTDS): {
                 set_rounding_mode(instr.misc);
-                // perform conversion (not using c conversion because this using the conversion with truncation: cvtt)
-                int64_t result;
-                __asm__ __volatile__("cvtsd2si %1, %0" : "=r"(result) : "x"(conv.f64));
-                register_file[instr.rd] = result;
+                converter conv;
+                conv.d32 = register_file[instr.rs1 + START_FP_STATICS];
+                conv.f64 = static_cast<double>(conv.f32);
+
+                register_file[instr.rd + START_FP_STATICS] = conv.d64;
+                break;
             }
-            break;
-        case FRV_FCVTLUD:
-            if (instr.rd != 0) {
+            INSTR(FRV_FCVTSD): {
+                set_rounding_mode(instr.misc);
                 converter conv;
                 conv.d64 = register_file[instr.rs1 + START_FP_STATICS];
-                set_rounding_mode(instr.misc);
-                // perform conversion (not using c conversion because this using the conversion with truncation: cvtt)
-                int64_t result;
-                __asm__ __volatile__("cvtsd2si %1, %0" : "=r"(result) : "x"(conv.f64));
-                // if value is negative, the result should be zero. spread sign bit and use inverted value to zero if necessary.
-                result = result & ~(conv.i64 >> 63);
-                register_file[instr.rd] = result;
-            }
-            break;
-
-        case FRV_FCVTDW: {
-            set_rounding_mode(instr.misc);
-            double res = static_cast<double>(static_cast<int32_t>(register_file[instr.rs1]));
-            uint64_t *res_ptr = reinterpret_cast<uint64_t *>(&res);
-            register_file[instr.rd + START_FP_STATICS] = *res_ptr;
-            break;
-        }
-        case FRV_FCVTDWU: {
-            set_rounding_mode(instr.misc);
-            double res = static_cast<double>(static_cast<uint32_t>(register_file[instr.rs1]));
-            uint64_t *res_ptr = reinterpret_cast<uint64_t *>(&res);
-            register_file[instr.rd + START_FP_STATICS] = *res_ptr;
-            break;
-        }
-        case FRV_FCVTDL: {
-            set_rounding_mode(instr.misc);
-            double res = static_cast<double>(static_cast<int64_t>(register_file[instr.rs1]));
-            uint64_t *res_ptr = reinterpret_cast<uint64_t *>(&res);
-            register_file[instr.rd + START_FP_STATICS] = *res_ptr;
-            break;
-        }
-        case FRV_FCVTDLU: {
-            set_rounding_mode(instr.misc);
-            double res = static_cast<double>(register_file[instr.rs1]);
-            uint64_t *res_ptr = reinterpret_cast<uint64_t *>(&res);
-            register_file[instr.rd + START_FP_STATICS] = *res_ptr;
-            break;
-        }
-        case FRV_FCVTDS: {
-            set_rounding_mode(instr.misc);
-            converter conv;
-            conv.d32 = register_file[instr.rs1 + START_FP_STATICS];
-            conv.f64 = static_cast<double>(conv.f32);
+                conv.f32 = static_cast<float>(conv.f64);
+
+                register_file[instr.rd + START_FP_STATICS] = conv.d32;
+                break;
+            }
+
+            INSTR(FRV_FMVXW):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = static_cast<int64_t>(static_cast<int32_t>(register_file[instr.rs1 + START_FP_STATICS]));
+                }
+                break;
+            INSTR(FRV_FMVWX):
+                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(static_cast<uint32_t>(register_file[instr.rs1]));
+                break;
+            INSTR(FRV_FMVXD):
+                if (instr.rd != 0) {
+                    register_file[instr.rd] = register_file[instr.rs1 + START_FP_STATICS];
+                }
+                break;
+            INSTR(FRV_FMVDX):
+                register_file[instr.rd + START_FP_STATICS] = register_file[instr.rs1];
+                break;
+
+            INSTR(FRV_FSGNJS):
+                if (instr.rs1 == instr.rs2) {
+                    register_file[instr.rd + START_FP_STATICS] = register_file[instr.rs1 + START_FP_STATICS];
+                } else {
+                    register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>((static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]) & 0x7FFF'FFFF) |
+                                                                                       (static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]) & 0x8000'0000));
+                }
+                break;
+            INSTR(FRV_FSGNJD):
+                if (instr.rs1 == instr.rs2) {
+                    register_file[instr.rd + START_FP_STATICS] = register_file[instr.rs1 + START_FP_STATICS];
+                } else {
+                    register_file[instr.rd + START_FP_STATICS] =
+                        (register_file[instr.rs1 + START_FP_STATICS] & 0x7FFF'FFFF'FFFF'FFFF) | (register_file[instr.rs2 + START_FP_STATICS] & 0x8000'0000'0000'0000);
+                }
+                break;
+            INSTR(FRV_FSGNJNS):
+                if (instr.rs1 == instr.rs2) {
+                    // negate the floating point value (change sign bit)
+                    register_file[instr.rd + START_FP_STATICS] = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]) ^ 0x8000'0000;
+                } else {
+                    register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>((static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]) & 0x7FFF'FFFF) |
+                                                                                       (~static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]) & 0x8000'0000));
+                }
+                break;
+            INSTR(FRV_FSGNJND):
+                if (instr.rs1 == instr.rs2) {
+                    // negate the floating point value (change sign bit)
+                    register_file[instr.rd + START_FP_STATICS] = register_file[instr.rs1 + START_FP_STATICS] ^ 0x8000'0000'0000'0000;
+                } else {
+                    register_file[instr.rd + START_FP_STATICS] =
+                        (register_file[instr.rs1 + START_FP_STATICS] & 0x7FFF'FFFF'FFFF'FFFF) | (~register_file[instr.rs2 + START_FP_STATICS] & 0x8000'0000'0000'0000);
+                }
+                break;
+            INSTR(FRV_FSGNJXS): {
+                if (instr.rs1 == instr.rs2) {
+                    // calculate the absulate value (set sign bit to zero)
+                    register_file[instr.rd + START_FP_STATICS] = register_file[instr.rs1 + START_FP_STATICS] & 0x7FFF'FFFF;
+                } else {
+                    uint32_t new_sign =
+                        (static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]) & 0x8000'0000) ^ (static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]) & 0x8000'0000);
+                    register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>((static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]) & 0x7FFF'FFFF) | new_sign);
+                }
+                break;
+            }
+            INSTR(FRV_FSGNJXD):
+                if (instr.rs1 == instr.rs2) {
+                    // calculate the absulate value (set sign bit to zero)
+                    register_file[instr.rd + START_FP_STATICS] = register_file[instr.rs1 + START_FP_STATICS] & 0x7FFF'FFFF'FFFF'FFFF;
+                } else {
+                    uint64_t new_sign = (register_file[instr.rs1 + START_FP_STATICS] & 0x8000'0000'0000'0000) ^ (register_file[instr.rs2 + START_FP_STATICS] & 0x8000'0000'0000'0000);
+                    register_file[instr.rd + START_FP_STATICS] = (register_file[instr.rs1 + START_FP_STATICS] & 0x7FFF'FFFF'FFFF'FFFF) | new_sign;
+                }
+                break;
+
+            INSTR(FRV_FLTS):
+                FP_COMPARE(d32, f32, <);
+            INSTR(FRV_FLTD):
+                FP_COMPARE(d64, f64, <);
+            INSTR(FRV_FLES):
+                FP_COMPARE(d32, f32, <=);
+            INSTR(FRV_FLED):
+                FP_COMPARE(d64, f64, <=);
+            INSTR(FRV_FEQS):
+                FP_COMPARE(d32, f32, ==);
+            INSTR(FRV_FEQD):
+                FP_COMPARE(d64, f64, ==);
+            INSTR(FRV_FCLASSS):
+                if (instr.rd != 0) {
+                    const uint32_t val = register_file[instr.rs1 + START_FP_STATICS];
+                    uint64_t result = 0;
+
+                    const uint32_t sign = val >> 31;
+                    const uint32_t exponent = (val >> 23) & 0xFF;
+                    const uint32_t mantisse = val & 0x7F'FFFF;
+                    const uint32_t mantisse_msb = mantisse >> 22;
+
+                    // negative infinity
+                    result |= (val == 0xFF80'0000);
+
+                    // negative normal number
+                    result |= (sign && (exponent != 0) && (exponent != 0xFF)) << 1;
+
+                    // negative subnormal number
+                    result |= (sign && (exponent == 0) && (mantisse != 0)) << 2;
+
+                    // negative zero
+                    result |= (val == 0x8000'0000) << 3;
+
+                    // positive zero
+                    result |= (val == 0) << 4;
+
+                    // positive subnormal number
+                    result |= (!sign && (exponent == 0) && (mantisse != 0)) << 5;
+
+                    // positive normal number
+                    result |= (!sign && (exponent != 0) && (exponent != 0xFF)) << 6;
+
+                    // positive infinity
+                    result |= (val == 0x7F80'0000) << 7;
+
+                    // sNaN
+                    result |= ((exponent == 0xFF) && !mantisse_msb && (mantisse != 0)) << 8;
+
+                    // qNaN
+                    result |= ((exponent == 0xFF) && mantisse_msb) << 9;
+
+                    register_file[instr.rd] = result;
+                }
+                break;
+
+            INSTR(FRV_FCLASSD):
+                if (instr.rd != 0) {
+                    const uint64_t val = register_file[instr.rs1 + START_FP_STATICS];
+                    uint64_t result = 0;
+
+                    const uint64_t sign = val >> 63;
+                    const uint64_t exponent = (val >> 52) & 0x7FF;
+                    const uint64_t mantisse = val & 0xF'FFFF'FFFF'FFFF;
+                    const uint64_t mantisse_msb = mantisse >> 51;
+
+                    // negative infinity
+                    result |= (val == 0xFFF0'0000'0000'0000);
+
+                    // negative normal number
+                    result |= (sign && (exponent != 0) && (exponent != 0x7FF)) << 1;
+
+                    // negative subnormal number
+                    result |= (sign && (exponent == 0) && (mantisse != 0)) << 2;
+
+                    // negative zero
+                    result |= (val == 0x8000'0000'0000'0000) << 3;
+
+                    // positive zero
+                    result |= (val == 0) << 4;
+
+                    // positive subnormal number
+                    result |= (!sign && (exponent == 0) && (mantisse != 0)) << 5;
+
+                    // positive normal number
+                    result |= (!sign && (exponent != 0) && (exponent != 0x7FF)) << 6;
+
+                    // positive infinity
+                    result |= (val == 0x7FF0'0000'0000'0000) << 7;
 
-            register_file[instr.rd + START_FP_STATICS] = conv.d64;
-            break;
-        }
-        case FRV_FCVTSD: {
-            set_rounding_mode(instr.misc);
-            converter conv;
-            conv.d64 = register_file[instr.rs1 + START_FP_STATICS];
-            conv.f32 = static_cast<float>(conv.f64);
+                    // sNaN
+                    result |= ((exponent == 0x7FF) && !mantisse_msb && (mantisse != 0)) << 8;
 
-            register_file[instr.rd + START_FP_STATICS] = conv.d32;
-            break;
-        }
+                    // qNaN
+                    result |= ((exponent == 0x7FF) && mantisse_msb) << 9;
 
-        case FRV_FMVXW:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = static_cast<int64_t>(static_cast<int32_t>(register_file[instr.rs1 + START_FP_STATICS]));
-            }
-            break;
-        case FRV_FMVWX:
-            register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>(static_cast<uint32_t>(register_file[instr.rs1]));
-            break;
-        case FRV_FMVXD:
-            if (instr.rd != 0) {
-                register_file[instr.rd] = register_file[instr.rs1 + START_FP_STATICS];
+                    register_file[instr.rd] = result;
+                }
+                break;
+            default:
+                // decoded by frvdec but without a handler here
+                trace(pc, &instr);
+                illegal_instruction(pc);
             }
-            break;
-        case FRV_FMVDX:
-            register_file[instr.rd + START_FP_STATICS] = register_file[instr.rs1];
-            break;
 
-        case FRV_FSGNJS:
-            if (instr.rs1 == instr.rs2) {
-                register_file[instr.rd + START_FP_STATICS] = register_file[instr.rs1 + START_FP_STATICS];
-            } else {
-                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>((static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]) & 0x7FFF'FFFF) |
-                                                                                   (static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]) & 0x8000'0000));
-            }
-            break;
-        case FRV_FSGNJD:
-            if (instr.rs1 == instr.rs2) {
-                register_file[instr.rd + START_FP_STATICS] = register_file[instr.rs1 + START_FP_STATICS];
-            } else {
-                register_file[instr.rd + START_FP_STATICS] =
-                    (register_file[instr.rs1 + START_FP_STATICS] & 0x7FFF'FFFF'FFFF'FFFF) | (register_file[instr.rs2 + START_FP_STATICS] & 0x8000'0000'0000'0000);
-            }
-            break;
-        case FRV_FSGNJNS:
-            if (instr.rs1 == instr.rs2) {
-                // negate the floating point value (change sign bit)
-                register_file[instr.rd + START_FP_STATICS] = static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]) ^ 0x8000'0000;
-            } else {
-                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>((static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]) & 0x7FFF'FFFF) |
-                                                                                   (~static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]) & 0x8000'0000));
-            }
-            break;
-        case FRV_FSGNJND:
-            if (instr.rs1 == instr.rs2) {
-                // negate the floating point value (change sign bit)
-                register_file[instr.rd + START_FP_STATICS] = register_file[instr.rs1 + START_FP_STATICS] ^ 0x8000'0000'0000'0000;
-            } else {
-                register_file[instr.rd + START_FP_STATICS] =
-                    (register_file[instr.rs1 + START_FP_STATICS] & 0x7FFF'FFFF'FFFF'FFFF) | (~register_file[instr.rs2 + START_FP_STATICS] & 0x8000'0000'0000'0000);
+            // pc is the address of the instruction while it's executed (auipc, jal and the branches are relative to it
+            // and link pc + r), it only moves on to the next one afterwards if the instruction didn't jump
+            if (!jump) {
+                pc += r;
             }
-            break;
-        case FRV_FSGNJXS: {
-            if (instr.rs1 == instr.rs2) {
-                // calculate the absulate value (set sign bit to zero)
-                register_file[instr.rd + START_FP_STATICS] = register_file[instr.rs1 + START_FP_STATICS] & 0x7FFF'FFFF;
-            } else {
-                uint32_t new_sign =
-                    (static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]) & 0x8000'0000) ^ (static_cast<uint32_t>(register_file[instr.rs2 + START_FP_STATICS]) & 0x8000'0000);
-                register_file[instr.rd + START_FP_STATICS] = static_cast<uint64_t>((static_cast<uint32_t>(register_file[instr.rs1 + START_FP_STATICS]) & 0x7FFF'FFFF) | new_sign);
-            }
-            break;
         }
-        case FRV_FSGNJXD:
-            if (instr.rs1 == instr.rs2) {
-                // calculate the absulate value (set sign bit to zero)
-                register_file[instr.rd + START_FP_STATICS] = register_file[instr.rs1 + START_FP_STATICS] & 0x7FFF'FFFF'FFFF'FFFF;
-            } else {
-                uint64_t new_sign = (register_file[instr.rs1 + START_FP_STATICS] & 0x8000'0000'0000'0000) ^ (register_file[instr.rs2 + START_FP_STATICS] & 0x8000'0000'0000'0000);
-                register_file[instr.rd + START_FP_STATICS] = (register_file[instr.rs1 + START_FP_STATICS] & 0x7FFF'FFFF'FFFF'FFFF) | new_sign;
-            }
-            break;
 
-        // TODO: fix copypasta
-        case FRV_FLTS: {
-            if (instr.rd != 0) {
-                converter conv1, conv2;
-                conv1.d32 = register_file[instr.rs1 + START_FP_STATICS];
-                conv2.d32 = register_file[instr.rs2 + START_FP_STATICS];
-                register_file[instr.rd] = conv1.f32 < conv2.f32 ? 1 : 0;
-            }
-            break;
-        }
-        case FRV_FLTD: {
-            if (instr.rd != 0) {
-                converter conv1, conv2;
-                conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
-                conv2.d64 = register_file[instr.rs2 + START_FP_STATICS];
-                register_file[instr.rd] = conv1.f64 < conv2.f64 ? 1 : 0;
-            }
-            break;
-        }
-        case FRV_FLES: {
-            if (instr.rd != 0) {
-                converter conv1, conv2;
-                conv1.d32 = register_file[instr.rs1 + START_FP_STATICS];
-                conv2.d32 = register_file[instr.rs2 + START_FP_STATICS];
-                register_file[instr.rd] = conv1.f32 <= conv2.f32 ? 1 : 0;
-            }
-            break;
-        }
-        case FRV_FLED: {
-            if (instr.rd != 0) {
-                converter conv1, conv2;
-                conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
-                conv2.d64 = register_file[instr.rs2 + START_FP_STATICS];
-                register_file[instr.rd] = conv1.f64 <= conv2.f64 ? 1 : 0;
-            }
-            break;
-        }
-        case FRV_FEQS: {
-            if (instr.rd != 0) {
-                converter conv1, conv2;
-                conv1.d32 = register_file[instr.rs1 + START_FP_STATICS];
-                conv2.d32 = register_file[instr.rs2 + START_FP_STATICS];
-                register_file[instr.rd] = conv1.f32 == conv2.f32 ? 1 : 0;
-            }
-            break;
-        }
-        case FRV_FEQD: {
-            if (instr.rd != 0) {
-                converter conv1, conv2;
-                conv1.d64 = register_file[instr.rs1 + START_FP_STATICS];
-                conv2.d64 = register_file[instr.rs2 + START_FP_STATICS];
-                register_file[instr.rd] = conv1.f64 == conv2.f64 ? 1 : 0;
-            }
-            break;
+        if (cache_dropped) {
+            block = find_block(pc);
+            continue;
         }
-        case FRV_FCLASSS:
-            if (instr.rd != 0) {
-                const uint32_t val = register_file[instr.rs1 + START_FP_STATICS];
-                uint64_t result = 0;
-
-                const uint32_t sign = val >> 31;
-                const uint32_t exponent = (val >> 23) & 0xFF;
-                const uint32_t mantisse = val & 0x7F'FFFF;
-                const uint32_t mantisse_msb = mantisse >> 22;
-
-                // negative infinity
-                result |= (val == 0xFF80'0000);
-
-                // negative normal number
-                result |= (sign && (exponent != 0) && (exponent != 0xFF)) << 1;
-
-                // negative subnormal number
-                result |= (sign && (exponent == 0) && (mantisse != 0)) << 2;
-
-                // negative zero
-                result |= (val == 0x8000'0000) << 3;
-
-                // positive zero
-                result |= (val == 0) << 4;
-
-                // positive subnormal number
-                result |= (!sign && (exponent == 0) && (mantisse != 0)) << 5;
-
-                // positive normal number
-                result |= (!sign && (exponent != 0) && (exponent != 0xFF)) << 6;
 
-                // positive infinity
-                result |= (val == 0x7F80'0000) << 7;
-
-                // sNaN
-                result |= ((exponent == 0xFF) && !mantisse_msb && (mantisse != 0)) << 8;
-
-                // qNaN
-                result |= ((exponent == 0xFF) && mantisse_msb) << 9;
-
-                register_file[instr.rd] = result;
-            }
-            break;
-
-        case FRV_FCLASSD:
-            if (instr.rd != 0) {
-                const uint64_t val = register_file[instr.rs1 + START_FP_STATICS];
-                uint64_t result = 0;
-
-                const uint64_t sign = val >> 63;
-                const uint64_t exponent = (val >> 52) & 0x7FF;
-                const uint64_t mantisse = val & 0xF'FFFF'FFFF'FFFF;
-                const uint64_t mantisse_msb = mantisse >> 51;
-
-                // negative infinity
-                result |= (val == 0xFFF0'0000'0000'0000);
-
-                // negative normal number
-                result |= (sign && (exponent != 0) && (exponent != 0x7FF)) << 1;
-
-                // negative subnormal number
-                result |= (sign && (exponent == 0) && (mantisse != 0)) << 2;
-
-                // negative zero
-                result |= (val == 0x8000'0000'0000'0000) << 3;
-
-                // positive zero
-                result |= (val == 0) << 4;
-
-                // positive subnormal number
-                result |= (!sign && (exponent == 0) && (mantisse != 0)) << 5;
-
-                // positive normal number
-                result |= (!sign && (exponent != 0) && (exponent != 0x7FF)) << 6;
-
-                // positive infinity
-                result |= (val == 0x7FF0'0000'0000'0000) << 7;
-
-                // sNaN
-                result |= ((exponent == 0x7FF) && !mantisse_msb && (mantisse != 0)) << 8;
-
-                // qNaN
-                result |= ((exponent == 0x7FF) && mantisse_msb) << 9;
-
-                register_file[instr.rd] = result;
+        // follow the chain of the block or look the successor up and chain it
+        DecodedBlock *next = block->successors[jump];
+        if (next == nullptr || next->pc != pc) {
+            const uint64_t generation = block_cache_generation;
+            next = find_block(pc);
+            if (generation == block_cache_generation) {
+                block->successors[jump] = next;
             }
-            break;
-        default:
-            trace(pc, &instr);
-            trace_dump_state(pc);
-            panic("instruction not implemented\n");
-            break;
-        }
-
-        if (!jump) {
-            pc += r; // FIXME: is increment PC a pre or post operation ?
         }
-    } while (!is_cfop || (return_addr = calc_target(pc)) == 0);
+        block = next;
+    }
+    const uint64_t return_addr = block->translated;
+    if (entry != nullptr) {
+        entry->instr_count += instr_count;
+    }
 
     /* At this point we have found a valid entry point back into
      * the compiled BasicBlocks
      */
+    // the translated code expects round-to-nearest when it's entered through the lookup
+    set_rounding_mode(0);
+    thread::unlock_interpreter();
 #if TRACE
     puts("TRACE: found compiled basic block, pc: ");
     print_hex64(pc);
@@ -1500,4 +1733,7 @@ extern "C" uint64_t unresolved_ijump_handler(uint64_t pc) {
     return return_addr;
 }
 
+#undef INSTR
+#pragma GCC diagnostic pop
+
 } // namespace helper::interpreter
@@ -0,0 +1,523 @@
+#include "frvdec.h"
+#include "generator/syscall_ids.h"
+#include "generator/x86_64/helper/helper.h"
+#include "generator/x86_64/helper/interpreter.h"
+#include "generator/x86_64/helper/thread.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/* Runtime compiler for hot blocks of the interpreter
+ * Blocks which only use the integer base instructions and multiplications are translated to x86_64 code in a buffer
+ * mapped by the helper. The code keeps all statics in the register_file like the interpreter does, so it can be
+ * called by the interpreter in place of interpreting the block. It gets the register_file of the interpreting thread
+ * in rdi, uses rax, rcx and rdx as temporaries and returns the guest address of the next block.
+ */
+namespace helper::jit {
+
+using interpreter::DecodedBlock;
+
+constexpr inline size_t CODE_BUFFER_SIZE = 4 << 20;
+constexpr inline size_t PAGE_SIZE = 4096;
+// upper bound of the code of a single instruction and of the prologue/epilogue of a block
+constexpr inline size_t MAX_INSTR_CODE_SIZE = 48;
+
+constexpr inline size_t PROT_READ = 0x1;
+constexpr inline size_t PROT_WRITE = 0x2;
+constexpr inline size_t PROT_EXEC = 0x4;
+constexpr inline size_t MAP_PRIVATE = 0x02;
+constexpr inline size_t MAP_ANONYMOUS = 0x20;
+
+uint8_t *code_buffer = nullptr;
+size_t code_buffer_used = 0;
+// the buffer couldn't be mapped
+bool disabled = false;
+
+namespace {
+
+enum Reg : uint8_t { RAX = 0, RCX = 1, RDX = 2, RDI = 7 };
+
+// condition codes of jcc/setcc/cmovcc
+enum Cond : uint8_t { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD };
+
+// opcodes of the "op r/m, reg" forms
+enum AluOp : uint8_t { ALU_ADD = 0x01, ALU_OR = 0x09, ALU_AND = 0x21, ALU_SUB = 0x29, ALU_XOR = 0x31, ALU_CMP = 0x39 };
+
+// reg field of the shift group "op r/m, cl"
+enum ShiftOp : uint8_t { SHIFT_SHL = 4, SHIFT_SHR = 5, SHIFT_SAR = 7 };
+
+constexpr uint8_t REX_W = 0x48;
+
+struct Emitter {
+    uint8_t *code;
+    size_t size = 0;
+
+    void byte(const uint8_t b) { code[size++] = b; }
+
+    void imm32(const uint32_t v) {
+        for (size_t i = 0; i < 4; ++i) {
+            byte(static_cast<uint8_t>(v >> (8 * i)));
+        }
+    }
+
+    void imm64(const uint64_t v) {
+        for (size_t i = 0; i < 8; ++i) {
+            byte(static_cast<uint8_t>(v >> (8 * i)));
+        }
+    }
+
+    // mov reg, imm (sign extended imm32 or movabs)
+    void mov_imm(const Reg reg, const uint64_t v) {
+        if (static_cast<int64_t>(v) == static_cast<int32_t>(v)) {
+            byte(REX_W);
+            byte(0xC7);
+            byte(0xC0 | reg);
+            imm32(static_cast<uint32_t>(v));
+        } else {
+            byte(REX_W);
+            byte(0xB8 | reg);
+            imm64(v);
+        }
+    }
+
+    // mov reg, [rdi + 8 * static_idx], x0 is always zero
+    void load_static(const Reg reg, const uint8_t static_idx) {
+        if (static_idx == 0) {
+            // xor reg32, reg32
+            byte(0x31);
+            byte(0xC0 | (reg << 3) | reg);
+            return;
+        }
+        byte(REX_W);
+        byte(0x8B);
+        byte(0x80 | (reg << 3) | RDI);
+        imm32(8 * static_idx);
+    }
+
+    // mov [rdi + 8 * static_idx], reg, writes to x0 are dropped
+    void store_static(const uint8_t static_idx, const Reg reg) {
+        if (static_idx == 0) {
+            return;
+        }
+        byte(REX_W);
+        byte(0x89);
+        byte(0x80 | (reg << 3) | RDI);
+        imm32(8 * static_idx);
+    }
+
+    // op rax, rcx
+    void alu(const AluOp op, const bool wide) {
+        if (wide) {
+            byte(REX_W);
+        }
+        byte(op);
+        byte(0xC0 | (RCX << 3) | RAX);
+    }
+
+    // op rax, cl
+    void shift(const ShiftOp op, const bool wide) {
+        if (wide) {
+            byte(REX_W);
+        }
+        byte(0xD3);
+        byte(0xC0 | (op << 3) | RAX);
+    }
+
+    // imul rax, rcx
+    void imul(const bool wide) {
+        if (wide) {
+            byte(REX_W);
+        }
+        byte(0x0F);
+        byte(0xAF);
+        byte(0xC0 | (RAX << 3) | RCX);
+    }
+
+    // movsxd rax, eax
+    void sign_extend_32() {
+        byte(REX_W);
+        byte(0x63);
+        byte(0xC0);
+    }
+
+    // setcc al; movzx eax, al
+    void set_cond(const Cond cond) {
+        byte(0x0F);
+        byte(0x90 | cond);
+        byte(0xC0);
+        byte(0x0F);
+        byte(0xB6);
+        byte(0xC0);
+    }
+
+    // cmovcc rax, rdx
+    void cmov_cond(const Cond cond) {
+        byte(REX_W);
+        byte(0x0F);
+        byte(0x40 | cond);
+        byte(0xC0 | (RAX << 3) | RDX);
+    }
+
+    // [rax + disp32] as the memory operand with the given reg field
+    void mem_rax(const uint8_t reg, const int32_t disp) {
+        byte(0x80 | (reg << 3) | RAX);
+        imm32(static_cast<uint32_t>(disp));
+    }
+
+    void mfence() {
+        byte(0x0F);
+        byte(0xAE);
+        byte(0xF0);
+    }
+
+    void ret() { byte(0xC3); }
+};
+
+// reg-reg and reg-imm arithmetic, rs1 is in rax and the second operand in rcx
+bool compile_arithmetic(Emitter &e, const FrvInst &instr) {
+    switch (instr.mnem) {
+    case FRV_ADD:
+    case FRV_ADDI:
+        e.alu(ALU_ADD, true);
+        break;
+    case FRV_ADDW:
+    case FRV_ADDIW:
+        e.alu(ALU_ADD, false);
+        e.sign_extend_32();
+        break;
+    case FRV_SUB:
+        e.alu(ALU_SUB, true);
+        break;
+    case FRV_SUBW:
+        e.alu(ALU_SUB, false);
+        e.sign_extend_32();
+        break;
+    case FRV_AND:
+    case FRV_ANDI:
+        e.alu(ALU_AND, true);
+        break;
+    case FRV_OR:
+    case FRV_ORI:
+        e.alu(ALU_OR, true);
+        break;
+    case FRV_XOR:
+    case FRV_XORI:
+        e.alu(ALU_XOR, true);
+        break;
+    case FRV_SLT:
+    case FRV_SLTI:
+        e.alu(ALU_CMP, true);
+        e.set_cond(CC_L);
+        break;
+    case FRV_SLTU:
+    case FRV_SLTIU:
+        e.alu(ALU_CMP, true);
+        e.set_cond(CC_B);
+        break;
+    // x86 masks the shift amount like RISC-V does
+    case FRV_SLL:
+    case FRV_SLLI:
+        e.shift(SHIFT_SHL, true);
+        break;
+    case FRV_SRL:
+    case FRV_SRLI:
+        e.shift(SHIFT_SHR, true);
+        break;
+    case FRV_SRA:
+    case FRV_SRAI:
+        e.shift(SHIFT_SAR, true);
+        break;
+    case FRV_SLLW:
+    case FRV_SLLIW:
+        e.shift(SHIFT_SHL, false);
+        e.sign_extend_32();
+        break;
+    case FRV_SRLW:
+    case FRV_SRLIW:
+        e.shift(SHIFT_SHR, false);
+        e.sign_extend_32();
+        break;
+    case FRV_SRAW:
+    case FRV_SRAIW:
+        e.shift(SHIFT_SAR, false);
+        e.sign_extend_32();
+        break;
+    case FRV_MUL:
+        e.imul(true);
+        break;
+    case FRV_MULW:
+        e.imul(false);
+        e.sign_extend_32();
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+bool is_immediate_op(const FrvInst &instr) {
+    switch (instr.mnem) {
+    case FRV_ADDI:
+    case FRV_ADDIW:
+    case FRV_ANDI:
+    case FRV_ORI:
+    case FRV_XORI:
+    case FRV_SLTI:
+    case FRV_SLTIU:
+    case FRV_SLLI:
+    case FRV_SRLI:
+    case FRV_SRAI:
+    case FRV_SLLIW:
+    case FRV_SRLIW:
+    case FRV_SRAIW:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// loads and stores address the guest memory directly, rs1 + imm is computed in the addressing mode
+bool compile_memory(Emitter &e, const FrvInst &instr) {
+    switch (instr.mnem) {
+    case FRV_LB:
+    case FRV_LH:
+    case FRV_LW:
+    case FRV_LD:
+    case FRV_LBU:
+    case FRV_LHU:
+    case FRV_LWU:
+        // like the interpreter, loads to x0 don't access memory
+        if (instr.rd == 0) {
+            return true;
+        }
+        e.load_static(RAX, instr.rs1);
+        switch (instr.mnem) {
+        case FRV_LB:
+            // movsx rax, byte ptr
+            e.byte(REX_W);
+            e.byte(0x0F);
+            e.byte(0xBE);
+            break;
+        case FRV_LH:
+            // movsx rax, word ptr
+            e.byte(REX_W);
+            e.byte(0x0F);
+            e.byte(0xBF);
+            break;
+        case FRV_LW:
+            // movsxd rax, dword ptr
+            e.byte(REX_W);
+            e.byte(0x63);
+            break;
+        case FRV_LD:
+            e.byte(REX_W);
+            e.byte(0x8B);
+            break;
+        case FRV_LBU:
+            // movzx eax, byte ptr
+            e.byte(0x0F);
+            e.byte(0xB6);
+            break;
+        case FRV_LHU:
+            // movzx eax, word ptr
+            e.byte(0x0F);
+            e.byte(0xB7);
+            break;
+        default:
+            // mov eax, dword ptr
+            e.byte(0x8B);
+            break;
+        }
+        e.mem_rax(RAX, instr.imm);
+        e.store_static(instr.rd, RAX);
+        return true;
+    case FRV_SB:
+    case FRV_SH:
+    case FRV_SW:
+    case FRV_SD:
+        e.load_static(RAX, instr.rs1);
+        e.load_static(RCX, instr.rs2);
+        switch (instr.mnem) {
+        case FRV_SB:
+            e.byte(0x88);
+            break;
+        case FRV_SH:
+            e.byte(0x66);
+            e.byte(0x89);
+            break;
+        case FRV_SW:
+            e.byte(0x89);
+            break;
+        default:
+            e.byte(REX_W);
+            e.byte(0x89);
+            break;
+        }
+        e.mem_rax(RCX, instr.imm);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// the last instruction of a block leaves the next guest address in rax
+bool compile_control_flow(Emitter &e, const FrvInst &instr, const uint64_t pc, const uint64_t next_pc) {
+    Cond cond;
+    switch (instr.mnem) {
+    case FRV_JAL:
+        e.mov_imm(RDX, next_pc);
+        e.store_static(instr.rd, RDX);
+        e.mov_imm(RAX, pc + static_cast<int64_t>(instr.imm));
+        return true;
+    case FRV_JALR:
+        // the target is computed before rd is written as rd may be rs1
+        e.load_static(RAX, instr.rs1);
+        e.mov_imm(RCX, static_cast<int64_t>(instr.imm));
+        e.alu(ALU_ADD, true);
+        // and rax, -2
+        e.byte(REX_W);
+        e.byte(0x83);
+        e.byte(0xE0);
+        e.byte(0xFE);
+        e.mov_imm(RDX, next_pc);
+        e.store_static(instr.rd, RDX);
+        return true;
+    case FRV_BEQ:
+        cond = CC_E;
+        break;
+    case FRV_BNE:
+        cond = CC_NE;
+        break;
+    case FRV_BLT:
+        cond = CC_L;
+        break;
+    case FRV_BGE:
+        cond = CC_GE;
+        break;
+    case FRV_BLTU:
+        cond = CC_B;
+        break;
+    case FRV_BGEU:
+        cond = CC_AE;
+        break;
+    default:
+        return false;
+    }
+
+    // the moves of the addresses keep the flags of the comparison
+    e.load_static(RAX, instr.rs1);
+    e.load_static(RCX, instr.rs2);
+    e.alu(ALU_CMP, true);
+    e.mov_imm(RAX, next_pc);
+    e.mov_imm(RDX, pc + static_cast<int64_t>(instr.imm));
+    e.cmov_cond(cond);
+    return true;
+}
+
+bool compile_instr(Emitter &e, const FrvInst &instr, const uint64_t pc) {
+    switch (instr.mnem) {
+    case FRV_LUI:
+        e.mov_imm(RAX, static_cast<int64_t>(instr.imm));
+        e.store_static(instr.rd, RAX);
+        return true;
+    case FRV_AUIPC:
+        e.mov_imm(RAX, pc + static_cast<int64_t>(instr.imm));
+        e.store_static(instr.rd, RAX);
+        return true;
+    case FRV_FENCE:
+        if (thread::multithreaded && interpreter::fence_needs_barrier(instr.imm)) {
+            e.mfence();
+        }
+        return true;
+    case FRV_FENCEI:
+        return true;
+    default:
+        break;
+    }
+
+    if (compile_memory(e, instr)) {
+        return true;
+    }
+
+    const size_t start = e.size;
+    e.load_static(RAX, instr.rs1);
+    if (is_immediate_op(instr)) {
+        e.mov_imm(RCX, static_cast<int64_t>(instr.imm));
+    } else {
+        e.load_static(RCX, instr.rs2);
+    }
+    if (!compile_arithmetic(e, instr)) {
+        e.size = start;
+        return false;
+    }
+    e.store_static(instr.rd, RAX);
+    return true;
+}
+
+bool protect(const size_t offset, const size_t size, const size_t prot) {
+    const size_t start = offset & ~(PAGE_SIZE - 1);
+    const size_t end = (offset + size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    return syscall3(AMD64_SYSCALL_ID::MPROTECT, reinterpret_cast<size_t>(code_buffer + start), end - start, prot) == 0;
+}
+
+bool emit_block(Emitter &e, const DecodedBlock &block) {
+    uint64_t pc = block.pc;
+    for (uint32_t i = 0; i < block.instr_count; ++i) {
+        const auto &decoded = block.instrs[i];
+        if (decoded.len < 0) {
+            return false;
+        }
+        const uint64_t next_pc = pc + decoded.len;
+        if (i + 1 == block.instr_count && compile_control_flow(e, decoded.instr, pc, next_pc)) {
+            e.ret();
+            return true;
+        }
+        if (!compile_instr(e, decoded.instr, pc)) {
+            return false;
+        }
+        pc = next_pc;
+    }
+
+    // the block was split, it continues after its last instruction
+    e.mov_imm(RAX, pc);
+    e.ret();
+    return true;
+}
+
+} // namespace
+
+CompiledBlock compile_block(const DecodedBlock &block) {
+    if (disabled || block.instr_count == 0) {
+        return nullptr;
+    }
+    if (code_buffer == nullptr) {
+        const auto res = syscall6(AMD64_SYSCALL_ID::MMAP, 0, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, static_cast<size_t>(-1), 0);
+        if (res > static_cast<size_t>(-4096)) {
+            disabled = true;
+            return nullptr;
+        }
+        code_buffer = reinterpret_cast<uint8_t *>(res);
+    }
+
+    // the pages are only writable while a block is emitted
+    const size_t max_size = (block.instr_count + 2) * MAX_INSTR_CODE_SIZE;
+    if (code_buffer_used + max_size > CODE_BUFFER_SIZE || !protect(code_buffer_used, max_size, PROT_READ | PROT_WRITE)) {
+        return nullptr;
+    }
+    Emitter e{code_buffer + code_buffer_used};
+    const bool success = emit_block(e, block);
+    if (!protect(code_buffer_used, max_size, PROT_READ | PROT_EXEC)) {
+        panic("jit: unable to make the code buffer executable");
+    }
+    if (!success) {
+        return nullptr;
+    }
+
+    const auto compiled = reinterpret_cast<CompiledBlock>(code_buffer + code_buffer_used);
+    code_buffer_used += (e.size + 15) & ~static_cast<size_t>(15);
+    return compiled;
+}
+
+void reset() { code_buffer_used = 0; }
+
+} // namespace helper::jit
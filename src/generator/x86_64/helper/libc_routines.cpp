@@ -0,0 +1,173 @@
+#include "generator/x86_64/helper/helper.h"
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * SSE2 implementations of the libc routines the lifter substitutes (lifter option libc_subst). The translated code
+ * calls the libc_* entry points directly with the arguments from a0-a2 and writes the result to a0, so the results are
+ * returned as 64 bit values like in the RISC-V calling convention.
+ *
+ * The byte loops must not be turned back into calls to the libc functions since the helper library is not linked
+ * against any libc.
+ */
+#define NO_LIBC_CALLS __attribute__((optimize("no-tree-loop-distribute-patterns")))
+
+namespace helper {
+
+namespace {
+
+constexpr uintptr_t PAGE_SIZE = 4096;
+constexpr size_t VEC_SIZE = sizeof(__m128i);
+
+// an unaligned vector load starting at ptr doesn't touch the next page
+inline bool vec_fits_page(const uint8_t *ptr) { return (reinterpret_cast<uintptr_t>(ptr) & (PAGE_SIZE - 1)) <= PAGE_SIZE - VEC_SIZE; }
+
+inline __m128i load(const uint8_t *ptr) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(ptr)); }
+
+inline void store(uint8_t *ptr, __m128i val) { _mm_storeu_si128(reinterpret_cast<__m128i *>(ptr), val); }
+
+NO_LIBC_CALLS void *rv_memcpy(uint8_t *dst, const uint8_t *src, size_t count) {
+    if (count >= VEC_SIZE) {
+        // the last vector overlaps the previous one instead of copying the tail bytewise
+        const auto tail = load(src + count - VEC_SIZE);
+        for (size_t i = 0; i + VEC_SIZE <= count; i += VEC_SIZE) {
+            store(dst + i, load(src + i));
+        }
+        store(dst + count - VEC_SIZE, tail);
+        return dst;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = src[i];
+    }
+    return dst;
+}
+
+NO_LIBC_CALLS void *rv_memset(uint8_t *dst, uint8_t val, size_t count) {
+    const auto vec = _mm_set1_epi8(static_cast<char>(val));
+    size_t i = 0;
+    for (; i + VEC_SIZE <= count; i += VEC_SIZE) {
+        store(dst + i, vec);
+    }
+    for (; i < count; ++i) {
+        dst[i] = val;
+    }
+    return dst;
+}
+
+NO_LIBC_CALLS void *rv_memmove(uint8_t *dst, const uint8_t *src, size_t count) {
+    if (dst <= src || dst >= src + count) {
+        // every vector is loaded before it's stored, so copying forwards is safe if dst is below src
+        size_t i = 0;
+        for (; i + VEC_SIZE <= count; i += VEC_SIZE) {
+            store(dst + i, load(src + i));
+        }
+        for (; i < count; ++i) {
+            dst[i] = src[i];
+        }
+        return dst;
+    }
+
+    size_t i = count;
+    for (; i >= VEC_SIZE; i -= VEC_SIZE) {
+        store(dst + i - VEC_SIZE, load(src + i - VEC_SIZE));
+    }
+    for (; i > 0; --i) {
+        dst[i - 1] = src[i - 1];
+    }
+    return dst;
+}
+
+size_t rv_strlen(const uint8_t *str) {
+    // aligned loads never cross a page boundary, so reading past the terminator can't fault
+    const auto offset = reinterpret_cast<uintptr_t>(str) & (VEC_SIZE - 1);
+    const auto *ptr = str - offset;
+    const auto zero = _mm_setzero_si128();
+
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(ptr)), zero))) >> offset;
+    if (mask) {
+        return __builtin_ctz(mask);
+    }
+
+    while (true) {
+        ptr += VEC_SIZE;
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(ptr)), zero));
+        if (mask) {
+            return ptr - str + __builtin_ctz(mask);
+        }
+    }
+}
+
+int64_t rv_strcmp(const uint8_t *lhs, const uint8_t *rhs) {
+    const auto zero = _mm_setzero_si128();
+    while (true) {
+        if (vec_fits_page(lhs) && vec_fits_page(rhs)) {
+            const auto lhs_vec = load(lhs);
+            const auto rhs_vec = load(rhs);
+            // stop at the first differing byte or the terminator
+            const auto diff = _mm_andnot_si128(_mm_cmpeq_epi8(lhs_vec, rhs_vec), _mm_set1_epi8(-1));
+            const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(diff, _mm_cmpeq_epi8(lhs_vec, zero))));
+            if (mask) {
+                const auto idx = __builtin_ctz(mask);
+                return static_cast<int64_t>(lhs[idx]) - static_cast<int64_t>(rhs[idx]);
+            }
+            lhs += VEC_SIZE;
+            rhs += VEC_SIZE;
+            continue;
+        }
+
+        // close to the end of a page, compare bytewise until both pointers have crossed it
+        for (size_t i = 0; i < VEC_SIZE; ++i, ++lhs, ++rhs) {
+            if (*lhs != *rhs || *lhs == 0) {
+                return static_cast<int64_t>(*lhs) - static_cast<int64_t>(*rhs);
+            }
+        }
+    }
+}
+
+const void *rv_memchr(const uint8_t *ptr, uint8_t val, size_t count) {
+    if (count == 0) {
+        return nullptr;
+    }
+
+    // aligned loads like strlen: the caller's count may be larger than the object if the byte is contained
+    const auto offset = reinterpret_cast<uintptr_t>(ptr) & (VEC_SIZE - 1);
+    const auto *block = ptr - offset;
+    const auto vec = _mm_set1_epi8(static_cast<char>(val));
+
+    // bit 0 of the mask belongs to ptr + base
+    auto mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(block)), vec))) >> offset;
+    size_t base = 0;
+    while (true) {
+        if (mask) {
+            const size_t idx = base + __builtin_ctz(mask);
+            return idx < count ? ptr + idx : nullptr;
+        }
+        block += VEC_SIZE;
+        base = block - ptr;
+        if (base >= count) {
+            return nullptr;
+        }
+        mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_load_si128(reinterpret_cast<const __m128i *>(block)), vec));
+    }
+}
+
+} // namespace
+
+// the arguments are the full 64 bit registers, so the byte arguments are truncated here
+extern "C" {
+uint64_t libc_memcpy(uint64_t dst, uint64_t src, uint64_t count) { return reinterpret_cast<uint64_t>(rv_memcpy(reinterpret_cast<uint8_t *>(dst), reinterpret_cast<const uint8_t *>(src), count)); }
+
+uint64_t libc_memset(uint64_t dst, uint64_t val, uint64_t count) { return reinterpret_cast<uint64_t>(rv_memset(reinterpret_cast<uint8_t *>(dst), static_cast<uint8_t>(val), count)); }
+
+uint64_t libc_memmove(uint64_t dst, uint64_t src, uint64_t count) { return reinterpret_cast<uint64_t>(rv_memmove(reinterpret_cast<uint8_t *>(dst), reinterpret_cast<const uint8_t *>(src), count)); }
+
+uint64_t libc_strlen(uint64_t str) { return rv_strlen(reinterpret_cast<const uint8_t *>(str)); }
+
+uint64_t libc_strcmp(uint64_t str1, uint64_t str2) { return static_cast<uint64_t>(rv_strcmp(reinterpret_cast<const uint8_t *>(str1), reinterpret_cast<const uint8_t *>(str2))); }
+
+uint64_t libc_memchr(uint64_t ptr, uint64_t val, uint64_t count) { return reinterpret_cast<uint64_t>(rv_memchr(reinterpret_cast<const uint8_t *>(ptr), static_cast<uint8_t>(val), count)); }
+}
+
+} // namespace helper
@@ -0,0 +1,151 @@
+#include "generator/x86_64/helper/stats.h"
+
+#include "generator/x86_64/helper/helper.h"
+#include "generator/x86_64/helper/interpreter.h"
+
+#include <fcntl.h>
+
+extern "C" {
+uint64_t stats_ijump_lookups = 0;
+uint64_t stats_ijump_lookup_misses = 0;
+uint64_t stats_ret_mispredicts = 0;
+uint64_t stats_rounding_switches = 0;
+}
+
+namespace helper::stats {
+
+const char *output_path = nullptr;
+
+SyscallStats syscalls[static_cast<size_t>(RISCV_SYSCALL_ID::SYSCALL_ID_MAX) + 1];
+
+void record_syscall(const uint64_t id, const uint64_t cycles) {
+    // libc routines go through syscall_impl too, they are not counted
+    if (id <= static_cast<uint64_t>(RISCV_SYSCALL_ID::SYSCALL_ID_MAX)) {
+        __atomic_fetch_add(&syscalls[id].count, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&syscalls[id].cycles, cycles, __ATOMIC_RELAXED);
+    }
+}
+
+namespace {
+
+/* buffers the output so the file isn't written with a syscall per number */
+struct Writer {
+    int64_t fd;
+    size_t len = 0;
+    char buf[4096];
+
+    void flush() {
+        syscall3(AMD64_SYSCALL_ID::WRITE, fd, reinterpret_cast<size_t>(buf), len);
+        len = 0;
+    }
+
+    void str(const char *str) {
+        while (*str) {
+            if (len == sizeof(buf)) {
+                flush();
+            }
+            buf[len++] = *str++;
+        }
+    }
+
+    void dec(uint64_t val) {
+        char out[20 + 1];
+        char *digits = &out[20];
+        *digits = '\0';
+        do {
+            *--digits = static_cast<char>('0' + val % 10);
+            val /= 10;
+        } while (val != 0);
+        str(digits);
+    }
+
+    // JSON has no hex numbers, addresses are written as strings
+    void hex_str(const uint64_t val) {
+        char out[1 + 2 + 16 + 1 + 1] = "\"0x";
+        utoa(val, &out[3], 16, 16);
+        out[19] = '"';
+        out[20] = '\0';
+        str(out);
+    }
+};
+
+} // namespace
+
+void write() {
+    if (!stats_counted) {
+        return;
+    }
+    // only written once if multiple threads exit at the same time, the first one takes the path
+    const char *const path = __atomic_exchange_n(&output_path, nullptr, __ATOMIC_ACQ_REL);
+    if (path == nullptr) {
+        return;
+    }
+
+    Writer out;
+    out.fd = static_cast<int64_t>(syscall4(AMD64_SYSCALL_ID::OPENAT, static_cast<size_t>(AT_FDCWD), reinterpret_cast<size_t>(path), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    if (out.fd < 0) {
+        puts("WARNING: the statistics file could not be opened\n");
+        return;
+    }
+
+    out.str("{\n  \"syscalls\": [");
+    bool first = true;
+    for (size_t id = 0; id <= static_cast<size_t>(RISCV_SYSCALL_ID::SYSCALL_ID_MAX); ++id) {
+        if (syscalls[id].count == 0) {
+            continue;
+        }
+        out.str(first ? "\n    {\"id\": " : ",\n    {\"id\": ");
+        out.dec(id);
+        out.str(", \"count\": ");
+        out.dec(syscalls[id].count);
+        out.str(", \"cycles\": ");
+        out.dec(syscalls[id].cycles);
+        out.str("}");
+        first = false;
+    }
+    out.str(first ? "],\n" : "\n  ],\n");
+
+    out.str("  \"ijump_lookups\": {\"count\": ");
+    out.dec(stats_ijump_lookups);
+    out.str(", \"hits\": ");
+    out.dec(stats_ijump_lookups - stats_ijump_lookup_misses);
+    out.str(", \"misses\": ");
+    out.dec(stats_ijump_lookup_misses);
+    out.str("},\n");
+
+    out.str("  \"return_mispredictions\": ");
+    out.dec(stats_ret_mispredicts);
+    out.str(",\n  \"rounding_mode_switches\": ");
+    out.dec(stats_rounding_switches);
+    out.str(",\n");
+
+    out.str("  \"interpreter\": {\n    \"entries\": ");
+    out.dec(interpreter::perf_enter_count);
+    out.str(",\n    \"interpreted_instructions\": ");
+    out.dec(interpreter::perf_instr_count);
+    out.str(",\n    \"decoded_blocks\": ");
+    out.dec(interpreter::perf_block_decode_count);
+    out.str(",\n    \"compiled_blocks\": ");
+    out.dec(interpreter::perf_block_compile_count);
+    out.str(",\n    \"by_pc\": [");
+    first = true;
+    for (const auto &entry : interpreter::entry_stats) {
+        if (entry.addr == 0) {
+            continue;
+        }
+        out.str(first ? "\n      {\"pc\": " : ",\n      {\"pc\": ");
+        out.hex_str(entry.addr);
+        out.str(", \"entries\": ");
+        out.dec(entry.count);
+        out.str(", \"instructions\": ");
+        out.dec(entry.instr_count);
+        out.str("}");
+        first = false;
+    }
+    out.str(first ? "]\n  }\n}\n" : "\n    ]\n  }\n}\n");
+
+    out.flush();
+    syscall1(AMD64_SYSCALL_ID::CLOSE, out.fd);
+}
+
+} // namespace helper::stats
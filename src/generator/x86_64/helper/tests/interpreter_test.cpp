@@ -0,0 +1,271 @@
+#include "generator/syscall_ids.h"
+#include "test_env.h"
+
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <gtest/gtest.h>
+
+using namespace helper_test;
+using namespace helper_test::rv;
+
+class Interpreter : public ::testing::Test {
+  protected:
+    void SetUp() override { reset_guest(); }
+};
+
+TEST_F(Interpreter, arithmetic) {
+    const Program program({
+        addi(T0, ZERO, -7),
+        addi(T1, ZERO, 5),
+        add(A0, T0, T1),
+        sub(A1, T1, T0),
+        slti(A2, T0, 0),
+        sltu(A3, T1, T0),
+        lui(T2, 0x12345000),
+        xori(T2, T2, 0x678),
+        slli(RA, T1, 62),
+        srai(SP, RA, 60),
+        addiw(A7, T2, 0x7FF),
+    });
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+
+    EXPECT_EQ(regs()[A0], static_cast<uint64_t>(-2));
+    EXPECT_EQ(regs()[A1], 12u);
+    EXPECT_EQ(regs()[A2], 1u);
+    // -7 is the larger one unsigned
+    EXPECT_EQ(regs()[A3], 1u);
+    EXPECT_EQ(regs()[T2], 0x12345678u);
+    EXPECT_EQ(regs()[RA], uint64_t{1} << 62);
+    EXPECT_EQ(regs()[SP], 4u);
+    EXPECT_EQ(regs()[A7], 0x12345E77u);
+}
+
+TEST_F(Interpreter, word_ops_sign_extend) {
+    regs()[T0] = 0x7FFF'FFFF;
+    const Program program({
+        addiw(A0, T0, 1),
+        addw(A1, T0, T0),
+    });
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+
+    EXPECT_EQ(regs()[A0], 0xFFFF'FFFF'8000'0000);
+    EXPECT_EQ(regs()[A1], 0xFFFF'FFFF'FFFF'FFFE);
+}
+
+TEST_F(Interpreter, writes_to_zero_are_ignored) {
+    int64_t mem = 0x1234;
+    regs()[A0] = reinterpret_cast<uint64_t>(&mem);
+    const Program program({
+        addi(ZERO, ZERO, 5),
+        add(ZERO, A0, A0),
+        ld(ZERO, A0, 0),
+        lui(ZERO, 0x1000),
+        add(A1, ZERO, ZERO),
+    });
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+
+    EXPECT_EQ(regs()[ZERO], 0u);
+    EXPECT_EQ(regs()[A1], 0u);
+}
+
+TEST_F(Interpreter, pc_is_the_executed_instruction) {
+    const Program program({
+        auipc(T0, 0),
+        auipc(T1, 0x1000),
+        // skips the addi
+        jal(RA, 8),
+        addi(A0, ZERO, 1),
+        addi(A1, ZERO, 2),
+    });
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+
+    EXPECT_EQ(regs()[T0], program.addr(0));
+    EXPECT_EQ(regs()[T1], program.addr(1) + 0x1000);
+    // the link is the instruction after the jal
+    EXPECT_EQ(regs()[RA], program.addr(3));
+    EXPECT_EQ(regs()[A0], 0u);
+    EXPECT_EQ(regs()[A1], 2u);
+}
+
+TEST_F(Interpreter, jalr) {
+    const Program program({
+        auipc(T0, 0),
+        // to the last addi, the target is computed before rd is written
+        jalr(T0, T0, 16),
+        addi(A0, ZERO, 1),
+        addi(A0, ZERO, 2),
+        addi(A1, ZERO, 3),
+    });
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+
+    EXPECT_EQ(regs()[T0], program.addr(2));
+    EXPECT_EQ(regs()[A0], 0u);
+    EXPECT_EQ(regs()[A1], 3u);
+}
+
+TEST_F(Interpreter, branches) {
+    regs()[T0] = static_cast<uint64_t>(-1);
+    regs()[T1] = 1;
+    const Program program({
+        // not taken, the next instruction runs
+        beq(T0, T1, 8),
+        addi(A0, ZERO, 1),
+        // taken, skips one instruction
+        blt(T0, T1, 8),
+        addi(A1, ZERO, 1),
+        // -1 is larger unsigned
+        bgeu(T0, T1, 8),
+        addi(A2, ZERO, 1),
+        bne(T0, T0, 8),
+        addi(A3, ZERO, 1),
+    });
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+
+    EXPECT_EQ(regs()[A0], 1u);
+    EXPECT_EQ(regs()[A1], 0u);
+    EXPECT_EQ(regs()[A2], 0u);
+    EXPECT_EQ(regs()[A3], 1u);
+}
+
+TEST_F(Interpreter, backward_branch_loop) {
+    const Program program({
+        addi(T0, ZERO, 10),
+        // loop: sum up 10..1
+        add(A0, A0, T0),
+        addi(T0, T0, -1),
+        bne(T0, ZERO, -8),
+    });
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+
+    EXPECT_EQ(regs()[A0], 55u);
+    EXPECT_EQ(regs()[T0], 0u);
+}
+
+TEST_F(Interpreter, loads_and_stores) {
+    uint64_t mem[2] = {0, 0};
+    regs()[A0] = reinterpret_cast<uint64_t>(&mem[0]);
+    regs()[T0] = 0x8899'AABB'CCDD'EEFF;
+    const Program program({
+        sd(A0, T0, 0),
+        sw(A0, T0, 8),
+        sb(A0, T0, 12),
+        ld(A1, A0, 0),
+        lw(A2, A0, 8),
+        lwu(A3, A0, 8),
+        lb(T1, A0, 12),
+        lbu(T2, A0, 12),
+    });
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+
+    EXPECT_EQ(mem[0], 0x8899'AABB'CCDD'EEFF);
+    EXPECT_EQ(mem[1], 0xFF'CCDD'EEFFu);
+    EXPECT_EQ(regs()[A1], 0x8899'AABB'CCDD'EEFF);
+    EXPECT_EQ(regs()[A2], 0xFFFF'FFFF'CCDD'EEFF);
+    EXPECT_EQ(regs()[A3], 0xCCDD'EEFFu);
+    EXPECT_EQ(regs()[T1], static_cast<uint64_t>(-1));
+    EXPECT_EQ(regs()[T2], 0xFFu);
+}
+
+TEST_F(Interpreter, multiply_divide) {
+    regs()[T0] = static_cast<uint64_t>(-7);
+    regs()[T1] = 2;
+    regs()[T2] = uint64_t{1} << 63;
+    const Program program({
+        mul(A0, T0, T1),
+        mulh(A1, T2, T1),
+        div(A2, T0, T1),
+        divu(A3, T2, T1),
+        rem(A7, T0, T1),
+    });
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+
+    EXPECT_EQ(regs()[A0], static_cast<uint64_t>(-14));
+    EXPECT_EQ(regs()[A1], static_cast<uint64_t>(-1));
+    // rounded towards zero
+    EXPECT_EQ(regs()[A2], static_cast<uint64_t>(-3));
+    EXPECT_EQ(regs()[A3], uint64_t{1} << 62);
+    EXPECT_EQ(regs()[A7], static_cast<uint64_t>(-1));
+}
+
+TEST_F(Interpreter, fp_compare) {
+    const double d1 = 1.5, d2 = -2.0;
+    const float s1 = 0.25f, s2 = 0.25f;
+    std::memcpy(&fp_reg(1), &d1, sizeof(d1));
+    std::memcpy(&fp_reg(2), &d2, sizeof(d2));
+    std::memcpy(&fp_reg(3), &s1, sizeof(s1));
+    std::memcpy(&fp_reg(4), &s2, sizeof(s2));
+    const Program program({
+        flt_d(A0, 2, 1),
+        flt_d(A1, 1, 2),
+        fle_d(A2, 1, 1),
+        feq_d(A3, 1, 2),
+        flt_s(T0, 3, 4),
+        fle_s(T1, 3, 4),
+        feq_s(T2, 3, 4),
+        // only written to integer registers, x0 stays 0
+        feq_s(ZERO, 3, 4),
+    });
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+
+    EXPECT_EQ(regs()[A0], 1u);
+    EXPECT_EQ(regs()[A1], 0u);
+    EXPECT_EQ(regs()[A2], 1u);
+    EXPECT_EQ(regs()[A3], 0u);
+    EXPECT_EQ(regs()[T0], 0u);
+    EXPECT_EQ(regs()[T1], 1u);
+    EXPECT_EQ(regs()[T2], 1u);
+    EXPECT_EQ(regs()[ZERO], 0u);
+}
+
+TEST_F(Interpreter, ecall) {
+    syscall_result = 42;
+    const Program program({
+        addi(A7, ZERO, static_cast<int32_t>(RISCV_SYSCALL_ID::WRITE)),
+        addi(A0, ZERO, 1),
+        addi(A1, ZERO, 2),
+        addi(A2, ZERO, 3),
+        ecall(),
+        // continues after the ecall with its result
+        addi(A1, A0, 1),
+    });
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+
+    ASSERT_EQ(guest_syscalls.size(), 1u);
+    EXPECT_EQ(guest_syscalls[0].id, static_cast<uint64_t>(RISCV_SYSCALL_ID::WRITE));
+    EXPECT_EQ(guest_syscalls[0].args[0], 1u);
+    EXPECT_EQ(guest_syscalls[0].args[1], 2u);
+    EXPECT_EQ(guest_syscalls[0].args[2], 3u);
+    EXPECT_EQ(regs()[A0], 42u);
+    EXPECT_EQ(regs()[A1], 43u);
+}
+
+TEST_F(Interpreter, starts_at_any_instruction) {
+    const Program program({
+        addi(A0, ZERO, 1),
+        addi(A1, ZERO, 2),
+    });
+    ASSERT_EQ(program.run(1), EXIT_TARGET);
+
+    EXPECT_EQ(regs()[A0], 0u);
+    EXPECT_EQ(regs()[A1], 2u);
+}
+
+TEST(InterpreterDeathTest, ebreak_raises_sigill) {
+    const Program program({
+        addi(A0, ZERO, 1),
+        ebreak(),
+    });
+    EXPECT_EXIT(program.run(), ::testing::KilledBySignal(SIGILL), "Illegal instruction");
+}
+
+TEST(InterpreterDeathTest, undecodable_instruction_raises_sigill) {
+    // all zeros is defined to be illegal
+    const Program program({0});
+    EXPECT_EXIT(program.run(), ::testing::KilledBySignal(SIGILL), "Illegal instruction");
+}
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,128 @@
+#include "generator/x86_64/helper/interpreter.h"
+#include "test_env.h"
+
+#include <cstdint>
+#include <gtest/gtest.h>
+
+using namespace helper_test;
+using namespace helper_test::rv;
+using helper::interpreter::DecodedBlock;
+using helper::interpreter::DecodedInstr;
+
+namespace {
+
+/* the first count instructions of the program as the interpreter decodes them */
+struct TestBlock {
+    DecodedInstr instrs[16];
+    DecodedBlock block;
+
+    TestBlock(const Program &program, const uint32_t count) {
+        block = {};
+        block.pc = program.start;
+        block.instrs = instrs;
+        block.instr_count = count;
+        uint64_t pc = program.start;
+        for (uint32_t i = 0; i < count; ++i) {
+            instrs[i].len = frv_decode(4, reinterpret_cast<const uint8_t *>(pc), FRV_RV64, &instrs[i].instr);
+            instrs[i].handler = nullptr;
+            pc += 4;
+        }
+        block.end_pc = pc;
+    }
+};
+
+} // namespace
+
+class Jit : public ::testing::Test {
+  protected:
+    void SetUp() override { reset_guest(); }
+};
+
+TEST_F(Jit, straight_line_block) {
+    uint64_t mem = 0;
+    regs()[A0] = reinterpret_cast<uint64_t>(&mem);
+    const Program program({
+        addi(T0, ZERO, -7),
+        addi(T1, ZERO, 3),
+        mul(T2, T0, T1),
+        sd(A0, T2, 0),
+        lw(A1, A0, 0),
+        sltu(A2, T1, T0),
+        addiw(A3, T2, 1),
+        auipc(RA, 0x1000),
+    });
+    const TestBlock test_block(program, 8);
+    const auto compiled = helper::jit::compile_block(test_block.block);
+    ASSERT_NE(compiled, nullptr);
+
+    // the block was split, it continues after its last instruction
+    EXPECT_EQ(compiled(regs()), program.addr(8));
+    EXPECT_EQ(mem, static_cast<uint64_t>(-21));
+    EXPECT_EQ(regs()[T2], static_cast<uint64_t>(-21));
+    EXPECT_EQ(regs()[A1], static_cast<uint64_t>(-21));
+    EXPECT_EQ(regs()[A2], 1u);
+    EXPECT_EQ(regs()[A3], static_cast<uint64_t>(-20));
+    EXPECT_EQ(regs()[RA], program.addr(7) + 0x1000);
+    EXPECT_EQ(regs()[ZERO], 0u);
+}
+
+TEST_F(Jit, control_flow_returns_the_next_pc) {
+    const Program branch({
+        addi(T0, T0, 1),
+        blt(T0, T1, -4),
+    });
+    const auto compiled_branch = helper::jit::compile_block(TestBlock(branch, 2).block);
+    ASSERT_NE(compiled_branch, nullptr);
+    regs()[T1] = 2;
+    // taken back to the addi, then falls through
+    EXPECT_EQ(compiled_branch(regs()), branch.addr(0));
+    EXPECT_EQ(compiled_branch(regs()), branch.addr(2));
+
+    const Program jump({jal(RA, 16)});
+    const auto compiled_jal = helper::jit::compile_block(TestBlock(jump, 1).block);
+    ASSERT_NE(compiled_jal, nullptr);
+    EXPECT_EQ(compiled_jal(regs()), jump.addr(0) + 16);
+    EXPECT_EQ(regs()[RA], jump.addr(1));
+
+    // the lowest bit of the target is cleared, it's computed before rd is written
+    const Program indirect_jump({jalr(A0, A0, 3)});
+    const auto compiled_jalr = helper::jit::compile_block(TestBlock(indirect_jump, 1).block);
+    ASSERT_NE(compiled_jalr, nullptr);
+    regs()[A0] = 0x1000;
+    EXPECT_EQ(compiled_jalr(regs()), 0x1002u);
+    EXPECT_EQ(regs()[A0], indirect_jump.addr(1));
+}
+
+TEST_F(Jit, unsupported_blocks) {
+    // the interpreter keeps blocks with syscalls, divisions or floating point instructions
+    for (const auto instr : {ecall(), div(A0, A0, A1), feq_d(A0, 1, 2)}) {
+        const Program program({addi(A0, ZERO, 1), instr});
+        const TestBlock test_block(program, 2);
+        EXPECT_EQ(helper::jit::compile_block(test_block.block), nullptr);
+    }
+}
+
+TEST_F(Jit, hot_block_is_compiled_once) {
+    const Program program({
+        addi(T0, ZERO, 100),
+        // loop: sum up 100..1, the block of the loop gets hot
+        add(A0, A0, T0),
+        addi(T0, T0, -1),
+        bne(T0, ZERO, -8),
+    });
+    const auto compiles = helper::interpreter::perf_block_compile_count;
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+    EXPECT_EQ(regs()[A0], 5050u);
+    EXPECT_EQ(helper::interpreter::perf_block_compile_count, compiles + 1);
+
+    // The compiled block isn't registered with calc_target or the ijump lookup, so it is only reached through the
+    // interpreter: entering it again goes through unresolved_ijump_handler, which runs the cached compiled block
+    reset_guest();
+    const auto enters = helper::interpreter::perf_enter_count;
+    const auto decodes = helper::interpreter::perf_block_decode_count;
+    ASSERT_EQ(program.run(), EXIT_TARGET);
+    EXPECT_EQ(regs()[A0], 5050u);
+    EXPECT_EQ(helper::interpreter::perf_enter_count, enters + 1);
+    EXPECT_EQ(helper::interpreter::perf_block_decode_count, decodes);
+    EXPECT_EQ(helper::interpreter::perf_block_compile_count, compiles + 1);
+}
@@ -0,0 +1,125 @@
+#include "test_env.h"
+
+#include "generator/x86_64/helper/helper.h"
+#include "generator/x86_64/helper/stats.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+extern "C" uint64_t unresolved_ijump_handler(uint64_t pc);
+
+namespace helper_test {
+
+namespace {
+
+constexpr size_t CODE_ARENA_INSTRS = 1 << 16;
+uint32_t code_arena[CODE_ARENA_INSTRS];
+size_t code_arena_used = 0;
+
+// exit address of the program which is run
+uint64_t running_exit = 0;
+
+size_t host_syscall(const AMD64_SYSCALL_ID id, const size_t a1 = 0, const size_t a2 = 0, const size_t a3 = 0, const size_t a4 = 0, const size_t a5 = 0,
+                    const size_t a6 = 0) {
+    // the helper expects the raw result of the kernel
+    const long res = ::syscall(static_cast<long>(id), a1, a2, a3, a4, a5, a6);
+    return static_cast<size_t>(res == -1 ? -errno : res);
+}
+
+} // namespace
+
+std::vector<GuestSyscall> guest_syscalls;
+uint64_t syscall_result = 0;
+
+Program::Program(const std::vector<uint32_t> &instrs) {
+    // the instructions, the jal to the exit and the exit, which is never executed
+    if (code_arena_used + instrs.size() + 2 > CODE_ARENA_INSTRS) {
+        abort();
+    }
+    uint32_t *code = &code_arena[code_arena_used];
+    std::memcpy(code, instrs.data(), instrs.size() * sizeof(uint32_t));
+    code[instrs.size()] = rv::jal(rv::ZERO, 4);
+    code[instrs.size() + 1] = 0;
+    code_arena_used += instrs.size() + 2;
+
+    start = reinterpret_cast<uint64_t>(code);
+    exit = start + 4 * (instrs.size() + 1);
+}
+
+uint64_t Program::run(const size_t idx) const {
+    running_exit = exit;
+    return unresolved_ijump_handler(addr(idx));
+}
+
+void reset_guest() {
+    std::memset(regs(), 0, helper::REGISTER_FILE_SIZE * sizeof(uint64_t));
+    guest_syscalls.clear();
+    syscall_result = 0;
+}
+
+} // namespace helper_test
+
+extern "C" {
+// the counters themselves are in stats.cpp
+const bool stats_counted = false;
+
+uint64_t syscall_impl(const uint64_t id, const uint64_t arg0, const uint64_t arg1, const uint64_t arg2, const uint64_t arg3, const uint64_t arg4, const uint64_t arg5) {
+    helper_test::guest_syscalls.push_back({id, {arg0, arg1, arg2, arg3, arg4, arg5}});
+    return helper_test::syscall_result;
+}
+
+void panic(const char *err_msg) {
+    helper::puts(err_msg);
+    abort();
+}
+}
+
+namespace helper {
+
+bool have_fma = false;
+
+namespace thread {
+
+extern "C" {
+const bool multithreaded = false;
+uint64_t register_file[REGISTER_FILE_SIZE] = {};
+}
+
+bool creates_thread(uint64_t, uint64_t) { return false; }
+uint64_t clone_interpreted(uint64_t, uint64_t, uint64_t, uint64_t, uint64_t, uint64_t) { abort(); }
+void lock_interpreter() {}
+void unlock_interpreter() {}
+
+} // namespace thread
+
+size_t calc_target(const uint64_t addr) { return addr == helper_test::running_exit ? helper_test::EXIT_TARGET : 0; }
+
+size_t syscall0(AMD64_SYSCALL_ID id) { return helper_test::host_syscall(id); }
+size_t syscall1(AMD64_SYSCALL_ID id, size_t a1) { return helper_test::host_syscall(id, a1); }
+size_t syscall2(AMD64_SYSCALL_ID id, size_t a1, size_t a2) { return helper_test::host_syscall(id, a1, a2); }
+size_t syscall3(AMD64_SYSCALL_ID id, size_t a1, size_t a2, size_t a3) { return helper_test::host_syscall(id, a1, a2, a3); }
+size_t syscall4(AMD64_SYSCALL_ID id, size_t a1, size_t a2, size_t a3, size_t a4) { return helper_test::host_syscall(id, a1, a2, a3, a4); }
+size_t syscall5(AMD64_SYSCALL_ID id, size_t a1, size_t a2, size_t a3, size_t a4, size_t a5) { return helper_test::host_syscall(id, a1, a2, a3, a4, a5); }
+size_t syscall6(AMD64_SYSCALL_ID id, size_t a1, size_t a2, size_t a3, size_t a4, size_t a5, size_t a6) {
+    return helper_test::host_syscall(id, a1, a2, a3, a4, a5, a6);
+}
+
+size_t puts(const char *str) { return ::write(STDERR_FILENO, str, std::strlen(str)); }
+
+void utoa(uint64_t v, char *buf, unsigned int base, unsigned int num_digits) {
+    for (unsigned int i = num_digits; i > 0; --i) {
+        buf[i - 1] = "0123456789abcdef"[v % base];
+        v /= base;
+    }
+}
+
+void print_hex64(uint64_t val) {
+    char buf[17] = {};
+    utoa(val, buf, 16, 16);
+    puts(buf);
+}
+
+} // namespace helper
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "generator/x86_64/helper/thread.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/* Hosted environment for the interpreter and the jit of the helper library
+ * The tests link interpreter.cpp and jit.cpp against replacements of the rest of the helper (test_env.cpp): the
+ * syscall wrappers use the ones of libc, there is no translated code and calc_target only knows the address a
+ * program exits at. syscall_impl records the guest syscalls instead of emulating them.
+ */
+namespace helper_test {
+
+/* RISC-V encodings of the instructions used in the tests */
+namespace rv {
+
+enum Reg : uint32_t { ZERO = 0, RA = 1, SP = 2, T0 = 5, T1 = 6, T2 = 7, A0 = 10, A1 = 11, A2 = 12, A3 = 13, A7 = 17 };
+
+constexpr uint32_t r_type(const uint32_t opcode, const uint32_t funct3, const uint32_t funct7, const uint32_t rd, const uint32_t rs1, const uint32_t rs2) {
+    return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+constexpr uint32_t i_type(const uint32_t opcode, const uint32_t funct3, const uint32_t rd, const uint32_t rs1, const int32_t imm) {
+    return (static_cast<uint32_t>(imm & 0xFFF) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+constexpr uint32_t s_type(const uint32_t opcode, const uint32_t funct3, const uint32_t rs1, const uint32_t rs2, const int32_t imm) {
+    const auto uimm = static_cast<uint32_t>(imm);
+    return (((uimm >> 5) & 0x7F) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((uimm & 0x1F) << 7) | opcode;
+}
+constexpr uint32_t b_type(const uint32_t funct3, const uint32_t rs1, const uint32_t rs2, const int32_t imm) {
+    const auto uimm = static_cast<uint32_t>(imm);
+    return (((uimm >> 12) & 0x1) << 31) | (((uimm >> 5) & 0x3F) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (((uimm >> 1) & 0xF) << 8) |
+           (((uimm >> 11) & 0x1) << 7) | 0x63;
+}
+constexpr uint32_t u_type(const uint32_t opcode, const uint32_t rd, const int32_t imm) { return (static_cast<uint32_t>(imm) & 0xFFFFF000) | (rd << 7) | opcode; }
+constexpr uint32_t j_type(const uint32_t rd, const int32_t imm) {
+    const auto uimm = static_cast<uint32_t>(imm);
+    return (((uimm >> 20) & 0x1) << 31) | (((uimm >> 1) & 0x3FF) << 21) | (((uimm >> 11) & 0x1) << 20) | (((uimm >> 12) & 0xFF) << 12) | (rd << 7) | 0x6F;
+}
+
+constexpr uint32_t addi(const uint32_t rd, const uint32_t rs1, const int32_t imm) { return i_type(0x13, 0, rd, rs1, imm); }
+constexpr uint32_t slti(const uint32_t rd, const uint32_t rs1, const int32_t imm) { return i_type(0x13, 2, rd, rs1, imm); }
+constexpr uint32_t xori(const uint32_t rd, const uint32_t rs1, const int32_t imm) { return i_type(0x13, 4, rd, rs1, imm); }
+constexpr uint32_t slli(const uint32_t rd, const uint32_t rs1, const int32_t shamt) { return i_type(0x13, 1, rd, rs1, shamt); }
+constexpr uint32_t srai(const uint32_t rd, const uint32_t rs1, const int32_t shamt) { return i_type(0x13, 5, rd, rs1, 0x400 | shamt); }
+constexpr uint32_t addiw(const uint32_t rd, const uint32_t rs1, const int32_t imm) { return i_type(0x1B, 0, rd, rs1, imm); }
+constexpr uint32_t add(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x33, 0, 0, rd, rs1, rs2); }
+constexpr uint32_t sub(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x33, 0, 0x20, rd, rs1, rs2); }
+constexpr uint32_t sltu(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x33, 3, 0, rd, rs1, rs2); }
+constexpr uint32_t addw(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x3B, 0, 0, rd, rs1, rs2); }
+constexpr uint32_t mul(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x33, 0, 1, rd, rs1, rs2); }
+constexpr uint32_t mulh(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x33, 1, 1, rd, rs1, rs2); }
+constexpr uint32_t div(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x33, 4, 1, rd, rs1, rs2); }
+constexpr uint32_t divu(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x33, 5, 1, rd, rs1, rs2); }
+constexpr uint32_t rem(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x33, 6, 1, rd, rs1, rs2); }
+constexpr uint32_t lui(const uint32_t rd, const int32_t imm) { return u_type(0x37, rd, imm); }
+constexpr uint32_t auipc(const uint32_t rd, const int32_t imm) { return u_type(0x17, rd, imm); }
+constexpr uint32_t lb(const uint32_t rd, const uint32_t rs1, const int32_t imm) { return i_type(0x03, 0, rd, rs1, imm); }
+constexpr uint32_t lw(const uint32_t rd, const uint32_t rs1, const int32_t imm) { return i_type(0x03, 2, rd, rs1, imm); }
+constexpr uint32_t ld(const uint32_t rd, const uint32_t rs1, const int32_t imm) { return i_type(0x03, 3, rd, rs1, imm); }
+constexpr uint32_t lbu(const uint32_t rd, const uint32_t rs1, const int32_t imm) { return i_type(0x03, 4, rd, rs1, imm); }
+constexpr uint32_t lwu(const uint32_t rd, const uint32_t rs1, const int32_t imm) { return i_type(0x03, 6, rd, rs1, imm); }
+constexpr uint32_t sb(const uint32_t rs1, const uint32_t rs2, const int32_t imm) { return s_type(0x23, 0, rs1, rs2, imm); }
+constexpr uint32_t sw(const uint32_t rs1, const uint32_t rs2, const int32_t imm) { return s_type(0x23, 2, rs1, rs2, imm); }
+constexpr uint32_t sd(const uint32_t rs1, const uint32_t rs2, const int32_t imm) { return s_type(0x23, 3, rs1, rs2, imm); }
+constexpr uint32_t beq(const uint32_t rs1, const uint32_t rs2, const int32_t imm) { return b_type(0, rs1, rs2, imm); }
+constexpr uint32_t bne(const uint32_t rs1, const uint32_t rs2, const int32_t imm) { return b_type(1, rs1, rs2, imm); }
+constexpr uint32_t blt(const uint32_t rs1, const uint32_t rs2, const int32_t imm) { return b_type(4, rs1, rs2, imm); }
+constexpr uint32_t bgeu(const uint32_t rs1, const uint32_t rs2, const int32_t imm) { return b_type(7, rs1, rs2, imm); }
+constexpr uint32_t jal(const uint32_t rd, const int32_t imm) { return j_type(rd, imm); }
+constexpr uint32_t jalr(const uint32_t rd, const uint32_t rs1, const int32_t imm) { return i_type(0x67, 0, rd, rs1, imm); }
+// the comparisons of the F and D extension write an integer register
+constexpr uint32_t fle_s(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x53, 0, 0x50, rd, rs1, rs2); }
+constexpr uint32_t flt_s(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x53, 1, 0x50, rd, rs1, rs2); }
+constexpr uint32_t feq_s(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x53, 2, 0x50, rd, rs1, rs2); }
+constexpr uint32_t fle_d(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x53, 0, 0x51, rd, rs1, rs2); }
+constexpr uint32_t flt_d(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x53, 1, 0x51, rd, rs1, rs2); }
+constexpr uint32_t feq_d(const uint32_t rd, const uint32_t rs1, const uint32_t rs2) { return r_type(0x53, 2, 0x51, rd, rs1, rs2); }
+constexpr uint32_t ecall() { return 0x00000073; }
+constexpr uint32_t ebreak() { return 0x00100073; }
+
+} // namespace rv
+
+/* returned by calc_target for the exit address of the running program */
+constexpr inline uint64_t EXIT_TARGET = 0xE817'0000;
+
+/* A guest program in the code arena, its instructions are followed by a jal to the exit address. Programs are never
+ * freed, so the block cache of the interpreter never sees two programs at the same address. */
+struct Program {
+    uint64_t start, exit;
+
+    explicit Program(const std::vector<uint32_t> &instrs);
+
+    // address of the instruction at idx
+    [[nodiscard]] uint64_t addr(const size_t idx) const { return start + 4 * idx; }
+
+    // runs the program from idx on in the interpreter, the result is the one of unresolved_ijump_handler
+    uint64_t run(size_t idx = 0) const;
+};
+
+struct GuestSyscall {
+    uint64_t id, args[6];
+};
+
+/* the syscalls made by the guest since the last reset, syscall_impl returns syscall_result for all of them */
+extern std::vector<GuestSyscall> guest_syscalls;
+extern uint64_t syscall_result;
+
+/* clears the register file and the recorded syscalls */
+void reset_guest();
+
+inline uint64_t *regs() { return helper::thread::register_file; }
+
+// the floating point registers follow the integer ones and the fcsr in the register_file
+inline uint64_t &fp_reg(const size_t idx) { return regs()[33 + idx]; }
+
+} // namespace helper_test
@@ -0,0 +1,205 @@
+#include "generator/x86_64/helper/thread.h"
+
+#include "generator/syscall_ids.h"
+#include "generator/x86_64/helper/helper.h"
+
+#include <asm/prctl.h>
+#include <linux/errno.h>
+#include <linux/futex.h>
+#include <linux/sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+
+extern "C" {
+/* raw clone, the new thread pops the EntryFrame at the top of its stack and returns to it with rax = 0 (wrappers.S) */
+uint64_t clone_thread(uint64_t flags, uint8_t *stack, uint64_t parent_tid, uint64_t child_tid, helper::ThreadControlBlock *tls);
+
+/* from compiled code, only emitted with --multithreaded: pops a guest address and runs it through the interpreter */
+[[gnu::weak]] void thread_start();
+
+/* pushes tcb onto *free_list (next is &tcb->next_free) and exits the thread without using its stack anymore (wrappers.S) */
+[[noreturn]] void exit_to_free_list(helper::ThreadControlBlock **free_list, helper::ThreadControlBlock *tcb, helper::ThreadControlBlock **next, uint64_t status);
+}
+
+namespace helper::thread {
+
+namespace {
+/* host stack of a new thread, its ThreadControlBlock is at the top. The stack and the block of an exited thread can't
+ * be unmapped by the thread itself since it still runs on them, they are put on free_blocks for the next thread instead. */
+constexpr size_t STACK_SIZE = 8 * 1024 * 1024;
+/* the return stack is reset before it grows into this part of the stack, which is left for frames and the helpers */
+constexpr size_t STACK_RESERVE = 256 * 1024;
+
+/* threads which haven't exited yet */
+uint64_t live_threads = 1;
+
+/* futexes of the interpreter lock and the lock of the threads taking blocks from free_blocks,
+ * 0: unlocked, 1: locked, 2: locked and there may be waiters */
+uint32_t interpreter_lock = 0;
+uint32_t free_blocks_lock = 0;
+
+/* Blocks of exited threads, linked through next_free. Exiting threads push without the lock, only one thread pops at a
+ * time so a block can't be popped and pushed again between reading the head and swapping it. */
+ThreadControlBlock *free_blocks = nullptr;
+
+void lock(uint32_t &futex) {
+    uint32_t state = 0;
+    if (__atomic_compare_exchange_n(&futex, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    if (state != 2) {
+        state = __atomic_exchange_n(&futex, 2, __ATOMIC_ACQUIRE);
+    }
+    while (state != 0) {
+        syscall4(AMD64_SYSCALL_ID::FUTEX, reinterpret_cast<size_t>(&futex), FUTEX_WAIT_PRIVATE, 2, 0);
+        state = __atomic_exchange_n(&futex, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+void unlock(uint32_t &futex) {
+    if (__atomic_exchange_n(&futex, 0, __ATOMIC_RELEASE) == 2) {
+        syscall3(AMD64_SYSCALL_ID::FUTEX, reinterpret_cast<size_t>(&futex), FUTEX_WAKE_PRIVATE, 1);
+    }
+}
+
+ThreadControlBlock *pop_free_block() {
+    lock(free_blocks_lock);
+    auto *tcb = __atomic_load_n(&free_blocks, __ATOMIC_ACQUIRE);
+    while (tcb != nullptr && !__atomic_compare_exchange_n(&free_blocks, &tcb, tcb->next_free, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+    }
+    unlock(free_blocks_lock);
+    return tcb;
+}
+
+void push_free_block(ThreadControlBlock *tcb) {
+    auto *head = __atomic_load_n(&free_blocks, __ATOMIC_RELAXED);
+    do {
+        tcb->next_free = head;
+    } while (!__atomic_compare_exchange_n(&free_blocks, &head, tcb, false, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/* reuses or maps the stack of a new thread and sets up its block with a copy of the register file of the calling thread */
+ThreadControlBlock *create_block(const uint64_t flags, const uint64_t stack, const uint64_t tls) {
+    if (!multithreaded) {
+        panic("Creating threads needs a binary translated with --multithreaded");
+    }
+
+    uint64_t mapping;
+    auto *tcb = pop_free_block();
+    if (tcb != nullptr) {
+        // the limit of the return stack is at a fixed offset from the start of the mapping
+        mapping = tcb->ret_stack_limit - STACK_RESERVE;
+    } else {
+        mapping = syscall6(AMD64_SYSCALL_ID::MMAP, 0, STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_STACK, static_cast<size_t>(-1), 0);
+        if (mapping > static_cast<size_t>(-4096)) {
+            return nullptr;
+        }
+        tcb = reinterpret_cast<ThreadControlBlock *>((mapping + STACK_SIZE - sizeof(ThreadControlBlock)) & ~static_cast<size_t>(63));
+    }
+
+    memcpy(tcb->register_file, current()->register_file, sizeof(tcb->register_file));
+    // the new thread gets 0 from the clone and starts on the given stack
+    tcb->register_file[10] = 0;
+    tcb->register_file[2] = stack;
+    if (flags & CLONE_SETTLS) {
+        tcb->register_file[4] = tls;
+    }
+    tcb->self = tcb;
+    tcb->init_stack_ptr = 0;
+    // two zeros like _start pushes them, no return matches them
+    auto *ret_stack = reinterpret_cast<uint64_t *>(tcb) - 2;
+    ret_stack[0] = ret_stack[1] = 0;
+    tcb->init_ret_stack_ptr = reinterpret_cast<uint64_t>(ret_stack);
+    tcb->ret_stack_limit = mapping + STACK_RESERVE;
+    tcb->reservation = 0;
+    tcb->next_free = nullptr;
+    return tcb;
+}
+
+uint64_t start(const uint64_t flags, const uint64_t parent_tid, const uint64_t child_tid, ThreadControlBlock *tcb, uint8_t *stack) {
+    // fs of the new thread points at its block, the RISC-V thread pointer is a static
+    __atomic_add_fetch(&live_threads, 1, __ATOMIC_RELAXED);
+    const auto res = clone_thread(flags | CLONE_SETTLS, stack, parent_tid, child_tid, tcb);
+    if (res > static_cast<uint64_t>(-4096)) {
+        __atomic_sub_fetch(&live_threads, 1, __ATOMIC_RELAXED);
+        push_free_block(tcb);
+    }
+    return res;
+}
+} // namespace
+
+void init_main_thread() {
+    auto *tcb = reinterpret_cast<ThreadControlBlock *>(register_file);
+    tcb->self = tcb;
+    syscall2(AMD64_SYSCALL_ID::ARCH_PRCTL, ARCH_SET_FS, reinterpret_cast<size_t>(tcb));
+}
+
+bool creates_thread(const uint64_t flags, const uint64_t stack) { return (flags & CLONE_VM) && stack != 0; }
+
+uint64_t clone_translated(const uint64_t flags, const uint64_t stack, const uint64_t parent_tid, const uint64_t tls, const uint64_t child_tid, const EntryFrame *entry_frame) {
+    auto *tcb = create_block(flags, stack, tls);
+    if (tcb == nullptr) {
+        return -ENOMEM;
+    }
+
+    // everything from the caller's frame up to the start of the return stack is copied, so the offsets of the stack
+    // frames stay the same and the copied return stack only predicts returns the thread would also do
+    const auto *caller_stack = reinterpret_cast<const uint8_t *>(entry_frame + 1);
+    const auto *parent_ret_stack = reinterpret_cast<const uint8_t *>(current()->init_ret_stack_ptr);
+    const auto size = static_cast<size_t>(parent_ret_stack - caller_stack);
+    if (size + sizeof(EntryFrame) > tcb->init_ret_stack_ptr - tcb->ret_stack_limit) {
+        push_free_block(tcb);
+        return -ENOMEM;
+    }
+    auto *child_stack = reinterpret_cast<uint8_t *>(tcb->init_ret_stack_ptr) - size;
+    memcpy(child_stack, caller_stack, size);
+
+    // the translated code may keep values in the callee-saved registers across the syscall_impl call
+    child_stack -= sizeof(EntryFrame);
+    memcpy(child_stack, entry_frame, sizeof(EntryFrame));
+    return start(flags, parent_tid, child_tid, tcb, child_stack);
+}
+
+uint64_t clone_interpreted(const uint64_t flags, const uint64_t stack, const uint64_t parent_tid, const uint64_t tls, const uint64_t child_tid, const uint64_t pc) {
+    auto *tcb = create_block(flags, stack, tls);
+    if (tcb == nullptr) {
+        return -ENOMEM;
+    }
+
+    auto *child_stack = reinterpret_cast<uint64_t *>(tcb->init_ret_stack_ptr);
+    *--child_stack = pc;
+    auto *entry_frame = reinterpret_cast<EntryFrame *>(child_stack) - 1;
+    *entry_frame = EntryFrame{};
+    entry_frame->return_address = reinterpret_cast<uint64_t>(&thread_start);
+    return start(flags, parent_tid, child_tid, tcb, reinterpret_cast<uint8_t *>(entry_frame));
+}
+
+bool exit_thread() { return __atomic_sub_fetch(&live_threads, 1, __ATOMIC_ACQ_REL) == 0; }
+
+void exit_current(const uint64_t status) {
+    // the block of the main thread is part of the binary
+    auto *tcb = multithreaded ? current() : nullptr;
+    if (tcb == nullptr || tcb == reinterpret_cast<ThreadControlBlock *>(register_file)) {
+        syscall1(AMD64_SYSCALL_ID::EXIT, status);
+        __builtin_unreachable();
+    }
+
+    // a signal handler would run on the stack after the next thread took it
+    uint64_t blocked = ~static_cast<uint64_t>(0);
+    syscall4(AMD64_SYSCALL_ID::RT_SIGPROCMASK, SIG_BLOCK, reinterpret_cast<size_t>(&blocked), 0, sizeof(blocked));
+    exit_to_free_list(&free_blocks, tcb, &tcb->next_free, status);
+}
+
+void lock_interpreter() {
+    if (multithreaded) {
+        lock(interpreter_lock);
+    }
+}
+
+void unlock_interpreter() {
+    if (multithreaded) {
+        unlock(interpreter_lock);
+    }
+}
+
+} // namespace helper::thread
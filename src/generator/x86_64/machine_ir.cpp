@@ -0,0 +1,572 @@
+#include "generator/x86_64/machine_ir.h"
+
+#include <cassert>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+using namespace generator::x86_64;
+using namespace generator::x86_64::mir;
+
+const std::array<std::array<const char *, 4>, REG_COUNT> generator::x86_64::reg_names = {
+    std::array<const char *, 4>{"rax", "eax", "ax", "al"},
+    {"rbx", "ebx", "bx", "bl"},
+    {"rcx", "ecx", "cx", "cl"},
+    {"rdx", "edx", "dx", "dl"},
+    {"rdi", "edi", "di", "dil"},
+    {"rsi", "esi", "si", "sil"},
+    {"r8", "r8d", "r8w", "r8b"},
+    {"r9", "r9d", "r9w", "r9b"},
+    {"r10", "r10d", "r10w", "r10b"},
+    {"r11", "r11d", "r11w", "r11b"},
+    {"r12", "r12d", "r12w", "r12b"},
+    {"r13", "r13d", "r13w", "r13b"},
+    {"r14", "r14d", "r14w", "r14b"},
+    {"r15", "r15d", "r15w", "r15b"},
+};
+
+const std::array<const char *, FP_REG_COUNT> generator::x86_64::fp_reg_names = {"xmm0", "xmm1", "xmm2",  "xmm3",  "xmm4",  "xmm5",  "xmm6",  "xmm7",
+                                                                                 "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"};
+
+namespace {
+constexpr std::array<const char *, 4> ptr_names = {"QWORD PTR ", "DWORD PTR ", "WORD PTR ", "BYTE PTR "};
+constexpr std::array<const char *, 16> cond_names = {"o", "no", "b", "ae", "e", "ne", "be", "a", "s", "ns", "p", "np", "l", "ge", "le", "g"};
+
+void append_int(std::string &out, const int64_t val) {
+    char buf[24];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), val);
+    out.append(buf, res.ptr);
+}
+
+void append_uint(std::string &out, const uint64_t val, const int base = 10) {
+    char buf[24];
+    const auto res = std::to_chars(buf, buf + sizeof(buf), val, base);
+    out.append(buf, res.ptr);
+}
+
+// also knows the registers which can't be allocated
+const char *reg_name(const REGISTER reg, const uint8_t width) {
+    static constexpr std::array<std::array<const char *, 4>, 2> sp_bp_names = {std::array<const char *, 4>{"rsp", "esp", "sp", "spl"}, {"rbp", "ebp", "bp", "bpl"}};
+    switch (reg) {
+    case REG_SP:
+        return sp_bp_names[0][width];
+    case REG_BP:
+        return sp_bp_names[1][width];
+    case REG_IP:
+        return "rip";
+    default:
+        assert(reg < REG_COUNT);
+        return reg_names[reg][width];
+    }
+}
+
+void lower_mem(std::string &out, const Operand &op) {
+    out += '[';
+    auto first = true;
+    const auto add_part = [&out, &first]() {
+        if (!first) {
+            out += " + ";
+        }
+        first = false;
+    };
+    // rip-relative addresses are written as [rip + sym + disp], otherwise the symbol comes first
+    if (op.reg == REG_IP) {
+        add_part();
+        out += "rip";
+    }
+    if (op.has_sym) {
+        add_part();
+        lower_symbol(out, op.sym);
+    }
+    if (op.reg != REG_NONE && op.reg != REG_IP) {
+        add_part();
+        out += reg_name(op.reg, 0);
+    }
+    if (op.index != REG_NONE) {
+        add_part();
+        out += reg_name(op.index, 0);
+        if (op.scale != 1) {
+            out += " * ";
+            append_uint(out, op.scale);
+        }
+    }
+    if (op.has_disp || first) {
+        add_part();
+        append_int(out, op.val);
+    }
+    out += ']';
+}
+
+void lower_operand(std::string &out, const Operand &op, const char *static_segment) {
+    if (op.is_mem() && op.width != Operand::NO_PTR) {
+        out += ptr_names[op.width];
+    }
+
+    switch (op.kind) {
+    case Operand::Kind::REG:
+        out += reg_name(op.reg, op.width);
+        break;
+    case Operand::Kind::FP_REG:
+        out += fp_reg_names[op.reg];
+        break;
+    case Operand::Kind::IMM:
+        append_int(out, op.val);
+        break;
+    case Operand::Kind::HEX_IMM:
+        out += "0x";
+        append_uint(out, static_cast<uint64_t>(op.val), 16);
+        break;
+    case Operand::Kind::MEM:
+        if (op.tcb) {
+            out += static_segment;
+        }
+        lower_mem(out, op);
+        break;
+    case Operand::Kind::STACK_SLOT:
+        out += "[rsp + 8 * ";
+        append_uint(out, static_cast<uint64_t>(op.val));
+        out += ']';
+        break;
+    case Operand::Kind::STATIC:
+        out += static_segment;
+        out += "[s";
+        append_uint(out, static_cast<uint64_t>(op.val));
+        out += ']';
+        break;
+    case Operand::Kind::BINARY:
+        out += "[binary + ";
+        append_int(out, op.val);
+        out += ']';
+        break;
+    case Operand::Kind::LABEL:
+        lower_symbol(out, op.sym);
+        break;
+    case Operand::Kind::OFFSET:
+        out += "offset ";
+        lower_symbol(out, op.sym);
+        break;
+    case Operand::Kind::NONE:
+        assert(0);
+        exit(1);
+    }
+}
+} // namespace
+
+void mir::lower_symbol(std::string &out, const Symbol &sym) {
+    using Kind = Symbol::Kind;
+
+    switch (sym.kind) {
+    case Kind::NAMED:
+        out += sym.name;
+        return;
+    case Kind::STATIC:
+        out += 's';
+        append_uint(out, sym.id);
+        return;
+    case Kind::ERR_UNREACHABLE:
+        out += "err_unreachable_b";
+        append_uint(out, sym.id);
+        return;
+    case Kind::LOOKUP_PAGE:
+        out += "ijump_lookup_page";
+        append_uint(out, sym.id);
+        return;
+    case Kind::LOCAL:
+        append_uint(out, sym.id);
+        out += sym.sub ? 'f' : 'b';
+        return;
+    default:
+        break;
+    }
+
+    // all other labels belong to a block
+    out += 'b';
+    append_uint(out, sym.id);
+    switch (sym.kind) {
+    case Kind::BLOCK:
+        break;
+    case Kind::REG_ALLOC:
+        out += "_reg_alloc";
+        break;
+    case Kind::CALL_CONV:
+        out += "_cc";
+        break;
+    case Kind::CF:
+    case Kind::IJUMP_CACHE:
+    case Kind::IJUMP_CACHE_DATA:
+    case Kind::IJUMP_CACHE_MISS:
+    case Kind::JUMP_TABLE:
+        out += "_cf";
+        append_uint(out, sym.sub);
+        if (sym.kind == Kind::IJUMP_CACHE) {
+            out += "_ic";
+        } else if (sym.kind == Kind::IJUMP_CACHE_DATA) {
+            out += "_ic_data";
+        } else if (sym.kind == Kind::IJUMP_CACHE_MISS) {
+            out += "_ic_miss";
+        } else if (sym.kind == Kind::JUMP_TABLE) {
+            out += "_jt";
+        }
+        break;
+    case Kind::REG_ALLOC_CF:
+    case Kind::UNORDERED:
+        out += "_reg_alloc_cf";
+        append_uint(out, sym.sub);
+        if (sym.kind == Kind::UNORDERED) {
+            out += "_unordered";
+        }
+        break;
+    case Kind::ATOMIC:
+    case Kind::UMAX:
+    case Kind::UMIN:
+    case Kind::SMAX:
+    case Kind::SMIN: {
+        static constexpr std::array<const char *, 5> suffixes = {"_atomic", "_max", "_min", "_smax", "_smin"};
+        out += '_';
+        append_uint(out, sym.sub);
+        out += suffixes[static_cast<size_t>(sym.kind) - static_cast<size_t>(Kind::ATOMIC)];
+        break;
+    }
+    default:
+        assert(0);
+        exit(1);
+    }
+}
+
+const char *mir::mnemonic(const Opcode op) {
+    switch (op) {
+    case Opcode::NONE:
+    case Opcode::COMMENT:
+    case Opcode::LABEL:
+    case Opcode::ALIGN:
+    case Opcode::SECTION:
+    case Opcode::GLOBAL:
+    case Opcode::SET:
+    case Opcode::TYPE:
+    case Opcode::SIZE:
+    case Opcode::SPACE:
+    case Opcode::ASCII:
+    case Opcode::INCBIN:
+        // pseudo instructions
+        return "";
+    case Opcode::BYTE:
+        return ".byte";
+    case Opcode::LONG:
+        return ".4byte";
+    case Opcode::QUAD:
+        return ".8byte";
+    case Opcode::MOV:
+        return "mov";
+    case Opcode::MOVD:
+        return "movd";
+    case Opcode::MOVQ:
+        return "movq";
+    case Opcode::MOVZX:
+        return "movzx";
+    case Opcode::MOVSX:
+        return "movsx";
+    case Opcode::MOVSXD:
+        return "movsxd";
+    case Opcode::LEA:
+        return "lea";
+    case Opcode::ADD:
+        return "add";
+    case Opcode::SUB:
+        return "sub";
+    case Opcode::AND:
+        return "and";
+    case Opcode::OR:
+        return "or";
+    case Opcode::XOR:
+        return "xor";
+    case Opcode::CMP:
+        return "cmp";
+    case Opcode::TEST:
+        return "test";
+    case Opcode::IMUL:
+        return "imul";
+    case Opcode::MUL:
+        return "mul";
+    case Opcode::DIV:
+        return "div";
+    case Opcode::IDIV:
+        return "idiv";
+    case Opcode::NEG:
+        return "neg";
+    case Opcode::NOT:
+        return "not";
+    case Opcode::INC:
+        return "inc";
+    case Opcode::SHL:
+        return "shl";
+    case Opcode::SHR:
+        return "shr";
+    case Opcode::SAR:
+        return "sar";
+    case Opcode::ROR:
+        return "ror";
+    case Opcode::SHLX:
+        return "shlx";
+    case Opcode::SHRX:
+        return "shrx";
+    case Opcode::SARX:
+        return "sarx";
+    case Opcode::CDQ:
+        return "cdq";
+    case Opcode::CQO:
+        return "cqo";
+    case Opcode::XCHG:
+        return "xchg";
+    case Opcode::XADD:
+        return "xadd";
+    case Opcode::CMPXCHG:
+        return "cmpxchg";
+    case Opcode::PUSH:
+        return "push";
+    case Opcode::POP:
+        return "pop";
+    case Opcode::JMP:
+        return "jmp";
+    case Opcode::JCC:
+        return "j";
+    case Opcode::CMOVCC:
+        return "cmov";
+    case Opcode::SETCC:
+        return "set";
+    case Opcode::CALL:
+        return "call";
+    case Opcode::RET:
+        return "ret";
+    case Opcode::SYSCALL:
+        return "syscall";
+    case Opcode::MFENCE:
+        return "mfence";
+    case Opcode::LDMXCSR:
+        return "ldmxcsr";
+    case Opcode::STMXCSR:
+        return "stmxcsr";
+    case Opcode::ADDSS:
+        return "addss";
+    case Opcode::ADDSD:
+        return "addsd";
+    case Opcode::SUBSS:
+        return "subss";
+    case Opcode::SUBSD:
+        return "subsd";
+    case Opcode::MULSS:
+        return "mulss";
+    case Opcode::MULSD:
+        return "mulsd";
+    case Opcode::DIVSS:
+        return "divss";
+    case Opcode::DIVSD:
+        return "divsd";
+    case Opcode::MINSS:
+        return "minss";
+    case Opcode::MINSD:
+        return "minsd";
+    case Opcode::MAXSS:
+        return "maxss";
+    case Opcode::MAXSD:
+        return "maxsd";
+    case Opcode::SQRTSS:
+        return "sqrtss";
+    case Opcode::SQRTSD:
+        return "sqrtsd";
+    case Opcode::COMISS:
+        return "comiss";
+    case Opcode::COMISD:
+        return "comisd";
+    case Opcode::UCOMISS:
+        return "ucomiss";
+    case Opcode::UCOMISD:
+        return "ucomisd";
+    case Opcode::ROUNDSS:
+        return "roundss";
+    case Opcode::ROUNDSD:
+        return "roundsd";
+    case Opcode::VFMADD213SS:
+        return "vfmadd213ss";
+    case Opcode::VFMADD213SD:
+        return "vfmadd213sd";
+    case Opcode::VFMSUB213SS:
+        return "vfmsub213ss";
+    case Opcode::VFMSUB213SD:
+        return "vfmsub213sd";
+    case Opcode::VFNMADD213SS:
+        return "vfnmadd213ss";
+    case Opcode::VFNMADD213SD:
+        return "vfnmadd213sd";
+    case Opcode::VFNMSUB213SS:
+        return "vfnmsub213ss";
+    case Opcode::VFNMSUB213SD:
+        return "vfnmsub213sd";
+    case Opcode::CVTSI2SS:
+        return "cvtsi2ss";
+    case Opcode::CVTSI2SD:
+        return "cvtsi2sd";
+    case Opcode::CVTSS2SI:
+        return "cvtss2si";
+    case Opcode::CVTSD2SI:
+        return "cvtsd2si";
+    case Opcode::CVTTSS2SI:
+        return "cvttss2si";
+    case Opcode::CVTTSD2SI:
+        return "cvttsd2si";
+    case Opcode::CVTSS2SD:
+        return "cvtss2sd";
+    case Opcode::CVTSD2SS:
+        return "cvtsd2ss";
+    case Opcode::PXOR:
+        return "pxor";
+    }
+
+    assert(0);
+    exit(1);
+}
+
+const char *mir::cond_name(const Cond cond) { return cond_names[static_cast<size_t>(cond)]; }
+
+const char *mir::section_directive(const Section section) {
+    switch (section) {
+    case Section::DATA:
+        return ".data";
+    case Section::BSS:
+        return ".bss";
+    case Section::TEXT:
+        return ".text";
+    case Section::TEXT_COLD:
+        return ".section .text.cold, \"ax\", @progbits";
+    case Section::RODATA:
+        return ".section .rodata";
+    case Section::ORIG_BINARY:
+        return ".section .orig_binary, \"aw\"";
+    }
+
+    assert(0);
+    exit(1);
+}
+
+void Block::append_text(const Opcode op, const std::string_view str) {
+    auto &inst = append(op);
+    inst.text_off = static_cast<uint32_t>(text.size());
+    inst.text_len = static_cast<uint32_t>(str.size());
+    text += str;
+}
+
+void Block::append(const Block &other) {
+    const auto text_base = static_cast<uint32_t>(text.size());
+    insts.reserve(insts.size() + other.insts.size());
+    for (auto inst : other.insts) {
+        inst.text_off += text_base;
+        insts.push_back(inst);
+    }
+    text += other.text;
+}
+
+void Block::lower(std::string &out, const char *static_segment) const {
+    for (const auto &inst : insts) {
+        switch (inst.op) {
+        case Opcode::NONE:
+            continue;
+        case Opcode::COMMENT:
+            out += "# ";
+            out.append(text, inst.text_off, inst.text_len);
+            out += '\n';
+            continue;
+        case Opcode::LABEL:
+            if (inst.ops[0].sym.kind == Symbol::Kind::LOCAL) {
+                append_uint(out, inst.ops[0].sym.id);
+            } else {
+                lower_symbol(out, inst.ops[0].sym);
+            }
+            out += ":\n";
+            continue;
+        case Opcode::ALIGN:
+            out += ".p2align ";
+            append_int(out, inst.ops[0].val);
+            out += '\n';
+            continue;
+        case Opcode::SECTION:
+            out += section_directive(static_cast<Section>(inst.ops[0].val));
+            out += '\n';
+            continue;
+        case Opcode::GLOBAL:
+            out += ".global ";
+            lower_symbol(out, inst.ops[0].sym);
+            out += '\n';
+            continue;
+        case Opcode::SET:
+            lower_symbol(out, inst.ops[0].sym);
+            out += " = ";
+            lower_operand(out, inst.ops[1], static_segment);
+            out += '\n';
+            continue;
+        case Opcode::TYPE:
+            out += ".type ";
+            lower_symbol(out, inst.ops[0].sym);
+            out += static_cast<SymbolType>(inst.ops[1].val) == SymbolType::FUNC ? ",STT_FUNC\n" : ",STT_OBJECT\n";
+            continue;
+        case Opcode::SIZE:
+            out += ".size ";
+            lower_symbol(out, inst.ops[0].sym);
+            out += ',';
+            if (inst.op_count > 1) {
+                lower_symbol(out, inst.ops[1].sym);
+            } else {
+                out += '$';
+            }
+            out += '-';
+            lower_symbol(out, inst.ops[0].sym);
+            out += '\n';
+            continue;
+        case Opcode::SPACE:
+            out += ".space ";
+            append_int(out, inst.ops[0].val);
+            out += '\n';
+            continue;
+        case Opcode::ASCII:
+            out += ".ascii \"";
+            for (const char c : text_of(inst)) {
+                switch (c) {
+                case '\n':
+                    out += "\\n";
+                    break;
+                case '\0':
+                    out += "\\0";
+                    break;
+                case '"':
+                case '\\':
+                    out += '\\';
+                    out += c;
+                    break;
+                default:
+                    out += c;
+                    break;
+                }
+            }
+            out += "\"\n";
+            continue;
+        case Opcode::INCBIN:
+            out += ".incbin \"";
+            out += text_of(inst);
+            out += "\"\n";
+            continue;
+        default:
+            break;
+        }
+
+        if (inst.lock) {
+            out += "lock ";
+        }
+        out += mnemonic(inst.op);
+        if (inst.op == Opcode::JCC || inst.op == Opcode::CMOVCC || inst.op == Opcode::SETCC) {
+            out += cond_name(inst.cond);
+        }
+        for (size_t i = 0; i < inst.op_count; ++i) {
+            out += (i == 0) ? " " : ", ";
+            lower_operand(out, inst.ops[i], static_segment);
+        }
+        out += '\n';
+    }
+}
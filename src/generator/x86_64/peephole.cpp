@@ -0,0 +1,380 @@
+#include "generator/x86_64/peephole.h"
+
+#include <algorithm>
+
+using namespace generator::x86_64;
+using namespace generator::x86_64::peephole;
+using mir::Inst;
+using mir::Opcode;
+using mir::Operand;
+
+namespace {
+// bit i: general purpose register i (including rsp, rbp and rip), bit 32 + i: xmm register i
+using RegSet = uint64_t;
+
+RegSet reg_bit(const Operand &op) {
+    if (op.kind == Operand::Kind::REG) {
+        return RegSet{1} << op.reg;
+    }
+    if (op.kind == Operand::Kind::FP_REG) {
+        return RegSet{1} << (32 + op.reg);
+    }
+    return 0;
+}
+
+RegSet addr_regs(const Operand &op) {
+    if (op.kind != Operand::Kind::MEM) {
+        return 0;
+    }
+    auto set = RegSet{0};
+    if (op.reg != REG_NONE) {
+        set |= RegSet{1} << op.reg;
+    }
+    if (op.index != REG_NONE) {
+        set |= RegSet{1} << op.index;
+    }
+    return set;
+}
+
+bool is_stack_ptr(const Operand &op) { return op.kind == Operand::Kind::REG && op.reg == REG_SP; }
+
+// writes the whole 64 bits of a general purpose register (or the low 64 bits of an xmm register)
+bool is_full_reg(const Operand &op) { return (op.kind == Operand::Kind::REG && op.width == 0) || op.kind == Operand::Kind::FP_REG; }
+
+// statics and stack slots are the only memory locations we can tell apart
+bool is_tracked_mem(const Operand &op) { return (op.kind == Operand::Kind::STATIC || op.kind == Operand::Kind::STACK_SLOT) && op.width == Operand::NO_PTR; }
+
+bool may_alias(const Operand &a, const Operand &b) {
+    const auto tracked = [](const Operand &op) { return op.kind == Operand::Kind::STATIC || op.kind == Operand::Kind::STACK_SLOT; };
+    if (tracked(a) && tracked(b)) {
+        return a.kind == b.kind && a.val == b.val;
+    }
+    return true;
+}
+
+bool is_move(const Opcode op) {
+    switch (op) {
+    case Opcode::MOV:
+    case Opcode::MOVQ:
+    case Opcode::MOVZX:
+    case Opcode::MOVSX:
+    case Opcode::MOVSXD:
+    case Opcode::LEA:
+    case Opcode::SHLX:
+    case Opcode::SHRX:
+    case Opcode::SARX:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool is_stack_adjust(const Inst &inst) {
+    return (inst.op == Opcode::ADD || inst.op == Opcode::SUB) && is_stack_ptr(inst.ops[0]) && inst.ops[0].width == 0 && inst.ops[1].kind == Operand::Kind::IMM;
+}
+
+bool is_dead(const Inst &inst) { return inst.op == Opcode::NONE; }
+
+void kill(Inst &inst) {
+    inst.op = Opcode::NONE;
+    inst.op_count = 0;
+}
+
+struct Effects {
+    // unknown effects (labels, control flow, implicit operands)
+    bool barrier = false;
+    // touches rsp or a stack slot
+    bool uses_stack = false;
+    // changes rsp, so stack slots refer to other memory afterwards
+    bool moves_stack = false;
+    RegSet reads = 0;
+    RegSet writes = 0;
+    const Operand *mem_read = nullptr;
+    const Operand *mem_write = nullptr;
+};
+
+// killed instructions and comments are skipped and don't count towards the window
+bool is_transparent(const Inst &inst) { return inst.op == Opcode::NONE || inst.op == Opcode::COMMENT; }
+
+Effects effects(const Inst &inst) {
+    auto e = Effects{};
+    switch (inst.op) {
+    case Opcode::MOV:
+    case Opcode::MOVQ:
+    case Opcode::MOVZX:
+    case Opcode::MOVSX:
+    case Opcode::MOVSXD:
+    case Opcode::LEA:
+    case Opcode::ADD:
+    case Opcode::SUB:
+    case Opcode::AND:
+    case Opcode::OR:
+    case Opcode::XOR:
+    case Opcode::CMP:
+    case Opcode::TEST:
+    case Opcode::SHL:
+    case Opcode::SHR:
+    case Opcode::SAR:
+    case Opcode::SHLX:
+    case Opcode::SHRX:
+    case Opcode::SARX:
+        break;
+    case Opcode::IMUL:
+        // one operand form uses rax and rdx
+        if (inst.op_count == 1) {
+            e.barrier = true;
+            return e;
+        }
+        break;
+    default:
+        // labels, control flow and instructions with implicit operands
+        e.barrier = true;
+        return e;
+    }
+
+    for (size_t i = 0; i < inst.op_count; ++i) {
+        const auto &op = inst.ops[i];
+        e.reads |= addr_regs(op);
+        if (is_stack_ptr(op) || op.kind == Operand::Kind::STACK_SLOT || (op.kind == Operand::Kind::MEM && (op.reg == REG_SP || op.index == REG_SP))) {
+            e.uses_stack = true;
+        }
+    }
+
+    const auto &dst = inst.ops[0];
+    if (is_stack_ptr(dst)) {
+        e.moves_stack = (inst.op != Opcode::CMP && inst.op != Opcode::TEST);
+    }
+    if (inst.op == Opcode::CMP || inst.op == Opcode::TEST) {
+        e.reads |= reg_bit(dst);
+        if (dst.is_mem()) {
+            e.mem_read = &dst;
+        }
+    } else if (dst.is_mem()) {
+        e.mem_write = &dst;
+        if (!is_move(inst.op)) {
+            e.mem_read = &dst;
+        }
+    } else {
+        e.writes |= reg_bit(dst);
+        // 8 and 16 bit writes keep the upper part of the register
+        if (!is_move(inst.op) || (dst.kind == Operand::Kind::REG && dst.width >= 2)) {
+            e.reads |= reg_bit(dst);
+        }
+    }
+
+    for (size_t i = 1; i < inst.op_count; ++i) {
+        const auto &op = inst.ops[i];
+        e.reads |= reg_bit(op);
+        if (op.is_mem() && inst.op != Opcode::LEA) {
+            e.mem_read = &op;
+        }
+    }
+    return e;
+}
+} // namespace
+
+void Peephole::run(mir::Block &block) {
+    if (window == 0) {
+        return;
+    }
+
+    // rules can enable each other (e.g. a forwarded reload turns into a self move), so run until nothing changes
+    for (size_t pass = 0; pass < 4; ++pass) {
+        auto changed = false;
+        for (size_t idx = 0; idx < block.insts.size(); ++idx) {
+            if (is_transparent(block.insts[idx])) {
+                continue;
+            }
+            changed |= self_move(block, idx) || stack_adjust(block, idx) || forward_memory(block, idx) || reverse_move(block, idx) || dead_move(block, idx);
+        }
+        if (!changed) {
+            break;
+        }
+    }
+
+    block.insts.erase(std::remove_if(block.insts.begin(), block.insts.end(), is_dead), block.insts.end());
+}
+
+bool Peephole::self_move(mir::Block &block, const size_t idx) {
+    auto &inst = block.insts[idx];
+    if ((inst.op != Opcode::MOV && inst.op != Opcode::MOVQ) || !is_full_reg(inst.ops[0]) || inst.ops[0] != inst.ops[1]) {
+        // mov eax, eax zero-extends so it isn't a nop
+        return false;
+    }
+
+    kill(inst);
+    ++hits[SELF_MOVE];
+    return true;
+}
+
+bool Peephole::reverse_move(mir::Block &block, const size_t idx) {
+    const auto &inst = block.insts[idx];
+    if ((inst.op != Opcode::MOV && inst.op != Opcode::MOVQ) || !is_full_reg(inst.ops[0]) || !is_full_reg(inst.ops[1])) {
+        return false;
+    }
+
+    const auto regs = reg_bit(inst.ops[0]) | reg_bit(inst.ops[1]);
+    size_t seen = 0;
+    for (auto next_idx = idx + 1; next_idx < block.insts.size() && seen < window; ++next_idx) {
+        auto &next = block.insts[next_idx];
+        if (is_transparent(next)) {
+            continue;
+        }
+        ++seen;
+        if (next.op == inst.op && next.ops[0] == inst.ops[1] && next.ops[1] == inst.ops[0]) {
+            kill(next);
+            ++hits[REVERSE_MOVE];
+            return true;
+        }
+
+        const auto e = effects(next);
+        if (e.barrier || (e.writes & regs)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool Peephole::dead_move(mir::Block &block, const size_t idx) {
+    auto &inst = block.insts[idx];
+    if (!is_move(inst.op) || inst.op == Opcode::SHLX || inst.op == Opcode::SHRX || inst.op == Opcode::SARX) {
+        return false;
+    }
+    const auto &dst = inst.ops[0];
+    // 32 bit writes clear the upper half so they count as full writes here
+    if (!is_full_reg(dst) && !(dst.kind == Operand::Kind::REG && dst.width == 1)) {
+        return false;
+    }
+    // loads from guest memory might fault, so they have to stay
+    if (inst.op != Opcode::LEA && inst.ops[1].kind == Operand::Kind::MEM) {
+        return false;
+    }
+
+    const auto reg = reg_bit(dst);
+    size_t seen = 0;
+    for (auto next_idx = idx + 1; next_idx < block.insts.size() && seen < window; ++next_idx) {
+        const auto &next = block.insts[next_idx];
+        if (is_transparent(next)) {
+            continue;
+        }
+        ++seen;
+
+        const auto e = effects(next);
+        if (e.barrier || (e.reads & reg)) {
+            return false;
+        }
+        if (e.writes & reg) {
+            kill(inst);
+            ++hits[DEAD_MOVE];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Peephole::forward_memory(mir::Block &block, const size_t idx) {
+    auto &inst = block.insts[idx];
+    if (inst.op != Opcode::MOV && inst.op != Opcode::MOVQ) {
+        return false;
+    }
+
+    // the register holds the value of the memory location after the instruction
+    const auto is_store = inst.ops[0].is_mem();
+    const auto mem = is_store ? inst.ops[0] : inst.ops[1];
+    const auto reg = is_store ? inst.ops[1] : inst.ops[0];
+    if (!is_tracked_mem(mem) || !is_full_reg(reg)) {
+        return false;
+    }
+    if ((inst.op == Opcode::MOV) != (reg.kind == Operand::Kind::REG)) {
+        return false;
+    }
+
+    auto changed = false;
+    auto mem_read = false;
+    size_t seen = 0;
+    for (auto next_idx = idx + 1; next_idx < block.insts.size() && seen < window; ++next_idx) {
+        auto &next = block.insts[next_idx];
+        if (is_transparent(next)) {
+            continue;
+        }
+        ++seen;
+
+        const auto e = effects(next);
+        if (e.barrier || e.moves_stack) {
+            break;
+        }
+
+        if (next.op == inst.op && next.ops[1] == mem && is_full_reg(next.ops[0]) && next.ops[0].kind == reg.kind) {
+            // load of the value we already have in a register
+            if (next.ops[0] == reg) {
+                kill(next);
+            } else {
+                next.ops[1] = reg;
+            }
+            ++hits[is_store ? STORE_FORWARD : RELOAD_FORWARD];
+            changed = true;
+            continue;
+        }
+
+        if (next.op == inst.op && next.ops[0] == mem && next.ops[1] == reg) {
+            // stores the value which is already in memory
+            kill(next);
+            ++hits[REDUNDANT_STORE];
+            changed = true;
+            continue;
+        }
+
+        if (e.mem_write && may_alias(*e.mem_write, mem)) {
+            if (is_store && !mem_read && (next.op == Opcode::MOV || next.op == Opcode::MOVQ) && *e.mem_write == mem && is_full_reg(next.ops[1])) {
+                // the stored value is overwritten before anyone could read it
+                kill(inst);
+                ++hits[DEAD_STORE];
+                return true;
+            }
+            break;
+        }
+        if (e.mem_read && may_alias(*e.mem_read, mem)) {
+            mem_read = true;
+        }
+        if (e.writes & reg_bit(reg)) {
+            break;
+        }
+    }
+    return changed;
+}
+
+bool Peephole::stack_adjust(mir::Block &block, const size_t idx) {
+    auto &inst = block.insts[idx];
+    if (!is_stack_adjust(inst)) {
+        return false;
+    }
+
+    size_t seen = 0;
+    for (auto next_idx = idx + 1; next_idx < block.insts.size() && seen < window; ++next_idx) {
+        auto &next = block.insts[next_idx];
+        if (is_transparent(next)) {
+            continue;
+        }
+        ++seen;
+
+        if (is_stack_adjust(next)) {
+            const auto total = (inst.op == Opcode::ADD ? inst.ops[1].val : -inst.ops[1].val) + (next.op == Opcode::ADD ? next.ops[1].val : -next.ops[1].val);
+            kill(next);
+            if (total == 0) {
+                kill(inst);
+            } else {
+                inst.op = (total > 0) ? Opcode::ADD : Opcode::SUB;
+                inst.ops[1].val = (total > 0) ? total : -total;
+            }
+            ++hits[STACK_ADJUST];
+            return true;
+        }
+
+        // the adjustment can only be moved over instructions which don't care about the stack
+        const auto e = effects(next);
+        if (e.barrier || e.uses_stack) {
+            return false;
+        }
+    }
+    return false;
+}
@@ -1,3 +1,4 @@
+#include "common/parallel.h"
 #include "generator/x86_64/generator.h"
 
 #include <iostream>
@@ -6,66 +7,34 @@
 using namespace generator::x86_64;
 
 namespace {
-std::array<std::array<const char *, 4>, REG_COUNT> reg_names = {
-    std::array<const char *, 4>{"rax", "eax", "ax", "al"},
-    {"rbx", "ebx", "bx", "bl"},
-    {"rcx", "ecx", "cx", "cl"},
-    {"rdx", "edx", "dx", "dl"},
-    {"rdi", "edi", "di", "dil"},
-    {"rsi", "esi", "si", "sil"},
-    {"r8", "r8d", "r8w", "r8b"},
-    {"r9", "r9d", "r9w", "r9b"},
-    {"r10", "r10d", "r10w", "r10b"},
-    {"r11", "r11d", "r11w", "r11b"},
-    {"r12", "r12d", "r12w", "r12b"},
-    {"r13", "r13d", "r13w", "r13b"},
-    {"r14", "r14d", "r14w", "r14b"},
-    {"r15", "r15d", "r15w", "r15b"},
-};
-
-std::array<const char *, FP_REG_COUNT> fp_reg_names = {"xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7", "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14", "xmm15"};
-
 std::array<REGISTER, 6> call_reg = {REG_DI, REG_SI, REG_D, REG_C, REG_8, REG_9};
 
-// only for integers
-const char *reg_name(const REGISTER reg, const Type type) {
-    const auto &arr = reg_names[reg];
-    switch (type) {
-    case Type::imm:
-    case Type::i64:
-        return arr[0];
-    case Type::i32:
-        return arr[1];
-    case Type::i16:
-        return arr[2];
-    case Type::i8:
-        return arr[3];
-    default:
-        assert(0);
-        exit(1);
-    }
-}
+// arguments of the syscall instruction
+std::array<REGISTER, 6> syscall_reg = {REG_DI, REG_SI, REG_D, REG_10, REG_8, REG_9};
+
+// fixed registers for the register call convention (static idx, register): a0-a7, sp, s0 and ra.
+// r12-r14 are callee-saved in the SysV ABI so sp, s0 and ra survive calls into helper functions
+constexpr std::array<std::pair<size_t, REGISTER>, 11> call_conv_regs = {
+    std::pair<size_t, REGISTER>{10, REG_DI},
+    {11, REG_SI},
+    {12, REG_D},
+    {13, REG_C},
+    {14, REG_8},
+    {15, REG_9},
+    {16, REG_10},
+    {17, REG_11},
+    {2, REG_12},
+    {8, REG_13},
+    {1, REG_14},
+};
 
-const char *mem_size(const Type type) {
-    switch (type) {
-    case Type::imm:
-    case Type::i64:
-        return "QWORD PTR";
-    case Type::i32:
-        return "DWORD PTR";
-    case Type::i16:
-        return "WORD PTR";
-    case Type::i8:
-        return "BYTE PTR";
-    case Type::f32:
-    case Type::f64:
-    case Type::mt:
-        assert(0);
-        exit(1);
+REGISTER call_conv_reg(const size_t static_idx) {
+    for (const auto &[idx, reg] : call_conv_regs) {
+        if (idx == static_idx) {
+            return reg;
+        }
     }
-
-    assert(0);
-    exit(1);
+    return REG_NONE;
 }
 
 Type choose_type(SSAVar *typ1, SSAVar *typ2) {
@@ -78,86 +47,171 @@ Type choose_type(SSAVar *typ1, SSAVar *typ2) {
         return typ1->type;
     }
 }
-} // namespace
 
-void RegAlloc::compile_blocks() {
+// shl/shr/sar with a register shift count
+mir::Opcode bmi2_shift(const Instruction type) {
+    switch (type) {
+    case Instruction::shl:
+        return mir::Opcode::SHLX;
+    case Instruction::shr:
+        return mir::Opcode::SHRX;
+    default:
+        assert(type == Instruction::sar);
+        return mir::Opcode::SARX;
+    }
+}
 
-    auto compiled_blocks = std::vector<BasicBlock *>{};
-    for (const auto &bb : gen->ir->basic_blocks) {
-        if (bb->gen_info.compiled) {
-            continue;
+bool is_plain_imm(const SSAVar *var, const int64_t val) { return var != nullptr && var->is_immediate() && !std::get<SSAVar::ImmInfo>(var->info).binary_relative && std::get<SSAVar::ImmInfo>(var->info).val == val; }
+
+// checks whether the flags at the end of body + cf_code still describe the value of reg, i.e. the last instruction that
+// touches the flags wrote reg with the given width (OPT_FUSE_BRANCHES). Moves don't touch the flags so they can be skipped
+// as long as they don't overwrite reg. add/sub set CF and OF from the operation instead of a compare against 0, so they
+// are only usable for equality checks
+bool flags_describe_reg(const mir::Block &body, const mir::Block &cf_code, const mir::Symbol &cf_label, const REGISTER reg, const uint8_t width, const bool equality_check) {
+    for (const auto *block : {&cf_code, &body}) {
+        for (auto it = block->insts.rbegin(); it != block->insts.rend(); ++it) {
+            const auto &inst = *it;
+            const auto writes_reg = inst.op_count != 0 && inst.ops[0].kind == mir::Operand::Kind::REG && inst.ops[0].reg == reg;
+            switch (inst.op) {
+            case mir::Opcode::NONE:
+            case mir::Opcode::COMMENT:
+                continue;
+            case mir::Opcode::LABEL:
+                // the label of the first cfop is never jumped to
+                if (inst.ops[0].sym != cf_label) {
+                    return false;
+                }
+                continue;
+            case mir::Opcode::MOV:
+            case mir::Opcode::MOVQ:
+            case mir::Opcode::MOVZX:
+            case mir::Opcode::MOVSX:
+            case mir::Opcode::MOVSXD:
+            case mir::Opcode::LEA:
+            case mir::Opcode::POP:
+                if (writes_reg) {
+                    return false;
+                }
+                continue;
+            case mir::Opcode::PUSH:
+                continue;
+            case mir::Opcode::ADD:
+            case mir::Opcode::SUB:
+                return equality_check && writes_reg && inst.op_count == 2 && inst.ops[0].width == width;
+            case mir::Opcode::AND:
+            case mir::Opcode::OR:
+            case mir::Opcode::XOR:
+                return writes_reg && inst.op_count == 2 && inst.ops[0].width == width;
+            default:
+                return false;
+            }
         }
+    }
+    return false;
+}
+} // namespace
 
-        if (!is_block_top_level(bb.get())) {
-            continue;
+void RegAlloc::compile_blocks() {
+    plan_groups();
+
+    auto &pool = *gen->thread_pool;
+    const auto thread_count = pool.thread_count();
+
+    // groups are compiled in batches so only the assembly of a few groups has to be held in memory at once
+    const auto batch_size = thread_count * 16;
+    for (size_t batch_start = 0; batch_start < groups.size(); batch_start += batch_size) {
+        const auto batch_end = std::min(groups.size(), batch_start + batch_size);
+        auto contexts = std::vector<GroupContext>{};
+        contexts.reserve(batch_end - batch_start);
+        for (size_t group_id = batch_start; group_id < batch_end; ++group_id) {
+            contexts.emplace_back(gen, this, group_id);
+        }
+
+        // the cfops of a group need the input maps and stack frame sizes of all groups before it and whether a block
+        // needs a translation block is only known after the cfops of all groups before it have been compiled,
+        // so every step needs to be finished for the whole batch before starting with the next one
+        pool.parallel_for(contexts.size(), [&contexts](const size_t idx) { contexts[idx].compile_group(); });
+        pool.parallel_for(contexts.size(), [&contexts](const size_t idx) { contexts[idx].write_group(); });
+        for (const auto &ctx : contexts) {
+            for (auto *bb : ctx.trans_bb_requests) {
+                bb->gen_info.needs_trans_bb = true;
+            }
         }
+        pool.parallel_for(contexts.size(), [&contexts](const size_t idx) { contexts[idx].write_translation_blocks(); });
 
-        auto supported = true;
-        for (auto *input : bb->inputs) {
-            if (!std::holds_alternative<size_t>(input->info)) {
-                supported = false;
-                break;
+        for (const auto &ctx : contexts) {
+            gen->write(ctx.output);
+            for (const auto *bb : ctx.unreachable_blocks) {
+                gen->err_msgs.emplace_back(Generator::ErrType::unreachable, bb);
+            }
+            for (size_t rule = 0; rule < peephole::RULE_COUNT; ++rule) {
+                gen->peephole_hits[rule] += ctx.peephole.hits[rule];
             }
-
-            const auto static_idx = std::get<size_t>(input->info);
-            input->gen_info.location = SSAVar::GeneratorInfoX64::STATIC;
-            input->gen_info.static_idx = static_idx;
         }
+    }
+}
 
-        if (!supported) {
-            assert(0);
+void RegAlloc::plan_groups() {
+    groups.clear();
+    group_ids.assign(gen->ir->cur_block_id, NO_GROUP);
+    input_map_owners.assign(gen->ir->cur_block_id, std::pair<const BasicBlock *, size_t>{nullptr, 0});
+
+    for (const auto &bb : gen->ir->basic_blocks) {
+        if (group_ids[bb->id] != NO_GROUP) {
             continue;
         }
 
-        if (!bb->gen_info.input_map_setup) {
-            generate_input_map(bb.get());
+        if (!is_block_top_level(bb.get())) {
+            continue;
         }
 
-        size_t max_stack_frame = 0;
-        compiled_blocks.clear();
-        compile_block(bb.get(), true, max_stack_frame, compiled_blocks);
+        if (!setup_group_entry(bb.get())) {
+            continue;
+        }
 
-        translation_blocks.clear();
-        asm_buf.clear();
+        groups.emplace_back();
+        plan_block(bb.get());
     }
 
     // when blocks have a self-contained circular reference chain, they do not get recognized as top-level so
     // we compile them here and use the lowest-id-block (which should later be the lowest-address one) as the first
     for (const auto &bb : gen->ir->basic_blocks) {
-        if (bb->gen_info.compiled) {
+        if (group_ids[bb->id] != NO_GROUP) {
             continue;
         }
 
-        auto supported = true;
-        for (auto *input : bb->inputs) {
-            if (!std::holds_alternative<size_t>(input->info)) {
-                supported = false;
-                break;
-            }
-
-            const auto static_idx = std::get<size_t>(input->info);
-            input->gen_info.location = SSAVar::GeneratorInfoX64::STATIC;
-            input->gen_info.static_idx = static_idx;
+        if (!setup_group_entry(bb.get())) {
+            continue;
         }
 
-        if (!supported) {
+        bb->gen_info.manual_top_level = true;
+        groups.emplace_back();
+        plan_block(bb.get());
+    }
+}
+
+bool RegAlloc::setup_group_entry(BasicBlock *bb) {
+    for (auto *input : bb->inputs) {
+        if (!std::holds_alternative<size_t>(input->info)) {
             assert(0);
-            continue;
+            return false;
         }
 
-        // only for testing
+        const auto static_idx = std::get<size_t>(input->info);
+        input->gen_info.location = SSAVar::GeneratorInfoX64::STATIC;
+        input->gen_info.static_idx = static_idx;
+    }
+
+    if (uses_call_conv(gen, bb)) {
         if (!bb->gen_info.input_map_setup) {
-            generate_input_map(bb.get());
+            set_bb_inputs_from_static(bb);
+        } else {
+            set_call_conv_input_locations(bb);
         }
-
-        size_t max_stack_frame = 0;
-        compiled_blocks.clear();
-        bb->gen_info.manual_top_level = true;
-        compile_block(bb.get(), true, max_stack_frame, compiled_blocks);
-
-        translation_blocks.clear();
-        asm_buf.clear();
+    } else if (!bb->gen_info.input_map_setup) {
+        generate_input_map(bb);
     }
+    return true;
 }
 
 // compile all bblocks with an id greater than this with the normal generator
@@ -165,18 +219,16 @@ constexpr size_t BB_OLD_COMPILE_ID_TIL = static_cast<size_t>(-1);
 // only merge bblocks with an id <= BB_MERGE_TIL_ID, otherwise mark them as a top-level block and pass inputs through statics
 constexpr size_t BB_MERGE_TIL_ID = static_cast<size_t>(-1);
 
-void RegAlloc::compile_block(BasicBlock *bb, const bool first_block, size_t &max_stack_frame_size, std::vector<BasicBlock *> &compiled_blocks) {
-    RegMap reg_map = {};
-    FPRegMap fp_reg_map = {};
-    StackMap stack_map = {};
-    cur_bb = bb;
-    cur_reg_map = &reg_map;
-    cur_fp_reg_map = &fp_reg_map;
-    cur_stack_map = &stack_map;
+void RegAlloc::plan_block(BasicBlock *bb) {
+    const auto group_id = groups.size() - 1;
+    group_ids[bb->id] = group_id;
+    groups.back().blocks.push_back(bb);
 
     // TODO: this hack is needed because syscalls have a continuation mapping so we cant create the input mapping in the previous' block
     // cfop
-    if (!bb->gen_info.input_map_setup) {
+    if (!is_input_map_planned(bb) && uses_call_conv(gen, bb)) {
+        set_bb_inputs_from_static(bb);
+    } else if (!is_input_map_planned(bb)) {
         for (auto *input : bb->inputs) {
             if (!std::holds_alternative<size_t>(input->info)) {
                 assert(0);
@@ -195,114 +247,232 @@ void RegAlloc::compile_block(BasicBlock *bb, const bool first_block, size_t &max
         bb->gen_info.input_map_setup = true;
     }
 
-    if (bb->id > BB_OLD_COMPILE_ID_TIL) {
-        gen->compile_block(bb);
-        bb->gen_info.compiled = true;
-    } else {
+    // set the input maps of the cfop targets the same way GroupContext::prepare_cf_ops would, but only remember
+    // which cfop is responsible for the ones that depend on the register allocation
+    for (size_t cf_idx = 0; cf_idx < bb->control_flow_ops.size(); ++cf_idx) {
+        const auto &cf_op = bb->control_flow_ops[cf_idx];
+        auto *target = cf_op.target();
+        if (!target || is_input_map_planned(target)) {
+            continue;
+        }
+        if (target->gen_info.call_cont_block || uses_call_conv(gen, target)) {
+            set_bb_inputs_from_static(target);
+            continue;
+        }
 
-        // fill in reg_map and stack_map from inputs
-        for (auto *var : bb->inputs) {
-            if (var->gen_info.location == SSAVar::GeneratorInfoX64::REGISTER) {
-                reg_map[var->gen_info.reg_idx].cur_var = var;
-                reg_map[var->gen_info.reg_idx].alloc_time = 0;
-            } else if (var->gen_info.location == SSAVar::GeneratorInfoX64::FP_REGISTER) {
-                fp_reg_map[var->gen_info.reg_idx].cur_var = var;
-                fp_reg_map[var->gen_info.reg_idx].alloc_time = 0;
-            } else if (var->gen_info.location == SSAVar::GeneratorInfoX64::STACK_FRAME) {
-                const auto stack_slot = var->gen_info.stack_slot;
-                if (stack_map.size() <= stack_slot) {
-                    stack_map.resize(stack_slot + 1);
-                }
-                stack_map[stack_slot].free = false;
-                stack_map[stack_slot].var = var;
+        switch (cf_op.type) {
+        case CFCInstruction::jump:
+        case CFCInstruction::cjump:
+            if (target->id > BB_MERGE_TIL_ID || is_block_top_level(target)) {
+                set_bb_inputs_from_static(target);
             }
+            // the cfop still needs to load its immediate inputs into registers
+            input_map_owners[target->id] = {bb, cf_idx};
+            break;
+        case CFCInstruction::syscall:
+            set_bb_inputs_from_static(target);
+            break;
+        case CFCInstruction::call: {
+            set_bb_inputs_from_static(target);
+            auto *cont_block = std::get<CfOp::CallInfo>(cf_op.info).continuation_block;
+            if (!is_input_map_planned(cont_block)) {
+                set_bb_inputs_from_static(cont_block);
+            }
+            break;
         }
+        default:
+            break;
+        }
+    }
 
-        if (!first_block) {
-            if (!(gen->optimizations & Generator::OPT_NO_TRANS_BBS) || is_block_jumpable(bb)) {
-                generate_translation_block(bb);
+    // TODO: prioritize jumps so we can omit the jmp bX_reg_alloc
+    auto cf_ops = std::vector<const CfOp *>{};
+    for (const auto &cf_op : bb->control_flow_ops) {
+        cf_ops.push_back(&cf_op);
+    }
+    if (gen->optimizations & Generator::OPT_BLOCK_LAYOUT) {
+        // the last cfop is the fall-through path (e.g. the jump after a cjump), so compiling its target
+        // directly after this block lets compile_cf_ops omit the jump
+        std::reverse(cf_ops.begin(), cf_ops.end());
+    }
+    for (const auto *cf_op_ptr : cf_ops) {
+        const auto &cf_op = *cf_op_ptr;
+        auto *target = cf_op.target();
+        if (target && group_ids[target->id] == NO_GROUP && target->id <= BB_MERGE_TIL_ID && !is_block_top_level(target) && !target->gen_info.call_cont_block) {
+            plan_block(target);
+        }
+        if (cf_op.type == CFCInstruction::call) {
+            // sometimes there are cases where a block is a call target and continuation block,
+            // e.g. with noreturn calls the next block will be recognized as a continuation block
+            auto *cont_block = std::get<CfOp::CallInfo>(cf_op.info).continuation_block;
+            if (group_ids[cont_block->id] == NO_GROUP && !is_block_top_level(cont_block)) {
+                plan_block(cont_block);
+            }
+        } else if (cf_op.type == CFCInstruction::icall) {
+            auto *cont_block = std::get<CfOp::ICallInfo>(cf_op.info).continuation_block;
+            if (group_ids[cont_block->id] == NO_GROUP && !is_block_top_level(cont_block)) {
+                plan_block(cont_block);
             }
-            print_asm("b%zu_reg_alloc:\n", bb->id);
-            print_asm("# MBRA\n"); // multi-block register allocation
-            print_asm("# Virt Start: %#lx\n# Virt End:  %#lx\n", bb->virt_start_addr, bb->virt_end_addr);
         }
+    }
+}
 
-        init_time_of_use(bb);
+RegAlloc::GroupContext::GroupContext(Generator *gen, const RegAlloc *reg_alloc, size_t group_id)
+    : gen(gen), reg_alloc(reg_alloc), group_id(group_id), peephole(gen->peephole_window), keep_comments(gen->out_fd != nullptr) {}
 
-        compile_vars(bb);
+void RegAlloc::GroupContext::compile_group() {
+    const auto &blocks = reg_alloc->groups[group_id].blocks;
+    if (gen->reg_alloc_kind == Generator::RegAllocKind::WEIGHTED_EVICTION) {
+        live_intervals = std::make_unique<weighted_eviction::LiveIntervals>(blocks);
+        live_intervals->build();
+    }
+    rounding_plan.build(blocks, gen->optimizations & Generator::OPT_ARCH_SSE4);
+    for (auto *bb : blocks) {
+        bb->gen_info.entry_rounding_mode = rounding_plan.entry_mode(bb);
+    }
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        compile_block(blocks[i], i == 0);
+    }
 
-        prepare_cf_ops(bb);
+    // need to add a bit of space to the stack since the cfops might need to spill to the stack
+    max_stack_frame_size += gen->ir->statics.size();
+    // align to 16 bytes
+    max_stack_frame_size = (((max_stack_frame_size * 8) + 15) & 0xFFFFFFFF'FFFFFFF0);
+    for (auto *bb : blocks) {
+        bb->gen_info.max_stack_size = max_stack_frame_size;
+    }
+}
 
-        max_stack_frame_size = std::max(max_stack_frame_size, stack_map.size());
-        {
-            auto asm_block = AssembledBlock{};
-            asm_block.bb = bb;
-            asm_block.assembly = asm_buf;
-            asm_buf.clear();
-            asm_block.reg_map = reg_map;
-            asm_block.fp_reg_map = fp_reg_map;
-            asm_block.stack_map = std::move(stack_map);
-            assembled_blocks.push_back(std::move(asm_block));
+void RegAlloc::GroupContext::compile_block(BasicBlock *bb, const bool first_block) {
+    RegMap reg_map = {};
+    FPRegMap fp_reg_map = {};
+    StackMap stack_map = {};
+    cur_bb = bb;
+    cur_reg_map = &reg_map;
+    cur_fp_reg_map = &fp_reg_map;
+    cur_stack_map = &stack_map;
+
+    // fill in reg_map and stack_map from inputs
+    for (auto *var : bb->inputs) {
+        if (var->gen_info.location == SSAVar::GeneratorInfoX64::REGISTER) {
+            reg_map[var->gen_info.reg_idx].cur_var = var;
+            reg_map[var->gen_info.reg_idx].alloc_time = 0;
+        } else if (var->gen_info.location == SSAVar::GeneratorInfoX64::FP_REGISTER) {
+            fp_reg_map[var->gen_info.reg_idx].cur_var = var;
+            fp_reg_map[var->gen_info.reg_idx].alloc_time = 0;
+        } else if (var->gen_info.location == SSAVar::GeneratorInfoX64::STACK_FRAME) {
+            const auto stack_slot = var->gen_info.stack_slot;
+            if (stack_map.size() <= stack_slot) {
+                stack_map.resize(stack_slot + 1);
+            }
+            stack_map[stack_slot].free = false;
+            stack_map[stack_slot].var = var;
         }
+    }
 
-        cur_bb = nullptr;
-        cur_stack_map = nullptr;
-        cur_reg_map = nullptr;
-        cur_fp_reg_map = nullptr;
-        bb->gen_info.compiled = true;
-        compiled_blocks.push_back(bb);
+    if (!first_block) {
+        if (gen->is_loop_header(bb)) {
+            asm_buf.align(4);
+        }
+        asm_buf.label(mir::symbol(mir::Symbol::Kind::REG_ALLOC, bb->id));
+        asm_buf.comment("MBRA"); // multi-block register allocation
+        comment(asm_buf, "Virt Start: %#lx", bb->virt_start_addr);
+        comment(asm_buf, "Virt End:  %#lx", bb->virt_end_addr);
+    }
 
-        // TODO: prioritize jumps so we can omit the jmp bX_reg_alloc
-        for (const auto &cf_op : bb->control_flow_ops) {
-            auto *target = cf_op.target();
-            if (target && !target->gen_info.compiled && target->id <= BB_MERGE_TIL_ID && !is_block_top_level(target) && !target->gen_info.call_cont_block) {
-                compile_block(target, false, max_stack_frame_size, compiled_blocks);
-            }
-            if (cf_op.type == CFCInstruction::call) {
-                // sometimes there are cases where a block is a call target and continuation block,
-                // e.g. with noreturn calls the next block will be recognized as a continuation block
-                auto *cont_block = std::get<CfOp::CallInfo>(cf_op.info).continuation_block;
-                if (!cont_block->gen_info.compiled && !is_block_top_level(cont_block)) {
-                    compile_block(cont_block, false, max_stack_frame_size, compiled_blocks);
-                }
-            } else if (cf_op.type == CFCInstruction::icall) {
-                auto *cont_block = std::get<CfOp::ICallInfo>(cf_op.info).continuation_block;
-                if (!cont_block->gen_info.compiled && !is_block_top_level(cont_block)) {
-                    compile_block(cont_block, false, max_stack_frame_size, compiled_blocks);
-                }
+    fold_addresses(bb);
+    init_time_of_use(bb);
+
+    if (use_weighted_eviction()) {
+        for (auto *var : bb->inputs) {
+            if (var->gen_info.location == SSAVar::GeneratorInfoX64::STATIC) {
+                live_intervals->set_home_static(var, var->gen_info.static_idx);
             }
         }
+        remat_statics = true;
+    }
+    cur_rounding_mode = rounding_plan.entry_mode(bb);
+    cur_dyn_rm_var = nullptr;
+    compile_vars(bb);
+    remat_statics = false;
+    // the blocks jumped to expect the planned mode
+    switch_rounding_mode(rounding_plan.exit_mode(bb));
 
-        if (first_block) {
-            // need to add a bit of space to the stack since the cfops might need to spill to the stack
-            max_stack_frame_size += gen->ir->statics.size();
-            // align to 16 bytes
-            max_stack_frame_size = (((max_stack_frame_size * 8) + 15) & 0xFFFFFFFF'FFFFFFF0);
-            for (auto *bb : compiled_blocks) {
-                bb->gen_info.max_stack_size = max_stack_frame_size;
-            }
+    prepare_cf_ops(bb);
 
-            fprintf(gen->out_fd, "b%zu:\nsub rsp, %zu\n", bb->id, max_stack_frame_size);
-            fprintf(gen->out_fd, "# MBRA\n"); // multi-block register allocation
-            fprintf(gen->out_fd, "# Virt Start: %#lx\n# Virt End:  %#lx\n", bb->virt_start_addr, bb->virt_end_addr);
-            write_assembled_blocks(max_stack_frame_size, compiled_blocks);
+    max_stack_frame_size = std::max(max_stack_frame_size, stack_map.size());
+    {
+        auto asm_block = AssembledBlock{};
+        asm_block.bb = bb;
+        asm_block.assembly = std::move(asm_buf);
+        asm_buf.clear();
+        asm_block.reg_map = reg_map;
+        asm_block.fp_reg_map = fp_reg_map;
+        asm_block.stack_map = std::move(stack_map);
+        asm_block.has_entry_label = !first_block;
+        assembled_blocks.push_back(std::move(asm_block));
+    }
+
+    cur_bb = nullptr;
+    cur_stack_map = nullptr;
+    cur_reg_map = nullptr;
+    cur_fp_reg_map = nullptr;
+    bb->gen_info.compiled = true;
+}
 
-            fprintf(gen->out_fd, "\n# Translation Blocks\n");
-            for (const auto &pair : translation_blocks) {
-                fprintf(gen->out_fd, "b%zu:\nsub rsp, %zu\n", pair.first, max_stack_frame_size);
-                fprintf(gen->out_fd, "# MBRATB\n"); // multi-block register allocation translation block
-                fprintf(gen->out_fd, "%s\n", pair.second.c_str());
+void RegAlloc::GroupContext::write_group() {
+    auto *bb = reg_alloc->groups[group_id].blocks.front();
+    if (gen->is_loop_header(bb)) {
+        output.align(4);
+    }
+    output.label(mir::symbol(mir::Symbol::Kind::BLOCK, bb->id));
+    if (uses_call_conv(gen, bb)) {
+        // entry for callers that pass everything in statics, direct calls use the register entry
+        for (size_t i = 0; i < bb->inputs.size(); ++i) {
+            const auto &info = bb->gen_info.input_map[i];
+            if (info.location == BasicBlock::GeneratorInfo::InputInfo::REGISTER) {
+                output.append(mir::Opcode::MOV, mir::reg(static_cast<REGISTER>(info.reg_idx)), mir::static_var(bb->inputs[i]->get_static()));
             }
-            fprintf(gen->out_fd, "\n");
-            translation_blocks.clear();
-            assembled_blocks.clear();
         }
+        output.label(mir::symbol(mir::Symbol::Kind::CALL_CONV, bb->id));
+    }
+    output.append(mir::Opcode::SUB, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size)));
+    output.comment("MBRA"); // multi-block register allocation
+    comment(output, "Virt Start: %#lx", bb->virt_start_addr);
+    comment(output, "Virt End:  %#lx", bb->virt_end_addr);
+    write_assembled_blocks(max_stack_frame_size);
+    assembled_blocks.clear();
+}
+
+void RegAlloc::GroupContext::write_translation_blocks() {
+    const auto &blocks = reg_alloc->groups[group_id].blocks;
+    for (size_t i = 1; i < blocks.size(); ++i) {
+        if (!(gen->optimizations & Generator::OPT_NO_TRANS_BBS) || is_block_jumpable(blocks[i])) {
+            generate_translation_block(blocks[i]);
+        }
+    }
+
+    // translation blocks are only entered through the ijump lookup or from other groups so keep them out of the hot path
+    if (gen->optimizations & Generator::OPT_BLOCK_LAYOUT) {
+        output.section(mir::Section::TEXT_COLD);
+    }
+    output.comment("Translation Blocks");
+    for (const auto &pair : translation_blocks) {
+        output.label(mir::symbol(mir::Symbol::Kind::BLOCK, pair.first));
+        output.append(mir::Opcode::SUB, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size)));
+        output.comment("MBRATB"); // multi-block register allocation translation block
+        output.append(pair.second);
+    }
+    if (gen->optimizations & Generator::OPT_BLOCK_LAYOUT) {
+        output.section(mir::Section::TEXT);
     }
+    translation_blocks.clear();
 }
 
-void RegAlloc::compile_vars(BasicBlock *bb) {
+void RegAlloc::GroupContext::compile_vars(BasicBlock *bb) {
     auto &reg_map = *cur_reg_map;
     std::ostringstream ir_stream;
+    const auto *fused = fused_compare(bb);
     for (size_t var_idx = 0; var_idx < bb->variables.size(); ++var_idx) {
         auto *var = bb->variables[var_idx].get();
         const auto cur_time = var_idx;
@@ -312,9 +482,14 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
         // TODO: when we merge ops, we need to print ir before the merged op
         ir_stream.str("");
         var->print(ir_stream, gen->ir);
-        print_asm("# %s\n", ir_stream.str().c_str());
+        asm_buf.comment(ir_stream.str());
 
-        if (var->gen_info.already_generated) {
+        if (var->gen_info.already_generated || (fused != nullptr && var == fused->out_vars[0])) {
+            // fused compares are generated together with the cjump
+            continue;
+        }
+        if (folded_vars.count(var) != 0) {
+            // part of a memory operand
             continue;
         }
 
@@ -390,23 +565,22 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                     }
                     clear_reg(cur_time, REG_D);
                     if (op->type == Instruction::div) {
-                        if (var->type == Type::i32) {
-                            print_asm("cdq\n");
-                        } else {
-                            print_asm("cqo\n");
-                        }
+                        emit(var->type == Type::i32 ? mir::Opcode::CDQ : mir::Opcode::CQO);
                     } else if (op->type == Instruction::udiv) {
-                        print_asm("xor edx, edx\n");
+                        emit(mir::Opcode::XOR, mir::reg(REG_D, Type::i32), mir::reg(REG_D, Type::i32));
                     }
                 }
 
-                const auto in1_reg_name = reg_name(in1_reg, choose_type(in1, in2));
+                const auto in1_op = mir::reg(in1_reg, choose_type(in1, in2));
                 REGISTER dst_reg = REG_NONE;
                 if (op->type != Instruction::add || in1->gen_info.last_use_time == cur_time) {
                     dst_reg = in1_reg;
                 } else {
                     // check if there is a free register
                     for (size_t reg = 0; reg < REG_COUNT; ++reg) {
+                        if (is_reg_pinned(reg)) {
+                            continue;
+                        }
                         if (reg_map[reg].cur_var == nullptr) {
                             dst_reg = static_cast<REGISTER>(reg);
                             break;
@@ -429,6 +603,9 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                         // check if there is a variable thats already saved on the stack and used after the dst
                         auto check_unsaved_vars = !in1->gen_info.saved_in_stack;
                         for (size_t reg = 0; reg < REG_COUNT; ++reg) {
+                            if (is_reg_pinned(reg)) {
+                                continue;
+                            }
                             auto *var = reg_map[reg].cur_var;
                             if (!check_unsaved_vars && !var->gen_info.saved_in_stack) {
                                 continue;
@@ -451,7 +628,6 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                         }
                     }
                 }
-                const auto dst_reg_name = reg_name(dst_reg, choose_type(in1, in2));
 
                 if (reg_map[dst_reg].cur_var && reg_map[dst_reg].cur_var->gen_info.last_use_time > cur_time) {
                     save_reg(dst_reg);
@@ -474,19 +650,16 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                                             auto *nnext_op = std::get<std::unique_ptr<Operation>>(nnext_var->info).get();
                                             if (nnext_op->in_vars[0] == load_dst && nnext_op->type == Instruction::zero_extend) {
                                                 auto *ext_dst = nnext_op->out_vars[0];
+                                                mir::Operand src;
                                                 if (imm_val != INT64_MIN && std::abs(imm_val) < 0x7FFFFFFF) {
-                                                    if (load_dst->type == Type::i32) {
-                                                        print_asm("mov %s, [%s + %ld]\n", reg_names[dst_reg][1], in1_reg_name, imm_val);
-                                                    } else {
-                                                        print_asm("movzx %s, %s [%s + %ld]\n", reg_name(dst_reg, ext_dst->type), mem_size(load_dst->type), in1_reg_name, imm_val);
-                                                    }
+                                                    src = mir::mem(in1_reg, imm_val);
+                                                } else {
+                                                    src = mir::mem(in1_reg, load_val_in_reg(cur_time, in2));
+                                                }
+                                                if (load_dst->type == Type::i32) {
+                                                    emit(mir::Opcode::MOV, mir::reg(dst_reg, Type::i32), src);
                                                 } else {
-                                                    const auto imm_reg = load_val_in_reg(cur_time, in2);
-                                                    if (load_dst->type == Type::i32) {
-                                                        print_asm("mov %s, [%s + %s]\n", reg_names[dst_reg][1], in1_reg_name, reg_names[imm_reg][0]);
-                                                    } else {
-                                                        print_asm("movzx %s, %s [%s + %s]\n", reg_name(dst_reg, ext_dst->type), mem_size(load_dst->type), in1_reg_name, reg_names[imm_reg][0]);
-                                                    }
+                                                    emit(mir::Opcode::MOVZX, mir::reg(dst_reg, ext_dst->type), mir::sized(src, load_dst->type));
                                                 }
                                                 clear_reg(cur_time, dst_reg);
                                                 set_var_to_reg(cur_time, ext_dst, dst_reg);
@@ -495,21 +668,17 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                                                 did_merge = true;
                                             } else if (nnext_op->in_vars[0] == load_dst && nnext_op->type == Instruction::sign_extend) {
                                                 auto *ext_dst = nnext_op->out_vars[0];
+                                                mir::Operand src;
                                                 if (imm_val != INT64_MIN && std::abs(imm_val) < 0x7FFFFFFF) {
-                                                    if (load_dst->type == Type::i32) {
-                                                        assert(ext_dst->type == Type::i32 || ext_dst->type == Type::i64);
-                                                        print_asm("movsxd %s, %s [%s + %ld]\n", reg_name(dst_reg, ext_dst->type), mem_size(load_dst->type), in1_reg_name, imm_val);
-                                                    } else {
-                                                        print_asm("movsx %s, %s [%s + %ld]\n", reg_name(dst_reg, ext_dst->type), mem_size(load_dst->type), in1_reg_name, imm_val);
-                                                    }
+                                                    src = mir::mem(in1_reg, imm_val);
+                                                } else {
+                                                    src = mir::mem(in1_reg, load_val_in_reg(cur_time, in2));
+                                                }
+                                                if (load_dst->type == Type::i32) {
+                                                    assert(ext_dst->type == Type::i32 || ext_dst->type == Type::i64);
+                                                    emit(mir::Opcode::MOVSXD, mir::reg(dst_reg, ext_dst->type), mir::sized(src, load_dst->type));
                                                 } else {
-                                                    const auto imm_reg = load_val_in_reg(cur_time, in2);
-                                                    if (load_dst->type == Type::i32) {
-                                                        assert(ext_dst->type == Type::i32 || ext_dst->type == Type::i64);
-                                                        print_asm("movsxd %s, %s [%s + %s]\n", reg_name(dst_reg, ext_dst->type), mem_size(load_dst->type), in1_reg_name, reg_names[imm_reg][0]);
-                                                    } else {
-                                                        print_asm("movsx %s, %s [%s + %s]\n", reg_name(dst_reg, ext_dst->type), mem_size(load_dst->type), in1_reg_name, reg_names[imm_reg][0]);
-                                                    }
+                                                    emit(mir::Opcode::MOVSX, mir::reg(dst_reg, ext_dst->type), mir::sized(src, load_dst->type));
                                                 }
                                                 clear_reg(cur_time, dst_reg);
                                                 set_var_to_reg(cur_time, ext_dst, dst_reg);
@@ -523,10 +692,10 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                                     if (!did_merge) {
                                         // merge add and load
                                         if (imm_val != INT64_MIN && std::abs(imm_val) < 0x7FFFFFFF) {
-                                            print_asm("mov %s, [%s + %ld]\n", reg_name(dst_reg, load_dst->type), in1_reg_name, imm_val);
+                                            emit(mir::Opcode::MOV, mir::reg(dst_reg, load_dst->type), mir::mem(in1_reg, imm_val));
                                         } else {
                                             const auto imm_reg = load_val_in_reg(cur_time, in2);
-                                            print_asm("mov %s, [%s + %s]\n", reg_name(dst_reg, load_dst->type), in1_reg_name, reg_names[imm_reg][0]);
+                                            emit(mir::Opcode::MOV, mir::reg(dst_reg, load_dst->type), mir::mem(in1_reg, imm_reg));
                                         }
                                         clear_reg(cur_time, dst_reg);
                                         set_var_to_reg(cur_time, load_dst, dst_reg);
@@ -544,7 +713,7 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                                                 auto *store_dst = nnext_op->out_vars[0]; // should be == nnext_var
                                                 // load source of cast
                                                 const auto cast_reg = load_val_in_reg(cur_time, next_op->in_vars[0].get());
-                                                print_asm("mov [%s + %ld], %s\n", in1_reg_name, imm_val, reg_name(cast_reg, cast_var->type));
+                                                emit(mir::Opcode::MOV, mir::mem(in1_reg, imm_val), mir::reg(cast_reg, cast_var->type));
                                                 cast_var->gen_info.already_generated = true;
                                                 store_dst->gen_info.already_generated = true;
                                                 did_merge = true;
@@ -557,14 +726,14 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                                     if (store_src->is_immediate() && !store_src->get_immediate().binary_relative) {
                                         const auto store_imm_val = store_src->get_immediate().val;
                                         if (store_imm_val != INT64_MIN && std::abs(store_imm_val) < 0x7FFFFFFF) {
-                                            print_asm("mov %s [%s + %ld], %ld\n", mem_size(next_op->lifter_info.in_op_size), in1_reg_name, imm_val, store_imm_val);
+                                            emit(mir::Opcode::MOV, mir::sized(mir::mem(in1_reg, imm_val), next_op->lifter_info.in_op_size), mir::imm(store_imm_val));
                                             next_op->out_vars[0]->gen_info.already_generated = true;
                                             did_merge = true;
                                         }
                                     }
                                     if (!did_merge) {
                                         const auto src_reg = load_val_in_reg(cur_time, store_src);
-                                        print_asm("mov [%s + %ld], %s\n", in1_reg_name, imm_val, reg_name(src_reg, store_src->type));
+                                        emit(mir::Opcode::MOV, mir::mem(in1_reg, imm_val), mir::reg(src_reg, store_src->type));
                                         next_op->out_vars[0]->gen_info.already_generated = true;
                                         did_merge = true;
                                     }
@@ -589,13 +758,7 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                                             nnext_op->in_vars[1] == dst) {
                                             // this can be merged into a single shift
                                             const auto cast_reg = load_val_in_reg(cur_time, next_op->in_vars[0].get());
-                                            if (nnext_op->type == Instruction::shl) {
-                                                print_asm("shlx %s, %s, %s\n", reg_names[dst_reg][1], reg_names[cast_reg][1], reg_names[in1_reg][1]);
-                                            } else if (nnext_op->type == Instruction::shr) {
-                                                print_asm("shrx %s, %s, %s\n", reg_names[dst_reg][1], reg_names[cast_reg][1], reg_names[in1_reg][1]);
-                                            } else if (nnext_op->type == Instruction::sar) {
-                                                print_asm("sarx %s, %s, %s\n", reg_names[dst_reg][1], reg_names[cast_reg][1], reg_names[in1_reg][1]);
-                                            }
+                                            emit(bmi2_shift(nnext_op->type), mir::reg(dst_reg, Type::i32), mir::reg(cast_reg, Type::i32), mir::reg(in1_reg, Type::i32));
 
                                             clear_reg(cur_time, dst_reg);
                                             set_var_to_reg(cur_time, nnext_var, dst_reg);
@@ -614,13 +777,7 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                                     // check if the shift operand is 64bit and we shift the anded value
                                     if (next_op->in_vars[0]->type == Type::i64 && next_op->in_vars[1] == dst) {
                                         const auto shift_reg = load_val_in_reg(cur_time, next_op->in_vars[0].get());
-                                        if (next_op->type == Instruction::shl) {
-                                            print_asm("shlx %s, %s, %s\n", reg_names[dst_reg][0], reg_names[shift_reg][0], reg_names[in1_reg][0]);
-                                        } else if (next_op->type == Instruction::shr) {
-                                            print_asm("shrx %s, %s, %s\n", reg_names[dst_reg][0], reg_names[shift_reg][0], reg_names[in1_reg][0]);
-                                        } else if (next_op->type == Instruction::sar) {
-                                            print_asm("sarx %s, %s, %s\n", reg_names[dst_reg][0], reg_names[shift_reg][0], reg_names[in1_reg][0]);
-                                        }
+                                        emit(bmi2_shift(next_op->type), mir::reg(dst_reg), mir::reg(shift_reg), mir::reg(in1_reg));
                                         next_var->gen_info.already_generated = true;
                                         clear_reg(cur_time, dst_reg);
                                         set_var_to_reg(cur_time, next_var, dst_reg);
@@ -636,96 +793,96 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                     break;
                 }
 
-                const auto op_with_imm32 = [imm_val, this, in1_reg_name, cur_time, in1, in2](const char *op_str) {
+                const auto op_with_imm32 = [imm_val, this, in1_op, cur_time, in1, in2](const mir::Opcode opcode) {
                     // 0x8000'0000'0000'0000 cannot be represented as uint64_t
                     if (imm_val != INT64_MIN && std::abs(imm_val) <= 0x7FFF'FFFF) {
-                        print_asm("%s %s, 0x%lx\n", op_str, in1_reg_name, imm_val);
+                        emit(opcode, in1_op, mir::hex_imm(imm_val));
                     } else {
                         auto imm_reg = alloc_reg(cur_time);
-                        print_asm("mov %s, 0x%lx\n", reg_names[imm_reg][0], imm_val);
-                        print_asm("%s %s, %s\n", op_str, in1_reg_name, reg_name(imm_reg, choose_type(in1, in2)));
+                        emit(mir::Opcode::MOV, mir::reg(imm_reg), mir::hex_imm(imm_val));
+                        emit(opcode, in1_op, mir::reg(imm_reg, choose_type(in1, in2)));
                     }
                 };
                 switch (op->type) {
                 case Instruction::add:
                     if (dst_reg == in1_reg) {
-                        op_with_imm32("add");
+                        op_with_imm32(mir::Opcode::ADD);
                     } else {
                         if (imm_val != INT64_MIN && std::abs(imm_val) <= 0x7FFF'FFFF) {
-                            print_asm("lea %s, [%s + %ld]\n", dst_reg_name, in1_reg_name, imm_val);
+                            emit(mir::Opcode::LEA, mir::reg(dst_reg, choose_type(in1, in2)), mir::mem(in1_reg, imm_val));
                         } else {
                             auto imm_reg = alloc_reg(cur_time);
-                            print_asm("mov %s, %ld\n", reg_names[imm_reg][0], imm_val);
-                            print_asm("lea %s, [%s + %s]\n", reg_names[dst_reg][0], reg_names[in1_reg][0], reg_names[imm_reg][0]);
+                            emit(mir::Opcode::MOV, mir::reg(imm_reg), mir::imm(imm_val));
+                            emit(mir::Opcode::LEA, mir::reg(dst_reg), mir::mem(in1_reg, imm_reg));
                         }
                     }
                     break;
                 case Instruction::sub:
-                    op_with_imm32("sub");
+                    op_with_imm32(mir::Opcode::SUB);
                     break;
                 case Instruction::shl:
-                    print_asm("shl %s, %ld\n", in1_reg_name, imm_val);
+                    emit(mir::Opcode::SHL, in1_op, mir::imm(imm_val));
                     break;
                 case Instruction::shr:
-                    print_asm("shr %s, %ld\n", in1_reg_name, imm_val);
+                    emit(mir::Opcode::SHR, in1_op, mir::imm(imm_val));
                     break;
                 case Instruction::sar:
-                    print_asm("sar %s, %ld\n", in1_reg_name, imm_val);
+                    emit(mir::Opcode::SAR, in1_op, mir::imm(imm_val));
                     break;
                 case Instruction::_or:
-                    op_with_imm32("or");
+                    op_with_imm32(mir::Opcode::OR);
                     break;
                 case Instruction::_and:
-                    op_with_imm32("and");
+                    op_with_imm32(mir::Opcode::AND);
                     break;
                 case Instruction::_xor:
-                    op_with_imm32("xor");
+                    op_with_imm32(mir::Opcode::XOR);
                     break;
                 case Instruction::umax:
-                    op_with_imm32("cmp");
-                    print_asm("jae b%zu_%zu_max\n", bb->id, var_idx);
-                    print_asm("mov %s, %ld\n", in1_reg_name, imm_val);
-                    print_asm("b%zu_%zu_max:\n", bb->id, var_idx);
+                    op_with_imm32(mir::Opcode::CMP);
+                    emit(mir::Opcode::JCC, mir::Cond::AE, mir::label(mir::symbol(mir::Symbol::Kind::UMAX, bb->id, var_idx)));
+                    emit(mir::Opcode::MOV, in1_op, mir::imm(imm_val));
+                    asm_buf.label(mir::symbol(mir::Symbol::Kind::UMAX, bb->id, var_idx));
                     break;
                 case Instruction::umin:
-                    op_with_imm32("cmp");
-                    print_asm("jbe b%zu_%zu_min\n", bb->id, var_idx);
-                    print_asm("mov %s, %ld\n", in1_reg_name, imm_val);
-                    print_asm("b%zu_%zu_min:\n", bb->id, var_idx);
+                    op_with_imm32(mir::Opcode::CMP);
+                    emit(mir::Opcode::JCC, mir::Cond::BE, mir::label(mir::symbol(mir::Symbol::Kind::UMIN, bb->id, var_idx)));
+                    emit(mir::Opcode::MOV, in1_op, mir::imm(imm_val));
+                    asm_buf.label(mir::symbol(mir::Symbol::Kind::UMIN, bb->id, var_idx));
                     break;
                 case Instruction::max:
-                    op_with_imm32("cmp");
-                    print_asm("jge b%zu_%zu_smax\n", bb->id, var_idx);
-                    print_asm("mov %s, %ld\n", in1_reg_name, imm_val);
-                    print_asm("b%zu_%zu_smax:\n", bb->id, var_idx);
+                    op_with_imm32(mir::Opcode::CMP);
+                    emit(mir::Opcode::JCC, mir::Cond::GE, mir::label(mir::symbol(mir::Symbol::Kind::SMAX, bb->id, var_idx)));
+                    emit(mir::Opcode::MOV, in1_op, mir::imm(imm_val));
+                    asm_buf.label(mir::symbol(mir::Symbol::Kind::SMAX, bb->id, var_idx));
                     break;
                 case Instruction::min:
-                    op_with_imm32("cmp");
-                    print_asm("jle b%zu_%zu_smin\n", bb->id, var_idx);
-                    print_asm("mov %s, %ld\n", in1_reg_name, imm_val);
-                    print_asm("b%zu_%zu_smin:\n", bb->id, var_idx);
+                    op_with_imm32(mir::Opcode::CMP);
+                    emit(mir::Opcode::JCC, mir::Cond::LE, mir::label(mir::symbol(mir::Symbol::Kind::SMIN, bb->id, var_idx)));
+                    emit(mir::Opcode::MOV, in1_op, mir::imm(imm_val));
+                    asm_buf.label(mir::symbol(mir::Symbol::Kind::SMIN, bb->id, var_idx));
                     break;
                 case Instruction::mul_l:
-                    op_with_imm32("imul");
+                    op_with_imm32(mir::Opcode::IMUL);
                     break;
                 case Instruction::ssmul_h: {
                     const auto imm_reg = load_val_in_reg(cur_time, in2);
-                    print_asm("imul %s\n", reg_name(imm_reg, in1->type));
+                    emit(mir::Opcode::IMUL, mir::reg(imm_reg, in1->type));
                     break;
                 }
                 case Instruction::uumul_h: {
                     const auto imm_reg = load_val_in_reg(cur_time, in2);
-                    print_asm("mul %s\n", reg_name(imm_reg, in1->type));
+                    emit(mir::Opcode::MUL, mir::reg(imm_reg, in1->type));
                     break;
                 }
                 case Instruction::div: {
                     const auto imm_reg = load_val_in_reg(cur_time, in2, REG_NONE, REG_D);
-                    print_asm("idiv %s\n", reg_name(imm_reg, in1->type));
+                    emit(mir::Opcode::IDIV, mir::reg(imm_reg, in1->type));
                     break;
                 }
                 case Instruction::udiv: {
                     const auto imm_reg = load_val_in_reg(cur_time, in2, REG_NONE, REG_D);
-                    print_asm("div %s\n", reg_name(imm_reg, in1->type));
+                    emit(mir::Opcode::DIV, mir::reg(imm_reg, in1->type));
                     break;
                 }
                 default:
@@ -752,6 +909,40 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                 break;
             }
             // TODO: when in1 == imm & in2 != imm and we have a sub we can neg in2, add in2, in1
+            if (folded_vars.count(in1) != 0 || folded_vars.count(in2) != 0) {
+                // one of the inputs is a load that is used as a memory operand
+                auto *load_var = (folded_vars.count(in2) != 0 ? in2 : in1);
+                auto *other = (load_var == in2 ? in1 : in2);
+                const auto mem_op = address_operand(cur_time, folded_addrs.at(load_var));
+                const auto other_reg = load_val_in_reg(cur_time, other);
+                if (other->gen_info.last_use_time > cur_time) {
+                    save_reg(other_reg);
+                }
+
+                auto opcode = mir::Opcode::ADD;
+                switch (op->type) {
+                case Instruction::sub:
+                    opcode = mir::Opcode::SUB;
+                    break;
+                case Instruction::_and:
+                    opcode = mir::Opcode::AND;
+                    break;
+                case Instruction::_or:
+                    opcode = mir::Opcode::OR;
+                    break;
+                case Instruction::_xor:
+                    opcode = mir::Opcode::XOR;
+                    break;
+                default:
+                    assert(op->type == Instruction::add);
+                    break;
+                }
+                emit(opcode, mir::reg(other_reg, Type::i64), mem_op);
+                clear_reg(cur_time, other_reg);
+                set_var_to_reg(cur_time, dst, other_reg);
+                break;
+            }
+
             REGISTER in1_reg, in2_reg;
             if (op->type == Instruction::ssmul_h || op->type == Instruction::uumul_h) {
                 // TODO: here we could optimise and accept either in1 or in2 in reg a if one of them already is or is already in a register
@@ -771,13 +962,9 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                 }
                 clear_reg(cur_time, REG_D);
                 if (op->type == Instruction::div) {
-                    if (var->type == Type::i32) {
-                        print_asm("cdq\n");
-                    } else {
-                        print_asm("cqo\n");
-                    }
+                    emit(var->type == Type::i32 ? mir::Opcode::CDQ : mir::Opcode::CQO);
                 } else {
-                    print_asm("xor edx, edx\n");
+                    emit(mir::Opcode::XOR, mir::reg(REG_D, Type::i32), mir::reg(REG_D, Type::i32));
                 }
             } else if (op->type == Instruction::shl || op->type == Instruction::shr || op->type == Instruction::sar) {
                 if (!(gen->optimizations & Generator::OPT_ARCH_BMI2) || (op->in_vars[0]->type != Type::i64 && op->in_vars[0]->type != Type::i32)) {
@@ -792,8 +979,8 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                 in2_reg = load_val_in_reg(cur_time, in2);
             }
             const auto type = choose_type(in1, in2);
-            const auto in1_reg_name = reg_name(in1_reg, type);
-            const auto in2_reg_name = reg_name(in2_reg, type);
+            const auto in1_op = mir::reg(in1_reg, type);
+            const auto in2_op = mir::reg(in2_reg, type);
 
             if (in1->gen_info.last_use_time > cur_time) {
                 save_reg(in1_reg);
@@ -803,68 +990,68 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                 break;
             }
 
-            const auto write_shift = [this, in1_reg_name, in2_reg_name, op](const char *instr_name) {
+            const auto write_shift = [this, in1_op, in2_op, op](const mir::Opcode shift) {
                 if (!(gen->optimizations & Generator::OPT_ARCH_BMI2) || (op->in_vars[0]->type != Type::i64 && op->in_vars[0]->type != Type::i32)) {
-                    print_asm("%s %s, cl\n", instr_name, in1_reg_name);
+                    emit(shift, in1_op, mir::reg(REG_C, Type::i8));
                 } else {
-                    print_asm("%sx %s, %s, %s\n", instr_name, in1_reg_name, in1_reg_name, in2_reg_name);
+                    emit(bmi2_shift(op->type), in1_op, in1_op, in2_op);
                 }
             };
             switch (op->type) {
             case Instruction::add:
-                print_asm("add %s, %s\n", in1_reg_name, in2_reg_name);
+                emit(mir::Opcode::ADD, in1_op, in2_op);
                 break;
             case Instruction::sub:
-                print_asm("sub %s, %s\n", in1_reg_name, in2_reg_name);
+                emit(mir::Opcode::SUB, in1_op, in2_op);
                 break;
             case Instruction::shl:
-                write_shift("shl");
+                write_shift(mir::Opcode::SHL);
                 break;
             case Instruction::shr:
-                write_shift("shr");
+                write_shift(mir::Opcode::SHR);
                 break;
             case Instruction::sar:
-                write_shift("sar");
+                write_shift(mir::Opcode::SAR);
                 break;
             case Instruction::_or:
-                print_asm("or %s, %s\n", in1_reg_name, in2_reg_name);
+                emit(mir::Opcode::OR, in1_op, in2_op);
                 break;
             case Instruction::_and:
-                print_asm("and %s, %s\n", in1_reg_name, in2_reg_name);
+                emit(mir::Opcode::AND, in1_op, in2_op);
                 break;
             case Instruction::_xor:
-                print_asm("xor %s, %s\n", in1_reg_name, in2_reg_name);
+                emit(mir::Opcode::XOR, in1_op, in2_op);
                 break;
             case Instruction::umax:
-                print_asm("cmp %s, %s\n", in1_reg_name, in2_reg_name);
-                print_asm("cmovb %s, %s\n", in1_reg_name, in2_reg_name);
+                emit(mir::Opcode::CMP, in1_op, in2_op);
+                emit(mir::Opcode::CMOVCC, mir::Cond::B, in1_op, in2_op);
                 break;
             case Instruction::umin:
-                print_asm("cmp %s, %s\n", in1_reg_name, in2_reg_name);
-                print_asm("cmova %s, %s\n", in1_reg_name, in2_reg_name);
+                emit(mir::Opcode::CMP, in1_op, in2_op);
+                emit(mir::Opcode::CMOVCC, mir::Cond::A, in1_op, in2_op);
                 break;
             case Instruction::max:
-                print_asm("cmp %s, %s\n", in1_reg_name, in2_reg_name);
-                print_asm("cmovl %s, %s\n", in1_reg_name, in2_reg_name);
+                emit(mir::Opcode::CMP, in1_op, in2_op);
+                emit(mir::Opcode::CMOVCC, mir::Cond::L, in1_op, in2_op);
                 break;
             case Instruction::min:
-                print_asm("cmp %s, %s\n", in1_reg_name, in2_reg_name);
-                print_asm("cmovg %s, %s\n", in1_reg_name, in2_reg_name);
+                emit(mir::Opcode::CMP, in1_op, in2_op);
+                emit(mir::Opcode::CMOVCC, mir::Cond::G, in1_op, in2_op);
                 break;
             case Instruction::mul_l:
-                print_asm("imul %s, %s\n", in1_reg_name, in2_reg_name);
+                emit(mir::Opcode::IMUL, in1_op, in2_op);
                 break;
             case Instruction::ssmul_h:
-                print_asm("imul %s\n", in2_reg_name);
+                emit(mir::Opcode::IMUL, in2_op);
                 break;
             case Instruction::uumul_h:
-                print_asm("mul %s\n", in2_reg_name);
+                emit(mir::Opcode::MUL, in2_op);
                 break;
             case Instruction::div:
-                print_asm("idiv %s\n", in2_reg_name);
+                emit(mir::Opcode::IDIV, in2_op);
                 break;
             case Instruction::udiv:
-                print_asm("div %s\n", in2_reg_name);
+                emit(mir::Opcode::DIV, in2_op);
                 break;
             default:
                 // should never be hit
@@ -893,13 +1080,18 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
             auto *addr = op->in_vars[0].get();
             auto *dst = op->out_vars[0];
 
+            if (const auto it = folded_addrs.find(dst); it != folded_addrs.end()) {
+                compile_folded_load(cur_time, var_idx, it->second);
+                break;
+            }
+
             // TODO: when addr is a (binary-relative) immediate it should be foldable into one instruction
             const auto addr_reg = load_val_in_reg(cur_time, addr);
             if (addr->gen_info.last_use_time > cur_time) {
                 save_reg(addr_reg);
             }
 
-            print_asm("mov %s, [%s]\n", reg_name(addr_reg, dst->type), reg_names[addr_reg][0]);
+            emit(mir::Opcode::MOV, mir::reg(addr_reg, dst->type), mir::mem(addr_reg));
             clear_reg(cur_time, addr_reg);
             set_var_to_reg(cur_time, dst, addr_reg);
             break;
@@ -909,17 +1101,31 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
             auto *val = op->in_vars[1].get();
             assert(addr->is_immediate() || addr->type == Type::i64);
 
+            if (const auto it = folded_addrs.find(var); it != folded_addrs.end()) {
+                const auto addr_op = address_operand(cur_time, it->second);
+                if (val->is_immediate() && !val->get_immediate().binary_relative) {
+                    const auto imm_val = val->get_immediate().val;
+                    if (imm_val != INT64_MIN && std::abs(imm_val) < 0x7FFFFFFF) {
+                        emit(mir::Opcode::MOV, mir::sized(addr_op, op->lifter_info.in_op_size), mir::imm(imm_val));
+                        break;
+                    }
+                }
+                const auto val_reg = load_val_in_reg(cur_time, val);
+                emit(mir::Opcode::MOV, addr_op, mir::reg(val_reg, op->lifter_info.in_op_size));
+                break;
+            }
+
             // TODO: when addr is a (binary-relative) immediate this can be omitted sometimes
             const auto addr_reg = load_val_in_reg(cur_time, addr);
             if (val->is_immediate() && !val->get_immediate().binary_relative) {
                 const auto imm_val = val->get_immediate().val;
                 if (imm_val != INT64_MIN && std::abs(imm_val) < 0x7FFFFFFF) {
-                    print_asm("mov %s [%s], %ld\n", mem_size(op->lifter_info.in_op_size), reg_names[addr_reg][0], imm_val);
+                    emit(mir::Opcode::MOV, mir::sized(mir::mem(addr_reg), op->lifter_info.in_op_size), mir::imm(imm_val));
                     break;
                 }
             }
             const auto val_reg = load_val_in_reg(cur_time, val);
-            print_asm("mov [%s], %s\n", reg_names[addr_reg][0], reg_name(val_reg, op->lifter_info.in_op_size));
+            emit(mir::Opcode::MOV, mir::mem(addr_reg), mir::reg(val_reg, op->lifter_info.in_op_size));
             break;
         }
         case Instruction::_not: {
@@ -932,7 +1138,7 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                 save_reg(val_reg);
             }
 
-            print_asm("not %s\n", reg_name(val_reg, val->is_immediate() ? Type::i64 : val->type));
+            emit(mir::Opcode::NOT, mir::reg(val_reg, val->is_immediate() ? Type::i64 : val->type));
             clear_reg(cur_time, val_reg);
             set_var_to_reg(cur_time, dst, val_reg);
             break;
@@ -956,27 +1162,29 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
             if (val1->is_immediate() && val2->is_immediate()) {
                 const auto &val1_info = std::get<SSAVar::ImmInfo>(val1->info);
                 const auto &val2_info = std::get<SSAVar::ImmInfo>(val2->info);
-                if (val1_info.val == 1 && !val1_info.binary_relative && val2_info.val == 0 && !val2_info.binary_relative) {
+                // with the values the other way around the inverted condition is set
+                const auto set_if_true = (val1_info.val == 1 && val2_info.val == 0);
+                if ((set_if_true || (val1_info.val == 0 && val2_info.val == 1)) && !val1_info.binary_relative && !val2_info.binary_relative) {
                     if (cmp2->is_immediate() && !std::get<SSAVar::ImmInfo>(cmp2->info).binary_relative && std::get<SSAVar::ImmInfo>(cmp2->info).val != INT64_MIN &&
                         std::abs(cmp2->get_immediate().val) < 0x7FFF'FFFF) {
                         const auto type = cmp1->is_immediate() ? Type::i64 : cmp1->type;
-                        print_asm("cmp %s, %ld\n", reg_name(cmp1_reg, type), std::get<SSAVar::ImmInfo>(cmp2->info).val);
+                        emit(mir::Opcode::CMP, mir::reg(cmp1_reg, type), mir::imm(std::get<SSAVar::ImmInfo>(cmp2->info).val));
                     } else {
                         const auto cmp2_reg = load_val_in_reg(cur_time, cmp2);
                         auto type = choose_type(cmp1, cmp2);
-                        print_asm("cmp %s, %s\n", reg_name(cmp1_reg, type), reg_name(cmp2_reg, type));
+                        emit(mir::Opcode::CMP, mir::reg(cmp1_reg, type), mir::reg(cmp2_reg, type));
                     }
 
                     if (!cmp1->is_immediate() || std::get<SSAVar::ImmInfo>(cmp1->info).binary_relative || static_cast<uint64_t>(std::get<SSAVar::ImmInfo>(cmp1->info).val) > 255) {
                         // dont need to clear if we know the register holds a value that fits into 1 byte
-                        print_asm("mov %s, 0\n", reg_names[cmp1_reg][0]);
+                        emit(mir::Opcode::MOV, mir::reg(cmp1_reg), mir::imm(0));
                     }
                     if (op->type == Instruction::seq) {
-                        print_asm("sete %s\n", reg_names[cmp1_reg][3]);
+                        emit(mir::Opcode::SETCC, set_if_true ? mir::Cond::E : mir::Cond::NE, mir::reg(cmp1_reg, Type::i8));
                     } else if (op->type == Instruction::slt) {
-                        print_asm("setl %s\n", reg_names[cmp1_reg][3]);
+                        emit(mir::Opcode::SETCC, set_if_true ? mir::Cond::L : mir::Cond::GE, mir::reg(cmp1_reg, Type::i8));
                     } else {
-                        print_asm("setb %s\n", reg_names[cmp1_reg][3]);
+                        emit(mir::Opcode::SETCC, set_if_true ? mir::Cond::B : mir::Cond::AE, mir::reg(cmp1_reg, Type::i8));
                     }
                     clear_reg(cur_time, cmp1_reg);
                     set_var_to_reg(cur_time, dst, cmp1_reg);
@@ -990,22 +1198,23 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
             if (cmp2->is_immediate() && !std::get<SSAVar::ImmInfo>(cmp2->info).binary_relative && std::get<SSAVar::ImmInfo>(cmp2->info).val != INT64_MIN &&
                 std::abs(std::get<SSAVar::ImmInfo>(cmp2->info).val) <= 0x7FFFFFFF) {
                 const auto type = cmp1->is_immediate() ? Type::i64 : cmp1->type;
-                print_asm("cmp %s, %ld\n", reg_name(cmp1_reg, type), std::get<SSAVar::ImmInfo>(cmp2->info).val);
+                emit(mir::Opcode::CMP, mir::reg(cmp1_reg, type), mir::imm(std::get<SSAVar::ImmInfo>(cmp2->info).val));
             } else {
                 const auto cmp2_reg = load_val_in_reg(cur_time, cmp2);
                 auto type = choose_type(cmp1, cmp2);
-                print_asm("cmp %s, %s\n", reg_name(cmp1_reg, type), reg_name(cmp2_reg, type));
+                emit(mir::Opcode::CMP, mir::reg(cmp1_reg, type), mir::reg(cmp2_reg, type));
             }
 
+            const auto dst_op = mir::reg(cmp1_reg, dst->type);
             if (op->type == Instruction::seq) {
-                print_asm("cmove %s, %s\n", reg_name(cmp1_reg, dst->type), reg_name(val1_reg, dst->type));
-                print_asm("cmovne %s, %s\n", reg_name(cmp1_reg, dst->type), reg_name(val2_reg, dst->type));
+                emit(mir::Opcode::CMOVCC, mir::Cond::E, dst_op, mir::reg(val1_reg, dst->type));
+                emit(mir::Opcode::CMOVCC, mir::Cond::NE, dst_op, mir::reg(val2_reg, dst->type));
             } else if (op->type == Instruction::slt) {
-                print_asm("cmovl %s, %s\n", reg_name(cmp1_reg, dst->type), reg_name(val1_reg, dst->type));
-                print_asm("cmovge %s, %s\n", reg_name(cmp1_reg, dst->type), reg_name(val2_reg, dst->type));
+                emit(mir::Opcode::CMOVCC, mir::Cond::L, dst_op, mir::reg(val1_reg, dst->type));
+                emit(mir::Opcode::CMOVCC, mir::Cond::GE, dst_op, mir::reg(val2_reg, dst->type));
             } else {
-                print_asm("cmovb %s, %s\n", reg_name(cmp1_reg, dst->type), reg_name(val1_reg, dst->type));
-                print_asm("cmovae %s, %s\n", reg_name(cmp1_reg, dst->type), reg_name(val2_reg, dst->type));
+                emit(mir::Opcode::CMOVCC, mir::Cond::B, dst_op, mir::reg(val1_reg, dst->type));
+                emit(mir::Opcode::CMOVCC, mir::Cond::AE, dst_op, mir::reg(val2_reg, dst->type));
             }
 
             clear_reg(cur_time, cmp1_reg);
@@ -1016,7 +1225,7 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
             auto *dst = op->out_vars[0];
             assert(dst->type == Type::i64);
             const auto dst_reg = alloc_reg(cur_time);
-            print_asm("mov %s, [init_stack_ptr]\n", reg_names[dst_reg][0]);
+            emit(mir::Opcode::MOV, mir::reg(dst_reg), mir::tcb("init_stack_ptr"));
             set_var_to_reg(cur_time, dst, dst_reg);
             break;
         }
@@ -1047,22 +1256,20 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                     exit(1);
                 }
                 const auto dst_reg = alloc_reg(cur_time);
-                const auto dst_reg_name = reg_name(dst_reg, output->type);
-                print_asm("mov %s, %ld\n", dst_reg_name, imm);
+                emit(mir::Opcode::MOV, mir::reg(dst_reg, output->type), mir::imm(imm));
 
                 set_var_to_reg(cur_time, output, dst_reg);
                 break;
             }
 
             const auto dst_reg = load_val_in_reg(cur_time, input);
-            const auto dst_reg_name = reg_name(dst_reg, input->type);
             if (input->gen_info.last_use_time > cur_time) {
                 save_reg(dst_reg);
             }
 
             // TODO: in theory you could simply alias the input var for cast and zero_extend
             if (op->type == Instruction::sign_extend) {
-                print_asm("movsx %s, %s\n", reg_name(dst_reg, output->type), dst_reg_name);
+                emit(mir::Opcode::MOVSX, mir::reg(dst_reg, output->type), mir::reg(dst_reg, input->type));
             } else if (input->type != output->type) {
                 // clear upper parts of register
                 // find smallest type
@@ -1075,13 +1282,12 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
                     type = Type::i32;
                 }
                 if (type == Type::i32) {
-                    const auto name = reg_name(dst_reg, type);
-                    print_asm("mov %s, %s\n", name, name);
+                    emit(mir::Opcode::MOV, mir::reg(dst_reg, type), mir::reg(dst_reg, type));
                 } else {
                     if (type == Type::i16) {
-                        print_asm("and %s, 0xFFFF\n", reg_names[dst_reg][0]);
+                        emit(mir::Opcode::AND, mir::reg(dst_reg), mir::hex_imm(0xFFFF));
                     } else if (type == Type::i8) {
-                        print_asm("and %s, 0xFF\n", reg_names[dst_reg][0]);
+                        emit(mir::Opcode::AND, mir::reg(dst_reg), mir::hex_imm(0xFF));
                     }
                     // nothing to do for 64 bit
                 }
@@ -1091,6 +1297,139 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
             set_var_to_reg(cur_time, output, dst_reg);
             break;
         }
+        case Instruction::atomic_rmw: {
+            auto *addr = op->in_vars[0].get();
+            auto *val = op->in_vars[1].get();
+            auto *dst = op->out_vars[0];
+            const auto type = op->lifter_info.in_op_size;
+            const auto rmw_op = op->atomic_info.rmw_op;
+
+            if (rmw_op == Instruction::store || rmw_op == Instruction::add) {
+                // xchg with memory is always locked, both leave the old value in the register of val
+                const auto addr_reg = load_val_in_reg(cur_time, addr);
+                const auto val_reg = load_val_in_reg(cur_time, val, REG_NONE, addr_reg);
+                if (val->gen_info.last_use_time > cur_time) {
+                    save_reg(val_reg);
+                }
+                if (rmw_op == Instruction::store) {
+                    emit(mir::Opcode::XCHG, mir::sized(mir::mem(addr_reg), type), mir::reg(val_reg, type));
+                } else {
+                    emit(mir::Opcode::XADD, mir::sized(mir::mem(addr_reg), type), mir::reg(val_reg, type)).lock = true;
+                }
+                clear_reg(cur_time, val_reg);
+                set_var_to_reg(cur_time, dst, val_reg);
+                break;
+            }
+
+            if (dst->ref_count == 0 && (rmw_op == Instruction::_and || rmw_op == Instruction::_or || rmw_op == Instruction::_xor)) {
+                // nobody needs the old value (e.g. amoor.w zero, ...), no loop needed
+                const auto addr_reg = load_val_in_reg(cur_time, addr);
+                const auto val_reg = load_val_in_reg(cur_time, val);
+                const auto opcode = (rmw_op == Instruction::_and ? mir::Opcode::AND : (rmw_op == Instruction::_or ? mir::Opcode::OR : mir::Opcode::XOR));
+                emit(opcode, mir::sized(mir::mem(addr_reg), type), mir::reg(val_reg, type)).lock = true;
+                break;
+            }
+
+            // cmpxchg compares with rax and loads the current value into it if it differs, so the new value is
+            // computed again until the memory wasn't changed in between
+            const auto addr_reg = load_val_in_reg(cur_time, addr, REG_NONE, REG_A);
+            const auto val_reg = load_val_in_reg(cur_time, val, REG_NONE, REG_A);
+            if (reg_map[REG_A].cur_var && reg_map[REG_A].cur_var->gen_info.last_use_time > cur_time) {
+                save_reg(REG_A);
+            }
+            clear_reg(cur_time, REG_A);
+            const auto new_reg = alloc_reg(cur_time, REG_NONE, REG_A, addr_reg, val_reg);
+            const auto rax_op = mir::reg(REG_A, type);
+            const auto val_op = mir::reg(val_reg, type);
+            const auto new_op = mir::reg(new_reg, type);
+            const auto loop_label = mir::symbol(mir::Symbol::Kind::ATOMIC, bb->id, var_idx);
+
+            emit(mir::Opcode::MOV, rax_op, mir::sized(mir::mem(addr_reg), type));
+            asm_buf.label(loop_label);
+            emit(mir::Opcode::MOV, new_op, val_op);
+            switch (rmw_op) {
+            case Instruction::_and:
+                emit(mir::Opcode::AND, new_op, rax_op);
+                break;
+            case Instruction::_or:
+                emit(mir::Opcode::OR, new_op, rax_op);
+                break;
+            case Instruction::_xor:
+                emit(mir::Opcode::XOR, new_op, rax_op);
+                break;
+            case Instruction::max:
+                emit(mir::Opcode::CMP, rax_op, val_op);
+                emit(mir::Opcode::CMOVCC, mir::Cond::G, new_op, rax_op);
+                break;
+            case Instruction::min:
+                emit(mir::Opcode::CMP, rax_op, val_op);
+                emit(mir::Opcode::CMOVCC, mir::Cond::L, new_op, rax_op);
+                break;
+            case Instruction::umax:
+                emit(mir::Opcode::CMP, rax_op, val_op);
+                emit(mir::Opcode::CMOVCC, mir::Cond::A, new_op, rax_op);
+                break;
+            case Instruction::umin:
+                emit(mir::Opcode::CMP, rax_op, val_op);
+                emit(mir::Opcode::CMOVCC, mir::Cond::B, new_op, rax_op);
+                break;
+            default:
+                // should never be hit
+                assert(0);
+                exit(1);
+            }
+            emit(mir::Opcode::CMPXCHG, mir::sized(mir::mem(addr_reg), type), new_op).lock = true;
+            emit(mir::Opcode::JCC, mir::Cond::NE, mir::label(loop_label));
+            set_var_to_reg(cur_time, dst, REG_A);
+            break;
+        }
+        case Instruction::cas: {
+            auto *addr = op->in_vars[0].get();
+            auto *expected = op->in_vars[1].get();
+            auto *new_val = op->in_vars[2].get();
+            auto *dst = op->out_vars[0];
+            const auto type = op->lifter_info.in_op_size;
+
+            // the value in memory ends up in rax whether it's replaced or not
+            const auto expected_reg = load_val_in_reg(cur_time, expected, REG_A);
+            if (expected->gen_info.last_use_time > cur_time) {
+                save_reg(expected_reg);
+            }
+            const auto addr_reg = load_val_in_reg(cur_time, addr, REG_NONE, REG_A);
+            const auto new_reg = load_val_in_reg(cur_time, new_val, REG_NONE, REG_A);
+            emit(mir::Opcode::CMPXCHG, mir::sized(mir::mem(addr_reg), type), mir::reg(new_reg, type)).lock = true;
+            clear_reg(cur_time, expected_reg);
+            set_var_to_reg(cur_time, dst, REG_A);
+            break;
+        }
+        case Instruction::load_reserved: {
+            auto *addr = op->in_vars[0].get();
+            auto *dst = op->out_vars[0];
+
+            const auto addr_reg = load_val_in_reg(cur_time, addr);
+            if (addr->gen_info.last_use_time > cur_time) {
+                save_reg(addr_reg);
+            }
+
+            // the loads of x86 aren't reordered with other loads, a plain load already has acquire semantics
+            emit(mir::Opcode::MOV, mir::reg(addr_reg, dst->type), mir::mem(addr_reg));
+            emit(mir::Opcode::MOV, mir::tcb("reservation"), mir::reg(addr_reg));
+            clear_reg(cur_time, addr_reg);
+            set_var_to_reg(cur_time, dst, addr_reg);
+            break;
+        }
+        case Instruction::reservation: {
+            auto *dst = op->out_vars[0];
+            const auto dst_reg = alloc_reg(cur_time);
+            emit(mir::Opcode::MOV, mir::reg(dst_reg, dst->type), mir::tcb("reservation"));
+            set_var_to_reg(cur_time, dst, dst_reg);
+            break;
+        }
+        case Instruction::fence:
+            if (Generator::fence_needs_barrier(*op)) {
+                emit(mir::Opcode::MFENCE);
+            }
+            break;
         default:
             fprintf(stderr, "Encountered unknown instruction in generator\n");
             assert(0);
@@ -1099,24 +1438,28 @@ void RegAlloc::compile_vars(BasicBlock *bb) {
     }
 }
 
-void RegAlloc::compile_fp_op(SSAVar *var, size_t cur_time) {
+void RegAlloc::GroupContext::compile_fp_op(SSAVar *var, size_t cur_time) {
     const auto *op = std::get<std::unique_ptr<Operation>>(var->info).get();
     SSAVar *in1 = op->in_vars[0];
+    if (op->type != Instruction::convert && op->type != Instruction::uconvert) {
+        // the arithmetic is rounded to nearest
+        compile_rounding_mode(cur_time, op);
+    }
     // handles binary fp operations
-    auto bin_op = [this, var, op, in1, cur_time](const char *instruction) {
+    auto bin_op = [this, var, op, in1, cur_time](const mir::Opcode instruction) {
         assert(is_float(var->type) && var->type == op->in_vars[0]->type && var->type == op->in_vars[1]->type);
         const FP_REGISTER in1_reg = load_val_in_fp_reg(cur_time, op->in_vars[0]);
         const FP_REGISTER in2_reg = load_val_in_fp_reg(cur_time, op->in_vars[1]);
         if (in1->gen_info.last_use_time > cur_time) {
             save_fp_reg(in1_reg);
         }
-        print_asm("%s%s %s, %s\n", instruction, Generator::fp_op_size_from_type(var->type), fp_reg_names[in1_reg], fp_reg_names[in2_reg]);
+        emit(mir::scalar(instruction, var->type), mir::fp_reg(in1_reg), mir::fp_reg(in2_reg));
         clear_fp_reg(cur_time, in1_reg);
         set_var_to_fp_reg(cur_time, var, in1_reg);
     };
 
     // handles fused multiply add operations
-    auto fma_op = [this, var, op, in1, cur_time](const char *fma_instruction, const char *second_instruction, const bool negate_mul_res = false) {
+    auto fma_op = [this, var, op, in1, cur_time](const mir::Opcode fma_instruction, const mir::Opcode second_instruction, const bool negate_mul_res = false) {
         assert(is_float(var->type) && var->type == in1->type && var->type == op->in_vars[1]->type && var->type == op->in_vars[2]->type);
         const FP_REGISTER in1_reg = load_val_in_fp_reg(cur_time, in1);
         const FP_REGISTER in2_reg = load_val_in_fp_reg(cur_time, op->in_vars[1]);
@@ -1125,25 +1468,25 @@ void RegAlloc::compile_fp_op(SSAVar *var, size_t cur_time) {
             save_fp_reg(in1_reg);
         }
         if (gen->optimizations & Generator::OPT_ARCH_FMA3) {
-            print_asm("%s%s %s, %s, %s\n", fma_instruction, Generator::fp_op_size_from_type(var->type), fp_reg_names[in1_reg], fp_reg_names[in2_reg], fp_reg_names[in3_reg]);
+            emit(mir::scalar(fma_instruction, var->type), mir::fp_reg(in1_reg), mir::fp_reg(in2_reg), mir::fp_reg(in3_reg));
         } else {
             assert(is_float(var->type) && var->type == in1->type && var->type == op->in_vars[1]->type && var->type == op->in_vars[2]->type);
-            print_asm("muls%s %s, %s\n", Generator::fp_op_size_from_type(var->type), fp_reg_names[in1_reg], fp_reg_names[in2_reg]);
+            emit(mir::scalar(mir::Opcode::MULSS, var->type), mir::fp_reg(in1_reg), mir::fp_reg(in2_reg));
             if (negate_mul_res) {
                 const REGISTER tempr_reg = alloc_reg(cur_time);
-                print_asm("mov %s, %lu\n", reg_name(tempr_reg, Type::i64), (var->type == Type::f32 ? 0x8000'0000 : 0x8000'0000'0000'0000));
-                print_asm("push %s\n", reg_name(tempr_reg, Type::i64));
-                print_asm("push QWORD PTR 0\n");
-                print_asm("pxor %s, [rsp]\n", fp_reg_names[in1_reg]);
-                print_asm("add rsp, 16\n");
+                emit(mir::Opcode::MOV, mir::reg(tempr_reg, Type::i64), mir::hex_imm(var->type == Type::f32 ? 0x8000'0000 : INT64_MIN));
+                emit(mir::Opcode::PUSH, mir::reg(tempr_reg, Type::i64));
+                emit(mir::Opcode::PUSH, mir::imm(0));
+                emit(mir::Opcode::PXOR, mir::fp_reg(in1_reg), mir::mem(REG_SP));
+                emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(16));
             }
-            print_asm("%s%s %s, %s\n", second_instruction, Generator::fp_op_size_from_type(var->type), fp_reg_names[in1_reg], fp_reg_names[in3_reg]);
+            emit(mir::scalar(second_instruction, var->type), mir::fp_reg(in1_reg), mir::fp_reg(in3_reg));
         }
         clear_fp_reg(cur_time, in1_reg);
         set_var_to_fp_reg(cur_time, var, in1_reg);
     };
 
-    auto cmp_op = [this, var, op, in1, cur_time](const char *cc) {
+    auto cmp_op = [this, var, op, in1, cur_time](const mir::Cond cc) {
         SSAVar *cmp2 = op->in_vars[1];
         SSAVar *val1 = op->in_vars[2];
         SSAVar *val2 = op->in_vars[3];
@@ -1155,60 +1498,60 @@ void RegAlloc::compile_fp_op(SSAVar *var, size_t cur_time) {
         if (val1->gen_info.last_use_time > cur_time) {
             save_reg(val1_reg);
         }
-        print_asm("comis%s %s, %s\n", Generator::fp_op_size_from_type(in1->type), fp_reg_names[cmp1_reg], fp_reg_names[cmp2_reg]);
-        print_asm("cmov%s %s, %s\n", cc, reg_name(val1_reg, var->type), reg_name(val2_reg, var->type));
+        emit(mir::scalar(mir::Opcode::COMISS, in1->type), mir::fp_reg(cmp1_reg), mir::fp_reg(cmp2_reg));
+        emit(mir::Opcode::CMOVCC, cc, mir::reg(val1_reg, var->type), mir::reg(val2_reg, var->type));
         clear_reg(cur_time, val1_reg);
         set_var_to_reg(cur_time, var, val1_reg);
     };
 
     switch (op->type) {
     case Instruction::min:
-        bin_op("mins");
+        bin_op(mir::Opcode::MINSS);
         break;
     case Instruction::max:
-        bin_op("maxs");
+        bin_op(mir::Opcode::MAXSS);
         break;
     case Instruction::add:
-        bin_op("adds");
+        bin_op(mir::Opcode::ADDSS);
         break;
     case Instruction::sub:
-        bin_op("subs");
+        bin_op(mir::Opcode::SUBSS);
         break;
     case Instruction::fmul:
-        bin_op("muls");
+        bin_op(mir::Opcode::MULSS);
         break;
     case Instruction::fdiv:
-        bin_op("divs");
+        bin_op(mir::Opcode::DIVSS);
         break;
     case Instruction::fmadd:
-        fma_op("vfmadd213s", "adds");
+        fma_op(mir::Opcode::VFMADD213SS, mir::Opcode::ADDSS);
         break;
     case Instruction::fmsub:
-        fma_op("vfmsub213s", "subs");
+        fma_op(mir::Opcode::VFMSUB213SS, mir::Opcode::SUBSS);
         break;
     case Instruction::fnmadd:
-        fma_op("vfnmadd213s", "adds", true);
+        fma_op(mir::Opcode::VFNMADD213SS, mir::Opcode::ADDSS, true);
         break;
     case Instruction::fnmsub:
-        fma_op("vfnmsub213s", "subs", true);
+        fma_op(mir::Opcode::VFNMSUB213SS, mir::Opcode::SUBSS, true);
         break;
     case Instruction::fsqrt: {
         assert(is_float(var->type) && var->type == in1->type);
         const FP_REGISTER in1_reg = load_val_in_fp_reg(cur_time, in1);
         const FP_REGISTER dest_reg = alloc_fp_reg(cur_time);
-        print_asm("sqrts%s %s, %s\n", Generator::fp_op_size_from_type(var->type), fp_reg_names[dest_reg], fp_reg_names[in1_reg]);
+        emit(mir::scalar(mir::Opcode::SQRTSS, var->type), mir::fp_reg(dest_reg), mir::fp_reg(in1_reg));
         clear_fp_reg(cur_time, dest_reg);
         set_var_to_fp_reg(cur_time, var, dest_reg);
         break;
     }
     case Instruction::slt:
-        cmp_op("ae");
+        cmp_op(mir::Cond::AE);
         break;
     case Instruction::sle:
-        cmp_op("a");
+        cmp_op(mir::Cond::A);
         break;
     case Instruction::seq:
-        cmp_op("ne");
+        cmp_op(mir::Cond::NE);
         break;
     case Instruction::load: {
         assert(in1->type == Type::i64 || in1->type == Type::imm);
@@ -1217,7 +1560,7 @@ void RegAlloc::compile_fp_op(SSAVar *var, size_t cur_time) {
             save_reg(addr_reg);
         }
         const FP_REGISTER dest_reg = alloc_fp_reg(cur_time);
-        print_asm("mov%s %s, [%s]\n", (var->type == Type::f32 ? "d" : "q"), fp_reg_names[dest_reg], reg_names[addr_reg][0]);
+        emit(var->type == Type::f32 ? mir::Opcode::MOVD : mir::Opcode::MOVQ, mir::fp_reg(dest_reg), mir::mem(addr_reg));
         set_var_to_fp_reg(cur_time, var, dest_reg);
         break;
     }
@@ -1227,7 +1570,7 @@ void RegAlloc::compile_fp_op(SSAVar *var, size_t cur_time) {
         assert(is_float(val->type));
         const REGISTER addr_reg = load_val_in_reg(cur_time, in1);
         const FP_REGISTER val_reg = load_val_in_fp_reg(cur_time, val);
-        print_asm("mov%s [%s], %s\n", (val->type == Type::f32 ? "d" : "q"), reg_names[addr_reg][0], fp_reg_names[val_reg]);
+        emit(val->type == Type::f32 ? mir::Opcode::MOVD : mir::Opcode::MOVQ, mir::mem(addr_reg), mir::fp_reg(val_reg));
         break;
     }
     case Instruction::zero_extend:
@@ -1246,70 +1589,67 @@ void RegAlloc::compile_fp_op(SSAVar *var, size_t cur_time) {
             } else {
                 const FP_REGISTER in_reg = load_val_in_fp_reg(cur_time, in1);
                 const REGISTER dest_reg = alloc_reg(cur_time);
-                print_asm("mov%s %s, %s\n", (in1->type == Type::f32 ? "d" : "q"), reg_name(dest_reg, var->type), fp_reg_names[in_reg]);
+                emit(in1->type == Type::f32 ? mir::Opcode::MOVD : mir::Opcode::MOVQ, mir::reg(dest_reg, var->type), mir::fp_reg(in_reg));
                 set_var_to_reg(cur_time, var, dest_reg);
             }
         } else {
             const REGISTER in_reg = load_val_in_reg(cur_time, in1);
             const FP_REGISTER dest_reg = alloc_fp_reg(cur_time);
-            print_asm("mov%s %s, %s\n", (var->type == Type::f32 ? "d" : "q"), fp_reg_names[dest_reg], reg_name(in_reg, in1->type));
+            emit(var->type == Type::f32 ? mir::Opcode::MOVD : mir::Opcode::MOVQ, mir::fp_reg(dest_reg), mir::reg(in_reg, in1->type));
             set_var_to_fp_reg(cur_time, var, dest_reg);
         }
         break;
     }
     case Instruction::convert: {
         assert(is_float(var->type) || is_float(in1->type));
-        // evalute convert names
-        const char *conv_name_1 = Generator::convert_name_from_type(in1->type);
-        const char *conv_name_2 = Generator::convert_name_from_type(var->type);
         if (is_float(in1->type)) {
             FP_REGISTER in_reg = load_val_in_fp_reg(cur_time, in1);
             // floating point -> integer
             if (is_float(var->type)) {
                 // floating point -> floating point
                 const FP_REGISTER dest_reg = alloc_fp_reg(cur_time);
-                compile_rounding_mode(cur_time, op, alloc_reg(cur_time));
-                print_asm("cvt%s2%s %s, %s\n", conv_name_1, conv_name_2, fp_reg_names[dest_reg], fp_reg_names[in_reg]);
+                compile_rounding_mode(cur_time, op);
+                emit(in1->type == Type::f32 ? mir::Opcode::CVTSS2SD : mir::Opcode::CVTSD2SS, mir::fp_reg(dest_reg), mir::fp_reg(in_reg));
                 set_var_to_fp_reg(cur_time, var, dest_reg);
                 break;
             } else {
                 const REGISTER dest_reg = alloc_reg(cur_time);
-                in_reg = compile_rounding_mode(cur_time, op, dest_reg, true, in_reg);
-                // compile_rounding_mode(cur_time, op, dest_reg);
-                print_asm("cvt%s2%s %s, %s\n", conv_name_1, conv_name_2, reg_name(dest_reg, var->type), fp_reg_names[in_reg]);
+                in_reg = compile_rounding_mode(cur_time, op, true, in_reg);
+                emit(mir::scalar(rounding::is_truncating(op) ? mir::Opcode::CVTTSS2SI : mir::Opcode::CVTSS2SI, in1->type), mir::reg(dest_reg, var->type), mir::fp_reg(in_reg));
                 set_var_to_reg(cur_time, var, dest_reg);
             }
         } else {
             // integer -> floating point
-            compile_rounding_mode(cur_time, op, alloc_reg(cur_time));
+            compile_rounding_mode(cur_time, op);
             const REGISTER in_reg = load_val_in_reg(cur_time, in1);
             const FP_REGISTER dest_reg = alloc_fp_reg(cur_time);
-            print_asm("cvt%s2%s %s, %s\n", conv_name_1, conv_name_2, fp_reg_names[dest_reg], reg_name(in_reg, in1->type));
+            emit(mir::scalar(mir::Opcode::CVTSI2SS, var->type), mir::fp_reg(dest_reg), mir::reg(in_reg, in1->type));
             set_var_to_fp_reg(cur_time, var, dest_reg);
         }
         break;
     }
     case Instruction::uconvert: {
         assert(is_float(in1->type) ^ is_float(var->type));
-        compile_rounding_mode(cur_time, op, alloc_reg(cur_time));
-        const char *conv_name_1 = Generator::convert_name_from_type(in1->type);
-        const char *conv_name_2 = Generator::convert_name_from_type(var->type);
+        compile_rounding_mode(cur_time, op);
         if (is_float(in1->type)) {
             // floating point -> unsigned integer
             assert(var->type == Type::i32 || var->type == Type::i64);
             const FP_REGISTER in_reg = load_val_in_fp_reg(cur_time, in1);
             const REGISTER dest_reg = alloc_reg(cur_time);
             const bool single_precision = in1->type == Type::f32;
-            const char *dest_reg_name = reg_name(dest_reg, var->type);
-            print_asm("cvt%s2si %s, %s\n", conv_name_1, dest_reg_name, fp_reg_names[in_reg]);
-            print_asm("mov%s %s, %s\n", (single_precision ? "d" : "q"), (single_precision ? "ebp" : "rbp"), fp_reg_names[in_reg]);
-            print_asm("sar rbp, %d\n", (single_precision ? 31 : 63));
+            emit(mir::scalar(rounding::is_truncating(op) ? mir::Opcode::CVTTSS2SI : mir::Opcode::CVTSS2SI, in1->type), mir::reg(dest_reg, var->type), mir::fp_reg(in_reg));
+            if (single_precision) {
+                emit(mir::Opcode::MOVD, mir::reg(REG_BP, Type::i32), mir::fp_reg(in_reg));
+            } else {
+                emit(mir::Opcode::MOVQ, mir::reg(REG_BP), mir::fp_reg(in_reg));
+            }
+            emit(mir::Opcode::SAR, mir::reg(REG_BP), mir::imm(single_precision ? 31 : 63));
             if (var->type == Type::i64 && single_precision) {
-                print_asm("movsxd rbp, ebp\n");
+                emit(mir::Opcode::MOVSXD, mir::reg(REG_BP), mir::reg(REG_BP, Type::i32));
             }
-            print_asm("not rbp\n");
-            print_asm("and %s, %s\n", dest_reg_name, (var->type == Type::i32 ? "ebp" : "rbp"));
-            print_asm("xor rbp, rbp\n");
+            emit(mir::Opcode::NOT, mir::reg(REG_BP));
+            emit(mir::Opcode::AND, mir::reg(dest_reg, var->type), mir::reg(REG_BP, var->type));
+            emit(mir::Opcode::XOR, mir::reg(REG_BP), mir::reg(REG_BP));
             set_var_to_reg(cur_time, var, dest_reg);
         } else {
             // unsigned integer -> floating point
@@ -1319,43 +1659,44 @@ void RegAlloc::compile_fp_op(SSAVar *var, size_t cur_time) {
             const REGISTER help_reg = alloc_reg(cur_time, REG_NONE, in_reg);
             if (in1->type == Type::i32) {
                 // "zero extend" and then convert: use 64bit register
-                print_asm("mov %s, %s\n", reg_names[in_reg][1], reg_names[in_reg][1]);
-                print_asm("cvt%s2%s %s, %s\n", Generator::convert_name_from_type(Type::i64), conv_name_2, fp_reg_names[dest_reg], reg_names[in_reg][0]);
+                emit(mir::Opcode::MOV, mir::reg(in_reg, Type::i32), mir::reg(in_reg, Type::i32));
+                emit(mir::scalar(mir::Opcode::CVTSI2SS, var->type), mir::fp_reg(dest_reg), mir::reg(in_reg));
             } else if (in1->type == Type::i64) {
                 // method taken from gcc compiler
-                const char *in_reg_name = reg_names[in_reg][0], *help_reg_name = reg_names[help_reg][0], *dest_reg_name = fp_reg_names[dest_reg];
+                const auto in_op = mir::reg(in_reg), help_op = mir::reg(help_reg), dest_op = mir::fp_reg(dest_reg);
+                const auto cvtsi2s = mir::scalar(mir::Opcode::CVTSI2SS, var->type);
                 // test if msb is set: if set, then handle else use normal (signed) convert
-                print_asm("test %s, %s\n", in_reg_name, in_reg_name);
-                print_asm("js 0f\n");
-                print_asm("cvtsi2%s %s, %s\n", conv_name_2, dest_reg_name, in_reg_name);
-                print_asm("jmp 2f\n");
-                print_asm("0:\n");
+                emit(mir::Opcode::TEST, in_op, in_op);
+                emit(mir::Opcode::JCC, mir::Cond::S, mir::label(mir::local(0)));
+                emit(cvtsi2s, dest_op, in_op);
+                emit(mir::Opcode::JMP, mir::label(mir::local(2)));
+                asm_buf.label(mir::local(0));
 
                 // test for edge case
-                print_asm("mov %s, -1\n", help_reg_name);
-                print_asm("cmp %s, %s\n", in_reg_name, help_reg_name);
-                print_asm("je 1f\n");
+                emit(mir::Opcode::MOV, help_op, mir::imm(-1));
+                emit(mir::Opcode::CMP, in_op, help_op);
+                emit(mir::Opcode::JCC, mir::Cond::E, mir::label(mir::local(1)));
 
                 // use gcc method to convert unsigned values
-                print_asm("mov %s, %s\n", help_reg_name, in_reg_name);
-                print_asm("shr %s, 1\n", help_reg_name);
-                print_asm("and %s, 1\n", reg_name(in_reg, Type::i32));
-                print_asm("or %s, %s\n", in_reg_name, help_reg_name);
-                print_asm("cvtsi2%s %s, %s\n", conv_name_2, dest_reg_name, in_reg_name);
-                print_asm("adds%s %s, %s\n", Generator::fp_op_size_from_type(var->type), dest_reg_name, dest_reg_name);
-                print_asm("jmp 2f\n");
-
-                print_asm("1:\n");
+                emit(mir::Opcode::MOV, help_op, in_op);
+                emit(mir::Opcode::SHR, help_op, mir::imm(1));
+                emit(mir::Opcode::AND, mir::reg(in_reg, Type::i32), mir::imm(1));
+                emit(mir::Opcode::OR, in_op, help_op);
+                emit(cvtsi2s, dest_op, in_op);
+                emit(mir::scalar(mir::Opcode::ADDSS, var->type), dest_op, dest_op);
+                emit(mir::Opcode::JMP, mir::label(mir::local(2)));
+
+                asm_buf.label(mir::local(1));
                 // handle edge case
                 if (var->type == Type::f32) {
-                    print_asm("mov %s, 0x5f800000\n", reg_name(help_reg, Type::i32));
-                    print_asm("movd %s, %s\n", dest_reg_name, reg_name(help_reg, Type::i32));
+                    emit(mir::Opcode::MOV, mir::reg(help_reg, Type::i32), mir::hex_imm(0x5f800000));
+                    emit(mir::Opcode::MOVD, dest_op, mir::reg(help_reg, Type::i32));
                 } else {
-                    print_asm("mov %s, 0x43F0000000000000\n", help_reg_name);
-                    print_asm("movq %s, %s\n", dest_reg_name, help_reg_name);
+                    emit(mir::Opcode::MOV, help_op, mir::hex_imm(0x43F0000000000000));
+                    emit(mir::Opcode::MOVQ, dest_op, help_op);
                 }
 
-                print_asm("2:\n");
+                asm_buf.label(mir::local(2));
             }
             set_var_to_fp_reg(cur_time, var, dest_reg);
         }
@@ -1368,7 +1709,7 @@ void RegAlloc::compile_fp_op(SSAVar *var, size_t cur_time) {
     }
 }
 
-bool RegAlloc::merge_op_bin(size_t cur_time, size_t var_idx, REGISTER dst_reg) {
+bool RegAlloc::GroupContext::merge_op_bin(size_t cur_time, size_t var_idx, REGISTER dst_reg) {
     // we know the current var has an operation and two inputs which are both in registers
     auto *op = std::get<std::unique_ptr<Operation>>(cur_bb->variables[var_idx]->info).get();
     auto *dst = op->out_vars[0];
@@ -1398,8 +1739,7 @@ bool RegAlloc::merge_op_bin(size_t cur_time, size_t var_idx, REGISTER dst_reg) {
                     return false;
                 }
                 assert((in1->type == Type::i64 || in1->is_immediate()) && (in2->type == Type::i64 || in2->is_immediate()));
-                const auto *in1_reg_name = reg_names[in1->gen_info.reg_idx][0];
-                const auto *in2_reg_name = reg_names[in2->gen_info.reg_idx][0];
+                const auto addr = mir::mem(static_cast<REGISTER>(in1->gen_info.reg_idx), static_cast<REGISTER>(in2->gen_info.reg_idx));
                 // check if there is a zero/sign-extend afterwards
                 auto *load_dst = next_op->out_vars[0];
                 if (load_dst->ref_count == 1 && cur_bb->variables.size() > var_idx + 2) {
@@ -1409,16 +1749,16 @@ bool RegAlloc::merge_op_bin(size_t cur_time, size_t var_idx, REGISTER dst_reg) {
                         if (ext_op->in_vars[0] == load_dst) {
                             if (ext_op->type == Instruction::zero_extend) {
                                 if (load_dst->type == Type::i32) {
-                                    print_asm("mov %s, [%s + %s]\n", reg_names[dst_reg][1], in1_reg_name, in2_reg_name);
+                                    emit(mir::Opcode::MOV, mir::reg(dst_reg, Type::i32), addr);
                                 } else {
-                                    print_asm("movzx %s, %s [%s + %s]\n", reg_name(dst_reg, ext_dst->type), mem_size(load_dst->type), in1_reg_name, in2_reg_name);
+                                    emit(mir::Opcode::MOVZX, mir::reg(dst_reg, ext_dst->type), mir::sized(addr, load_dst->type));
                                 }
                             } else if (ext_op->type == Instruction::sign_extend) {
                                 if (load_dst->type == Type::i32) {
                                     assert(ext_dst->type == Type::i32 || ext_dst->type == Type::i64);
-                                    print_asm("movsxd %s, DWORD PTR [%s + %s]\n", reg_name(dst_reg, ext_dst->type), in1_reg_name, in2_reg_name);
+                                    emit(mir::Opcode::MOVSXD, mir::reg(dst_reg, ext_dst->type), mir::sized(addr, Type::i32));
                                 } else {
-                                    print_asm("movsx %s, %s [%s + %s]\n", reg_name(dst_reg, ext_dst->type), mem_size(load_dst->type), in1_reg_name, in2_reg_name);
+                                    emit(mir::Opcode::MOVSX, mir::reg(dst_reg, ext_dst->type), mir::sized(addr, load_dst->type));
                                 }
                             }
 
@@ -1434,7 +1774,7 @@ bool RegAlloc::merge_op_bin(size_t cur_time, size_t var_idx, REGISTER dst_reg) {
                 }
 
                 // no extension
-                print_asm("mov %s, [%s + %s]\n", reg_name(dst_reg, load_dst->type), in1_reg_name, in2_reg_name);
+                emit(mir::Opcode::MOV, mir::reg(dst_reg, load_dst->type), addr);
                 clear_reg(cur_time, dst_reg);
                 set_var_to_reg(cur_time, load_dst, dst_reg);
                 load_dst->gen_info.already_generated = true;
@@ -1447,20 +1787,19 @@ bool RegAlloc::merge_op_bin(size_t cur_time, size_t var_idx, REGISTER dst_reg) {
                     return false;
                 }
                 assert((in1->type == Type::i64 || in1->is_immediate()) && (in2->type == Type::i64 || in2->is_immediate()));
-                const auto *in1_reg_name = reg_names[in1->gen_info.reg_idx][0];
-                const auto *in2_reg_name = reg_names[in2->gen_info.reg_idx][0];
+                const auto addr = mir::mem(static_cast<REGISTER>(in1->gen_info.reg_idx), static_cast<REGISTER>(in2->gen_info.reg_idx));
 
                 if (val_src->is_immediate() && !val_src->get_immediate().binary_relative) {
                     const auto store_imm_val = val_src->get_immediate().val;
                     if (store_imm_val != INT64_MIN && std::abs(store_imm_val) < 0x7FFFFFFF) {
-                        print_asm("mov %s [%s + %s], %ld\n", mem_size(next_op->lifter_info.in_op_size), in1_reg_name, in2_reg_name, store_imm_val);
+                        emit(mir::Opcode::MOV, mir::sized(addr, next_op->lifter_info.in_op_size), mir::imm(store_imm_val));
                         next_op->out_vars[0]->gen_info.already_generated = true;
                         return true;
                     }
                 }
 
                 const auto val_reg = load_val_in_reg(cur_time, val_src);
-                print_asm("mov [%s + %s], %s\n", in1_reg_name, in2_reg_name, reg_name(val_reg, next_op->lifter_info.in_op_size));
+                emit(mir::Opcode::MOV, addr, mir::reg(val_reg, next_op->lifter_info.in_op_size));
                 next_op->out_vars[0]->gen_info.already_generated = true;
                 return true;
             } else if (next_op->type == Instruction::cast) {
@@ -1477,11 +1816,10 @@ bool RegAlloc::merge_op_bin(size_t cur_time, size_t var_idx, REGISTER dst_reg) {
                     return false;
                 }
                 assert((in1->type == Type::i64 || in1->is_immediate()) && (in2->type == Type::i64 || in2->is_immediate()));
-                const auto *in1_reg_name = reg_names[in1->gen_info.reg_idx][0];
-                const auto *in2_reg_name = reg_names[in2->gen_info.reg_idx][0];
+                const auto addr = mir::mem(static_cast<REGISTER>(in1->gen_info.reg_idx), static_cast<REGISTER>(in2->gen_info.reg_idx));
 
                 const auto cast_reg = load_val_in_reg(cur_time, next_op->in_vars[0].get());
-                print_asm("mov [%s + %s], %s\n", in1_reg_name, in2_reg_name, reg_name(cast_reg, cast_var->type));
+                emit(mir::Opcode::MOV, addr, mir::reg(cast_reg, cast_var->type));
                 store_op->out_vars[0]->gen_info.already_generated = true;
                 cast_var->gen_info.already_generated = true;
                 return true;
@@ -1495,68 +1833,237 @@ bool RegAlloc::merge_op_bin(size_t cur_time, size_t var_idx, REGISTER dst_reg) {
     return false;
 }
 
-FP_REGISTER RegAlloc::compile_rounding_mode(size_t cur_time, const Operation *op, const REGISTER help_reg, const bool use_rounds, const FP_REGISTER fp_in_reg) {
-    if (std::holds_alternative<RoundingMode>(op->rounding_info)) {
-        const RoundingMode rounding_mode = std::get<RoundingMode>(op->rounding_info);
-        SSAVar *in1 = op->in_vars[0];
-        if (use_rounds && gen->optimizations & Generator::OPT_ARCH_SSE4) {
-            const char *x86_64_rounding_mode;
-            switch (rounding_mode) {
-            case RoundingMode::NEAREST:
-                x86_64_rounding_mode = "0b00";
-                break;
-            case RoundingMode::DOWN:
-                x86_64_rounding_mode = "0b01";
-                break;
-            case RoundingMode::UP:
-                x86_64_rounding_mode = "0b10";
-                break;
-            case RoundingMode::ZERO:
-                x86_64_rounding_mode = "0b11";
-                break;
-            default:
-                assert(0);
-                break;
+void RegAlloc::GroupContext::fold_addresses(BasicBlock *bb) {
+    folded_addrs.clear();
+    folded_vars.clear();
+    if (!(gen->optimizations & Generator::OPT_MERGE_OP)) {
+        return;
+    }
+
+    auto folded = std::vector<SSAVar *>{};
+    for (size_t var_idx = 0; var_idx < bb->variables.size(); ++var_idx) {
+        auto *var = bb->variables[var_idx].get();
+        if (!std::holds_alternative<std::unique_ptr<Operation>>(var->info)) {
+            continue;
+        }
+
+        auto *op = std::get<std::unique_ptr<Operation>>(var->info).get();
+        if (op->type == Instruction::load || op->type == Instruction::store) {
+            // float loads and stores are compiled by compile_fp_op
+            if (is_float(op->lifter_info.in_op_size) || is_float(var->type) || (op->type == Instruction::store && is_float(op->in_vars[1]->type))) {
+                continue;
             }
-            const FP_REGISTER help_fp_reg = alloc_fp_reg(cur_time);
+            folded.clear();
+            const auto mode = match_address(op->in_vars[0].get(), folded);
+            if (!folded.empty()) {
+                folded_addrs.emplace(var, mode);
+                folded_vars.insert(folded.begin(), folded.end());
+            }
+            continue;
+        }
+
+        // a load directly in front of its only use can be the memory source of an ALU op
+        if (var_idx == 0 || var->type != Type::i64) {
+            continue;
+        }
+        if (op->type != Instruction::add && op->type != Instruction::sub && op->type != Instruction::_and && op->type != Instruction::_or && op->type != Instruction::_xor) {
+            continue;
+        }
+        auto *load_var = bb->variables[var_idx - 1].get();
+        if (load_var->ref_count != 1 || load_var->type != Type::i64 || !std::holds_alternative<std::unique_ptr<Operation>>(load_var->info)) {
+            continue;
+        }
+        const auto *load_op = std::get<std::unique_ptr<Operation>>(load_var->info).get();
+        if (load_op->type != Instruction::load) {
+            continue;
+        }
+        auto *in1 = op->in_vars[0].get();
+        auto *in2 = op->in_vars[1].get();
+        if (in2 == load_var) {
+            if (in1 == load_var) {
+                continue;
+            }
+        } else if (in1 != load_var || op->type == Instruction::sub || (in2->is_immediate() && !in2->get_immediate().binary_relative)) {
+            // sub isn't commutative and immediates are compiled differently
+            continue;
+        }
+        if (folded_addrs.count(load_var) == 0) {
+            auto *addr = load_op->in_vars[0].get();
+            if (std::holds_alternative<std::unique_ptr<Operation>>(addr->info) && addr->ref_count == 1) {
+                // the address computation is merged with the load by compile_vars
+                continue;
+            }
+            folded_addrs.emplace(load_var, AddressMode{addr});
+        }
+        folded_vars.insert(load_var);
+    }
+}
+
+RegAlloc::GroupContext::AddressMode RegAlloc::GroupContext::match_address(SSAVar *addr, std::vector<SSAVar *> &folded) const {
+    // intermediate values can only be folded if the address is their only use
+    const auto foldable_op = [this](const SSAVar *var, const Instruction type) -> const Operation * {
+        if (var->ref_count != 1 || var->type != Type::i64 || !std::holds_alternative<std::unique_ptr<Operation>>(var->info) || folded_vars.count(var) != 0) {
+            return nullptr;
+        }
+        const auto *op = std::get<std::unique_ptr<Operation>>(var->info).get();
+        return op->type == type ? op : nullptr;
+    };
+    const auto add_disp = [](const SSAVar *var, int64_t &disp) {
+        if (!var->is_immediate() || var->get_immediate().binary_relative) {
+            return false;
+        }
+        const auto val = var->get_immediate().val;
+        if (val == INT64_MIN || std::abs(val) >= 0x7FFFFFFF || std::abs(disp + val) >= 0x7FFFFFFF) {
+            return false;
+        }
+        disp += val;
+        return true;
+    };
+    // shl by 1 to 3 is an index scale
+    const auto scaled_index = [&foldable_op](SSAVar *var) -> const Operation * {
+        const auto *op = foldable_op(var, Instruction::shl);
+        if (op == nullptr || op->in_vars[0]->is_immediate() || !op->in_vars[1]->is_immediate() || op->in_vars[1]->get_immediate().binary_relative) {
+            return nullptr;
+        }
+        const auto shift = op->in_vars[1]->get_immediate().val;
+        return (shift >= 1 && shift <= 3) ? op : nullptr;
+    };
+
+    auto mode = AddressMode{addr};
+    while (const auto *op = foldable_op(mode.base, Instruction::add)) {
+        auto *in1 = op->in_vars[0].get();
+        auto *in2 = op->in_vars[1].get();
+        if (add_disp(in2, mode.disp)) {
+            folded.push_back(mode.base);
+            mode.base = in1;
+            continue;
+        }
+        if (add_disp(in1, mode.disp)) {
+            folded.push_back(mode.base);
+            mode.base = in2;
+            continue;
+        }
+        if (mode.index != nullptr || in1->is_immediate() || in2->is_immediate()) {
+            break;
+        }
+
+        folded.push_back(mode.base);
+        mode.base = in1;
+        mode.index = in2;
+        if (const auto *shl = scaled_index(in2); shl != nullptr) {
+            folded.push_back(in2);
+            mode.index = shl->in_vars[0].get();
+            mode.scale = static_cast<uint8_t>(1 << shl->in_vars[1]->get_immediate().val);
+        } else if (const auto *shl = scaled_index(in1); shl != nullptr) {
+            folded.push_back(in1);
+            mode.base = in2;
+            mode.index = shl->in_vars[0].get();
+            mode.scale = static_cast<uint8_t>(1 << shl->in_vars[1]->get_immediate().val);
+        }
+    }
+    return mode;
+}
+
+mir::Operand RegAlloc::GroupContext::address_operand(const size_t cur_time, const AddressMode &mode) {
+    const auto base_reg = load_val_in_reg(cur_time, mode.base);
+    const auto index_reg = (mode.index != nullptr ? load_val_in_reg(cur_time, mode.index) : REG_NONE);
+    return mir::mem(base_reg, index_reg, mode.scale, mode.disp);
+}
+
+void RegAlloc::GroupContext::compile_folded_load(const size_t cur_time, const size_t var_idx, const AddressMode &mode) {
+    auto *dst = cur_bb->variables[var_idx].get();
+    const auto addr_op = address_operand(cur_time, mode);
+    // the value is loaded into the base register like an unfolded load
+    const auto dst_reg = static_cast<REGISTER>(addr_op.reg);
+    if (mode.base->gen_info.last_use_time > cur_time) {
+        save_reg(dst_reg);
+    }
+
+    const Operation *ext_op = nullptr;
+    if (dst->ref_count == 1 && dst->type != Type::i64 && cur_bb->variables.size() > var_idx + 1) {
+        auto *next_var = cur_bb->variables[var_idx + 1].get();
+        if (std::holds_alternative<std::unique_ptr<Operation>>(next_var->info) && !is_float(next_var->type)) {
+            const auto *next_op = std::get<std::unique_ptr<Operation>>(next_var->info).get();
+            if ((next_op->type == Instruction::zero_extend || next_op->type == Instruction::sign_extend) && next_op->in_vars[0] == dst && next_var->type != dst->type) {
+                ext_op = next_op;
+            }
+        }
+    }
+
+    if (ext_op == nullptr) {
+        emit(mir::Opcode::MOV, mir::reg(dst_reg, dst->type), addr_op);
+        clear_reg(cur_time, dst_reg);
+        set_var_to_reg(cur_time, dst, dst_reg);
+        return;
+    }
+
+    auto *ext_dst = ext_op->out_vars[0];
+    if (ext_op->type == Instruction::zero_extend) {
+        if (dst->type == Type::i32) {
+            // writing the 32 bit register clears the upper half
+            emit(mir::Opcode::MOV, mir::reg(dst_reg, Type::i32), addr_op);
+        } else {
+            emit(mir::Opcode::MOVZX, mir::reg(dst_reg, ext_dst->type), mir::sized(addr_op, dst->type));
+        }
+    } else if (dst->type == Type::i32) {
+        emit(mir::Opcode::MOVSXD, mir::reg(dst_reg, ext_dst->type), mir::sized(addr_op, dst->type));
+    } else {
+        emit(mir::Opcode::MOVSX, mir::reg(dst_reg, ext_dst->type), mir::sized(addr_op, dst->type));
+    }
+    clear_reg(cur_time, dst_reg);
+    set_var_to_reg(cur_time, ext_dst, dst_reg);
+    dst->gen_info.already_generated = true;
+    ext_dst->gen_info.already_generated = true;
+}
+
+FP_REGISTER RegAlloc::GroupContext::compile_rounding_mode(size_t cur_time, const Operation *op, const bool use_rounds, const FP_REGISTER fp_in_reg) {
+    const bool with_rounds = use_rounds && (gen->optimizations & Generator::OPT_ARCH_SSE4);
+    const auto req = rounding::requirement(op, with_rounds);
+    switch (req.kind) {
+    case rounding::Requirement::NONE: {
+        if (!with_rounds || !std::holds_alternative<RoundingMode>(op->rounding_info)) {
+            return fp_in_reg;
+        }
+        const RoundingMode rounding_mode = std::get<RoundingMode>(op->rounding_info);
+        if (rounding_mode == RoundingMode::ZERO || cur_rounding_mode == rounding_mode) {
+            // cvtt or the conversion itself rounds correctly
+            return fp_in_reg;
+        }
+        int64_t x86_64_rounding_mode;
+        switch (rounding_mode) {
+        case RoundingMode::NEAREST:
+            x86_64_rounding_mode = 0b00;
+            break;
+        case RoundingMode::DOWN:
+            x86_64_rounding_mode = 0b01;
+            break;
+        case RoundingMode::UP:
+            x86_64_rounding_mode = 0b10;
+            break;
+        default:
+            assert(0);
+            x86_64_rounding_mode = 0b00;
+            break;
+        }
+        const FP_REGISTER help_fp_reg = alloc_fp_reg(cur_time);
 
-            assert(fp_in_reg != FP_REG_NONE);
-            print_asm("rounds%s %s, %s, %s\n", Generator::fp_op_size_from_type(in1->type), fp_reg_names[help_fp_reg], fp_reg_names[fp_in_reg], x86_64_rounding_mode);
-            return help_fp_reg;
-        } else {
-            uint32_t x86_64_rounding_mode;
-            switch (std::get<RoundingMode>(op->rounding_info)) {
-            case RoundingMode::NEAREST:
-                x86_64_rounding_mode = 0x0000;
-                break;
-            case RoundingMode::DOWN:
-                x86_64_rounding_mode = 0x2000;
-                break;
-            case RoundingMode::UP:
-                x86_64_rounding_mode = 0x4000;
-                break;
-            case RoundingMode::ZERO:
-                x86_64_rounding_mode = 0x6000;
-                break;
-            default:
-                assert(0);
-                break;
-            }
-            // use dest_reg to set mxcsr
-            const char *round_reg_name = reg_name(help_reg, Type::i32);
-            print_asm("sub rsp, 4\n");
-            print_asm("stmxcsr [rsp]\n");
-            print_asm("mov %s, [rsp]\n", round_reg_name);
-            print_asm("and %s, 0xFFFF1FFF\n", round_reg_name);
-            if (x86_64_rounding_mode != 0) {
-                print_asm("or %s, %d\n", round_reg_name, x86_64_rounding_mode);
-            }
-            print_asm("mov [rsp], %s\n", round_reg_name);
-            print_asm("ldmxcsr [rsp]\n");
-            print_asm("add rsp, 4\n");
+        assert(fp_in_reg != FP_REG_NONE);
+        emit(mir::scalar(mir::Opcode::ROUNDSS, op->in_vars[0]->type), mir::fp_reg(help_fp_reg), mir::fp_reg(fp_in_reg), mir::imm(x86_64_rounding_mode));
+        return help_fp_reg;
+    }
+    case rounding::Requirement::STATIC:
+        switch_rounding_mode(req.mode);
+        return fp_in_reg;
+    case rounding::Requirement::DEFAULT:
+        // a dynamic rounding mode is kept for the following operations
+        if (cur_rounding_mode) {
+            switch_rounding_mode(RoundingMode::NEAREST);
+        }
+        return fp_in_reg;
+    case rounding::Requirement::DYNAMIC: {
+        if (!cur_rounding_mode && cur_dyn_rm_var == req.rm_var) {
             return fp_in_reg;
         }
-    } else if (std::holds_alternative<RefPtr<SSAVar>>(op->rounding_info)) {
         // let helper handle dynamic rounding
         SSAVar *rm_var = std::get<RefPtr<SSAVar>>(op->rounding_info).get();
         const REGISTER reg = load_val_in_reg(cur_time, rm_var, REG_DI);
@@ -1566,23 +2073,57 @@ FP_REGISTER RegAlloc::compile_rounding_mode(size_t cur_time, const Operation *op
         assert(reg == REG_DI);
         clear_reg(cur_time, REG_DI);
         // TODO: Stack alignment?
-        print_asm("push rax\npush rcx\npush rdx\npush rsi\n");
-        print_asm("call resolve_dynamic_rounding\n");
-        print_asm("pop rsi\npop rdx\npop rcx\npop rax\n");
+        for (const auto reg : {REG_A, REG_C, REG_D, REG_SI}) {
+            emit(mir::Opcode::PUSH, mir::reg(reg));
+        }
+        emit(mir::Opcode::CALL, mir::label(mir::named("resolve_dynamic_rounding")));
+        for (const auto reg : {REG_SI, REG_D, REG_C, REG_A}) {
+            emit(mir::Opcode::POP, mir::reg(reg));
+        }
+        cur_rounding_mode = std::nullopt;
+        cur_dyn_rm_var = rm_var;
         return fp_in_reg;
     }
-    return FP_REG_NONE;
+    }
+    return fp_in_reg;
 }
 
-void RegAlloc::prepare_cf_ops(BasicBlock *bb) {
-    // just set the input maps when the cf-op targets do not yet have a input mapping
-    for (auto &cf_op : bb->control_flow_ops) {
+void RegAlloc::GroupContext::switch_rounding_mode(const RoundingMode mode) {
+    if (cur_rounding_mode == mode) {
+        return;
+    }
+    write_rounding_mode(mode);
+    cur_rounding_mode = mode;
+    cur_dyn_rm_var = nullptr;
+}
+
+void RegAlloc::GroupContext::write_edge_rounding_mode(const BasicBlock *bb, const RoundingMode target_mode) {
+    if (rounding_plan.exit_mode(bb) != target_mode) {
+        write_rounding_mode(target_mode);
+    }
+}
+
+void RegAlloc::GroupContext::write_rounding_mode(const RoundingMode mode) {
+    // ldmxcsr is slow, so the callers keep track of the current mode
+    emit(mir::Opcode::SUB, mir::stack_ptr(), mir::imm(4));
+    emit(mir::Opcode::STMXCSR, mir::mem(REG_SP));
+    emit(mir::Opcode::AND, mir::sized(mir::mem(REG_SP), Type::i32), mir::hex_imm(0xFFFF1FFF));
+    if (const auto bits = rounding::mxcsr_bits(mode); bits != 0) {
+        emit(mir::Opcode::OR, mir::sized(mir::mem(REG_SP), Type::i32), mir::imm(bits));
+    }
+    emit(mir::Opcode::LDMXCSR, mir::mem(REG_SP));
+    emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(4));
+    if (gen->count_stats) {
+        emit(mir::Opcode::INC, mir::sized(mir::mem(mir::named("stats_rounding_switches")), Type::i64)).lock = gen->multithreaded_guest;
+    }
+}
+
+void RegAlloc::GroupContext::prepare_cf_ops(BasicBlock *bb) {
+    // RegAlloc::plan_groups already set up all input maps which don't depend on the register allocation
+    for (size_t cf_idx = 0; cf_idx < bb->control_flow_ops.size(); ++cf_idx) {
+        const auto &cf_op = bb->control_flow_ops[cf_idx];
         auto *target = cf_op.target();
-        if (!target || target->gen_info.input_map_setup) {
-            continue;
-        }
-        if (target->gen_info.call_cont_block) {
-            set_bb_inputs_from_static(target);
+        if (!target || reg_alloc->input_map_owners[target->id] != std::pair<const BasicBlock *, size_t>{bb, cf_idx}) {
             continue;
         }
 
@@ -1593,26 +2134,102 @@ void RegAlloc::prepare_cf_ops(BasicBlock *bb) {
         case CFCInstruction::cjump:
             set_bb_inputs(target, std::get<CfOp::CJumpInfo>(cf_op.info).target_inputs);
             break;
-        case CFCInstruction::syscall:
-            // TODO: we don't need this, just need to respect the clobbered registers from a syscall
-            set_bb_inputs_from_static(target);
+        default:
+            assert(0);
             break;
-        case CFCInstruction::call: {
-            set_bb_inputs_from_static(target);
-            auto *cont_block = std::get<CfOp::CallInfo>(cf_op.info).continuation_block;
-            if (!cont_block->gen_info.input_map_setup) {
-                set_bb_inputs_from_static(cont_block);
+        }
+    }
+}
+
+const Operation *RegAlloc::GroupContext::fused_compare(const BasicBlock *bb) const {
+    if (!(gen->optimizations & Generator::OPT_FUSE_BRANCHES)) {
+        return nullptr;
+    }
+
+    for (const auto &cf_op : bb->control_flow_ops) {
+        if (cf_op.type != CFCInstruction::cjump) {
+            continue;
+        }
+
+        // cjump eq/neq v, 0 with v <- slt/sltu/seq/sle a, b, 1, 0 and no other uses of v
+        const auto type = std::get<CfOp::CJumpInfo>(cf_op.info).type;
+        auto *cond = cf_op.in_vars[0].get();
+        if ((type != CfOp::CJumpInfo::CJumpType::eq && type != CfOp::CJumpInfo::CJumpType::neq) || !is_plain_imm(cf_op.in_vars[1].get(), 0) || cond->ref_count != 1 ||
+            !std::holds_alternative<std::unique_ptr<Operation>>(cond->info)) {
+            return nullptr;
+        }
+
+        const auto *op = std::get<std::unique_ptr<Operation>>(cond->info).get();
+        if (!is_plain_imm(op->in_vars[2].get(), 1) || !is_plain_imm(op->in_vars[3].get(), 0)) {
+            return nullptr;
+        }
+        if (is_float(op->in_vars[0]->type)) {
+            return (op->type == Instruction::slt || op->type == Instruction::sle || op->type == Instruction::seq) ? op : nullptr;
+        }
+        return (op->type == Instruction::slt || op->type == Instruction::sltu || op->type == Instruction::seq) ? op : nullptr;
+    }
+    return nullptr;
+}
+
+void RegAlloc::GroupContext::compile_fused_compare(const size_t cur_time, const Operation *op, const size_t bb_id, const size_t cf_idx, const bool skip_if_set) {
+    auto *cmp1 = op->in_vars[0].get();
+    auto *cmp2 = op->in_vars[1].get();
+    const auto skip_label = mir::label(mir::symbol(mir::Symbol::Kind::REG_ALLOC_CF, bb_id, static_cast<uint32_t>(cf_idx + 1)));
+    mir::Cond skip_cc;
+
+    if (is_float(cmp1->type)) {
+        // ucomis sets ZF, PF and CF for unordered operands while RISC-V compares with a NaN are always false
+        const auto cmp1_reg = load_val_in_fp_reg(cur_time, cmp1);
+        const auto cmp2_reg = load_val_in_fp_reg(cur_time, cmp2);
+        if (op->type == Instruction::seq) {
+            emit(mir::scalar(mir::Opcode::UCOMISS, cmp1->type), mir::fp_reg(cmp1_reg), mir::fp_reg(cmp2_reg));
+            if (skip_if_set) {
+                // equal is ZF set and PF clear
+                const auto unordered = mir::symbol(mir::Symbol::Kind::UNORDERED, bb_id, static_cast<uint32_t>(cf_idx));
+                emit(mir::Opcode::JCC, mir::Cond::P, mir::label(unordered));
+                emit(mir::Opcode::JCC, mir::Cond::E, skip_label);
+                asm_buf.label(unordered);
+            } else {
+                emit(mir::Opcode::JCC, mir::Cond::P, skip_label);
+                emit(mir::Opcode::JCC, mir::Cond::NE, skip_label);
             }
-            break;
+            return;
         }
-        default:
-            break;
+
+        // with swapped operands a and ae are only true for ordered operands
+        emit(mir::scalar(mir::Opcode::UCOMISS, cmp1->type), mir::fp_reg(cmp2_reg), mir::fp_reg(cmp1_reg));
+        if (op->type == Instruction::slt) {
+            skip_cc = (skip_if_set ? mir::Cond::A : mir::Cond::BE);
+        } else {
+            skip_cc = (skip_if_set ? mir::Cond::AE : mir::Cond::B);
         }
+        emit(mir::Opcode::JCC, skip_cc, skip_label);
+        return;
+    }
+
+    const auto cmp1_reg = load_val_in_reg(cur_time, cmp1);
+    if (cmp2->is_immediate() && !std::get<SSAVar::ImmInfo>(cmp2->info).binary_relative && std::get<SSAVar::ImmInfo>(cmp2->info).val != INT64_MIN &&
+        std::abs(std::get<SSAVar::ImmInfo>(cmp2->info).val) <= 0x7FFFFFFF) {
+        const auto type = cmp1->is_immediate() ? Type::i64 : cmp1->type;
+        emit(mir::Opcode::CMP, mir::reg(cmp1_reg, type), mir::imm(std::get<SSAVar::ImmInfo>(cmp2->info).val));
+    } else {
+        const auto cmp2_reg = load_val_in_reg(cur_time, cmp2);
+        const auto type = choose_type(cmp1, cmp2);
+        emit(mir::Opcode::CMP, mir::reg(cmp1_reg, type), mir::reg(cmp2_reg, type));
+    }
+
+    if (op->type == Instruction::seq) {
+        skip_cc = (skip_if_set ? mir::Cond::E : mir::Cond::NE);
+    } else if (op->type == Instruction::slt) {
+        skip_cc = (skip_if_set ? mir::Cond::L : mir::Cond::GE);
+    } else {
+        skip_cc = (skip_if_set ? mir::Cond::B : mir::Cond::AE);
     }
+    emit(mir::Opcode::JCC, skip_cc, skip_label);
 }
 
-void RegAlloc::compile_cf_ops(BasicBlock *bb, RegMap &reg_map, FPRegMap &fp_reg_map, StackMap &stack_map, size_t max_stack_frame_size, BasicBlock *next_bb,
-                              std::vector<BasicBlock *> &compiled_blocks) {
+void RegAlloc::GroupContext::compile_cf_ops(BasicBlock *bb, const mir::Block &body, RegMap &reg_map, FPRegMap &fp_reg_map, StackMap &stack_map, size_t max_stack_frame_size,
+                                            BasicBlock *next_bb) {
     // TODO: when there is one cfop and it's a jump we can already omit the jmp bX_reg_alloc if the block isn't compiled yet
     // since it will get compiled straight after
 
@@ -1637,7 +2254,8 @@ void RegAlloc::compile_cf_ops(BasicBlock *bb, RegMap &reg_map, FPRegMap &fp_reg_
             }
         }
         const auto &cf_op = bb->control_flow_ops[cf_idx];
-        print_asm("b%zu_reg_alloc_cf%zu:\n", bb->id, cf_idx);
+        const auto cf_label = mir::symbol(mir::Symbol::Kind::REG_ALLOC_CF, bb->id, static_cast<uint32_t>(cf_idx));
+        asm_buf.label(cf_label);
         auto target_top_level = false;
         if (auto *target = cf_op.target(); target != nullptr) {
             target_top_level = is_block_top_level(target);
@@ -1647,19 +2265,56 @@ void RegAlloc::compile_cf_ops(BasicBlock *bb, RegMap &reg_map, FPRegMap &fp_reg_
         if (cf_op.type == CFCInstruction::cjump) {
             auto *cmp1 = cf_op.in_vars[0].get();
             auto *cmp2 = cf_op.in_vars[1].get();
+            const auto cjump_type = std::get<CfOp::CJumpInfo>(cf_op.info).type;
+            const auto *fused = fused_compare(bb);
 
             assert(!is_float(cmp1->type));
             assert(!is_float(cmp2->type));
 
-            const auto cmp1_reg = load_val_in_reg(cur_time, cmp1);
-            const auto type = choose_type(cmp1, cmp2);
-            if (cmp2->is_immediate() && !std::get<SSAVar::ImmInfo>(cmp2->info).binary_relative && static_cast<uint64_t>(cmp2->get_immediate().val) != 0x80000000'00000000 &&
-                std::abs(cmp2->get_immediate().val) <= 0x7FFFFFFF) {
-                // TODO: only 32bit immediates which are safe to sign extend
-                print_asm("cmp %s, %ld\n", reg_name(cmp1_reg, type), std::get<SSAVar::ImmInfo>(cmp2->info).val);
+            if (fused != nullptr) {
+                // the compare result is only tested against 0, so branch on the compare itself
+                compile_fused_compare(cur_time, fused, bb->id, cf_idx, cjump_type == CfOp::CJumpInfo::CJumpType::eq);
             } else {
-                const auto cmp2_reg = load_val_in_reg(cur_time, cmp2);
-                print_asm("cmp %s, %s\n", reg_name(cmp1_reg, type), reg_name(cmp2_reg, type));
+                const auto cmp1_reg = load_val_in_reg(cur_time, cmp1);
+                const auto type = choose_type(cmp1, cmp2);
+                if ((gen->optimizations & Generator::OPT_FUSE_BRANCHES) && is_plain_imm(cmp2, 0)) {
+                    // test is shorter and the compare can be left out entirely if the value was just computed
+                    const auto equality_check = cjump_type == CfOp::CJumpInfo::CJumpType::eq || cjump_type == CfOp::CJumpInfo::CJumpType::neq;
+                    // later cf ops are entered through their label, so only the first one can rely on the flags of the body
+                    if (!flags_describe_reg(body, asm_buf, (cf_idx == 0 ? cf_label : mir::Symbol{}), cmp1_reg, mir::width_of(type), equality_check)) {
+                        emit(mir::Opcode::TEST, mir::reg(cmp1_reg, type), mir::reg(cmp1_reg, type));
+                    }
+                } else if (cmp2->is_immediate() && !std::get<SSAVar::ImmInfo>(cmp2->info).binary_relative && static_cast<uint64_t>(cmp2->get_immediate().val) != 0x80000000'00000000 &&
+                           std::abs(cmp2->get_immediate().val) <= 0x7FFFFFFF) {
+                    // TODO: only 32bit immediates which are safe to sign extend
+                    emit(mir::Opcode::CMP, mir::reg(cmp1_reg, type), mir::imm(std::get<SSAVar::ImmInfo>(cmp2->info).val));
+                } else {
+                    const auto cmp2_reg = load_val_in_reg(cur_time, cmp2);
+                    emit(mir::Opcode::CMP, mir::reg(cmp1_reg, type), mir::reg(cmp2_reg, type));
+                }
+
+                auto skip_cc = mir::Cond::NE;
+                switch (cjump_type) {
+                case CfOp::CJumpInfo::CJumpType::eq:
+                    skip_cc = mir::Cond::NE;
+                    break;
+                case CfOp::CJumpInfo::CJumpType::neq:
+                    skip_cc = mir::Cond::E;
+                    break;
+                case CfOp::CJumpInfo::CJumpType::lt:
+                    skip_cc = mir::Cond::AE;
+                    break;
+                case CfOp::CJumpInfo::CJumpType::gt:
+                    skip_cc = mir::Cond::BE;
+                    break;
+                case CfOp::CJumpInfo::CJumpType::slt:
+                    skip_cc = mir::Cond::GE;
+                    break;
+                case CfOp::CJumpInfo::CJumpType::sgt:
+                    skip_cc = mir::Cond::LE;
+                    break;
+                }
+                emit(mir::Opcode::JCC, skip_cc, mir::label(mir::symbol(mir::Symbol::Kind::REG_ALLOC_CF, bb->id, static_cast<uint32_t>(cf_idx + 1))));
             }
 
             gen_infos.clear();
@@ -1699,50 +2354,35 @@ void RegAlloc::compile_cf_ops(BasicBlock *bb, RegMap &reg_map, FPRegMap &fp_reg_
                 continue;
             }*/
 
-            switch (std::get<CfOp::CJumpInfo>(cf_op.info).type) {
-            case CfOp::CJumpInfo::CJumpType::eq:
-                print_asm("jne");
-                break;
-            case CfOp::CJumpInfo::CJumpType::neq:
-                print_asm("je");
-                break;
-            case CfOp::CJumpInfo::CJumpType::lt:
-                print_asm("jae");
-                break;
-            case CfOp::CJumpInfo::CJumpType::gt:
-                print_asm("jbe");
-                break;
-            case CfOp::CJumpInfo::CJumpType::slt:
-                print_asm("jge");
-                break;
-            case CfOp::CJumpInfo::CJumpType::sgt:
-                print_asm("jle");
-                break;
-            }
-            print_asm(" b%zu_reg_alloc_cf%zu\n", bb->id, cf_idx + 1);
         }
 
         switch (cf_op.type) {
         case CFCInstruction::jump: {
             auto *target = std::get<CfOp::JumpInfo>(cf_op.info).target;
-            const auto out_of_group = std::find(compiled_blocks.begin(), compiled_blocks.end(), target) == compiled_blocks.end();
+            const auto out_of_group = !in_group(target);
             if (out_of_group && !target_top_level) {
-                if (!target->gen_info.compiled) {
-                    target->gen_info.needs_trans_bb = true;
+                // groups after this one are not compiled yet, so their input maps aren't known
+                if (reg_alloc->group_ids[target->id] > group_id) {
+                    trans_bb_requests.push_back(target);
                     // TODO: this can be fixed with the assembler by compiling all cfops at the end and holding trans bbs until the end before throwing out unneeded ones
                     auto static_mapping = std::vector<std::pair<RefPtr<SSAVar>, size_t>>{};
                     for (size_t i = 0; i < target->inputs.size(); ++i) {
-                        static_mapping.emplace_back(std::get<CfOp::JumpInfo>(cf_op.info).target_inputs[i], std::get<size_t>(target->inputs[i]->info));
+                        const auto static_idx = std::get<size_t>(target->inputs[i]->info);
+                        if (!gen->is_static_live_in(target, static_idx)) {
+                            continue;
+                        }
+                        static_mapping.emplace_back(std::get<CfOp::JumpInfo>(cf_op.info).target_inputs[i], static_idx);
                     }
                     write_static_mapping(target, cur_time, static_mapping);
-                    print_asm("add rsp, %zu\n", max_stack_frame_size);
-                    print_asm("jmp b%zu\n", target->id);
+                    emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size)));
+                    write_edge_rounding_mode(bb, RoundingMode::NEAREST);
+                    emit(mir::Opcode::JMP, mir::block(target->id));
                     break;
                 }
 
                 if (target->gen_info.max_stack_size > max_stack_frame_size) {
                     const size_t delta = target->gen_info.max_stack_size - max_stack_frame_size;
-                    print_asm("sub rsp, %zu\n", delta);
+                    emit(mir::Opcode::SUB, mir::stack_ptr(), mir::imm(static_cast<int64_t>(delta)));
                     for (auto &var : bb->variables) {
                         if (var->gen_info.saved_in_stack) {
                             var->gen_info.stack_slot += delta / 8;
@@ -1754,30 +2394,22 @@ void RegAlloc::compile_cf_ops(BasicBlock *bb, RegMap &reg_map, FPRegMap &fp_reg_
                     write_target_inputs(target, cur_time, std::get<CfOp::JumpInfo>(cf_op.info).target_inputs);
                 } else {
                     const size_t delta = max_stack_frame_size - target->gen_info.max_stack_size;
-                    for (auto &input : target->gen_info.input_map) {
-                        if (input.location == BasicBlock::GeneratorInfo::InputInfo::STACK) {
-                            input.stack_slot += delta / 8;
-                        }
-                    }
-                    write_target_inputs(target, cur_time, std::get<CfOp::JumpInfo>(cf_op.info).target_inputs);
-                    for (auto &input : target->gen_info.input_map) {
-                        if (input.location == BasicBlock::GeneratorInfo::InputInfo::STACK) {
-                            input.stack_slot -= delta / 8;
-                        }
-                    }
-                    print_asm("add rsp, %zu\n", delta);
+                    write_target_inputs(target, cur_time, std::get<CfOp::JumpInfo>(cf_op.info).target_inputs, delta / 8);
+                    emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(delta)));
                 }
             } else {
                 write_target_inputs(target, cur_time, std::get<CfOp::JumpInfo>(cf_op.info).target_inputs);
             }
 
             if (target_top_level) {
-                print_asm("# destroy stack space\n");
-                print_asm("add rsp, %zu\n", max_stack_frame_size);
-                print_asm("jmp b%zu\n", target->id);
+                comment(asm_buf, "destroy stack space");
+                emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size)));
+                write_edge_rounding_mode(bb, RoundingMode::NEAREST);
+                emit(mir::Opcode::JMP, mir::block(target->id, uses_call_conv(gen, target) ? mir::Symbol::Kind::CALL_CONV : mir::Symbol::Kind::BLOCK));
             } else {
+                write_edge_rounding_mode(bb, target->gen_info.entry_rounding_mode);
                 if (cf_idx != bb->control_flow_ops.size() - 1 || target != next_bb) {
-                    print_asm("jmp b%zu_reg_alloc\n", target->id);
+                    emit(mir::Opcode::JMP, mir::block(target->id, mir::Symbol::Kind::REG_ALLOC));
                 }
             }
             break;
@@ -1785,24 +2417,30 @@ void RegAlloc::compile_cf_ops(BasicBlock *bb, RegMap &reg_map, FPRegMap &fp_reg_
         case CFCInstruction::cjump: {
             auto *target = std::get<CfOp::CJumpInfo>(cf_op.info).target;
             // asm_buf += cjump_asm;
-            const auto out_of_group = std::find(compiled_blocks.begin(), compiled_blocks.end(), target) == compiled_blocks.end();
+            const auto out_of_group = !in_group(target);
             if (out_of_group && !target_top_level) {
-                if (!target->gen_info.compiled) {
-                    target->gen_info.needs_trans_bb = true;
+                // groups after this one are not compiled yet, so their input maps aren't known
+                if (reg_alloc->group_ids[target->id] > group_id) {
+                    trans_bb_requests.push_back(target);
                     // TODO: this can be fixed with the assembler by compiling all cfops at the end and holding trans bbs until the end before throwing out unneeded ones
                     auto static_mapping = std::vector<std::pair<RefPtr<SSAVar>, size_t>>{};
                     for (size_t i = 0; i < target->inputs.size(); ++i) {
-                        static_mapping.emplace_back(std::get<CfOp::CJumpInfo>(cf_op.info).target_inputs[i], std::get<size_t>(target->inputs[i]->info));
+                        const auto static_idx = std::get<size_t>(target->inputs[i]->info);
+                        if (!gen->is_static_live_in(target, static_idx)) {
+                            continue;
+                        }
+                        static_mapping.emplace_back(std::get<CfOp::CJumpInfo>(cf_op.info).target_inputs[i], static_idx);
                     }
                     write_static_mapping(target, cur_time, static_mapping);
-                    print_asm("add rsp, %zu\n", max_stack_frame_size);
-                    print_asm("jmp b%zu\n", target->id);
+                    emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size)));
+                    write_edge_rounding_mode(bb, RoundingMode::NEAREST);
+                    emit(mir::Opcode::JMP, mir::block(target->id));
                     break;
                 }
 
                 if (target->gen_info.max_stack_size > max_stack_frame_size) {
                     const size_t delta = target->gen_info.max_stack_size - max_stack_frame_size;
-                    print_asm("sub rsp, %zu\n", delta);
+                    emit(mir::Opcode::SUB, mir::stack_ptr(), mir::imm(static_cast<int64_t>(delta)));
                     for (auto &var : bb->variables) {
                         if (var->gen_info.saved_in_stack) {
                             var->gen_info.stack_slot += delta / 8;
@@ -1814,36 +2452,32 @@ void RegAlloc::compile_cf_ops(BasicBlock *bb, RegMap &reg_map, FPRegMap &fp_reg_
                     write_target_inputs(target, cur_time, std::get<CfOp::CJumpInfo>(cf_op.info).target_inputs);
                 } else {
                     const size_t delta = max_stack_frame_size - target->gen_info.max_stack_size;
-                    for (auto &input : target->gen_info.input_map) {
-                        if (input.location == BasicBlock::GeneratorInfo::InputInfo::STACK) {
-                            input.stack_slot += delta / 8;
-                        }
-                    }
-                    write_target_inputs(target, cur_time, std::get<CfOp::CJumpInfo>(cf_op.info).target_inputs);
-                    for (auto &input : target->gen_info.input_map) {
-                        if (input.location == BasicBlock::GeneratorInfo::InputInfo::STACK) {
-                            input.stack_slot -= delta / 8;
-                        }
-                    }
-                    print_asm("add rsp, %zu\n", delta);
+                    write_target_inputs(target, cur_time, std::get<CfOp::CJumpInfo>(cf_op.info).target_inputs, delta / 8);
+                    emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(delta)));
                 }
             } else {
                 write_target_inputs(target, cur_time, std::get<CfOp::CJumpInfo>(cf_op.info).target_inputs);
             }
 
             if (target_top_level) {
-                print_asm("# destroy stack space\n");
-                print_asm("add rsp, %zu\n", max_stack_frame_size);
-                print_asm("jmp b%zu\n", target->id);
+                comment(asm_buf, "destroy stack space");
+                emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size)));
+                write_edge_rounding_mode(bb, RoundingMode::NEAREST);
+                emit(mir::Opcode::JMP, mir::block(target->id, uses_call_conv(gen, target) ? mir::Symbol::Kind::CALL_CONV : mir::Symbol::Kind::BLOCK));
             } else {
-                print_asm("jmp b%zu_reg_alloc\n", target->id);
+                write_edge_rounding_mode(bb, target->gen_info.entry_rounding_mode);
+                emit(mir::Opcode::JMP, mir::block(target->id, mir::Symbol::Kind::REG_ALLOC));
             }
             break;
         }
         case CFCInstruction::unreachable: {
-            gen->err_msgs.emplace_back(Generator::ErrType::unreachable, bb);
-            print_asm("lea rdi, [rip + err_unreachable_b%zu]\n", bb->id);
-            print_asm("jmp panic\n");
+            unreachable_blocks.push_back(bb);
+            // keep the register file complete for debugging
+            for (size_t i = 0; i < gen->pinned_statics.size(); ++i) {
+                emit(mir::Opcode::MOV, mir::static_var(gen->pinned_statics[i]), mir::reg(Generator::pinned_regs[i]));
+            }
+            emit(mir::Opcode::LEA, mir::reg(REG_DI), mir::mem(mir::symbol(mir::Symbol::Kind::ERR_UNREACHABLE, bb->id), REG_IP));
+            emit(mir::Opcode::JMP, mir::label(mir::named("panic")));
             break;
         }
         case CFCInstruction::ijump: {
@@ -1851,21 +2485,93 @@ void RegAlloc::compile_cf_ops(BasicBlock *bb, RegMap &reg_map, FPRegMap &fp_reg_
             write_static_mapping((info.targets.empty() ? nullptr : info.targets[0]), cur_time, info.mapping);
             // TODO: we get a problem if the dst is in a static that has already been written out (so overwritten)
             auto *dst = cf_op.in_vars[0].get();
-            load_val_in_reg(cur_time + 1 + info.mapping.size(), dst, REG_B);
+            const auto dst_reg = load_val_in_reg(cur_time + 1 + info.mapping.size(), dst, REG_B);
             assert(dst->type == Type::imm || dst->type == Type::i64);
-            print_asm("# destroy stack space\n");
-            print_asm("add rsp, %zu\n", max_stack_frame_size);
 
-            print_asm("jmp ijump_lookup\n");
+            // the index has to be computed before the stack frame is destroyed since the entry address may be spilled
+            const auto jump_table = gen->uses_jump_table(cf_op);
+            auto index_reg = REG_NONE;
+            if (jump_table) {
+                const auto entry_addr_reg = load_val_in_reg(cur_time + 1 + info.mapping.size(), cf_op.in_vars[1].get(), REG_NONE, dst_reg);
+                index_reg = alloc_reg(cur_time + 1 + info.mapping.size(), REG_NONE, dst_reg, entry_addr_reg);
+                gen->jump_table_index(asm_buf, cf_op, index_reg, entry_addr_reg);
+            }
+
+            comment(asm_buf, "destroy stack space");
+            emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size)));
+
+            if (jump_table) {
+                gen->jump_table_dispatch(asm_buf, bb, cf_op, index_reg);
+            } else {
+                emit(mir::Opcode::JMP, mir::label(gen->ijump_target_label(bb, cf_op)));
+            }
             break;
         }
         case CFCInstruction::syscall: {
             // TODO: allocate over inlined syscall or syscall helper call
-            // TODO: inline syscalls if they are just passthrough
             const auto &info = std::get<CfOp::SyscallInfo>(cf_op.info);
             write_static_mapping(info.continuation_block, cur_time, info.continuation_mapping);
             // cur_time += 1 + info.continuation_mapping.size();
 
+            // blocks using the register call convention expect some inputs in registers so they need to be entered through the translation block
+            const auto cont_from_static = is_block_top_level(info.continuation_block) || uses_call_conv(gen, info.continuation_block);
+            if (const auto *syscall_info = gen->inline_syscall_info(cf_op)) {
+                // the arguments follow the number in the inputs
+                for (size_t i = 0; i < syscall_info->param_count; ++i) {
+                    auto *var = cf_op.in_vars[i + 1].get();
+                    if (var == nullptr) {
+                        break;
+                    }
+
+                    const auto reg = syscall_reg[i];
+                    if (reg_map[reg].cur_var && reg_map[reg].cur_var->gen_info.last_use_time >= cur_time) {
+                        save_reg(reg);
+                    }
+                    load_val_in_reg(cur_time, var, reg);
+                }
+                if (reg_map[REG_A].cur_var && reg_map[REG_A].cur_var->gen_info.last_use_time >= cur_time) {
+                    save_reg(REG_A);
+                }
+                clear_reg(cur_time, REG_A);
+                emit(mir::Opcode::MOV, mir::reg(REG_A, Type::i32), mir::imm(static_cast<int64_t>(syscall_info->translated_id)));
+                emit(mir::Opcode::SYSCALL);
+                if (info.static_mapping.size() > 0) {
+                    emit(mir::Opcode::MOV, static_op(info.static_mapping.at(0)), mir::reg(REG_A));
+                }
+                comment(asm_buf, "destroy stack space");
+                if (cont_from_static) {
+                    emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size)));
+                }
+                emit(mir::Opcode::JMP, mir::block(info.continuation_block->id, cont_from_static ? mir::Symbol::Kind::BLOCK : mir::Symbol::Kind::REG_ALLOC));
+                break;
+            }
+
+            if (const auto *routine = Generator::libc_routine_symbol(cf_op)) {
+                // the routines take at most 3 arguments and don't need the stack space syscall_impl gets
+                for (size_t i = 0; i < 3; ++i) {
+                    auto *var = cf_op.in_vars[i + 1].get();
+                    if (var == nullptr) {
+                        break;
+                    }
+
+                    const auto reg = call_reg[i];
+                    if (reg_map[reg].cur_var && reg_map[reg].cur_var->gen_info.last_use_time >= cur_time) {
+                        save_reg(reg);
+                    }
+                    load_val_in_reg(cur_time, var, reg);
+                }
+                emit(mir::Opcode::CALL, mir::label(mir::named(routine)));
+                if (info.static_mapping.size() > 0) {
+                    emit(mir::Opcode::MOV, static_op(info.static_mapping.at(0)), mir::reg(REG_A));
+                }
+                comment(asm_buf, "destroy stack space");
+                if (cont_from_static) {
+                    emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size)));
+                }
+                emit(mir::Opcode::JMP, mir::block(info.continuation_block->id, cont_from_static ? mir::Symbol::Kind::BLOCK : mir::Symbol::Kind::REG_ALLOC));
+                break;
+            }
+
             for (size_t i = 0; i < call_reg.size(); ++i) {
                 auto *var = cf_op.in_vars[i].get();
                 if (var == nullptr)
@@ -1881,87 +2587,132 @@ void RegAlloc::compile_cf_ops(BasicBlock *bb, RegMap &reg_map, FPRegMap &fp_reg_
                 load_val_in_reg(cur_time, var, call_reg[i]);
             }
             if (cf_op.in_vars[6] == nullptr) {
-                print_asm("sub rsp, 16\n");
+                emit(mir::Opcode::SUB, mir::stack_ptr(), mir::imm(16));
             } else {
                 // TODO: clear rax before when we have inputs < 64 bit
                 if (reg_map[REG_A].cur_var && reg_map[REG_A].cur_var->gen_info.last_use_time >= cur_time) {
                     save_reg(REG_A);
                 }
                 load_val_in_reg(cur_time, cf_op.in_vars[6].get(), REG_A);
-                print_asm("sub rsp, 8\n");
-                print_asm("push rax\n");
+                emit(mir::Opcode::SUB, mir::stack_ptr(), mir::imm(8));
+                emit(mir::Opcode::PUSH, mir::reg(REG_A));
             }
 
-            print_asm("call syscall_impl\n");
+            // a thread created by the syscall starts with a copy of the register file but not of the pinned registers
+            if (gen->multithreaded_guest) {
+                for (size_t i = 0; i < gen->pinned_statics.size(); ++i) {
+                    emit(mir::Opcode::MOV, mir::static_var(gen->pinned_statics[i]), mir::reg(Generator::pinned_regs[i]));
+                }
+            }
+            emit(mir::Opcode::CALL, mir::label(mir::named("syscall_impl")));
+            if (gen->multithreaded_guest) {
+                for (size_t i = 0; i < gen->pinned_statics.size(); ++i) {
+                    emit(mir::Opcode::MOV, mir::reg(Generator::pinned_regs[i]), mir::static_var(gen->pinned_statics[i]));
+                }
+            }
             if (info.static_mapping.size() > 0) {
-                print_asm("mov [s%zu], rax\n", info.static_mapping.at(0));
+                emit(mir::Opcode::MOV, static_op(info.static_mapping.at(0)), mir::reg(REG_A));
             }
-            print_asm("# destroy stack space\n");
-            if (is_block_top_level(info.continuation_block)) {
-                print_asm("add rsp, %zu\n", max_stack_frame_size + 16);
+            comment(asm_buf, "destroy stack space");
+            if (cont_from_static) {
+                emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size + 16)));
             } else {
-                print_asm("add rsp, 16\n");
+                emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(16));
             }
             // need to jump to translation block
             // TODO: technically we don't need to if the block didn't have a input mapping before
             // so only do that when the next block does have an input mapping or more than one predecessor?
-            print_asm("jmp b%zu%s\n", info.continuation_block->id, is_block_top_level(info.continuation_block) ? "" : "_reg_alloc");
+            emit(mir::Opcode::JMP, mir::block(info.continuation_block->id, cont_from_static ? mir::Symbol::Kind::BLOCK : mir::Symbol::Kind::REG_ALLOC));
             break;
         }
         case CFCInstruction::call: {
             auto &info = std::get<CfOp::CallInfo>(cf_op.info);
-            // write_target_inputs(info.target, cur_time, info.target_inputs);
-            auto static_mapping = std::vector<std::pair<RefPtr<SSAVar>, size_t>>{};
-            for (size_t i = 0; i < info.target->inputs.size(); ++i) {
-                static_mapping.emplace_back(std::get<CfOp::CallInfo>(cf_op.info).target_inputs[i], std::get<size_t>(info.target->inputs[i]->info));
+            const auto call_conv = uses_call_conv(gen, info.target);
+            if (call_conv) {
+                write_target_inputs(info.target, cur_time, info.target_inputs);
+            } else {
+                auto static_mapping = std::vector<std::pair<RefPtr<SSAVar>, size_t>>{};
+                for (size_t i = 0; i < info.target->inputs.size(); ++i) {
+                    const auto static_idx = std::get<size_t>(info.target->inputs[i]->info);
+                    if (!gen->is_static_live_in(info.target, static_idx)) {
+                        continue;
+                    }
+                    static_mapping.emplace_back(std::get<CfOp::CallInfo>(cf_op.info).target_inputs[i], static_idx);
+                }
+                write_static_mapping(info.target, cur_time, static_mapping);
             }
-            write_static_mapping(info.target, cur_time, static_mapping);
 
             // prevent overflow
-            print_asm("mov rax, [init_ret_stack_ptr]\n");
-            print_asm("lea rax, [rax - %zu]\n", max_stack_frame_size);
-            print_asm("cmp rsp, stack_space + 524288\n"); // max depth ~65k
-            print_asm("cmovb rsp, rax\n");
+            emit(mir::Opcode::MOV, mir::reg(REG_A), mir::tcb("init_ret_stack_ptr"));
+            emit(mir::Opcode::LEA, mir::reg(REG_A), mir::mem(REG_A, -static_cast<int64_t>(max_stack_frame_size)));
+            emit(mir::Opcode::CMP, mir::stack_ptr(), gen->ret_stack_limit()); // max depth ~65k
+            emit(mir::Opcode::CMOVCC, mir::Cond::B, mir::stack_ptr(), mir::reg(REG_A));
 
             if (info.continuation_block->virt_start_addr <= 0x7FFFFFFF) {
-                print_asm("push %lu\n", info.continuation_block->virt_start_addr);
+                emit(mir::Opcode::PUSH, mir::imm(static_cast<int64_t>(info.continuation_block->virt_start_addr)));
             } else {
-                print_asm("mov rax, %lu\n", info.continuation_block->virt_start_addr);
-                print_asm("push rax\n");
+                emit(mir::Opcode::MOV, mir::reg(REG_A), mir::imm(static_cast<int64_t>(info.continuation_block->virt_start_addr)));
+                emit(mir::Opcode::PUSH, mir::reg(REG_A));
             }
 
-            print_asm("call b%zu\n", info.target->id);
+            emit(mir::Opcode::CALL, mir::block(info.target->id, call_conv ? mir::Symbol::Kind::CALL_CONV : mir::Symbol::Kind::BLOCK));
             if (bb->control_flow_ops.size() != 1 || info.continuation_block != next_bb || is_block_top_level(info.continuation_block)) {
-                if (is_block_top_level(info.continuation_block) || std::find(compiled_blocks.begin(), compiled_blocks.end(), info.continuation_block) == compiled_blocks.end()) {
-                    print_asm("add rsp, %zu\n", max_stack_frame_size + 8);
-                    print_asm("jmp b%zu\n", info.continuation_block->id);
+                if (is_block_top_level(info.continuation_block) || !in_group(info.continuation_block)) {
+                    emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size + 8)));
+                    write_call_conv_continuation(info.continuation_block);
                 } else {
-                    print_asm("add rsp, 8\n");
-                    print_asm("jmp b%zu_reg_alloc\n", info.continuation_block->id);
+                    emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(8));
+                    emit(mir::Opcode::JMP, mir::block(info.continuation_block->id, mir::Symbol::Kind::REG_ALLOC));
                 }
             } else {
-                print_asm("add rsp, 8\n");
+                emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(8));
             }
             break;
         }
         case CFCInstruction::_return: {
-            write_static_mapping(nullptr, cur_time, std::get<CfOp::RetInfo>(cf_op.info).mapping);
-            // TODO: write out ret addr last and keep it in reg
-            const auto ret_reg = load_val_in_reg(cur_time + std::get<CfOp::RetInfo>(cf_op.info).mapping.size(), cf_op.in_vars[0]);
-            const auto dst_reg_name = reg_names[ret_reg][0];
-
-            print_asm("# destroy stack space\n");
-            print_asm("add rsp, %zu\n", max_stack_frame_size);
-            print_asm("cmp [rsp + 8], %s\n", dst_reg_name);
-            print_asm("jnz 0f\n");
-            print_asm("ret\n");
-            print_asm("0:\n");
+            const auto &mapping = std::get<CfOp::RetInfo>(cf_op.info).mapping;
+            const auto call_conv = (gen->optimizations & Generator::OPT_CALL_CONV) != 0;
+            auto ret_reg = REG_NONE;
+            if (call_conv) {
+                // the continuation gets the convention registers directly, everything else goes through the statics
+                auto static_mapping = std::vector<std::pair<RefPtr<SSAVar>, size_t>>{};
+                for (const auto &pair : mapping) {
+                    if (call_conv_reg(pair.second) == REG_NONE) {
+                        static_mapping.emplace_back(pair);
+                    } else if (pair.first->type != Type::mt) {
+                        // the static mapping is written first, keep the values alive so they aren't dropped when evicted
+                        auto &info = pair.first->gen_info;
+                        info.last_use_time = std::max(info.last_use_time, cur_time + mapping.size() + 1);
+                        info.uses.push_back(cur_time + mapping.size() + 1);
+                    }
+                }
+                write_static_mapping(nullptr, cur_time, static_mapping);
+                ret_reg = load_val_in_reg(cur_time + mapping.size(), cf_op.in_vars[0], REG_B);
+                write_call_conv_regs(cur_time + mapping.size() + 1, mapping);
+            } else {
+                write_static_mapping(nullptr, cur_time, mapping);
+                // TODO: write out ret addr last and keep it in reg
+                ret_reg = load_val_in_reg(cur_time + mapping.size(), cf_op.in_vars[0]);
+            }
+
+            comment(asm_buf, "destroy stack space");
+            emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size)));
+            emit(mir::Opcode::CMP, mir::mem(REG_SP, 8), mir::reg(ret_reg));
+            emit(mir::Opcode::JCC, mir::Cond::NE, mir::label(mir::local(0)));
+            emit(mir::Opcode::RET);
+            asm_buf.label(mir::local(0));
+            if (call_conv) {
+                write_call_conv_statics();
+            }
             // reset ret stack
-            print_asm("mov rsp, [init_ret_stack_ptr]\n");
+            if (gen->count_stats) {
+                emit(mir::Opcode::INC, mir::sized(mir::mem(mir::named("stats_ret_mispredicts")), Type::i64)).lock = gen->multithreaded_guest;
+            }
+            emit(mir::Opcode::MOV, mir::stack_ptr(), mir::tcb("init_ret_stack_ptr"));
 
             // do ijump
-            print_asm("mov rbx, %s\n", dst_reg_name);
-            print_asm("jmp ijump_lookup\n");
+            emit(mir::Opcode::MOV, mir::reg(REG_B), mir::reg(ret_reg));
+            emit(mir::Opcode::JMP, mir::label(gen->ijump_target_label(bb, cf_op)));
             break;
         }
         case CFCInstruction::icall: {
@@ -1973,33 +2724,32 @@ void RegAlloc::compile_cf_ops(BasicBlock *bb, RegMap &reg_map, FPRegMap &fp_reg_
             assert(dst->type == Type::imm || dst->type == Type::i64);
 
             const auto overflow_reg = alloc_reg(cur_time + 1 + info.mapping.size(), REG_NONE, dst_reg);
-            const auto of_reg_name = reg_names[overflow_reg][0];
             // prevent overflow
-            print_asm("mov %s, [init_ret_stack_ptr]\n", of_reg_name);
-            print_asm("lea %s, [%s - %zu]\n", of_reg_name, of_reg_name, max_stack_frame_size);
-            print_asm("cmp rsp, stack_space + 524288\n"); // max depth ~65k
-            print_asm("cmovb rsp, %s\n", of_reg_name);
+            emit(mir::Opcode::MOV, mir::reg(overflow_reg), mir::tcb("init_ret_stack_ptr"));
+            emit(mir::Opcode::LEA, mir::reg(overflow_reg), mir::mem(overflow_reg, -static_cast<int64_t>(max_stack_frame_size)));
+            emit(mir::Opcode::CMP, mir::stack_ptr(), gen->ret_stack_limit()); // max depth ~65k
+            emit(mir::Opcode::CMOVCC, mir::Cond::B, mir::stack_ptr(), mir::reg(overflow_reg));
 
             if (info.continuation_block->virt_start_addr <= 0x7FFFFFFF) {
-                print_asm("push %lu\n", info.continuation_block->virt_start_addr);
+                emit(mir::Opcode::PUSH, mir::imm(static_cast<int64_t>(info.continuation_block->virt_start_addr)));
             } else {
                 const auto tmp_reg = alloc_reg(cur_time + 1 + info.mapping.size());
-                print_asm("mov %s, %lu\n", reg_names[tmp_reg][0], info.continuation_block->virt_start_addr);
-                print_asm("push %s\n", reg_names[tmp_reg][0]);
+                emit(mir::Opcode::MOV, mir::reg(tmp_reg), mir::imm(static_cast<int64_t>(info.continuation_block->virt_start_addr)));
+                emit(mir::Opcode::PUSH, mir::reg(tmp_reg));
             }
 
-            print_asm("call ijump_lookup\n");
+            emit(mir::Opcode::CALL, mir::label(gen->ijump_target_label(bb, cf_op)));
 
             if (bb->control_flow_ops.size() != 1 || info.continuation_block != next_bb || is_block_top_level(info.continuation_block)) {
-                if (is_block_top_level(info.continuation_block) || std::find(compiled_blocks.begin(), compiled_blocks.end(), info.continuation_block) == compiled_blocks.end()) {
-                    print_asm("add rsp, %zu\n", max_stack_frame_size + 8);
-                    print_asm("jmp b%zu\n", info.continuation_block->id);
+                if (is_block_top_level(info.continuation_block) || !in_group(info.continuation_block)) {
+                    emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(static_cast<int64_t>(max_stack_frame_size + 8)));
+                    write_call_conv_continuation(info.continuation_block);
                 } else {
-                    print_asm("add rsp, 8\n");
-                    print_asm("jmp b%zu_reg_alloc\n", info.continuation_block->id);
+                    emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(8));
+                    emit(mir::Opcode::JMP, mir::block(info.continuation_block->id, mir::Symbol::Kind::REG_ALLOC));
                 }
             } else {
-                print_asm("add rsp, 8\n");
+                emit(mir::Opcode::ADD, mir::stack_ptr(), mir::imm(8));
             }
             break;
         }
@@ -2011,19 +2761,40 @@ void RegAlloc::compile_cf_ops(BasicBlock *bb, RegMap &reg_map, FPRegMap &fp_reg_
     }
 }
 
-void RegAlloc::write_assembled_blocks(size_t max_stack_frame_size, std::vector<BasicBlock *> &compiled_blocks) {
+void RegAlloc::GroupContext::write_assembled_blocks(size_t max_stack_frame_size) {
+    auto first_cold_block = assembled_blocks.size();
+    if ((gen->optimizations & Generator::OPT_BLOCK_LAYOUT) && assembled_blocks.size() > 1) {
+        // blocks that can only panic are moved to the end of the group and into the cold section.
+        // the first block needs to stay in place since it directly follows the group's entry
+        const auto it = std::stable_partition(std::next(assembled_blocks.begin()), assembled_blocks.end(), [](const AssembledBlock &block) { return !layout::BlockLayout::is_cold(block.bb); });
+        first_cold_block = std::distance(assembled_blocks.begin(), it);
+    }
+
     for (size_t i = 0; i < assembled_blocks.size(); ++i) {
         auto &block = assembled_blocks[i];
 
-        fprintf(gen->out_fd, "%s\n", block.assembly.c_str());
+        if (i == first_cold_block) {
+            output.section(mir::Section::TEXT_COLD);
+        }
         asm_buf.clear();
         cur_bb = block.bb;
         cur_reg_map = &block.reg_map;
         cur_fp_reg_map = &block.fp_reg_map;
         cur_stack_map = &block.stack_map;
-        auto *next_bb = (i + 1 >= assembled_blocks.size()) ? nullptr : assembled_blocks[i + 1].bb;
-        compile_cf_ops(block.bb, block.reg_map, block.fp_reg_map, block.stack_map, max_stack_frame_size, next_bb, compiled_blocks);
-        fprintf(gen->out_fd, "%s\n", asm_buf.c_str());
+        // a jump can only be omitted if the target's label directly follows the cfops of this block
+        auto *next_bb = (i + 1 >= assembled_blocks.size() || i + 1 == first_cold_block || !assembled_blocks[i + 1].has_entry_label) ? nullptr : assembled_blocks[i + 1].bb;
+        compile_cf_ops(block.bb, block.assembly, block.reg_map, block.fp_reg_map, block.stack_map, max_stack_frame_size, next_bb);
+        if (gen->optimizations & Generator::OPT_PEEPHOLE) {
+            // the cfops are only known now, so the block is optimized as a whole once they are appended
+            block.assembly.append(asm_buf);
+            asm_buf.clear();
+            peephole.run(block.assembly);
+        }
+        output.append(block.assembly);
+        output.append(asm_buf);
+    }
+    if (first_cold_block < assembled_blocks.size()) {
+        output.section(mir::Section::TEXT);
     }
     cur_bb = nullptr;
     cur_reg_map = nullptr;
@@ -2031,8 +2802,8 @@ void RegAlloc::write_assembled_blocks(size_t max_stack_frame_size, std::vector<B
     cur_stack_map = nullptr;
 }
 
-void RegAlloc::generate_translation_block(BasicBlock *bb) {
-    std::string tmp_buf = {};
+void RegAlloc::GroupContext::generate_translation_block(BasicBlock *bb) {
+    auto tmp_buf = mir::Block{};
     std::swap(tmp_buf, asm_buf);
 
     bool rax_input = false;
@@ -2055,20 +2826,20 @@ void RegAlloc::generate_translation_block(BasicBlock *bb) {
                 rax_static = src_static;
                 break;
             }
-            print_asm("mov %s, [s%zu]\n", reg_names[input_info.reg_idx][0], src_static);
+            emit(mir::Opcode::MOV, mir::reg(static_cast<REGISTER>(input_info.reg_idx)), static_op(src_static));
             break;
         case BasicBlock::GeneratorInfo::InputInfo::FP_REGISTER:
-            print_asm("movq %s, [s%zu]\n", fp_reg_names[input_info.reg_idx], src_static);
+            emit(mir::Opcode::MOVQ, mir::fp_reg(static_cast<FP_REGISTER>(input_info.reg_idx)), static_op(src_static));
             break;
         case BasicBlock::GeneratorInfo::InputInfo::STACK:
-            print_asm("mov rax, [s%zu]\n", src_static);
-            print_asm("mov [rsp + 8 * %zu], rax\n", input_info.stack_slot);
+            emit(mir::Opcode::MOV, mir::reg(REG_A), static_op(src_static));
+            emit(mir::Opcode::MOV, mir::stack_slot(input_info.stack_slot), mir::reg(REG_A));
             break;
         case BasicBlock::GeneratorInfo::InputInfo::STATIC:
             if (input_info.static_idx != src_static) {
                 // TODO: this can break when two statics are swapped
-                print_asm("mov rax, [s%zu]\n", src_static);
-                print_asm("mov [s%zu], rax\n", input_info.static_idx);
+                emit(mir::Opcode::MOV, mir::reg(REG_A), static_op(src_static));
+                emit(mir::Opcode::MOV, static_op(input_info.static_idx), mir::reg(REG_A));
             }
             break;
         default:
@@ -2079,15 +2850,22 @@ void RegAlloc::generate_translation_block(BasicBlock *bb) {
     }
 
     if (rax_input) {
-        print_asm("mov rax, [s%zu]\n", rax_static);
+        emit(mir::Opcode::MOV, mir::reg(REG_A), static_op(rax_static));
+    }
+    // translation blocks are entered with round-to-nearest
+    if (bb->gen_info.entry_rounding_mode != RoundingMode::NEAREST) {
+        write_rounding_mode(bb->gen_info.entry_rounding_mode);
     }
-    print_asm("jmp b%zu_reg_alloc\n", bb->id);
+    emit(mir::Opcode::JMP, mir::block(bb->id, mir::Symbol::Kind::REG_ALLOC));
 
     std::swap(tmp_buf, asm_buf);
-    translation_blocks.push_back(std::make_pair(bb->id, std::move(tmp_buf)));
+    if (gen->optimizations & Generator::OPT_PEEPHOLE) {
+        peephole.run(tmp_buf);
+    }
+    translation_blocks.emplace_back(bb->id, std::move(tmp_buf));
 }
 
-void RegAlloc::set_bb_inputs(BasicBlock *target, const std::vector<RefPtr<SSAVar>> &inputs) {
+void RegAlloc::GroupContext::set_bb_inputs(BasicBlock *target, const std::vector<RefPtr<SSAVar>> &inputs) {
     // TODO: when there are multiple blocks that follow only generate an input mapping once
     auto &reg_map = *cur_reg_map;
     auto &fp_reg_map = *cur_fp_reg_map;
@@ -2108,8 +2886,8 @@ void RegAlloc::set_bb_inputs(BasicBlock *target, const std::vector<RefPtr<SSAVar
 
     assert(target->inputs.size() == inputs.size());
     if (target->id > BB_MERGE_TIL_ID || is_block_top_level(target)) {
-        // cheap fix to force single block register allocation
-        set_bb_inputs_from_static(target);
+        // cheap fix to force single block register allocation, the input map was already set up by RegAlloc::plan_groups
+        assert(target->gen_info.input_map_setup);
     } else {
         for (size_t i = 0; i < inputs.size(); ++i) {
             auto *input = inputs[i].get();
@@ -2119,6 +2897,29 @@ void RegAlloc::set_bb_inputs(BasicBlock *target, const std::vector<RefPtr<SSAVar
                 load_val_in_reg<false>(cur_time, input);
             }
         }
+        if (use_weighted_eviction() && live_intervals->loop_depth(target) > 0) {
+            // the interval is split at the block boundary, so values that are used inside a loop can be handed over in a
+            // free register instead of being reloaded from the stack on every iteration
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                auto *input = inputs[i].get();
+                if (input->gen_info.location != SSAVar::GeneratorInfoX64::STACK_FRAME || live_intervals->spill_weight(target->inputs[i]) == 0.f) {
+                    continue;
+                }
+                if (is_float(input->type)) {
+                    if (std::any_of(fp_reg_map.begin(), fp_reg_map.end(), [cur_time](const RegInfo &info) { return !info.cur_var || info.cur_var->gen_info.last_use_time < cur_time; })) {
+                        load_val_in_fp_reg(cur_time, input);
+                    }
+                } else if (input->type != Type::mt) {
+                    auto has_free_reg = false;
+                    for (size_t reg = 0; reg < REG_COUNT && !has_free_reg; ++reg) {
+                        has_free_reg = !is_reg_pinned(reg) && (!reg_map[reg].cur_var || reg_map[reg].cur_var->gen_info.last_use_time < cur_time);
+                    }
+                    if (has_free_reg) {
+                        load_val_in_reg<false>(cur_time, input);
+                    }
+                }
+            }
+        }
         bool rax_used = false, xmm0_used = false;
         SSAVar *rax_input, *xmm0_input;
         // just write input locations, compile the input map and we done
@@ -2139,9 +2940,9 @@ void RegAlloc::set_bb_inputs(BasicBlock *target, const std::vector<RefPtr<SSAVar
 
                 // move var to stack slot
                 if (input_var->gen_info.location == SSAVar::GeneratorInfoX64::REGISTER) {
-                    print_asm("mov [rsp + 8 * %zu], %s\n", stack_slot, reg_names[input_var->gen_info.reg_idx][0]);
+                    emit(mir::Opcode::MOV, mir::stack_slot(stack_slot), mir::reg(static_cast<REGISTER>(input_var->gen_info.reg_idx)));
                 } else if (input_var->gen_info.location == SSAVar::GeneratorInfoX64::FP_REGISTER) {
-                    print_asm("movq [rsp + 8 * %zu], %s\n", stack_slot, fp_reg_names[input_var->gen_info.reg_idx]);
+                    emit(mir::Opcode::MOVQ, mir::stack_slot(stack_slot), mir::fp_reg(static_cast<FP_REGISTER>(input_var->gen_info.reg_idx)));
                 } else if (is_float(input_var->type)) {
                     FP_REGISTER reg = FP_REG_NONE;
                     // find free/unused register
@@ -2160,11 +2961,14 @@ void RegAlloc::set_bb_inputs(BasicBlock *target, const std::vector<RefPtr<SSAVar
                         }
                         load_val_in_fp_reg(cur_time, input_var, REG_XMM0);
                     }
-                    print_asm("movq [rsp + 8 * %zu], %s\n", stack_slot, fp_reg_names[reg]);
+                    emit(mir::Opcode::MOVQ, mir::stack_slot(stack_slot), mir::fp_reg(reg));
                 } else {
                     auto reg = REG_NONE;
                     // find free/unused register
                     for (size_t i = 0; i < REG_COUNT; ++i) {
+                        if (is_reg_pinned(i)) {
+                            continue;
+                        }
                         if (reg_map[i].cur_var == nullptr || reg_map[i].cur_var->gen_info.last_use_time < cur_time) {
                             reg = static_cast<REGISTER>(i);
                             break;
@@ -2179,7 +2983,7 @@ void RegAlloc::set_bb_inputs(BasicBlock *target, const std::vector<RefPtr<SSAVar
                         }
                         load_val_in_reg<false>(cur_time, input_var, REG_A);
                     }
-                    print_asm("mov [rsp + 8 * %zu], %s\n", stack_slot, reg_names[reg][0]);
+                    emit(mir::Opcode::MOV, mir::stack_slot(stack_slot), mir::reg(reg));
                     if (!input_var->gen_info.saved_in_stack) {
                         input_var->gen_info.saved_in_stack = true;
                         input_var->gen_info.stack_slot = stack_slot;
@@ -2227,6 +3031,7 @@ void RegAlloc::set_bb_inputs(BasicBlock *target, const std::vector<RefPtr<SSAVar
 }
 
 void RegAlloc::set_bb_inputs_from_static(BasicBlock *target) {
+    const auto call_conv = uses_call_conv(gen, target);
     for (size_t i = 0; i < target->inputs.size(); ++i) {
         auto *var = target->inputs[i];
         assert(std::holds_alternative<size_t>(var->info));
@@ -2236,9 +3041,91 @@ void RegAlloc::set_bb_inputs_from_static(BasicBlock *target) {
         info.static_idx = std::get<size_t>(var->info);
         var->gen_info.location = SSAVar::GeneratorInfoX64::STATIC;
         var->gen_info.static_idx = info.static_idx;
+        if (const auto reg = call_conv_reg(info.static_idx); call_conv && reg != REG_NONE && var->type != Type::mt) {
+            info.location = BasicBlock::GeneratorInfo::InputInfo::REGISTER;
+            info.reg_idx = reg;
+        }
         target->gen_info.input_map.push_back(info);
     }
     target->gen_info.input_map_setup = true;
+    if (call_conv) {
+        set_call_conv_input_locations(target);
+    }
+}
+
+bool RegAlloc::uses_call_conv(const Generator *gen, const BasicBlock *bb) { return (gen->optimizations & Generator::OPT_CALL_CONV) && (bb->gen_info.call_target || bb->gen_info.call_cont_block); }
+
+mir::Operand RegAlloc::GroupContext::static_op(const size_t static_idx, const Type type) const {
+    const auto reg = gen->pinned_reg(static_idx);
+    return (reg == REG_NONE) ? mir::static_var(static_idx) : mir::reg(reg, type);
+}
+
+bool RegAlloc::GroupContext::is_reg_pinned(const size_t reg) const { return gen->is_reg_pinned(static_cast<REGISTER>(reg)); }
+
+void RegAlloc::set_call_conv_input_locations(BasicBlock *bb) {
+    assert(bb->gen_info.input_map_setup);
+    for (size_t i = 0; i < bb->inputs.size(); ++i) {
+        const auto &info = bb->gen_info.input_map[i];
+        if (info.location == BasicBlock::GeneratorInfo::InputInfo::REGISTER) {
+            bb->inputs[i]->gen_info.location = SSAVar::GeneratorInfoX64::REGISTER;
+            bb->inputs[i]->gen_info.reg_idx = info.reg_idx;
+        }
+    }
+}
+
+void RegAlloc::GroupContext::write_call_conv_regs(size_t cur_time, const std::vector<std::pair<RefPtr<SSAVar>, size_t>> &mapping) {
+    auto vars = std::array<SSAVar *, call_conv_regs.size()>{};
+    for (size_t i = 0; i < call_conv_regs.size(); ++i) {
+        for (const auto &pair : mapping) {
+            if (pair.second == call_conv_regs[i].first && pair.first->type != Type::mt) {
+                vars[i] = pair.first.get();
+                break;
+            }
+        }
+        // fixup time calculation so values which still need to be moved to their register are saved when they get evicted
+        if (vars[i]) {
+            vars[i]->gen_info.last_use_time = std::max(vars[i]->gen_info.last_use_time, cur_time + i);
+            vars[i]->gen_info.uses.push_back(cur_time + i);
+        }
+    }
+
+    auto &reg_map = *cur_reg_map;
+    for (size_t i = 0; i < call_conv_regs.size(); ++i) {
+        const auto [static_idx, reg] = call_conv_regs[i];
+        if (vars[i]) {
+            load_val_in_reg(cur_time + i, vars[i], reg);
+            continue;
+        }
+
+        // not in the mapping, so the static is still up-to-date
+        if (reg_map[reg].cur_var && reg_map[reg].cur_var->gen_info.last_use_time >= cur_time + i) {
+            save_reg(reg);
+        }
+        clear_reg(cur_time + i, reg);
+        emit(mir::Opcode::MOV, mir::reg(reg), static_op(static_idx));
+    }
+}
+
+void RegAlloc::GroupContext::write_call_conv_statics() {
+    for (const auto &[static_idx, reg] : call_conv_regs) {
+        emit(mir::Opcode::MOV, static_op(static_idx), mir::reg(reg));
+    }
+}
+
+void RegAlloc::GroupContext::write_call_conv_continuation(BasicBlock *cont_block) {
+    if (!(gen->optimizations & Generator::OPT_CALL_CONV)) {
+        emit(mir::Opcode::JMP, mir::block(cont_block->id));
+        return;
+    }
+
+    // the callee returned with the convention registers filled in
+    if (is_block_top_level(cont_block) && uses_call_conv(gen, cont_block)) {
+        emit(mir::Opcode::JMP, mir::block(cont_block->id, mir::Symbol::Kind::CALL_CONV));
+        return;
+    }
+    // the block lives in a different group so it has to be entered through its translation block
+    write_call_conv_statics();
+    emit(mir::Opcode::JMP, mir::block(cont_block->id));
 }
 
 void RegAlloc::generate_input_map(BasicBlock *bb) {
@@ -2279,7 +3166,7 @@ void RegAlloc::generate_input_map(BasicBlock *bb) {
     bb->gen_info.input_map_setup = true;
 }
 
-void RegAlloc::write_static_mapping([[maybe_unused]] BasicBlock *bb, size_t cur_time, const std::vector<std::pair<RefPtr<SSAVar>, size_t>> &mapping) {
+void RegAlloc::GroupContext::write_static_mapping([[maybe_unused]] BasicBlock *bb, size_t cur_time, const std::vector<std::pair<RefPtr<SSAVar>, size_t>> &mapping) {
     // TODO: this is a bit unfaithful to the time calculation since we write out registers first but that should be fine
 
     auto written_out = std::vector<bool>{};
@@ -2338,11 +3225,11 @@ void RegAlloc::write_static_mapping([[maybe_unused]] BasicBlock *bb, size_t cur_
             }
         }
         if (location == SSAVar::GeneratorInfoX64::FP_REGISTER) {
-            print_asm("movq [s%zu], %s\n", pair.second, fp_reg_names[var->gen_info.reg_idx]);
+            emit(mir::Opcode::MOVQ, static_op(pair.second), mir::fp_reg(static_cast<FP_REGISTER>(var->gen_info.reg_idx)));
             continue;
         }
 
-        print_asm("mov [s%zu], %s\n", pair.second, reg_names[var->gen_info.reg_idx][0]);
+        emit(mir::Opcode::MOV, static_op(pair.second), mir::reg(static_cast<REGISTER>(var->gen_info.reg_idx)));
         written_out[i] = true;
     }
 
@@ -2378,15 +3265,15 @@ void RegAlloc::write_static_mapping([[maybe_unused]] BasicBlock *bb, size_t cur_
         // TODO: really need to fix this time management
         if (is_float(var->type)) {
             const auto reg = load_val_in_fp_reg(cur_time, var);
-            print_asm("movq [s%zu], %s\n", static_idx, fp_reg_names[reg]);
+            emit(mir::Opcode::MOVQ, static_op(static_idx), mir::fp_reg(reg));
         } else {
             const auto reg = load_val_in_reg(cur_time /*+ var_idx*/, var);
-            print_asm("mov [s%zu], %s\n", static_idx, reg_names[reg][0]);
+            emit(mir::Opcode::MOV, static_op(static_idx), mir::reg(reg));
         }
     }
 }
 
-void RegAlloc::write_target_inputs(BasicBlock *target, size_t cur_time, const std::vector<RefPtr<SSAVar>> &inputs) {
+void RegAlloc::GroupContext::write_target_inputs(BasicBlock *target, size_t cur_time, const std::vector<RefPtr<SSAVar>> &inputs, const size_t stack_slot_offset) {
     // Here we have multiple problems:
     // - we could need to write to a static that is needed to be somewhere else later
     // - we could need to write to a register that is needed somewhere else later
@@ -2397,7 +3284,13 @@ void RegAlloc::write_target_inputs(BasicBlock *target, size_t cur_time, const st
 
     assert(target->gen_info.input_map_setup);
     assert(target->inputs.size() == target->gen_info.input_map.size());
-    const auto &input_map = target->gen_info.input_map;
+    // the input map may be read by other groups at the same time so it can't be shifted in place
+    auto input_map = target->gen_info.input_map;
+    for (auto &input : input_map) {
+        if (input.location == BasicBlock::GeneratorInfo::InputInfo::STACK) {
+            input.stack_slot += stack_slot_offset;
+        }
+    }
     // mark all stack slots used as inputs as non-free
     auto &stack_map = *cur_stack_map;
     for (size_t i = 0; i < input_map.size(); ++i) {
@@ -2521,6 +3414,11 @@ void RegAlloc::write_target_inputs(BasicBlock *target, size_t cur_time, const st
             cur_write_time++;
             continue;
         }
+        if (!gen->is_static_live_in(target, std::get<size_t>(target->inputs[var_idx]->info))) {
+            // nobody reads the value anymore
+            cur_write_time++;
+            continue;
+        }
 
         auto *var = inputs[var_idx].get();
         if (std::holds_alternative<size_t>(var->info)) {
@@ -2542,10 +3440,10 @@ void RegAlloc::write_target_inputs(BasicBlock *target, size_t cur_time, const st
 
         if (is_float(var->type)) {
             const auto reg = load_val_in_fp_reg(cur_write_time, var);
-            print_asm("movq [s%zu], %s\n", input_map[var_idx].static_idx, fp_reg_names[reg]);
+            emit(mir::Opcode::MOVQ, static_op(input_map[var_idx].static_idx), mir::fp_reg(reg));
         } else {
             const auto reg = load_val_in_reg(cur_write_time, var);
-            print_asm("mov [s%zu], %s\n", input_map[var_idx].static_idx, reg_names[reg][0]);
+            emit(mir::Opcode::MOV, static_op(input_map[var_idx].static_idx), mir::reg(reg));
         }
         cur_write_time++;
     }
@@ -2564,10 +3462,10 @@ void RegAlloc::write_target_inputs(BasicBlock *target, size_t cur_time, const st
 
         if (is_float(input->type)) {
             const auto reg = load_val_in_fp_reg(cur_write_time, input);
-            print_asm("movq [rsp + 8 * %zu], %s\n", info.stack_slot, fp_reg_names[reg]);
+            emit(mir::Opcode::MOVQ, mir::stack_slot(info.stack_slot), mir::fp_reg(reg));
         } else {
             const auto reg = load_val_in_reg(cur_write_time, input);
-            print_asm("mov [rsp + 8 * %zu], %s\n", info.stack_slot, reg_names[reg][0]);
+            emit(mir::Opcode::MOV, mir::stack_slot(info.stack_slot), mir::reg(reg));
         }
         cur_write_time++;
     }
@@ -2593,7 +3491,7 @@ void RegAlloc::write_target_inputs(BasicBlock *target, size_t cur_time, const st
                 save_reg(reg);
             }
             clear_reg(cur_write_time, reg);
-            print_asm("mov %s, %s\n", reg_names[reg][0], reg_names[input->gen_info.reg_idx][0]);
+            emit(mir::Opcode::MOV, mir::reg(reg), mir::reg(static_cast<REGISTER>(input->gen_info.reg_idx)));
             reg_map[reg].cur_var = input;
             reg_map[reg].alloc_time = cur_write_time;
         } else {
@@ -2623,7 +3521,7 @@ void RegAlloc::write_target_inputs(BasicBlock *target, size_t cur_time, const st
                 save_fp_reg(reg);
             }
             clear_fp_reg(cur_write_time, reg);
-            print_asm("movq %s, %s\n", fp_reg_names[reg], fp_reg_names[input->gen_info.reg_idx]);
+            emit(mir::Opcode::MOVQ, mir::fp_reg(reg), mir::fp_reg(static_cast<FP_REGISTER>(input->gen_info.reg_idx)));
             fp_reg_map[reg].cur_var = input;
             fp_reg_map[reg].alloc_time = cur_write_time;
         } else {
@@ -2633,22 +3531,35 @@ void RegAlloc::write_target_inputs(BasicBlock *target, size_t cur_time, const st
     }
 }
 
-void RegAlloc::init_time_of_use(BasicBlock *bb) {
+void RegAlloc::GroupContext::init_time_of_use(BasicBlock *bb) {
+    const auto add_input_uses = [this](const Operation *op, const size_t i, const auto &self) -> void {
+        for (const auto &input : op->in_vars) {
+            if (!input) {
+                continue;
+            }
+            if (folded_vars.count(input.get()) != 0) {
+                // the inputs of a folded var are used where the memory operand is
+                self(std::get<std::unique_ptr<Operation>>(input->info).get(), i, self);
+                continue;
+            }
+            input->gen_info.last_use_time = i; // max(last_use_time, i)?
+            input->gen_info.uses.push_back(i);
+        }
+    };
     for (size_t i = 0; i < bb->variables.size(); ++i) {
         auto *var = bb->variables[i].get();
         if (!std::holds_alternative<std::unique_ptr<Operation>>(var->info)) {
             continue;
         }
 
-        auto *op = std::get<std::unique_ptr<Operation>>(var->info).get();
-        for (auto &input : op->in_vars) {
-            if (!input) {
-                continue;
-            }
-            input->gen_info.last_use_time = i; // max(last_use_time, i)?
-            input->gen_info.uses.push_back(i);
+        if (folded_vars.count(var) != 0) {
+            // folded vars are computed as part of their user's memory operand
+            continue;
         }
 
+        auto *op = std::get<std::unique_ptr<Operation>>(var->info).get();
+        add_input_uses(op, i, add_input_uses);
+
         if (std::holds_alternative<RefPtr<SSAVar>>(op->rounding_info)) {
             SSAVar *rounding_info = std::get<RefPtr<SSAVar>>(op->rounding_info).get();
             rounding_info->gen_info.last_use_time = i;
@@ -2656,6 +3567,15 @@ void RegAlloc::init_time_of_use(BasicBlock *bb) {
         }
     }
 
+    if (const auto *fused = fused_compare(bb); fused != nullptr) {
+        // the operands of a fused compare are used by the cjump
+        for (size_t i = 0; i < 2; ++i) {
+            auto &info = fused->in_vars[i]->gen_info;
+            info.last_use_time = std::max(info.last_use_time, bb->variables.size());
+            info.uses.push_back(bb->variables.size());
+        }
+    }
+
     const auto set_time_cont_mapping = [](const size_t time_off, std::vector<std::pair<RefPtr<SSAVar>, size_t>> &mapping) {
         for (size_t i = 0; i < mapping.size(); ++i) {
             auto &info = mapping[i].first->gen_info;
@@ -2719,7 +3639,7 @@ void RegAlloc::init_time_of_use(BasicBlock *bb) {
     }
 }
 
-template <bool evict_imms, typename... Args> REGISTER RegAlloc::alloc_reg(size_t cur_time, REGISTER only_this_reg, Args... clear_regs) {
+template <bool evict_imms, typename... Args> REGISTER RegAlloc::GroupContext::alloc_reg(size_t cur_time, REGISTER only_this_reg, Args... clear_regs) {
     static_assert((std::is_same_v<Args, REGISTER> && ...));
     auto &reg_map = *cur_reg_map;
 
@@ -2727,7 +3647,12 @@ template <bool evict_imms, typename... Args> REGISTER RegAlloc::alloc_reg(size_t
         auto &cur_var = reg_map[only_this_reg].cur_var;
         if (cur_var != nullptr) {
             save_reg(only_this_reg, !evict_imms);
-            cur_var->gen_info.location = SSAVar::GeneratorInfoX64::STACK_FRAME;
+            if (can_remat_static(cur_var)) {
+                cur_var->gen_info.location = SSAVar::GeneratorInfoX64::STATIC;
+                cur_var->gen_info.static_idx = live_intervals->home_static(cur_var);
+            } else {
+                cur_var->gen_info.location = SSAVar::GeneratorInfoX64::STACK_FRAME;
+            }
             cur_var = nullptr;
         }
         return only_this_reg;
@@ -2736,7 +3661,7 @@ template <bool evict_imms, typename... Args> REGISTER RegAlloc::alloc_reg(size_t
     REGISTER reg = REG_NONE;
     // try to find free register
     for (size_t i = 0; i < REG_COUNT; ++i) {
-        if (((i == clear_regs) || ...)) { // NOLINT(clang-diagnostic-parentheses-equality)
+        if (((i == clear_regs) || ...) || is_reg_pinned(i)) { // NOLINT(clang-diagnostic-parentheses-equality)
             continue;
         }
 
@@ -2749,7 +3674,7 @@ template <bool evict_imms, typename... Args> REGISTER RegAlloc::alloc_reg(size_t
     if (reg == REG_NONE) {
         // try to find reg with unused var
         for (size_t i = 0; i < REG_COUNT; ++i) {
-            if (((i == clear_regs) || ...)) { // NOLINT(clang-diagnostic-parentheses-equality)
+            if (((i == clear_regs) || ...) || is_reg_pinned(i)) { // NOLINT(clang-diagnostic-parentheses-equality)
                 continue;
             }
 
@@ -2764,8 +3689,9 @@ template <bool evict_imms, typename... Args> REGISTER RegAlloc::alloc_reg(size_t
             // TODO: prefer variables that are used less often so that the stack ptr for example stays in a register
             size_t farthest_use_time = 0;
             REGISTER farthest_use_reg = REG_NONE;
+            auto lowest_cost = 0.f;
             for (size_t i = 0; i < REG_COUNT; ++i) {
-                if (((i == clear_regs) || ...)) { // NOLINT(clang-diagnostic-parentheses-equality)
+                if (((i == clear_regs) || ...) || is_reg_pinned(i)) { // NOLINT(clang-diagnostic-parentheses-equality)
                     continue;
                 }
 
@@ -2786,6 +3712,17 @@ template <bool evict_imms, typename... Args> REGISTER RegAlloc::alloc_reg(size_t
                     // var is needed in this step
                     continue;
                 }
+                if (use_weighted_eviction()) {
+                    // cheapest spill first, values that can be recomputed cost nothing
+                    const auto *var = reg_map[i].cur_var;
+                    const auto cost = ((evict_imms && var->is_immediate()) || can_remat_static(var)) ? 0.f : live_intervals->spill_weight(var);
+                    if (farthest_use_reg == REG_NONE || cost < lowest_cost || (cost == lowest_cost && farthest_use_time < next_use)) {
+                        lowest_cost = cost;
+                        farthest_use_time = next_use;
+                        farthest_use_reg = static_cast<REGISTER>(i);
+                    }
+                    continue;
+                }
                 if (farthest_use_time < next_use) {
                     farthest_use_time = next_use;
                     farthest_use_reg = static_cast<REGISTER>(i);
@@ -2805,7 +3742,7 @@ template <bool evict_imms, typename... Args> REGISTER RegAlloc::alloc_reg(size_t
     return reg;
 }
 
-template <typename... Args> FP_REGISTER RegAlloc::alloc_fp_reg(size_t cur_time, FP_REGISTER only_this_reg, Args... clear_regs) {
+template <typename... Args> FP_REGISTER RegAlloc::GroupContext::alloc_fp_reg(size_t cur_time, FP_REGISTER only_this_reg, Args... clear_regs) {
 
     static_assert((std::is_same_v<Args, FP_REGISTER> && ...));
     auto &reg_map = *cur_fp_reg_map;
@@ -2814,7 +3751,12 @@ template <typename... Args> FP_REGISTER RegAlloc::alloc_fp_reg(size_t cur_time,
         auto &cur_var = reg_map[only_this_reg].cur_var;
         if (cur_var != nullptr) {
             save_fp_reg(only_this_reg);
-            cur_var->gen_info.location = SSAVar::GeneratorInfoX64::STACK_FRAME;
+            if (can_remat_static(cur_var)) {
+                cur_var->gen_info.location = SSAVar::GeneratorInfoX64::STATIC;
+                cur_var->gen_info.static_idx = live_intervals->home_static(cur_var);
+            } else {
+                cur_var->gen_info.location = SSAVar::GeneratorInfoX64::STACK_FRAME;
+            }
             cur_var = nullptr;
         }
         return only_this_reg;
@@ -2851,6 +3793,7 @@ template <typename... Args> FP_REGISTER RegAlloc::alloc_fp_reg(size_t cur_time,
             // TODO: prefer variables that are used less often so that the stack ptr for example stays in a register
             size_t farthest_use_time = 0;
             FP_REGISTER farthest_use_reg = FP_REG_NONE;
+            auto lowest_cost = 0.f;
             for (size_t i = 0; i < FP_REG_COUNT; ++i) {
                 if (((i == clear_regs) || ...)) {
                     continue;
@@ -2873,6 +3816,17 @@ template <typename... Args> FP_REGISTER RegAlloc::alloc_fp_reg(size_t cur_time,
                     // var is needed in this step
                     continue;
                 }
+                if (use_weighted_eviction()) {
+                    // cheapest spill first, values that can be recomputed cost nothing
+                    const auto *var = reg_map[i].cur_var;
+                    const auto cost = (can_remat_static(var)) ? 0.f : live_intervals->spill_weight(var);
+                    if (farthest_use_reg == FP_REG_NONE || cost < lowest_cost || (cost == lowest_cost && farthest_use_time < next_use)) {
+                        lowest_cost = cost;
+                        farthest_use_time = next_use;
+                        farthest_use_reg = static_cast<FP_REGISTER>(i);
+                    }
+                    continue;
+                }
                 if (farthest_use_time < next_use) {
                     farthest_use_time = next_use;
                     farthest_use_reg = static_cast<FP_REGISTER>(i);
@@ -2892,7 +3846,7 @@ template <typename... Args> FP_REGISTER RegAlloc::alloc_fp_reg(size_t cur_time,
     return reg;
 }
 
-template <bool evict_imms, typename... Args> REGISTER RegAlloc::load_val_in_reg(size_t cur_time, SSAVar *var, REGISTER only_this_reg, Args... clear_regs) {
+template <bool evict_imms, typename... Args> REGISTER RegAlloc::GroupContext::load_val_in_reg(size_t cur_time, SSAVar *var, REGISTER only_this_reg, Args... clear_regs) {
     static_assert((std::is_same_v<Args, REGISTER> && ...));
     auto &reg_map = *cur_reg_map;
 
@@ -2902,7 +3856,7 @@ template <bool evict_imms, typename... Args> REGISTER RegAlloc::load_val_in_reg(
                 // clear_regs take precedent over only_this_reg though it should never happen
                 assert(((only_this_reg != clear_regs) && ...));
                 const auto new_reg = alloc_reg(cur_time, REG_NONE, clear_regs...);
-                print_asm("mov %s, %s\n", reg_names[new_reg][0], reg_names[var->gen_info.reg_idx][0]);
+                emit(mir::Opcode::MOV, mir::reg(new_reg), mir::reg(static_cast<REGISTER>(var->gen_info.reg_idx)));
                 reg_map[var->gen_info.reg_idx].cur_var = nullptr;
                 reg_map[new_reg].cur_var = var;
                 reg_map[new_reg].alloc_time = cur_time;
@@ -2924,7 +3878,7 @@ template <bool evict_imms, typename... Args> REGISTER RegAlloc::load_val_in_reg(
             save_reg(only_this_reg);
         }
         clear_reg(cur_time, only_this_reg);
-        print_asm("mov %s, %s\n", reg_names[only_this_reg][0], reg_names[var->gen_info.reg_idx][0]);
+        emit(mir::Opcode::MOV, mir::reg(only_this_reg), mir::reg(static_cast<REGISTER>(var->gen_info.reg_idx)));
         reg_map[var->gen_info.reg_idx].cur_var = nullptr;
         reg_map[only_this_reg].cur_var = var;
         var->gen_info.reg_idx = only_this_reg;
@@ -2936,17 +3890,17 @@ template <bool evict_imms, typename... Args> REGISTER RegAlloc::load_val_in_reg(
     if (var->is_immediate()) {
         auto &info = std::get<SSAVar::ImmInfo>(var->info);
         if (info.binary_relative) {
-            print_asm("lea %s, [binary + %ld]\n", reg_names[reg][0], info.val);
+            emit(mir::Opcode::LEA, mir::reg(reg), mir::binary(info.val));
         } else {
-            print_asm("mov %s, %ld\n", reg_names[reg][0], info.val);
+            emit(mir::Opcode::MOV, mir::reg(reg), mir::imm(info.val));
         }
     } else {
         // non-immediates should have been calculated before
         assert(var->gen_info.location != SSAVar::GeneratorInfoX64::NOT_CALCULATED);
         if (var->gen_info.location == SSAVar::GeneratorInfoX64::STATIC) {
-            print_asm("mov %s, [s%zu]\n", reg_name(reg, var->type), var->gen_info.static_idx);
+            emit(mir::Opcode::MOV, mir::reg(reg, var->type), static_op(var->gen_info.static_idx, var->type));
         } else {
-            print_asm("mov %s, [rsp + 8 * %zu]\n", reg_name(reg, var->type), var->gen_info.stack_slot);
+            emit(mir::Opcode::MOV, mir::reg(reg, var->type), mir::stack_slot(var->gen_info.stack_slot));
         }
     }
 
@@ -2956,7 +3910,7 @@ template <bool evict_imms, typename... Args> REGISTER RegAlloc::load_val_in_reg(
     return reg;
 }
 
-template <typename... Args> FP_REGISTER RegAlloc::load_val_in_fp_reg(size_t cur_time, SSAVar *var, FP_REGISTER only_this_reg, Args... clear_regs) {
+template <typename... Args> FP_REGISTER RegAlloc::GroupContext::load_val_in_fp_reg(size_t cur_time, SSAVar *var, FP_REGISTER only_this_reg, Args... clear_regs) {
     static_assert((std::is_same_v<Args, FP_REGISTER> && ...));
     auto &reg_map = *cur_fp_reg_map;
     assert(var->gen_info.location != SSAVar::GeneratorInfoX64::REGISTER);
@@ -2967,7 +3921,7 @@ template <typename... Args> FP_REGISTER RegAlloc::load_val_in_fp_reg(size_t cur_
                 // clear_regs take precedent over only_this_reg though it should never happen
                 assert(((only_this_reg != clear_regs) && ...));
                 const auto new_reg = alloc_fp_reg(cur_time, FP_REG_NONE, clear_regs...);
-                print_asm("movq %s, %s\n", fp_reg_names[new_reg], fp_reg_names[var->gen_info.reg_idx]);
+                emit(mir::Opcode::MOVQ, mir::fp_reg(new_reg), mir::fp_reg(static_cast<FP_REGISTER>(var->gen_info.reg_idx)));
                 reg_map[var->gen_info.reg_idx].cur_var = nullptr;
                 reg_map[new_reg].cur_var = var;
                 reg_map[new_reg].alloc_time = cur_time;
@@ -2990,7 +3944,7 @@ template <typename... Args> FP_REGISTER RegAlloc::load_val_in_fp_reg(size_t cur_
             save_fp_reg(only_this_reg);
         }
         clear_fp_reg(cur_time, only_this_reg);
-        print_asm("movq %s, %s\n", fp_reg_names[only_this_reg], fp_reg_names[var->gen_info.reg_idx]);
+        emit(mir::Opcode::MOVQ, mir::fp_reg(only_this_reg), mir::fp_reg(static_cast<FP_REGISTER>(var->gen_info.reg_idx)));
         reg_map[var->gen_info.reg_idx].cur_var = nullptr;
         reg_map[only_this_reg].cur_var = var;
         var->gen_info.reg_idx = only_this_reg;
@@ -3002,9 +3956,9 @@ template <typename... Args> FP_REGISTER RegAlloc::load_val_in_fp_reg(size_t cur_
     // non-immediates should have been calculated before
     assert(var->gen_info.location != SSAVar::GeneratorInfoX64::NOT_CALCULATED);
     if (var->gen_info.location == SSAVar::GeneratorInfoX64::STATIC) {
-        print_asm("movq %s, [s%zu]\n", fp_reg_names[reg], var->gen_info.static_idx);
+        emit(mir::Opcode::MOVQ, mir::fp_reg(reg), static_op(var->gen_info.static_idx));
     } else {
-        print_asm("movq %s, [rsp + 8 * %zu]\n", fp_reg_names[reg], var->gen_info.stack_slot);
+        emit(mir::Opcode::MOVQ, mir::fp_reg(reg), mir::stack_slot(var->gen_info.stack_slot));
     }
 
     reg_map[reg].cur_var = var;
@@ -3013,7 +3967,7 @@ template <typename... Args> FP_REGISTER RegAlloc::load_val_in_fp_reg(size_t cur_
     return reg;
 }
 
-void RegAlloc::clear_reg(size_t cur_time, REGISTER reg, bool imm_to_stack) {
+void RegAlloc::GroupContext::clear_reg(size_t cur_time, REGISTER reg, bool imm_to_stack) {
     auto &reg_map = *cur_reg_map;
     auto *var = reg_map[reg].cur_var;
     if (!var) {
@@ -3025,6 +3979,10 @@ void RegAlloc::clear_reg(size_t cur_time, REGISTER reg, bool imm_to_stack) {
         var->gen_info.location = SSAVar::GeneratorInfoX64::NOT_CALCULATED;
     } else if (var->gen_info.saved_in_stack) {
         var->gen_info.location = SSAVar::GeneratorInfoX64::STACK_FRAME;
+    } else if (can_remat_static(var)) {
+        // reloaded from the unmodified static
+        var->gen_info.location = SSAVar::GeneratorInfoX64::STATIC;
+        var->gen_info.static_idx = live_intervals->home_static(var);
     } else {
         // var that was never saved on stack and is not needed anymore
         // TODO: <?
@@ -3034,7 +3992,7 @@ void RegAlloc::clear_reg(size_t cur_time, REGISTER reg, bool imm_to_stack) {
     reg_map[reg].cur_var = nullptr;
 }
 
-void RegAlloc::clear_fp_reg(size_t cur_time, FP_REGISTER reg) {
+void RegAlloc::GroupContext::clear_fp_reg(size_t cur_time, FP_REGISTER reg) {
     auto &reg_map = *cur_fp_reg_map;
     auto *var = reg_map[reg].cur_var;
     if (!var) {
@@ -3043,6 +4001,10 @@ void RegAlloc::clear_fp_reg(size_t cur_time, FP_REGISTER reg) {
 
     if (var->gen_info.saved_in_stack) {
         var->gen_info.location = SSAVar::GeneratorInfoX64::STACK_FRAME;
+    } else if (can_remat_static(var)) {
+        // reloaded from the unmodified static
+        var->gen_info.location = SSAVar::GeneratorInfoX64::STATIC;
+        var->gen_info.static_idx = live_intervals->home_static(var);
     } else {
         // var that was never saved on stack and is not needed anymore
         assert(var->gen_info.last_use_time <= cur_time);
@@ -3051,7 +4013,7 @@ void RegAlloc::clear_fp_reg(size_t cur_time, FP_REGISTER reg) {
     reg_map[reg].cur_var = nullptr;
 }
 
-size_t RegAlloc::allocate_stack_slot(SSAVar *var) {
+size_t RegAlloc::GroupContext::allocate_stack_slot(SSAVar *var) {
     auto &stack_map = *cur_stack_map;
     // find slot for var
     size_t stack_slot = 0;
@@ -3075,7 +4037,7 @@ size_t RegAlloc::allocate_stack_slot(SSAVar *var) {
     return stack_slot;
 }
 
-void RegAlloc::save_reg(REGISTER reg, bool imm_to_stack) {
+void RegAlloc::GroupContext::save_reg(REGISTER reg, bool imm_to_stack) {
     auto &reg_map = *cur_reg_map;
 
     auto *var = reg_map[reg].cur_var;
@@ -3093,15 +4055,19 @@ void RegAlloc::save_reg(REGISTER reg, bool imm_to_stack) {
         return;
     }
 
+    if (can_remat_static(var)) {
+        return;
+    }
+
     // find slot for var
     size_t stack_slot = allocate_stack_slot(var);
 
-    print_asm("mov [rsp + 8 * %zu], %s\n", stack_slot, reg_name(reg, var->type));
+    emit(mir::Opcode::MOV, mir::stack_slot(stack_slot), mir::reg(reg, var->type));
     var->gen_info.saved_in_stack = true;
     var->gen_info.stack_slot = stack_slot;
 }
 
-void RegAlloc::save_fp_reg(FP_REGISTER reg) {
+void RegAlloc::GroupContext::save_fp_reg(FP_REGISTER reg) {
     auto &reg_map = *cur_fp_reg_map;
 
     auto *var = reg_map[reg].cur_var;
@@ -3114,16 +4080,20 @@ void RegAlloc::save_fp_reg(FP_REGISTER reg) {
         return;
     }
 
+    if (can_remat_static(var)) {
+        return;
+    }
+
     // find slot for var
     size_t stack_slot = allocate_stack_slot(var);
 
-    print_asm("movq [rsp + 8 * %zu], %s\n", stack_slot, fp_reg_names[reg]);
+    emit(mir::Opcode::MOVQ, mir::stack_slot(stack_slot), mir::fp_reg(reg));
 
     var->gen_info.saved_in_stack = true;
     var->gen_info.stack_slot = stack_slot;
 }
 
-void RegAlloc::clear_after_alloc_time(size_t alloc_time) {
+void RegAlloc::GroupContext::clear_after_alloc_time(size_t alloc_time) {
     // TODO: doesnt work
     auto &reg_map = *cur_reg_map;
     for (size_t i = 0; i < REG_COUNT; ++i) {
@@ -0,0 +1,237 @@
+#include <generator/x86_64/rounding.h>
+
+#include <array>
+#include <numeric>
+#include <optional>
+
+using namespace generator::x86_64::rounding;
+
+namespace {
+// these conversions can't lose precision, so the rounding mode doesn't matter
+bool is_exact_conversion(const Type from, const Type to) { return to == Type::f64 && (from == Type::f32 || from == Type::i32); }
+
+// state of MXCSR while the operations of a block are planned
+struct BlockScan {
+    enum State { ENTRY, KNOWN, UNKNOWN };
+
+    // mode the block would like to be entered with
+    std::optional<RoundingMode> entry_pref = std::nullopt;
+    State state = ENTRY;
+    RoundingMode mode = RoundingMode::NEAREST;
+
+    void scan(const BasicBlock *bb, const bool use_rounds) {
+        bool seen_requirement = false;
+        for (const auto &var : bb->variables) {
+            if (!std::holds_alternative<std::unique_ptr<Operation>>(var->info)) {
+                continue;
+            }
+            const auto req = requirement(std::get<std::unique_ptr<Operation>>(var->info).get(), use_rounds);
+            switch (req.kind) {
+            case Requirement::NONE:
+                continue;
+            case Requirement::STATIC:
+                state = KNOWN;
+                mode = req.mode;
+                break;
+            case Requirement::DEFAULT:
+                // after a dynamic rounding mode the generated code keeps it for the arithmetic
+                if (state != UNKNOWN) {
+                    state = KNOWN;
+                    mode = RoundingMode::NEAREST;
+                }
+                break;
+            case Requirement::DYNAMIC:
+                state = UNKNOWN;
+                break;
+            }
+            if (!seen_requirement && state == KNOWN) {
+                entry_pref = mode;
+            }
+            seen_requirement = true;
+        }
+    }
+
+    // mode the block would like to be left with
+    [[nodiscard]] std::optional<RoundingMode> exit_pref() const { return state == KNOWN ? std::optional<RoundingMode>{mode} : std::nullopt; }
+};
+
+size_t find_root(std::vector<size_t> &parents, size_t node) {
+    while (parents[node] != node) {
+        parents[node] = parents[parents[node]];
+        node = parents[node];
+    }
+    return node;
+}
+} // namespace
+
+namespace generator::x86_64::rounding {
+
+Requirement requirement(const Operation *op, const bool use_rounds) {
+    switch (op->type) {
+    case Instruction::add:
+    case Instruction::sub:
+        if (!op->out_vars[0] || !is_float(op->out_vars[0]->type)) {
+            return {};
+        }
+        return {Requirement::DEFAULT};
+    case Instruction::fmul:
+    case Instruction::fdiv:
+    case Instruction::fsqrt:
+    case Instruction::fmadd:
+    case Instruction::fmsub:
+    case Instruction::fnmadd:
+    case Instruction::fnmsub:
+        return {Requirement::DEFAULT};
+    case Instruction::convert:
+    case Instruction::uconvert: {
+        const auto from = op->in_vars[0]->type;
+        const auto to = op->out_vars[0]->type;
+        if (is_exact_conversion(from, to)) {
+            return {};
+        }
+        if (std::holds_alternative<RefPtr<SSAVar>>(op->rounding_info)) {
+            return {Requirement::DYNAMIC, RoundingMode::NEAREST, std::get<RefPtr<SSAVar>>(op->rounding_info).get()};
+        }
+        if (!std::holds_alternative<RoundingMode>(op->rounding_info)) {
+            return {Requirement::DEFAULT};
+        }
+        const auto mode = std::get<RoundingMode>(op->rounding_info);
+        if (is_float(from) && !is_float(to)) {
+            // cvtt truncates regardless of MXCSR, roundsd takes the mode as an immediate
+            if (mode == RoundingMode::ZERO || (use_rounds && op->type == Instruction::convert)) {
+                return {};
+            }
+        }
+        return {Requirement::STATIC, mode};
+    }
+    default:
+        return {};
+    }
+}
+
+uint32_t mxcsr_bits(const RoundingMode mode) {
+    switch (mode) {
+    case RoundingMode::NEAREST:
+        return 0x0000;
+    case RoundingMode::DOWN:
+        return 0x2000;
+    case RoundingMode::UP:
+        return 0x4000;
+    case RoundingMode::ZERO:
+        return 0x6000;
+    }
+    return 0x0000;
+}
+
+/* Every block gets a mode it's entered with and one it's left with. Boundaries which are crossed by anything but a jump
+ * inside the group (the group's entry, calls, syscalls and indirect jumps) are fixed to round-to-nearest. The remaining
+ * boundaries connected by jumps are merged into classes which all get the same mode, the mode most of their blocks want.
+ * Jumps from or to a fixed boundary and out of the group switch the mode on the edge if necessary, so e.g. a loop which
+ * converts with rdn switches MXCSR once before it's entered and once when it's left.
+ */
+void GroupPlan::build(const std::vector<BasicBlock *> &blocks, const bool use_rounds) {
+    const size_t block_count = blocks.size();
+    block_idxs.clear();
+    for (size_t i = 0; i < block_count; ++i) {
+        block_idxs[blocks[i]->id] = i;
+    }
+
+    // node 2 * i is the entry of block i, 2 * i + 1 its exit
+    std::vector<size_t> parents(2 * block_count);
+    std::iota(parents.begin(), parents.end(), 0);
+    std::vector<bool> fixed(2 * block_count, false);
+    std::vector<std::array<size_t, 4>> votes(2 * block_count, std::array<size_t, 4>{});
+
+    const auto group_idx = [this](const BasicBlock *bb) {
+        const auto it = (bb ? block_idxs.find(bb->id) : block_idxs.end());
+        return it == block_idxs.end() ? SIZE_MAX : it->second;
+    };
+
+    const auto is_jump = [](const CfOp &cf_op) { return cf_op.type == CFCInstruction::jump || cf_op.type == CFCInstruction::cjump; };
+
+    if (block_count != 0) {
+        fixed[0] = true;
+    }
+    for (size_t i = 0; i < block_count; ++i) {
+        const auto *bb = blocks[i];
+        if (bb->gen_info.call_cont_block) {
+            fixed[2 * i] = true;
+        }
+        if (bb->control_flow_ops.empty()) {
+            fixed[2 * i + 1] = true;
+        }
+
+        for (const auto &cf_op : bb->control_flow_ops) {
+            if (is_jump(cf_op)) {
+                continue;
+            }
+
+            fixed[2 * i + 1] = true;
+            // blocks entered after a call or a syscall
+            if (const auto target_idx = group_idx(cf_op.target()); target_idx != SIZE_MAX) {
+                fixed[2 * target_idx] = true;
+            }
+            if (cf_op.type == CFCInstruction::call || cf_op.type == CFCInstruction::icall) {
+                const auto *cont_block = cf_op.type == CFCInstruction::call ? std::get<CfOp::CallInfo>(cf_op.info).continuation_block : std::get<CfOp::ICallInfo>(cf_op.info).continuation_block;
+                if (const auto cont_idx = group_idx(cont_block); cont_idx != SIZE_MAX) {
+                    fixed[2 * cont_idx] = true;
+                }
+            }
+        }
+
+        BlockScan scan;
+        scan.scan(bb, use_rounds);
+        if (scan.entry_pref) {
+            votes[2 * i][static_cast<size_t>(*scan.entry_pref)]++;
+        }
+        if (const auto exit_pref = scan.exit_pref(); exit_pref) {
+            votes[2 * i + 1][static_cast<size_t>(*exit_pref)]++;
+        }
+    }
+
+    // a jump between boundaries which are fixed to round-to-nearest and the others switches the mode itself
+    for (size_t i = 0; i < block_count; ++i) {
+        if (fixed[2 * i + 1]) {
+            continue;
+        }
+        for (const auto &cf_op : blocks[i]->control_flow_ops) {
+            const auto target_idx = group_idx(cf_op.target());
+            if (is_jump(cf_op) && target_idx != SIZE_MAX && !fixed[2 * target_idx]) {
+                parents[find_root(parents, 2 * target_idx)] = find_root(parents, 2 * i + 1);
+            }
+        }
+    }
+
+    std::vector<bool> class_fixed(2 * block_count, false);
+    std::vector<std::array<size_t, 4>> class_votes(2 * block_count, std::array<size_t, 4>{});
+    for (size_t node = 0; node < 2 * block_count; ++node) {
+        const auto root = find_root(parents, node);
+        class_fixed[root] = class_fixed[root] || fixed[node];
+        for (size_t mode = 0; mode < 4; ++mode) {
+            class_votes[root][mode] += votes[node][mode];
+        }
+    }
+
+    const auto class_mode = [&](const size_t node) {
+        const auto root = find_root(parents, node);
+        auto best = RoundingMode::NEAREST;
+        if (class_fixed[root]) {
+            return best;
+        }
+        for (size_t mode = 0; mode < 4; ++mode) {
+            if (class_votes[root][mode] > class_votes[root][static_cast<size_t>(best)]) {
+                best = static_cast<RoundingMode>(mode);
+            }
+        }
+        return best;
+    };
+
+    entry_modes.resize(block_count);
+    exit_modes.resize(block_count);
+    for (size_t i = 0; i < block_count; ++i) {
+        entry_modes[i] = class_mode(2 * i);
+        exit_modes[i] = class_mode(2 * i + 1);
+    }
+}
+
+} // namespace generator::x86_64::rounding
@@ -0,0 +1,174 @@
+#include <generator/x86_64/static_liveness.h>
+
+using namespace generator::x86_64::liveness;
+
+namespace {
+struct Edge {
+    // nullptr if the edge can go anywhere
+    const BasicBlock *target = nullptr;
+    bool dead_end = false;
+    // statics written by the edge's mapping
+    std::vector<bool> written;
+    // (source static, destination static) for values that are passed through unchanged
+    std::vector<std::pair<size_t, size_t>> copies;
+};
+
+struct Summary {
+    // statics whose value at block entry is read by an operation or a cfop argument
+    std::vector<bool> read;
+    std::vector<Edge> edges;
+};
+
+void add_mapping_entry(Edge &edge, const SSAVar *src, const size_t dst_static) {
+    edge.written[dst_static] = true;
+    if (std::holds_alternative<size_t>(src->info)) {
+        edge.copies.emplace_back(std::get<size_t>(src->info), dst_static);
+    }
+}
+
+Edge build_edge(const CfOp &cf_op, const size_t static_count) {
+    Edge edge;
+    edge.written.assign(static_count, false);
+
+    switch (cf_op.type) {
+    case CFCInstruction::jump:
+    case CFCInstruction::cjump:
+    case CFCInstruction::call: {
+        const auto *target = cf_op.target();
+        const auto &target_inputs = cf_op.target_inputs();
+        edge.target = target;
+        for (size_t i = 0; i < target->inputs.size() && i < target_inputs.size(); ++i) {
+            if (!std::holds_alternative<size_t>(target->inputs[i]->info)) {
+                // the generators do not handle blocks with non-static inputs, so don't make any assumptions about them
+                edge.target = nullptr;
+                continue;
+            }
+            add_mapping_entry(edge, target_inputs[i], std::get<size_t>(target->inputs[i]->info));
+        }
+        break;
+    }
+    case CFCInstruction::syscall: {
+        const auto &info = std::get<CfOp::SyscallInfo>(cf_op.info);
+        for (const auto &[var, static_idx] : info.continuation_mapping) {
+            add_mapping_entry(edge, var.get(), static_idx);
+        }
+        for (const auto static_idx : info.static_mapping) {
+            edge.written[static_idx] = true;
+        }
+        break;
+    }
+    case CFCInstruction::_return:
+        for (const auto &[var, static_idx] : std::get<CfOp::RetInfo>(cf_op.info).mapping) {
+            add_mapping_entry(edge, var.get(), static_idx);
+        }
+        break;
+    case CFCInstruction::ijump:
+        for (const auto &[var, static_idx] : std::get<CfOp::IJumpInfo>(cf_op.info).mapping) {
+            add_mapping_entry(edge, var.get(), static_idx);
+        }
+        break;
+    case CFCInstruction::icall:
+        for (const auto &[var, static_idx] : std::get<CfOp::ICallInfo>(cf_op.info).mapping) {
+            add_mapping_entry(edge, var.get(), static_idx);
+        }
+        break;
+    case CFCInstruction::unreachable:
+        // panics, nothing is read afterwards
+        edge.dead_end = true;
+        break;
+    }
+    return edge;
+}
+
+Summary build_summary(const BasicBlock *bb, const size_t static_count) {
+    Summary summary;
+    summary.read.assign(static_count, false);
+    const auto mark_read = [&summary](const SSAVar *var) {
+        if (var && std::holds_alternative<size_t>(var->info)) {
+            summary.read[std::get<size_t>(var->info)] = true;
+        }
+    };
+
+    for (const auto &var : bb->variables) {
+        if (var->type == Type::mt && std::holds_alternative<size_t>(var->info)) {
+            // the memory token is not a value, never try to reason about it
+            summary.read[std::get<size_t>(var->info)] = true;
+        }
+        if (!std::holds_alternative<std::unique_ptr<Operation>>(var->info)) {
+            continue;
+        }
+        for (const auto &in_var : std::get<std::unique_ptr<Operation>>(var->info)->in_vars) {
+            mark_read(in_var.get());
+        }
+    }
+
+    for (const auto &cf_op : bb->control_flow_ops) {
+        for (const auto &in_var : cf_op.in_vars) {
+            mark_read(in_var.get());
+        }
+        summary.edges.push_back(build_edge(cf_op, static_count));
+    }
+    return summary;
+}
+} // namespace
+
+void StaticLiveness::build() {
+    const size_t static_count = ir->statics.size();
+    live_in.assign(ir->cur_block_id, std::vector<bool>(static_count, false));
+
+    std::vector<std::pair<const BasicBlock *, Summary>> summaries;
+    summaries.reserve(ir->basic_blocks.size());
+    for (const auto &bb : ir->basic_blocks) {
+        summaries.emplace_back(bb.get(), build_summary(bb.get(), static_count));
+    }
+
+    // iterate backwards to the fixpoint, blocks are mostly stored in program order so this converges quickly
+    std::vector<bool> cur_live(static_count);
+    auto changed = true;
+    while (changed) {
+        changed = false;
+        for (auto it = summaries.rbegin(); it != summaries.rend(); ++it) {
+            const auto &[bb, summary] = *it;
+            cur_live = summary.read;
+            for (const auto &edge : summary.edges) {
+                if (edge.dead_end) {
+                    continue;
+                }
+
+                const auto is_live_after = [this, &edge](const size_t static_idx) { return edge.target == nullptr || live_in[edge.target->id][static_idx]; };
+                for (size_t i = 0; i < static_count; ++i) {
+                    // statics not touched by the mapping keep their value
+                    if (!edge.written[i] && is_live_after(i)) {
+                        cur_live[i] = true;
+                    }
+                }
+                for (const auto &[src, dst] : edge.copies) {
+                    if (is_live_after(dst)) {
+                        cur_live[src] = true;
+                    }
+                }
+            }
+
+            if (cur_live != live_in[bb->id]) {
+                // liveness only grows, so this terminates
+                live_in[bb->id] = cur_live;
+                changed = true;
+            }
+        }
+    }
+
+    live_out.assign(ir->cur_block_id, std::vector<bool>(static_count, false));
+    for (const auto &[bb, summary] : summaries) {
+        auto &out = live_out[bb->id];
+        for (const auto &edge : summary.edges) {
+            if (edge.dead_end) {
+                continue;
+            }
+            for (size_t i = 0; i < static_count; ++i) {
+                if (edge.target == nullptr || live_in[edge.target->id][i]) {
+                    out[i] = true;
+                }
+            }
+        }
+    }
+}
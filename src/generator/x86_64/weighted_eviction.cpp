@@ -0,0 +1,173 @@
+#include <generator/x86_64/weighted_eviction.h>
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+
+using namespace generator::x86_64::weighted_eviction;
+
+namespace {
+// deeper nesting doesn't make a difference for the spill decisions but could overflow the weight
+constexpr size_t MAX_LOOP_DEPTH = 3;
+
+template <typename Func> void for_each_cf_use(const CfOp &cf_op, Func &&func) {
+    for (const auto &input : cf_op.in_vars) {
+        if (input) {
+            func(input.get());
+        }
+    }
+
+    const auto mapping_uses = [&func](const std::vector<std::pair<RefPtr<SSAVar>, size_t>> &mapping) {
+        for (const auto &pair : mapping) {
+            func(pair.first.get());
+        }
+    };
+    switch (cf_op.type) {
+    case CFCInstruction::jump:
+    case CFCInstruction::cjump:
+    case CFCInstruction::call:
+        for (auto *input : cf_op.target_inputs()) {
+            func(input);
+        }
+        break;
+    case CFCInstruction::ijump:
+        mapping_uses(std::get<CfOp::IJumpInfo>(cf_op.info).mapping);
+        break;
+    case CFCInstruction::icall:
+        mapping_uses(std::get<CfOp::ICallInfo>(cf_op.info).mapping);
+        break;
+    case CFCInstruction::_return:
+        mapping_uses(std::get<CfOp::RetInfo>(cf_op.info).mapping);
+        break;
+    case CFCInstruction::syscall:
+        mapping_uses(std::get<CfOp::SyscallInfo>(cf_op.info).continuation_mapping);
+        break;
+    case CFCInstruction::unreachable:
+        break;
+    }
+}
+} // namespace
+
+void LiveIntervals::build() {
+    intervals.clear();
+    block_starts.clear();
+    var_intervals.clear();
+    find_loops();
+
+    size_t pos = 0;
+    for (auto *bb : blocks) {
+        block_starts.push_back(pos);
+        pos += bb->variables.size() + bb->control_flow_ops.size();
+    }
+
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        add_block(i);
+    }
+}
+
+size_t LiveIntervals::loop_depth(const BasicBlock *bb) const {
+    const auto it = std::find(blocks.begin(), blocks.end(), bb);
+    if (it == blocks.end()) {
+        return 0;
+    }
+    return loop_depths[std::distance(blocks.begin(), it)];
+}
+
+float LiveIntervals::spill_weight(const SSAVar *var) const {
+    const auto it = var_intervals.find(var);
+    return it == var_intervals.end() ? 0.f : intervals[it->second].weight;
+}
+
+size_t LiveIntervals::home_static(const SSAVar *var) const {
+    const auto it = var_intervals.find(var);
+    return it == var_intervals.end() ? SIZE_MAX : intervals[it->second].home_static;
+}
+
+void LiveIntervals::set_home_static(const SSAVar *var, const size_t static_idx) {
+    const auto it = var_intervals.find(var);
+    if (it != var_intervals.end()) {
+        intervals[it->second].home_static = static_idx;
+    }
+}
+
+void LiveIntervals::find_loops() {
+    // the group order is a depth-first order, so a jump to a block at or before the current one closes a loop that
+    // contains all blocks in between. That overestimates loops with side exits but is good enough for spill weights
+    loop_depths.assign(blocks.size(), 0);
+    auto group_idx = std::unordered_map<const BasicBlock *, size_t>{};
+    for (size_t i = 0; i < blocks.size(); ++i) {
+        group_idx.emplace(blocks[i], i);
+    }
+
+    for (size_t latch = 0; latch < blocks.size(); ++latch) {
+        for (const auto &cf_op : blocks[latch]->control_flow_ops) {
+            const auto it = group_idx.find(cf_op.target());
+            if (it == group_idx.end() || it->second > latch) {
+                continue;
+            }
+            for (auto i = it->second; i <= latch; ++i) {
+                loop_depths[i] = std::min(loop_depths[i] + 1, MAX_LOOP_DEPTH);
+            }
+        }
+    }
+}
+
+void LiveIntervals::add_block(const size_t block_idx) {
+    auto *bb = blocks[block_idx];
+    const auto base = block_starts[block_idx];
+    const auto first = intervals.size();
+
+    const auto use = [this, first](const SSAVar *var, const size_t pos) {
+        const auto it = var_intervals.find(var);
+        if (it == var_intervals.end() || it->second < first) {
+            // defined in another block
+            return;
+        }
+        auto &interval = intervals[it->second];
+        interval.end = std::max(interval.end, pos);
+        ++interval.use_count;
+    };
+
+    for (size_t i = 0; i < bb->variables.size(); ++i) {
+        auto *var = bb->variables[i].get();
+        if (var->type == Type::mt) {
+            continue;
+        }
+        auto interval = Interval{};
+        interval.var = var;
+        interval.bb = bb;
+        // inputs are live from the block's start
+        interval.start = interval.end = (std::holds_alternative<size_t>(var->info) ? base : base + i);
+        interval.loop_depth = loop_depths[block_idx];
+        interval.remat = var->is_immediate();
+        var_intervals.emplace(var, intervals.size());
+        intervals.push_back(interval);
+    }
+
+    for (size_t i = 0; i < bb->variables.size(); ++i) {
+        auto *var = bb->variables[i].get();
+        if (!std::holds_alternative<std::unique_ptr<Operation>>(var->info)) {
+            continue;
+        }
+        const auto *op = std::get<std::unique_ptr<Operation>>(var->info).get();
+        for (const auto &input : op->in_vars) {
+            if (input) {
+                use(input.get(), base + i);
+            }
+        }
+        if (std::holds_alternative<RefPtr<SSAVar>>(op->rounding_info)) {
+            use(std::get<RefPtr<SSAVar>>(op->rounding_info).get(), base + i);
+        }
+    }
+
+    const auto cf_base = base + bb->variables.size();
+    for (size_t i = 0; i < bb->control_flow_ops.size(); ++i) {
+        for_each_cf_use(bb->control_flow_ops[i], [&use, cf_base, i](const SSAVar *var) { use(var, cf_base + i); });
+    }
+
+    for (auto i = first; i < intervals.size(); ++i) {
+        auto &interval = intervals[i];
+        const auto length = static_cast<float>(interval.end - interval.start + 1);
+        interval.weight = static_cast<float>(interval.use_count) * std::pow(10.f, static_cast<float>(interval.loop_depth)) / length;
+    }
+}
@@ -116,6 +116,21 @@ std::ostream &operator<<(std::ostream &stream, Instruction instr) {
     case Instruction::uconvert:
         stream << "uconvert";
         break;
+    case Instruction::atomic_rmw:
+        stream << "atomic_rmw";
+        break;
+    case Instruction::cas:
+        stream << "cas";
+        break;
+    case Instruction::load_reserved:
+        stream << "load_reserved";
+        break;
+    case Instruction::reservation:
+        stream << "reservation";
+        break;
+    case Instruction::fence:
+        stream << "fence";
+        break;
     }
     return stream;
 }
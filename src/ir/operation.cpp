@@ -56,6 +56,17 @@ void Operation::print(std::ostream &stream, const IR *ir) const {
     } else if (std::holds_alternative<RoundingMode>(rounding_info)) {
         stream << "(rm = " << static_cast<uint32_t>(std::get<RoundingMode>(rounding_info)) << ")";
     }
+    if (type == Instruction::atomic_rmw) {
+        stream << "(op = " << atomic_info.rmw_op << ")";
+    } else if (type == Instruction::fence) {
+        stream << "(pred = " << static_cast<uint32_t>(atomic_info.pred) << ", succ = " << static_cast<uint32_t>(atomic_info.succ) << ")";
+    }
+    if (atomic_info.acquire) {
+        stream << " aq";
+    }
+    if (atomic_info.release) {
+        stream << " rl";
+    }
 }
 
 namespace {
@@ -74,12 +74,33 @@ Type resolve_simple_op_type(const Operation &op, [[maybe_unused]] size_t block_i
 #endif
 }
 
+size_t type_byte_size(Type type) {
+    switch (type) {
+    case Type::i64:
+    case Type::f64:
+        return 8;
+    case Type::i32:
+    case Type::f32:
+        return 4;
+    case Type::i16:
+        return 2;
+    case Type::i8:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
 class ConstFoldPass {
     VarRewriter rewrite;
     BasicBlock *current_block;
     size_t var_index;
+    const IR *ir;
+    const ReadOnlyMemory *ro_memory;
 
   public:
+    ConstFoldPass(const IR *ir, const ReadOnlyMemory *ro_memory) : ir(ir), ro_memory(ro_memory) {}
+
     void process_block(BasicBlock *block);
 
   private:
@@ -112,6 +133,9 @@ class ConstFoldPass {
     /** Simplify an operation with an immediate on the right and an operation on the left */
     std::optional<BinOp> simplify_double_op_imm_right(Type type, Instruction cins, const SSAVar::ImmInfo &imm, Instruction pins, SSAVar *pa, SSAVar *pb);
 
+    /** Replace a load from read-only memory with its value */
+    void fold_ro_load(SSAVar *var, Operation &op);
+
     void fixup_block();
 };
 
@@ -562,6 +586,35 @@ void ConstFoldPass::simplify_morph(Instruction insn, Type in_type, SSAVar *in_va
     }
 }
 
+void ConstFoldPass::fold_ro_load(SSAVar *var, Operation &op) {
+    auto &addr = op.in_vars[0];
+    if (!ro_memory || !addr->is_immediate()) {
+        return;
+    }
+    const auto size = type_byte_size(var->type);
+    if (size == 0) {
+        return;
+    }
+
+    const auto &addr_imm = addr->get_immediate();
+    const auto virt_addr = static_cast<uint64_t>(addr_imm.val) + (addr_imm.binary_relative ? ir->base_addr : 0);
+    const auto value = ro_memory->read(virt_addr, size);
+    if (!value) {
+        return;
+    }
+
+    if (is_float(var->type)) {
+        // there are no floating point immediates, so load the bits as an integer and move them over
+        const auto int_type = (var->type == Type::f64) ? Type::i64 : Type::i32;
+        auto *bits = new_imm(int_type, *value);
+        op.type = Instruction::cast;
+        op.lifter_info.in_op_size = int_type;
+        op.set_inputs(bits);
+    } else {
+        replace_with_immediate(var, *value);
+    }
+}
+
 void ConstFoldPass::process_block(BasicBlock *block) {
     rewrite = {};
     current_block = block;
@@ -710,6 +763,9 @@ void ConstFoldPass::process_block(BasicBlock *block) {
                 int64_t result = op.out_vars[0] ? div_result : rem_result;
                 replace_with_immediate(var, result);
             }
+        } else if (op.type == Instruction::load) {
+            // load [ro_addr]
+            fold_ro_load(var, op);
         } else if (is_conditional_set(op.type)) {
             auto &a = op.in_vars[0], &b = op.in_vars[1], &val_if_true = op.in_vars[2], &val_if_false = op.in_vars[3];
             if (!can_handle_types({a->type, b->type}))
@@ -771,8 +827,25 @@ void ConstFoldPass::fixup_block() {
 
 } // namespace
 
-void const_fold(IR *ir) {
-    ConstFoldPass pass;
+std::optional<uint64_t> ReadOnlyMemory::read(const uint64_t addr, const size_t size) const {
+    assert(size <= sizeof(uint64_t));
+    for (const auto &segment : segments) {
+        if (addr < segment.start || addr - segment.start > segment.size || segment.size - (addr - segment.start) < size) {
+            continue;
+        }
+
+        uint64_t value = 0;
+        const auto *bytes = segment.data + (addr - segment.start);
+        for (size_t i = 0; i < size; ++i) {
+            value |= static_cast<uint64_t>(bytes[i]) << (i * 8);
+        }
+        return value;
+    }
+    return std::nullopt;
+}
+
+void const_fold(IR *ir, const ReadOnlyMemory *ro_memory) {
+    ConstFoldPass pass{ir, ro_memory};
     for (auto &bb : ir->basic_blocks) {
         pass.process_block(bb.get());
     }
@@ -278,7 +278,7 @@ void dce(IR *ir) {
         for (size_t i = bb->variables.size(); i > 0; i--) {
             const auto *var = bb->variables[i - 1].get();
 
-            if (var->is_operation() && (var->get_operation().type == Instruction::store || track_buf[var->id])) {
+            if (var->is_operation() && (has_side_effects(var->get_operation().type) || track_buf[var->id])) {
                 for (auto &in : var->get_operation().in_vars) {
                     if (in) {
                         track_buf[in->id] = true;
@@ -289,7 +289,10 @@ void dce(IR *ir) {
             if (var->ref_count == 0) {
                 if (var->is_static())
                     continue;
-                if (var->is_operation() && var->get_operation().type == Instruction::store)
+                // secondary outputs (e.g. the memory token of an atomic) are owned by the op of another var
+                if (var->is_uninitialized())
+                    continue;
+                if (var->is_operation() && has_side_effects(var->get_operation().type))
                     continue;
 
                 bb->variables.erase(std::next(bb->variables.begin(), i - 1));
@@ -374,7 +377,7 @@ void dce(IR *ir) {
             const auto *var = var_visit.front();
             var_visit.pop();
 
-            // `store`s have already been marked
+            // `store`s and the other ops with side effects have already been marked
             if (var->is_operation()) {
                 auto &op = var->get_operation();
 
@@ -454,7 +457,9 @@ void dce(IR *ir) {
             const auto *var = block->variables[i - 1].get();
 
             if (var->ref_count == 0 && !side_effects[var->id]) {
-                if (var->is_operation() && var->get_operation().type == Instruction::store)
+                if (var->is_operation() && has_side_effects(var->get_operation().type))
+                    continue;
+                if (var->is_uninitialized())
                     continue;
 
                 block->variables.erase(std::next(block->variables.begin(), i - 1));
@@ -110,9 +110,12 @@ void dedup(IR *ir) {
                 rw.apply_to(var->get_operation());
 
                 auto insn = var->get_operation().type;
-                if (insn == Instruction::store || insn == Instruction::load) {
+                if (insn == Instruction::load || insn == Instruction::reservation || has_side_effects(insn)) {
                     continue;
                 }
+            } else if (var->is_uninitialized()) {
+                // secondary output of the op of another var
+                continue;
             }
 
             auto replacement = vars.find(VarMeta(var));
@@ -103,6 +103,56 @@ TEST(TestConstFolding, test_simplify_double_morph) {
     ASSERT_EQ(op.type, Instruction::cast);
 }
 
+TEST(TestConstFolding, test_ro_load) {
+    IR ir;
+    ir.add_static(Type::mt);
+    auto *bb = ir.add_basic_block();
+
+    const uint8_t rodata[] = {0x01, 0x02, 0x03, 0xF4, 0x00, 0x00, 0xF0, 0x3F};
+    ReadOnlyMemory ro_memory;
+    ro_memory.segments.push_back({0x1000, rodata, sizeof(rodata)});
+
+    auto *mt = bb->add_var_from_static(0);
+    auto *addr = bb->add_var_imm(0x1002, 0);
+    addr->type = Type::i64;
+    auto *a = bb->add_var(Type::i16, 1);
+    a->set_op(Operation::new_load(a, addr, mt));
+
+    auto *b = bb->add_var(Type::i64, 2);
+    b->set_op(Operation::new_sign_extend(b, a));
+
+    auto *addr2 = bb->add_var_imm(0x1000, 3);
+    addr2->type = Type::i64;
+    auto *c = bb->add_var(Type::f64, 4);
+    c->set_op(Operation::new_load(c, addr2, mt));
+
+    // partially outside of the segment
+    auto *addr3 = bb->add_var_imm(0x1004, 5);
+    addr3->type = Type::i64;
+    auto *d = bb->add_var(Type::i64, 6);
+    d->set_op(Operation::new_load(d, addr3, mt));
+
+    assert_valid(ir);
+
+    const_fold(&ir, &ro_memory);
+
+    assert_valid(ir);
+
+    ASSERT_TRUE(a->is_immediate());
+    ASSERT_EQ(a->get_immediate().val, 0xF403);
+    ASSERT_TRUE(b->is_immediate());
+    ASSERT_EQ(b->get_immediate().val, (int64_t)(int16_t)0xF403);
+
+    ASSERT_TRUE(c->is_operation());
+    auto &op = c->get_operation();
+    ASSERT_EQ(op.type, Instruction::cast);
+    ASSERT_TRUE(op.in_vars[0]->is_immediate());
+    ASSERT_EQ((uint64_t)op.in_vars[0]->get_immediate().val, 0x3FF00000F4030201ull);
+
+    ASSERT_TRUE(d->is_operation());
+    ASSERT_EQ(d->get_operation().type, Instruction::load);
+}
+
 enum class Side {
     Any,
     Left,
@@ -5,6 +5,8 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
+
 using namespace optimizer;
 
 TEST(TestDce, dce_removes_variables) {
@@ -20,6 +22,48 @@ TEST(TestDce, dce_removes_variables) {
     ASSERT_TRUE(bb->variables.empty());
 }
 
+TEST(TestDce, dce_keeps_atomics) {
+    IR ir;
+    const auto addr_static = ir.add_static(Type::i64);
+    const auto mem_static = ir.add_static(Type::mt);
+    auto *bb = ir.add_basic_block();
+
+    auto *addr = bb->add_var_from_static(addr_static, 0);
+    auto *mt = bb->add_var_from_static(mem_static, 0);
+    auto *val = bb->add_var_imm(1, 0);
+
+    // the loaded value isn't needed, the results and memory token of the atomic and the token of the fence aren't either
+    auto *loaded = bb->add_var(Type::i64, 1);
+    loaded->set_op(Operation::new_load(loaded, addr, mt));
+
+    auto *old_val = bb->add_var(Type::i64, 2);
+    auto *rmw_token = bb->add_var(Type::mt, 2);
+    {
+        auto op = std::make_unique<Operation>(Instruction::atomic_rmw);
+        op->atomic_info.rmw_op = Instruction::add;
+        op->set_inputs(addr, val, mt);
+        op->set_outputs(old_val, rmw_token);
+        old_val->set_op(std::move(op));
+    }
+
+    auto *fenced = bb->add_var(Type::mt, 3);
+    {
+        auto op = std::make_unique<Operation>(Instruction::fence);
+        op->set_inputs(mt);
+        op->set_outputs(fenced);
+        fenced->set_op(std::move(op));
+    }
+
+    dce(&ir);
+
+    assert_valid(ir);
+    const auto has_var = [bb](const SSAVar *var) { return std::any_of(bb->variables.begin(), bb->variables.end(), [var](const auto &v) { return v.get() == var; }); };
+    ASSERT_FALSE(has_var(loaded));
+    ASSERT_TRUE(has_var(old_val));
+    ASSERT_TRUE(has_var(rmw_token));
+    ASSERT_TRUE(has_var(fenced));
+}
+
 TEST(TestDedupImm, deduplicates_immediate) {
     IR ir;
     auto *bb = ir.add_basic_block();
@@ -42,3 +86,36 @@ TEST(TestDedupImm, deduplicates_immediate) {
     // the duplicate should be removed
     ASSERT_EQ(bb->variables.size(), 2);
 }
+
+TEST(TestDedupImm, keeps_atomic_memory_token) {
+    IR ir;
+    const auto addr_static = ir.add_static(Type::i64);
+    const auto mem_static = ir.add_static(Type::mt);
+    auto *bb = ir.add_basic_block();
+
+    auto *addr = bb->add_var_from_static(addr_static, 0);
+    auto *mt = bb->add_var_from_static(mem_static, 0);
+    auto *a = bb->add_var_imm(1, 0);
+
+    auto *old_val = bb->add_var(Type::i64, 1);
+    auto *rmw_token = bb->add_var(Type::mt, 1);
+    {
+        auto op = std::make_unique<Operation>(Instruction::atomic_rmw);
+        op->atomic_info.rmw_op = Instruction::add;
+        op->set_inputs(addr, a, mt);
+        op->set_outputs(old_val, rmw_token);
+        old_val->set_op(std::move(op));
+    }
+
+    // the load is ordered after the atomic by its memory token
+    auto *b = bb->add_var_imm(1, 2);
+    auto *loaded = bb->add_var(Type::i64, 2);
+    loaded->set_op(Operation::new_load(loaded, addr, rmw_token));
+
+    dedup(&ir);
+
+    assert_valid(ir);
+    ASSERT_EQ(loaded->get_operation().in_vars[1].get(), rmw_token);
+    ASSERT_EQ(std::find_if(bb->variables.begin(), bb->variables.end(), [b](const auto &v) { return v.get() == b; }), bb->variables.end());
+    ASSERT_EQ(bb->variables.size(), 6);
+}
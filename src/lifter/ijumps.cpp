@@ -53,3 +53,30 @@ void Lifter::process_ijumps(std::vector<CfOp *> &unprocessed_ijumps, ELF64File *
         }
     }
 }
+
+void Lifter::process_ijump_hints(const Program *prog) {
+    for (const uint64_t jmp_addr : ijump_hints) {
+        // hints come from runs of an earlier translation, the binary could have changed since then
+        const auto it = std::lower_bound(prog->addrs.begin(), prog->addrs.end(), jmp_addr);
+        if (it == prog->addrs.end() || *it != jmp_addr) {
+            DEBUG_LOG("Indirect jump hint outside of the loaded instructions, skipping.");
+            continue;
+        }
+        const auto &entry = prog->data[it - prog->addrs.begin()];
+        if (!std::holds_alternative<RV64Inst>(entry) || std::get<RV64Inst>(entry).instr.mnem == FRV_INVALID) {
+            DEBUG_LOG("Indirect jump hint doesn't point to a valid instruction, skipping.");
+            continue;
+        }
+
+        BasicBlock *jump_bb = get_bb(jmp_addr);
+        if (jump_bb == nullptr) {
+            DEBUG_LOG("Couldn't find a basic block at an indirect jump hint, skipping.");
+            continue;
+        }
+        if (jump_bb->virt_start_addr != jmp_addr) {
+            jump_bb = split_basic_block(jump_bb, jmp_addr, prog->elf_base.get());
+        }
+        // the block at the hinted address has to be reachable from the ijump lookup
+        jump_bb->gen_info.needs_trans_bb = true;
+    }
+}
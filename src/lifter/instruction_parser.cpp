@@ -186,7 +186,7 @@ void Lifter::parse_instruction(BasicBlock *bb, const RV64Inst &instr, reg_map &m
 
     case FRV_FENCE:
     case FRV_FENCEI:
-        lift_fence(bb, instr, ip);
+        lift_fence(bb, instr, mapping, ip);
         break;
 
     case FRV_AUIPC:
@@ -585,10 +585,32 @@ void Lifter::lift_lui(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, u
     write_to_mapping(mapping, immediate, instr.instr.rd);
 }
 
-void Lifter::lift_fence([[maybe_unused]] BasicBlock *bb, [[maybe_unused]] const RV64Inst &instr, [[maybe_unused]] uint64_t ip) {
-    if (ENABLE_DEBUG) {
-        std::stringstream str;
-        str << "Skipping " << str_decode_instr(&instr.instr) << " instruction. (BasicBlock #0x" << std::hex << bb->id << ", address <0x" << ip << ">)";
-        DEBUG_LOG(str.str());
+void Lifter::lift_fence(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip) {
+    // the instruction cache of x86 is coherent and a single thread can't observe the order of its own memory accesses
+    if (instr.instr.mnem == FRV_FENCEI || !multithreaded_guest) {
+        if (ENABLE_DEBUG) {
+            std::stringstream str;
+            str << "Skipping " << str_decode_instr(&instr.instr) << " instruction. (BasicBlock #0x" << std::hex << bb->id << ", address <0x" << ip << ">)";
+            DEBUG_LOG(str.str());
+        }
+        return;
     }
+
+    // the sets are in the immediate: fm (ignored, fence.tso is lifted as the fence rw, rw it implies), pred, succ.
+    // a fence without one of the sets is reserved and lifted like a full fence
+    auto pred = static_cast<uint8_t>((instr.instr.imm >> 4) & 0xF);
+    auto succ = static_cast<uint8_t>(instr.instr.imm & 0xF);
+    if (pred == 0 || succ == 0) {
+        pred = succ = 0xF;
+    }
+
+    SSAVar *result_memory_token = bb->add_var(Type::mt, ip, MEM_IDX);
+    auto operation = std::make_unique<Operation>(Instruction::fence);
+    operation->atomic_info.pred = pred;
+    operation->atomic_info.succ = succ;
+    operation->set_inputs(mapping[MEM_IDX]);
+    operation->set_outputs(result_memory_token);
+    result_memory_token->set_op(std::move(operation));
+
+    write_to_mapping(mapping, result_memory_token, MEM_IDX);
 }
@@ -2,6 +2,34 @@
 
 using namespace lifter::RV64;
 
+namespace {
+// the aq and rl bits of the instruction
+void set_ordering(Operation *op, const RV64Inst &instr) {
+    op->atomic_info.acquire = (instr.instr.misc & 2) != 0;
+    op->atomic_info.release = (instr.instr.misc & 1) != 0;
+}
+} // namespace
+
+void Lifter::write_amo_result(BasicBlock *bb, const RV64Inst &instr, Lifter::reg_map &mapping, uint64_t ip, SSAVar *result) {
+    SSAVar *write_back_result = result;
+
+    // extend the result ot 64bit to store it in the mapping (according to the definition of the amo instructions)
+    if (cast_dir(result->type, Type::i64) == 1) {
+        SSAVar *extended_result = bb->add_var(Type::i64, ip);
+        {
+            auto extend_operation = std::make_unique<Operation>(Instruction::sign_extend);
+            extend_operation->lifter_info.in_op_size = result->type;
+            extend_operation->set_inputs(result);
+            extend_operation->set_outputs(extended_result);
+            extended_result->set_op(std::move(extend_operation));
+        }
+        write_back_result = extended_result;
+    }
+
+    // write the [extended, if op_size == Type::i32] result to the mapping
+    write_to_mapping(mapping, write_back_result, instr.instr.rd);
+}
+
 SSAVar *Lifter::load_rs1_to_rd(BasicBlock *bb, const RV64Inst &instr, Lifter::reg_map &mapping, uint64_t ip, const Type op_size) {
     // no usage of "normal" load function in order to optimize
 
@@ -20,23 +48,7 @@ SSAVar *Lifter::load_rs1_to_rd(BasicBlock *bb, const RV64Inst &instr, Lifter::re
     // assign the operation as variable of the destination
     load_dest->set_op(std::move(operation));
 
-    SSAVar *write_back_result = load_dest;
-
-    // extend the result ot 64bit to store it in the mapping (according to the definition of the amo instructions)
-    if (cast_dir(op_size, Type::i64) == 1) {
-        SSAVar *extended_result = bb->add_var(Type::i64, ip);
-        {
-            auto extend_operation = std::make_unique<Operation>(Instruction::sign_extend);
-            extend_operation->lifter_info.in_op_size = load_dest->type;
-            extend_operation->set_inputs(load_dest);
-            extend_operation->set_outputs(extended_result);
-            extended_result->set_op(std::move(extend_operation));
-        }
-        write_back_result = extended_result;
-    }
-
-    // write the [extended, if op_size == Type::i32] result to the mapping
-    write_to_mapping(mapping, write_back_result, instr.instr.rd);
+    write_amo_result(bb, instr, mapping, ip, load_dest);
 
     // but return the [not extended] result. With op_size == Type::i32, we perform 32bit operations and therefore can use the not sign extended result.
     // And with op_size == Type::i64 the result is returned.
@@ -58,16 +70,80 @@ void Lifter::store_val_to_rs1(BasicBlock *bb, const RV64Inst &instr, Lifter::reg
     write_to_mapping(mapping, real_rs2_val, mod_instr.instr.rs2);
 }
 
-void Lifter::lift_amo_load_reserve(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, const Type op_size) { load_rs1_to_rd(bb, instr, mapping, ip, op_size); }
+void Lifter::lift_amo_load_reserve(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, const Type op_size) {
+    if (!multithreaded_guest) {
+        load_rs1_to_rd(bb, instr, mapping, ip, op_size);
+        return;
+    }
+
+    SSAVar *addr = get_from_mapping(bb, mapping, instr.instr.rs1, ip);
+    SSAVar *load_dest = bb->add_var(op_size, ip);
+    {
+        auto operation = std::make_unique<Operation>(Instruction::load_reserved);
+        operation->lifter_info.in_op_size = op_size;
+        set_ordering(operation.get(), instr);
+        operation->set_inputs(addr, mapping[MEM_IDX]);
+        operation->set_outputs(load_dest);
+        load_dest->set_op(std::move(operation));
+    }
+    write_amo_result(bb, instr, mapping, ip, load_dest);
+}
 
 void Lifter::lift_amo_store_conditional(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, const Type op_size) {
-    store_val_to_rs1(bb, instr, mapping, ip, op_size, get_from_mapping(bb, mapping, instr.instr.rs2, ip));
+    if (!multithreaded_guest) {
+        store_val_to_rs1(bb, instr, mapping, ip, op_size, get_from_mapping(bb, mapping, instr.instr.rs2, ip));
+
+        // if the operation succeeds (which it always does without other threads), 0 is placed into the destination register
+        write_to_mapping(mapping, bb->add_var_imm(0, ip), instr.instr.rd);
+        return;
+    }
+
+    // The reservation is the value the last load reserved of the thread loaded, the store succeeds if the memory still
+    // holds it. Unlike a real reservation, this doesn't notice if another thread stored the same value in the meantime.
+    SSAVar *addr = get_from_mapping(bb, mapping, instr.instr.rs1, ip);
+    SSAVar *val = get_from_mapping_and_shrink(bb, mapping, instr.instr.rs2, ip, op_size);
+
+    SSAVar *expected = bb->add_var(op_size, ip);
+    {
+        auto operation = std::make_unique<Operation>(Instruction::reservation);
+        operation->lifter_info.in_op_size = op_size;
+        operation->set_outputs(expected);
+        expected->set_op(std::move(operation));
+    }
 
-    // if the operation succeeds (which it always does without actual atomic operations), 0 is placed into the destination register
-    write_to_mapping(mapping, bb->add_var_imm(0, ip), instr.instr.rd);
+    // the cas is a store, so it produces a new memory token which orders the following memory operations after it
+    SSAVar *old_val = bb->add_var(op_size, ip);
+    SSAVar *result_memory_token = bb->add_var(Type::mt, ip, MEM_IDX);
+    {
+        auto operation = std::make_unique<Operation>(Instruction::cas);
+        operation->lifter_info.in_op_size = op_size;
+        set_ordering(operation.get(), instr);
+        operation->set_inputs(addr, expected, val, mapping[MEM_IDX]);
+        operation->set_outputs(old_val, result_memory_token);
+        old_val->set_op(std::move(operation));
+    }
+    write_to_mapping(mapping, result_memory_token, MEM_IDX);
+
+    // 0 if the value was stored, 1 otherwise
+    SSAVar *stored = load_immediate(bb, 0, ip, false);
+    SSAVar *not_stored = load_immediate(bb, 1, ip, false);
+    SSAVar *result = bb->add_var(Type::i64, ip, instr.instr.rd);
+    {
+        auto operation = std::make_unique<Operation>(Instruction::seq);
+        operation->lifter_info.in_op_size = op_size;
+        operation->set_inputs(old_val, expected, stored, not_stored);
+        operation->set_outputs(result);
+        result->set_op(std::move(operation));
+    }
+    write_to_mapping(mapping, result, instr.instr.rd);
 }
 
 void Lifter::lift_amo_swap(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, const Type op_size) {
+    if (multithreaded_guest) {
+        lift_amo_atomic(bb, instr, mapping, ip, Instruction::store, op_size);
+        return;
+    }
+
     // input1: rd, input2: rs2
     // this is up here so that when rs2 == rd, the call to load_rs1_to_rd doesn't override the value in rs2 as well
     SSAVar *in_2 = get_from_mapping(bb, mapping, instr.instr.rs2, ip);
@@ -79,6 +155,11 @@ void Lifter::lift_amo_swap(BasicBlock *bb, const RV64Inst &instr, reg_map &mappi
 }
 
 void Lifter::lift_amo_binary_op(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, const Instruction instruction_type, const Type op_size) {
+    if (multithreaded_guest) {
+        lift_amo_atomic(bb, instr, mapping, ip, instruction_type, op_size);
+        return;
+    }
+
     SSAVar *in_2 = get_from_mapping(bb, mapping, instr.instr.rs2, ip);
 
     // input1: rd, input2: rs2
@@ -101,3 +182,24 @@ void Lifter::lift_amo_binary_op(BasicBlock *bb, const RV64Inst &instr, reg_map &
     // sign extension for the operation result is not requried
     store_val_to_rs1(bb, instr, mapping, ip, op_size, op_result);
 }
+
+void Lifter::lift_amo_atomic(BasicBlock *bb, const RV64Inst &instr, reg_map &mapping, uint64_t ip, const Instruction rmw_op, const Type op_size) {
+    // both inputs are read before rd is written since it may be one of them
+    SSAVar *addr = get_from_mapping(bb, mapping, instr.instr.rs1, ip);
+    SSAVar *val = get_from_mapping_and_shrink(bb, mapping, instr.instr.rs2, ip, op_size);
+
+    // the operation owns both outputs through old_val, the memory token orders the following memory operations after it
+    SSAVar *old_val = bb->add_var(op_size, ip);
+    SSAVar *result_memory_token = bb->add_var(Type::mt, ip, MEM_IDX);
+    {
+        auto operation = std::make_unique<Operation>(Instruction::atomic_rmw);
+        operation->lifter_info.in_op_size = op_size;
+        operation->atomic_info.rmw_op = rmw_op;
+        set_ordering(operation.get(), instr);
+        operation->set_inputs(addr, val, mapping[MEM_IDX]);
+        operation->set_outputs(old_val, result_memory_token);
+        old_val->set_op(std::move(operation));
+    }
+    write_to_mapping(mapping, result_memory_token, MEM_IDX);
+    write_amo_result(bb, instr, mapping, ip, old_val);
+}
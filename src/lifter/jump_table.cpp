@@ -2,6 +2,63 @@
 
 using namespace lifter::RV64;
 
+namespace {
+// more entries than this are rather a bogus bound than a switch
+constexpr uint64_t MAX_JUMP_TABLE_ENTRIES = 0x10000;
+
+/* Number of valid indices if the block in front of the dispatch checks the index against a constant:
+ * "bgeu idx, N" -> "idx <u N", "bgtu idx, N - 1" -> "!(N - 1 <u idx)" and "sltiu t, idx, N" + "beqz t" -> "!(t == 0)".
+ * The translated dispatch checks the bound again, so the index doesn't need to be the one of the jump.
+ */
+std::optional<uint64_t> index_bound(const CfOp &check, const uint64_t dispatch_addr) {
+    if (check.type != CFCInstruction::cjump || check.lifter_info.index() != 1 || !check.in_vars[0] || !check.in_vars[1]) {
+        return std::nullopt;
+    }
+
+    // whether the dispatch is reached if the condition holds
+    const auto dispatch_if_true = std::get<CfOp::LifterInfo>(check.lifter_info).jump_addr == dispatch_addr;
+    const auto *lhs = check.in_vars[0].get();
+    const auto *rhs = check.in_vars[1].get();
+    std::optional<uint64_t> bound;
+    switch (std::get<CfOp::CJumpInfo>(check.info).type) {
+    case CfOp::CJumpInfo::CJumpType::lt:
+        if (dispatch_if_true && rhs->is_immediate()) {
+            bound = rhs->get_immediate().val;
+        } else if (!dispatch_if_true && lhs->is_immediate()) {
+            bound = lhs->get_immediate().val + 1;
+        }
+        break;
+    case CfOp::CJumpInfo::CJumpType::eq:
+        if (!dispatch_if_true && rhs->is_immediate() && rhs->get_immediate().val == 0) {
+            if (const auto *sltu = lhs->maybe_get_operation(); sltu && sltu->type == Instruction::sltu && sltu->in_vars[1]->is_immediate()) {
+                bound = sltu->in_vars[1]->get_immediate().val;
+            }
+        }
+        break;
+    default:
+        break;
+    }
+
+    if (!bound || *bound == 0 || *bound > MAX_JUMP_TABLE_ENTRIES) {
+        return std::nullopt;
+    }
+    return bound;
+}
+
+// whether [addr, addr + size) lies in a segment which isn't writable
+bool is_read_only(const ELF64File *elf, const uint64_t addr, const uint64_t size) {
+    if (!elf) {
+        return false;
+    }
+    for (const auto &phdr : elf->program_headers) {
+        if (phdr.p_type == PT_LOAD && addr >= phdr.p_vaddr && addr + size <= phdr.p_vaddr + phdr.p_filesz) {
+            return !(phdr.p_flags & PF_W);
+        }
+    }
+    return false;
+}
+} // namespace
+
 /* Jump tables are considered to be used by an ijump if the following operation
  * sequence is called: "x add a, b" -> "y load x, c" -> "x0 jalr y, 0"
  */
@@ -89,20 +146,23 @@ bool Lifter::is_jump_table_jump(const BasicBlock *bb, CfOp &cf_op, const RV64Ins
         return false;
     }
 
-    // the switch-condition integer is multiplied by this value to select the 4-byte wide addresses.
-    constexpr int64_t addr_step = 4;
+    // the switch-condition integer is multiplied by the size of the loaded addresses, only tables of words (lw) or
+    // doublewords (ld) are handled
+    const auto entry_type = loaded_addr_op->out_vars[0]->type;
+    if (entry_type != Type::i64 && entry_type != Type::i32) {
+        return false;
+    }
+    const int64_t addr_step = entry_type == Type::i64 ? 8 : 4;
 
     // find upper bound for jump table (might not succeed)
     // manually get basic block before current one because predecessors aren't yet resolved
-    BasicBlock *pred = get_bb(bb->virt_start_addr - 4);
-    if (pred && pred->control_flow_ops[0].type == CFCInstruction::cjump) {
-        auto &cf_op = pred->control_flow_ops[0];
-        for (SSAVar *in_var : cf_op.in_vars) {
-            if (in_var && std::holds_alternative<SSAVar::ImmInfo>(in_var->info)) {
-                jt_end_addr = jt_start_addr + addr_step * std::get<SSAVar::ImmInfo>(in_var->info).val;
-                break;
-            }
-        }
+    std::optional<uint64_t> entry_count;
+    const BasicBlock *pred = get_bb(bb->virt_start_addr - 4);
+    if (pred && !pred->control_flow_ops.empty()) {
+        entry_count = index_bound(pred->control_flow_ops[0], bb->virt_start_addr);
+    }
+    if (entry_count) {
+        jt_end_addr = jt_start_addr + addr_step * *entry_count;
     }
 
     // map jump table start and end address to indices in the prog->addr and prog->data array.
@@ -110,18 +170,21 @@ bool Lifter::is_jump_table_jump(const BasicBlock *bb, CfOp &cf_op, const RV64Ins
 
     auto next_addr = [prog, addr_step](size_t idx) -> uint64_t {
         uint64_t value_at_addr = 0;
-        for (size_t i = 0; i < addr_step; ++i) {
+        for (int64_t i = 0; i < addr_step; ++i) {
             // exit address joining if the entered start address is obviously incorrect. Returning 0 will completely stop the jump table parsing.
-            if (idx + i > prog->data.size() || !std::holds_alternative<uint8_t>(prog->data[idx + i])) {
+            if (idx + i >= prog->data.size() || !std::holds_alternative<uint8_t>(prog->data[idx + i])) {
                 return 0;
             }
-            value_at_addr |= std::get<uint8_t>(prog->data[idx + i]) << (i * 8);
+            value_at_addr |= static_cast<uint64_t>(std::get<uint8_t>(prog->data[idx + i])) << (i * 8);
         }
-        return value_at_addr;
+        // 32 bit entries are loaded with lw
+        return addr_step == 4 ? static_cast<uint64_t>(static_cast<int64_t>(static_cast<int32_t>(value_at_addr))) : value_at_addr;
     };
 
+    // the translated table mirrors the entries, every slot past the last valid one falls back to the address lookup
+    std::vector<uint64_t> entries;
     auto &jmp_addrs = cf_op.type == CFCInstruction::ijump ? std::get<CfOp::IJumpInfo>(cf_op.info).jmp_addrs : std::get<CfOp::ICallInfo>(cf_op.info).jmp_addrs;
-    for (size_t i = addr_start_idx;; i += addr_step) {
+    for (size_t i = addr_start_idx; i < prog->addrs.size(); i += addr_step) {
         if (jt_end_addr != 0 && prog->addrs[i] >= jt_end_addr) {
             break;
         }
@@ -129,13 +192,24 @@ bool Lifter::is_jump_table_jump(const BasicBlock *bb, CfOp &cf_op, const RV64Ins
         if (value_at_addr >= ir->virt_bb_start_addr && value_at_addr <= ir->virt_bb_end_addr) {
             needs_bb_start[(value_at_addr - ir->virt_bb_start_addr) / 2] = true;
             jmp_addrs.emplace_back(value_at_addr);
+            entries.emplace_back(value_at_addr & ~1ull);
         } else if (jt_end_addr == 0) {
             break;
+        } else {
+            entries.emplace_back(0);
         }
     }
 
     if (!jmp_addrs.empty()) {
         std::get<CfOp::LifterInfo>(cf_op.lifter_info).jump_addr = jmp_addrs.front();
     }
+
+    // the generator can only index a copy of the table if the guest can't change it
+    const auto table_size = entries.size() * addr_step;
+    if (cf_op.type == CFCInstruction::ijump && !entries.empty() && addr_start_idx < static_cast<ptrdiff_t>(prog->addrs.size()) && prog->addrs[addr_start_idx] == jt_start_addr &&
+        jt_addr_var->type == Type::i64 && is_read_only(prog->elf_base.get(), jt_start_addr, table_size)) {
+        std::get<CfOp::IJumpInfo>(cf_op.info).jump_table = CfOp::JumpTable{jt_start_addr, static_cast<size_t>(addr_step), std::move(entries)};
+        cf_op.in_vars[1] = jt_addr_var.get();
+    }
     return true;
 }
@@ -0,0 +1,110 @@
+#include <generator/syscall_ids.h>
+#include <lifter/lifter.h>
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <unordered_set>
+
+using namespace lifter::RV64;
+
+namespace {
+struct LibcRoutine {
+    const char *name;
+    LIBC_ROUTINE_ID id;
+};
+
+constexpr std::array<LibcRoutine, 6> LIBC_ROUTINES = {{
+    {"memcpy", LIBC_ROUTINE_ID::MEMCPY},
+    {"memset", LIBC_ROUTINE_ID::MEMSET},
+    {"memmove", LIBC_ROUTINE_ID::MEMMOVE},
+    {"strlen", LIBC_ROUTINE_ID::STRLEN},
+    {"strcmp", LIBC_ROUTINE_ID::STRCMP},
+    {"memchr", LIBC_ROUTINE_ID::MEMCHR},
+}};
+
+void print_skipped(const char *name, uint64_t addr, const char *reason) { std::cout << "Not substituting " << name << " at 0x" << std::hex << addr << std::dec << ": " << reason << '\n'; }
+} // namespace
+
+/* Replaces the entry blocks of recognised libc functions with a syscall cfop numbered with the LIBC_ROUTINE_ID of the
+ * function, followed by a return to ra. The generator turns it into a direct call of the native routine in the helper
+ * library. The arguments are passed in a0-a2 and the result is written to a0 which matches the RISC-V calling
+ * convention, so the callers don't need to be changed. The rest of the function stays in the IR since other blocks may
+ * still jump into it.
+ */
+void Lifter::substitute_libc_routines(const ELF64File *elf_base) {
+    std::unordered_set<uint64_t> substituted_addrs;
+
+    for (size_t sym_idx = 0; sym_idx < elf_base->symbols.size(); ++sym_idx) {
+        const auto &sym = elf_base->symbols[sym_idx];
+        if (ELF64_ST_TYPE(sym.st_info) != STT_FUNC || sym.st_value == 0) {
+            continue;
+        }
+
+        const auto &sym_name = elf_base->symbol_names[sym_idx];
+        const auto routine = std::find_if(LIBC_ROUTINES.begin(), LIBC_ROUTINES.end(), [&sym_name](const LibcRoutine &r) { return sym_name == r.name; });
+        if (routine == LIBC_ROUTINES.end() || substituted_addrs.find(sym.st_value) != substituted_addrs.end()) {
+            continue;
+        }
+
+        auto *bb = get_bb(sym.st_value);
+        if (!bb || bb->virt_start_addr != sym.st_value) {
+            print_skipped(routine->name, sym.st_value, "no basic block starts at the symbol");
+            continue;
+        }
+        if (sym.st_size == 0) {
+            print_skipped(routine->name, sym.st_value, "the symbol has no size");
+            continue;
+        }
+
+        // a jump back to the entry from inside the function would otherwise call the native routine again
+        const auto sym_end = sym.st_value + sym.st_size;
+        if (std::any_of(bb->predecessors.begin(), bb->predecessors.end(), [&sym, sym_end](const BasicBlock *pred) { return pred->virt_start_addr >= sym.st_value && pred->virt_start_addr < sym_end; })) {
+            print_skipped(routine->name, sym.st_value, "the function jumps back to its entry");
+            continue;
+        }
+
+        // clear the entry block
+        for (auto *succ : bb->successors) {
+            succ->predecessors.erase(std::remove(succ->predecessors.begin(), succ->predecessors.end(), bb), succ->predecessors.end());
+        }
+        bb->successors.clear();
+        bb->control_flow_ops.clear();
+        bb->inputs.clear();
+        while (!bb->variables.empty()) {
+            bb->variables.pop_back();
+        }
+        bb->cur_ssa_id = 0;
+
+        reg_map mapping{};
+        for (size_t i = 1; i < count_used_static_vars; ++i) {
+            mapping[i] = bb->add_var_from_static(i, sym.st_value);
+        }
+        auto *id_var = bb->add_var_imm(static_cast<int64_t>(routine->id), sym.st_value);
+
+        auto &cf_op = bb->add_cf_op(CFCInstruction::syscall, nullptr, sym.st_value);
+        cf_op.set_inputs(id_var, mapping[10], mapping[11], mapping[12]);
+        std::get<CfOp::SyscallInfo>(cf_op.info).static_mapping = {10};
+        for (size_t i = 1; i < count_used_static_vars; ++i) {
+            cf_op.add_target_input(mapping[i], i);
+        }
+
+        // return to the caller like the substituted function would
+        auto *ret_bb = ir->add_basic_block(0, std::string{routine->name} + "_subst_return");
+        for (size_t i = 1; i < count_used_static_vars; ++i) {
+            mapping[i] = ret_bb->add_var_from_static(i);
+        }
+        auto &ret_op = ret_bb->add_cf_op((optimizations & OPT_CALL_RET) ? CFCInstruction::_return : CFCInstruction::ijump, nullptr);
+        ret_op.set_inputs(mapping[LINK_IDX_1]);
+        for (size_t i = 1; i < count_used_static_vars; ++i) {
+            ret_op.add_target_input(mapping[i], i);
+        }
+
+        cf_op.set_target(ret_bb);
+        bb->successors.push_back(ret_bb);
+        ret_bb->predecessors.push_back(bb);
+
+        substituted_addrs.insert(sym.st_value);
+        std::cout << "Substituted " << routine->name << " at 0x" << std::hex << sym.st_value << std::dec << " with a native routine\n";
+    }
+}
@@ -355,6 +355,11 @@ void Lifter::postprocess(Program *prog) {
 
     // find more basic block entrypoints from ijumps
     process_ijumps(unprocessed_ijumps, prog->elf_base.get());
+    process_ijump_hints(prog);
+
+    if (optimizations & OPT_LIBC_SUBST) {
+        substitute_libc_routines(prog->elf_base.get());
+    }
 
     // add setup_stack block
     auto *program_entry = ir->basic_blocks[ir->entry_block].get();
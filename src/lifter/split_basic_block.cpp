@@ -261,6 +261,12 @@ BasicBlock *Lifter::split_basic_block(BasicBlock *bb, uint64_t addr, ELF64File *
         auto &cf_op = new_bb->control_flow_ops[i];
         cf_op.source = new_bb;
 
+        // the address of the jump table entry can't be recovered from the register mapping if it was computed before the split
+        if (cf_op.type == CFCInstruction::ijump && cf_op.in_vars[1] && std::get<SSAVar::LifterInfo>(cf_op.in_vars[1]->lifter_info).assign_addr < addr) {
+            std::get<CfOp::IJumpInfo>(cf_op.info).jump_table.reset();
+            cf_op.in_vars[1].reset(nullptr);
+        }
+
         for (auto &var : cf_op.in_vars) {
             if (!var) {
                 continue;
@@ -0,0 +1,101 @@
+#include "ir/ir.h"
+#include "lifter/lifter.h"
+
+#include "gtest/gtest.h"
+
+using namespace lifter::RV64;
+
+namespace lifter_test {
+
+class TestAmoLifting : public ::testing::Test {
+  public:
+    IR *ir;
+    Lifter *lifter;
+    BasicBlock *bb;
+    uint64_t virt_start_addr;
+    Lifter::reg_map mapping;
+
+    TestAmoLifting() {}
+
+    void SetUp() {
+        ir = new IR();
+        lifter = new Lifter(ir);
+        // the atomics are only lifted to atomic operations for multithreaded guests
+        lifter->multithreaded_guest = true;
+
+        lifter->add_statics();
+
+        virt_start_addr = random();
+        ir->setup_bb_addr_vec(virt_start_addr, virt_start_addr + 100);
+        bb = ir->add_basic_block(virt_start_addr);
+
+        mapping = {};
+        for (size_t i = 0; i < lifter->count_used_static_vars; i++) {
+            mapping[i] = bb->add_var_from_static(i, virt_start_addr);
+        }
+    }
+
+    void TearDown() {
+        delete lifter;
+        delete ir;
+    }
+
+    void verify() {
+        std::vector<std::string> messages;
+        bool valid = ir->verify(messages);
+        for (const auto &message : messages) {
+            std::cerr << message << '\n';
+        }
+        ASSERT_TRUE(valid) << "The IR has structural errors (see previous messages)";
+    }
+
+    Operation *find_op(const Instruction type) {
+        for (const auto &var : bb->variables) {
+            if (auto *op = var->maybe_get_operation(); op && op->type == type) {
+                return op;
+            }
+        }
+        return nullptr;
+    }
+
+    // lifts the atomic followed by lw x7, 0(x6) and checks that the load is ordered after the atomic
+    void test_load_after_atomic(const RV64Inst &atomic_instr, const Instruction atomic_type) {
+        SSAVar *prev_memory_token = mapping[Lifter::MEM_IDX];
+
+        lifter->parse_instruction(bb, atomic_instr, mapping, virt_start_addr, virt_start_addr + 4);
+        const RV64Inst load_instr{FrvInst{FRV_LW, 7, 6, 0, 0, 0, 0}, 4};
+        lifter->parse_instruction(bb, load_instr, mapping, virt_start_addr + 4, virt_start_addr + 8);
+
+        verify();
+
+        auto *atomic_op = find_op(atomic_type);
+        ASSERT_NE(atomic_op, nullptr) << "The atomic operation wasn't lifted!";
+        ASSERT_EQ(atomic_op->in_vars[atomic_type == Instruction::cas ? 3 : 2], prev_memory_token) << "The atomic doesn't depend on the previous memory token!";
+
+        auto *memory_token = atomic_op->out_vars[1];
+        ASSERT_NE(memory_token, nullptr) << "The atomic doesn't produce a memory token!";
+        ASSERT_EQ(memory_token->type, Type::mt) << "The second output of the atomic isn't a memory token!";
+        ASSERT_EQ(memory_token, mapping[Lifter::MEM_IDX]) << "The memory token of the atomic isn't written to the mapping!";
+
+        auto *load_op = find_op(Instruction::load);
+        ASSERT_NE(load_op, nullptr) << "The load wasn't lifted!";
+        ASSERT_EQ(load_op->in_vars[1], memory_token) << "The load doesn't depend on the memory token of the atomic!";
+    }
+};
+
+TEST_F(TestAmoLifting, test_load_after_amoadd) {
+    // amoadd.w x5, x6, (x6)
+    test_load_after_atomic(RV64Inst{FrvInst{FRV_AMOADDW, 5, 6, 6, 0, 0, 0}, 4}, Instruction::atomic_rmw);
+}
+
+TEST_F(TestAmoLifting, test_load_after_amoswap) {
+    // amoswap.d.aqrl x5, x8, (x6)
+    test_load_after_atomic(RV64Inst{FrvInst{FRV_AMOSWAPD, 5, 6, 8, 0, 3, 0}, 4}, Instruction::atomic_rmw);
+}
+
+TEST_F(TestAmoLifting, test_load_after_sc) {
+    // sc.w x5, x8, (x6)
+    test_load_after_atomic(RV64Inst{FrvInst{FRV_SCW, 5, 6, 8, 0, 0, 0}, 4}, Instruction::cas);
+}
+
+} // namespace lifter_test
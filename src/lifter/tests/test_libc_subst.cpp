@@ -0,0 +1,107 @@
+#include "elf.h"
+#include "generator/syscall_ids.h"
+#include "ir/basic_block.h"
+#include "ir/ir.h"
+#include "lifter/lifter.h"
+
+#include "gtest/gtest.h"
+#include <string>
+
+using namespace lifter::RV64;
+
+namespace {
+constexpr uint64_t FUNC_ADDR = 0x100;
+constexpr uint64_t FUNC_SIZE = 0x40;
+
+void verify_ir(IR *ir) {
+    std::vector<std::string> messages;
+    bool valid = ir->verify(messages);
+    for (const auto &message : messages) {
+        std::cerr << message << '\n';
+    }
+    ASSERT_TRUE(valid) << "The IR has structural errors (see error log)";
+}
+
+BasicBlock *add_block(IR &ir, const Lifter &lifter, uint64_t start_addr, uint64_t end_addr) {
+    auto *bb = ir.add_basic_block(start_addr);
+    bb->set_virt_end_addr(end_addr);
+    for (size_t i = 1; i < lifter.count_used_static_vars; ++i) {
+        bb->add_var_from_static(i, start_addr);
+    }
+    return bb;
+}
+
+void add_jump(BasicBlock *from, BasicBlock *to, CFCInstruction type = CFCInstruction::jump) {
+    auto &cf_op = from->add_cf_op(type, to);
+    for (auto *input : from->inputs) {
+        cf_op.add_target_input(input, std::get<size_t>(input->info));
+    }
+}
+
+void add_func_symbol(ELF64File &elf, const std::string &name) {
+    Elf64_Sym sym{};
+    sym.st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+    sym.st_value = FUNC_ADDR;
+    sym.st_size = FUNC_SIZE;
+    elf.symbols.push_back(sym);
+    elf.symbol_names.push_back(name);
+}
+} // namespace
+
+TEST(LIBC_SUBST_TEST, substitutes_entry) {
+    IR ir{};
+    ir.setup_bb_addr_vec(0, 0x300);
+    Lifter lifter{&ir, false, false, Lifter::OPT_CALL_RET | Lifter::OPT_LIBC_SUBST};
+    lifter.add_statics();
+
+    // caller -> memcpy entry -> memcpy body, the body returns
+    auto *caller = add_block(ir, lifter, 0x200, 0x204);
+    auto *entry = add_block(ir, lifter, FUNC_ADDR, FUNC_ADDR + 0xC);
+    auto *body = add_block(ir, lifter, FUNC_ADDR + 0x10, FUNC_ADDR + 0x3C);
+    add_jump(caller, entry, CFCInstruction::call);
+    add_jump(entry, body);
+    body->add_cf_op(CFCInstruction::unreachable, nullptr);
+
+    ELF64File elf{"test"};
+    add_func_symbol(elf, "memcpy");
+    lifter.substitute_libc_routines(&elf);
+    verify_ir(&ir);
+
+    ASSERT_EQ(entry->control_flow_ops.size(), 1);
+    const auto &cf_op = entry->control_flow_ops[0];
+    ASSERT_EQ(cf_op.type, CFCInstruction::syscall);
+    ASSERT_TRUE(cf_op.in_vars[0]->is_immediate());
+    ASSERT_EQ(cf_op.in_vars[0]->get_immediate().val, static_cast<int64_t>(LIBC_ROUTINE_ID::MEMCPY));
+    ASSERT_EQ(std::get<CfOp::SyscallInfo>(cf_op.info).static_mapping, std::vector<size_t>{10});
+
+    // the body isn't reachable from the entry anymore but stays in the IR
+    ASSERT_TRUE(body->predecessors.empty());
+    ASSERT_EQ(entry->predecessors, std::vector<BasicBlock *>{caller});
+
+    auto *ret_bb = cf_op.target();
+    ASSERT_NE(ret_bb, nullptr);
+    ASSERT_EQ(ret_bb->control_flow_ops.size(), 1);
+    ASSERT_EQ(ret_bb->control_flow_ops[0].type, CFCInstruction::_return);
+}
+
+TEST(LIBC_SUBST_TEST, keeps_loop_to_entry) {
+    IR ir{};
+    ir.setup_bb_addr_vec(0, 0x300);
+    Lifter lifter{&ir, false, false, Lifter::OPT_LIBC_SUBST};
+    lifter.add_statics();
+
+    // the function jumps back to its own entry, so it can't be replaced by a single call
+    auto *entry = add_block(ir, lifter, FUNC_ADDR, FUNC_ADDR + 0xC);
+    auto *body = add_block(ir, lifter, FUNC_ADDR + 0x10, FUNC_ADDR + 0x3C);
+    add_jump(entry, body);
+    add_jump(body, entry);
+
+    ELF64File elf{"test"};
+    add_func_symbol(elf, "strlen");
+    lifter.substitute_libc_routines(&elf);
+    verify_ir(&ir);
+
+    ASSERT_EQ(entry->control_flow_ops.size(), 1);
+    ASSERT_EQ(entry->control_flow_ops[0].type, CFCInstruction::jump);
+    ASSERT_EQ(entry->control_flow_ops[0].target(), body);
+}
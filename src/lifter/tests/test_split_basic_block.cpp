@@ -310,3 +310,51 @@ TEST(SPLIT_BASIC_BLOCK_TEST, test_big) {
 
     // ir.print(std::cout);
 }
+
+TEST(SPLIT_BASIC_BLOCK_TEST, test_ijump_hints) {
+    const size_t prog_start = 0;
+    const size_t prog_end = 100;
+
+    const size_t bb_start_addr = 8;
+    const size_t bb_end_addr = 16;
+
+    IR ir{};
+    ir.setup_bb_addr_vec(prog_start, prog_end);
+
+    Lifter lifter{&ir};
+
+    lifter.add_statics();
+
+    BasicBlock *block = ir.add_basic_block(bb_start_addr, "test_block_1");
+    block->set_virt_end_addr(bb_end_addr);
+
+    reg_map mapping{};
+    for (unsigned long i = 1; i < lifter.count_used_static_vars; i++) {
+        mapping[i] = block->add_var_from_static(i, bb_start_addr);
+    }
+
+    // instructions = (addi x2, x0, 50), (andi x3, x2, 16), (sub x2, x3, x2), followed by a data byte
+    RV64Inst instructions[3] = {RV64Inst{FrvInst{FRV_ADDI, 2, 0, 0, 0, 0, 50}, 4}, RV64Inst{FrvInst{FRV_ANDI, 3, 2, 0, 0, 0, 16}, 4}, RV64Inst{FrvInst{FRV_SUB, 2, 3, 2, 0, 0, 0}, 4}};
+
+    Program prog(std::unique_ptr<ELF64File>(nullptr));
+    uint64_t curr_ip = bb_start_addr;
+    for (RV64Inst &instr : instructions) {
+        lifter.parse_instruction(block, instr, mapping, curr_ip, curr_ip + 4);
+        prog.insert_value(curr_ip, instr);
+        curr_ip += 4;
+    }
+    prog.insert_value(curr_ip, static_cast<uint8_t>(0));
+
+    // only the hint at the second instruction is an instruction start, the others are in the middle of an instruction,
+    // data or outside of the program
+    lifter.ijump_hints = {14, 12, 20, 200};
+    lifter.process_ijump_hints(&prog);
+
+    verify(&ir);
+
+    ASSERT_EQ(block->successors.size(), 1) << "The hinted address must split the basic block!";
+    BasicBlock *second_block = block->successors[0];
+    ASSERT_EQ(second_block->virt_start_addr, 12) << "The second basic block must start at the hinted address!";
+    ASSERT_EQ(ir.basic_blocks.size(), 2) << "Only valid hints may split basic blocks!";
+    ASSERT_TRUE(second_block->gen_info.needs_trans_bb) << "Hinted basic blocks must be reachable through the ijump lookup!";
+}
@@ -1,5 +1,6 @@
 #include "argument_parser.h"
 #include "common/internal.h"
+#include "generator/x86_64/assembler.h"
 #include "generator/x86_64/generator.h"
 #include "ir/ir.h"
 #include "ir/optimizer/common.h"
@@ -9,6 +10,7 @@
 #include "lifter/elf_file.h"
 #include "lifter/lifter.h"
 
+#include <algorithm>
 #include <chrono>
 #include <csignal>
 #include <cstdio>
@@ -24,9 +26,13 @@ using std::filesystem::path;
 void print_help(bool usage_only);
 bool parse_opt_flags(const Args &args, uint32_t &gen_optimizations, uint32_t &lifter_optimizations, uint32_t &ir_optimizations);
 void dump_elf(const ELF64File *);
+void print_peephole_hits(const generator::x86_64::Generator &generator);
+bool parse_pinned_regs(std::string_view list, std::vector<size_t> &out_statics);
+bool parse_ijump_hints(const path &file, std::vector<uint64_t> &out_addrs);
 std::optional<path> create_temp_directory();
 bool find_runtime_dependencies(const path &exec_dir, const Args &args, path &out_helper_lib, path &out_linker_script);
 FILE *open_assembler(const path &output_file);
+bool write_internal_object(generator::x86_64::assembler::Assembler &assembler, const path &output_file);
 bool run_linker(const path &linker_script_file, const path &output_file, const path &translated_object, const path &helper_library);
 } // namespace
 
@@ -62,6 +68,54 @@ int main(int argc, const char **argv) {
         return EXIT_FAILURE;
     }
 
+    size_t thread_count = 0;
+    if (args.has_argument("threads")) {
+        const auto threads = std::string{args.get_argument("threads")};
+        char *end;
+        thread_count = std::strtoul(threads.c_str(), &end, 10);
+        if (threads.empty() || *end != '\0') {
+            std::cerr << "Invalid thread count: " << threads << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    auto reg_alloc_kind = generator::x86_64::Generator::RegAllocKind::GREEDY;
+    if (args.has_argument("regalloc")) {
+        const auto kind = args.get_argument("regalloc");
+        if (kind == "weighted") {
+            reg_alloc_kind = generator::x86_64::Generator::RegAllocKind::WEIGHTED_EVICTION;
+            // choosing an allocator implies register allocation
+            gen_optimizations |= generator::x86_64::Generator::OPT_MBRA;
+        } else if (kind != "greedy") {
+            std::cerr << "Unknown register allocator: " << kind << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    auto pinned_statics = std::vector<size_t>{};
+    auto pin_hot_regs = false;
+    if (args.has_argument("pin-regs")) {
+        const auto list = args.get_argument("pin-regs");
+        if (list == "auto") {
+            pin_hot_regs = true;
+        } else if (!parse_pinned_regs(list, pinned_statics)) {
+            return EXIT_FAILURE;
+        }
+        // pinning only works together with register allocation
+        gen_optimizations |= generator::x86_64::Generator::OPT_MBRA;
+    }
+
+    size_t peephole_window = 8;
+    if (args.has_argument("peephole-window")) {
+        const auto window = std::string{args.get_argument("peephole-window")};
+        char *end;
+        peephole_window = std::strtoul(window.c_str(), &end, 10);
+        if (window.empty() || *end != '\0') {
+            std::cerr << "Invalid peephole window: " << window << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
     path elf_path(args.positional[0]);
 
     std::cout << "Translating file " << elf_path << '\n';
@@ -114,6 +168,8 @@ int main(int argc, const char **argv) {
     }
 
     const bool interpreter_only = args.has_argument("interpreter-only") && (args.get_argument("interpreter-only") == "" || args.get_value_as_bool("interpreter-only"));
+    const bool multithreaded = args.has_argument("multithreaded") && (args.get_argument("multithreaded") == "" || args.get_value_as_bool("multithreaded"));
+    const bool count_stats = args.has_argument("stats") && (args.get_argument("stats") == "" || args.get_value_as_bool("stats"));
     const auto time_pre_lift = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
 
     Program prog(std::move(elf_file));
@@ -123,6 +179,10 @@ int main(int argc, const char **argv) {
     uint64_t time_post_lift;
     {
         auto lifter = lifter::RV64::Lifter(&ir, fp_support, interpreter_only, lifter_optimizations);
+        lifter.multithreaded_guest = multithreaded;
+        if (args.has_argument("ijump-hints") && !parse_ijump_hints(path(args.get_argument("ijump-hints")), lifter.ijump_hints)) {
+            return EXIT_FAILURE;
+        }
         lifter.lift(&prog);
         time_post_lift = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
     }
@@ -131,7 +191,14 @@ int main(int argc, const char **argv) {
 
     {
         if (ir_optimizations & optimizer::OPT_CONST_FOLDING) {
-            optimizer::const_fold(&ir);
+            // loads from segments the binary can't write to are constant
+            optimizer::ReadOnlyMemory ro_memory;
+            for (const auto &phdr : prog.elf_base->program_headers) {
+                if (phdr.p_type == PT_LOAD && !(phdr.p_flags & PF_W) && phdr.p_offset + phdr.p_filesz <= prog.elf_base->file_content.size()) {
+                    ro_memory.segments.push_back({phdr.p_vaddr, prog.elf_base->file_content.data() + phdr.p_offset, phdr.p_filesz});
+                }
+            }
+            optimizer::const_fold(&ir, &ro_memory);
         }
         if (ir_optimizations & optimizer::OPT_DCE) {
             optimizer::dce(&ir);
@@ -169,68 +236,84 @@ int main(int argc, const char **argv) {
     }
 
     auto output_object = temp_dir / "translated.o";
-    FILE *assembler = open_assembler(output_object);
-    if (!assembler) {
+    const bool external_as = args.has_argument("external-as") && (args.get_argument("external-as") == "" || args.get_value_as_bool("external-as"));
+    FILE *assembler = nullptr;
+    if (external_as && !(assembler = open_assembler(output_object))) {
         return EXIT_FAILURE;
     }
+
+    FILE *asm_out = nullptr;
+    std::string asm_file;
+    if (args.has_argument("asm-out")) {
+        asm_file = std::string{args.get_argument("asm-out")};
+        asm_out = fopen(asm_file.c_str(), "w");
+        if (!asm_out) {
+            std::cerr << "The assembly output couldn't be opened: " << std::strerror(errno) << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    // the generator hands its code to the built-in assembler, Intel syntax is only written for --asm-out or the external assembler
+    generator::x86_64::assembler::Assembler internal_as;
     uint64_t time_pre_gen, time_post_gen;
-    if (!args.has_argument("asm-out")) {
+    {
         time_pre_gen = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
-        generator::x86_64::Generator generator(&ir, binary_image_file.string(), assembler, interpreter_only);
+        generator::x86_64::Generator generator(&ir, binary_image_file.string(), asm_out ? asm_out : assembler, interpreter_only);
+        if (!external_as) {
+            generator.assembler = &internal_as;
+        }
         generator.optimizations = gen_optimizations;
         generator.ijump_hasher.optimizations = gen_optimizations;
+        generator.thread_count = thread_count;
+        generator.peephole_window = peephole_window;
+        generator.reg_alloc_kind = reg_alloc_kind;
+        generator.pinned_statics = pin_hot_regs ? generator.choose_pinned_statics() : pinned_statics;
+        generator.multithreaded_guest = multithreaded;
+        generator.count_stats = count_stats;
 
         generator.compile();
         time_post_gen = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
-    } else {
-        const auto asm_file = std::string{args.get_argument("asm-out")};
-        auto asm_out = fopen(asm_file.c_str(), "w");
-        if (!asm_out) {
-            std::cerr << "The assembly output couldn't be opened: " << std::strerror(errno) << "\n";
-            return EXIT_FAILURE;
-        }
+        print_peephole_hits(generator);
+    }
 
-        time_pre_gen = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
-        {
-            generator::x86_64::Generator generator(&ir, binary_image_file.string(), asm_out, interpreter_only);
-            generator.optimizations = gen_optimizations;
-            generator.ijump_hasher.optimizations = gen_optimizations;
+    // free memory
+    ir = {};
 
-            generator.compile();
-            time_post_gen = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
-        }
+    if (asm_out) {
         const auto file_size = ftell(asm_out);
         fclose(asm_out);
 
-        // free memory
-        ir = {};
-
-        asm_out = fopen(asm_file.c_str(), "r");
-        if (!asm_out) {
-            return EXIT_FAILURE;
-        }
-
-        const auto asm_out_fd = fileno(asm_out);
-        const auto assembler_fd = fileno(assembler);
-        auto bytes_left = file_size;
-        while (true) {
-            const auto res = splice(asm_out_fd, nullptr, assembler_fd, nullptr, bytes_left, 0);
-            if (res < 0) {
-                std::cerr << "Failed to assemble the binary: " << std::strerror(errno) << '\n';
+        if (external_as) {
+            asm_out = fopen(asm_file.c_str(), "r");
+            if (!asm_out) {
                 return EXIT_FAILURE;
             }
-            bytes_left -= res;
-            if (res == 0 || bytes_left == 0) {
-                break;
+
+            const auto asm_out_fd = fileno(asm_out);
+            const auto assembler_fd = fileno(assembler);
+            auto bytes_left = file_size;
+            while (true) {
+                const auto res = splice(asm_out_fd, nullptr, assembler_fd, nullptr, bytes_left, 0);
+                if (res < 0) {
+                    std::cerr << "Failed to assemble the binary: " << std::strerror(errno) << '\n';
+                    return EXIT_FAILURE;
+                }
+                bytes_left -= res;
+                if (res == 0 || bytes_left == 0) {
+                    break;
+                }
             }
+            fclose(asm_out);
         }
-
-        fclose(asm_out);
     }
 
-    auto asm_status = pclose(assembler);
-    if (asm_status != EXIT_SUCCESS) {
-        std::cerr << "Assembler failed with exit code " << asm_status << '\n';
+    if (external_as) {
+        auto asm_status = pclose(assembler);
+        if (asm_status != EXIT_SUCCESS) {
+            std::cerr << "Assembler failed with exit code " << asm_status << '\n';
+            return EXIT_FAILURE;
+        }
+    } else if (!write_internal_object(internal_as, output_object)) {
         return EXIT_FAILURE;
     }
 
@@ -257,9 +340,12 @@ void print_help(bool usage_only) {
         std::cerr << "    --debug:                  Enables debug logging (use --debug=false to prevent logging in debug builds)\n";
         std::cerr << "    --disable-fp:             Disables the support of floating point instructions.\n";
         std::cerr << "    --dump-elf:               Show information about the input file\n";
+        std::cerr << "    --external-as:            Pipe the generated Assembly through an external assembler instead of encoding it in-process\n";
         std::cerr << "    --full-backtracking:      Evaluates every possible input combination for indirect jump address backtracking.\n";
         std::cerr << "    --help:                   Shows this help message\n";
+        std::cerr << "    --ijump-hints:            Lift the indirect jump targets a translated binary recorded in this file (see SBT_IJUMP_HINTS) as additional entry points\n";
         std::cerr << "    --interpreter-only:       Only uses the interpreter to translate the binary (dynamic binary translation). (default: false)\n";
+        std::cerr << "    --multithreaded:          Keep the RISC-V registers per thread so the binary can create threads, they are addressed through fs, and translate the A extension and fences atomically (default: false)\n";
         std::cerr << "    --optimize:               Set optimization flags, comma-seperated list. Specifying a group enables all flags in that group. Appending '!' before disables a single flag\n";
         std::cerr << "    Optimization Flags:\n";
         std::cerr << "      - ir:\n";
@@ -274,18 +360,32 @@ void print_help(bool usage_only) {
         std::cerr << "          - fma3:                 Allow usage of instructions in the FMA3 set extension (fused multiply add)\n";
         std::cerr << "          - sse4:                 Allow usage of instructions in the SSE4 set extension, especially rounds[s|d]\n";
         std::cerr << "          - no_trans_bbs:         Register Allocation won't emit Translation Blocks (Should only be used with call_ret)\n";
+        std::cerr << "          - block_layout:         Order blocks along likely fall-through paths, align loop headers and move cold code into .text.cold\n";
+        std::cerr << "          - call_conv:            Pass ra, sp, s0 and a0-a7 in fixed registers across calls and returns (needs reg_alloc and call_ret)\n";
+        std::cerr << "          - static_liveness:      Skip writing back statics which are dead in all successors (whole-program liveness analysis)\n";
+        std::cerr << "          - peephole:             Run a peephole optimizer over the allocated instructions (dead moves, store-to-load forwarding, stack adjustments)\n";
+        std::cerr << "          - fuse_branches:        Branch directly on the flags of compares and arithmetic instead of materializing the condition (needs reg_alloc)\n";
+        std::cerr << "          - inline_cache:         Give every indirect jump, indirect call and return its own cache of recent targets before the shared lookup\n";
+        std::cerr << "          - jump_tables:          Dispatch recognised switch jump tables through a table of translated blocks instead of the lookup\n";
+        std::cerr << "          - inline_syscalls:      Issue syscalls with a constant number which the helper passes through unchanged with an inline `syscall` (not with --stats)\n";
         std::cerr << "      - lifter:\n";
         std::cerr << "          - call_ret:             Detect and replace RISC-V `call` and `return` instructions\n";
+        std::cerr << "          - libc_subst:           Replace memcpy, memset, memmove, strlen, strcmp and memchr with native SSE2 routines (needs symbols)\n";
         std::cerr << "          - no_hash_lookup        Do not use a hashtable for storing the lookup table\n";
         std::cerr << "    --output:                 Set the output file name (by default, the input file path suffixed with `.translated`)\n";
         std::cerr << "    --print-ir:               Prints a textual representation of the IR (if no file is specified, prints to standard out)\n";
+        std::cerr << "    --regalloc:               Register allocator used with reg_alloc: greedy (default, evicts the farthest next use) or weighted (evicts by live interval spill weights)\n";
+        std::cerr << "    --pin-regs:               Comma separated RISC-V registers (e.g. sp,ra,gp,tp) kept in r12-r15 by reg_alloc, or auto\n";
+        std::cerr << "    --peephole-window:        Number of instructions the peephole rules look ahead (default: 8)\n";
+        std::cerr << "    --stats:                  Count ijump lookups, mispredicted returns and rounding mode switches in the translated code so SBT_STATS can report them (default: false)\n";
+        std::cerr << "    --threads:                Number of threads used for compiling the register allocation groups (default: 0, one per core)\n";
         std::cerr << "    --helper-path:            Set the path to the runtime helper library\n";
         std::cerr << "    --linkerscript-path:      Set the path to the linker script\n";
         std::cerr << "                              (The above two are only required if the translator can't find these by itself)\n\n";
         std::cerr << "    --allow-inconsistency:    Allow inconsistencies in the IR (not recommended).\n";
         std::cerr << '\n';
         std::cerr << "Environment variables:\n";
-        std::cerr << "    AS: Override the assembler binary (by default, the system `as` is used)\n";
+        std::cerr << "    AS: Override the assembler binary used with --external-as (by default, the system `as` is used)\n";
         std::cerr << "    LD: Override the linker binary (by default, the system `ld` is used)\n";
     }
 }
@@ -338,6 +438,8 @@ bool parse_opt_flags(const Args &args, uint32_t &gen_optimizations, uint32_t &li
             gen_opt_change |= generator::x86_64::Generator::OPT_ARCH_SSE4;
         } else if (opt_flag == "call_ret") {
             lifter_opt_change = lifter::RV64::Lifter::OPT_CALL_RET;
+        } else if (opt_flag == "libc_subst") {
+            lifter_opt_change = lifter::RV64::Lifter::OPT_LIBC_SUBST;
         } else if (opt_flag == "dce") {
             ir_opt_change = optimizer::OPT_DCE;
         } else if (opt_flag == "const_folding") {
@@ -346,6 +448,22 @@ bool parse_opt_flags(const Args &args, uint32_t &gen_optimizations, uint32_t &li
             ir_opt_change = optimizer::OPT_DEDUP;
         } else if (opt_flag == "no_hash_lookup") {
             gen_opt_change = generator::x86_64::Generator::OPT_NO_HASH_LOOKUP;
+        } else if (opt_flag == "block_layout") {
+            gen_opt_change = generator::x86_64::Generator::OPT_BLOCK_LAYOUT;
+        } else if (opt_flag == "call_conv") {
+            gen_opt_change = generator::x86_64::Generator::OPT_CALL_CONV;
+        } else if (opt_flag == "static_liveness") {
+            gen_opt_change = generator::x86_64::Generator::OPT_STATIC_LIVENESS;
+        } else if (opt_flag == "peephole") {
+            gen_opt_change = generator::x86_64::Generator::OPT_PEEPHOLE;
+        } else if (opt_flag == "fuse_branches") {
+            gen_opt_change = generator::x86_64::Generator::OPT_FUSE_BRANCHES;
+        } else if (opt_flag == "inline_cache") {
+            gen_opt_change = generator::x86_64::Generator::OPT_INLINE_CACHE;
+        } else if (opt_flag == "jump_tables") {
+            gen_opt_change = generator::x86_64::Generator::OPT_JUMP_TABLES;
+        } else if (opt_flag == "inline_syscalls") {
+            gen_opt_change = generator::x86_64::Generator::OPT_INLINE_SYSCALLS;
         } else {
             std::cerr << "Warning: Unknown optimization flag: '" << opt_flag << "'\n";
             return false;
@@ -391,6 +509,86 @@ std::optional<path> create_temp_directory() {
     return full_path;
 }
 
+bool parse_pinned_regs(std::string_view list, std::vector<size_t> &out_statics) {
+    static constexpr std::array<std::string_view, 32> abi_names = {"zero", "ra", "sp", "gp", "tp",  "t0",  "t1", "t2", "s0", "s1", "a0",
+                                                                   "a1",   "a2", "a3", "a4", "a5",  "a6",  "a7", "s2", "s3", "s4", "s5",
+                                                                   "s6",   "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+    while (!list.empty()) {
+        const auto comma_pos = list.find(',');
+        auto name = list.substr(0, comma_pos);
+        list.remove_prefix(comma_pos == std::string_view::npos ? list.size() : comma_pos + 1);
+        if (name == "fp") {
+            name = "s0";
+        }
+
+        auto idx = static_cast<size_t>(std::find(abi_names.begin(), abi_names.end(), name) - abi_names.begin());
+        if (idx == abi_names.size() && name.size() > 1 && name[0] == 'x') {
+            const auto num = std::string{name.substr(1)};
+            char *end;
+            idx = std::strtoul(num.c_str(), &end, 10);
+            if (*end != '\0') {
+                idx = abi_names.size();
+            }
+        }
+        // x0 is hardwired to zero
+        if (idx == 0 || idx >= abi_names.size()) {
+            std::cerr << "Invalid register to pin: " << name << "\n";
+            return false;
+        }
+        if (std::find(out_statics.begin(), out_statics.end(), idx) == out_statics.end()) {
+            out_statics.push_back(idx);
+        }
+    }
+
+    if (out_statics.size() > generator::x86_64::Generator::pinned_regs.size()) {
+        std::cerr << "At most " << generator::x86_64::Generator::pinned_regs.size() << " registers can be pinned\n";
+        return false;
+    }
+    return true;
+}
+
+/* The helper appends "<address> <count>" lines in hex for every address it had to interpret, an address can appear
+ * in multiple lines if the file collected several runs. */
+bool parse_ijump_hints(const path &file, std::vector<uint64_t> &out_addrs) {
+    std::ifstream in(file);
+    if (!in) {
+        std::cerr << "The indirect jump hints file " << file << " could not be opened\n";
+        return false;
+    }
+
+    std::string line;
+    size_t line_num = 0;
+    while (std::getline(in, line)) {
+        ++line_num;
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        char *end;
+        const uint64_t addr = std::strtoull(line.c_str(), &end, 16);
+        if (end == line.c_str() || (*end != '\0' && *end != ' ')) {
+            std::cerr << "Invalid indirect jump hint in line " << line_num << ": " << line << "\n";
+            return false;
+        }
+        out_addrs.push_back(addr);
+    }
+
+    std::sort(out_addrs.begin(), out_addrs.end());
+    out_addrs.erase(std::unique(out_addrs.begin(), out_addrs.end()), out_addrs.end());
+    return true;
+}
+
+void print_peephole_hits(const generator::x86_64::Generator &generator) {
+    if (!(generator.optimizations & generator::x86_64::Generator::OPT_PEEPHOLE)) {
+        return;
+    }
+
+    std::cout << "Peephole hits:\n";
+    for (size_t rule = 0; rule < generator::x86_64::peephole::RULE_COUNT; ++rule) {
+        std::cout << "  " << generator::x86_64::peephole::rule_names[rule] << ": " << generator.peephole_hits[rule] << '\n';
+    }
+}
+
 bool find_runtime_dependencies(const path &exec_dir, const Args &args, path &out_helper_lib, path &out_linker_script) {
     if (args.has_argument("helper-path")) {
         out_helper_lib = path(args.get_argument("helper-path"));
@@ -458,6 +656,22 @@ FILE *open_assembler(const path &output_file) {
     return assembler;
 }
 
+bool write_internal_object(generator::x86_64::assembler::Assembler &assembler, const path &output_file) {
+    if (!assembler.finish()) {
+        for (const auto &error : assembler.errors) {
+            std::cerr << "Assembler: " << error << '\n';
+        }
+        std::cerr << "The built-in assembler failed, try using --external-as\n";
+        return false;
+    }
+
+    if (!assembler.write_object(output_file.string())) {
+        std::cerr << "Failed to write the translated object: " << std::strerror(errno) << '\n';
+        return false;
+    }
+    return true;
+}
+
 bool run_linker(const path &linker_script_file, const path &output_file, const path &translated_object, const path &helper_library) {
     const char *ld = get_binary("LD", "ld");
 
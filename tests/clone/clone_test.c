@@ -0,0 +1,110 @@
+#define _GNU_SOURCE
+#include <linux/futex.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define STACK_SIZE (64 * 1024)
+#define HELD_VALUE 0x5eed1234abcdUL
+#define SHORT_LIVED_THREADS 4096
+
+static uint64_t child_value;
+
+/* Clones a thread which stores s1 to child_value and exits. s1 is held in a register across the ecall in both threads,
+ * the child runs on an empty stack so it doesn't return from the inline assembly. */
+uint64_t clone_with_held_register(uint8_t *stack_top) {
+    register uint64_t a0 asm("a0") = CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD | CLONE_SYSVSEM;
+    register uint64_t a1 asm("a1") = (uint64_t)stack_top;
+    register uint64_t a2 asm("a2") = 0;
+    register uint64_t a3 asm("a3") = 0;
+    register uint64_t a4 asm("a4") = 0;
+    register uint64_t held asm("s1") = HELD_VALUE;
+    register uint64_t *out asm("s2") = &child_value;
+    __asm__ __volatile__("li a7, 220\n"
+                         "ecall\n"
+                         "bnez a0, 1f\n"
+                         "sd s1, 0(s2)\n"
+                         "li a0, 0\n"
+                         "li a7, 93\n"
+                         "ecall\n"
+                         "1:\n"
+                         : "+r"(a0), "+r"(held)
+                         : "r"(a1), "r"(a2), "r"(a3), "r"(a4), "r"(out)
+                         : "a7", "memory");
+    if ((int64_t)a0 < 0) {
+        printf("clone failed: %ld\n", (int64_t)a0);
+        exit(1);
+    }
+    return held;
+}
+
+/* Clones a thread which exits right away and waits for it through the futex the kernel clears when it is gone */
+void run_short_lived_thread(uint8_t *stack_top) {
+    static volatile int child_tid;
+    register uint64_t a0 asm("a0") = CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD | CLONE_SYSVSEM | CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID;
+    register uint64_t a1 asm("a1") = (uint64_t)stack_top;
+    register uint64_t a2 asm("a2") = (uint64_t)&child_tid;
+    register uint64_t a3 asm("a3") = 0;
+    register uint64_t a4 asm("a4") = (uint64_t)&child_tid;
+    __asm__ __volatile__("li a7, 220\n"
+                         "ecall\n"
+                         "bnez a0, 1f\n"
+                         "li a7, 93\n"
+                         "ecall\n"
+                         "1:\n"
+                         : "+r"(a0)
+                         : "r"(a1), "r"(a2), "r"(a3), "r"(a4)
+                         : "a7", "memory");
+    if ((int64_t)a0 < 0) {
+        printf("clone failed: %ld\n", (int64_t)a0);
+        exit(1);
+    }
+
+    int tid;
+    while ((tid = child_tid) != 0) {
+        register uint64_t f0 asm("a0") = (uint64_t)&child_tid;
+        register uint64_t f1 asm("a1") = FUTEX_WAIT;
+        register uint64_t f2 asm("a2") = tid;
+        register uint64_t f3 asm("a3") = 0;
+        __asm__ __volatile__("li a7, 98\n"
+                             "ecall\n"
+                             : "+r"(f0)
+                             : "r"(f1), "r"(f2), "r"(f3)
+                             : "a7", "memory");
+    }
+}
+
+/* size of the address space in KiB */
+long vm_size() {
+    char line[256];
+    long size = -1;
+    FILE *status = fopen("/proc/self/status", "r");
+    while (status && fgets(line, sizeof(line), status)) {
+        if (strncmp(line, "VmSize:", 7) == 0) {
+            size = strtol(line + 7, NULL, 10);
+        }
+    }
+    if (status) {
+        fclose(status);
+    }
+    return size;
+}
+
+int main() {
+    uint8_t *stack = malloc(STACK_SIZE);
+    const uint64_t held = clone_with_held_register(stack + STACK_SIZE);
+    while (__atomic_load_n(&child_value, __ATOMIC_ACQUIRE) == 0)
+        ;
+    printf("parent: %lx\n", held);
+    printf("child: %lx\n", child_value);
+
+    // the stacks of exited threads are reused, thousands of them would take gigabytes of address space otherwise
+    const long size_before = vm_size();
+    for (int i = 0; i < SHORT_LIVED_THREADS; ++i) {
+        run_short_lived_thread(stack + STACK_SIZE);
+    }
+    printf("short lived threads reuse their stacks: %d\n", vm_size() - size_before < 64 * 1024);
+    return 0;
+}
@@ -0,0 +1,65 @@
+#!/bin/bash
+
+if [ "$#" -ne 1 ]
+then
+  echo "Usage: ${0} <path_to_riscv_gcc>"
+  exit 1
+fi
+
+TXT_BLUE="\e[36m"
+TXT_CLEAR="\e[0m"
+
+cd "${0%/*}"
+
+echo -e "${TXT_BLUE}Cleaning up leftovers...${TXT_CLEAR}"
+
+set -x
+
+rm -f clone_test translated opt_translated pinned_translated interpreter test_results.txt opt_test_results.txt pinned_test_results.txt interpreter_test_results.txt
+
+{ set +x; } 2>/dev/null
+set -e
+
+echo -e "${TXT_BLUE}Building...${TXT_CLEAR}"
+
+$1 -g -static -O2 -o clone_test clone_test.c -Wall -Wextra -Werror
+
+{ set +x; } 2>/dev/null
+
+echo -e "${TXT_BLUE}Translating...${TXT_CLEAR}"
+
+set -x
+
+../../build/src/translate --debug=false --multithreaded --output=translated clone_test
+../../build/src/translate --debug=false --multithreaded --output=opt_translated --optimize=all clone_test
+# s1 and s2 stay in host registers across the clone
+../../build/src/translate --debug=false --multithreaded --output=pinned_translated --optimize=all --pin-regs=s1,s2 clone_test
+../../build/src/translate --debug=false --multithreaded --output=interpreter --interpreter-only clone_test
+
+{ set +x; } 2>/dev/null
+
+
+echo -e "${TXT_BLUE}Testing for the right result...${TXT_CLEAR}"
+
+set -x
+
+./translated > test_results.txt
+./opt_translated > opt_test_results.txt
+./pinned_translated > pinned_test_results.txt
+./interpreter > interpreter_test_results.txt
+cmp correct_results.txt test_results.txt
+cmp correct_results.txt opt_test_results.txt
+cmp correct_results.txt pinned_test_results.txt
+cmp correct_results.txt interpreter_test_results.txt
+
+{ set +x; } 2>/dev/null
+
+echo -e "${TXT_BLUE}Successfully run the clone test!${TXT_CLEAR}"
+echo -e "${TXT_BLUE}Cleaning up...${TXT_CLEAR}"
+
+set -x
+
+rm clone_test translated opt_translated pinned_translated interpreter test_results.txt opt_test_results.txt pinned_test_results.txt interpreter_test_results.txt
+
+{ set +x; } 2>/dev/null
+exit 0
@@ -16,7 +16,7 @@ echo -e "${TXT_BLUE}Cleaning up leftovers...${TXT_CLEAR}"
 set -x
 
 rm -rf build_amd64 build_rv64
-rm amd64_mandelbrot.txt amd64_mandelbrot_fma.txt rv64_mandelbrot.txt optimized_mandelbrot.txt interpreter_mandelbrot.txt fma3_optimized_mandelbrot.txt
+rm amd64_mandelbrot.txt amd64_mandelbrot_fma.txt rv64_mandelbrot.txt optimized_mandelbrot.txt weighted_mandelbrot.txt interpreter_mandelbrot.txt fma3_optimized_mandelbrot.txt
 
 { set +x; } 2>/dev/null
 set -e
@@ -41,6 +41,7 @@ set -x
 
 ../../../build/src/translate --debug=false --output=translated mandelbrot
 ../../../build/src/translate --debug=false --output=optimized mandelbrot --optimize=all,!fma3 # dont use fma3 due to rounding issues and x86_64 also doesn't use it
+../../../build/src/translate --debug=false --output=weighted mandelbrot --optimize=all,!fma3 --regalloc=weighted
 ../../../build/src/translate --debug=false --output=fma3_optimized mandelbrot --optimize=all # use fma3 for comparison to x86_64 with fma
 ../../../build/src/translate --debug=false --output=interpreter mandelbrot --interpreter-only
 
@@ -55,11 +56,13 @@ build_amd64/mandelbrot > amd64_mandelbrot.txt
 build_amd64/mandelbrot_fma > amd64_mandelbrot_fma.txt
 build_rv64/translated > rv64_mandelbrot.txt
 build_rv64/optimized > optimized_mandelbrot.txt
+build_rv64/weighted > weighted_mandelbrot.txt
 build_rv64/fma3_optimized > fma3_optimized_mandelbrot.txt
 build_rv64/interpreter > interpreter_mandelbrot.txt
 
 cmp amd64_mandelbrot.txt rv64_mandelbrot.txt
 cmp amd64_mandelbrot.txt optimized_mandelbrot.txt
+cmp amd64_mandelbrot.txt weighted_mandelbrot.txt
 cmp amd64_mandelbrot_fma.txt fma3_optimized_mandelbrot.txt
 cmp amd64_mandelbrot_fma.txt interpreter_mandelbrot.txt
 
@@ -71,7 +74,7 @@ echo -e "${TXT_BLUE}Cleaning up...${TXT_CLEAR}"
 set -x
 
 rm -rf build_amd64 build_rv64
-rm amd64_mandelbrot.txt amd64_mandelbrot_fma.txt rv64_mandelbrot.txt optimized_mandelbrot.txt interpreter_mandelbrot.txt fma3_optimized_mandelbrot.txt
+rm amd64_mandelbrot.txt amd64_mandelbrot_fma.txt rv64_mandelbrot.txt optimized_mandelbrot.txt weighted_mandelbrot.txt interpreter_mandelbrot.txt fma3_optimized_mandelbrot.txt
 
 { set +x; } 2>/dev/null
 exit 0
@@ -38,6 +38,9 @@ set -x
 cd build_rv64
 ../../../build/src/translate --debug=false --output=translated main --disable-fp
 ../../../build/src/translate --debug=false --output=optimized main --disable-fp --optimize=all
+# only the register call convention on top of the register allocation, main, zip and miniz make a lot of calls
+../../../build/src/translate --debug=false --output=call_conv main --disable-fp --optimize=reg_alloc,call_ret,call_conv
+../../../build/src/translate --debug=false --output=weighted main --disable-fp --optimize=all --regalloc=weighted
 ../../../build/src/translate --debug=false --output=interpreter main --disable-fp --interpreter-only
 
 { set +x; } 2>/dev/null
@@ -48,10 +51,14 @@ set -x
 ./build_rv64/translated test_trans.zip main.c miniz.h zip.c zip.h
 ./build_rv64/interpreter test_interpreter.zip main.c miniz.h zip.c zip.h
 ./build_rv64/optimized test_opt.zip main.c miniz.h zip.c zip.h
+./build_rv64/call_conv test_call_conv.zip main.c miniz.h zip.c zip.h
+./build_rv64/weighted test_weighted.zip main.c miniz.h zip.c zip.h
 
 cmp test_amd64.zip test_trans.zip
 cmp test_amd64.zip test_interpreter.zip
 cmp test_amd64.zip test_opt.zip
+cmp test_amd64.zip test_call_conv.zip
+cmp test_amd64.zip test_weighted.zip
 
 { set +x; } 2>/dev/null
 echo -e "${TXT_GREEN}Testing if x86 and translated binaries produce same content when extracting${TXT_CLEAR}"
@@ -60,6 +67,8 @@ set -x
 ./build_rv64/translated -e test_trans.zip test_trans
 ./build_rv64/interpreter -e test_interpreter.zip test_interpreter
 ./build_rv64/optimized -e test_opt.zip test_opt
+./build_rv64/call_conv -e test_call_conv.zip test_call_conv
+./build_rv64/weighted -e test_weighted.zip test_weighted
 
 cmp test_amd64/main.c test_trans/main.c
 cmp test_amd64/miniz.h test_trans/miniz.h
@@ -76,6 +85,16 @@ cmp test_amd64/miniz.h test_opt/miniz.h
 cmp test_amd64/zip.c test_opt/zip.c
 cmp test_amd64/zip.h test_opt/zip.h
 
+cmp test_amd64/main.c test_call_conv/main.c
+cmp test_amd64/miniz.h test_call_conv/miniz.h
+cmp test_amd64/zip.c test_call_conv/zip.c
+cmp test_amd64/zip.h test_call_conv/zip.h
+
+cmp test_amd64/main.c test_weighted/main.c
+cmp test_amd64/miniz.h test_weighted/miniz.h
+cmp test_amd64/zip.c test_weighted/zip.c
+cmp test_amd64/zip.h test_weighted/zip.h
+
 { set +x; } 2>/dev/null
 echo -e "${TXT_GREEN}Successfully tested the ZIP-Utility!${TXT_CLEAR}"
 echo -e "${TXT_GREEN}Cleaning up...${TXT_CLEAR}"
@@ -86,10 +105,14 @@ rm -rf test_amd64
 rm -rf test_trans
 rm -rf test_interpreter
 rm -rf test_opt
+rm -rf test_call_conv
+rm -rf test_weighted
 rm test_amd64.zip
 rm test_trans.zip
 rm test_interpreter.zip
 rm test_opt.zip
+rm test_call_conv.zip
+rm test_weighted.zip
 
 { set +x; } 2>/dev/null
 exit 0